@@ -0,0 +1,223 @@
+/**
+ * @file http_range.h
+ * @brief Range, ETag and conditional request helpers for file downloads
+ *
+ * Plain C++ (no Arduino types) so the decisions can be checked on a host.
+ * Only single byte ranges are served; a multi-range request gets the whole
+ * file, which RFC 9110 allows.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define HTTP_RANGE_NONE 0
+#define HTTP_RANGE_PARTIAL 1
+#define HTTP_RANGE_UNSATISFIABLE 2
+
+/**
+ * @brief Parse a decimal number, advancing p
+ *
+ * @param p
+ * @param value
+ * @return true if at least one digit was read
+ */
+static inline bool httpParseNumber(const char *&p, uint64_t &value)
+{
+  if (!isdigit((unsigned char)*p))
+    return false;
+
+  value = 0;
+  while (isdigit((unsigned char)*p))
+  {
+    if (value < 0xFFFFFFFFFFull)
+      value = value * 10 + (*p - '0');
+    p++;
+  }
+  return true;
+}
+
+/**
+ * @brief Evaluate a Range header against a file size
+ *
+ * @param value -> Range header value ("bytes=0-499", "bytes=500-", "bytes=-500")
+ * @param size -> File size
+ * @param start -> First byte to send (HTTP_RANGE_PARTIAL)
+ * @param length -> Bytes to send (HTTP_RANGE_PARTIAL)
+ * @return HTTP_RANGE_NONE (send 200 with the whole file), HTTP_RANGE_PARTIAL (206)
+ *         or HTTP_RANGE_UNSATISFIABLE (416)
+ */
+static inline int httpParseRange(const char *value, uint32_t size, uint32_t &start, uint32_t &length)
+{
+  if (value == nullptr)
+    return HTTP_RANGE_NONE;
+
+  const char *p = value;
+  while (*p == ' ')
+    p++;
+  if (strncasecmp(p, "bytes", 5) != 0)
+    return HTTP_RANGE_NONE;
+  p += 5;
+  while (*p == ' ')
+    p++;
+  if (*p != '=')
+    return HTTP_RANGE_NONE;
+  p++;
+  while (*p == ' ')
+    p++;
+
+  uint64_t first = 0;
+  uint64_t last = 0;
+  bool hasFirst = httpParseNumber(p, first);
+  if (*p != '-')
+    return HTTP_RANGE_NONE;
+  p++;
+  bool hasLast = httpParseNumber(p, last);
+
+  while (*p == ' ')
+    p++;
+  // Syntax errors and multiple ranges are ignored
+  if (*p != 0 || (!hasFirst && !hasLast))
+    return HTTP_RANGE_NONE;
+
+  if (!hasFirst)
+  {
+    // Suffix: the last "last" bytes
+    if (last == 0 || size == 0)
+      return HTTP_RANGE_UNSATISFIABLE;
+    if (last > size)
+      last = size;
+    start = size - (uint32_t)last;
+    length = (uint32_t)last;
+    return HTTP_RANGE_PARTIAL;
+  }
+
+  if (hasLast && last < first)
+    return HTTP_RANGE_NONE;
+  if (first >= size)
+    return HTTP_RANGE_UNSATISFIABLE;
+  if (!hasLast || last >= size)
+    last = size - 1;
+
+  start = (uint32_t)first;
+  length = (uint32_t)(last - first + 1);
+  return HTTP_RANGE_PARTIAL;
+}
+
+/**
+ * @brief Strong ETag from the file size and its FAT modification stamp
+ *
+ * @param out -> At least 24 bytes
+ * @param cap
+ * @param size
+ * @param fatDate
+ * @param fatTime
+ */
+static inline void httpETag(char *out, size_t cap, uint32_t size, uint16_t fatDate, uint16_t fatTime)
+{
+  snprintf(out, cap, "\"%lx-%x%04x\"", (unsigned long)size, fatDate, fatTime);
+}
+
+/**
+ * @brief IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") from a FAT date and time
+ *
+ * FAT stamps carry no time zone; they are reported as GMT.
+ *
+ * @param out -> At least 30 bytes
+ * @param cap
+ * @param fatDate
+ * @param fatTime
+ * @return false if the file has no date
+ */
+static inline bool httpDate(char *out, size_t cap, uint16_t fatDate, uint16_t fatTime)
+{
+  static const char *days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+  static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+  int year = 1980 + (fatDate >> 9);
+  int month = (fatDate >> 5) & 0x0F;
+  int day = fatDate & 0x1F;
+  if (fatDate == 0 || month < 1 || month > 12 || day < 1)
+    return false;
+
+  // Day of the week (Sakamoto)
+  static const int t[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+  int y = year - (month < 3);
+  int wday = (y + y / 4 - y / 100 + y / 400 + t[month - 1] + day) % 7;
+
+  snprintf(out, cap, "%s, %02d %s %04d %02d:%02d:%02d GMT", days[wday], day, months[month - 1], year,
+           fatTime >> 11, (fatTime >> 5) & 0x3F, (fatTime & 0x1F) * 2);
+  return true;
+}
+
+/**
+ * @brief If-None-Match check (weak comparison)
+ *
+ * @param list -> Header value: "*" or a comma separated list of tags
+ * @param etag -> Current tag, quoted
+ * @return true if the client copy is current (answer 304)
+ */
+static inline bool httpETagListMatches(const char *list, const char *etag)
+{
+  if (list == nullptr)
+    return false;
+
+  size_t tagLen = strlen(etag);
+  const char *p = list;
+  while (*p)
+  {
+    while (*p == ' ' || *p == ',')
+      p++;
+    if (*p == '*')
+      return true;
+    if (p[0] == 'W' && p[1] == '/')
+      p += 2;
+
+    const char *end = p;
+    if (*end == '"')
+    {
+      end = strchr(end + 1, '"');
+      if (end == nullptr)
+        return false;
+      end++;
+    }
+    else
+    {
+      while (*end && *end != ',' && *end != ' ')
+        end++;
+    }
+
+    if ((size_t)(end - p) == tagLen && memcmp(p, etag, tagLen) == 0)
+      return true;
+    if (end == p)
+      break;
+    p = end;
+  }
+  return false;
+}
+
+/**
+ * @brief If-Range check
+ *
+ * An entity tag must match strongly; a date must be the exact Last-Modified
+ * value that was sent.
+ *
+ * @param value -> Header value
+ * @param etag
+ * @param lastModified -> Empty if the file has no date
+ * @return true if the range can be honoured, false to send the whole file
+ */
+static inline bool httpIfRangeMatches(const char *value, const char *etag, const char *lastModified)
+{
+  if (value == nullptr)
+    return true;
+  if (value[0] == 'W' && value[1] == '/')
+    return false;
+  if (value[0] == '"')
+    return strcmp(value, etag) == 0;
+  return lastModified[0] != 0 && strcmp(value, lastModified) == 0;
+}
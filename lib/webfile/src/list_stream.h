@@ -0,0 +1,362 @@
+/**
+ * @file list_stream.h
+ * @brief Streamed directory listing for /listfiles (HTML pages and JSON cursor)
+ *
+ * Plain C++ (no Arduino types) so the listing can be benchmarked on a host
+ * (test/test_listing). The platform clock and free heap are hooks in the
+ * stream state; webserver.h fills them with micros() and ESP.getFreeHeap().
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "DirIndex.h"
+#include "ThumbCache.h"
+
+/**
+ * @brief Largest single row of a streamed listing
+ *
+ * A 255 char name appears three times plus once URL-encoded.
+ */
+#define LIST_ROW_MAX 2560
+
+/**
+ * @brief Default and maximum page size of the JSON listing
+ */
+#define LIST_JSON_LIMIT 50
+#define LIST_JSON_LIMIT_MAX 500
+
+/**
+ * @brief Directory listing counters (/webstats)
+ *
+ */
+struct tListStats
+{
+  uint32_t responses = 0;
+  uint32_t lastEntries = 0;
+  uint32_t lastBytes = 0;
+  uint32_t lastTtfbUs = 0;   // handler entry to first chunk
+  uint32_t lastTotalUs = 0;  // handler entry to last chunk
+  uint32_t lastHeapUsed = 0; // free heap at entry minus the lowest seen while streaming
+  uint32_t maxHeapUsed = 0;
+};
+tListStats listStats;
+
+/**
+ * @brief State of one streamed listing
+ *
+ * Rows are formatted one at a time into row[] and copied into the TCP send
+ * window by the chunk callback, so memory stays bounded whatever the
+ * directory size. The directory snapshot is held until the response ends.
+ */
+struct tListStream
+{
+  tDirListPtr list;
+  bool json = false;
+  int stage = 0;
+  int page = 0;
+  int first = 0;
+  int end = 0;
+  int i = 0;
+  uint32_t gen = 0;
+
+  size_t len = 0;
+  size_t pos = 0;
+
+  uint32_t t0 = 0;
+  uint32_t bytes = 0;
+  uint32_t heap0 = 0;
+  uint32_t heapMin = 0;
+  bool started = false;
+
+  // Directory shown in the header, and the clock and free heap of the platform
+  char dir[256] = "/";
+  uint32_t (*nowUs)() = nullptr;
+  uint32_t (*freeHeap)() = nullptr;
+
+  char row[LIST_ROW_MAX];
+  char enc[800];
+};
+
+/**
+ * @brief Append a JSON quoted string to a buffer
+ *
+ * @param out
+ * @param cap
+ * @param text
+ * @return size_t chars written (output is always terminated)
+ */
+size_t jsonQuoteTo(char *out, size_t cap, const char *text)
+{
+  size_t n = 0;
+  if (cap < 3)
+    return 0;
+
+  out[n++] = '"';
+  for (const char *p = text; *p && n + 8 < cap; p++)
+  {
+    char c = *p;
+    if (c == '"' || c == '\\')
+    {
+      out[n++] = '\\';
+      out[n++] = c;
+    }
+    else if ((uint8_t)c < 0x20)
+    {
+      n += snprintf(out + n, cap - n, "\\u%04x", (uint8_t)c);
+    }
+    else
+    {
+      out[n++] = c;
+    }
+  }
+  out[n++] = '"';
+  out[n] = 0;
+  return n;
+}
+
+/**
+ * @brief URL-encode a file name into a buffer
+ *
+ * @param out
+ * @param cap
+ * @param value
+ */
+void urlEncodeTo(char *out, size_t cap, const char *value)
+{
+  size_t n = 0;
+  for (const char *p = value; *p && n + 4 < cap; p++)
+  {
+    char c = *p;
+    if (isalnum((uint8_t)c) || c == '-' || c == '_' || c == '.' || c == '~')
+      out[n++] = c;
+    else
+      n += snprintf(out + n, cap - n, "%%%02X", (uint8_t)c);
+  }
+  out[n] = 0;
+}
+
+/**
+ * @brief Human readable size into a buffer
+ *
+ * Same text as humanReadableSize() in webserver.h, without a String per row.
+ *
+ * @param out
+ * @param cap
+ * @param bytes
+ */
+void humanSizeTo(char *out, size_t cap, uint64_t bytes)
+{
+  if (bytes < 1024)
+    snprintf(out, cap, "%u B", (unsigned)bytes);
+  else if (bytes < (1024 * 1024))
+    snprintf(out, cap, "%.2f KB", bytes / 1024.0);
+  else if (bytes < (1024 * 1024 * 1024))
+    snprintf(out, cap, "%.2f MB", bytes / (1024.0 * 1024.0));
+  else
+    snprintf(out, cap, "%.2f GB", bytes / (1024.0 * 1024.0 * 1024.0));
+}
+
+/**
+ * @brief Format one HTML listing row
+ *
+ * @param st
+ * @param i
+ * @return size_t
+ */
+size_t listRowHTML(tListStream &st, int i)
+{
+  const char *name = st.list->name(i);
+  char size[24];
+  int n;
+
+  if (st.list->isDir(i))
+  {
+    n = snprintf(st.row, LIST_ROW_MAX,
+                 "<tr align='left'><td style=\"width:300px\">"
+                 "<img src=\"folder\"> <a href='#' onclick='changeDirectory(\"%s\")'>%s</a>"
+                 "</td><td style=\"text-align:center\">dir</td><td></td>"
+                 "<td><button class=\"button\" onclick=\"downloadDeleteButton('%s', 'deldir')\"><img src=\"del\"> Delete</button></td></tr>",
+                 name, name, name);
+  }
+  else
+  {
+    bool tzx;
+    bool tape = thumbIsTape(name, tzx);
+    if (tape)
+      urlEncodeTo(st.enc, sizeof(st.enc), name);
+
+    humanSizeTo(size, sizeof(size), st.list->size(i));
+    n = snprintf(st.row, LIST_ROW_MAX,
+                 "<tr align='left'><td style=\"width:300px\"><img src=\"files\"> %s%s%s%s"
+                 "</td><td style=\"text-align:right\">%s</td>"
+                 "<td><button class=\"button\" onclick=\"downloadDeleteButton('%s', 'download')\"><img src=\"down\"> Download</button></td>"
+                 "<td><button class=\"button\" onclick=\"downloadDeleteButton('%s', 'delete')\"><img src=\"del\"> Delete</button></td></tr>",
+                 name,
+                 tape ? " <img src=\"thumb?name=" : "",
+                 tape ? st.enc : "",
+                 tape ? "\" width=\"64\" height=\"48\" loading=\"lazy\" style=\"vertical-align:middle\" onerror=\"this.style.display='none'\">" : "",
+                 size, name, name);
+  }
+
+  return n < LIST_ROW_MAX ? n : LIST_ROW_MAX - 1;
+}
+
+/**
+ * @brief Format one JSON listing entry
+ *
+ * @param st
+ * @param i
+ * @return size_t
+ */
+size_t listRowJSON(tListStream &st, int i)
+{
+  size_t n = 0;
+  if (st.i > st.first)
+    st.row[n++] = ',';
+
+  n += snprintf(st.row + n, LIST_ROW_MAX - n, "{\"name\":");
+  n += jsonQuoteTo(st.row + n, LIST_ROW_MAX - n - 48, st.list->name(i));
+  n += snprintf(st.row + n, LIST_ROW_MAX - n, ",\"dir\":%s,\"size\":%u}",
+                st.list->isDir(i) ? "true" : "false", (unsigned)st.list->size(i));
+  return n;
+}
+
+/**
+ * @brief Produce the next piece of a listing into st.row
+ *
+ * @param st
+ * @return false when the listing is complete
+ */
+bool listNextPiece(tListStream &st)
+{
+  int total = st.list->count();
+  int n = 0;
+
+  switch (st.stage)
+  {
+  case 0:
+    if (st.json)
+    {
+      n = snprintf(st.row, LIST_ROW_MAX, "{\"dir\":");
+      n += jsonQuoteTo(st.row + n, LIST_ROW_MAX - n, st.dir);
+      n += snprintf(st.row + n, LIST_ROW_MAX - n, ",\"gen\":%u,\"total\":%d,\"cursor\":%d,\"next\":%d,\"entries\":[",
+                    (unsigned)st.gen, total, st.first, st.end < total ? st.end : -1);
+    }
+    else
+    {
+      n = snprintf(st.row, LIST_ROW_MAX, "%s",
+                   "<div style=\"overflow-y:scroll;\"><table><tr><th>Name</th><th style=\"text-align:center\">Size</th><th></th><th></th></tr>");
+      if (strcmp(st.dir, "/") != 0)
+      {
+        n += snprintf(st.row + n, LIST_ROW_MAX - n, "%s",
+                      "<tr align='left'><td style=\"width:300px\">"
+                      "<img src=\"folder\"> <a href='#' onclick='changeDirectory(\"..\")'>..</a>"
+                      "</td><td style=\"text-align:center\">dir</td><td></td><td></td></tr>");
+      }
+    }
+    st.i = st.first;
+    st.stage = 1;
+    break;
+
+  case 1:
+    if (st.i >= st.end || st.i >= total)
+    {
+      st.stage = 2;
+      return listNextPiece(st);
+    }
+    n = st.json ? listRowJSON(st, st.i) : listRowHTML(st, st.i);
+    st.i++;
+    break;
+
+  case 2:
+    if (st.json)
+    {
+      n = snprintf(st.row, LIST_ROW_MAX, "]}");
+    }
+    else
+    {
+      n = snprintf(st.row, LIST_ROW_MAX, "</table></div><p></p><p><tr align='left'>");
+      if (st.page > 0)
+      {
+        n += snprintf(st.row + n, LIST_ROW_MAX - n,
+                      "<ti><button class=\"button\" onclick='loadPage(0)'>First</button></ti>"
+                      "<ti><button class=\"button\" onclick='loadPage(%d)'>Prev</button></ti>",
+                      st.page - 1);
+      }
+
+      n += snprintf(st.row + n, LIST_ROW_MAX - n, "<ti><span> Page %d/%d </span></ti>", st.page + 1, (total / 10) + 1);
+
+      if (total > st.end)
+      {
+        n += snprintf(st.row + n, LIST_ROW_MAX - n,
+                      "<ti><button class=\"button\" onclick='loadPage(%d)'>Next</button></ti>"
+                      "<ti><button class=\"button\" onclick='loadPage(%d)'>Last</button></ti>",
+                      st.page + 1, total / 10);
+      }
+    }
+    st.stage = 3;
+    break;
+
+  default:
+    return false;
+  }
+
+  st.len = n;
+  st.pos = 0;
+  return true;
+}
+
+/**
+ * @brief Chunk callback of a streamed listing
+ *
+ * @param st
+ * @param buffer
+ * @param maxLen
+ * @return size_t bytes written, 0 when done
+ */
+size_t listFill(tListStream &st, uint8_t *buffer, size_t maxLen)
+{
+  size_t n = 0;
+
+  while (n < maxLen)
+  {
+    if (st.pos == st.len && !listNextPiece(st))
+      break;
+
+    size_t chunk = st.len - st.pos;
+    if (chunk > maxLen - n)
+      chunk = maxLen - n;
+    memcpy(buffer + n, st.row + st.pos, chunk);
+    st.pos += chunk;
+    n += chunk;
+  }
+
+  uint32_t heap = st.freeHeap();
+  if (heap < st.heapMin)
+    st.heapMin = heap;
+
+  if (!st.started && n > 0)
+  {
+    st.started = true;
+    listStats.lastTtfbUs = st.nowUs() - st.t0;
+  }
+
+  st.bytes += n;
+
+  if (n == 0)
+  {
+    listStats.responses++;
+    listStats.lastEntries = st.i - st.first;
+    listStats.lastBytes = st.bytes;
+    listStats.lastTotalUs = st.nowUs() - st.t0;
+    listStats.lastHeapUsed = st.heap0 - st.heapMin;
+    if (listStats.lastHeapUsed > listStats.maxHeapUsed)
+      listStats.maxHeapUsed = listStats.lastHeapUsed;
+  }
+
+  return n;
+}
@@ -263,6 +263,7 @@ function dropped(e)
   {
     for (const file of files) 
     {
+      formData.append("size", file.size);
       formData.append("file[]", file, file.name); 
       fileNames += file.name + ", ";
     }
@@ -8,10 +8,14 @@
 
 #include <esp_task_wdt.h>
 #include <algorithm> 
+#include <memory>
 #include <vector>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include "sd_fat32_fs_wrapper.h"
+#include "http_range.h"
+#include "list_stream.h"
+#include <atomic>
 
 fs::FS webFile = fs::FS(fs::FSImplPtr(new SdFat32FSImpl(sdf)));
 csd_t csd;
@@ -32,8 +36,6 @@ String currentDir;
 String createDir;
 uint8_t nextSlash = 0;
 
-bool updateList = true;
-
 const int FILES_PER_PAGE = 10; 
 
 /**
@@ -42,20 +44,26 @@ const int FILES_PER_PAGE = 10;
  */
  void getSdInfo()
  {
+  // freeClusterCount() reads the whole FAT
+  SDioLock lock(SDIO_INTERACTIVE);
   sdFree = (sdf.freeClusterCount() * sdf.sectorsPerCluster() * 0.000512) * 1024 * 1024;
   sdUsed = sdTotal-sdFree;
  }
 
 /**
- * @brief File directory cache
+ * @brief Sorted listing of the current directory
  *
+ * A snapshot from the shared directory index (DirIndex.h). Streamed
+ * listings keep their own reference, so it can be swapped at any time.
  */
-struct FileEntry {
-  String name;
-  bool isDirectory;
-  size_t size;
-};
-std::vector<FileEntry> fileCache;
+tDirListPtr fileCache;
+
+/**
+ * @brief Bumped every time fileCache points to a different snapshot
+ *
+ * The JSON cursor is only valid for the generation it was issued with.
+ */
+uint32_t fileCacheGen = 0;
 
 
 /**
@@ -83,108 +91,49 @@ String humanReadableSize(uint64_t bytes)
 }
 
 /**
- * @brief Extract position of numeric part of string
+ * @brief Point fileCache at a directory
  *
- * @param String
- * @return pos 
- */
-int extractNumber(const String& str, int& pos)
-{
-  int num = 0;
-  while (pos < str.length() && isdigit(str[pos])) 
-  {
-    num = num * 10 + (str[pos] - '0');
-    pos++;
-  }
-  return num;
-}
-
-/**
- * @brief Compare alphanumerical two strings
+ * Served from the shared directory index. The SD is only read the first
+ * time a directory is visited or after the index dropped it. Uploads and
+ * deletes update the index in place.
  *
- * @param a -> First string
- * @param b -> Second string
- * @return true/false
+ * @param dir
  */
-bool naturalCompare(const String& a, const String& b) 
+void cacheDirectoryContent(const String& dir) 
 {
-  int i = 0, j = 0;
-  while (i < a.length() && j < b.length()) 
+  tDirListPtr list = dirIndex.get(dir.c_str(), [&](auto add)
   {
-    if (isdigit(a[i]) && isdigit(b[j])) 
-    {
-      int numA = extractNumber(a, i);
-      int numB = extractNumber(b, j);
-      if (numA != numB) 
-        return numA < numB;
-    } 
-    else 
-    {
-      if (tolower(a[i]) != tolower(b[j])) 
-        return tolower(a[i]) < tolower(b[j]);
-      i++;
-      j++;
-    }
-  }
+    SDioLock lock(SDIO_INTERACTIVE);
 
-  return a.length() < b.length();
-}
+    File root = webFile.open(dir.c_str());
+    if (!root)
+      return false;
 
-/**
- * @brief Compare File Cache entries
- *
- * @param a -> File Cache entries 
- * @param b -> File Cache entries
- * @return true/false
- */
-bool compareFileEntries(const FileEntry& a, const FileEntry& b)
-{
-  if (a.isDirectory != b.isDirectory) 
-    return a.isDirectory > b.isDirectory; 
+    File foundFile = root.openNextFile();
+    while (foundFile)
+    {
+      add(foundFile.name(), foundFile.isDirectory(), foundFile.size());
 
-  return naturalCompare(a.name, b.name);
-}
+      esp_task_wdt_reset(); 
+      lock.yield();
 
-/**
- * @brief Sort File Cache entries
- *
- */
-void sortFileCache() 
-{
-  std::sort(fileCache.begin(), fileCache.end(), compareFileEntries);
-}
+      foundFile = root.openNextFile();
+    }
 
-/**
- * @brief Cache file entries in directory
- *
- * @param dir
- */
-void cacheDirectoryContent(const String& dir) 
-{
-  fileCache.clear();  
+    root.close();
+    return true;
+  }, []() { return (uint32_t)micros(); });
 
-  File root = webFile.open(dir.c_str());
-  File foundFile = root.openNextFile();
+  if (!list)
+    list = std::make_shared<const tDirList>();
 
-  while (foundFile)
+  if (list != fileCache)
   {
-    FileEntry entry;
-    entry.name = foundFile.name();
-    entry.isDirectory = foundFile.isDirectory();
-    entry.size = foundFile.size();
-
-    fileCache.push_back(entry);
-    
-    esp_task_wdt_reset(); 
-
-    foundFile = root.openNextFile();
+    fileCache = list;
+    fileCacheGen++;
   }
 
-  root.close();
- 
   currentDir = dir;
-
-  sortFileCache();
 }
 
 /**
@@ -253,81 +202,77 @@ void rebootESP()
 }
 
 /**
- * @brief List Files in Web Page
- * 
- * @param ishtml 
+ * @brief Stream a page of the current directory
+ *
+ * HTML pages keep the old layout for the web file manager. The JSON variant
+ * uses a cursor into the sorted cache: {"gen","total","cursor","next",
+ * "entries":[...]}, with next = -1 on the last page. A cursor from an older
+ * generation is rejected with 409 so the client starts over.
+ *
+ * @param request
+ * @param json
+ * @param first
+ * @param count
  * @param page
- * @return String 
  */
-String listFiles(bool ishtml, int page = 0)
+void sendListing(AsyncWebServerRequest *request, bool json, int first, int count, int page)
 {
-  String returnText = "";
-
-  int startIdx = page * FILES_PER_PAGE; 
-  int endIdx = startIdx + FILES_PER_PAGE; 
-
-  if (ishtml)
-  {
-    returnText += "<div style=\"overflow-y:scroll;\"><table><tr><th>Name</th><th style=\"text-align:center\">Size</th><th></th><th></th></tr>";
-    if (oldDir != "/")
+  uint32_t heap0 = ESP.getFreeHeap();
+
+  std::shared_ptr<tListStream> st(new tListStream());
+  st->nowUs = []() { return (uint32_t)micros(); };
+  st->freeHeap = []() { return (uint32_t)ESP.getFreeHeap(); };
+  snprintf(st->dir, sizeof(st->dir), "%s", oldDir.c_str());
+  st->t0 = micros();
+  st->heap0 = heap0;
+  st->heapMin = heap0;
+  st->json = json;
+  st->page = page;
+  st->first = first < 0 ? 0 : first;
+  st->end = st->first + count;
+  st->gen = fileCacheGen;
+  st->list = fileCache ? fileCache : std::make_shared<const tDirList>();
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(json ? "application/json" : "text/html",
+    [st](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
     {
-      returnText += "<tr align='left'><td style=\"width:300px\">";
-      returnText += "<img src=\"folder\"> <a href='#' onclick='changeDirectory(\"..\")'>..</a>";
-      returnText += "</td><td style=\"text-align:center\">dir</td><td></td><td></td>";
-      returnText += "</tr>";
-    }
-  }
+      return listFill(*st, buffer, maxLen);
+    });
 
-  for (int i = startIdx; i < endIdx && i < fileCache.size(); ++i) 
-  {
-    FileEntry& entry = fileCache[i];
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
 
-    if (ishtml) 
-    {
-      returnText += "<tr align='left'><td style=\"width:300px\">";
-      if (entry.isDirectory) 
-      {
-        returnText += "<img src=\"folder\"> <a href='#' onclick='changeDirectory(\"" + entry.name + "\")'>" + entry.name + "</a>";
-        returnText += "</td><td style=\"text-align:center\">dir</td>"; 
-        returnText += "<td></td>";
-        returnText += "<td><button class=\"button\" onclick=\"downloadDeleteButton('" + entry.name + "', 'deldir')\"><img src=\"del\"> Delete</button></td>";
-      } 
-      else 
-      {
-        returnText += "<img src=\"files\"> " + entry.name;
-        returnText += "</td><td style=\"text-align:right\">" + humanReadableSize(entry.size) + "</td>";
-        returnText += "<td><button class=\"button\" onclick=\"downloadDeleteButton('" + entry.name + "', 'download')\"><img src=\"down\"> Download</button></td>";
-        returnText += "<td><button class=\"button\" onclick=\"downloadDeleteButton('" + entry.name + "', 'delete')\"><img src=\"del\"> Delete</button></td>";
-      }
-      returnText += "</tr>";
-    }
-    else 
-    {
-      returnText += "File: " + entry.name + " Size: " + humanReadableSize(entry.size) + "\n";
-    }
-  }
+/**
+ * @brief Permanent redirect of a legacy endpoint to its /api replacement
+ *
+ * 308 keeps the method and the form body; the query string is carried over.
+ *
+ * @param request
+ * @param to
+ */
+void redirectLegacy(AsyncWebServerRequest *request, const char *to)
+{
+  String url = to;
+  char enc[256];
 
-  if (ishtml)
+  for (size_t i = 0; i < request->params(); i++)
   {
-    returnText += "</table></div><p></p><p>";
-    
-    returnText += "<tr align='left'>"; 
-    if (page > 0) 
-    {
-      returnText += "<ti><button class=\"button\" onclick='loadPage(" + String(0) + ")'>First</button></ti>";
-      returnText += "<ti><button class=\"button\" onclick='loadPage(" + String(page - 1) + ")'>Prev</button></ti>";
-    }
-
-    returnText += "<ti><span> Page " + String(page + 1) + "/" + String((fileCache.size() / 10)+1) + " </span></ti>";
-
-    if (fileCache.size() > endIdx)
-    {
-      returnText += "<ti><button class=\"button\" onclick='loadPage(" + String(page + 1) + ")'>Next</button></ti>";
-      returnText += "<ti><button class=\"button\" onclick='loadPage(" + String((fileCache.size() / 10)) + ")'>Last</button></ti>";
-    }
+    AsyncWebParameter *p = request->getParam(i);
+    if (p->isPost() || p->isFile())
+      continue;
+
+    url += url.indexOf('?') < 0 ? '?' : '&';
+    urlEncodeTo(enc, sizeof(enc), p->name().c_str());
+    url += enc;
+    url += '=';
+    urlEncodeTo(enc, sizeof(enc), p->value().c_str());
+    url += enc;
   }
- 
-  return returnText;
+
+  AsyncWebServerResponse *response = request->beginResponse(308);
+  response->addHeader("Location", url);
+  request->send(response);
 }
 
 /**
@@ -343,15 +288,26 @@ bool createDirectories(String filepath)
   {
     nextSlash = filepath.indexOf('/', lastSlash + 1);
     String dir = filepath.substring(0, nextSlash);
+    bool created = true;
+    bool exists;
+    {
+      SDioLock lock(SDIO_INTERACTIVE);
+      exists = webFile.exists(oldDir + "/" + dir);
+      if (!exists)
+      {
+        created = webFile.mkdir(oldDir + "/" + dir);
+      }
+    }
         
-    if (!webFile.exists(oldDir + "/" + dir))
+    if (!exists)
     {
-      if (!webFile.mkdir(oldDir + "/" + dir))
+      if (!created)
       {
         log_e("Directory %s creation error", dir.c_str());
         return false;
       }
       log_v("Directory %s created",dir.c_str());
+      dirIndex.addPath((oldDir + "/" + dir).c_str(), true, 0);
     }
     if (nextSlash == 255) break;
     lastSlash = nextSlash;
@@ -361,9 +317,54 @@ bool createDirectories(String filepath)
   return true;
 }
 
+/**
+ * @brief Upload session of a request
+ *
+ * Created with the first uploaded byte and kept in request->_tempObject
+ * until uploadDone() or the client disconnects, whichever comes first.
+ *
+ * @param request
+ * @return UploadSession*
+ */
+UploadSession *uploadSession(AsyncWebServerRequest *request)
+{
+  if (request->_tempObject == nullptr)
+  {
+    request->_tempObject = new UploadSession();
+    request->onDisconnect([request]()
+                          {
+                            delete (UploadSession *)request->_tempObject;
+                            request->_tempObject = nullptr; });
+  }
+  return (UploadSession *)request->_tempObject;
+}
+
+/**
+ * @brief Size of the file being uploaded, if the page sent it
+ *
+ * The upload form adds a "size" field right before each file, so the
+ * last one parsed belongs to the file that is starting.
+ *
+ * @param request
+ * @return uint32_t -> 0 if unknown
+ */
+uint32_t uploadSizeHint(AsyncWebServerRequest *request)
+{
+  for (int i = request->params() - 1; i >= 0; i--)
+  {
+    AsyncWebParameter *p = request->getParam(i);
+    if (p->isPost() && !p->isFile() && p->name() == "size")
+      return p->value().toInt();
+  }
+  return 0;
+}
+
 /**
  * @brief Upload file handle
  * 
+ * Data goes through the request's UploadSession, which writes it to the SD
+ * in large sector aligned blocks.
+ *
  * @param request 
  * @param filename 
  * @param index 
@@ -373,8 +374,6 @@ bool createDirectories(String filepath)
 void handleUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final)
 {
   String pathFull = oldDir + "/" + filename;
-  char strpath[255] = {};
-  strcpy(strpath,pathFull.c_str());
 
   uint8_t lastSlashIndex = filename.lastIndexOf("/");
   
@@ -392,167 +391,1841 @@ void handleUpload(AsyncWebServerRequest *request, String filename, size_t index,
   
   log_v("%s", filename.c_str());
 
+  UploadSession *session = uploadSession(request);
+
   if (!index)
   {
     request->client()->setRxTimeout(15000);
-    request->_tempFile = webFile.open(strpath, "w+", true);  
+    session->openFile(pathFull, uploadSizeHint(request));
   }
 
   if (len)
-    request->_tempFile.write(data, len);
+    session->write(data, len);
 
   if (final)
   {
-    request->_tempFile.close();
-    updateList = true;
+    session->closeFile(true);
+    thumbCache.request(oldDir, true);
   }
 }
 
 /**
- * @brief Send PNG file from SPIFFS to webpage
- * 
- * @param imageFile
- * @param request 
+ * @brief Destination folder of a tar upload (?dir=, current folder by default)
+ *
+ * @param request
+ * @return String
  */
-void sendSpiffsImage(const char *imageFile,AsyncWebServerRequest *request)
+String untarDir(AsyncWebServerRequest *request)
 {
-  FILE *f = fopen(imageFile,"r");
-  fseek(f, 0, SEEK_END);
-  size_t size = ftell(f);
-  rewind(f);
-  uint8_t *buffer = (uint8_t*)ps_malloc(sizeof(uint8_t)*size);
-
-  fread(buffer, sizeof(uint8_t),size,f);
-  fclose(f);
-  request->send_P(200,"image/png",buffer,size);
-            
-  free(buffer);
+  if (request->hasParam("dir"))
+    return request->getParam("dir")->value();
+  return oldDir;
 }
 
 /**
- * @brief Delete directory recursive
- * 
- * @param dirPath -> directory path
- * @return true/false if successful
+ * @brief Tar sent as a multipart file. Extracted as it arrives
+ *
+ * @param request
+ * @param filename
+ * @param index
+ * @param data
+ * @param len
+ * @param final
  */
-bool deleteDirRecursive(const char *dirPath)
+void handleTarUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final)
 {
-  log_v("%s",dirPath);
-  String basePath = dirPath;
-  if (!basePath.endsWith("/"))
+  UploadSession *session = uploadSession(request);
+
+  if (!index)
   {
-      basePath += "/";
+    request->client()->setRxTimeout(15000);
+    session->untarTo(untarDir(request));
   }
 
-  log_v("Processing directory: %s", basePath.c_str());
+  if (len && !session->feedTar(data, len))
+    log_e("Bad tar header in %s", filename.c_str());
+}
 
-  File dir = webFile.open(basePath.c_str());
-  if (!dir || !dir.isDirectory())
-  {
-      log_e("Error: %s isn't a directory or can't open", basePath.c_str());
-      return false;
-  }
+/**
+ * @brief Tar sent as the raw request body (application/x-tar)
+ *
+ * @param request
+ * @param data
+ * @param len
+ * @param index
+ * @param total
+ */
+void handleTarBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  UploadSession *session = uploadSession(request);
 
-  while (true)
+  if (!index)
   {
-      File entry = dir.openNextFile();
-      if (!entry)
-      {
-          break; 
-      }
+    request->client()->setRxTimeout(15000);
+    session->untarTo(untarDir(request));
+  }
 
-      String entryPath = basePath + entry.name(); 
+  if (len && !session->feedTar(data, len))
+    log_e("Bad tar header");
+}
 
-      if (entry.isDirectory())
-      {
-          log_v("Found subdirectory: %s", entryPath.c_str());
-          if (!deleteDirRecursive(entryPath.c_str()))
-          {
-              entry.close();
-              return false;
-          }
-      }
-      else
-      {
-          log_v("Found file: %s", entryPath.c_str());
-          if (!webFile.remove(entryPath.c_str()))
-          {
-              log_e("Error deleting file: %s", entryPath.c_str());
-              entry.close();
-              return false;
-          }
-          log_v("Deleted file: %s", entryPath.c_str());
-      }
-      entry.close();
-  }
+/**
+ * @brief Answer an upload once the whole body was received
+ *
+ * Closes the session and reports what was written.
+ *
+ * @param request
+ */
+void uploadDone(AsyncWebServerRequest *request)
+{
+  UploadSession *session = (UploadSession *)request->_tempObject;
+  request->_tempObject = nullptr;
 
-  dir.close();
+  bool ok = false;
+  String json = "{\"files\":0,\"errors\":0,\"bytes\":0}";
 
-  if (!webFile.rmdir(basePath.c_str()))
+  if (session != nullptr)
   {
-      log_e("Error deleting directory: %s", basePath.c_str());
-      return false;
+    bool untar = session->untarring();
+    ok = session->errors() == 0 && (!untar || session->tarComplete());
+    json = "{\"files\":" + String(session->files());
+    json += ",\"errors\":" + String(session->errors());
+    json += ",\"bytes\":" + String(session->bytes());
+    if (untar)
+      json += ",\"complete\":" + String(session->tarComplete() ? "true" : "false");
+    json += "}";
+
+    delete session;
+
+    if (untar)
+      thumbCache.request(untarDir(request), true);
   }
 
-  log_v("Deleted directory: %s", basePath.c_str());
-  return true;
+  request->send(ok ? 200 : 500, "application/json", json);
 }
 
 /**
- * @brief Configure Web Server
- * 
+ * @brief Bytes read ahead from the SD for a download
+ *
+ * Twice the lwIP send window, rounded up to scheduler slices, so each SD
+ * read refills the TCP window a couple of times.
  */
-void configureWebServer()
+#ifndef DOWNLOAD_READAHEAD_BYTES
+  #ifdef TCP_SND_BUF
+    #define DOWNLOAD_READAHEAD_BYTES ((2 * TCP_SND_BUF + SDIO_SLICE_BYTES - 1) / SDIO_SLICE_BYTES * SDIO_SLICE_BYTES)
+  #else
+    #define DOWNLOAD_READAHEAD_BYTES 16384
+  #endif
+#endif
+
+/**
+ * @brief Download counters (/webstats)
+ *
+ */
+struct tDownloadStats
 {
-  sdTotal = (sdf.clusterCount() * sdf.sectorsPerCluster() * 0.000512) * 1024 * 1024; 
-  sdf.card()->readCSD(&csd);
-  sdType = sdf.card()->type();
-  sdCap = csd.capacity();
+  uint32_t responses = 0;
+  uint32_t partial = 0;       // 206
+  uint32_t notModified = 0;   // 304
+  uint32_t unsatisfiable = 0; // 416
+  uint32_t sdReads = 0;
+  uint64_t bytes = 0;
+};
+tDownloadStats downloadStats;
 
-  server.onNotFound(webNotFound);
-  server.onFileUpload(handleUpload);
-  oldDir = "/";
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
-            {
-              //getSdInfo();
-              String logMessage = "Client:" + request->client()->remoteIP().toString() + +" " + request->url();
-                log_i("%s", logMessage.c_str());
-                request->send_P(200, "text/html", index_html, webParser); 
-            });
+/**
+ * @brief Response body read from an SD file, optionally a byte range
+ *
+ * The TCP stack asks for at most one send window at a time; those requests
+ * are served from a read-ahead buffer that is refilled with large reads
+ * through the SD scheduler. A HEAD response sends the same headers and no
+ * body.
+ */
+class SdFileResponse : public AsyncAbstractResponse
+{
+private:
+  File32 _file;
+  uint32_t _offset;
+  uint32_t _end;
+  uint8_t *_ahead = nullptr;
+  uint32_t _aheadPos = 0;
+  uint32_t _aheadLen = 0;
+  bool _headOnly;
+
+  bool refill()
+  {
+    uint32_t n = _end - _offset;
+    if (n > DOWNLOAD_READAHEAD_BYTES)
+      n = DOWNLOAD_READAHEAD_BYTES;
 
+    {
+      SDioLock lock(SDIO_INTERACTIVE);
+      if (!_file.seekSet(_offset))
+        return false;
+    }
+    int r = sdsched.read(_file, _ahead, n, SDIO_INTERACTIVE);
+    downloadStats.sdReads++;
 
-  server.on("/logo", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/logo_small.png",request); });
-            
-  server.on("/files", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/file.png",request); });
+    _aheadPos = _offset;
+    _aheadLen = r > 0 ? r : 0;
+    return _aheadLen > 0;
+  }
 
-  server.on("/folder", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/folder.png",request); });
-  
-  server.on("/down", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/download.png", request); });
-  
-  server.on("/up", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/upload.png", request); });          
+public:
+  SdFileResponse(File32 file, int code, const String &contentType, uint32_t start, uint32_t length, bool headOnly)
+      : _file(file), _offset(start), _end(start + length), _headOnly(headOnly)
+  {
+    _code = code;
+    _contentType = contentType;
+    _contentLength = length;
 
-  server.on("/del", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/delete.png", request); });
+    if (!headOnly)
+      _ahead = (uint8_t *)blockPool.alloc(DOWNLOAD_READAHEAD_BYTES);
+  }
 
-  server.on("/reb", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/reboot.png", request); });    
+  ~SdFileResponse()
+  {
+    {
+      SDioLock lock(SDIO_INTERACTIVE);
+      _file.close();
+    }
+    blockPool.release(_ahead);
+  }
 
-  server.on("/list", HTTP_GET, [](AsyncWebServerRequest *request)
-            { sendSpiffsImage("/spiffs/list.png", request); });                    
+  bool _sourceValid() const
+  {
+    return _file.isOpen();
+  }
 
-  server.on("/reboot", HTTP_GET, [](AsyncWebServerRequest *request)
-            {
-              String logMessage = "Client:" + request->client()->remoteIP().toString() + " " + request->url();
-              request->send(200, "text/html", reboot_html);
-              log_i("%s",logMessage.c_str());
-              rebootESP(); });
+  void _respond(AsyncWebServerRequest *request)
+  {
+    if (!_headOnly)
+    {
+      AsyncAbstractResponse::_respond(request);
+      return;
+    }
 
-  server.on("/listfiles", HTTP_GET, [](AsyncWebServerRequest *request)
+    // Content-Length goes out with the real size, then there is no body
+    addHeader("Connection", "close");
+    _head = _assembleHead(request->version());
+    _contentLength = 0;
+    _state = RESPONSE_HEADERS;
+    _ack(request, 0, 0);
+  }
+
+  size_t _fillBuffer(uint8_t *buf, size_t maxLen)
+  {
+    if (_offset >= _end || maxLen == 0)
+      return 0;
+    if (maxLen > _end - _offset)
+      maxLen = _end - _offset;
+
+    size_t n;
+    if (_ahead == nullptr)
+    {
+      // No buffer available: read straight into the TCP buffer
+      if (maxLen > SDIO_SLICE_BYTES)
+        maxLen = SDIO_SLICE_BYTES;
+
+      SDioLock lock(SDIO_INTERACTIVE);
+      if (!_file.seekSet(_offset))
+        return 0;
+      int r = _file.read(buf, maxLen);
+      downloadStats.sdReads++;
+      n = r > 0 ? r : 0;
+    }
+    else
+    {
+      if (_offset < _aheadPos || _offset >= _aheadPos + _aheadLen)
+      {
+        if (!refill())
+          return 0;
+      }
+
+      n = _aheadPos + _aheadLen - _offset;
+      if (n > maxLen)
+        n = maxLen;
+      memcpy(buf, _ahead + (_offset - _aheadPos), n);
+    }
+
+    _offset += n;
+    downloadStats.bytes += n;
+    return n;
+  }
+};
+
+/**
+ * @brief Value of a request header, nullptr if missing
+ *
+ * @param request
+ * @param name
+ * @return const char*
+ */
+const char *requestHeader(AsyncWebServerRequest *request, const char *name)
+{
+  AsyncWebHeader *h = request->getHeader(name);
+  return h ? h->value().c_str() : nullptr;
+}
+
+/**
+ * @brief Send a file from SD reading it through the SD scheduler
+ *
+ * Supports HEAD, single byte Range requests (with If-Range) and
+ * If-None-Match. The ETag comes from the file size and its modification
+ * stamp, so an interrupted download can be resumed safely.
+ *
+ * @param request
+ * @param path -> Full file path
+ * @param contentType
+ */
+void sendSdFile(AsyncWebServerRequest *request, const String& path, const String& contentType)
+{
+  File32 file;
+  uint16_t fatDate = 0;
+  uint16_t fatTime = 0;
+  {
+    SDioLock lock(SDIO_INTERACTIVE);
+    file = sdf.open(path.c_str(), O_RDONLY);
+    if (file.isOpen())
+      file.getModifyDateTime(&fatDate, &fatTime);
+  }
+
+  if (!file.isOpen())
+  {
+    request->send(404, "text/plain", "ERROR: cannot open file");
+    return;
+  }
+
+  uint32_t size = file.fileSize();
+  char etag[24];
+  char lastModified[32] = "";
+  httpETag(etag, sizeof(etag), size, fatDate, fatTime);
+  httpDate(lastModified, sizeof(lastModified), fatDate, fatTime);
+
+  downloadStats.responses++;
+
+  int code = 200;
+  uint32_t start = 0;
+  uint32_t length = size;
+  int range = HTTP_RANGE_NONE;
+
+  if (httpETagListMatches(requestHeader(request, "If-None-Match"), etag))
+  {
+    code = 304;
+    downloadStats.notModified++;
+  }
+  else if (httpIfRangeMatches(requestHeader(request, "If-Range"), etag, lastModified))
+  {
+    range = httpParseRange(requestHeader(request, "Range"), size, start, length);
+    if (range == HTTP_RANGE_PARTIAL)
+    {
+      code = 206;
+      downloadStats.partial++;
+    }
+    else if (range == HTTP_RANGE_UNSATISFIABLE)
+    {
+      code = 416;
+      downloadStats.unsatisfiable++;
+    }
+    else
+    {
+      start = 0;
+      length = size;
+    }
+  }
+
+  AsyncWebServerResponse *response;
+  if (code == 304 || code == 416)
+  {
+    {
+      SDioLock lock(SDIO_INTERACTIVE);
+      file.close();
+    }
+    response = request->beginResponse(code);
+    if (code == 416)
+      response->addHeader("Content-Range", "bytes */" + String(size));
+  }
+  else
+  {
+    response = new SdFileResponse(file, code, contentType, start, length, request->method() == HTTP_HEAD);
+    if (code == 206)
+      response->addHeader("Content-Range", "bytes " + String(start) + "-" + String(start + length - 1) + "/" + String(size));
+
+    String fileName = path.substring(path.lastIndexOf("/") + 1);
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + fileName + "\"");
+  }
+
+  response->addHeader("Accept-Ranges", "bytes");
+  response->addHeader("ETag", etag);
+  if (lastModified[0])
+    response->addHeader("Last-Modified", lastModified);
+  request->send(response);
+}
+
+/**
+ * @brief Nextion output counters as JSON
+ *
+ * "requestedBps" is what writeString was asked to send (the old behaviour),
+ * "sentBps" what actually went out after diffing and coalescing.
+ * "link" is the negotiated baud rate and the last POST /hmistats?bench result.
+ *
+ * @return String
+ */
+String hmiStatsJSON()
+{
+  tHMIoutStats st = hmiOut.getStats();
+  unsigned long ms = millis() - st.since;
+  if (ms == 0)
+    ms = 1;
+
+  String json = "{";
+  json += "\"seconds\":" + String(ms / 1000.0, 1);
+  json += ",\"requested\":" + String(st.requested);
+  json += ",\"sent\":" + String(st.sent);
+  json += ",\"suppressed\":" + String(st.suppressed);
+  json += ",\"coalesced\":" + String(st.coalesced);
+  json += ",\"dropped\":" + String(st.dropped);
+  json += ",\"requestedBps\":" + String((uint32_t)((uint64_t)st.bytesRequested * 1000 / ms));
+  json += ",\"sentBps\":" + String((uint32_t)((uint64_t)st.bytesSent * 1000 / ms));
+  json += ",\"blockedUsCore0\":" + String(st.blockedUs[0]);
+  json += ",\"blockedUsCore1\":" + String(st.blockedUs[1]);
+
+  tHMIrxStats rx = hmiRx.getStats();
+  json += ",\"rx\":{";
+  json += "\"frames\":" + String(rx.frames);
+  json += ",\"queueFull\":" + String(rx.queueFull);
+  json += ",\"maxDispatchUs\":" + String(rx.maxDispatchUs);
+  json += "}";
+
+  tHMIlinkReport link = hmiLink.report();
+  json += ",\"link\":{";
+  json += "\"baud\":" + String(link.baud);
+  json += ",\"detectedBaud\":" + String(link.detectedBaud);
+  json += ",\"failedBaud\":" + String(link.failedBaud);
+  json += ",\"benchDone\":" + String(link.benchDone ? "true" : "false");
+  json += ",\"cmdsPerSec\":" + String(link.cmdsPerSec);
+  json += ",\"rttUs\":" + String(link.rttUs);
+  json += ",\"benchErrors\":" + String(link.benchErrors);
+  json += "}}";
+  return json;
+}
+
+/**
+ * @brief Web file manager counters as JSON
+ *
+ * "list" is the last streamed /listfiles response: time to first byte,
+ * total time and the heap it took while streaming.
+ *
+ * @return String
+ */
+String webStatsJSON()
+{
+  String json = "{\"list\":{";
+  json += "\"responses\":" + String(listStats.responses);
+  json += ",\"entries\":" + String(listStats.lastEntries);
+  json += ",\"bytes\":" + String(listStats.lastBytes);
+  json += ",\"ttfbUs\":" + String(listStats.lastTtfbUs);
+  json += ",\"totalUs\":" + String(listStats.lastTotalUs);
+  json += ",\"heapUsed\":" + String(listStats.lastHeapUsed);
+  json += ",\"maxHeapUsed\":" + String(listStats.maxHeapUsed);
+  tDirIndexStats ix = dirIndex.getStats();
+  json += "},\"index\":{";
+  json += "\"hits\":" + String(ix.hits);
+  json += ",\"misses\":" + String(ix.misses);
+  json += ",\"updates\":" + String(ix.updates);
+  json += ",\"evictions\":" + String(ix.evictions);
+  json += ",\"walkUs\":" + String(ix.walkUs);
+  json += ",\"bytes\":" + String((uint32_t)dirIndex.bytes());
+  json += "},\"upload\":{";
+  json += "\"files\":" + String(uploadStats.files);
+  json += ",\"tarFiles\":" + String(uploadStats.tarFiles);
+  json += ",\"preallocated\":" + String(uploadStats.preallocated);
+  json += ",\"errors\":" + String(uploadStats.errors);
+  json += ",\"writes\":" + String(uploadStats.writes);
+  json += ",\"bytes\":" + String((uint32_t)uploadStats.bytes);
+  json += ",\"lastBytes\":" + String(uploadStats.lastBytes);
+  json += ",\"lastUs\":" + String(uploadStats.lastUs);
+  json += ",\"lastKBps\":" + String(uploadStats.lastKBps);
+  json += ",\"bestKBps\":" + String(uploadStats.bestKBps);
+  json += "},\"download\":{";
+  json += "\"responses\":" + String(downloadStats.responses);
+  json += ",\"partial\":" + String(downloadStats.partial);
+  json += ",\"notModified\":" + String(downloadStats.notModified);
+  json += ",\"unsatisfiable\":" + String(downloadStats.unsatisfiable);
+  json += ",\"sdReads\":" + String(downloadStats.sdReads);
+  json += ",\"bytes\":" + String((uint32_t)downloadStats.bytes);
+  json += "},\"stream\":{";
+  json += "\"streams\":" + String(streamStats.streams);
+  json += ",\"blocks\":" + String(streamStats.blocks);
+  json += ",\"unsupported\":" + String(streamStats.unsupported);
+  json += ",\"truncated\":" + String(streamStats.truncated);
+  json += ",\"underruns\":" + String(streamStats.underruns);
+  json += ",\"overflows\":" + String(streamStats.overflows);
+  json += ",\"bytes\":" + String((uint32_t)streamStats.bytes);
+  json += "},\"inspect\":{";
+  json += "\"requests\":" + String(inspectStats.requests);
+  json += ",\"dsc\":" + String(inspectStats.dsc);
+  json += ",\"scans\":" + String(inspectStats.scans);
+  json += ",\"stale\":" + String(inspectStats.stale);
+  json += ",\"lastBlocks\":" + String(inspectStats.lastBlocks);
+  json += ",\"lastUs\":" + String(inspectStats.lastUs);
+  json += "}}";
+  return json;
+}
+
+/**
+ * @brief Quote a C string for JSON
+ *
+ * @param text
+ * @return String
+ */
+String jsonQuote(const char *text)
+{
+  String out = "\"";
+  for (const char *p = text; *p; p++)
+  {
+    char c = *p;
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += c;
+    }
+    else if ((uint8_t)c < 0x20)
+    {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", (uint8_t)c);
+      out += esc;
+    }
+    else
+    {
+      out += c;
+    }
+  }
+  out += "\"";
+  return out;
+}
+
+/**
+ * @brief Tape status as JSON
+ *
+ * Built from the snapshot published by the player task (TapeStatus.h), so
+ * the web task never reads the player's String globals. "transport" is the
+ * command latency from post to acknowledgement (TransportBus.h).
+ * positionMs/tapeMs are estimated from the seek table (TapeSeek.h).
+ *
+ * @return String
+ */
+String tapeStatusJSON()
+{
+  tTapeStatus st;
+  tapeStatus.read(st);
+
+  String json = "{";
+  json += "\"updates\":" + String(st.updates);
+  json += ",\"play\":" + String(st.play ? "true" : "false");
+  json += ",\"pause\":" + String(st.pause ? "true" : "false");
+  json += ",\"stop\":" + String(st.stop ? "true" : "false");
+  json += ",\"rec\":" + String(st.rec ? "true" : "false");
+  json += ",\"eject\":" + String(st.eject ? "true" : "false");
+  json += ",\"fileType\":" + jsonQuote(st.fileType);
+  json += ",\"name\":" + jsonQuote(st.programName);
+  json += ",\"name2\":" + jsonQuote(st.programName2);
+  json += ",\"type\":" + jsonQuote(st.type);
+  json += ",\"group\":" + jsonQuote(st.group);
+  json += ",\"message\":" + jsonQuote(st.message);
+  json += ",\"size\":" + String(st.size);
+  json += ",\"block\":" + String(st.block);
+  json += ",\"totalBlocks\":" + String(st.totalBlocks);
+  json += ",\"progressBlock\":" + String(st.progressBlock);
+  json += ",\"progressTotal\":" + String(st.progressTotal);
+  json += ",\"positionMs\":" + String(st.positionMs);
+  json += ",\"tapeMs\":" + String(st.tapeMs);
+
+  tTransportStats tr = transport.getStats();
+  json += ",\"transport\":{";
+  json += "\"posted\":" + String(tr.posted);
+  json += ",\"acked\":" + String(tr.acked);
+  json += ",\"overflows\":" + String(tr.overflows);
+  json += ",\"lastAckUs\":" + String(tr.lastAckUs);
+  json += ",\"maxAckUs\":" + String(tr.maxAckUs);
+  json += ",\"avgAckUs\":" + String(tr.acked ? (uint32_t)(tr.totalAckUs / tr.acked) : 0);
+  json += "}}";
+  return json;
+}
+
+/**
+ * @brief SD scheduler latency histograms as JSON
+ *
+ * @return String
+ */
+String sdStatsJSON()
+{
+  String json = "{";
+  for (int c = 0; c < SDIO_CLASSES; c++)
+  {
+    tSDioStats st = sdsched.getStats((tSDioClass)c);
+    if (c) json += ",";
+    json += "\"" + String(SDscheduler::className(c)) + "\":{";
+    json += "\"requests\":" + String(st.requests);
+    json += ",\"maxWaitUs\":" + String(st.maxWaitUs);
+    json += ",\"maxTotalUs\":" + String(st.maxTotalUs);
+    json += ",\"hist\":[";
+    for (int b = 0; b < SDIO_HIST_BUCKETS; b++)
+    {
+      if (b) json += ",";
+      json += "[" + String(SDscheduler::bucketLimitUs(b)) + "," + String(st.hist[b]) + "]";
+    }
+    json += "]}";
+  }
+
+  tPrefetchStats pf = prefetcher.getStats();
+  json += ",\"prefetch\":{";
+  json += "\"hits\":" + String(pf.hits);
+  json += ",\"stalls\":" + String(pf.stalls);
+  json += ",\"misses\":" + String(pf.misses);
+  json += ",\"maxStallUs\":" + String(pf.maxStallUs);
+  json += "}}";
+  return json;
+}
+
+/**
+ * @brief Send PNG file from SPIFFS to webpage
+ * 
+ * @param imageFile
+ * @param request 
+ */
+void sendSpiffsImage(const char *imageFile,AsyncWebServerRequest *request)
+{
+  FILE *f = fopen(imageFile,"r");
+  fseek(f, 0, SEEK_END);
+  size_t size = ftell(f);
+  rewind(f);
+  uint8_t *buffer = (uint8_t*)ps_malloc(sizeof(uint8_t)*size);
+
+  fread(buffer, sizeof(uint8_t),size,f);
+  fclose(f);
+  request->send_P(200,"image/png",buffer,size);
+            
+  free(buffer);
+}
+
+/**
+ * @brief Delete directory recursive
+ * 
+ * @param dirPath -> directory path
+ * @return true/false if successful
+ */
+bool deleteDirRecursive(const char *dirPath)
+{
+  log_v("%s",dirPath);
+  String basePath = dirPath;
+  if (!basePath.endsWith("/"))
+  {
+      basePath += "/";
+  }
+
+  log_v("Processing directory: %s", basePath.c_str());
+
+  SDioLock lock(SDIO_INTERACTIVE);
+
+  File dir = webFile.open(basePath.c_str());
+  if (!dir || !dir.isDirectory())
+  {
+      log_e("Error: %s isn't a directory or can't open", basePath.c_str());
+      return false;
+  }
+
+  while (true)
+  {
+      File entry = dir.openNextFile();
+      if (!entry)
+      {
+          break; 
+      }
+
+      lock.yield();
+
+      String entryPath = basePath + entry.name(); 
+
+      if (entry.isDirectory())
+      {
+          log_v("Found subdirectory: %s", entryPath.c_str());
+          if (!deleteDirRecursive(entryPath.c_str()))
+          {
+              entry.close();
+              return false;
+          }
+      }
+      else
+      {
+          log_v("Found file: %s", entryPath.c_str());
+          if (!webFile.remove(entryPath.c_str()))
+          {
+              log_e("Error deleting file: %s", entryPath.c_str());
+              entry.close();
+              return false;
+          }
+          log_v("Deleted file: %s", entryPath.c_str());
+      }
+      entry.close();
+  }
+
+  dir.close();
+
+  if (!webFile.rmdir(basePath.c_str()))
+  {
+      log_e("Error deleting directory: %s", basePath.c_str());
+      return false;
+  }
+
+  log_v("Deleted directory: %s", basePath.c_str());
+  return true;
+}
+
+/**
+ * @brief Status WebSocket
+ *
+ * Pushes the tape status as deltas (RemoteStatus.h), at most
+ * REMOTE_STATUS_HZ times a second. A client gets the whole state when it
+ * connects.
+ */
+AsyncWebSocket ws("/ws");
+StatusDelta wsStatus;
+std::atomic<bool> wsSendFull{false};
+uint32_t wsLastMs = 0;
+
+/**
+ * @brief WebSocket events
+ *
+ */
+void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+{
+  if (type == WS_EVT_CONNECT)
+  {
+    log_i("ws client %u connected", client->id());
+    wsSendFull = true;
+  }
+}
+
+/**
+ * @brief Send pending status changes to the WebSocket clients
+ *
+ * Called from the HMI task loop. Does nothing without clients, and skips a
+ * round while a client still has frames queued; the changes are sent in
+ * the next one.
+ */
+void remoteStatusPump()
+{
+  uint32_t now = millis();
+  if (now - wsLastMs < 1000 / REMOTE_STATUS_HZ)
+    return;
+  wsLastMs = now;
+
+  ws.cleanupClients();
+  if (ws.count() == 0 || !ws.availableForWriteAll())
+    return;
+
+  tTapeStatus st;
+  tapeStatus.read(st);
+
+  wsStatus.begin();
+  wsStatus.addBool("play", st.play);
+  wsStatus.addBool("pause", st.pause);
+  wsStatus.addBool("stop", st.stop);
+  wsStatus.addBool("rec", st.rec);
+  wsStatus.addBool("eject", st.eject);
+  wsStatus.addInt("loadingState", st.loadingState);
+  wsStatus.addString("fileType", st.fileType);
+  wsStatus.addString("name", st.programName);
+  wsStatus.addString("type", st.type);
+  wsStatus.addString("message", st.message);
+  wsStatus.addInt("block", st.block);
+  wsStatus.addInt("totalBlocks", st.totalBlocks);
+  wsStatus.addInt("progressBlock", st.progressBlock);
+  wsStatus.addInt("progressTotal", st.progressTotal);
+  wsStatus.addInt("bytesLoaded", BYTES_LOADED);
+  wsStatus.addInt("positionMs", st.positionMs);
+  wsStatus.addInt("tapeMs", st.tapeMs);
+  wsStatus.addInt("volume", (int)MAIN_VOL);
+  wsStatus.addBool("inverted", INVERSETRAIN);
+  wsStatus.addInt("heapKB", ESP.getFreeHeap() / 1024);
+  wsStatus.addInt("psramKB", ESP.getFreePsram() / 1024);
+
+  std::string out;
+  if (wsSendFull.exchange(false))
+  {
+    // The full state becomes the base for the next deltas
+    wsStatus.delta(out);
+    wsStatus.full(out);
+  }
+  else if (!wsStatus.delta(out))
+  {
+    return;
+  }
+  ws.textAll(out.c_str(), out.length());
+}
+
+/**
+ * @brief Reply to an accepted API command
+ *
+ * Commands are queued for the player task; the reply does not wait for
+ * them. /api/ack?seq= tells when one was applied.
+ *
+ * @param request
+ * @param cmd
+ * @param seq
+ */
+void apiAccepted(AsyncWebServerRequest *request, uint8_t cmd, uint32_t seq)
+{
+  request->send(202, "application/json",
+                "{\"cmd\":\"" + String(TransportBus::name(cmd)) + "\",\"seq\":" + String(seq) + "}");
+}
+
+/**
+ * @brief Reply with a JSON error
+ *
+ * @param request
+ * @param code
+ * @param message
+ */
+void apiError(AsyncWebServerRequest *request, int code, const char *message)
+{
+  request->send(code, "application/json", "{\"error\":" + jsonQuote(message) + "}");
+}
+
+/**
+ * @brief Integer parameter from the query string or a form body
+ *
+ * @param request
+ * @param name
+ * @param value
+ * @return true if present
+ */
+bool apiIntParam(AsyncWebServerRequest *request, const char *name, int &value)
+{
+  AsyncWebParameter *p = request->getParam(name, true);
+  if (p == nullptr)
+    p = request->getParam(name);
+  if (p == nullptr)
+    return false;
+  value = p->value().toInt();
+  return true;
+}
+
+/**
+ * @brief Text parameter from the form body or the query string
+ *
+ * @param request
+ * @param name
+ * @param value
+ * @return false if missing
+ */
+bool apiStringParam(AsyncWebServerRequest *request, const char *name, String &value)
+{
+  AsyncWebParameter *p = request->getParam(name, true);
+  if (p == nullptr)
+    p = request->getParam(name);
+  if (p == nullptr)
+    return false;
+  value = p->value();
+  return true;
+}
+
+/**
+ * @brief Transport commands without arguments
+ *
+ */
+struct tApiCommand
+{
+  const char *path;
+  uint8_t cmd;
+};
+
+static const tApiCommand API_COMMANDS[] = {
+    {"/api/play", TCMD_PLAY},
+    {"/api/stop", TCMD_STOP},
+    {"/api/pause", TCMD_PAUSE},
+    {"/api/ffwd", TCMD_FFWD},
+    {"/api/rwd", TCMD_RWD},
+    {"/api/eject", TCMD_EJECT},
+    {"/api/rec", TCMD_REC},
+};
+
+/**
+ * @brief State of one streamed /api/tape reply
+ *
+ * Blocks are read from the descriptor cache or the tape headers while the
+ * reply is sent, so the block list is never held in memory. The totals go
+ * after the page because they are only known once the walk ends.
+ */
+struct tTapeStream
+{
+  TapeInspection insp;
+  String path;
+  String format;
+  int cursor = 0;
+  int end = 0;
+  bool verify = false;
+  int stage = 0;
+  int total = 0;
+  uint64_t tapeMs = 0;
+  uint32_t t0 = 0;
+
+  size_t len = 0;
+  size_t pos = 0;
+  char row[768];
+};
+
+/**
+ * @brief Produce the next piece of a /api/tape reply into st.row
+ *
+ * @param st
+ * @return false when the reply is complete
+ */
+bool tapeNextPiece(tTapeStream &st)
+{
+  int n = 0;
+  tInspectBlock b;
+
+  switch (st.stage)
+  {
+  case 0:
+    n = snprintf(st.row, sizeof(st.row), "{\"path\":");
+    n += jsonQuoteTo(st.row + n, sizeof(st.row) - n - 128, st.path.c_str());
+    n += snprintf(st.row + n, sizeof(st.row) - n, ",\"format\":\"%s\",\"size\":%u,\"source\":\"%s\",\"cursor\":%d,\"blocks\":[",
+                  st.format.c_str(), (unsigned)st.insp.size,
+                  st.insp.inspector->source() == INSPECT_SOURCE_DSC ? "dsc" : "scan", st.cursor);
+    st.stage = 1;
+    break;
+
+  case 1:
+    while (true)
+    {
+      if (!st.insp.inspector->next(b))
+      {
+        st.stage = 2;
+        return tapeNextPiece(st);
+      }
+
+      int i = st.total++;
+      st.tapeMs += (uint64_t)b.ms * b.passes;
+      if (i < st.cursor || i >= st.end)
+        continue;
+
+      if (st.verify)
+        st.insp.inspector->verify(b);
+      if (i > st.cursor)
+        st.row[n++] = ',';
+      n += inspectBlockJSON(st.row + n, sizeof(st.row) - n, b);
+      break;
+    }
+    break;
+
+  case 2:
+    n = snprintf(st.row, sizeof(st.row), "],\"total\":%d,\"tapeMs\":%llu,\"next\":%d,\"error\":%s}",
+                 st.total, (unsigned long long)st.tapeMs, st.end < st.total ? st.end : -1,
+                 st.insp.inspector->error() ? "true" : "false");
+    inspectStats.requests++;
+    inspectStats.lastBlocks = st.total;
+    inspectStats.lastUs = micros() - st.t0;
+    st.stage = 3;
+    break;
+
+  default:
+    return false;
+  }
+
+  st.len = n;
+  st.pos = 0;
+  return true;
+}
+
+/**
+ * @brief Chunk callback of a /api/tape reply
+ *
+ * @param st
+ * @param buffer
+ * @param maxLen
+ * @return size_t bytes written, 0 when done
+ */
+size_t tapeFill(tTapeStream &st, uint8_t *buffer, size_t maxLen)
+{
+  size_t n = 0;
+
+  while (n < maxLen)
+  {
+    if (st.pos == st.len && !tapeNextPiece(st))
+      break;
+
+    size_t chunk = st.len - st.pos;
+    if (chunk > maxLen - n)
+      chunk = maxLen - n;
+    memcpy(buffer + n, st.row + st.pos, chunk);
+    st.pos += chunk;
+    n += chunk;
+  }
+  return n;
+}
+
+/**
+ * @brief Block list of a tape file
+ *
+ * TZX/TSX/CDT files are listed from the .dsc descriptor the player wrote
+ * when it is newer than the tape and matches its size; otherwise, and for
+ * TAP files, the block headers are walked. The tape is never re-parsed by
+ * the player and the .dsc is never written here.
+ *
+ * @param request
+ */
+void handleTapeInspect(AsyncWebServerRequest *request)
+{
+  AsyncWebParameter *p = request->getParam("path");
+  if (p == nullptr)
+  {
+    apiError(request, 400, "path param required");
+    return;
+  }
+
+  String path = p->value();
+  if (!path.startsWith("/"))
+    path = (oldDir == "/" ? "/" : oldDir + "/") + path;
+
+  int cursor = 0;
+  int limit = INSPECT_LIMIT;
+  int verify = 0;
+  apiIntParam(request, "cursor", cursor);
+  apiIntParam(request, "limit", limit);
+  apiIntParam(request, "verify", verify);
+  if (cursor < 0)
+    cursor = 0;
+  if (limit <= 0 || limit > INSPECT_LIMIT_MAX)
+    limit = INSPECT_LIMIT;
+
+  bool exists;
+  {
+    SDioLock lock(SDIO_INTERACTIVE);
+    exists = sdf.exists(path.c_str());
+  }
+  if (!exists)
+  {
+    apiError(request, 404, "file not found");
+    return;
+  }
+
+  std::shared_ptr<tTapeStream> st(new tTapeStream());
+  if (!st->insp.open(path))
+  {
+    apiError(request, 400, "not a tape file");
+    return;
+  }
+
+  st->t0 = micros();
+  st->path = path;
+  st->format = path.substring(path.lastIndexOf('.') + 1);
+  st->format.toUpperCase();
+  st->cursor = cursor;
+  st->end = cursor + limit;
+  st->verify = verify != 0;
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+    [st](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+    {
+      return tapeFill(*st, buffer, maxLen);
+    });
+
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+/**
+ * @brief Library integrity scan status as JSON
+ *
+ * @return String
+ */
+String integrityStatusJSON()
+{
+  tIntegrityStatus st = integrity.status();
+  const tIntegrityTotals &t = st.totals;
+
+  String json = "{\"running\":" + String(st.running ? "true" : "false");
+  json += ",\"done\":" + String(st.done ? "true" : "false");
+  json += ",\"current\":" + jsonQuote(st.current.c_str());
+  json += ",\"tapes\":" + String(t.tapes);
+  json += ",\"blocks\":" + String(t.blocks);
+  json += ",\"checked\":" + String(t.checked);
+  json += ",\"bad\":" + String(t.bad);
+  json += ",\"unsupported\":" + String(t.unsupported);
+  json += ",\"truncated\":" + String(t.truncated);
+  json += ",\"badTapes\":" + String(t.badTapes);
+  json += ",\"elapsedMs\":" + String(st.elapsedMs);
+  json += "}";
+  return json;
+}
+
+/**
+ * @brief WAV digitiser queue status as JSON
+ *
+ * @return String
+ */
+String digitiseStatusJSON()
+{
+  tDigitiseStatus st = digitiser.status();
+
+  String json = "{\"running\":" + String(st.running ? "true" : "false");
+  json += ",\"queued\":" + String(st.queued);
+  json += ",\"current\":" + jsonQuote(st.current.c_str());
+  json += ",\"size\":" + String(st.size);
+  json += ",\"read\":" + String(st.read);
+  json += ",\"files\":" + String(st.files);
+  json += ",\"failed\":" + String(st.failed);
+  json += ",\"skipped\":" + String(st.skipped);
+  json += ",\"blocks\":" + String(st.blocks);
+  json += ",\"written\":" + String(st.written);
+  json += ",\"badChecksum\":" + String(st.badChecksum);
+  json += ",\"audioMs\":" + String(st.audioMs);
+  json += ",\"elapsedMs\":" + String(st.elapsedMs);
+  json += "}";
+  return json;
+}
+
+/**
+ * @brief Queue WAV captures for conversion to TAP or TZX
+ *
+ * "path" is a WAV file or a folder (its WAV files, not subfolders). The
+ * output goes next to each WAV; existing outputs are kept unless
+ * overwrite=1.
+ *
+ * @param request
+ */
+void handleDigitise(AsyncWebServerRequest *request)
+{
+  String action;
+  if (apiStringParam(request, "action", action) && action == "stop")
+  {
+    digitiser.stop();
+    request->send(202, "application/json", digitiseStatusJSON());
+    return;
+  }
+
+  String path;
+  if (!apiStringParam(request, "path", path))
+  {
+    apiError(request, 400, "path param required");
+    return;
+  }
+  if (!path.startsWith("/"))
+    path = (oldDir == "/" ? "/" : oldDir + "/") + path;
+
+  String format = "tap";
+  int overwrite = 0;
+  apiStringParam(request, "format", format);
+  apiIntParam(request, "overwrite", overwrite);
+  format.toLowerCase();
+  if (format != "tap" && format != "tzx")
+  {
+    apiError(request, 400, "format=tap|tzx required");
+    return;
+  }
+
+  bool exists;
+  {
+    SDioLock lock(SDIO_INTERACTIVE);
+    exists = sdf.exists(path.c_str());
+  }
+  if (!exists)
+  {
+    apiError(request, 404, "file not found");
+    return;
+  }
+
+  if (!digitiser.request(path, format == "tzx", overwrite != 0))
+  {
+    apiError(request, 409, "queue full");
+    return;
+  }
+  request->send(202, "application/json", digitiseStatusJSON());
+}
+
+/**
+ * @brief Tape export progress as JSON
+ *
+ * audioMs is the length of what has been rendered so far; speed is how
+ * many times faster than real time it went.
+ *
+ * @return String
+ */
+String exportStatusJSON()
+{
+  tExportStatus st = tapeExport.status();
+  uint32_t audioMs = st.rate > 0 ? (uint32_t)((uint64_t)st.samples * 1000 / st.rate) : 0;
+
+  String json = "{\"state\":\"" + String(exportStateName(st.state)) + "\"";
+  json += ",\"path\":" + jsonQuote(st.path.c_str());
+  json += ",\"out\":" + jsonQuote(st.out.c_str());
+  json += ",\"format\":\"" + st.format + "\"";
+  json += ",\"bits\":" + String(st.bits);
+  json += ",\"rate\":" + String(st.rate);
+  json += ",\"size\":" + String(st.size);
+  json += ",\"bytesIn\":" + String(st.bytesIn);
+  json += ",\"bytesOut\":" + String(st.bytesOut);
+  json += ",\"samples\":" + String(st.samples);
+  json += ",\"audioMs\":" + String(audioMs);
+  json += ",\"elapsedMs\":" + String(st.ms);
+  json += ",\"speed\":" + String(st.ms > 0 ? (float)audioMs / st.ms : 0.0f, 1);
+  json += ",\"blocks\":" + String(st.blocks);
+  json += ",\"error\":" + jsonQuote(st.error.c_str());
+  json += "}";
+  return json;
+}
+
+/**
+ * @brief Queue a tape export to WAV or CSW
+ *
+ * The player renders it the next time it is idle. The output goes next to
+ * the tape unless "out" is given.
+ *
+ * @param request
+ */
+void handleExport(AsyncWebServerRequest *request)
+{
+  String action;
+  if (apiStringParam(request, "action", action) && action == "stop")
+  {
+    tapeExport.stop();
+    request->send(202, "application/json", exportStatusJSON());
+    return;
+  }
+
+  String path;
+  if (!apiStringParam(request, "path", path))
+  {
+    apiError(request, 400, "path param required");
+    return;
+  }
+  if (!path.startsWith("/"))
+    path = (oldDir == "/" ? "/" : oldDir + "/") + path;
+
+  String ext = path.substring(path.lastIndexOf('.'));
+  ext.toUpperCase();
+  if (ext != ".TAP" && ext != ".TZX" && ext != ".CDT")
+  {
+    apiError(request, 400, "not a TAP, TZX or CDT file");
+    return;
+  }
+
+  String format = "wav";
+  int bits = 16;
+  int rate = 44100;
+  apiStringParam(request, "format", format);
+  apiIntParam(request, "bits", bits);
+  apiIntParam(request, "rate", rate);
+  format.toLowerCase();
+  if (format != "wav" && format != "csw")
+  {
+    apiError(request, 400, "format=wav|csw required");
+    return;
+  }
+  if (bits != 8 && bits != 16)
+  {
+    apiError(request, 400, "bits=8|16 required");
+    return;
+  }
+  if (rate < EXPORT_RATE_MIN || rate > EXPORT_RATE_MAX)
+  {
+    apiError(request, 400, "rate 8000-48000 required");
+    return;
+  }
+
+  String out;
+  if (!apiStringParam(request, "out", out))
+    out = exportDefaultOut(path, format);
+  else if (!out.startsWith("/"))
+    out = (oldDir == "/" ? "/" : oldDir + "/") + out;
+
+  if (out == path)
+  {
+    apiError(request, 400, "out must differ from path");
+    return;
+  }
+
+  bool exists;
+  {
+    SDioLock lock(SDIO_INTERACTIVE);
+    exists = sdf.exists(path.c_str());
+  }
+  if (!exists)
+  {
+    apiError(request, 404, "file not found");
+    return;
+  }
+
+  if (!tapeExport.request(path, out, format, bits, rate))
+  {
+    apiError(request, 409, "export already running");
+    return;
+  }
+  request->send(202, "application/json", exportStatusJSON());
+}
+
+/**
+ * @brief Remote control API
+ *
+ * Every command goes through the transport bus, the same path as the
+ * display buttons:
+ *
+ *   GET  /api/status                     tape status
+ *   GET  /api/ack?seq=N                  {"acked":true} once command N was applied
+ *   POST /api/play|stop|pause|ffwd|rwd|eject|rec
+ *   POST /api/load?path=/GAMES/x.tzx     needs the tape stopped or empty
+ *   POST /api/seek?block=N | ?ms=N
+ *   POST /api/volume?value=0..100
+ *   POST /api/polarity?inverted=0|1
+ *   GET  /api/tape?path=...&cursor=0&limit=50&verify=0
+ *                                        block list, see handleTapeInspect
+ *   GET  /api/integrity                  checksum scan of every tape on the card
+ *   GET  /api/integrity?report=1         its report, one line per damaged tape
+ *   POST /api/integrity?action=start|resume|stop
+ *   GET  /api/export                     progress of the last export
+ *   POST /api/export?path=...&format=wav|csw&bits=8|16&rate=44100[&out=...]
+ *                                        render a tape to audio, see handleExport
+ *   POST /api/export?action=stop
+ *   GET  /api/digitise                   WAV to TAP/TZX conversion queue
+ *   GET  /api/digitise?report=1          its report, blocks found in each WAV
+ *   POST /api/digitise?path=/WAV&format=tap|tzx&overwrite=0|1
+ *   POST /api/digitise?action=stop
+ *
+ * Recording follows the display: rec arms it, pause starts it and stop
+ * ends it. Parameters may come in the query string or a form body.
+ */
+void configureRemoteApi()
+{
+  ws.onEvent(onWsEvent);
+  server.addHandler(&ws);
+
+  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request)
+            { request->send(200, "application/json", tapeStatusJSON()); });
+
+  server.on("/api/ack", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+              int seq;
+              if (!apiIntParam(request, "seq", seq))
+              {
+                apiError(request, 400, "seq param required");
+                return;
+              }
+              request->send(200, "application/json",
+                            "{\"acked\":" + String(transport.acked(seq) ? "true" : "false") + "}"); });
+
+  for (const tApiCommand &c : API_COMMANDS)
+  {
+    uint8_t cmd = c.cmd;
+    server.on(c.path, HTTP_POST, [cmd](AsyncWebServerRequest *request)
+              { apiAccepted(request, cmd, transport.post(cmd)); });
+  }
+
+  server.on("/api/load", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              AsyncWebParameter *p = request->getParam("path", true);
+              if (p == nullptr)
+                p = request->getParam("path");
+              if (p == nullptr)
+              {
+                apiError(request, 400, "path param required");
+                return;
+              }
+
+              String path = p->value();
+              if (!path.startsWith("/"))
+                path = (oldDir == "/" ? "/" : oldDir + "/") + path;
+
+              String ext = path.substring(path.lastIndexOf('.'));
+              ext.toUpperCase();
+              if (ext != ".TAP" && ext != ".TZX" && ext != ".TSX" && ext != ".CDT" && ext != ".WAV" && ext != ".MP3")
+              {
+                apiError(request, 400, "not a tape or audio file");
+                return;
+              }
+
+              bool exists;
+              {
+                SDioLock lock(SDIO_INTERACTIVE);
+                exists = sdf.exists(path.c_str());
+              }
+              if (!exists)
+              {
+                apiError(request, 404, "file not found");
+                return;
+              }
+
+              apiAccepted(request, TCMD_LOAD, transportLoad(path.c_str())); });
+
+  server.on("/api/seek", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              int v;
+              if (apiIntParam(request, "block", v))
+                apiAccepted(request, TCMD_SEEK, transport.post(TCMD_SEEK, v));
+              else if (apiIntParam(request, "ms", v))
+                apiAccepted(request, TCMD_SEEK_MS, transport.post(TCMD_SEEK_MS, v));
+              else
+                apiError(request, 400, "block or ms param required"); });
+
+  server.on("/api/volume", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              int v;
+              if (!apiIntParam(request, "value", v) || v < 0 || v > 100)
+              {
+                apiError(request, 400, "value 0-100 required");
+                return;
+              }
+              apiAccepted(request, TCMD_VOLUME, transport.post(TCMD_VOLUME, v)); });
+
+  server.on("/api/polarity", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              int v;
+              if (!apiIntParam(request, "inverted", v))
+              {
+                apiError(request, 400, "inverted param required");
+                return;
+              }
+              apiAccepted(request, TCMD_POLARITY, transport.post(TCMD_POLARITY, v ? 1 : 0)); });
+
+  server.on("/api/tape", HTTP_GET, handleTapeInspect);
+
+  server.on("/api/integrity", HTTP_GET | HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              if (request->method() == HTTP_GET)
+              {
+                if (request->hasParam("report"))
+                {
+                  bool exists;
+                  {
+                    SDioLock lock(SDIO_INTERACTIVE);
+                    exists = sdf.exists(INTEGRITY_REPORT);
+                  }
+                  if (!exists)
+                    apiError(request, 404, "no report yet");
+                  else
+                    sendSdFile(request, INTEGRITY_REPORT, "text/plain");
+                  return;
+                }
+                request->send(200, "application/json", integrityStatusJSON());
+                return;
+              }
+
+              AsyncWebParameter *p = request->getParam("action", true);
+              if (p == nullptr)
+                p = request->getParam("action");
+              String action = p != nullptr ? p->value() : String("");
+
+              if (action == "stop")
+                integrity.stop();
+              else if (action != "start" && action != "resume")
+              {
+                apiError(request, 400, "action=start|resume|stop required");
+                return;
+              }
+              else if (!integrity.start(action == "resume"))
+              {
+                apiError(request, 409, "scan already running");
+                return;
+              }
+              request->send(202, "application/json", integrityStatusJSON()); });
+
+  server.on("/api/export", HTTP_GET, [](AsyncWebServerRequest *request)
+            { request->send(200, "application/json", exportStatusJSON()); });
+  server.on("/api/export", HTTP_POST, handleExport);
+
+  server.on("/api/digitise", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+              if (request->hasParam("report"))
+              {
+                bool exists;
+                {
+                  SDioLock lock(SDIO_INTERACTIVE);
+                  exists = sdf.exists(DIGITISE_REPORT);
+                }
+                if (!exists)
+                  apiError(request, 404, "no report yet");
+                else
+                  sendSdFile(request, DIGITISE_REPORT, "text/plain");
+                return;
+              }
+              request->send(200, "application/json", digitiseStatusJSON()); });
+  server.on("/api/digitise", HTTP_POST, handleDigitise);
+}
+
+/**
+ * @brief Streaming play request state
+ *
+ */
+struct tStreamRequest
+{
+  bool accepted = false;
+  bool done = false;
+  bool overflow = false;
+  const char *error = nullptr;
+  uint32_t bytes = 0;
+  UploadSession *tee = nullptr;
+};
+
+// Connection feeding the stream. Only used from the AsyncTCP task
+AsyncClient *streamClient = nullptr;
+
+/**
+ * @brief End of the data for a streaming play request
+ *
+ * @param s
+ * @param complete -> false if the connection dropped
+ * @return true if a copy was saved to the SD
+ */
+bool streamRequestEnd(tStreamRequest *s, bool complete)
+{
+  if (s->accepted && !s->done)
+  {
+    s->done = true;
+    streamClient = nullptr;
+    streamTape.producerDone(complete);
+  }
+
+  bool saved = false;
+  if (s->tee != nullptr)
+  {
+    saved = s->tee->closeFile(complete);
+    delete s->tee;
+    s->tee = nullptr;
+  }
+  return saved;
+}
+
+/**
+ * @brief Streaming play state of a request, created with the first body chunk
+ *
+ * @param request
+ * @return tStreamRequest*
+ */
+tStreamRequest *streamRequest(AsyncWebServerRequest *request)
+{
+  if (request->_tempObject == nullptr)
+  {
+    request->_tempObject = new tStreamRequest();
+    request->onDisconnect([request]()
+                          {
+                            tStreamRequest *s = (tStreamRequest *)request->_tempObject;
+                            if (s != nullptr)
+                            {
+                              streamRequestEnd(s, false);
+                              delete s;
+                              request->_tempObject = nullptr;
+                            } });
+  }
+  return (tStreamRequest *)request->_tempObject;
+}
+
+/**
+ * @brief Acknowledge deferred stream bytes to TCP
+ *
+ * AsyncClient only counts a chunk as deferred after its data callback
+ * returns, so part of a grant may not be ackable yet; it is kept for the
+ * next one.
+ *
+ * @param client
+ * @param k
+ */
+void streamAck(AsyncClient *client, size_t k)
+{
+  if (k == 0)
+    return;
+
+  size_t done = client->ack(k);
+  if (done < k)
+    streamTape.credit.received(k - done);
+}
+
+/**
+ * @brief Reopen the TCP window as the player drains the ring
+ *
+ * Runs on the connection poll (every ~500 ms), which keeps feeding the
+ * ring once the window was closed and no more body chunks arrive. That
+ * is several times the rate a tape is played at.
+ *
+ * @param arg
+ * @param client
+ */
+void streamPoll(void *arg, AsyncClient *client)
+{
+  if (client != streamClient)
+    return;
+
+  streamAck(client, streamTape.credit.grant(streamTape.ring.space()));
+}
+
+/**
+ * @brief Body of POST /play
+ *
+ * The bytes go to the player ring. They are acknowledged to TCP only as
+ * the ring has room for them, so a full ring closes the receive window
+ * and the sender waits, without blocking the network task.
+ *
+ * @param request
+ * @param data
+ * @param len
+ * @param index
+ * @param total
+ */
+void handleStreamBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  tStreamRequest *s = streamRequest(request);
+
+  if (!index)
+  {
+    AsyncWebParameter *p = request->getParam("name");
+    String name = p != nullptr ? p->value() : String("stream");
+
+    if ((TAPESTATE != 0 && TAPESTATE != 10) || LOADING_STATE != 0)
+    {
+      s->error = "tape busy";
+    }
+    else if (!streamTape.open(name))
+    {
+      s->error = "another stream is playing";
+    }
+    else
+    {
+      s->accepted = true;
+      streamClient = request->client();
+      // The window may stay closed for minutes while a long block plays
+      request->client()->setRxTimeout(0);
+      // Replaces the request's own poll handler, which only resumes long
+      // responses; /play answers with a short JSON
+      request->client()->onPoll(streamPoll, nullptr);
+
+      AsyncWebParameter *save = request->getParam("save");
+      if (save != nullptr)
+      {
+        s->tee = new UploadSession();
+        s->tee->openFile(save->value(), total);
+      }
+    }
+  }
+
+  if (!s->accepted || s->done)
+    return;
+
+  s->bytes += len;
+  if (s->tee != nullptr)
+    s->tee->write(data, len);
+
+  AsyncClient *client = request->client();
+
+  if (streamTape.ring.aborted())
+  {
+    // The player stopped: the rest is only archived, if asked to
+    streamAck(client, streamTape.credit.release());
+    return;
+  }
+
+  client->ackLater();
+  if (streamTape.ring.write(data, len) < len)
+  {
+    s->overflow = true;
+    streamStats.overflows++;
+  }
+  streamStats.bytes += len;
+
+  // Earlier chunks first; this one is only ackable once the callback returns
+  streamAck(client, streamTape.credit.grant(streamTape.ring.space()));
+  streamTape.credit.received(len);
+}
+
+/**
+ * @brief Answer POST /play once the whole tape was received
+ *
+ * @param request
+ */
+void streamDone(AsyncWebServerRequest *request)
+{
+  tStreamRequest *s = (tStreamRequest *)request->_tempObject;
+  request->_tempObject = nullptr;
+
+  if (s == nullptr)
+  {
+    apiError(request, 400, "send the tape as the body, Content-Type: application/octet-stream");
+    return;
+  }
+
+  if (s->error != nullptr)
+  {
+    apiError(request, 409, s->error);
+    delete s;
+    return;
+  }
+
+  bool stopped = streamTape.ring.aborted();
+  bool saved = streamRequestEnd(s, true);
+
+  String json = "{\"bytes\":" + String(s->bytes);
+  json += ",\"stopped\":" + String(stopped ? "true" : "false");
+  json += ",\"saved\":" + String(saved ? "true" : "false");
+  json += ",\"overflow\":" + String(s->overflow ? "true" : "false");
+  json += "}";
+  delete s;
+
+  request->send(200, "application/json", json);
+}
+
+/**
+ * @brief Configure Web Server
+ * 
+ */
+void configureWebServer()
+{
+  {
+    SDioLock lock(SDIO_INTERACTIVE);
+    sdTotal = (sdf.clusterCount() * sdf.sectorsPerCluster() * 0.000512) * 1024 * 1024; 
+    sdf.card()->readCSD(&csd);
+    sdType = sdf.card()->type();
+    sdCap = csd.capacity();
+  }
+
+  server.onNotFound(webNotFound);
+  configureRemoteApi();
+  server.onFileUpload(handleUpload);
+  server.on("/", HTTP_POST, uploadDone, handleUpload);
+  server.on("/untar", HTTP_POST, uploadDone, handleTarUpload, handleTarBody);
+
+  // Play a tape while it is received: curl -H "Content-Type: application/octet-stream"
+  //   --data-binary @GAME.tzx "http://powadcr/play?name=GAME.tzx[&save=/STREAM/GAME.tzx]"
+  server.on("/play", HTTP_POST, streamDone, nullptr, handleStreamBody);
+  oldDir = "/";
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+              //getSdInfo();
+              String logMessage = "Client:" + request->client()->remoteIP().toString() + +" " + request->url();
+                log_i("%s", logMessage.c_str());
+                request->send_P(200, "text/html", index_html, webParser); 
+            });
+
+
+  server.on("/logo", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/logo_small.png",request); });
+            
+  server.on("/files", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/file.png",request); });
+
+  server.on("/folder", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/folder.png",request); });
+  
+  server.on("/down", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/download.png", request); });
+  
+  server.on("/up", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/upload.png", request); });          
+
+  server.on("/del", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/delete.png", request); });
+
+  server.on("/reb", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/reboot.png", request); });    
+
+  server.on("/list", HTTP_GET, [](AsyncWebServerRequest *request)
+            { sendSpiffsImage("/spiffs/list.png", request); });                    
+
+  server.on("/reboot", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+              String logMessage = "Client:" + request->client()->remoteIP().toString() + " " + request->url();
+              request->send(200, "text/html", reboot_html);
+              log_i("%s",logMessage.c_str());
+              rebootESP(); });
+
+  server.on("/sdstats", HTTP_GET, [](AsyncWebServerRequest *request)
+            { request->send(200, "application/json", sdStatsJSON()); });
+
+  server.on("/sdstats", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              if (request->hasParam("reset"))
+              {
+                sdsched.resetStats();
+                prefetcher.resetStats();
+              }
+              request->send(200, "application/json", sdStatsJSON()); });
+
+  server.on("/hmistats", HTTP_GET, [](AsyncWebServerRequest *request)
+            { request->send(200, "application/json", hmiStatsJSON()); });
+
+  server.on("/hmistats", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              if (request->hasParam("reset"))
+              {
+                hmiOut.resetStats();
+                hmiRx.resetStats();
+              }
+              if (request->hasParam("bench"))
+              {
+                HMI_LINK_BENCH_REQUEST = true;
+              }
+              request->send(200, "application/json", hmiStatsJSON()); });
+
+  server.on("/webstats", HTTP_GET, [](AsyncWebServerRequest *request)
+            { request->send(200, "application/json", webStatsJSON()); });
+
+  server.on("/webstats", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              if (request->hasParam("reset"))
+              {
+                listStats = tListStats();
+                uploadStats = tUploadStats();
+                downloadStats = tDownloadStats();
+                streamStats = tStreamStats();
+                inspectStats = tInspectStats();
+              }
+              request->send(200, "application/json", webStatsJSON()); });
+
+  // Replaced by /api/status and /api/seek
+  server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request)
+            { redirectLegacy(request, "/api/status"); });
+
+  server.on("/seek", HTTP_POST, [](AsyncWebServerRequest *request)
+            { redirectLegacy(request, "/api/seek"); });
+
+  server.on("/sdbench", HTTP_GET, [](AsyncWebServerRequest *request)
+            { request->send(200, "application/json", sdBenchJSON()); });
+
+  // Runs in the tape task. If something else is using the SD it is not started
+  // and "refused" says why.
+  server.on("/sdbench", HTTP_POST, [](AsyncWebServerRequest *request)
+            {
+              if (SD_BENCHMARK_RUNNING)
+              {
+                apiError(request, 409, "benchmark already running");
+                return;
+              }
+              SD_BENCHMARK_REQUEST = true;
+              request->send(202, "application/json", sdBenchJSON()); });
+
+  server.on("/thumb", HTTP_GET, [](AsyncWebServerRequest *request)
+            {
+              if (!request->hasParam("name"))
+              {
+                request->send(400, "text/plain", "ERROR: name param required");
+                return;
+              }
+
+              uint8_t *bmp = (uint8_t*)blockPool.alloc(THUMB_BMP_SIZE + THUMB_BYTES);
+              if (bmp == nullptr || !thumbCache.get(oldDir, request->getParam("name")->value(), bmp + THUMB_BMP_SIZE))
+              {
+                blockPool.release(bmp);
+                request->send(404, "text/plain", "ERROR: no thumbnail");
+                return;
+              }
+
+              thumbToBMP(bmp + THUMB_BMP_SIZE, bmp);
+              AsyncResponseStream *response = request->beginResponseStream("image/bmp", THUMB_BMP_SIZE);
+              response->write(bmp, THUMB_BMP_SIZE);
+              blockPool.release(bmp);
+              response->addHeader("Cache-Control", "max-age=60");
+              request->send(response); });
+
+  server.on("/listfiles", HTTP_GET, [](AsyncWebServerRequest *request)
             {
               String logMessage = "Client:" + request->client()->remoteIP().toString() + " " + request->url();
               log_i("%s", logMessage.c_str());
@@ -563,15 +2236,34 @@ void configureWebServer()
                 page = request->getParam("page")->value().toInt();
               }
         
-              if (updateList)
+              // An index hit unless the directory was never listed, so changes
+              // made by the recorder or the HMI show up without a rescan
+              cacheDirectoryContent(oldDir);
+
+              if (request->hasParam("format") && request->getParam("format")->value() == "json")
               {
-                //getSdInfo();
-                cacheDirectoryContent(oldDir);
+                int cursor = 0;
+                int limit = LIST_JSON_LIMIT;
+                if (request->hasParam("cursor"))
+                  cursor = request->getParam("cursor")->value().toInt();
+                if (request->hasParam("limit"))
+                  limit = request->getParam("limit")->value().toInt();
+                if (limit <= 0 || limit > LIST_JSON_LIMIT_MAX)
+                  limit = LIST_JSON_LIMIT;
+
+                if (cursor > 0 && request->hasParam("gen") && (uint32_t)request->getParam("gen")->value().toInt() != fileCacheGen)
+                {
+                  request->send(409, "text/plain", "ERROR: directory changed, restart from cursor 0");
+                  return;
+                }
+
+                sendListing(request, true, cursor, limit, 0);
+                return;
               }
 
-              request->send(200, "text/html", listFiles(true, page)); });
+              sendListing(request, false, page * FILES_PER_PAGE, FILES_PER_PAGE, page); });
 
-  server.on("/file", HTTP_GET, [](AsyncWebServerRequest *request)
+  server.on("/file", HTTP_GET | HTTP_HEAD, [](AsyncWebServerRequest *request)
             {
               String logMessage = "Client:" + request->client()->remoteIP().toString() + " " + request->url();
               log_i("%s", logMessage.c_str());
@@ -586,7 +2278,17 @@ void configureWebServer()
                 String path = oldDir + "/" + String(fileName);
                 log_i("%s",path.c_str());
 
-                if (!sdf.exists(path))
+                bool exists;
+                {
+                  SDioLock lock(SDIO_INTERACTIVE);
+                  exists = sdf.exists(path.c_str());
+                }
+
+                if (request->method() == HTTP_HEAD && strcmp(fileAction, "download") != 0)
+                {
+                  request->send(405, "text/plain", "ERROR: HEAD only for download");
+                }
+                else if (!exists)
                 {
                   request->send(400, "text/plain", "ERROR: file does not exist");
                 }
@@ -596,23 +2298,26 @@ void configureWebServer()
                   if (strcmp(fileAction, "download") == 0)
                   {
                     logMessage += " downloaded";
-                    request->send(webFile, path, "application/octet-stream");
+                    sendSdFile(request, path, "application/octet-stream");
                   }
                   else if (strcmp(fileAction, "deldir") == 0)
                   {
                     logMessage += " deleted";
                     deleteDirRecursive(path.c_str());
+                    dirIndex.removePath(path.c_str());
                     request->send(200, "text/plain", "Deleted Folder: " + String(fileName));
-                    updateList = true;
                   }
                   else if (strcmp(fileAction, "delete") == 0)
                   {
                     logMessage += " deleted";
                     char strpath[255] = {};
                     strcpy(strpath,path.c_str());
-                    sdf.remove(String(strpath));
+                    {
+                      SDioLock lock(SDIO_INTERACTIVE);
+                      sdf.remove(String(strpath));
+                    }
+                    dirIndex.removePath(strpath);
                     request->send(200, "text/plain", "Deleted File: " + String(fileName));
-                    updateList = true;
                   }
                   else
                   {
@@ -631,7 +2336,6 @@ void configureWebServer()
             {
               if (request->hasParam("dir"))
               {
-                updateList = false;
 
                 newDir = request->getParam("dir")->value();
                 log_i("new dir %s", newDir.c_str());
@@ -0,0 +1,433 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: AudioSink.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Destinos de las muestras que genera ZXProcessor.
+
+    ZXProcessor escribe siempre bloques de muestras estéreo de 16 bits (R, L) al códec. Con
+    ZXProcessor::set_sink() se pueden mandar a otro sitio, por ejemplo a un fichero, y entonces
+    el render va tan rápido como den la CPU y la SD.
+
+      WavSink   WAV PCM mono de 8 o 16 bits (canal R)
+      CswSink   CSW 1.01 con RLE: la duración en muestras de cada semipulso
+
+    Los dos escriben en un AudioByteOut, que en el ESP32 es un fichero de la SD con buffer
+    (SdAudioOut) y en el host puede ser un FILE*. Como no dependen del framework, la misma
+    secuencia de muestras da exactamente los mismos bytes en los dos sitios.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Bytes por muestra de ZXProcessor (R y L de 16 bits)
+#define AUDIO_SINK_FRAME 4
+
+#define CSW_HEADER_SIZE 0x20
+#define WAV_HEADER_SIZE 44
+
+// Buffer de SdAudioOut
+#define AUDIO_OUT_BUFFER 16384
+
+// Destino de las muestras de ZXProcessor
+class ZXAudioSink
+{
+    public:
+
+        virtual ~ZXAudioSink() {}
+        // frames = muestras R, L de 16 bits. len en bytes
+        virtual void write(const uint8_t* frames, size_t len) = 0;
+};
+
+// Donde escriben los formatos
+class AudioByteOut
+{
+    public:
+
+        virtual ~AudioByteOut() {}
+        virtual bool put(const uint8_t* data, size_t len) = 0;
+        // Reescribe bytes ya escritos (cabeceras)
+        virtual bool patch(uint32_t offset, const uint8_t* data, size_t len) = 0;
+};
+
+static inline void audioLe16(uint8_t* p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static inline void audioLe32(uint8_t* p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+class WavSink : public ZXAudioSink
+{
+    private:
+
+        AudioByteOut& _out;
+        uint32_t _rate;
+        uint8_t _bits;
+        uint32_t _samples = 0;
+        bool _ok = true;
+        uint8_t _tmp[512];
+
+    public:
+
+        WavSink(AudioByteOut& out, uint32_t rate, uint8_t bits)
+            : _out(out), _rate(rate), _bits(bits == 8 ? 8 : 16)
+        {
+        }
+
+        // Cabecera con los tamaños a 0. Se completan en finish()
+        bool begin()
+        {
+            uint8_t h[WAV_HEADER_SIZE];
+            uint32_t align = _bits / 8;
+
+            memcpy(h, "RIFF", 4);
+            audioLe32(h + 4, 0);
+            memcpy(h + 8, "WAVEfmt ", 8);
+            audioLe32(h + 16, 16);
+            audioLe16(h + 20, 1);           // PCM
+            audioLe16(h + 22, 1);           // Mono
+            audioLe32(h + 24, _rate);
+            audioLe32(h + 28, _rate * align);
+            audioLe16(h + 32, align);
+            audioLe16(h + 34, _bits);
+            memcpy(h + 36, "data", 4);
+            audioLe32(h + 40, 0);
+
+            _samples = 0;
+            _ok = _out.put(h, sizeof(h));
+            return _ok;
+        }
+
+        void write(const uint8_t* frames, size_t len) override
+        {
+            size_t k = 0;
+
+            for (size_t i = 0; i + AUDIO_SINK_FRAME <= len; i += AUDIO_SINK_FRAME)
+            {
+                int16_t s;
+                memcpy(&s, frames + i, 2);
+
+                if (_bits == 8)
+                {
+                    _tmp[k++] = (uint8_t)((s >> 8) + 128);
+                }
+                else
+                {
+                    audioLe16(_tmp + k, (uint16_t)s);
+                    k += 2;
+                }
+
+                if (k + 2 > sizeof(_tmp))
+                {
+                    _ok = _out.put(_tmp, k) && _ok;
+                    k = 0;
+                }
+                _samples++;
+            }
+
+            if (k > 0)
+            {
+                _ok = _out.put(_tmp, k) && _ok;
+            }
+        }
+
+        // Tamaños de la cabecera. El bloque de datos se rellena a tamaño par
+        bool finish()
+        {
+            uint32_t data = _samples * (_bits / 8);
+            uint8_t v[4];
+
+            if (data & 1)
+            {
+                uint8_t pad = 0;
+                _ok = _out.put(&pad, 1) && _ok;
+            }
+
+            audioLe32(v, 36 + data + (data & 1));
+            _ok = _out.patch(4, v, 4) && _ok;
+            audioLe32(v, data);
+            _ok = _out.patch(40, v, 4) && _ok;
+            return _ok;
+        }
+
+        uint32_t samples()
+        {
+            return _samples;
+        }
+
+        bool ok()
+        {
+            return _ok;
+        }
+};
+
+class CswSink : public ZXAudioSink
+{
+    private:
+
+        AudioByteOut& _out;
+        uint32_t _rate;
+        uint32_t _samples = 0;
+        uint32_t _run = 0;
+        bool _level = false;
+        bool _firstLevel = false;
+        bool _ok = true;
+        uint8_t _tmp[512];
+        size_t _k = 0;
+
+        void flush()
+        {
+            if (_k > 0)
+            {
+                _ok = _out.put(_tmp, _k) && _ok;
+                _k = 0;
+            }
+        }
+
+        // Un semipulso: 1 byte, o 0 + DWORD si no cabe
+        void emit(uint32_t run)
+        {
+            if (_k + 5 > sizeof(_tmp))
+            {
+                flush();
+            }
+
+            if (run <= 0xFF)
+            {
+                _tmp[_k++] = (uint8_t)run;
+            }
+            else
+            {
+                _tmp[_k++] = 0;
+                audioLe32(_tmp + _k, run);
+                _k += 4;
+            }
+        }
+
+    public:
+
+        // rate <= 65535 (WORD en CSW 1.01)
+        CswSink(AudioByteOut& out, uint32_t rate)
+            : _out(out), _rate(rate)
+        {
+        }
+
+        bool begin()
+        {
+            uint8_t h[CSW_HEADER_SIZE];
+            memset(h, 0, sizeof(h));
+            memcpy(h, "Compressed Square Wave\x1A", 23);
+            h[0x17] = 1;                    // Versión 1.01
+            h[0x18] = 1;
+            audioLe16(h + 0x19, _rate);
+            h[0x1B] = 1;                    // RLE
+            // 0x1C: polaridad inicial, se pone en finish()
+
+            _samples = 0;
+            _run = 0;
+            _k = 0;
+            _ok = _out.put(h, sizeof(h));
+            return _ok;
+        }
+
+        void write(const uint8_t* frames, size_t len) override
+        {
+            for (size_t i = 0; i + AUDIO_SINK_FRAME <= len; i += AUDIO_SINK_FRAME)
+            {
+                int16_t s;
+                memcpy(&s, frames + i, 2);
+                bool level = s > 0;
+
+                if (_samples == 0)
+                {
+                    _level = level;
+                    _firstLevel = level;
+                }
+                else if (level != _level)
+                {
+                    emit(_run);
+                    _run = 0;
+                    _level = level;
+                }
+
+                _run++;
+                _samples++;
+            }
+        }
+
+        bool finish()
+        {
+            uint8_t flags = 0;
+
+            if (_run > 0)
+            {
+                emit(_run);
+                _run = 0;
+            }
+            flush();
+
+            // Bit 0: el primer semipulso es alto
+            flags = _firstLevel ? 1 : 0;
+            _ok = _out.patch(0x1C, &flags, 1) && _ok;
+            return _ok;
+        }
+
+        uint32_t samples()
+        {
+            return _samples;
+        }
+
+        bool ok()
+        {
+            return _ok;
+        }
+};
+
+#ifdef ARDUINO
+
+// Fichero de la SD con buffer en PSRAM
+class SdAudioOut : public AudioByteOut
+{
+    private:
+
+        File32& _f;
+        tSDioClass _io;
+        uint8_t* _buf = nullptr;
+        size_t _n = 0;
+        uint32_t _size = 0;
+        bool _failed = false;
+
+        bool flush()
+        {
+            if (_n > 0 && !_failed)
+            {
+                if (sdsched.write(_f, _buf, _n, _io) != _n)
+                {
+                    _failed = true;
+                }
+            }
+            _n = 0;
+            return !_failed;
+        }
+
+    public:
+
+        SdAudioOut(File32& f, tSDioClass io = SDIO_INTERACTIVE) : _f(f), _io(io)
+        {
+        }
+
+        ~SdAudioOut()
+        {
+            end();
+        }
+
+        bool begin()
+        {
+            _buf = (uint8_t*)blockPool.alloc(AUDIO_OUT_BUFFER);
+            _n = 0;
+            _size = 0;
+            _failed = (_buf == nullptr);
+            return !_failed;
+        }
+
+        bool put(const uint8_t* data, size_t len) override
+        {
+            if (_failed)
+            {
+                return false;
+            }
+
+            _size += len;
+            while (len > 0)
+            {
+                size_t chunk = AUDIO_OUT_BUFFER - _n;
+                if (chunk > len)
+                {
+                    chunk = len;
+                }
+                memcpy(_buf + _n, data, chunk);
+                _n += chunk;
+                data += chunk;
+                len -= chunk;
+
+                if (_n == AUDIO_OUT_BUFFER && !flush())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool patch(uint32_t offset, const uint8_t* data, size_t len) override
+        {
+            if (!flush())
+            {
+                return false;
+            }
+
+            SDioLock lock(_io);
+            bool ok = _f.seekSet(offset) && _f.write(data, len) == len && _f.seekSet(_size);
+            _failed = !ok;
+            return ok;
+        }
+
+        // Vacía el buffer y lo devuelve al pool
+        bool end()
+        {
+            bool ok = flush();
+            if (_buf != nullptr)
+            {
+                blockPool.release(_buf);
+                _buf = nullptr;
+            }
+            return ok;
+        }
+
+        uint32_t size()
+        {
+            return _size;
+        }
+
+        bool failed()
+        {
+            return _failed;
+        }
+};
+
+#endif
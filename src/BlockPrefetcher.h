@@ -0,0 +1,276 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: BlockPrefetcher.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Lectura anticipada de bloques. Mientras el ZXProcessor está generando el tono guía, los datos
+    o la pausa del bloque en curso, una tarea auxiliar lee de la SD el siguiente bloque (o la
+    siguiente partición de SIZE_FOR_SPLIT) en un doble buffer de PSRAM.
+
+    Uso desde el reproductor:
+      buffer = prefetcher.get(file, offset, size);      // datos del trozo actual
+      prefetcher.prefetch(file, nextOffset, nextSize);  // se lee mientras se reproduce "buffer"
+
+    El buffer devuelto por get() es válido hasta la siguiente llamada a get().
+    Si la predicción falla, get() lee en el momento (igual que antes) y lo cuenta como "miss".
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+struct tPrefetchStats
+{
+    // El dato ya estaba en memoria cuando se pidió
+    uint32_t hits = 0;
+    // La lectura anticipada estaba en curso y hubo que esperarla
+    uint32_t stalls = 0;
+    // No había lectura anticipada (o no coincidía) y se leyó en el momento
+    uint32_t misses = 0;
+    // Peor espera en get() (us)
+    uint32_t maxStallUs = 0;
+};
+
+class BlockPrefetcher
+{
+    private:
+
+        uint8_t* _buf[2] = {nullptr, nullptr};
+        int _capacity = 0;
+        // Buffer entregado al reproductor. El otro es el de lectura anticipada
+        int _front = 0;
+
+        // Petición de lectura anticipada
+        File32 _file;
+        // De qué fichero es: el objeto y su primer sector (el mismo File32 se reabre con otro)
+        const File32* _pfSrc = nullptr;
+        uint32_t _pfSector = 0;
+        uint32_t _pfOffset = 0;
+        int _pfSize = 0;
+        bool _pending = false;
+        volatile bool _pfBusy = false;
+
+        TaskHandle_t _task = nullptr;
+        SemaphoreHandle_t _go = nullptr;
+        SemaphoreHandle_t _done = nullptr;
+
+        tPrefetchStats _stats;
+
+        static void worker(void* param)
+        {
+            BlockPrefetcher* self = (BlockPrefetcher*)param;
+
+            for (;;)
+            {
+                xSemaphoreTake(self->_go, portMAX_DELAY);
+
+                uint8_t* dst = self->_buf[1 - self->_front];
+                sdm.readFileRange32(self->_file, dst, self->_pfOffset, self->_pfSize, false, SDIO_PLAYBACK);
+
+                self->_pfBusy = false;
+                xSemaphoreGive(self->_done);
+            }
+        }
+
+        // Espera a que termine la lectura anticipada pendiente (si la hay)
+        void waitPending()
+        {
+            if (_pending)
+            {
+                xSemaphoreTake(_done, portMAX_DELAY);
+                _pending = false;
+            }
+        }
+
+        bool ensureCapacity(int size)
+        {
+            if (size <= _capacity && _buf[0] != nullptr && _buf[1] != nullptr)
+            {
+                return true;
+            }
+
+            waitPending();
+
+            int newCapacity = size > SIZE_FOR_SPLIT ? size : SIZE_FOR_SPLIT;
+
+            for (int n = 0; n < 2; n++)
+            {
+                if (_buf[n] != nullptr)
+                {
+                    free(_buf[n]);
+                }
+                _buf[n] = (uint8_t*)ps_calloc(newCapacity, sizeof(uint8_t));
+            }
+
+            if (_buf[0] == nullptr || _buf[1] == nullptr)
+            {
+                release();
+                return false;
+            }
+
+            _capacity = newCapacity;
+            return true;
+        }
+
+    public:
+
+        // Prepara buffers y tarea lectora. Se llama al empezar a reproducir.
+        void begin()
+        {
+            if (_task == nullptr)
+            {
+                _go = xSemaphoreCreateBinary();
+                _done = xSemaphoreCreateBinary();
+                // Mismo núcleo que el HMI (el reproductor va en el 0)
+                xTaskCreatePinnedToCore(worker, "prefetch", 4096, this, 4, &_task, 1);
+            }
+
+            ensureCapacity(SIZE_FOR_SPLIT);
+            _pending = false;
+        }
+
+        // Espera a la lectura en curso. Los buffers se conservan para el siguiente PLAY.
+        void end()
+        {
+            waitPending();
+
+            #ifdef DEBUGMODE
+                logln("Prefetch - hits: " + String(_stats.hits) + " stalls: " + String(_stats.stalls)
+                      + " misses: " + String(_stats.misses) + " max stall: " + String(_stats.maxStallUs) + " us");
+            #endif
+        }
+
+        // Descarta la lectura anticipada de "mFile". Hay que llamarlo antes de cerrarlo:
+        // la tarea lectora usa una copia del File32 y no se puede cortar a mitad.
+        void cancel(const File32 &mFile)
+        {
+            if (_pending && _pfSrc == &mFile)
+            {
+                waitPending();
+            }
+        }
+
+        // Libera la PSRAM (al expulsar la cinta)
+        void release()
+        {
+            waitPending();
+
+            for (int n = 0; n < 2; n++)
+            {
+                if (_buf[n] != nullptr)
+                {
+                    free(_buf[n]);
+                    _buf[n] = nullptr;
+                }
+            }
+            _capacity = 0;
+        }
+
+        // Programa la lectura de un rango que se va a pedir a continuación
+        void prefetch(File32 &mFile, uint32_t offset, int size)
+        {
+            if (_task == nullptr || size <= 0 || size > _capacity)
+            {
+                return;
+            }
+
+            // Si había una anterior que no se ha usado, se descarta
+            waitPending();
+
+            _file = mFile;
+            _pfSrc = &mFile;
+            _pfSector = mFile.firstSector();
+            _pfOffset = offset;
+            _pfSize = size;
+            _pfBusy = true;
+            _pending = true;
+            xSemaphoreGive(_go);
+        }
+
+        // Devuelve los datos del rango pedido
+        uint8_t* get(File32 &mFile, uint32_t offset, int size)
+        {
+            if (!ensureCapacity(size))
+            {
+                return nullptr;
+            }
+
+            if (_pending && _pfSrc == &mFile && _pfSector == mFile.firstSector()
+                && _pfOffset == offset && _pfSize == size)
+            {
+                bool ready = !_pfBusy;
+                unsigned long t0 = micros();
+
+                waitPending();
+
+                if (ready)
+                {
+                    _stats.hits++;
+                }
+                else
+                {
+                    uint32_t stall = micros() - t0;
+                    _stats.stalls++;
+                    if (stall > _stats.maxStallUs)
+                    {
+                        _stats.maxStallUs = stall;
+                    }
+                }
+            }
+            else
+            {
+                unsigned long t0 = micros();
+
+                waitPending();
+                uint8_t* dst = _buf[1 - _front];
+                sdm.readFileRange32(mFile, dst, offset, size, false, SDIO_PLAYBACK);
+
+                uint32_t stall = micros() - t0;
+                _stats.misses++;
+                if (stall > _stats.maxStallUs)
+                {
+                    _stats.maxStallUs = stall;
+                }
+            }
+
+            _front = 1 - _front;
+            return _buf[_front];
+        }
+
+        tPrefetchStats getStats()
+        {
+            return _stats;
+        }
+
+        void resetStats()
+        {
+            _stats = tPrefetchStats();
+        }
+};
+
+// Instancia única. Solo hay un reproductor activo (TAP o TZX) a la vez.
+BlockPrefetcher prefetcher;
@@ -78,6 +78,7 @@ class BlockProcessor
         {
             logln("Existe? " + String(path));
 
+            SDioLock lock(SDIO_INTERACTIVE);
             if(mFile.open(path,O_READ))
             {
               mFile.close();
@@ -97,6 +98,7 @@ class BlockProcessor
           _blTZX.path = path;
 
           // Lo creamos otra vez
+          SDioLock lock(SDIO_INTERACTIVE);
           if(mFile.open(_blTZX.path, O_RDWR | O_CREAT))
           {
             logln("DSC file created or overwrite");
@@ -118,6 +120,7 @@ class BlockProcessor
             #endif
 
             // Ahora vamos a pasarle todo el descriptor TZX completo
+            SDioLock lock(SDIO_INTERACTIVE);
             mFile.println(String(pos) + "," + 
                           String(descriptor.ID) + "," + 
                           String(descriptor.chk) + "," +
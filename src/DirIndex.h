@@ -0,0 +1,476 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: DirIndex.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Índice de directorios en memoria, compartido por el gestor de ficheros web y el browser
+    del HMI.
+
+      - Cada directorio visitado se guarda ordenado (LRU de DIRINDEX_SLOTS directorios).
+        Volver a un directorio ya visitado no toca la SD.
+      - La clave de orden de cada entrada se calcula una vez al añadirla: minúsculas y cada
+        grupo de dígitos como marca + longitud + dígitos sin ceros a la izquierda. Así
+        "juego2" < "juego10" y ordenar es solo memcmp.
+      - Subidas, borrados y grabaciones actualizan la entrada (addPath/removePath) en lugar
+        de volver a leer el directorio.
+
+    Las listas son inmutables. Un cambio crea una copia nueva, así que quien está enviando
+    una lista (listado web por trozos) sigue con la suya sin bloqueos.
+    Los nombres y las claves van en un único bloque por directorio (a la PSRAM si es grande).
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+// Directorios que se mantienen en memoria
+#ifndef DIRINDEX_SLOTS
+  #define DIRINDEX_SLOTS 6
+#endif
+
+// Marca de grupo de dígitos en la clave (entre los signos y las letras, como un dígito)
+#define DIRINDEX_DIGITS '0'
+
+struct tDirItem
+{
+    uint32_t name;
+    uint32_t key;
+    uint32_t size;
+    uint16_t nameLen;
+    uint16_t keyLen;
+    bool isDir;
+};
+
+struct tDirIndexStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t updates = 0;
+    uint32_t evictions = 0;
+    uint32_t walkUs = 0;     // Última lectura de un directorio
+};
+
+// Lista ordenada de un directorio. Directorios primero y después orden natural.
+class tDirList
+{
+    private:
+
+        std::vector<tDirItem> _items;
+        std::vector<char> _pool;
+
+        uint32_t push(const char* s, size_t len)
+        {
+            uint32_t at = _pool.size();
+            _pool.insert(_pool.end(), s, s + len);
+            _pool.push_back(0);
+            return at;
+        }
+
+        bool less(const tDirItem &a, const tDirItem &b) const
+        {
+            int n = a.keyLen < b.keyLen ? a.keyLen : b.keyLen;
+            int c = memcmp(&_pool[a.key], &_pool[b.key], n);
+            return c != 0 ? c < 0 : a.keyLen < b.keyLen;
+        }
+
+    public:
+
+        // Clave de orden. Primer byte: directorio antes que fichero.
+        static void sortKey(const char* name, bool isDir, std::string &key)
+        {
+            key.clear();
+            key += isDir ? '\x01' : '\x02';
+
+            for (const char* p = name; *p; )
+            {
+                if (isdigit((uint8_t)*p))
+                {
+                    while (*p == '0' && isdigit((uint8_t)p[1]))
+                    {
+                        p++;
+                    }
+
+                    const char* d = p;
+                    while (isdigit((uint8_t)*p))
+                    {
+                        p++;
+                    }
+
+                    size_t len = p - d;
+                    key += (char)DIRINDEX_DIGITS;
+                    key += (char)(len < 255 ? len : 255);
+                    key.append(d, len);
+                }
+                else
+                {
+                    key += (char)tolower((uint8_t)*p);
+                    p++;
+                }
+            }
+        }
+
+        void reserve(size_t n, size_t bytes)
+        {
+            _items.reserve(n);
+            _pool.reserve(bytes);
+        }
+
+        void add(const char* name, bool isDir, uint32_t size)
+        {
+            std::string key;
+            sortKey(name, isDir, key);
+
+            tDirItem it;
+            it.nameLen = strlen(name);
+            it.name = push(name, it.nameLen);
+            it.keyLen = key.size();
+            it.key = push(key.data(), key.size());
+            it.size = size;
+            it.isDir = isDir;
+            _items.push_back(it);
+        }
+
+        void sort()
+        {
+            std::sort(_items.begin(), _items.end(), [this](const tDirItem &a, const tDirItem &b) { return less(a, b); });
+            _items.shrink_to_fit();
+            _pool.shrink_to_fit();
+        }
+
+        // Inserta en su sitio (la lista ya está ordenada). Si ya existe se sustituye.
+        void insert(const char* name, bool isDir, uint32_t size)
+        {
+            remove(name);
+            add(name, isDir, size);
+            tDirItem it = _items.back();
+            _items.pop_back();
+            auto pos = std::lower_bound(_items.begin(), _items.end(), it, [this](const tDirItem &a, const tDirItem &b) { return less(a, b); });
+            _items.insert(pos, it);
+        }
+
+        bool remove(const char* name)
+        {
+            int i = find(name);
+            if (i < 0)
+            {
+                return false;
+            }
+            // El nombre y la clave se quedan en el bloque hasta la próxima lectura
+            _items.erase(_items.begin() + i);
+            return true;
+        }
+
+        int find(const char* name) const
+        {
+            for (size_t i = 0; i < _items.size(); i++)
+            {
+                if (strcasecmp(&_pool[_items[i].name], name) == 0)
+                {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        size_t count() const
+        {
+            return _items.size();
+        }
+
+        const char* name(size_t i) const
+        {
+            return &_pool[_items[i].name];
+        }
+
+        bool isDir(size_t i) const
+        {
+            return _items[i].isDir;
+        }
+
+        uint32_t size(size_t i) const
+        {
+            return _items[i].size;
+        }
+
+        size_t bytes() const
+        {
+            return _items.capacity() * sizeof(tDirItem) + _pool.capacity();
+        }
+};
+
+typedef std::shared_ptr<const tDirList> tDirListPtr;
+
+class DirIndex
+{
+    private:
+
+        struct tSlot
+        {
+            std::string dir;
+            tDirListPtr list;
+            uint32_t used = 0;
+        };
+
+        std::mutex _mtx;
+        tSlot _slots[DIRINDEX_SLOTS];
+        uint32_t _clock = 0;
+        // Cambia con cada actualización. Una lectura que se cruza con un cambio no se guarda.
+        uint32_t _gen = 0;
+        tDirIndexStats _stats;
+
+        // Con _mtx cogido
+        tSlot* slotOf(const std::string &dir)
+        {
+            for (int n = 0; n < DIRINDEX_SLOTS; n++)
+            {
+                if (_slots[n].list && _slots[n].dir == dir)
+                {
+                    return &_slots[n];
+                }
+            }
+            return nullptr;
+        }
+
+        // Con _mtx cogido. Aplica f a una copia de la lista del directorio (si está).
+        template <class F>
+        void update(const std::string &dir, F f)
+        {
+            _gen++;
+            tSlot* s = slotOf(dir);
+            if (s == nullptr)
+            {
+                return;
+            }
+
+            std::shared_ptr<tDirList> copy(new tDirList(*s->list));
+            f(*copy);
+            s->list = copy;
+            _stats.updates++;
+        }
+
+        static void split(const char* path, std::string &dir, std::string &name)
+        {
+            std::string p = norm(path);
+            size_t slash = p.rfind('/');
+            dir = norm(p.substr(0, slash).c_str());
+            name = p.substr(slash + 1);
+        }
+
+    public:
+
+        // "/TAP/F/" y "/tap/f" son el mismo directorio (FAT no distingue mayúsculas)
+        static std::string norm(const char* dir)
+        {
+            std::string d = dir;
+            while (d.size() > 1 && d.back() == '/')
+            {
+                d.pop_back();
+            }
+            if (d.empty() || d[0] != '/')
+            {
+                d.insert(d.begin(), '/');
+            }
+            for (auto &c : d)
+            {
+                c = tolower((uint8_t)c);
+            }
+            return d;
+        }
+
+        tDirListPtr find(const char* dir)
+        {
+            std::string d = norm(dir);
+            std::lock_guard<std::mutex> lk(_mtx);
+            tSlot* s = slotOf(d);
+            if (s == nullptr)
+            {
+                return nullptr;
+            }
+            s->used = ++_clock;
+            _stats.hits++;
+            return s->list;
+        }
+
+        // Lista del directorio. Si no está, walk(add) la lee (sin _mtx cogido) y se guarda.
+        // walk devuelve false si no se ha podido abrir el directorio.
+        template <class W, class C>
+        tDirListPtr get(const char* dir, W walk, C clockUs)
+        {
+            tDirListPtr hit = find(dir);
+            if (hit)
+            {
+                return hit;
+            }
+
+            uint32_t gen;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _stats.misses++;
+                gen = _gen;
+            }
+
+            uint32_t t0 = clockUs();
+            std::shared_ptr<tDirList> list(new tDirList());
+            if (!walk([&](const char* name, bool isDir, uint32_t size) { list->add(name, isDir, size); }))
+            {
+                return nullptr;
+            }
+            list->sort();
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            _stats.walkUs = clockUs() - t0;
+
+            if (gen == _gen)
+            {
+                // Hueco libre o el menos usado
+                tSlot* s = &_slots[0];
+                for (int n = 0; n < DIRINDEX_SLOTS; n++)
+                {
+                    if (!_slots[n].list)
+                    {
+                        s = &_slots[n];
+                        break;
+                    }
+                    if (_slots[n].used < s->used)
+                    {
+                        s = &_slots[n];
+                    }
+                }
+
+                if (s->list)
+                {
+                    _stats.evictions++;
+                }
+
+                s->dir = norm(dir);
+                s->list = list;
+                s->used = ++_clock;
+            }
+
+            return list;
+        }
+
+        // Fichero o directorio nuevo (o que ha cambiado de tamaño)
+        void addPath(const char* path, bool isDir, uint32_t size)
+        {
+            std::string dir, name;
+            split(path, dir, name);
+            if (name.empty())
+            {
+                return;
+            }
+
+            std::string orig = path;
+            while (orig.size() > 1 && orig.back() == '/')
+            {
+                orig.pop_back();
+            }
+            // Se conserva el nombre tal cual (mayúsculas) para mostrarlo
+            std::string shown = orig.substr(orig.rfind('/') + 1);
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            update(dir, [&](tDirList &l) { l.insert(shown.c_str(), isDir, size); });
+        }
+
+        void removePath(const char* path)
+        {
+            std::string dir, name;
+            split(path, dir, name);
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            update(dir, [&](tDirList &l) { l.remove(name.c_str()); });
+
+            // Si era un directorio, él y lo que cuelga de él dejan de valer
+            std::string d = norm(path);
+            for (int n = 0; n < DIRINDEX_SLOTS; n++)
+            {
+                if (_slots[n].list && (_slots[n].dir == d || _slots[n].dir.compare(0, d.size() + 1, d + "/") == 0))
+                {
+                    _slots[n].list.reset();
+                }
+            }
+        }
+
+        // El directorio se volverá a leer la próxima vez
+        void invalidate(const char* dir)
+        {
+            std::string d = norm(dir);
+            std::lock_guard<std::mutex> lk(_mtx);
+            _gen++;
+            tSlot* s = slotOf(d);
+            if (s != nullptr)
+            {
+                s->list.reset();
+            }
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _gen++;
+            for (int n = 0; n < DIRINDEX_SLOTS; n++)
+            {
+                _slots[n].list.reset();
+            }
+        }
+
+        tDirIndexStats getStats()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _stats;
+        }
+
+        size_t bytes()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            size_t b = 0;
+            for (int n = 0; n < DIRINDEX_SLOTS; n++)
+            {
+                if (_slots[n].list)
+                {
+                    b += _slots[n].list->bytes();
+                }
+            }
+            return b;
+        }
+};
+
+#ifdef ARDUINO
+
+// Instancia única
+DirIndex dirIndex;
+
+#endif
@@ -53,6 +53,10 @@ class HMI
           String fileType="";
       };
 
+      // Estado de la cinta (TapeStatus.h). La última copia leída y lo que ya se ha enviado.
+      tTapeStatus _status = {};
+      tTapeStatus _shown = {};
+
       void clearFileBuffer()
       {
         // Borramos todos los registros
@@ -123,6 +127,8 @@ class HMI
               while (sdm.file.openNext(&sdm.dir, O_RDONLY))
               {
                   esp_task_wdt_reset();
+                  // Si el reproductor necesita la SD le dejamos pasar
+                  sdsched.yield();
 
                   // Ok. Entonces es un fichero y cogemos su extensión
                   #ifdef DEBUGMODE
@@ -597,6 +603,9 @@ class HMI
 
           tFileLST fl;
 
+          // El browser accede a la SD como tráfico interactivo
+          SDioLock lock(SDIO_INTERACTIVE);
+
           clearFileBuffer();
 
           #ifdef DEBUGMODE
@@ -637,6 +646,9 @@ class HMI
                 forze_rescan=true;
               }
 
+              // Miniaturas de las cintas de este directorio (en segundo plano)
+              thumbCache.request(FILE_LAST_DIR, forze_rescan);
+
 
               // Si el fichero manejador esta abierto no se hacen mas comprobaciones.
               if (!LST_FILE_IS_OPEN)
@@ -1114,7 +1126,12 @@ class HMI
               else if (type == "TAP" || type == "TZX" || type == "TSX" || type == "CDT" || type == "WAV" || type == "MP3")
               {
                   //Fichero
-                  if (_sdf.exists("/fav/" + szName))
+                  bool inFav;
+                  {
+                    SDioLock lock(SDIO_INTERACTIVE);
+                    inFav = _sdf.exists("/fav/" + szName);
+                  }
+                  if (inFav)
                   {
                     color = 34815;   // Cyan - Indica que esta en favoritos
                   }
@@ -1203,6 +1220,14 @@ class HMI
           putFilesInScreen();          
       }
 
+      void resetBlockIndicatorsScreen()
+      {
+          writeString("tape.totalBlocks.val=0");
+          writeString("tape.currentBlock.val=0");
+          writeString("tape.progressTotal.val=0");
+          writeString("tape.progressBlock.val=0");
+      }
+
       void resetBlockIndicators()
       {
           PROGRAM_NAME = "";
@@ -1211,10 +1236,7 @@ class HMI
           strcpy(LAST_TYPE,"                                   ");
           LAST_SIZE = 0;
 
-          writeString("tape.totalBlocks.val=0");
-          writeString("tape.currentBlock.val=0");
-          writeString("tape.progressTotal.val=0");
-          writeString("tape.progressBlock.val=0");
+          resetBlockIndicatorsScreen();
 
           TOTAL_BLOCKS = 0;
           BLOCK_SELECTED = 0;
@@ -1278,6 +1300,8 @@ class HMI
       void reloadDir()
       {
           // Recarga el directorio
+          // El usuario pide recarga: el índice compartido vuelve a leer la SD
+          dirIndex.invalidate(FILE_LAST_DIR.c_str());
           FILE_PTR_POS = 1;
 
           LST_FILE_IS_OPEN = false;
@@ -1297,34 +1321,131 @@ class HMI
           putFilesInScreen();        
       }
 
+      // Con el bus cogido. Entre trozos se deja pasar al reproductor y al grabador
       void copyFile(File32 &fSource, File32 &fTarget)
       {
           size_t n;  
-          uint8_t buf[64];
+          uint8_t buf[512];
 
           while ((n = fSource.read(buf, sizeof(buf))) > 0) 
           {
             fTarget.write(buf, n);
+            sdsched.yield();
           }        
       }
 
+      // Controles del TAPE. Se llaman desde verifyCommand y desde dispatchFrame.
+      // Las variables del transporte las cambia la tarea del reproductor (TransportBus.h).
+      void cmdFfwd()
+      {
+          logln("FFWD pressed");
+          transport.post(TCMD_FFWD);
+      }
+
+      void cmdRwd()
+      {
+          logln("RWD pressed");
+          transport.post(TCMD_RWD);
+      }
+
+      void cmdPlay()
+      {
+          #ifdef DEBUGMODE
+            logAlert("PLAY pressed.");
+          #endif
+
+          transport.post(TCMD_PLAY);
+      }
+
+      void cmdRec()
+      {
+          #ifdef DEBUGMODE
+            logAlert("REC pressed.");
+          #endif
+
+          transport.post(TCMD_REC);
+      }
+
+      void cmdPause()
+      {
+          #ifdef DEBUGMODE
+            logAlert("PAUSE pressed.");
+          #endif
+
+          transport.post(TCMD_PAUSE);
+          //updateInformationMainPage();
+      }
+
+      void cmdStop()
+      {
+          #ifdef DEBUGMODE
+            logAlert("STOP pressed.");
+          #endif
+
+          transport.post(TCMD_STOP);
+      }
+
+      void cmdEject()
+      {
+          #ifdef DEBUGMODE
+            logAlert("EJECT pressed.");
+          #endif
+
+          // Si no se esta subiendo nada a la SD desde WiFi podemos abrir
+          if (!WF_UPLOAD_TO_SD)
+          {
+              transport.post(TCMD_EJECT);
+
+              // Esto lo hacemos así porque el EJECT lanza un comando en paralelo
+              // al control del tape (tapeControl)
+              // no quitar!!
+              tapeStatus.read(_status);
+              if (_status.programName[0] != 0 || _status.totalBlocks != 0)
+              {
+                  transportNotice("Ejecting cassette.");
+                  writeString("g0.txt=\"Ejecting cassette.\"");
+                  delay(500);
+                  transport.post(TCMD_CLEARINFO);
+                  clearInformationScreen();
+                  delay(250);
+              }
+
+              FILE_BROWSER_OPEN = true;
+              //
+              // Entramos en el file browser
+              writeString("page file");          
+              delay(250);
+              refreshFiles();
+          }
+          else
+          {
+            transportNotice("Wait to finish the uploading process.");
+          }
+      }
+
       void verifyCommand(String strCmd) 
+      {
+        verifyCommand(strCmd, hmiLookup(strCmd.c_str(), strCmd.length()));
+      }
+
+      // "cmd" es el identificador del token (hmiLookup), para no buscarlo dos veces
+      void verifyCommand(String strCmd, int cmd) 
       {
         
         // Reiniciamos el comando
         LAST_COMMAND = "";
 
         // Selección de bloque desde keypad - pantalla
-        if(strCmd.indexOf("RSET") != -1)
+        if(cmd == HMICMD_RSET)
         {
           delay(2000);
           ESP.restart();
         }
-        else if (strCmd.indexOf("DSD") != -1)
+        else if (cmd == HMICMD_DSD)
         {
             DISABLE_SD = true;
         }
-        else if (strCmd.indexOf("BKX=") != -1) 
+        else if (cmd == HMICMD_BKX) 
         {
             // Con este procedimiento capturamos el bloque seleccionado
             // desde la pantalla.
@@ -1334,20 +1455,17 @@ class HMI
 
               strCmd.getBytes(buff, 7);
               long val = (long)((int)buff[4] + (256*(int)buff[5]) + (65536*(int)buff[6]));
-              String num = String(val);
-              BLOCK_SELECTED = num.toInt() + 1;
               // updateInformationMainPage(true);
-              // Esto lo hacemos para poder actualizar la info del bloque
-              UPDATE = true;
+              transport.post(TCMD_SEEK, val + 1);
             }
 
         }
-        else if (strCmd.indexOf("REL=") != -1)
+        else if (cmd == HMICMD_REL)
         {
             // Recarga la pantalla de ficheros
             firstLoadingFilesFB();
         }
-        else if (strCmd.indexOf("PAG=") != -1) 
+        else if (cmd == HMICMD_PAG) 
         {
             // Con este procedimiento obtenemos la pàgina del filebrowser
             // que se desea visualizar
@@ -1388,7 +1506,7 @@ class HMI
             // Refrescamos el listado de ficheros visualizado
             refreshFiles();            
         }      
-        else if (strCmd.indexOf("INFB") != -1) 
+        else if (cmd == HMICMD_INFB) 
         {
             // Con este comando nos indica la pantalla que 
             // está en modo FILEBROWSER
@@ -1399,14 +1517,14 @@ class HMI
             #endif
 
         }
-        else if (strCmd.indexOf("SHR") != -1) 
+        else if (cmd == HMICMD_SHR) 
         {
             // Con este comando nos indica la pantalla que 
             // está en modo searching
             //FILE_BROWSER_SEARCHING = true;
             findTheTextInFiles();      
         }
-        else if (strCmd.indexOf("OUTFB") != -1) 
+        else if (cmd == HMICMD_OUTFB) 
         {
 
             // Con este comando nos indica la pantalla que 
@@ -1416,7 +1534,7 @@ class HMI
               logAlert("OUTFB output: File browser closed");
             #endif
         }
-        else if (strCmd.indexOf("GFIL") != -1) 
+        else if (cmd == HMICMD_GFIL) 
         {
             // Con este comando nos indica la pantalla que quiere
             // le devolvamos ficheros en la posición actual del puntero
@@ -1429,7 +1547,9 @@ class HMI
             //FILE_PREPARED = false;
             FILE_SELECTED = false;
 
-            resetIndicators();
+            // Desde la tarea del HMI: el borrado lo hace la tarea del reproductor
+            transport.post(TCMD_CLEARINFO);
+            resetBlockIndicatorsScreen();
 
             if (FILE_LAST_DIR_LAST != FILE_LAST_DIR)
             {
@@ -1452,11 +1572,11 @@ class HMI
                 //FILE_BROWSER_SEARCHING = false;                   
             }            
         }
-        else if (strCmd.indexOf("RFSH") != -1) 
+        else if (cmd == HMICMD_RFSH) 
         {
             reloadDir();
         }
-        else if (strCmd.indexOf("FINI") != -1) 
+        else if (cmd == HMICMD_FINI) 
         {
             // Posicionamos entonces en la primera página
             // Cogemos el primer item y refrescamos
@@ -1468,7 +1588,7 @@ class HMI
             delay(125);
             showInformationAboutFiles();                     
         }
-        else if (strCmd.indexOf("FEND") != -1) 
+        else if (cmd == HMICMD_FEND) 
         {
             // Posicionamos entonces en la ultima página
             int totalPages = ((FILE_TOTAL_FILES-1) / TOTAL_FILES_IN_BROWSER_PAGE);
@@ -1481,7 +1601,7 @@ class HMI
             delay(125);
             showInformationAboutFiles();                       
         }        
-        else if (strCmd.indexOf("FPUP") != -1) 
+        else if (cmd == HMICMD_FPUP) 
         {
             // Con este comando nos indica la pantalla que quiere
             // le devolvamos ficheros en la posición actual del puntero
@@ -1497,7 +1617,7 @@ class HMI
             delay(125);
             showInformationAboutFiles();            
         }
-        else if (strCmd.indexOf("FPDOWN") != -1) 
+        else if (cmd == HMICMD_FPDOWN) 
         {
             // Con este comando nos indica la pantalla que quiere
             // le devolvamos ficheros en la posición actual del puntero
@@ -1519,7 +1639,7 @@ class HMI
             delay(125);
             showInformationAboutFiles();
         }
-        else if (strCmd.indexOf("FPHOME") != -1) 
+        else if (cmd == HMICMD_FPHOME) 
         {
             // Con este comando nos indica la pantalla que quiere
             // le devolvamos ficheros en la posición actual del puntero
@@ -1537,7 +1657,7 @@ class HMI
             getFilesFromSD(false,SOURCE_FILE_TO_MANAGE,SOURCE_FILE_INF_TO_MANAGE);
             refreshFiles(); 
         }        
-        else if (strCmd.indexOf("FAV=") != -1) 
+        else if (cmd == HMICMD_FAV) 
         {
             
             #ifdef DEBUGMODE
@@ -1585,6 +1705,7 @@ class HMI
                 
                 //Esto lo hacemos para ver si el directorio existe
                 String favDir = "/FAV";
+                SDioLock lock(SDIO_INTERACTIVE);
 
                 if (_sdf.chdir(favDir))
                 {
@@ -1660,13 +1781,13 @@ class HMI
                 }
             }     
         }              
-        else if (strCmd.indexOf("BBOPEN") != -1)
+        else if (cmd == HMICMD_BBOPEN)
         {
           // Block browser abierto
           BB_OPEN = true;
           BB_PTR_ITEM = 0;
         }
-        else if (strCmd.indexOf("BBCL=") != -1)
+        else if (cmd == HMICMD_BBCL)
         {
           // Block browser cerrado con ID seleccionado o -1 para ninguno
           // Con este procedimiento obtenemos la pàgina del filebrowser
@@ -1681,12 +1802,12 @@ class HMI
 
           if (blsel >= 0 && blsel <= TOTAL_BLOCKS)
           {
-            BLOCK_SELECTED = blsel;
-            UPDATE_HMI = true;
+            // Reproduciendo, la cinta salta a ese bloque
+            transport.post(TCMD_SEEK, blsel);
           }         
           BB_OPEN = false;
         }        
-        else if (strCmd.indexOf("BDOWN") != -1)
+        else if (cmd == HMICMD_BDOWN)
         {
           // Pagina arriba block browser
           BB_PTR_ITEM += MAX_BLOCKS_IN_BROWSER;
@@ -1699,7 +1820,7 @@ class HMI
           BB_UPDATE = true;
 
         }
-        else if (strCmd.indexOf("BUP") != -1)
+        else if (cmd == HMICMD_BUP)
         {
           // Pagina arriba block browser
           BB_PTR_ITEM -= MAX_BLOCKS_IN_BROWSER;
@@ -1712,7 +1833,7 @@ class HMI
           BB_UPDATE = true;
 
         }
-        else if (strCmd.indexOf("CHD=") != -1) 
+        else if (cmd == HMICMD_CHD) 
         {
             // Con este comando capturamos el directorio a cambiar
             uint8_t buff[8];
@@ -1779,7 +1900,7 @@ class HMI
             }
 
         }
-        else if (strCmd.indexOf("PAR=") != -1) 
+        else if (cmd == HMICMD_PAR) 
         {
             // Con este comando capturamos el directorio padre
             String oldDir = FILE_PREVIOUS_DIR;
@@ -1835,7 +1956,7 @@ class HMI
             refreshFiles();
       
         }
-        else if (strCmd.indexOf("TRS=") != -1) 
+        else if (cmd == HMICMD_TRS) 
         {
             // Con este comando
             // Borramos el fichero que se ha seleccionado en la pantalla
@@ -1855,29 +1976,39 @@ class HMI
             if (FILE_SELECTED_DELETE)
             {
               // Lo Borramos
-                File32 mf = _sdf.open(FILE_TO_DELETE,O_WRONLY);
+                bool writable;
+                bool readOnly;
+                {
+                  SDioLock lock(SDIO_INTERACTIVE);
+                  File32 mf = _sdf.open(FILE_TO_DELETE,O_WRONLY);
+                  writable = mf.isWritable();
+                  readOnly = mf.isReadOnly();
+                  mf.close();
+                }
 
-                if (!mf.isWritable())
+                if (!writable)
                 {
                   writeString("currentDir.txt=\">> Error. File not writeable <<\"");
                   delay(1500);
                   writeString("currentDir.txt=\"" + String(FILE_LAST_DIR_LAST) + "\"");                  
-                  mf.close();
                   FILE_SELECTED_DELETE = false;
                 }
-                else if (mf.isReadOnly())
+                else if (readOnly)
                 { 
                   writeString("currentDir.txt=\">> Error. Readonly file <<\"");
                   delay(1500);
                   writeString("currentDir.txt=\"" + String(FILE_LAST_DIR_LAST) + "\"");                  
-                  mf.close();
                   FILE_SELECTED_DELETE = false;
                 }
                 else
                 {
-                    mf.close();
+                    bool removed;
+                    {
+                      SDioLock lock(SDIO_INTERACTIVE);
+                      removed = _sdf.remove(FILE_TO_DELETE);
+                    }
 
-                    if (!_sdf.remove(FILE_TO_DELETE))
+                    if (!removed)
                     {
                       #ifdef DEBUGMODE
                         logln("Error to remove file. " + FILE_TO_DELETE);
@@ -1892,6 +2023,7 @@ class HMI
                     {
                       FILE_SELECTED_DELETE = false;
                       logln("File remove. " + FILE_TO_DELETE);
+                      dirIndex.removePath(FILE_TO_DELETE.c_str());
                       
                       // Tras borrar hacemos un rescan
                       getFilesFromSD(true,SOURCE_FILE_TO_MANAGE,SOURCE_FILE_INF_TO_MANAGE);      
@@ -1907,7 +2039,7 @@ class HMI
             }
         }      
         // Load file - Carga en el TAPE el fichero seleccionado en pantalla
-        else if (strCmd.indexOf("LFI=") != -1) 
+        else if (cmd == HMICMD_LFI) 
         {
             // Con este comando
             // devolvamos el fichero que se ha seleccionado en la pantalla
@@ -1948,181 +2080,90 @@ class HMI
       
         }   
         // Configuración de frecuencias de muestreo
-        else if (strCmd.indexOf("FRQ1") != -1)
+        else if (cmd == HMICMD_FRQ1)
         {
           DfreqCPU = 3250000.0;
         }
-        else if (strCmd.indexOf("FRQ2") != -1)
+        else if (cmd == HMICMD_FRQ2)
         {
           DfreqCPU = 3300000.0;
         }
-        else if (strCmd.indexOf("FRQ3") != -1)
+        else if (cmd == HMICMD_FRQ3)
         {
           DfreqCPU = 3330000.0;
         }
-        else if (strCmd.indexOf("FRQ4") != -1)
+        else if (cmd == HMICMD_FRQ4)
         {
           DfreqCPU = 3350000.0;
         }
-        else if (strCmd.indexOf("FRQ5") != -1)
+        else if (cmd == HMICMD_FRQ5)
         {
           DfreqCPU = 3400000.0;
         }
-        else if (strCmd.indexOf("FRQ6") != -1)
+        else if (cmd == HMICMD_FRQ6)
         {
           DfreqCPU = 3430000.0;
         }
-        else if (strCmd.indexOf("FRQ7") != -1)
+        else if (cmd == HMICMD_FRQ7)
         {
           DfreqCPU = 3450000.0;
         }
-        else if (strCmd.indexOf("FRQ8") != -1)
+        else if (cmd == HMICMD_FRQ8)
         {
           DfreqCPU = 3500000.0;
         }
         // Indica que la pantalla está activa
-        else if (strCmd.indexOf("LCDON") != -1) 
+        else if (cmd == HMICMD_LCDON) 
         {
             LCD_ON = true;
         }
         // Control de TAPE
-        else if (strCmd.indexOf("FFWD") != -1) 
+        else if (cmd == HMICMD_FFWD) 
         {
-            logln("FFWD pressed");
-            FFWIND = true;
-            RWIND = false;
+            cmdFfwd();
         }
-        else if (strCmd.indexOf("RWD") != -1) 
+        else if (cmd == HMICMD_RWD) 
         {
-            logln("RWD pressed");
-            FFWIND = false;
-            RWIND = true;
+            cmdRwd();
         }
-        else if (strCmd.indexOf("PLAY") != -1) 
+        else if (cmd == HMICMD_PLAY) 
         {
-
-          #ifdef DEBUGMODE
-            logAlert("PLAY pressed.");
-          #endif
-
-          PLAY = true;
-          PAUSE = false;
-          STOP = false;
-          REC = false;
-          EJECT = false;
-          ABORT = false;
-
-          BTN_PLAY_PRESSED = true;
-        }   
-        else if (strCmd.indexOf("REC") != -1) 
+            cmdPlay();
+        }
+        else if (cmd == HMICMD_REC) 
         {
-
-          #ifdef DEBUGMODE
-            logAlert("REC pressed.");
-          #endif
-
-          PLAY = false;
-          PAUSE = false;
-          STOP = false;
-          REC = true;
-          ABORT = false;
-          EJECT = false;
+            cmdRec();
         }
-        else if (strCmd.indexOf("PAUSE") != -1) 
+        else if (cmd == HMICMD_PAUSE) 
         {
-
-          #ifdef DEBUGMODE
-            logAlert("PAUSE pressed.");
-          #endif
-
-          PLAY = false;
-          PAUSE = true;
-          STOP = false;
-          REC = false;
-          ABORT = true;
-          EJECT = false;
-          //updateInformationMainPage();
-        }    
-        else if (strCmd.indexOf("STOP") != -1) 
+            cmdPause();
+        }
+        else if (cmd == HMICMD_STOP) 
         {
-
-          #ifdef DEBUGMODE
-            logAlert("STOP pressed.");
-          #endif
-
-          PLAY = false;
-          PAUSE = false;
-          STOP = true;
-          REC = false;
-          ABORT = true;
-          EJECT = false;
-
-          BLOCK_SELECTED = 0;
-          BYTES_LOADED = 0;
-        }     
-        else if (strCmd.indexOf("EJECT") != -1) 
+            cmdStop();
+        }
+        else if (cmd == HMICMD_EJECT) 
         {
-          
-          
-          #ifdef DEBUGMODE
-            logAlert("EJECT pressed.");
-          #endif
-
-          // Si no se esta subiendo nada a la SD desde WiFi podemos abrir
-          if (!WF_UPLOAD_TO_SD)
-          {
-              PLAY = false;
-              PAUSE = false;
-              STOP = true;
-              REC = false;
-              ABORT = false;
-              EJECT = true;
-
-              // Esto lo hacemos así porque el EJECT lanza un comando en paralelo
-              // al control del tape (tapeControl)
-              // no quitar!!
-              if (PROGRAM_NAME != "" || TOTAL_BLOCKS !=0)
-              {
-                  LAST_MESSAGE = "Ejecting cassette.";
-                  writeString("g0.txt=\"" + LAST_MESSAGE + "\"");
-                  delay(500);
-                  clearInformationFile();
-                  delay(250);
-              }
-
-              FILE_BROWSER_OPEN = true;
-              //
-              // Entramos en el file browser
-              writeString("page file");          
-              delay(250);
-              refreshFiles();
-          }
-          else
-          {
-            LAST_MESSAGE = "Wait to finish the uploading process.";
-          }
-        }    
+            cmdEject();
+        }
         // Ajuste del volumen
-        else if (strCmd.indexOf("VOL=") != -1) 
+        else if (cmd == HMICMD_VOL) 
         {
           //Cogemos el valor
           uint8_t buff[8];
           strCmd.getBytes(buff, 7);
           int valVol = (int)buff[4];
-          MAIN_VOL = valVol;
           
-          // Ajustamos el volumen
-          logln("Main volume value=" + String(MAIN_VOL));
-          // Control del Master volume
-          MAIN_VOL_L = MAIN_VOL;
-          MAIN_VOL_R = MAIN_VOL;
+          // Ajustamos el volumen (master, L y R) por el transporte, igual que la web
+          logln("Main volume value=" + String(valVol));
+          transport.post(TCMD_VOLUME, valVol);
 
           // ESP32kit.setVolume(MAIN_VOL);
           //ESP32kit.maxAmplitude = 
           //_zxp.set_amplitude(MAIN_VOL * 32767 / 100);
         }
         // Ajuste el vol canal R
-        else if (strCmd.indexOf("VRR=") != -1) 
+        else if (cmd == HMICMD_VRR) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2132,7 +2173,7 @@ class HMI
           MAIN_VOL_R = valVol;
         }
         // Ajuste el vol canal L
-        else if (strCmd.indexOf("VLL=") != -1) 
+        else if (cmd == HMICMD_VLL) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2148,7 +2189,7 @@ class HMI
           #endif
         }
         // Devuelve el % de filtrado aplicado en pantalla. Filtro del recording
-        else if (strCmd.indexOf("THR=") != -1) 
+        else if (cmd == HMICMD_THR) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2158,7 +2199,7 @@ class HMI
           logln("Threshold value=" + String(SCHMITT_THR));
         }
         // Habilitar terminadores para forzar siguiente pulso a HIGH
-        else if (strCmd.indexOf("TER=") != -1) 
+        else if (cmd == HMICMD_TER) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2182,34 +2223,21 @@ class HMI
           // #endif
         }
         // Polarización de la señal
-        else if (strCmd.indexOf("PLZ=") != -1) 
+        else if (cmd == HMICMD_PLZ) 
         {
           //Cogemos el valor
           uint8_t buff[8];
           strCmd.getBytes(buff, 7);
           int valEn = (int)buff[4];
-          //
-          if (valEn==1)
-          {
-              // Empieza en DOWN
-              POLARIZATION = up;
-              LAST_EAR_IS = up;
-              INVERSETRAIN = true;
-          }
-          else
-          {
-              // Empieza en UP
-              POLARIZATION = down;
-              LAST_EAR_IS = down;
-              INVERSETRAIN = false;
-          }
+          // 1 empieza en DOWN, 0 empieza en UP. Lo aplica el reproductor
+          transport.post(TCMD_POLARITY, valEn);
 
           logln("");
-          log("Polarization =" + String(INVERSETRAIN));
+          log("Polarization =" + String(valEn == 1));
 
         }
         // Nivel LOW a cero
-        else if (strCmd.indexOf("ZER=") != -1) 
+        else if (cmd == HMICMD_ZER) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2232,7 +2260,7 @@ class HMI
 
         }
         // Enable Schmitt Trigger threshold adjust
-        else if (strCmd.indexOf("ESH=") != -1) 
+        else if (cmd == HMICMD_ESH) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2253,7 +2281,7 @@ class HMI
 
         }
         // Mutea la salida amplificada
-        else if (strCmd.indexOf("MAM=") != -1) 
+        else if (cmd == HMICMD_MAM) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2273,7 +2301,7 @@ class HMI
           logln("Active amp=" + String(ACTIVE_AMP));
         }        
         // Habilita los dos canales
-        else if (strCmd.indexOf("STE=") != -1) 
+        else if (cmd == HMICMD_STE) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2285,7 +2313,7 @@ class HMI
           logln("Mute enable=" + String(EN_STEREO));
         }
         // Enable MIC left channel - Option
-        else if (strCmd.indexOf("EMI=") != -1) 
+        else if (cmd == HMICMD_EMI) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2303,7 +2331,7 @@ class HMI
           logln("MIC LEFT enable=" + String(SWAP_MIC_CHANNEL));
         }
         // Enable MIC left channel - Option
-        else if (strCmd.indexOf("EAR=") != -1) 
+        else if (cmd == HMICMD_EAR) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2330,7 +2358,7 @@ class HMI
           logln("EAR LEFT enable=" + String(SWAP_EAR_CHANNEL));
         }
         // Save polarization in ID 0x2B
-        else if (strCmd.indexOf("SAV") != -1) 
+        else if (cmd == HMICMD_SAV) 
         {
           //Guardamos la configuracion en un fichero
           String path = FILE_LAST_DIR;
@@ -2344,6 +2372,7 @@ class HMI
           logln("");
           log("Saving configuration in " + String(strpath));
 
+          SDioLock lock(SDIO_INTERACTIVE);
           if (cfg.open(strpath,O_WRITE | O_CREAT))
           {
             // Creamos el fichero de configuracion.
@@ -2374,7 +2403,7 @@ class HMI
           #endif
         }
         // Sampling rate
-        else if (strCmd.indexOf("SAM=") != -1) 
+        else if (cmd == HMICMD_SAM) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2407,7 +2436,7 @@ class HMI
           #endif
         }
         // Habilitar recording sobre WAV file
-        else if (strCmd.indexOf("WAV=") != -1) 
+        else if (cmd == HMICMD_WAV) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2430,7 +2459,7 @@ class HMI
           #endif
         }
         // Habilitar Audio output cuando está grabando.
-        else if (strCmd.indexOf("LOO=") != -1) 
+        else if (cmd == HMICMD_LOO) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2448,7 +2477,7 @@ class HMI
           }
         }
         // Habilitar/Des WiFi RADIO.
-        else if (strCmd.indexOf("WIF=") != -1) 
+        else if (cmd == HMICMD_WIF) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2474,8 +2503,63 @@ class HMI
               activateWifi(false);
           }          
         }
+        // Benchmark de la SD y selección de reloj
+        else if (cmd == HMICMD_SDBENCH) 
+        {
+          SD_BENCHMARK_REQUEST = true;
+        }
+        // Benchmark del enlace con la pantalla (página de debug)
+        else if (cmd == HMICMD_HMIBENCH) 
+        {
+          HMI_LINK_BENCH_REQUEST = true;
+        }
+        // Comprobación de todas las cintas de la SD (sigue donde se quedó)
+        else if (cmd == HMICMD_INTEGRITY) 
+        {
+          integrity.start(true);
+        }
+        // Caché de pulsos por cinta (.pls)
+        else if (cmd == HMICMD_PLS) 
+        {
+          //Cogemos el valor
+          uint8_t buff[8];
+          strCmd.getBytes(buff, 7);
+          int valEn = (int)buff[4];
+          //
+          if (valEn==1)
+          {
+              PULSE_CACHE_ENABLE = true;
+          }
+          else
+          {
+              PULSE_CACHE_ENABLE = false;
+          }
+          logln("PULSE_CACHE_ENABLE=" + String(PULSE_CACHE_ENABLE));
+        }
+        // Osciloscopio. Disparo (0 libre, 1 subida, 2 bajada)
+        else if (cmd == HMICMD_SCT) 
+        {
+          //Cogemos el valor
+          uint8_t buff[8];
+          strCmd.getBytes(buff, 7);
+          int valEn = (int)buff[4];
+          //
+          scope.setTrigger(valEn <= SCOPE_FALLING ? valEn : SCOPE_RISING);
+          logln("SCOPE trigger=" + String(valEn));
+        }
+        // Osciloscopio. Escala de tiempo (índice de SCOPE_ZOOM)
+        else if (cmd == HMICMD_SCZ) 
+        {
+          //Cogemos el valor
+          uint8_t buff[8];
+          strCmd.getBytes(buff, 7);
+          int valEn = (int)buff[4];
+          //
+          scope.setZoom(valEn);
+          logln("SCOPE zoom=" + String(valEn));
+        }
         // Show data debug by serial console
-        else if (strCmd.indexOf("SDD=") != -1) 
+        else if (cmd == HMICMD_SDD) 
         {
           //Cogemos el valor
           uint8_t buff[8];
@@ -2493,7 +2577,7 @@ class HMI
           logln("SHOW_DATA_DEBUG enable=" + String(SHOW_DATA_DEBUG));
         }     
         // Parametrizado del timming maquinas. ROM estandar (no se usa)
-        else if (strCmd.indexOf("MP1=") != -1) 
+        else if (cmd == HMICMD_MP1) 
         {
           //minSync1
           uint8_t buff[8];
@@ -2503,7 +2587,7 @@ class HMI
           MIN_SYNC=val;
           logln("MP1=" + String(MIN_SYNC));
         }
-        else if (strCmd.indexOf("MP2=") != -1) 
+        else if (cmd == HMICMD_MP2) 
         {
           //maxSync1
           uint8_t buff[8];
@@ -2513,7 +2597,7 @@ class HMI
           MAX_SYNC=val;
           logln("MP2=" + String(MAX_SYNC));
         }
-        else if (strCmd.indexOf("MP3=") != -1) 
+        else if (cmd == HMICMD_MP3) 
         {
           //minBit0
           uint8_t buff[8];
@@ -2523,7 +2607,7 @@ class HMI
           MIN_BIT0=val;
           logln("MP3=" + String(MIN_BIT0));
         }
-        else if (strCmd.indexOf("MP4=") != -1) 
+        else if (cmd == HMICMD_MP4) 
         {
           //maxBit0
           uint8_t buff[8];
@@ -2533,7 +2617,7 @@ class HMI
           MAX_BIT0=val;
           logln("MP4=" + String(MAX_BIT0));
         }
-        else if (strCmd.indexOf("MP5=") != -1) 
+        else if (cmd == HMICMD_MP5) 
         {
           //minBit1
           uint8_t buff[8];
@@ -2543,7 +2627,7 @@ class HMI
           MIN_BIT1=val;
           logln("MP5=" + String(MIN_BIT1));
         }
-        else if (strCmd.indexOf("MP6=") != -1) 
+        else if (cmd == HMICMD_MP6) 
         {
           //maxBit1
           uint8_t buff[8];
@@ -2553,7 +2637,7 @@ class HMI
           MAX_BIT1=val;
           logln("MP6=" + String(MAX_BIT1));
         }
-        else if (strCmd.indexOf("MP7=") != -1) 
+        else if (cmd == HMICMD_MP7) 
         {
           //max pulses lead
           uint8_t buff[8];
@@ -2573,7 +2657,7 @@ class HMI
           MAX_PULSES_LEAD=val;
           logln("MP7=" + String(MAX_PULSES_LEAD));
         }
-        else if (strCmd.indexOf("MP8=") != -1) 
+        else if (cmd == HMICMD_MP8) 
         {
           //minLead
           uint8_t buff[8];
@@ -2583,7 +2667,7 @@ class HMI
           MIN_LEAD=val;
           logln("MP8=" + String(MIN_LEAD));
         }
-        else if (strCmd.indexOf("MP9=") != -1) 
+        else if (cmd == HMICMD_MP9) 
         {
           //maxLead
           uint8_t buff[8];
@@ -2594,7 +2678,7 @@ class HMI
           logln("MP9=" + String(MAX_LEAD));
         }
         // Control de volumen por botones - MASTER
-        else if (strCmd.indexOf("VOLUP") != -1) 
+        else if (cmd == HMICMD_VOLUP) 
         {
           MAIN_VOL += 1;
           
@@ -2604,7 +2688,7 @@ class HMI
 
           }
         }        
-        else if (strCmd.indexOf("VOLDW") != -1) 
+        else if (cmd == HMICMD_VOLDW) 
         {
           MAIN_VOL -= 1;
           
@@ -2617,7 +2701,7 @@ class HMI
           // logln("");
         }
         // Busqueda de ficheros
-        else if (strCmd.indexOf("TXTF=") != -1) 
+        else if (cmd == HMICMD_TXTF) 
         {
           //Cogemos el valor
           uint8_t buff[50];
@@ -2650,30 +2734,44 @@ class HMI
           
           findTheTextInFiles();
         }
-        else if (strCmd.indexOf("PDEBUG") != -1)
+        else if (cmd == HMICMD_PDEBUG)
         {
             // Estamos en la pantalla DEBUG
             #ifdef DEBUGMODE
               logAlert("PAGE DEBUG");
             #endif
             CURRENT_PAGE = 3;
+            scope.stop();
         }
-        else if (strCmd.indexOf("PMENU1") != -1)
+        else if (cmd == HMICMD_PMENU1)
         {
             // Estamos en la pantalla MENU
             #ifdef DEBUGMODE
               logAlert("PAGE MENU");
             #endif
             CURRENT_PAGE = 2;
+            scope.stop();
         }       
-        else if (strCmd.indexOf("PTAPE") != -1)
+        else if (cmd == HMICMD_PSCOPE)
+        {
+            // Estamos en la pantalla del osciloscopio
+            #ifdef DEBUGMODE
+              logAlert("PAGE SCOPE");
+            #endif
+            CURRENT_PAGE = 4;
+            scope.start();
+        }
+        else if (cmd == HMICMD_PTAPE)
         {
             // Estamos en la pantalla TAPE
             #ifdef DEBUGMODE
               logAlert("PAGE TAPE");
             #endif
             CURRENT_PAGE = 1;
+            scope.stop();
             updateInformationMainPage(true);
+            // La pantalla borra lo que se había pintado al cambiar de página
+            screenPreview.redraw();
         }
         else
         {}
@@ -2683,25 +2781,9 @@ class HMI
 
       void writeString(String stringData) 
       {
-      
-          SerialHW.flush();
-      
-          SerialHW.write(0xff);
-          SerialHW.write(0xff);
-          SerialHW.write(0xff);
-      
-          for (int i = 0; i < stringData.length(); i++) 
-          {
-            // Enviamos los datos
-            SerialHW.write(stringData[i]);
-          }
-      
-          // Indicamos a la pantalla que ya hemos enviado todos
-          // los datos, con este triple uint8_t 0xFF
-          SerialHW.write(0xff);
-          SerialHW.write(0xff);
-          SerialHW.write(0xff);
-      
+          // Se envía enmarcado entre 0xFF 0xFF 0xFF sin esperar a que se vacíe
+          // la UART. Si el valor del atributo no ha cambiado no se envía (HMIout.h)
+          hmiOut.send(stringData);
       }
       
       void writeStringBlock(String stringData) 
@@ -2775,34 +2857,41 @@ class HMI
       void clearInformationFile()
       {
           PROGRAM_NAME = "";
-          lastPrgName = "";
           PROGRAM_NAME_2 = "";
-          lastPrgName2 = "";
           LAST_SIZE = 0;
           strncpy(LAST_NAME,"",1);
           strncpy(LAST_TYPE,"",1);
-          lastType = "";
           LAST_GROUP = "";
-          lastGrp = "";
-          lastBl1 = BLOCK_SELECTED = 0;
-          lastBl2 = TOTAL_BLOCKS = 0;
-          lastPr1 = PROGRESS_BAR_BLOCK_VALUE = 0;
-          lastPr2 = PROGRESS_BAR_TOTAL_VALUE = 0;
+          BLOCK_SELECTED = 0;
+          TOTAL_BLOCKS = 0;
+          PROGRESS_BAR_BLOCK_VALUE = 0;
+          PROGRESS_BAR_TOTAL_VALUE = 0;
 
+          clearInformationScreen();
+      }
+
+      // Solo la pantalla. No toca los globales, así que vale desde la tarea del HMI
+      // (el borrado de los datos se pide con TCMD_CLEARINFO).
+      void clearInformationScreen()
+      {
+          // Lo que queda en pantalla tras el borrado (el mensaje no se toca)
+          char msg[STATUS_MSG_LEN];
+          statusCopy(msg, sizeof(msg), _shown.message);
+          memset(&_shown, 0, sizeof(_shown));
+          statusCopy(_shown.message, sizeof(_shown.message), msg);
 
           // Forzamos un actualizado de la información del tape
-          // writeString("name.txt=\"" + PROGRAM_NAME + " : " + PROGRAM_NAME_2 + "\"");
-          writeString("name.txt=\"" + PROGRAM_NAME + "\"");
-          writeString("tape2.name.txt=\"" + PROGRAM_NAME + " : " + PROGRAM_NAME_2 + "\"");
+          writeString("name.txt=\"\"");
+          writeString("tape2.name.txt=\" : \"");
           writeString("size.txt=\"0 bytes\"");
           writeString("tape2.size.txt=\"0 bytes\"");
-          writeString("type.txt=\"" + String(LAST_TYPE) + " " + LAST_GROUP + "\"");
-          writeString("tape2.type.txt=\"" + String(LAST_TYPE) + " " + LAST_GROUP + "\"");
-          writeString("progression.val=" + String(PROGRESS_BAR_BLOCK_VALUE));   
-          writeString("progressTotal.val=" + String(PROGRESS_BAR_TOTAL_VALUE));
-          writeString("progressBlock.val=" + String(PROGRESS_BAR_BLOCK_VALUE));
-          writeString("totalBlocks.val=" + String(TOTAL_BLOCKS));       
-          writeString("currentBlock.val=" + String(BLOCK_SELECTED + 1));                              
+          writeString("type.txt=\" \"");
+          writeString("tape2.type.txt=\" \"");
+          writeString("progression.val=0");   
+          writeString("progressTotal.val=0");
+          writeString("progressBlock.val=0");
+          writeString("totalBlocks.val=0");       
+          writeString("currentBlock.val=1");                              
       }
 
       void updateInformationMainPage(bool FORZE_REFRESH = false) 
@@ -2828,166 +2917,139 @@ class HMI
           //   msgEAR = "DOWN";
           // }
 
-          if (PLAY)
+          // Estado publicado por la tarea del reproductor. No se leen aquí las variables
+          // globales que esa tarea está modificando.
+          tapeStatus.read(_status);
+          const tTapeStatus &st = _status;
+          bool isTAP = strcmp(st.fileType, "TAP") == 0;
+
+          if (st.play)
           {
             if (CURRENT_PAGE == 3)
             {
-                writeString("debug.dataOffset1.txt=\"" + dataOffset1 +"\"");
-                writeString("debug.dataOffset2.txt=\"" + dataOffset2 +"\"");
-                writeString("debug.dataOffset3.txt=\"" + dataOffset3 +"\"");
-                writeString("debug.dataOffset4.txt=\"" + dataOffset4 +"\"");
-
-                writeString("debug.offset1.txt=\"" + Offset1 +"\"");
-                writeString("debug.offset2.txt=\"" + Offset2 +"\"");
-                writeString("debug.offset3.txt=\"" + Offset3 +"\"");
-                writeString("debug.offset4.txt=\"" + Offset4 +"\"");
+                for (int n = 0; n < STATUS_DBG_FIELDS; n++)
+                {
+                    writeString("debug." + String(STATUS_DBG_NAMES[n]) + ".txt=\"" + String(st.dbg[n]) + "\"");
+                }
 
                 // DEBUG Information
-                writeString("debug.blockLoading.txt=\"" + String(BLOCK_SELECTED) +"\"");
-                
-                // Esto falla
-                writeString("debug.partLoading.txt=\"" + String(PARTITION_BLOCK) +"\"");
-                writeString("debug.totalParts.txt=\"" + String(TOTAL_PARTS) +"\"");
-
-                writeString("debug.dbgBlkInfo.txt=\"" + dbgBlkInfo +"\"");
-                writeString("debug.dbgPauseAB.txt=\"" + dbgPauseAB +"\"");
-                writeString("debug.dbgSync1.txt=\"" + dbgSync1 +"\"");
-                writeString("debug.dbgSync2.txt=\"" + dbgSync2 +"\"");
-                writeString("debug.dbgBit1.txt=\"" + dbgBit1 +"\"");
-                writeString("debug.dbgBit0.txt=\"" + dbgBit0 +"\"");
-                writeString("debug.dbgTState.txt=\"" + dbgTState +"\"");
-                writeString("debug.dbgRep.txt=\"" + dbgRep +"\"");
+                writeString("debug.blockLoading.txt=\"" + String(st.block) +"\"");
+                writeString("debug.partLoading.txt=\"" + String(st.partition) +"\"");
+                writeString("debug.totalParts.txt=\"" + String(st.totalParts) +"\"");
             }
           }
 
-          if (TOTAL_BLOCKS != 0 || REC || EJECT || FORZE_REFRESH) 
+          // Enlace con la pantalla (velocidad y benchmark)
+          if (CURRENT_PAGE == 3)
+          {
+              tHMIlinkReport link = hmiLink.report();
+              String linkInfo = String(link.baud) + " bd";
+              if (link.benchDone)
+              {
+                  linkInfo += " | " + String(link.cmdsPerSec) + " cmd/s | rtt " + String(link.rttUs) + " us | err " + String(link.benchErrors);
+              }
+              writeString("debug.hmiLink.txt=\"" + linkInfo + "\"");
+
+              // Comprobación de cintas
+              tIntegrityStatus chk = integrity.status();
+              String chkInfo = String(chk.running ? "running" : (chk.done ? "done" : "idle"))
+                               + " | " + String(chk.totals.tapes) + " tapes | bad " + String(chk.totals.bad)
+                               + " | unsup " + String(chk.totals.unsupported) + " | trunc " + String(chk.totals.truncated);
+              writeString("debug.integrity.txt=\"" + chkInfo + "\"");
+          }
+
+          if (st.totalBlocks != 0 || st.rec || st.eject || FORZE_REFRESH) 
           {
-        
             // Enviamos información al HMI
-            if (TYPE_FILE_LOAD != "TAP" || REC || FORZE_REFRESH)
+            if (strcmp(_shown.programName, st.programName) != 0 || FORZE_REFRESH)
             {
-                // Para TZX
-                if (lastPrgName!=PROGRAM_NAME)// || lastPrgName2!=PROGRAM_NAME_2)
+                writeString("name.txt=\"" + String(st.programName) + "\"");
+
+                if (!isTAP || st.rec)
                 {
-                  // writeString("name.txt=\"" + PROGRAM_NAME + " : " + PROGRAM_NAME_2 + "\"");
-                  writeString("name.txt=\"" + PROGRAM_NAME + "\"");
-                  writeString("tape2.name.txt=\"" + PROGRAM_NAME + " : " + PROGRAM_NAME_2 + "\"");
+                    // Para TZX
+                    writeString("tape2.name.txt=\"" + String(st.programName) + " : " + String(st.programName2) + "\"");
                 }
-                lastPrgName = PROGRAM_NAME;
-                lastPrgName2 = PROGRAM_NAME_2;
-            }
-            else
-            {
-                // Para TAP
-                if (lastPrgName!=PROGRAM_NAME || FORZE_REFRESH)
+                else
                 {
-                  writeString("name.txt=\"" + PROGRAM_NAME + "\"");
-                  writeString("tape2.name.txt=\"" + PROGRAM_NAME + "\"");
+                    writeString("tape2.name.txt=\"" + String(st.programName) + "\"");
                 }
-                lastPrgName = PROGRAM_NAME;
             }
+            statusCopy(_shown.programName, sizeof(_shown.programName), st.programName);
             
-            if (lstLastSize!=LAST_SIZE || FORZE_REFRESH)
+            if (_shown.size != st.size || FORZE_REFRESH)
             {
-                if (LAST_SIZE > 9999)
+                if (st.size > 9999)
                 {
-                  writeString("size.txt=\"" + String(LAST_SIZE / 1024) + " Kb\"");
-                  writeString("tape2.size.txt=\"" + String(LAST_SIZE / 1024) + " Kb\"");
+                  writeString("size.txt=\"" + String(st.size / 1024) + " Kb\"");
+                  writeString("tape2.size.txt=\"" + String(st.size / 1024) + " Kb\"");
                 }
                 else
                 {
-                  writeString("size.txt=\"" + String(LAST_SIZE) + " bytes\"");
-                  writeString("tape2.size.txt=\"" + String(LAST_SIZE) + " bytes\"");
+                  writeString("size.txt=\"" + String(st.size) + " bytes\"");
+                  writeString("tape2.size.txt=\"" + String(st.size) + " bytes\"");
                 }
             }
+            _shown.size = st.size;
 
-            lstLastSize = LAST_SIZE;
-
-            String cmpTypeStr = String(LAST_NAME);
-            cmpTypeStr.trim();
-
-
-            if (TYPE_FILE_LOAD != "TAP" || REC || FORZE_REFRESH)
+            if (!isTAP || st.rec || FORZE_REFRESH)
             {
-                if (lastType!=LAST_TYPE || lastGrp!=LAST_GROUP || FORZE_REFRESH)
+                // Para TZX
+                if (strcmp(_shown.type, st.type) != 0 || strcmp(_shown.group, st.group) != 0 || FORZE_REFRESH)
                 { 
-                  writeString("type.txt=\"" + String(LAST_TYPE) + " " + LAST_GROUP + "\"");
-                  writeString("tape2.type.txt=\"" + String(LAST_TYPE) + " " + LAST_GROUP + "\"");
+                  writeString("type.txt=\"" + String(st.type) + " " + String(st.group) + "\"");
+                  writeString("tape2.type.txt=\"" + String(st.type) + " " + String(st.group) + "\"");
                 }
-                lastType = LAST_TYPE;
-                lastGrp = LAST_GROUP;
+                statusCopy(_shown.group, sizeof(_shown.group), st.group);
             }
             else
             {
-
-                if (lastType!=LAST_TYPE || FORZE_REFRESH)
+                // Para TAP
+                if (strcmp(_shown.type, st.type) != 0)
                 { 
-                  writeString("type.txt=\"" + String(LAST_TYPE) + "\"");
-                  writeString("tape2.type.txt=\"" + String(LAST_TYPE) + "\"");
+                  writeString("type.txt=\"" + String(st.type) + "\"");
+                  writeString("tape2.type.txt=\"" + String(st.type) + "\"");
                 }
-                lastType = LAST_TYPE;  
-
-                // writeString("name.txt=\"" + PROGRAM_NAME + " : " + String(LAST_NAME) + "\"");           
-                // writeString("tape2.name.txt=\"" + PROGRAM_NAME + " : " + String(LAST_NAME) + "\"");     
-
-                if (lastPrgName!=PROGRAM_NAME || FORZE_REFRESH)
-                {
-                  writeString("name.txt=\"" + PROGRAM_NAME + "\"");
-                  writeString("tape2.name.txt=\"" + PROGRAM_NAME + "\"");
-                }
-                lastPrgName = PROGRAM_NAME;                
             }
-        
-            //writeString("totalBlocks.val=" + String(TOTAL_BLOCKS));
-            //writeString("currentBlock.val=" + String(BLOCK_SELECTED + 1));
-          }
-          else if (TOTAL_BLOCKS == 0)
-          {
-            //writeString("totalBlocks.val=0");
-            //writeString("currentBlock.val=0");
+            statusCopy(_shown.type, sizeof(_shown.type), st.type);
           }
 
-          // if (lastfname != HMI_FNAME || FORZE_REFRESH)
-          // {writeString("fname.txt=\"" + HMI_FNAME + "\"");}
-          // lastfname = HMI_FNAME;
-
-
-          if (lastMsn != LAST_MESSAGE || FORZE_REFRESH)
-          {writeString("g0.txt=\"" + LAST_MESSAGE + "\"");}
-          lastMsn = LAST_MESSAGE;
+          if (strcmp(_shown.message, st.message) != 0 || FORZE_REFRESH)
+          {writeString("g0.txt=\"" + String(st.message) + "\"");}
+          statusCopy(_shown.message, sizeof(_shown.message), st.message);
           
-          if (lastPr1 != PROGRESS_BAR_BLOCK_VALUE || FORZE_REFRESH)
-          {writeString("progressBlock.val=" + String(PROGRESS_BAR_BLOCK_VALUE));}
-          lastPr1 = PROGRESS_BAR_BLOCK_VALUE;
+          if (_shown.progressBlock != st.progressBlock || FORZE_REFRESH)
+          {writeString("progressBlock.val=" + String(st.progressBlock));}
+          _shown.progressBlock = st.progressBlock;
 
-          if (lastPr2 != PROGRESS_BAR_TOTAL_VALUE || FORZE_REFRESH)
-          {writeString("progressTotal.val=" + String(PROGRESS_BAR_TOTAL_VALUE));}
-          lastPr2 = PROGRESS_BAR_TOTAL_VALUE;
+          if (_shown.progressTotal != st.progressTotal || FORZE_REFRESH)
+          {writeString("progressTotal.val=" + String(st.progressTotal));}
+          _shown.progressTotal = st.progressTotal;
 
-          if (lastBl1 != TOTAL_BLOCKS || FORZE_REFRESH)
+          if (_shown.totalBlocks != st.totalBlocks || FORZE_REFRESH)
           {
-              if (TOTAL_BLOCKS == 0)
+              if (st.totalBlocks == 0)
               {
-                writeString("totalBlocks.val=" + String(TOTAL_BLOCKS));
+                writeString("totalBlocks.val=" + String(st.totalBlocks));
               }
               else
               {
-                writeString("totalBlocks.val=" + String(TOTAL_BLOCKS-1));                
+                writeString("totalBlocks.val=" + String(st.totalBlocks-1));                
               }
           }
-          lastBl1 = TOTAL_BLOCKS;
+          _shown.totalBlocks = st.totalBlocks;
 
-          if (lastBl2 != BLOCK_SELECTED || FORZE_REFRESH)
+          if (_shown.block != st.block || FORZE_REFRESH)
           {
-              if(TYPE_FILE_LOAD == "TAP")
+              if (isTAP)
               {
-                  writeString("currentBlock.val=" + String(BLOCK_SELECTED + 1));
+                  writeString("currentBlock.val=" + String(st.block + 1));
               }
               else
               {
-                  writeString("currentBlock.val=" + String(BLOCK_SELECTED));
+                  writeString("currentBlock.val=" + String(st.block));
               }
-              lastBl2 = BLOCK_SELECTED;
+              _shown.block = st.block;
           }
                             
           if (CURRENT_PAGE == 2)
@@ -3112,8 +3174,54 @@ class HMI
           }
       }
 
+      // Atiende una trama recibida por HMIrx. Los controles del TAPE van directos,
+      // el resto por verifyCommand como siempre.
+      void dispatchFrame(const tHMIframe &f)
+      {
+        // La pantalla ha podido cambiar de página o de valores
+        hmiOut.invalidate();
+
+        int cmd = hmiLookup(f.data, f.len);
+        switch (cmd)
+        {
+          case HMICMD_PLAY:   LAST_COMMAND = ""; cmdPlay();  break;
+          case HMICMD_STOP:   LAST_COMMAND = ""; cmdStop();  break;
+          case HMICMD_PAUSE:  LAST_COMMAND = ""; cmdPause(); break;
+          case HMICMD_REC:    LAST_COMMAND = ""; cmdRec();   break;
+          case HMICMD_FFWD:   LAST_COMMAND = ""; cmdFfwd();  break;
+          case HMICMD_RWD:    LAST_COMMAND = ""; cmdRwd();   break;
+          case HMICMD_EJECT:  LAST_COMMAND = ""; cmdEject(); break;
+
+          default:
+          {
+            // Puede llevar valores binarios (con 0x00), así que se copia byte a byte
+            String strCmd = "";
+            strCmd.reserve(f.len);
+            for (int i = 0; i < f.len; i++)
+            {
+              strCmd += f.data[i];
+            }
+            verifyCommand(strCmd, cmd);
+            break;
+          }
+        }
+
+        hmiRx.dispatched(f);
+      }
+
       void readUART() 
       {
+        // Tramas ya troceadas por el callback de la UART (HMIparser.h)
+        if (hmiRx.started())
+        {
+          tHMIframe f;
+          while (hmiRx.pop(f))
+          {
+            dispatchFrame(f);
+          }
+          return;
+        }
+
         if (SerialHW.available() >= 1) 
         {
           // get the new uint8_t:
@@ -3121,6 +3229,9 @@ class HMI
           {
             String strCmd = SerialHW.readString();
 
+            // La pantalla ha podido cambiar de página o de valores
+            hmiOut.invalidate();
+
             //ECHO
             // #ifdef DEBUGMODE
             //   logln("");
@@ -3200,12 +3311,17 @@ class HMI
 
       void updateMem()
       {
-          if (lst_stackFreeCore0 != stackFreeCore0 || lst_psram_used != ESP.getPsramSize() || lst_stack_used != ESP.getHeapSize())
+          // Pool de buffers de bloque: asignaciones / reutilizadas y uso actual / máximo
+          String poolAllocs = " | A:" + String(blockPool.stats.allocs) + " R:" + String(blockPool.stats.reused);
+          String poolUse = " | P:" + String(blockPool.stats.inUse / 1024) + "/" + String(blockPool.stats.highWater / 1024)
+                         + " F:" + String(blockPool.stats.arenaBytes / 1024) + "/" + String(blockPool.stats.arenaHighWater / 1024) + " KB";
+
+          if (lst_stackFreeCore0 != stackFreeCore0 || lst_psram_used != ESP.getPsramSize() || lst_stack_used != ESP.getHeapSize() || lst_pool_allocs != blockPool.stats.allocs)
           {
             #ifdef DEBUGMODE
-              writeString("menu.totalPSRAM.txt=\"Task0: " + String(stackFreeCore0) + " KB | " + String(ESP.getPsramSize() / 1024) + " KB | " + String(ESP.getHeapSize() / 1024) + " KB\"");            
+              writeString("menu.totalPSRAM.txt=\"Task0: " + String(stackFreeCore0) + " KB | " + String(ESP.getPsramSize() / 1024) + " KB | " + String(ESP.getHeapSize() / 1024) + " KB" + poolAllocs + "\"");            
             #else
-              writeString("menu.totalPSRAM.txt=\"" + String(ESP.getPsramSize() / 1024) + " KB | " + String(ESP.getHeapSize() / 1024) + " KB\"");            
+              writeString("menu.totalPSRAM.txt=\"" + String(ESP.getPsramSize() / 1024) + " KB | " + String(ESP.getHeapSize() / 1024) + " KB" + poolAllocs + "\"");            
             #endif
             
           }
@@ -3213,18 +3329,20 @@ class HMI
           lst_stackFreeCore0 = BLOCK_SELECTED;
           lst_psram_used = ESP.getPsramSize();
           lst_stack_used = ESP.getHeapSize();
+          lst_pool_allocs = blockPool.stats.allocs;
 
-          if (lst_stackFreeCore1 != stackFreeCore1 || lst_psram_used != ESP.getFreePsram() || lst_stack_used != ESP.getFreeHeap())
+          if (lst_stackFreeCore1 != stackFreeCore1 || lst_psram_used != ESP.getFreePsram() || lst_stack_used != ESP.getFreeHeap() || lst_pool_inuse != blockPool.stats.inUse + blockPool.stats.arenaBytes)
           {
             #ifdef DEBUGMODE
-              writeString("menu.freePSRAM.txt=\"Task1: "  + String(stackFreeCore1) + " KB | " + String(ESP.getFreePsram() / 1024) + " KB | " + String(ESP.getFreeHeap() / 1024) + " KB\"");
+              writeString("menu.freePSRAM.txt=\"Task1: "  + String(stackFreeCore1) + " KB | " + String(ESP.getFreePsram() / 1024) + " KB | " + String(ESP.getFreeHeap() / 1024) + " KB" + poolUse + "\"");
             #else
-              writeString("menu.freePSRAM.txt=\""  + String(ESP.getFreePsram() / 1024) + " KB | " + String(ESP.getFreeHeap() / 1024) + " KB\"");
+              writeString("menu.freePSRAM.txt=\""  + String(ESP.getFreePsram() / 1024) + " KB | " + String(ESP.getFreeHeap() / 1024) + " KB" + poolUse + "\"");
             #endif
           }
           lst_stackFreeCore1 = BLOCK_SELECTED;
           lst_psram_free = ESP.getFreePsram();
           lst_stack_free = ESP.getFreeHeap();
+          lst_pool_inuse = blockPool.stats.inUse + blockPool.stats.arenaBytes;
       }
 
       // Constructor
@@ -0,0 +1,390 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: HMIlink.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Velocidad del enlace con la pantalla Nextion.
+
+    Al arrancar se busca a qué velocidad está la pantalla (puede venir de un arranque anterior
+    con otra velocidad, o tener otro "bauds" por defecto en el proyecto del HMI) y se sube a la
+    mayor de HMI_LINK_BAUDS que supere la comprobación de eco:
+
+      sya0=<valor>  +  get sya0  -->  0x71 <valor int32> FF FF FF
+
+    con valores que recorren todos los bits (incluidos bytes 0xFF dentro de la respuesta).
+    Si una velocidad falla se vuelve a la anterior y, si no contesta, se busca de nuevo.
+    Se usa "baud=" y no "bauds=", así que la pantalla no guarda nada y tras un reinicio
+    vuelve a la suya.
+
+    El benchmark (botón en la página de debug, o POST /hmistats?bench) mide comandos por segundo
+    (escrituras seguidas cerradas con un get) y el tiempo de ida y vuelta de un get.
+
+    La lógica va sobre un puerto genérico para poder probarla en el host con una pantalla
+    simulada:
+      void setBaud(uint32_t baud);
+      void send(const char* cmd);                    // con los FF FF FF
+      bool readByte(uint8_t &b, uint32_t timeoutMs);
+      void flushRx();
+      void drainTx();                                // espera a que salga todo
+      void delayMs(uint32_t ms);
+      uint32_t nowUs();
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Velocidades de la Nextion, de mayor a menor
+static const uint32_t HMI_LINK_BAUDS[] = {921600, 512000, 256000, 250000, 230400, 115200, 57600, 38400, 19200, 9600};
+#define HMI_LINK_NUM_BAUDS (sizeof(HMI_LINK_BAUDS) / sizeof(HMI_LINK_BAUDS[0]))
+
+#ifndef HMI_LINK_MAX_BAUD
+  #define HMI_LINK_MAX_BAUD 921600
+#endif
+// Ecos que tienen que salir bien para aceptar una velocidad
+#define HMI_LINK_VERIFY_ROUNDS 16
+// Espera a la respuesta de un get
+#define HMI_LINK_REPLY_MS 60
+// Tiempo que se da a la pantalla para arrancar tras "rest"
+#define HMI_LINK_BOOT_MS 1500
+// Comandos de la prueba de comandos por segundo y de la de ida y vuelta
+#define HMI_LINK_BENCH_WRITES 400
+#define HMI_LINK_BENCH_ROUNDTRIPS 50
+
+struct tHMIlinkReport
+{
+    uint32_t baud = 0;              // Velocidad en uso
+    uint32_t detectedBaud = 0;      // A la que estaba la pantalla al arrancar
+    uint32_t failedBaud = 0;        // Última velocidad que no pasó la comprobación
+    uint32_t cmdsPerSec = 0;        // Benchmark
+    uint32_t rttUs = 0;
+    uint32_t benchErrors = 0;
+    bool benchDone = false;
+};
+
+template <class P>
+class HMIlinkCore
+{
+    private:
+
+        P& _port;
+        tHMIlinkReport _rep;
+
+        static uint32_t pattern(int round)
+        {
+            // Bits alternos, bytes 0xFF y 0x00 y valores negativos
+            static const uint32_t base[4] = {0x55AA55AA, 0xFFFFFF00, 0x00FF00FF, 0x80000001};
+            return base[round & 3] ^ ((uint32_t)round * 0x01010101);
+        }
+
+    public:
+
+        explicit HMIlinkCore(P& port) : _port(port) {}
+
+        // Espera una respuesta numérica (0x71). Se saltan otras tramas que lleguen antes.
+        bool readNumber(int32_t &value, uint32_t timeoutMs = HMI_LINK_REPLY_MS)
+        {
+            uint8_t b;
+            uint8_t buf[8];
+            int n = 0;
+
+            while (_port.readByte(b, timeoutMs))
+            {
+                if (n == 0 && b != 0x71)
+                {
+                    continue;
+                }
+
+                buf[n++] = b;
+
+                if (n == 8)
+                {
+                    if (buf[5] == 0xFF && buf[6] == 0xFF && buf[7] == 0xFF)
+                    {
+                        value = (int32_t)(buf[1] | (buf[2] << 8) | ((uint32_t)buf[3] << 16) | ((uint32_t)buf[4] << 24));
+                        return true;
+                    }
+
+                    // No era una respuesta. Se vuelve a buscar desde el siguiente 0x71.
+                    int from = 1;
+                    while (from < 8 && buf[from] != 0x71)
+                    {
+                        from++;
+                    }
+                    n = 8 - from;
+                    memmove(buf, buf + from, n);
+                }
+            }
+            return false;
+        }
+
+        // Eco: se escribe un valor y se lee. true si todos coinciden.
+        bool probe(int rounds)
+        {
+            char cmd[24];
+
+            _port.flushRx();
+
+            for (int r = 0; r < rounds; r++)
+            {
+                int32_t expected = (int32_t)pattern(r);
+                int32_t got;
+
+                snprintf(cmd, sizeof(cmd), "sya0=%ld", (long)expected);
+                _port.send(cmd);
+                _port.send("get sya0");
+
+                if (!readNumber(got) || got != expected)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Busca la velocidad de la pantalla. Empieza por la actual. 0 si no contesta.
+        uint32_t detect(uint32_t first)
+        {
+            if (first != 0)
+            {
+                _port.setBaud(first);
+                if (probe(2))
+                {
+                    _rep.baud = first;
+                    return first;
+                }
+            }
+
+            for (uint32_t i = 0; i < HMI_LINK_NUM_BAUDS; i++)
+            {
+                if (HMI_LINK_BAUDS[i] == first)
+                {
+                    continue;
+                }
+
+                _port.setBaud(HMI_LINK_BAUDS[i]);
+                if (probe(2))
+                {
+                    _rep.baud = HMI_LINK_BAUDS[i];
+                    return _rep.baud;
+                }
+            }
+
+            // Sin respuesta. La UART se queda como estaba.
+            _port.setBaud(first != 0 ? first : HMI_LINK_BAUDS[0]);
+            _rep.baud = 0;
+            return 0;
+        }
+
+        // Cambia pantalla y UART a "baud" y lo comprueba
+        bool trySwitch(uint32_t baud)
+        {
+            char cmd[24];
+            snprintf(cmd, sizeof(cmd), "baud=%lu", (unsigned long)baud);
+
+            _port.send(cmd);
+            _port.drainTx();
+            // La pantalla tarda un poco en cambiar
+            _port.delayMs(50);
+            _port.setBaud(baud);
+            _port.delayMs(20);
+
+            return probe(HMI_LINK_VERIFY_ROUNDS);
+        }
+
+        // Busca la pantalla y sube a la mayor velocidad fiable hasta maxBaud.
+        // fallback = velocidad con la que se queda la UART si la pantalla no contesta.
+        uint32_t negotiate(uint32_t first, uint32_t maxBaud, uint32_t fallback)
+        {
+            uint32_t cur = 0;
+            uint32_t t0 = _port.nowUs();
+
+            // La pantalla puede estar todavía arrancando
+            while (cur == 0 && (_port.nowUs() - t0) < HMI_LINK_BOOT_MS * 1000u)
+            {
+                cur = detect(first);
+            }
+
+            _rep.detectedBaud = cur;
+
+            if (cur == 0)
+            {
+                _port.setBaud(fallback);
+                _rep.baud = fallback;
+                return fallback;
+            }
+
+            for (uint32_t i = 0; i < HMI_LINK_NUM_BAUDS; i++)
+            {
+                uint32_t baud = HMI_LINK_BAUDS[i];
+                if (baud > maxBaud)
+                {
+                    continue;
+                }
+                if (baud <= cur)
+                {
+                    break;
+                }
+
+                if (trySwitch(baud))
+                {
+                    cur = baud;
+                    break;
+                }
+
+                _rep.failedBaud = baud;
+
+                // Volvemos a la que funcionaba. Si la orden no llega bien, se busca otra vez.
+                if (!trySwitch(cur))
+                {
+                    cur = detect(cur);
+                    if (cur == 0)
+                    {
+                        _port.setBaud(fallback);
+                        _rep.baud = fallback;
+                        return fallback;
+                    }
+                }
+            }
+
+            _rep.baud = cur;
+            return cur;
+        }
+
+        // Comandos por segundo y tiempo de ida y vuelta
+        void benchmark()
+        {
+            char cmd[24];
+            int32_t got;
+
+            _rep.benchErrors = 0;
+            _port.flushRx();
+
+            // Escrituras seguidas. El get final confirma que se han procesado todas.
+            uint32_t t0 = _port.nowUs();
+            for (int i = 0; i < HMI_LINK_BENCH_WRITES; i++)
+            {
+                snprintf(cmd, sizeof(cmd), "sya0=%d", i);
+                _port.send(cmd);
+            }
+            _port.send("get sya0");
+
+            if (!readNumber(got, 1000) || got != HMI_LINK_BENCH_WRITES - 1)
+            {
+                _rep.benchErrors++;
+            }
+
+            uint32_t us = _port.nowUs() - t0;
+            _rep.cmdsPerSec = us ? (uint32_t)((uint64_t)(HMI_LINK_BENCH_WRITES + 1) * 1000000 / us) : 0;
+
+            // Ida y vuelta
+            uint32_t total = 0;
+            for (int i = 0; i < HMI_LINK_BENCH_ROUNDTRIPS; i++)
+            {
+                uint32_t t1 = _port.nowUs();
+                _port.send("get sya0");
+                if (!readNumber(got) || got != HMI_LINK_BENCH_WRITES - 1)
+                {
+                    _rep.benchErrors++;
+                }
+                total += _port.nowUs() - t1;
+            }
+            _rep.rttUs = total / HMI_LINK_BENCH_ROUNDTRIPS;
+            _rep.benchDone = true;
+        }
+
+        tHMIlinkReport report()
+        {
+            return _rep;
+        }
+};
+
+#ifdef ARDUINO
+
+// Puerto sobre SerialHW. Las órdenes pasan por hmiOut (con su mutex) para no mezclarse
+// con lo que escriban otras tareas.
+class HMIlinkSerial
+{
+    public:
+
+        void setBaud(uint32_t baud)
+        {
+            SerialHW.updateBaudRate(baud);
+        }
+
+        void send(const char* cmd)
+        {
+            hmiOut.send(String(cmd));
+        }
+
+        bool readByte(uint8_t &b, uint32_t timeoutMs)
+        {
+            unsigned long t0 = millis();
+            while (!SerialHW.available())
+            {
+                if (millis() - t0 >= timeoutMs)
+                {
+                    return false;
+                }
+                vTaskDelay(1);
+            }
+            b = SerialHW.read();
+            return true;
+        }
+
+        void flushRx()
+        {
+            while (SerialHW.available())
+            {
+                SerialHW.read();
+            }
+        }
+
+        void drainTx()
+        {
+            SerialHW.flush();
+        }
+
+        void delayMs(uint32_t ms)
+        {
+            delay(ms);
+        }
+
+        uint32_t nowUs()
+        {
+            return micros();
+        }
+};
+
+HMIlinkSerial hmiLinkSerial;
+HMIlinkCore<HMIlinkSerial> hmiLink(hmiLinkSerial);
+
+#endif
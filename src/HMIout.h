@@ -0,0 +1,540 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: HMIout.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Salida hacia la pantalla Nextion. Todos los HMI::writeString pasan por aquí.
+
+      - Copia en sombra de cada atributo "objeto.atributo=valor". Si el valor no ha cambiado
+        no se vuelve a enviar.
+      - Tramas: entre beginFrame() y endFrame() los atributos que escribe la tarea del HMI se
+        acumulan y si uno se escribe dos veces solo se envía el último.
+      - Los comandos se dejan en el buffer de TX de la UART sin esperar a que se vacíe
+        (sin SerialHW.flush()). Si no hay sitio, un atributo se queda pendiente con su último
+        valor y se envía en cuanto haya hueco (antes que nada de lo que venga detrás); un
+        comando de otro tipo espera, sin bloquear al resto de tareas.
+
+    La sombra se olvida al recibir cualquier comando de la pantalla (puede haber cambiado de
+    página o el usuario puede haber cambiado un valor) y cada HMIOUT_SHADOW_TTL_MS.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <mutex>
+
+// Entradas de la sombra (potencia de 2)
+#define HMIOUT_SHADOW_SIZE 256
+// Atributos que se pueden acumular en una trama
+#define HMIOUT_STAGE_SIZE 32
+// Tiempo tras el que un atributo se vuelve a enviar aunque no cambie
+#define HMIOUT_SHADOW_TTL_MS 5000
+// Atributos pendientes por falta de sitio en la UART
+#define HMIOUT_DIRTY_SIZE 32
+// Tamaño del buffer de TX de la UART (SerialHW.setTxBufferSize en setup())
+#define HMIOUT_TX_RING 4096
+
+struct tHMIoutStats
+{
+    uint32_t requested = 0;       // Llamadas a writeString
+    uint32_t sent = 0;            // Comandos enviados a la UART
+    uint32_t suppressed = 0;      // Descartados por no cambiar el valor
+    uint32_t coalesced = 0;       // Sustituidos dentro de una trama
+    uint32_t dropped = 0;         // Aplazados por buffer de TX lleno (o perdidos en sendTransparent)
+    uint32_t bytesRequested = 0;  // Bytes que se habrían enviado sin sombra ni tramas
+    uint32_t bytesSent = 0;       // Bytes enviados realmente
+    uint32_t blockedUs[2] = {};   // Tiempo esperando sitio en la UART por núcleo
+    unsigned long since = 0;      // millis() del último reset
+};
+
+class HMIout
+{
+    private:
+
+        struct tShadow
+        {
+            uint32_t key;
+            uint32_t val;
+            unsigned long t;
+        };
+
+        struct tStaged
+        {
+            uint32_t key;
+            String cmd;
+        };
+
+        std::mutex _mtx;
+
+        tShadow _shadow[HMIOUT_SHADOW_SIZE] = {};
+
+        tStaged _stage[HMIOUT_STAGE_SIZE];
+        int _nStage = 0;
+        TaskHandle_t _frameOwner = nullptr;
+
+        // Atributos que no cupieron. En orden de llegada, uno por atributo.
+        tStaged _dirty[HMIOUT_DIRTY_SIZE];
+        int _nDirty = 0;
+
+        // Tarea que está enviando datos transparentes. Nadie más escribe en la UART.
+        TaskHandle_t _uartOwner = nullptr;
+
+        tHMIoutStats _stats;
+
+        static uint32_t hash(const char* s, int len)
+        {
+            // FNV-1a
+            uint32_t h = 2166136261u;
+            for (int i = 0; i < len; i++)
+            {
+                h ^= (uint8_t)s[i];
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        // ¿Es "objeto.atributo=valor"? Devuelve los hash del nombre y del valor
+        static bool splitAttr(const String &cmd, uint32_t &key, uint32_t &val)
+        {
+            int eq = cmd.indexOf('=');
+            if (eq <= 0)
+            {
+                return false;
+            }
+
+            bool dot = false;
+            for (int i = 0; i < eq; i++)
+            {
+                char c = cmd[i];
+                if (c == '.')
+                {
+                    dot = true;
+                }
+                else if (!isalnum(c) && c != '_' && c != '[' && c != ']')
+                {
+                    // "+=", "page 1", "vis b0,1"... se envían siempre
+                    return false;
+                }
+            }
+
+            if (!dot)
+            {
+                return false;
+            }
+
+            key = hash(cmd.c_str(), eq) | 1;
+            val = hash(cmd.c_str() + eq + 1, cmd.length() - eq - 1);
+            return true;
+        }
+
+        tShadow* findShadow(uint32_t key, bool create)
+        {
+            int first = key & (HMIOUT_SHADOW_SIZE - 1);
+            tShadow* freeSlot = nullptr;
+
+            for (int n = 0; n < 8; n++)
+            {
+                tShadow* s = &_shadow[(first + n) & (HMIOUT_SHADOW_SIZE - 1)];
+                if (s->key == key)
+                {
+                    return s;
+                }
+                if (s->key == 0 && freeSlot == nullptr)
+                {
+                    freeSlot = s;
+                }
+            }
+
+            if (!create)
+            {
+                return nullptr;
+            }
+
+            // Sin hueco. Se sustituye el primero.
+            tShadow* s = (freeSlot != nullptr) ? freeSlot : &_shadow[first];
+            s->key = key;
+            return s;
+        }
+
+        bool unchanged(uint32_t key, uint32_t val)
+        {
+            tShadow* s = findShadow(key, false);
+            return s != nullptr && s->val == val && (millis() - s->t) < HMIOUT_SHADOW_TTL_MS;
+        }
+
+        void remember(uint32_t key, uint32_t val)
+        {
+            tShadow* s = findShadow(key, true);
+            s->val = val;
+            s->t = millis();
+        }
+
+        void forget(uint32_t key)
+        {
+            tShadow* s = findShadow(key, false);
+            if (s != nullptr)
+            {
+                s->key = 0;
+            }
+        }
+
+        // ¿Se puede escribir ya "len" bytes? Los comandos más largos que el buffer se escriben
+        // igualmente (la UART los va sacando).
+        bool roomFor(size_t len)
+        {
+            if (_uartOwner != nullptr && _uartOwner != xTaskGetCurrentTaskHandle())
+            {
+                return false;
+            }
+            return len > HMIOUT_TX_RING || (size_t)SerialHW.availableForWrite() >= len;
+        }
+
+        void writeRaw(const String &cmd)
+        {
+            const uint8_t end[3] = {0xff, 0xff, 0xff};
+
+            SerialHW.write(end, 3);
+            SerialHW.write((const uint8_t*)cmd.c_str(), cmd.length());
+            SerialHW.write(end, 3);
+
+            _stats.sent++;
+            _stats.bytesSent += cmd.length() + 6;
+        }
+
+        void removeDirty(int n)
+        {
+            for (int m = n; m < _nDirty - 1; m++)
+            {
+                _dirty[m] = _dirty[m + 1];
+            }
+            _nDirty--;
+            _dirty[_nDirty].cmd = "";
+        }
+
+        void markDirty(uint32_t key, const String &cmd)
+        {
+            for (int n = 0; n < _nDirty; n++)
+            {
+                if (_dirty[n].key == key)
+                {
+                    // Se mantiene el orden de llegada: va detrás de lo que ya estaba
+                    removeDirty(n);
+                    break;
+                }
+            }
+
+            if (_nDirty == HMIOUT_DIRTY_SIZE)
+            {
+                // Sin sitio. Se olvida la sombra del más antiguo para que se envíe la próxima vez.
+                forget(_dirty[0].key);
+                removeDirty(0);
+            }
+
+            _dirty[_nDirty].key = key;
+            _dirty[_nDirty].cmd = cmd;
+            _nDirty++;
+        }
+
+        // Envía los atributos pendientes que quepan, en orden. true si no queda ninguno.
+        bool flushDirty()
+        {
+            while (_nDirty > 0 && roomFor(_dirty[0].cmd.length() + 6))
+            {
+                writeRaw(_dirty[0].cmd);
+                removeDirty(0);
+            }
+            return _nDirty == 0;
+        }
+
+        // Envía un atributo. Si no cabe, o quedan pendientes delante, se queda pendiente.
+        void sendAttr(const String &cmd, uint32_t key)
+        {
+            if (flushDirty() && roomFor(cmd.length() + 6))
+            {
+                writeRaw(cmd);
+                return;
+            }
+
+            _stats.dropped++;
+            markDirty(key, cmd);
+        }
+
+        // Comando que no es un atributo. Espera a que haya sitio sin tener el mutex, para
+        // no parar a las demás tareas mientras se vacía la UART.
+        void sendCmd(const String &cmd)
+        {
+            size_t len = cmd.length() + 6;
+            unsigned long t0 = micros();
+            bool waited = false;
+
+            for (;;)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+
+                    // Se respeta el orden con lo acumulado y lo pendiente
+                    if (inMyFrame())
+                    {
+                        flushStage();
+                    }
+
+                    if (flushDirty() && roomFor(len))
+                    {
+                        if (waited)
+                        {
+                            _stats.blockedUs[xPortGetCoreID()] += micros() - t0;
+                        }
+
+                        writeRaw(cmd);
+
+                        if (cmd.startsWith("page "))
+                        {
+                            memset(_shadow, 0, sizeof(_shadow));
+                        }
+                        return;
+                    }
+                }
+
+                waited = true;
+                vTaskDelay(1);
+            }
+        }
+
+        bool inMyFrame()
+        {
+            return _frameOwner != nullptr && _frameOwner == xTaskGetCurrentTaskHandle();
+        }
+
+        void unstage(uint32_t key)
+        {
+            for (int n = 0; n < _nStage; n++)
+            {
+                if (_stage[n].key == key)
+                {
+                    for (int m = n; m < _nStage - 1; m++)
+                    {
+                        _stage[m] = _stage[m + 1];
+                    }
+                    _nStage--;
+                    _stage[_nStage].cmd = "";
+                    return;
+                }
+            }
+        }
+
+        void flushStage()
+        {
+            for (int n = 0; n < _nStage; n++)
+            {
+                sendAttr(_stage[n].cmd, _stage[n].key);
+                _stage[n].cmd = "";
+            }
+            _nStage = 0;
+        }
+
+        void stage(uint32_t key, const String &cmd)
+        {
+            for (int n = 0; n < _nStage; n++)
+            {
+                if (_stage[n].key == key)
+                {
+                    _stage[n].cmd = cmd;
+                    _stats.coalesced++;
+                    return;
+                }
+            }
+
+            if (_nStage == HMIOUT_STAGE_SIZE)
+            {
+                flushStage();
+            }
+
+            _stage[_nStage].key = key;
+            _stage[_nStage].cmd = cmd;
+            _nStage++;
+        }
+
+    public:
+
+        void send(const String &cmd)
+        {
+            uint32_t key = 0;
+            uint32_t val = 0;
+            bool attr = splitAttr(cmd, key, val);
+
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+
+                _stats.requested++;
+                _stats.bytesRequested += cmd.length() + 6;
+
+                if (attr)
+                {
+                    if (unchanged(key, val))
+                    {
+                        _stats.suppressed++;
+                        return;
+                    }
+
+                    remember(key, val);
+
+                    if (inMyFrame())
+                    {
+                        stage(key, cmd);
+                        return;
+                    }
+
+                    // Escritura directa (otra tarea). Gana sobre lo acumulado en la trama.
+                    unstage(key);
+                    sendAttr(cmd, key);
+                    return;
+                }
+            }
+
+            sendCmd(cmd);
+        }
+
+        // Envía un comando solo si cabe ya en la UART (envíos largos por trozos).
+        // Devuelve false si no hay sitio.
+        bool trySend(const char* cmd)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+
+            size_t len = strlen(cmd) + 6;
+            _stats.requested++;
+            _stats.bytesRequested += len;
+
+            // Lo acumulado en la trama y lo pendiente van antes
+            if (inMyFrame())
+            {
+                flushStage();
+            }
+
+            if (!flushDirty() || !roomFor(len))
+            {
+                return false;
+            }
+
+            writeRaw(String(cmd));
+            return true;
+        }
+
+        // Comando con datos transparentes a continuación (addt, ...). La pantalla responde 0xFE
+        // cuando está lista para recibirlos. waitReady() espera esa respuesta. Nadie más puede
+        // escribir en la UART hasta que se han enviado todos los bytes.
+        template <class W>
+        bool sendTransparent(const String &cmd, const uint8_t* data, size_t len, W waitReady)
+        {
+            // Se toma la UART. Las esperas van sin el mutex: mientras tanto los atributos de
+            // otras tareas se quedan pendientes y sus comandos esperan.
+            for (;;)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    if (_uartOwner == nullptr)
+                    {
+                        _uartOwner = xTaskGetCurrentTaskHandle();
+                        _stats.requested++;
+                        _stats.bytesRequested += cmd.length() + 6 + len;
+                        break;
+                    }
+                }
+                vTaskDelay(1);
+            }
+
+            sendCmd(cmd);
+
+            bool ok = waitReady();
+            if (!ok)
+            {
+                // La pantalla no ha contestado. No se envían los datos para no
+                // mezclarlos con los comandos siguientes.
+                std::lock_guard<std::mutex> lk(_mtx);
+                _stats.dropped++;
+            }
+
+            size_t done = 0;
+            while (ok && done < len)
+            {
+                size_t room = SerialHW.availableForWrite();
+                if (room == 0)
+                {
+                    vTaskDelay(1);
+                    continue;
+                }
+                size_t n = (len - done) < room ? (len - done) : room;
+                SerialHW.write(data + done, n);
+                done += n;
+            }
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (ok)
+            {
+                _stats.bytesSent += len;
+            }
+            _uartOwner = nullptr;
+            return ok;
+        }
+
+        void beginFrame()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _frameOwner = xTaskGetCurrentTaskHandle();
+        }
+
+        void endFrame()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            flushDirty();
+            flushStage();
+            _frameOwner = nullptr;
+        }
+
+        // Olvida la sombra. Lo siguiente que se escriba se envía.
+        void invalidate()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            memset(_shadow, 0, sizeof(_shadow));
+        }
+
+        tHMIoutStats getStats()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _stats;
+        }
+
+        void resetStats()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _stats = tHMIoutStats();
+            _stats.since = millis();
+        }
+};
+
+// Instancia única. Las copias de HMI que tienen los procesadores escriben por aquí.
+HMIout hmiOut;
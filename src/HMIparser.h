@@ -0,0 +1,502 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: HMIparser.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Recepción de comandos de la pantalla Nextion byte a byte.
+
+    La pantalla no termina los comandos. Envía el token (PLAY, BKX=, VOL=...) seguido, si
+    acaso, de un valor binario, y si manda varios seguidos los separa con tres espacios
+    (0x20 0x20 0x20). Antes se leía con SerialHW.readString(), que no vuelve hasta que vence el
+    timeout del Stream. Ahora:
+
+      - HMIframer     Trocea la entrada por el separador de tres espacios o por silencio en la
+                      línea (fin de ráfaga). No usa memoria dinámica.
+      - hmiLookup     Busca el token del comando en una tabla ordenada (búsqueda binaria).
+      - HMIrx         (solo Arduino) Callback de la UART que salta tras HMI_RX_IDLE_SYMBOLS
+                      símbolos sin datos, trocea lo recibido y deja las tramas en una cola
+                      que consume HMI::readUART().
+
+    HMIframer y hmiLookup no dependen del framework para poder probarse en el host
+    reproduciendo capturas de la UART.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Tamaño máximo de un comando recibido
+#define HMI_FRAME_MAX 256
+// Tramas pendientes en la cola
+#define HMI_FRAME_SLOTS 8
+// Silencio en la línea que cierra una ráfaga (símbolos de 10 bits, ~0.1 ms a 921600)
+#define HMI_RX_IDLE_SYMBOLS 10
+
+struct tHMIframe
+{
+    uint16_t len;
+    // Instante de recepción (us) para medir la latencia hasta que se atiende
+    uint32_t tUs;
+    char data[HMI_FRAME_MAX];
+};
+
+class HMIframer
+{
+    private:
+
+        tHMIframe _cur = {};
+        int _spaces = 0;
+        uint32_t _overflows = 0;
+
+        bool emit(int len, tHMIframe &out)
+        {
+            bool ok = len > 0;
+            if (ok)
+            {
+                memcpy(out.data, _cur.data, len);
+                out.len = len;
+                out.tUs = _cur.tUs;
+            }
+            _cur.len = 0;
+            _spaces = 0;
+            return ok;
+        }
+
+    public:
+
+        // Añade un byte. Devuelve true si se ha completado una trama en "out"
+        bool feed(uint8_t b, uint32_t nowUs, tHMIframe &out)
+        {
+            if (_cur.len == 0)
+            {
+                _cur.tUs = nowUs;
+            }
+
+            if (_cur.len == HMI_FRAME_MAX)
+            {
+                // No cabe. Se entrega lo que hay y se empieza otra.
+                _overflows++;
+                emit(HMI_FRAME_MAX, out);
+                _cur.data[_cur.len++] = b;
+                _cur.tUs = nowUs;
+                return true;
+            }
+
+            _cur.data[_cur.len++] = b;
+
+            if (b == 0x20)
+            {
+                if (++_spaces == 3)
+                {
+                    // El separador no forma parte del comando
+                    return emit(_cur.len - 3, out);
+                }
+            }
+            else
+            {
+                _spaces = 0;
+            }
+
+            return false;
+        }
+
+        // Fin de ráfaga. Lo pendiente es un comando completo.
+        bool idle(tHMIframe &out)
+        {
+            return emit(_cur.len, out);
+        }
+
+        uint32_t getOverflows()
+        {
+            return _overflows;
+        }
+};
+
+// Comandos de la pantalla. Los controles del TAPE tienen manejador directo en
+// HMI::dispatchFrame; el resto los atiende HMI::verifyCommand con el identificador.
+enum tHMIcmdId
+{
+    HMICMD_NONE = 0,
+    HMICMD_BBCL,
+    HMICMD_BBOPEN,
+    HMICMD_BDOWN,
+    HMICMD_BKX,
+    HMICMD_BUP,
+    HMICMD_CHD,
+    HMICMD_DSD,
+    HMICMD_EAR,
+    HMICMD_EJECT,
+    HMICMD_EMI,
+    HMICMD_ESH,
+    HMICMD_FAV,
+    HMICMD_FEND,
+    HMICMD_FFWD,
+    HMICMD_FINI,
+    HMICMD_FPDOWN,
+    HMICMD_FPHOME,
+    HMICMD_FPUP,
+    HMICMD_FRQ1,
+    HMICMD_FRQ2,
+    HMICMD_FRQ3,
+    HMICMD_FRQ4,
+    HMICMD_FRQ5,
+    HMICMD_FRQ6,
+    HMICMD_FRQ7,
+    HMICMD_FRQ8,
+    HMICMD_GFIL,
+    HMICMD_HMIBENCH,
+    HMICMD_INFB,
+    HMICMD_INTEGRITY,
+    HMICMD_LCDON,
+    HMICMD_LFI,
+    HMICMD_LOO,
+    HMICMD_MAM,
+    HMICMD_MP1,
+    HMICMD_MP2,
+    HMICMD_MP3,
+    HMICMD_MP4,
+    HMICMD_MP5,
+    HMICMD_MP6,
+    HMICMD_MP7,
+    HMICMD_MP8,
+    HMICMD_MP9,
+    HMICMD_OUTFB,
+    HMICMD_PAG,
+    HMICMD_PAR,
+    HMICMD_PAUSE,
+    HMICMD_PDEBUG,
+    HMICMD_PLAY,
+    HMICMD_PLS,
+    HMICMD_PLZ,
+    HMICMD_PMENU1,
+    HMICMD_PSCOPE,
+    HMICMD_PTAPE,
+    HMICMD_REC,
+    HMICMD_REL,
+    HMICMD_RFSH,
+    HMICMD_RSET,
+    HMICMD_RWD,
+    HMICMD_SAM,
+    HMICMD_SAV,
+    HMICMD_SCT,
+    HMICMD_SCZ,
+    HMICMD_SDBENCH,
+    HMICMD_SDD,
+    HMICMD_SHR,
+    HMICMD_STE,
+    HMICMD_STOP,
+    HMICMD_TER,
+    HMICMD_THR,
+    HMICMD_TRS,
+    HMICMD_TXTF,
+    HMICMD_VLL,
+    HMICMD_VOL,
+    HMICMD_VOLDW,
+    HMICMD_VOLUP,
+    HMICMD_VRR,
+    HMICMD_WAV,
+    HMICMD_WIF,
+    HMICMD_ZER
+};
+
+struct tHMIcmd
+{
+    const char* token;
+    uint8_t id;
+};
+
+// Ordenada por token (strcmp). Ningún token es prefijo de otro.
+static const tHMIcmd HMI_CMD_TABLE[] =
+{
+    {"BBCL=",      HMICMD_BBCL},
+    {"BBOPEN",     HMICMD_BBOPEN},
+    {"BDOWN",      HMICMD_BDOWN},
+    {"BKX=",       HMICMD_BKX},
+    {"BUP",        HMICMD_BUP},
+    {"CHD=",       HMICMD_CHD},
+    {"DSD",        HMICMD_DSD},
+    {"EAR=",       HMICMD_EAR},
+    {"EJECT",      HMICMD_EJECT},
+    {"EMI=",       HMICMD_EMI},
+    {"ESH=",       HMICMD_ESH},
+    {"FAV=",       HMICMD_FAV},
+    {"FEND",       HMICMD_FEND},
+    {"FFWD",       HMICMD_FFWD},
+    {"FINI",       HMICMD_FINI},
+    {"FPDOWN",     HMICMD_FPDOWN},
+    {"FPHOME",     HMICMD_FPHOME},
+    {"FPUP",       HMICMD_FPUP},
+    {"FRQ1",       HMICMD_FRQ1},
+    {"FRQ2",       HMICMD_FRQ2},
+    {"FRQ3",       HMICMD_FRQ3},
+    {"FRQ4",       HMICMD_FRQ4},
+    {"FRQ5",       HMICMD_FRQ5},
+    {"FRQ6",       HMICMD_FRQ6},
+    {"FRQ7",       HMICMD_FRQ7},
+    {"FRQ8",       HMICMD_FRQ8},
+    {"GFIL",       HMICMD_GFIL},
+    {"HMIBENCH",   HMICMD_HMIBENCH},
+    {"INFB",       HMICMD_INFB},
+    {"INTEGRITY",  HMICMD_INTEGRITY},
+    {"LCDON",      HMICMD_LCDON},
+    {"LFI=",       HMICMD_LFI},
+    {"LOO=",       HMICMD_LOO},
+    {"MAM=",       HMICMD_MAM},
+    {"MP1=",       HMICMD_MP1},
+    {"MP2=",       HMICMD_MP2},
+    {"MP3=",       HMICMD_MP3},
+    {"MP4=",       HMICMD_MP4},
+    {"MP5=",       HMICMD_MP5},
+    {"MP6=",       HMICMD_MP6},
+    {"MP7=",       HMICMD_MP7},
+    {"MP8=",       HMICMD_MP8},
+    {"MP9=",       HMICMD_MP9},
+    {"OUTFB",      HMICMD_OUTFB},
+    {"PAG=",       HMICMD_PAG},
+    {"PAR=",       HMICMD_PAR},
+    {"PAUSE",      HMICMD_PAUSE},
+    {"PDEBUG",     HMICMD_PDEBUG},
+    {"PLAY",       HMICMD_PLAY},
+    {"PLS=",       HMICMD_PLS},
+    {"PLZ=",       HMICMD_PLZ},
+    {"PMENU1",     HMICMD_PMENU1},
+    {"PSCOPE",     HMICMD_PSCOPE},
+    {"PTAPE",      HMICMD_PTAPE},
+    {"REC",        HMICMD_REC},
+    {"REL=",       HMICMD_REL},
+    {"RFSH",       HMICMD_RFSH},
+    {"RSET",       HMICMD_RSET},
+    {"RWD",        HMICMD_RWD},
+    {"SAM=",       HMICMD_SAM},
+    {"SAV",        HMICMD_SAV},
+    {"SCT=",       HMICMD_SCT},
+    {"SCZ=",       HMICMD_SCZ},
+    {"SDBENCH",    HMICMD_SDBENCH},
+    {"SDD=",       HMICMD_SDD},
+    {"SHR",        HMICMD_SHR},
+    {"STE=",       HMICMD_STE},
+    {"STOP",       HMICMD_STOP},
+    {"TER=",       HMICMD_TER},
+    {"THR=",       HMICMD_THR},
+    {"TRS=",       HMICMD_TRS},
+    {"TXTF=",      HMICMD_TXTF},
+    {"VLL=",       HMICMD_VLL},
+    {"VOL=",       HMICMD_VOL},
+    {"VOLDW",      HMICMD_VOLDW},
+    {"VOLUP",      HMICMD_VOLUP},
+    {"VRR=",       HMICMD_VRR},
+    {"WAV=",       HMICMD_WAV},
+    {"WIF=",       HMICMD_WIF},
+    {"ZER=",       HMICMD_ZER}
+};
+
+#define HMI_CMD_TABLE_SIZE (sizeof(HMI_CMD_TABLE) / sizeof(HMI_CMD_TABLE[0]))
+
+// Compara el principio de la trama con el token: 0 si la trama empieza por él
+static int hmiTokenCmp(const char* data, int len, const char* t)
+{
+    int n = 0;
+    while (t[n] != 0)
+    {
+        if (n == len)
+        {
+            // La trama es más corta: va antes
+            return -1;
+        }
+        if ((uint8_t)data[n] != (uint8_t)t[n])
+        {
+            return (uint8_t)data[n] < (uint8_t)t[n] ? -1 : 1;
+        }
+        n++;
+    }
+    return 0;
+}
+
+// Identificador del comando con el que empieza la trama o HMICMD_NONE. Lo que sigue al
+// token (el valor de BKX=, VOL=...) no se mira.
+static int hmiLookup(const char* data, int len)
+{
+    int lo = 0;
+    int hi = HMI_CMD_TABLE_SIZE - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int c = hmiTokenCmp(data, len, HMI_CMD_TABLE[mid].token);
+
+        if (c == 0)
+        {
+            return HMI_CMD_TABLE[mid].id;
+        }
+        else if (c < 0)
+        {
+            hi = mid - 1;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return HMICMD_NONE;
+}
+
+#ifdef ARDUINO
+
+struct tHMIrxStats
+{
+    uint32_t frames = 0;
+    uint32_t queueFull = 0;
+    // Peor tiempo desde que llega la trama hasta que se atiende
+    uint32_t maxDispatchUs = 0;
+};
+
+class HMIrx
+{
+    private:
+
+        HardwareSerial* _serial = nullptr;
+        QueueHandle_t _q = nullptr;
+        HMIframer _framer;
+        volatile bool _suspended = false;
+        // Respuesta 0xFE FF FF FF (listo para datos transparentes)
+        SemaphoreHandle_t _xfer = nullptr;
+        uint32_t _tail = 0;
+
+        tHMIrxStats _stats;
+
+        void push(const tHMIframe &f)
+        {
+            _stats.frames++;
+            if (xQueueSend(_q, &f, 0) != pdTRUE)
+            {
+                _stats.queueFull++;
+            }
+        }
+
+        // Tarea de eventos de la UART, tras el silencio de fin de ráfaga
+        void service()
+        {
+            if (_suspended)
+            {
+                return;
+            }
+
+            static tHMIframe f;
+            while (_serial->available())
+            {
+                uint8_t b = _serial->read();
+
+                _tail = (_tail << 8) | b;
+                if (_tail == 0xFEFFFFFF)
+                {
+                    xSemaphoreGive(_xfer);
+                }
+
+                if (_framer.feed(b, micros(), f))
+                {
+                    push(f);
+                }
+            }
+
+            if (_framer.idle(f))
+            {
+                push(f);
+            }
+        }
+
+    public:
+
+        void begin(HardwareSerial &serial)
+        {
+            _serial = &serial;
+            _q = xQueueCreate(HMI_FRAME_SLOTS, sizeof(tHMIframe));
+            _xfer = xSemaphoreCreateBinary();
+            _serial->setRxTimeout(HMI_RX_IDLE_SYMBOLS);
+            _serial->onReceive([this]() { service(); }, true);
+        }
+
+        bool started()
+        {
+            return _q != nullptr && !_suspended;
+        }
+
+        // Para leer la UART directamente (subida del firmware de la pantalla)
+        void suspend(bool s)
+        {
+            _suspended = s;
+        }
+
+        // Descarta una respuesta 0xFE atrasada. Antes de enviar un comando transparente.
+        void armTransparent()
+        {
+            if (_xfer != nullptr)
+            {
+                xSemaphoreTake(_xfer, 0);
+            }
+        }
+
+        // Espera la respuesta 0xFE. Sin recepción por eventos (arranque) se da un margen fijo.
+        bool waitTransparent(uint32_t ms)
+        {
+            if (!started())
+            {
+                vTaskDelay(pdMS_TO_TICKS(ms));
+                return true;
+            }
+            return xSemaphoreTake(_xfer, pdMS_TO_TICKS(ms)) == pdTRUE;
+        }
+
+        bool pop(tHMIframe &f)
+        {
+            return _q != nullptr && xQueueReceive(_q, &f, 0) == pdTRUE;
+        }
+
+        void dispatched(const tHMIframe &f)
+        {
+            uint32_t us = micros() - f.tUs;
+            if (us > _stats.maxDispatchUs)
+            {
+                _stats.maxDispatchUs = us;
+            }
+        }
+
+        tHMIrxStats getStats()
+        {
+            return _stats;
+        }
+
+        void resetStats()
+        {
+            _stats = tHMIrxStats();
+        }
+};
+
+HMIrx hmiRx;
+
+#endif
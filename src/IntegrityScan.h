@@ -0,0 +1,792 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: IntegrityScan.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Comprobación en segundo plano de todas las cintas de la SD.
+
+    Una tarea recorre la tarjeta entera y, para cada TAP/TZX/TSX/CDT, comprueba el checksum
+    (XOR) de todos los bloques con datos de la ROM (TAP, 0x10 y 0x11). También apunta los
+    ficheros truncados, los TZX con cabecera mala y los ID que el reproductor no sabe tocar
+    (0x18, 0x19, ...). Las cintas con problemas van a un informe de texto, una línea por
+    cinta:
+
+      /_integrity.txt     <ruta>\tbad=2 (blocks 3,7)\tunsupported=1 (ID 0x19)\ttruncated
+
+    Cada cinta se lee en orden con lecturas grandes (IntegrityWindow, 32 KB) que sirven tanto
+    para las cabeceras que recorre TapeWalker como para el XOR, que se hace de 32 en 32 bits.
+
+    Se puede parar y seguir: después de cada cinta se guardan los contadores y la posición en
+    cada nivel de directorios en /_integrity.pos. Si se apaga a mitad, sigue al arrancar.
+
+    Igual que las miniaturas, no hace nada mientras haya PLAY o REC, usa la SD como
+    SDIO_BACKGROUND y descansa un poco entre lecturas. Si se va a remontar la SD deja la
+    cinta en curso y la repite después.
+
+    La comprobación de una cinta no depende del framework para poder probarse en el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "TapeWalker.h"
+
+#define INTEGRITY_REPORT "/_integrity.txt"
+#define INTEGRITY_STATE "/_integrity.pos"
+#define INTEGRITY_STATE_VERSION "v1"
+
+// Lecturas de la cinta
+#define INTEGRITY_WINDOW 32768
+// Descanso entre lecturas (ms) para dejar la SD a los demás
+#define INTEGRITY_REST_MS 5
+// Niveles de directorios que se recorren
+#define INTEGRITY_MAX_DEPTH 8
+// Bloques malos e ID no soportados que se apuntan por cinta
+#define INTEGRITY_MAX_LISTED 8
+
+// XOR de un trozo de datos empezando por x. Se hace de palabra en palabra.
+static inline uint8_t tapeXor(const uint8_t* p, size_t n, uint8_t x)
+{
+    while (n > 0 && ((uintptr_t)p & 3) != 0)
+    {
+        x ^= *p++;
+        n--;
+    }
+
+    uint32_t w = 0;
+    for (; n >= 16; n -= 16, p += 16)
+    {
+        uint32_t a, b, c, d;
+        memcpy(&a, p, 4);
+        memcpy(&b, p + 4, 4);
+        memcpy(&c, p + 8, 4);
+        memcpy(&d, p + 12, 4);
+        w ^= a ^ b ^ c ^ d;
+    }
+    for (; n >= 4; n -= 4, p += 4)
+    {
+        uint32_t a;
+        memcpy(&a, p, 4);
+        w ^= a;
+    }
+    w ^= w >> 16;
+    w ^= w >> 8;
+    x ^= (uint8_t)w;
+
+    while (n-- > 0)
+    {
+        x ^= *p++;
+    }
+    return x;
+}
+
+// ¿Sabe el reproductor tocar este ID? (TZXprocessor::getTZXBlock)
+static inline bool integrityIdSupported(uint8_t id)
+{
+    switch (id)
+    {
+        case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15:
+        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25:
+        case 0x26: case 0x27: case 0x28: case 0x2A: case 0x2B:
+        case 0x30: case 0x31: case 0x32: case 0x33: case 0x35:
+        case 0x4B: case 0x5A:
+            return true;
+        default:
+            return false;
+    }
+}
+
+struct tIntegrityResult
+{
+    uint32_t blocks = 0;
+    // Bloques con checksum comprobados y los que están mal
+    uint32_t checked = 0;
+    uint32_t bad = 0;
+    uint32_t unsupported = 0;
+    bool truncated = false;
+    // No empieza por "ZXTape!"
+    bool badHeader = false;
+
+    int badBlocks[INTEGRITY_MAX_LISTED];
+    int numBadBlocks = 0;
+    uint8_t ids[INTEGRITY_MAX_LISTED];
+    int numIds = 0;
+
+    bool clean() const
+    {
+        return bad == 0 && unsupported == 0 && !truncated && !badHeader;
+    }
+};
+
+// Ventana de lectura secuencial sobre el lector de TapeWalker. buf = INTEGRITY_WINDOW o lo
+// que se quiera. Cada byte de la cinta se lee una vez salvo las cabeceras que caen en el borde.
+template <class R>
+class IntegrityWindow
+{
+    private:
+
+        R& _reader;
+        uint8_t* _buf;
+        uint32_t _cap;
+        uint32_t _size;
+        uint32_t _start = 0;
+        uint32_t _len = 0;
+
+        bool fill(uint32_t offset)
+        {
+            uint32_t want = _size - offset < _cap ? _size - offset : _cap;
+            int n = offset < _size ? _reader.read(offset, _buf, (int)want) : 0;
+            if (n <= 0)
+            {
+                _len = 0;
+                return false;
+            }
+            _start = offset;
+            _len = n;
+            reads++;
+            return true;
+        }
+
+        bool inside(uint32_t offset)
+        {
+            return offset >= _start && offset < _start + _len;
+        }
+
+    public:
+
+        uint32_t reads = 0;
+
+        IntegrityWindow(R& reader, uint8_t* buf, uint32_t cap, uint32_t size)
+            : _reader(reader), _buf(buf), _cap(cap), _size(size)
+        {
+        }
+
+        // Para TapeWalker
+        int read(uint32_t offset, uint8_t* out, int len)
+        {
+            if (!inside(offset) || offset + len > _start + _len)
+            {
+                if (!fill(offset))
+                {
+                    return 0;
+                }
+            }
+            uint32_t n = _start + _len - offset;
+            if (n > (uint32_t)len)
+            {
+                n = len;
+            }
+            memcpy(out, _buf + (offset - _start), n);
+            return (int)n;
+        }
+
+        // XOR de un trozo de la cinta. false si no se puede leer
+        bool xorRange(uint32_t offset, uint32_t len, uint8_t &x)
+        {
+            while (len > 0)
+            {
+                if (!inside(offset) && !fill(offset))
+                {
+                    return false;
+                }
+                uint32_t n = _start + _len - offset;
+                if (n > len)
+                {
+                    n = len;
+                }
+                x = tapeXor(_buf + (offset - _start), n, x);
+                offset += n;
+                len -= n;
+            }
+            return true;
+        }
+};
+
+// Comprueba una cinta. keepGoing() se consulta entre bloques; si devuelve false se deja a
+// medias y el resultado no vale (devuelve false)
+template <class R, class K>
+bool integrityCheck(IntegrityWindow<R> &win, uint32_t size, bool tzx, tIntegrityResult &res, K keepGoing)
+{
+    res = tIntegrityResult();
+    TapeWalker<IntegrityWindow<R>> walker(win, size, tzx);
+    tTapeBlock b;
+
+    if (!walker.begin())
+    {
+        res.badHeader = true;
+        return true;
+    }
+
+    while (walker.next(b))
+    {
+        if (!keepGoing())
+        {
+            return false;
+        }
+
+        res.blocks++;
+
+        if (tzx && !integrityIdSupported(b.id))
+        {
+            res.unsupported++;
+            bool listed = false;
+            for (int i = 0; i < res.numIds; i++)
+            {
+                listed = listed || res.ids[i] == b.id;
+            }
+            if (!listed && res.numIds < INTEGRITY_MAX_LISTED)
+            {
+                res.ids[res.numIds++] = b.id;
+            }
+            continue;
+        }
+
+        // Flag + datos + checksum
+        if ((b.id == 0x10 || b.id == 0x11) && b.dataSize >= 2)
+        {
+            uint8_t x = 0;
+            if (!win.xorRange(b.dataOffset, b.dataSize, x))
+            {
+                res.truncated = true;
+                return true;
+            }
+            res.checked++;
+            if (x != 0)
+            {
+                res.bad++;
+                if (res.numBadBlocks < INTEGRITY_MAX_LISTED)
+                {
+                    res.badBlocks[res.numBadBlocks++] = b.index;
+                }
+            }
+        }
+    }
+
+    res.truncated = walker.error();
+    return true;
+}
+
+// Línea del informe. 0 si la cinta está bien
+static inline size_t integrityReportLine(char* out, size_t cap, const char* path, const tIntegrityResult &r)
+{
+    if (r.clean())
+    {
+        return 0;
+    }
+
+    int n = snprintf(out, cap, "%s", path);
+
+    if (r.badHeader)
+    {
+        n += snprintf(out + n, cap - n, "\tnot a tzx");
+    }
+
+    if (r.bad > 0)
+    {
+        n += snprintf(out + n, cap - n, "\tbad=%u (blocks", (unsigned)r.bad);
+        for (int i = 0; i < r.numBadBlocks && n < (int)cap; i++)
+        {
+            n += snprintf(out + n, cap - n, "%c%d", i == 0 ? ' ' : ',', r.badBlocks[i]);
+        }
+        n += snprintf(out + n, cap - n, "%s)", r.bad > (uint32_t)r.numBadBlocks ? ",..." : "");
+    }
+
+    if (r.unsupported > 0)
+    {
+        n += snprintf(out + n, cap - n, "\tunsupported=%u (ID", (unsigned)r.unsupported);
+        for (int i = 0; i < r.numIds && n < (int)cap; i++)
+        {
+            n += snprintf(out + n, cap - n, "%c0x%02X", i == 0 ? ' ' : ',', r.ids[i]);
+        }
+        n += snprintf(out + n, cap - n, ")");
+    }
+
+    if (r.truncated)
+    {
+        n += snprintf(out + n, cap - n, "\ttruncated");
+    }
+
+    n += snprintf(out + n, cap - n, "\n");
+    return n < (int)cap ? n : cap - 1;
+}
+
+// Contadores de un recorrido completo (se guardan en INTEGRITY_STATE)
+struct tIntegrityTotals
+{
+    uint32_t tapes = 0;
+    uint32_t blocks = 0;
+    uint32_t checked = 0;
+    uint32_t bad = 0;
+    uint32_t unsupported = 0;
+    uint32_t truncated = 0;
+    // Cintas con algún problema
+    uint32_t badTapes = 0;
+
+    void add(const tIntegrityResult &r)
+    {
+        tapes++;
+        blocks += r.blocks;
+        checked += r.checked;
+        bad += r.bad;
+        unsupported += r.unsupported;
+        truncated += (r.truncated || r.badHeader) ? 1 : 0;
+        badTapes += r.clean() ? 0 : 1;
+    }
+};
+
+#ifdef ARDUINO
+
+struct tIntegrityStatus
+{
+    bool running = false;
+    bool done = false;
+    tIntegrityTotals totals;
+    String current = "";
+    uint32_t elapsedMs = 0;
+};
+
+class IntegrityScanner
+{
+    private:
+
+        struct tLevel
+        {
+            String path;
+            uint32_t pos;
+        };
+
+        struct tReader
+        {
+            IntegrityScanner* self;
+            File32* f;
+
+            int read(uint32_t offset, uint8_t* buffer, int len)
+            {
+                if (!self->waitIdle())
+                {
+                    return 0;
+                }
+                bool ok;
+                {
+                    SDioLock lock(SDIO_BACKGROUND);
+                    ok = f->seekSet(offset);
+                }
+                int n = ok ? sdsched.read(*f, buffer, len, SDIO_BACKGROUND) : 0;
+                vTaskDelay(INTEGRITY_REST_MS / portTICK_PERIOD_MS);
+                return n;
+            }
+        };
+
+        TaskHandle_t _task = nullptr;
+        SemaphoreHandle_t _go = nullptr;
+        volatile bool _stop = false;
+        volatile bool _resume = false;
+
+        std::mutex _mtx;
+        tIntegrityStatus _status;
+
+        tLevel _stack[INTEGRITY_MAX_DEPTH];
+        int _depth = 0;
+
+        static String join(const String &dir, const char* name)
+        {
+            return dir.endsWith("/") ? dir + name : dir + "/" + name;
+        }
+
+        static void worker(void* param)
+        {
+            IntegrityScanner* self = (IntegrityScanner*)param;
+
+            for (;;)
+            {
+                xSemaphoreTake(self->_go, portMAX_DELAY);
+                self->run(self->_resume);
+            }
+        }
+
+        // Ni parada ni remontaje de la SD pendiente
+        bool keepGoing()
+        {
+            return !_stop && !sdsched.remountPending();
+        }
+
+        // Se cede la SD al reproductor/grabador. false si hay que parar o dejar la cinta
+        bool waitIdle()
+        {
+            while ((PLAY || REC) && keepGoing())
+            {
+                vTaskDelay(500 / portTICK_PERIOD_MS);
+            }
+            return keepGoing();
+        }
+
+        // Contadores y pila de directorios
+        bool saveState(bool done, uint32_t elapsedMs)
+        {
+            tIntegrityTotals t;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                t = _status.totals;
+            }
+
+            char line[96];
+            File32 f;
+            SDioLock lock(SDIO_BACKGROUND);
+            if (!f.open(INTEGRITY_STATE, O_WRONLY | O_CREAT | O_TRUNC))
+            {
+                return false;
+            }
+
+            snprintf(line, sizeof(line), "%s %s %u %u %u %u %u %u %u %u\n", INTEGRITY_STATE_VERSION,
+                     done ? "done" : "running", (unsigned)t.tapes, (unsigned)t.blocks, (unsigned)t.checked,
+                     (unsigned)t.bad, (unsigned)t.unsupported, (unsigned)t.truncated, (unsigned)t.badTapes,
+                     (unsigned)elapsedMs);
+            f.write(line, strlen(line));
+
+            for (int i = 0; i < _depth && !done; i++)
+            {
+                f.print(String(_stack[i].pos) + "\t" + _stack[i].path + "\n");
+            }
+            f.close();
+            return true;
+        }
+
+        // false si no hay estado o el recorrido ya terminó
+        bool loadState(tIntegrityTotals &t, uint32_t &elapsedMs, bool &done)
+        {
+            char line[300];
+            char version[8];
+            char state[12];
+            File32 f;
+            SDioLock lock(SDIO_BACKGROUND);
+
+            done = false;
+            _depth = 0;
+
+            if (!f.open(INTEGRITY_STATE, O_RDONLY))
+            {
+                return false;
+            }
+
+            unsigned v[8] = {0};
+            bool ok = f.fgets(line, sizeof(line)) > 0
+                      && sscanf(line, "%7s %11s %u %u %u %u %u %u %u %u", version, state, &v[0], &v[1], &v[2],
+                                &v[3], &v[4], &v[5], &v[6], &v[7]) == 10
+                      && strcmp(version, INTEGRITY_STATE_VERSION) == 0;
+
+            if (ok)
+            {
+                t.tapes = v[0];
+                t.blocks = v[1];
+                t.checked = v[2];
+                t.bad = v[3];
+                t.unsupported = v[4];
+                t.truncated = v[5];
+                t.badTapes = v[6];
+                elapsedMs = v[7];
+                done = strcmp(state, "done") == 0;
+            }
+
+            while (ok && !done && _depth < INTEGRITY_MAX_DEPTH && f.fgets(line, sizeof(line)) > 0)
+            {
+                char* tab = strchr(line, '\t');
+                if (tab == nullptr)
+                {
+                    break;
+                }
+                char* end = tab + strlen(tab);
+                while (end > tab && (end[-1] == '\n' || end[-1] == '\r'))
+                {
+                    *--end = 0;
+                }
+                *tab = 0;
+                _stack[_depth].pos = strtoul(line, nullptr, 10);
+                _stack[_depth].path = String(tab + 1);
+                _depth++;
+            }
+            f.close();
+            return ok && !done && _depth > 0;
+        }
+
+        void appendReport(const char* text, size_t len)
+        {
+            File32 f;
+            SDioLock lock(SDIO_BACKGROUND);
+            if (f.open(INTEGRITY_REPORT, O_WRONLY | O_CREAT | O_APPEND))
+            {
+                f.write(text, len);
+                f.close();
+            }
+        }
+
+        // Comprueba una cinta. false si se ha parado a mitad
+        bool checkTape(const String &path, bool tzx, uint8_t* buf, tIntegrityResult &res)
+        {
+            File32 tape;
+            uint32_t size;
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                if (!tape.open(path.c_str(), O_RDONLY))
+                {
+                    res = tIntegrityResult();
+                    res.truncated = true;
+                    return true;
+                }
+                size = tape.fileSize();
+            }
+
+            tReader reader = {this, &tape};
+            IntegrityWindow<tReader> win(reader, buf, INTEGRITY_WINDOW, size);
+            bool finished = integrityCheck(win, size, tzx, res, [this]() { return keepGoing(); }) && keepGoing();
+
+            SDioLock lock(SDIO_BACKGROUND);
+            tape.close();
+            return finished;
+        }
+
+        void run(bool resume)
+        {
+            unsigned long t0 = millis();
+            tIntegrityTotals totals;
+            uint32_t elapsedBase = 0;
+            bool done;
+
+            if (!resume || !loadState(totals, elapsedBase, done))
+            {
+                totals = tIntegrityTotals();
+                elapsedBase = 0;
+                _depth = 1;
+                _stack[0].path = "/";
+                _stack[0].pos = 0;
+
+                const char* head = "# powadcr tape integrity report\n";
+                SDioLock lock(SDIO_BACKGROUND);
+                File32 f;
+                if (f.open(INTEGRITY_REPORT, O_WRONLY | O_CREAT | O_TRUNC))
+                {
+                    f.write(head, strlen(head));
+                    f.close();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _status.running = true;
+                _status.done = false;
+                _status.totals = totals;
+            }
+
+            uint8_t* buf = (uint8_t*)blockPool.alloc(INTEGRITY_WINDOW);
+            char name[256];
+            char line[400];
+            File32 d;
+            File32 entry;
+
+            while (buf != nullptr && _depth > 0 && !_stop)
+            {
+                // Entre una entrada y otra no queda nada abierto: aquí se espera a un remontaje
+                SDsession session;
+                if (!waitIdle())
+                {
+                    continue;
+                }
+
+                tLevel &top = _stack[_depth - 1];
+                uint32_t before = top.pos;
+                bool isDir = false;
+                bool skip = true;
+                bool end = false;
+
+                {
+                    SDioLock lock(SDIO_BACKGROUND);
+                    if (!d.open(top.path.c_str(), O_RDONLY) || !d.seekSet(top.pos) || !entry.openNext(&d, O_RDONLY))
+                    {
+                        end = true;
+                    }
+                    else
+                    {
+                        entry.getName(name, sizeof(name));
+                        isDir = entry.isDir();
+                        skip = entry.isHidden() || name[0] == '.';
+                        top.pos = d.curPosition();
+                        entry.close();
+                    }
+                    d.close();
+                }
+
+                if (end)
+                {
+                    _depth--;
+                    continue;
+                }
+
+                String path = join(top.path, name);
+                bool tzx;
+
+                if (skip)
+                {
+                    continue;
+                }
+
+                if (isDir)
+                {
+                    if (_depth < INTEGRITY_MAX_DEPTH && strcmp(name, "System Volume Information") != 0)
+                    {
+                        _stack[_depth].path = path;
+                        _stack[_depth].pos = 0;
+                        _depth++;
+                    }
+                    continue;
+                }
+
+                if (!thumbIsTape(name, tzx))
+                {
+                    continue;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    _status.current = path;
+                }
+
+                tIntegrityResult res;
+                if (!checkTape(path, tzx, buf, res))
+                {
+                    // Se repite al seguir (o tras el remontaje)
+                    top.pos = before;
+                    continue;
+                }
+
+                size_t n = integrityReportLine(line, sizeof(line), path.c_str(), res);
+                if (n > 0)
+                {
+                    appendReport(line, n);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    _status.totals.add(res);
+                    _status.elapsedMs = elapsedBase + (millis() - t0);
+                }
+                saveState(false, elapsedBase + (millis() - t0));
+            }
+
+            blockPool.release(buf);
+
+            bool finished = buf != nullptr && _depth == 0;
+            uint32_t elapsed = elapsedBase + (millis() - t0);
+
+            if (finished)
+            {
+                tIntegrityTotals t;
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    t = _status.totals;
+                }
+                snprintf(line, sizeof(line), "# %u tapes, %u blocks, %u checked, %u bad, %u unsupported, %u truncated, %u ms\n",
+                         (unsigned)t.tapes, (unsigned)t.blocks, (unsigned)t.checked, (unsigned)t.bad,
+                         (unsigned)t.unsupported, (unsigned)t.truncated, (unsigned)elapsed);
+                appendReport(line, strlen(line));
+            }
+            saveState(finished, elapsed);
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            _status.running = false;
+            _status.done = finished;
+            _status.current = "";
+            _status.elapsedMs = elapsed;
+        }
+
+    public:
+
+        // Empieza de cero o sigue donde se quedó (resume). No hace nada si ya está en marcha
+        bool start(bool resume)
+        {
+            if (_task == nullptr)
+            {
+                _go = xSemaphoreCreateBinary();
+                // Prioridad mínima, en el núcleo del HMI
+                xTaskCreatePinnedToCore(worker, "integrity", 6144, this, 1, &_task, 1);
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (_status.running)
+                {
+                    return false;
+                }
+                _status.running = true;
+            }
+
+            _stop = false;
+            _resume = resume;
+            xSemaphoreGive(_go);
+            return true;
+        }
+
+        // Para después de la cinta actual (que se repite al seguir)
+        void stop()
+        {
+            _stop = true;
+        }
+
+        // Al arrancar: carga los contadores y sigue si se apagó a mitad de un recorrido
+        void resumeIfPending()
+        {
+            tIntegrityTotals t;
+            uint32_t elapsedMs = 0;
+            bool done;
+            bool pending = loadState(t, elapsedMs, done);
+
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _status.totals = t;
+                _status.done = done;
+                _status.elapsedMs = elapsedMs;
+            }
+
+            if (pending)
+            {
+                start(true);
+            }
+        }
+
+        tIntegrityStatus status()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _status;
+        }
+};
+
+IntegrityScanner integrity;
+
+#endif
@@ -0,0 +1,427 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: MemoryPool.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Gestión de memoria para los buffers de bloque de los procesadores TAP/TZX.
+
+    BlockPool - Buffers temporales (cabeceras, checksums, particiones, secuencias de pulsos).
+                Clases de tamaño fijo servidas desde slabs (un ps_malloc con varios buffers
+                de la misma clase) y lista de libres, de forma que tras el primer uso no se
+                vuelve a llamar a ps_calloc/free en cada bloque. Lo que no cabe en la clase
+                mayor se pide directamente a la PSRAM y se apunta en una lista aparte.
+                release() decide si un puntero es del pool por su dirección (dentro de un
+                slab o en la lista de grandes), sin leer nada delante de un puntero ajeno.
+
+    FileArena - Memoria que vive lo mismo que el fichero cargado (arrays de pulsos del
+                descriptor). Se reserva por trozos y se libera toda junta al expulsar.
+
+    Los contadores y la marca de máximo uso se muestran en HMI::updateMem().
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+// Clases de tamaño del pool (bytes útiles)
+#define POOL_CLASSES 5
+static const uint32_t POOL_CLASS_SIZE[POOL_CLASSES] = {64, 512, 4096, 16384, 65536};
+// Buffers por slab de cada clase
+static const int POOL_SLAB_COUNT[POOL_CLASSES] = {16, 8, 4, 4, 2};
+
+// Marca de buffer entregado y de buffer devuelto (detecta dobles release)
+#define POOL_MAGIC 0x504F
+#define POOL_FREED 0xDEAD
+#define POOL_LARGE 0xFF
+
+// Trozo de la arena por fichero
+#define ARENA_CHUNK_SIZE 16384
+
+struct tPoolStats
+{
+    uint32_t allocs = 0;        // Peticiones totales
+    uint32_t reused = 0;        // Servidas desde la lista de libres
+    uint32_t systemAllocs = 0;  // Tuvieron que pedir PSRAM (slab nuevo o grande)
+    uint32_t largeAllocs = 0;   // Mayores que la clase mayor
+    uint32_t inUse = 0;         // Bytes entregados ahora mismo
+    uint32_t highWater = 0;     // Máximo de inUse
+    uint32_t cached = 0;        // Bytes en listas de libres
+    uint32_t foreign = 0;       // release() de punteros que no son del pool
+    uint32_t doubleFree = 0;    // release() de buffers no entregados
+    uint32_t arenaBytes = 0;    // Bytes de la arena del fichero
+    uint32_t arenaHighWater = 0;
+};
+
+class BlockPool
+{
+    private:
+
+        // Cabecera delante de cada buffer. Mantiene el alineamiento a 8.
+        struct tHdr
+        {
+            uint16_t magic;
+            uint8_t cls;
+            uint8_t pad;
+            uint32_t size;
+            tHdr* next;
+            uint32_t pad2;
+        };
+
+        // Slab: POOL_SLAB_COUNT[cls] buffers seguidos de la misma clase
+        struct tSlab
+        {
+            tSlab* next;
+            uint8_t* begin;
+            uint8_t* end;
+            uint16_t cls;
+            uint16_t used;
+        };
+
+        tHdr* _free[POOL_CLASSES] = {};
+        tSlab* _slabs = nullptr;
+        // Buffers grandes entregados, enlazados por su cabecera
+        tHdr* _large = nullptr;
+
+        portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+        static int classFor(uint32_t size)
+        {
+            for (int c = 0; c < POOL_CLASSES; c++)
+            {
+                if (size <= POOL_CLASS_SIZE[c])
+                {
+                    return c;
+                }
+            }
+            return -1;
+        }
+
+        static uint32_t stride(int c)
+        {
+            return sizeof(tHdr) + POOL_CLASS_SIZE[c];
+        }
+
+        static uint32_t slabHeader()
+        {
+            return (sizeof(tSlab) + 7) & ~7u;
+        }
+
+        // Slab que contiene la dirección, o nullptr. Con _mux cogido.
+        tSlab* slabOf(const uint8_t* p)
+        {
+            for (tSlab* s = _slabs; s != nullptr; s = s->next)
+            {
+                if (p >= s->begin && p < s->end)
+                {
+                    return s;
+                }
+            }
+            return nullptr;
+        }
+
+        // Pide un slab nuevo y mete sus buffers en la lista de libres
+        bool grow(int c)
+        {
+            uint32_t count = POOL_SLAB_COUNT[c];
+            uint8_t* mem = (uint8_t*)ps_malloc(slabHeader() + count * stride(c));
+            if (mem == nullptr)
+            {
+                return false;
+            }
+
+            tSlab* s = (tSlab*)mem;
+            s->begin = mem + slabHeader();
+            s->end = s->begin + count * stride(c);
+            s->cls = c;
+            s->used = 0;
+
+            portENTER_CRITICAL(&_mux);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                tHdr* h = (tHdr*)(s->begin + i * stride(c));
+                h->magic = POOL_FREED;
+                h->cls = c;
+                h->size = POOL_CLASS_SIZE[c];
+                h->next = _free[c];
+                _free[c] = h;
+            }
+            s->next = _slabs;
+            _slabs = s;
+            stats.systemAllocs++;
+            stats.cached += count * POOL_CLASS_SIZE[c];
+            portEXIT_CRITICAL(&_mux);
+            return true;
+        }
+
+    public:
+
+        tPoolStats stats;
+
+        // Buffer de al menos "size" bytes, a cero (como ps_calloc)
+        void* alloc(uint32_t size)
+        {
+            int c = classFor(size);
+            tHdr* h = nullptr;
+
+            if (c < 0)
+            {
+                h = (tHdr*)ps_malloc(sizeof(tHdr) + size);
+                if (h == nullptr)
+                {
+                    return nullptr;
+                }
+                h->magic = POOL_MAGIC;
+                h->cls = POOL_LARGE;
+                h->size = size;
+
+                portENTER_CRITICAL(&_mux);
+                h->next = _large;
+                _large = h;
+                stats.allocs++;
+                stats.systemAllocs++;
+                stats.largeAllocs++;
+                stats.inUse += size;
+                if (stats.inUse > stats.highWater)
+                {
+                    stats.highWater = stats.inUse;
+                }
+                portEXIT_CRITICAL(&_mux);
+            }
+            else
+            {
+                bool fresh = false;
+                while (h == nullptr)
+                {
+                    portENTER_CRITICAL(&_mux);
+                    if (_free[c] != nullptr)
+                    {
+                        h = _free[c];
+                        _free[c] = h->next;
+                        slabOf((uint8_t*)h)->used++;
+                        h->magic = POOL_MAGIC;
+                        h->next = nullptr;
+                        stats.allocs++;
+                        if (!fresh) stats.reused++;
+                        stats.cached -= POOL_CLASS_SIZE[c];
+                        stats.inUse += POOL_CLASS_SIZE[c];
+                        if (stats.inUse > stats.highWater)
+                        {
+                            stats.highWater = stats.inUse;
+                        }
+                    }
+                    portEXIT_CRITICAL(&_mux);
+
+                    if (h == nullptr)
+                    {
+                        if (!grow(c))
+                        {
+                            return nullptr;
+                        }
+                        fresh = true;
+                    }
+                }
+            }
+
+            void* p = (void*)(h + 1);
+            memset(p, 0, size);
+            return p;
+        }
+
+        void release(void* p)
+        {
+            if (p == nullptr)
+            {
+                return;
+            }
+
+            uint8_t* addr = (uint8_t*)p;
+            tHdr* h = ((tHdr*)p) - 1;
+            bool foreign = false;
+            bool large = false;
+
+            portENTER_CRITICAL(&_mux);
+            tSlab* s = slabOf(addr);
+            if (s != nullptr)
+            {
+                // Solo vale el inicio de un buffer entregado. Lo demás es un error del
+                // llamante y no se toca.
+                if (((addr - s->begin) % stride(s->cls)) != sizeof(tHdr) || h->magic != POOL_MAGIC)
+                {
+                    stats.doubleFree++;
+                }
+                else
+                {
+                    h->magic = POOL_FREED;
+                    h->next = _free[s->cls];
+                    _free[s->cls] = h;
+                    s->used--;
+                    stats.inUse -= POOL_CLASS_SIZE[s->cls];
+                    stats.cached += POOL_CLASS_SIZE[s->cls];
+                }
+            }
+            else
+            {
+                foreign = true;
+                for (tHdr** l = &_large; *l != nullptr; l = &(*l)->next)
+                {
+                    if (*l == h)
+                    {
+                        *l = h->next;
+                        h->magic = POOL_FREED;
+                        stats.inUse -= h->size;
+                        foreign = false;
+                        large = true;
+                        break;
+                    }
+                }
+                if (foreign)
+                {
+                    stats.foreign++;
+                }
+            }
+            portEXIT_CRITICAL(&_mux);
+
+            if (large)
+            {
+                free(h);
+            }
+            else if (foreign)
+            {
+                // No es nuestro. Lo devolvemos tal cual.
+                free(p);
+            }
+        }
+
+        // Devuelve a la PSRAM los slabs que no tienen ningún buffer entregado
+        void trim()
+        {
+            tSlab* unused = nullptr;
+
+            portENTER_CRITICAL(&_mux);
+            for (tSlab** l = &_slabs; *l != nullptr; )
+            {
+                tSlab* s = *l;
+                if (s->used != 0)
+                {
+                    l = &s->next;
+                    continue;
+                }
+
+                // Sacamos sus buffers de la lista de libres
+                for (tHdr** f = &_free[s->cls]; *f != nullptr; )
+                {
+                    if ((uint8_t*)*f >= s->begin && (uint8_t*)*f < s->end)
+                    {
+                        *f = (*f)->next;
+                    }
+                    else
+                    {
+                        f = &(*f)->next;
+                    }
+                }
+                stats.cached -= POOL_SLAB_COUNT[s->cls] * POOL_CLASS_SIZE[s->cls];
+
+                *l = s->next;
+                s->next = unused;
+                unused = s;
+            }
+            portEXIT_CRITICAL(&_mux);
+
+            while (unused != nullptr)
+            {
+                tSlab* next = unused->next;
+                free(unused);
+                unused = next;
+            }
+        }
+};
+
+BlockPool blockPool;
+
+class FileArena
+{
+    private:
+
+        struct tChunk
+        {
+            tChunk* next;
+            uint32_t used;
+            uint32_t capacity;
+            uint32_t pad;
+        };
+
+        tChunk* _head = nullptr;
+
+    public:
+
+        // Memoria a cero que vive hasta releaseAll()
+        void* alloc(uint32_t size)
+        {
+            // Alineamos a 8
+            size = (size + 7) & ~7u;
+
+            if (_head == nullptr || (_head->capacity - _head->used) < size)
+            {
+                uint32_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+                tChunk* c = (tChunk*)ps_malloc(sizeof(tChunk) + capacity);
+                if (c == nullptr)
+                {
+                    return nullptr;
+                }
+                c->used = 0;
+                c->capacity = capacity;
+                c->next = _head;
+                _head = c;
+
+                blockPool.stats.arenaBytes += sizeof(tChunk) + capacity;
+                if (blockPool.stats.arenaBytes > blockPool.stats.arenaHighWater)
+                {
+                    blockPool.stats.arenaHighWater = blockPool.stats.arenaBytes;
+                }
+            }
+
+            uint8_t* p = ((uint8_t*)(_head + 1)) + _head->used;
+            _head->used += size;
+            memset(p, 0, size);
+            return p;
+        }
+
+        // Libera toda la arena de golpe (al expulsar la cinta)
+        void releaseAll()
+        {
+            while (_head != nullptr)
+            {
+                tChunk* next = _head->next;
+                free(_head);
+                _head = next;
+            }
+            blockPool.stats.arenaBytes = 0;
+        }
+};
+
+// Arena del fichero cargado
+FileArena tapeArena;
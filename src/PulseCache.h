@@ -0,0 +1,668 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: PulseCache.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Caché de la señal generada para una cinta. La primera vez que se reproduce una cinta entera
+    (desde el bloque 0 y sin STOP/PAUSE) se guardan los pulsos que salen del ZXProcessor en un
+    fichero <cinta>.pls junto a la cinta. Las siguientes veces se reproduce directamente desde ese
+    fichero, sin volver a leer los bloques ni generar los pulsos, y se puede empezar en cualquier
+    bloque gracias a las marcas de bloque.
+
+    Formato del fichero:
+      tPlsHeader                  - Clave de validez, número de bloques, posición del índice...
+      tPlsRec[]                   - Tramos de muestras {amplitud, nº muestras} y marcas de bloque
+      tPlsIndex[numBlocks]        - Posición y muestra inicial de cada bloque
+
+    La amplitud se guarda antes de aplicar el volumen, que se aplica al reproducir. La caché deja
+    de valer si cambia la cinta (tamaño o fecha), la frecuencia de muestreo, ZEROLEVEL, APPLY_END,
+    la polarización, los niveles de la señal (que es lo que cambian los .cfg de cada cinta) o los
+    tiempos de generación (reloj de la CPU, pilot, sync, bits y pausa entre bloques).
+
+    Al grabar, los registros se acumulan en dos buffers de 4 KB. Cuando uno se llena se pasa a
+    una tarea escritora y se sigue en el otro, de forma que la escritura en la SD nunca se hace
+    desde el camino del audio. Si al llenarse el segundo la tarea sigue escribiendo el primero
+    (SD lenta o bus ocupado), la grabación se abandona en vez de esperar.
+
+    Las cintas con bloques de control (stop the tape, saltos, loops, calls, select) no se guardan,
+    porque su reproducción depende de lo que haga el usuario.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#define PLS_MAGIC 0x31534C50    // "PLS1"
+#define PLS_VERSION 2
+#define PLS_EXT ".pls"
+#define PLS_TMP_EXT ".plt"
+
+// Registros de cada uno de los dos buffers de grabación (4 KB)
+#define PLS_BUFFER_RECORDS 512
+// Tamaño de cada lectura al reproducir desde la caché
+#define PLS_READ_CHUNK 4096
+
+#define PLS_TAG_RUN 0
+#define PLS_TAG_BLOCK 1
+
+#define PLS_NO_BLOCK 0xFFFFFFFF
+
+// Modos de la caché para la reproducción en curso
+enum tPlsMode
+{
+    PLS_OFF = 0,
+    PLS_RECORD = 1,
+    PLS_REPLAY = 2
+};
+
+// Lo que hace válida una caché
+struct tPlsKey
+{
+    uint32_t tapeSize = 0;
+    uint16_t tapeDate = 0;
+    uint16_t tapeTime = 0;
+    uint32_t samplingRate = 0;
+    int32_t levelUp = 0;
+    int32_t levelDown = 0;
+    // bit0 ZEROLEVEL, bit1 APPLY_END, bit2 POLARIZATION up
+    uint32_t flags = 0;
+    // Hash de los tiempos que se aplican al generar (reloj de la CPU, pilot, sync, bits, pausa)
+    uint32_t timing = 0;
+};
+
+struct tPlsHeader
+{
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    uint16_t recSize = 0;
+    tPlsKey key;
+    uint32_t numBlocks = 0;
+    uint32_t indexOffset = 0;
+    uint32_t totalSamples = 0;
+    // Estado de la señal al acabar, para dejar el ZXProcessor igual que tras generar la cinta
+    int32_t lastSilence = 0;
+    uint8_t endEar = 0;
+    uint8_t pad[3] = {};
+};
+
+// Tramo de muestras (tag 0) o marca de bloque (tag 1, count = nº de bloque)
+struct tPlsRec
+{
+    int16_t amp;
+    uint16_t tag;
+    uint32_t count;
+};
+
+struct tPlsIndex
+{
+    uint32_t offset;
+    uint32_t sampleStart;
+};
+
+class PulseCache
+{
+    private:
+
+        tPlsMode _mode = PLS_OFF;
+
+        File32 _f;
+        char _path[256] = {};
+        char _tmpPath[256] = {};
+
+        tPlsHeader _hdr;
+        tPlsIndex* _index = nullptr;
+        int _numBlocks = 0;
+
+        // Grabación. Los buffers salen del pool mientras se graba. _front es el que se
+        // llena; el otro puede estar en manos de la tarea escritora.
+        tPlsRec* _buf[2] = {nullptr, nullptr};
+        int _front = 0;
+        int _nBuf = 0;
+        tPlsRec _cur = {0, PLS_TAG_RUN, 0};
+        uint32_t _written = 0;
+        uint32_t _samples = 0;
+        bool _failed = false;
+
+        // Tarea escritora
+        TaskHandle_t _task = nullptr;
+        SemaphoreHandle_t _go = nullptr;
+        SemaphoreHandle_t _done = nullptr;
+        const tPlsRec* _wBuf = nullptr;
+        size_t _wLen = 0;
+        bool _pending = false;
+        volatile bool _writeFailed = false;
+        bool _tooSlow = false;
+
+        // Estadísticas
+        uint32_t _replays = 0;
+        uint32_t _records = 0;
+
+        static void writer(void* param)
+        {
+            PulseCache* self = (PulseCache*)param;
+
+            for (;;)
+            {
+                xSemaphoreTake(self->_go, portMAX_DELAY);
+
+                if (sdsched.write(self->_f, (const uint8_t*)self->_wBuf, self->_wLen, SDIO_RECORDING) != self->_wLen)
+                {
+                    // Sin espacio o error de escritura. Se descarta al final.
+                    self->_writeFailed = true;
+                }
+
+                xSemaphoreGive(self->_done);
+            }
+        }
+
+        // Espera a que la tarea escritora termine el buffer que tiene. No se llama desde
+        // el camino del audio.
+        void waitPending()
+        {
+            if (_pending)
+            {
+                xSemaphoreTake(_done, portMAX_DELAY);
+                _pending = false;
+            }
+        }
+
+        void freeBuffers()
+        {
+            for (int n = 0; n < 2; n++)
+            {
+                if (_buf[n] != nullptr)
+                {
+                    blockPool.release(_buf[n]);
+                    _buf[n] = nullptr;
+                }
+            }
+        }
+
+        bool makeKey(const char* tapePath, tPlsKey &key)
+        {
+            SDioLock lock(SDIO_PLAYBACK);
+
+            File32 tape;
+            if (!tape.open(tapePath, O_RDONLY))
+            {
+                return false;
+            }
+
+            key.tapeSize = tape.fileSize();
+            tape.getModifyDateTime(&key.tapeDate, &key.tapeTime);
+            tape.close();
+
+            key.samplingRate = SAMPLING_RATE;
+            key.levelUp = LEVELUP;
+            key.levelDown = maxLevelDown;
+            key.flags = (ZEROLEVEL ? 1 : 0) | (APPLY_END ? 2 : 0) | (POLARIZATION == up ? 4 : 0);
+            key.timing = timingHash();
+            return true;
+        }
+
+        // FNV-1a de los parámetros de tiempo efectivos. Si cambia alguno (FRQn desde el HMI,
+        // ajustes por cinta) la caché deja de valer.
+        static uint32_t timingHash()
+        {
+            const int32_t params[] = {
+                (int32_t)DfreqCPU, DPILOT_LEN, DSYNC1, DSYNC2, DBIT_0, DBIT_1,
+                DPULSES_HEADER, DPULSES_DATA, DSILENT
+            };
+
+            uint32_t h = 2166136261u;
+            const uint8_t* p = (const uint8_t*)params;
+            for (size_t i = 0; i < sizeof(params); i++)
+            {
+                h = (h ^ p[i]) * 16777619u;
+            }
+            return h;
+        }
+
+        static bool sameKey(const tPlsKey &a, const tPlsKey &b)
+        {
+            return memcmp(&a, &b, sizeof(tPlsKey)) == 0;
+        }
+
+        bool allocIndex(int numBlocks)
+        {
+            freeIndex();
+            _index = (tPlsIndex*)ps_malloc(numBlocks * sizeof(tPlsIndex));
+            if (_index == nullptr)
+            {
+                return false;
+            }
+            memset(_index, 0xFF, numBlocks * sizeof(tPlsIndex));
+            _numBlocks = numBlocks;
+            return true;
+        }
+
+        void freeIndex()
+        {
+            if (_index != nullptr)
+            {
+                free(_index);
+                _index = nullptr;
+            }
+            _numBlocks = 0;
+        }
+
+        // Pasa el buffer lleno a la tarea escritora y sigue en el otro. Si la anterior
+        // escritura no ha acabado no se espera: la grabación se abandona.
+        void flushBuffer()
+        {
+            if (_nBuf == 0 || _failed)
+            {
+                _nBuf = 0;
+                return;
+            }
+
+            if (_pending)
+            {
+                if (xSemaphoreTake(_done, 0) != pdTRUE)
+                {
+                    _failed = true;
+                    _tooSlow = true;
+                    _nBuf = 0;
+                    return;
+                }
+                _pending = false;
+            }
+
+            _wBuf = _buf[_front];
+            _wLen = _nBuf * sizeof(tPlsRec);
+            _pending = true;
+            xSemaphoreGive(_go);
+
+            _front = 1 - _front;
+            _nBuf = 0;
+        }
+
+        void push(const tPlsRec &r)
+        {
+            _buf[_front][_nBuf++] = r;
+            _written++;
+            if (_nBuf == PLS_BUFFER_RECORDS)
+            {
+                flushBuffer();
+            }
+        }
+
+        void pushCurrent()
+        {
+            if (_cur.count != 0)
+            {
+                push(_cur);
+                _cur.count = 0;
+            }
+        }
+
+        // Abre la caché existente y comprueba que corresponde a esta cinta y configuración
+        bool openReplay(const tPlsKey &key, int numBlocks)
+        {
+            SDioLock lock(SDIO_PLAYBACK);
+
+            if (!_f.open(_path, O_RDONLY))
+            {
+                return false;
+            }
+
+            tPlsHeader hdr;
+            if (_f.read(&hdr, sizeof(hdr)) != (int)sizeof(hdr)
+                || hdr.magic != PLS_MAGIC || hdr.version != PLS_VERSION
+                || hdr.recSize != sizeof(tPlsRec) || hdr.numBlocks != (uint32_t)numBlocks
+                || !sameKey(hdr.key, key) || !allocIndex(numBlocks))
+            {
+                _f.close();
+                return false;
+            }
+
+            size_t len = numBlocks * sizeof(tPlsIndex);
+            if (!_f.seekSet(hdr.indexOffset) || _f.read(_index, len) != (int)len)
+            {
+                freeIndex();
+                _f.close();
+                return false;
+            }
+
+            _hdr = hdr;
+            return true;
+        }
+
+        bool openRecord(const tPlsKey &key, int numBlocks)
+        {
+            if (!allocIndex(numBlocks))
+            {
+                return false;
+            }
+
+            if (_task == nullptr)
+            {
+                _go = xSemaphoreCreateBinary();
+                _done = xSemaphoreCreateBinary();
+                // Mismo núcleo que el HMI y la lectura anticipada (el reproductor va en el 0)
+                xTaskCreatePinnedToCore(writer, "plsWriter", 4096, this, 4, &_task, 1);
+            }
+
+            _buf[0] = (tPlsRec*)blockPool.alloc(PLS_BUFFER_RECORDS * sizeof(tPlsRec));
+            _buf[1] = (tPlsRec*)blockPool.alloc(PLS_BUFFER_RECORDS * sizeof(tPlsRec));
+            if (_task == nullptr || _buf[0] == nullptr || _buf[1] == nullptr)
+            {
+                freeBuffers();
+                freeIndex();
+                return false;
+            }
+
+            SDioLock lock(SDIO_RECORDING);
+
+            if (!_f.open(_tmpPath, O_RDWR | O_CREAT | O_TRUNC))
+            {
+                freeBuffers();
+                freeIndex();
+                return false;
+            }
+
+            // La cabecera se completa al terminar
+            _hdr = tPlsHeader();
+            _hdr.key = key;
+            _hdr.numBlocks = numBlocks;
+            _f.write(&_hdr, sizeof(_hdr));
+
+            _front = 0;
+            _nBuf = 0;
+            _cur = {0, PLS_TAG_RUN, 0};
+            _written = 0;
+            _samples = 0;
+            _failed = false;
+            _pending = false;
+            _writeFailed = false;
+            _tooSlow = false;
+            return true;
+        }
+
+        void commitRecord()
+        {
+            pushCurrent();
+            flushBuffer();
+            waitPending();
+
+            if (_writeFailed)
+            {
+                _failed = true;
+            }
+
+            SDioLock lock(SDIO_RECORDING);
+
+            _hdr.magic = PLS_MAGIC;
+            _hdr.version = PLS_VERSION;
+            _hdr.recSize = sizeof(tPlsRec);
+            _hdr.indexOffset = sizeof(tPlsHeader) + _written * sizeof(tPlsRec);
+            _hdr.totalSamples = _samples;
+            _hdr.lastSilence = LAST_SILENCE_DURATION;
+            _hdr.endEar = (LAST_EAR_IS == up) ? 1 : 0;
+
+            size_t len = _numBlocks * sizeof(tPlsIndex);
+            if (_failed || _f.write(_index, len) != len
+                || !_f.seekSet(0) || _f.write(&_hdr, sizeof(_hdr)) != sizeof(_hdr) || !_f.sync())
+            {
+                _f.remove();
+                logln(_tooSlow ? "Pulse cache not saved - SD too slow" : "Pulse cache not saved");
+                return;
+            }
+
+            // Sustituimos la anterior, si la había
+            File32 old;
+            if (old.open(_path, O_WRITE))
+            {
+                old.remove();
+            }
+
+            if (_f.rename(_path))
+            {
+                _records++;
+                logln("Pulse cache saved - " + String(_hdr.indexOffset + len) + " bytes");
+            }
+            _f.close();
+        }
+
+        void abortRecord()
+        {
+            waitPending();
+            SDioLock lock(SDIO_RECORDING);
+            _f.remove();
+        }
+
+    public:
+
+        // Al empezar play(). Decide si se reproduce de la caché, si se graba o si no se usa.
+        // "linear" indica que la cinta no tiene bloques de control.
+        tPlsMode begin(const String &tapePath, int firstBlock, int numBlocks, bool linear)
+        {
+            end(false);
+
+            if (!PULSE_CACHE_ENABLE || !linear || numBlocks <= 0 || tapePath.length() + 5 > sizeof(_path))
+            {
+                return PLS_OFF;
+            }
+
+            tPlsKey key;
+            if (!makeKey(tapePath.c_str(), key))
+            {
+                return PLS_OFF;
+            }
+
+            snprintf(_path, sizeof(_path), "%s%s", tapePath.c_str(), PLS_EXT);
+            snprintf(_tmpPath, sizeof(_tmpPath), "%s%s", tapePath.c_str(), PLS_TMP_EXT);
+
+            if (openReplay(key, numBlocks))
+            {
+                if (firstBlock < numBlocks && _index[firstBlock].offset != PLS_NO_BLOCK)
+                {
+                    _mode = PLS_REPLAY;
+                    return _mode;
+                }
+
+                // Bloque sin marca (no genera señal). Se reproduce como siempre.
+                end(false);
+                return PLS_OFF;
+            }
+
+            // Solo se graba una reproducción completa desde el principio
+            if (firstBlock == 0 && openRecord(key, numBlocks))
+            {
+                _mode = PLS_RECORD;
+            }
+
+            return _mode;
+        }
+
+        // Al acabar play(). "completed" = se ha llegado al final sin STOP/PAUSE.
+        void end(bool completed)
+        {
+            if (_mode == PLS_RECORD)
+            {
+                if (completed)
+                {
+                    commitRecord();
+                }
+                else
+                {
+                    abortRecord();
+                }
+            }
+            else if (_mode == PLS_REPLAY)
+            {
+                prefetcher.cancel(_f);
+                SDioLock lock(SDIO_PLAYBACK);
+                _f.close();
+            }
+
+            freeBuffers();
+
+            _mode = PLS_OFF;
+            freeIndex();
+        }
+
+        // ¿Se puede empezar a reproducir desde este bloque?
+        bool hasBlock(int block)
+        {
+            return _mode == PLS_REPLAY && block >= 0 && block < _numBlocks && _index[block].offset != PLS_NO_BLOCK;
+        }
+
+        bool recording()
+        {
+            return _mode == PLS_RECORD;
+        }
+
+        // Ganchos del ZXProcessor. "amp" es la amplitud antes del volumen.
+        void run(int amp, uint32_t samples)
+        {
+            if (samples == 0)
+            {
+                return;
+            }
+
+            if (_cur.count != 0 && _cur.amp != amp)
+            {
+                pushCurrent();
+            }
+
+            _cur.amp = amp;
+            _cur.tag = PLS_TAG_RUN;
+            _cur.count += samples;
+            _samples += samples;
+        }
+
+        // Empieza el bloque "block" de la cinta
+        void mark(int block)
+        {
+            if (_mode != PLS_RECORD || block < 0 || block >= _numBlocks)
+            {
+                return;
+            }
+
+            pushCurrent();
+
+            if (_index[block].offset == PLS_NO_BLOCK)
+            {
+                _index[block].offset = sizeof(tPlsHeader) + _written * sizeof(tPlsRec);
+                _index[block].sampleStart = _samples;
+            }
+
+            tPlsRec r = {(int16_t)(LAST_EAR_IS == up ? 1 : 0), PLS_TAG_BLOCK, (uint32_t)block};
+            push(r);
+        }
+
+        // Reproduce desde la caché empezando en firstBlock.
+        //   emit(amp, samples)  - genera el tramo. Devuelve false si hay STOP/PAUSE.
+        //   onBlock(block)      - actualiza el HMI al empezar cada bloque.
+        // Devuelve true si se ha llegado al final.
+        template <class Emit, class OnBlock>
+        bool replay(int firstBlock, Emit emit, OnBlock onBlock)
+        {
+            if (_mode != PLS_REPLAY)
+            {
+                return false;
+            }
+
+            _replays++;
+
+            uint32_t offset = _index[firstBlock].offset;
+            uint32_t endOffset = _hdr.indexOffset;
+            uint32_t played = _index[firstBlock].sampleStart;
+            uint32_t blockStart = played;
+            uint32_t blockEnd = _hdr.totalSamples;
+            uint32_t total = _hdr.totalSamples > 0 ? _hdr.totalSamples : 1;
+
+            while (offset < endOffset)
+            {
+                int size = (endOffset - offset) < PLS_READ_CHUNK ? (endOffset - offset) : PLS_READ_CHUNK;
+                tPlsRec* recs = (tPlsRec*)prefetcher.get(_f, offset, size);
+                if (recs == nullptr)
+                {
+                    return false;
+                }
+
+                offset += size;
+                if (offset < endOffset)
+                {
+                    int next = (endOffset - offset) < PLS_READ_CHUNK ? (endOffset - offset) : PLS_READ_CHUNK;
+                    prefetcher.prefetch(_f, offset, next);
+                }
+
+                int n = size / sizeof(tPlsRec);
+                for (int r = 0; r < n; r++)
+                {
+                    if (recs[r].tag == PLS_TAG_BLOCK)
+                    {
+                        int block = recs[r].count;
+                        LAST_EAR_IS = recs[r].amp ? up : down;
+
+                        // Límites del bloque para la barra de progreso
+                        blockStart = played;
+                        blockEnd = _hdr.totalSamples;
+                        for (int b = block + 1; b < _numBlocks; b++)
+                        {
+                            if (_index[b].offset != PLS_NO_BLOCK)
+                            {
+                                blockEnd = _index[b].sampleStart;
+                                break;
+                            }
+                        }
+
+                        onBlock(block);
+                        continue;
+                    }
+
+                    if (!emit(recs[r].amp, recs[r].count))
+                    {
+                        return false;
+                    }
+
+                    played += recs[r].count;
+                    PROGRESS_BAR_TOTAL_VALUE = ((uint64_t)played * 100) / total;
+                    PROGRESS_BAR_BLOCK_VALUE = (blockEnd > blockStart) ? (((uint64_t)(played - blockStart) * 100) / (blockEnd - blockStart)) : 100;
+                }
+            }
+
+            LAST_EAR_IS = _hdr.endEar ? up : down;
+            LAST_SILENCE_DURATION = _hdr.lastSilence;
+            return true;
+        }
+
+        uint32_t getReplays()
+        {
+            return _replays;
+        }
+
+        uint32_t getRecords()
+        {
+            return _records;
+        }
+};
+
+// Instancia única. Solo hay un reproductor activo (TAP o TZX) a la vez.
+PulseCache pulseCache;
@@ -0,0 +1,186 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: RemoteStatus.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Estado de la cinta por WebSocket (/ws) como deltas.
+
+    Cada vuelta se rellena el mismo esquema de campos (clave y valor ya en JSON) en el mismo
+    orden. delta() devuelve solo los que han cambiado desde el último envío, así que con la
+    cinta parada no sale nada y reproduciendo salen dos o tres campos (bloque, progreso).
+    full() da el estado completo para un cliente que se acaba de conectar.
+
+    No depende del framework de Arduino (std::string) para poder probarse en el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Envíos por segundo como mucho
+#ifndef REMOTE_STATUS_HZ
+  #define REMOTE_STATUS_HZ 5
+#endif
+
+class StatusDelta
+{
+    private:
+
+        struct tField
+        {
+            const char* key;
+            std::string value;
+            std::string sent;
+            bool everSent;
+        };
+
+        std::vector<tField> _f;
+        size_t _n = 0;
+        uint32_t _seq = 0;
+
+        void open(std::string& out, uint32_t seq)
+        {
+            out = "{\"seq\":";
+            out += std::to_string(seq);
+        }
+
+        void append(std::string& out, const tField& f)
+        {
+            out += ",\"";
+            out += f.key;
+            out += "\":";
+            out += f.value;
+        }
+
+    public:
+
+        // Empieza una vuelta
+        void begin()
+        {
+            _n = 0;
+        }
+
+        // "value" ya en JSON (número, true/false o cadena entre comillas)
+        void add(const char* key, const std::string& value)
+        {
+            if (_n == _f.size())
+            {
+                _f.push_back({key, value, std::string(), false});
+            }
+            else
+            {
+                _f[_n].key = key;
+                _f[_n].value = value;
+            }
+            _n++;
+        }
+
+        void addInt(const char* key, int64_t v)
+        {
+            add(key, std::to_string(v));
+        }
+
+        void addBool(const char* key, bool v)
+        {
+            add(key, v ? "true" : "false");
+        }
+
+        void addString(const char* key, const char* text)
+        {
+            std::string q = "\"";
+            for (const char* p = text; *p; p++)
+            {
+                unsigned char c = (unsigned char)*p;
+                if (c == '"' || c == '\\')
+                {
+                    q += '\\';
+                    q += (char)c;
+                }
+                else if (c < 0x20)
+                {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    q += esc;
+                }
+                else
+                {
+                    q += (char)c;
+                }
+            }
+            q += '"';
+            add(key, q);
+        }
+
+        // Campos cambiados desde el último delta. false si no hay ninguno
+        bool delta(std::string& out)
+        {
+            bool any = false;
+            for (size_t i = 0; i < _n; i++)
+            {
+                tField& f = _f[i];
+                if (f.everSent && f.value == f.sent)
+                {
+                    continue;
+                }
+                if (!any)
+                {
+                    open(out, ++_seq);
+                    any = true;
+                }
+                append(out, f);
+                f.sent = f.value;
+                f.everSent = true;
+            }
+            if (any)
+            {
+                out += '}';
+            }
+            return any;
+        }
+
+        // Todos los campos de la última vuelta (no cambia lo enviado)
+        void full(std::string& out)
+        {
+            open(out, _seq);
+            out += ",\"full\":true";
+            for (size_t i = 0; i < _n; i++)
+            {
+                append(out, _f[i]);
+            }
+            out += '}';
+        }
+
+        uint32_t seq() const
+        {
+            return _seq;
+        }
+};
@@ -0,0 +1,519 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: SDbenchmark.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Benchmark del bus de la SD. Para cada reloj SPI candidato se mide lectura y escritura,
+    secuencial y aleatoria, con tamaños de 512 B, 4 KB y 32 KB. De cada prueba se obtiene el
+    throughput y los percentiles de latencia p50/p95/p99. Todo lo que se lee se verifica con
+    CRC32 contra el patrón escrito.
+
+    El núcleo de medida (SDbenchCore) solo depende de la interfaz SDbenchIO, de forma que puede
+    ejecutarse en el host contra un fichero imagen. La parte del ESP32 (fichero sobre SdFat,
+    CID de la tarjeta y persistencia del reloj elegido) va al final, bajo ARDUINO.
+
+    El reloj elegido se guarda en /_sdclock.cfg, una línea por tarjeta:
+      <CID en hexadecimal>MHz</CID en hexadecimal>
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// Tamaño del fichero de prueba y número de operaciones aleatorias por test
+#ifndef SDBENCH_FILE_SIZE
+  #define SDBENCH_FILE_SIZE (256 * 1024)
+#endif
+#ifndef SDBENCH_RANDOM_OPS
+  #define SDBENCH_RANDOM_OPS 32
+#endif
+
+#define SDBENCH_MAX_CHUNK 32768
+#define SDBENCH_MAX_SAMPLES 512
+
+// Tests y tamaños
+enum { SDB_SEQ_READ = 0, SDB_SEQ_WRITE, SDB_RND_READ, SDB_RND_WRITE, SDB_TESTS };
+#define SDB_SIZES 3
+static const int SDB_SIZE_LIST[SDB_SIZES] = {512, 4096, 32768};
+
+struct tSDbenchResult
+{
+    uint32_t kbps = 0;
+    uint32_t p50 = 0;
+    uint32_t p95 = 0;
+    uint32_t p99 = 0;
+};
+
+struct tSDbenchReport
+{
+    int mhz = 0;
+    // La tarjeta aceptó el reloj (begin correcto)
+    bool mounted = false;
+    // Sin errores de E/S ni de CRC en toda la prueba
+    bool stable = false;
+    uint32_t crcErrors = 0;
+    uint32_t ioErrors = 0;
+    tSDbenchResult r[SDB_TESTS][SDB_SIZES];
+};
+
+// Acceso al dispositivo bajo prueba
+class SDbenchIO
+{
+    public:
+        virtual bool open() = 0;
+        virtual bool seek(uint32_t offset) = 0;
+        virtual int read(uint8_t* buffer, int len) = 0;
+        virtual int write(const uint8_t* buffer, int len) = 0;
+        virtual bool sync() = 0;
+        virtual void close() = 0;
+        virtual uint32_t nowUs() = 0;
+        virtual ~SDbenchIO() {}
+};
+
+class SDbenchCore
+{
+    private:
+
+        uint8_t* _buf = nullptr;
+        uint8_t* _ref = nullptr;
+        uint32_t _samples[SDBENCH_MAX_SAMPLES];
+        int _nSamples = 0;
+        uint32_t _rnd = 0x1234567;
+        uint32_t _crcTable[256];
+
+        void initCRC()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+                }
+                _crcTable[i] = c;
+            }
+        }
+
+        uint32_t crc32(const uint8_t* data, int len)
+        {
+            uint32_t c = 0xFFFFFFFF;
+            for (int i = 0; i < len; i++)
+            {
+                c = _crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+            }
+            return c ^ 0xFFFFFFFF;
+        }
+
+        // Patrón determinista que depende solo del offset absoluto
+        static void fillPattern(uint8_t* buffer, uint32_t offset, int len)
+        {
+            for (int i = 0; i < len; i += 4)
+            {
+                uint32_t x = (offset + i) * 2654435761u ^ 0xA5A5A5A5;
+                x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                int n = (len - i) < 4 ? (len - i) : 4;
+                memcpy(buffer + i, &x, n);
+            }
+        }
+
+        uint32_t nextRandom()
+        {
+            _rnd ^= _rnd << 13;
+            _rnd ^= _rnd >> 17;
+            _rnd ^= _rnd << 5;
+            return _rnd;
+        }
+
+        void addSample(uint32_t us)
+        {
+            if (_nSamples < SDBENCH_MAX_SAMPLES)
+            {
+                _samples[_nSamples++] = us;
+            }
+        }
+
+        uint32_t percentile(int p)
+        {
+            if (_nSamples == 0)
+            {
+                return 0;
+            }
+            int idx = ((_nSamples - 1) * p) / 100;
+            return _samples[idx];
+        }
+
+        void closeResult(tSDbenchResult &res, uint64_t bytes, uint32_t totalUs)
+        {
+            std::sort(_samples, _samples + _nSamples);
+            res.kbps = totalUs ? (uint32_t)((bytes * 1000000ULL) / (1024ULL * totalUs)) : 0;
+            res.p50 = percentile(50);
+            res.p95 = percentile(95);
+            res.p99 = percentile(99);
+            _nSamples = 0;
+        }
+
+        bool verify(const uint8_t* data, uint32_t offset, int len)
+        {
+            fillPattern(_ref, offset, len);
+            return crc32(data, len) == crc32(_ref, len);
+        }
+
+        void writeAt(SDbenchIO &io, tSDbenchReport &rep, uint32_t offset, int len)
+        {
+            fillPattern(_buf, offset, len);
+            uint32_t t0 = io.nowUs();
+            if (!io.seek(offset) || io.write(_buf, len) != len)
+            {
+                rep.ioErrors++;
+            }
+            addSample(io.nowUs() - t0);
+        }
+
+        void readAt(SDbenchIO &io, tSDbenchReport &rep, uint32_t offset, int len)
+        {
+            uint32_t t0 = io.nowUs();
+            if (!io.seek(offset) || io.read(_buf, len) != len)
+            {
+                rep.ioErrors++;
+                addSample(io.nowUs() - t0);
+                return;
+            }
+            addSample(io.nowUs() - t0);
+
+            if (!verify(_buf, offset, len))
+            {
+                rep.crcErrors++;
+            }
+        }
+
+    public:
+
+        SDbenchCore()
+        {
+            initCRC();
+        }
+
+        // Ejecuta la batería completa sobre io. Devuelve false si no se pudo empezar.
+        bool run(SDbenchIO &io, tSDbenchReport &rep)
+        {
+            rep.crcErrors = 0;
+            rep.ioErrors = 0;
+            rep.stable = false;
+
+            _buf = (uint8_t*)malloc(SDBENCH_MAX_CHUNK);
+            _ref = (uint8_t*)malloc(SDBENCH_MAX_CHUNK);
+
+            if (_buf == nullptr || _ref == nullptr || !io.open())
+            {
+                free(_buf);
+                free(_ref);
+                _buf = _ref = nullptr;
+                return false;
+            }
+
+            for (int s = 0; s < SDB_SIZES; s++)
+            {
+                int len = SDB_SIZE_LIST[s];
+                int chunks = SDBENCH_FILE_SIZE / len;
+                uint32_t t0;
+
+                // Escritura secuencial (deja el fichero con el patrón)
+                t0 = io.nowUs();
+                for (int c = 0; c < chunks; c++)
+                {
+                    writeAt(io, rep, (uint32_t)c * len, len);
+                }
+                if (!io.sync()) rep.ioErrors++;
+                closeResult(rep.r[SDB_SEQ_WRITE][s], SDBENCH_FILE_SIZE, io.nowUs() - t0);
+
+                // Lectura secuencial verificada
+                t0 = io.nowUs();
+                for (int c = 0; c < chunks; c++)
+                {
+                    readAt(io, rep, (uint32_t)c * len, len);
+                }
+                closeResult(rep.r[SDB_SEQ_READ][s], SDBENCH_FILE_SIZE, io.nowUs() - t0);
+
+                // Lectura aleatoria verificada
+                t0 = io.nowUs();
+                for (int n = 0; n < SDBENCH_RANDOM_OPS; n++)
+                {
+                    readAt(io, rep, (nextRandom() % chunks) * len, len);
+                }
+                closeResult(rep.r[SDB_RND_READ][s], (uint64_t)SDBENCH_RANDOM_OPS * len, io.nowUs() - t0);
+
+                // Escritura aleatoria (mismo patrón, el fichero sigue siendo coherente)
+                uint32_t seed = _rnd;
+                t0 = io.nowUs();
+                for (int n = 0; n < SDBENCH_RANDOM_OPS; n++)
+                {
+                    writeAt(io, rep, (nextRandom() % chunks) * len, len);
+                }
+                if (!io.sync()) rep.ioErrors++;
+                closeResult(rep.r[SDB_RND_WRITE][s], (uint64_t)SDBENCH_RANDOM_OPS * len, io.nowUs() - t0);
+
+                // Y verificamos lo escrito (sin medir)
+                _rnd = seed;
+                for (int n = 0; n < SDBENCH_RANDOM_OPS; n++)
+                {
+                    readAt(io, rep, (nextRandom() % chunks) * len, len);
+                }
+                _nSamples = 0;
+            }
+
+            io.close();
+
+            free(_buf);
+            free(_ref);
+            _buf = _ref = nullptr;
+
+            rep.stable = (rep.crcErrors == 0 && rep.ioErrors == 0);
+            return true;
+        }
+
+        // Índice del informe con el mejor reloj estable (lectura secuencial de 32 KB).
+        // -1 si ninguno es estable.
+        static int pickBest(const tSDbenchReport* reports, int n)
+        {
+            int best = -1;
+            for (int i = 0; i < n; i++)
+            {
+                if (!reports[i].mounted || !reports[i].stable)
+                {
+                    continue;
+                }
+                if (best == -1 || reports[i].r[SDB_SEQ_READ][SDB_SIZES - 1].kbps > reports[best].r[SDB_SEQ_READ][SDB_SIZES - 1].kbps)
+                {
+                    best = i;
+                }
+            }
+            return best;
+        }
+
+        static const char* testName(int t)
+        {
+            switch (t)
+            {
+                case SDB_SEQ_READ:  return "seqRead";
+                case SDB_SEQ_WRITE: return "seqWrite";
+                case SDB_RND_READ:  return "rndRead";
+                default:            return "rndWrite";
+            }
+        }
+};
+
+#ifdef ARDUINO
+
+// Relojes candidatos (MHz), de mayor a menor. Divisores de 80 MHz del SPI del ESP32.
+static const int SDBENCH_CLOCKS[] = {40, 26, 20, 16, 13, 10, 8, 4};
+#define SDBENCH_NUM_CLOCKS (sizeof(SDBENCH_CLOCKS) / sizeof(SDBENCH_CLOCKS[0]))
+
+#define SDBENCH_TEST_FILE "/_sdbench.tmp"
+#define SDBENCH_CLOCK_FILE "/_sdclock.cfg"
+
+// Resultados del último benchmark (para el HMI y la web)
+tSDbenchReport sdBenchReports[SDBENCH_NUM_CLOCKS];
+int sdBenchBest = -1;
+bool sdBenchDone = false;
+// Por qué no se lanzó el último benchmark pedido ("" si se lanzó). Siempre un literal,
+// así que la web lo puede leer mientras la tarea de la cinta lo cambia
+const char* volatile sdBenchRefused = "";
+
+// Fichero de prueba sobre SdFat
+class SDbenchFile32IO : public SDbenchIO
+{
+    private:
+        SdFat32 &_sd;
+        File32 _f;
+
+    public:
+        SDbenchFile32IO(SdFat32 &sd) : _sd(sd) {}
+
+        bool open() override
+        {
+            if (!_f.open(SDBENCH_TEST_FILE, O_RDWR | O_CREAT | O_TRUNC))
+            {
+                return false;
+            }
+            // Reservamos el espacio contiguo para no medir la asignación de clusters
+            _f.preAllocate(SDBENCH_FILE_SIZE);
+            return true;
+        }
+        bool seek(uint32_t offset) override { return _f.seekSet(offset); }
+        int read(uint8_t* buffer, int len) override { return _f.read(buffer, len); }
+        int write(const uint8_t* buffer, int len) override { return _f.write(buffer, len); }
+        bool sync() override { return _f.sync(); }
+        void close() override
+        {
+            _f.close();
+            _sd.remove(SDBENCH_TEST_FILE);
+        }
+        uint32_t nowUs() override { return micros(); }
+};
+
+// CID de la tarjeta en hexadecimal
+String getSDCardCID(SdFat32 &sd)
+{
+    cid_t cid;
+    String res = "";
+
+    if (!sd.card()->readCID(&cid))
+    {
+        return res;
+    }
+
+    const uint8_t* raw = (const uint8_t*)&cid;
+    for (int i = 0; i < (int)sizeof(cid_t); i++)
+    {
+        if (raw[i] < 16) res += "0";
+        res += String(raw[i], HEX);
+    }
+    res.toUpperCase();
+    return res;
+}
+
+// Reloj guardado para esta tarjeta. -1 si no hay.
+int getStoredSDClock(SdFat32 &sd)
+{
+    String cid = getSDCardCID(sd);
+    if (cid == "")
+    {
+        return -1;
+    }
+
+    File32 f;
+    if (!f.open(SDBENCH_CLOCK_FILE, O_RDONLY))
+    {
+        return -1;
+    }
+
+    int mhz = -1;
+    char line[96];
+    int n;
+    String tag = "<" + cid + ">";
+
+    while ((n = f.fgets(line, sizeof(line))) > 0)
+    {
+        String strLine = line;
+        if (strLine.startsWith(tag))
+        {
+            String value = sdm.getValueOfParam(strLine, cid);
+            if (value != "null")
+            {
+                mhz = value.toInt();
+            }
+            break;
+        }
+    }
+
+    f.close();
+    return mhz > 0 ? mhz : -1;
+}
+
+// Guarda (o sustituye) el reloj de esta tarjeta
+void storeSDClock(SdFat32 &sd, int mhz)
+{
+    String cid = getSDCardCID(sd);
+    if (cid == "")
+    {
+        return;
+    }
+
+    String tag = "<" + cid + ">";
+    String content = "";
+
+    File32 f;
+    if (f.open(SDBENCH_CLOCK_FILE, O_RDONLY))
+    {
+        char line[96];
+        int n;
+        while ((n = f.fgets(line, sizeof(line))) > 0)
+        {
+            String strLine = line;
+            strLine.trim();
+            if (strLine.length() != 0 && !strLine.startsWith(tag))
+            {
+                content += strLine + "\n";
+            }
+        }
+        f.close();
+    }
+
+    content += tag + String(mhz) + "</" + cid + ">\n";
+
+    if (f.open(SDBENCH_CLOCK_FILE, O_WRONLY | O_CREAT | O_TRUNC))
+    {
+        f.print(content);
+        f.close();
+    }
+}
+
+// Resultados en JSON para la web
+String sdBenchJSON()
+{
+    String json = "{\"done\":" + String(sdBenchDone ? "true" : "false");
+    json += ",\"running\":" + String(SD_BENCHMARK_RUNNING ? "true" : "false");
+    json += ",\"refused\":\"" + String(sdBenchRefused) + "\"";
+    json += ",\"currentMHz\":" + String(SD_SPEED_MHZ);
+    json += ",\"bestMHz\":" + String(sdBenchBest >= 0 ? sdBenchReports[sdBenchBest].mhz : -1);
+    json += ",\"clocks\":[";
+
+    for (int i = 0; i < (int)SDBENCH_NUM_CLOCKS; i++)
+    {
+        tSDbenchReport &rep = sdBenchReports[i];
+        if (i) json += ",";
+        json += "{\"mhz\":" + String(rep.mhz);
+        json += ",\"mounted\":" + String(rep.mounted ? "true" : "false");
+        json += ",\"stable\":" + String(rep.stable ? "true" : "false");
+        json += ",\"crcErrors\":" + String(rep.crcErrors);
+        json += ",\"ioErrors\":" + String(rep.ioErrors);
+
+        for (int t = 0; t < SDB_TESTS; t++)
+        {
+            json += ",\"" + String(SDbenchCore::testName(t)) + "\":[";
+            for (int s = 0; s < SDB_SIZES; s++)
+            {
+                tSDbenchResult &r = rep.r[t][s];
+                if (s) json += ",";
+                json += "{\"size\":" + String(SDB_SIZE_LIST[s]) + ",\"kbps\":" + String(r.kbps);
+                json += ",\"p50\":" + String(r.p50) + ",\"p95\":" + String(r.p95) + ",\"p99\":" + String(r.p99) + "}";
+            }
+            json += "]";
+        }
+        json += "}";
+    }
+
+    json += "]}";
+    return json;
+}
+
+#endif
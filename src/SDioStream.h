@@ -0,0 +1,183 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: SDioStream.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Adaptadores de audio-tools que pasan por el planificador de la SD (SDscheduler.h) solo en
+    el acceso al fichero.
+
+    AudioPlayer::copy() y StreamCopy::copy() leen o escriben la SD y, en la misma llamada,
+    esperan a que el I2S acepte o entregue el audio. Con un SDioLock alrededor de copy() el
+    bus queda ocupado durante toda la espera del codec. Con estos adaptadores se coge solo
+    mientras dura la lectura o la escritura del fichero:
+
+      - SdLockedSource: envuelve un AudioSource (AudioSourceSDFAT). Monta la SD como un
+        remontaje (SDremount), recorre el directorio con el bus cogido y entrega al
+        AudioPlayer un SdLockedStream en lugar del fichero.
+      - SdLockedStream: lecturas del fichero con SDioLock.
+      - SdLockedPrint: escrituras troceadas con sdsched.write (grabación a WAV).
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+class SdLockedStream : public Stream
+{
+    private:
+
+        Stream* _s = nullptr;
+        tSDioClass _io;
+
+    public:
+
+        using Stream::readBytes;
+
+        SdLockedStream(tSDioClass io) : _io(io)
+        {
+        }
+
+        void attach(Stream* s)
+        {
+            _s = s;
+        }
+
+        // Solo mira la posición y el tamaño del fichero, no el bus
+        int available() override
+        {
+            return _s != nullptr ? _s->available() : 0;
+        }
+
+        int read() override
+        {
+            if (_s == nullptr)
+            {
+                return -1;
+            }
+            SDioLock lock(_io);
+            return _s->read();
+        }
+
+        int peek() override
+        {
+            if (_s == nullptr)
+            {
+                return -1;
+            }
+            SDioLock lock(_io);
+            return _s->peek();
+        }
+
+        size_t readBytes(char* buffer, size_t length) override
+        {
+            if (_s == nullptr)
+            {
+                return 0;
+            }
+            SDioLock lock(_io);
+            return _s->readBytes(buffer, length);
+        }
+
+        size_t write(uint8_t) override
+        {
+            return 0;
+        }
+};
+
+class SdLockedPrint : public Print
+{
+    private:
+
+        File32& _f;
+        tSDioClass _io;
+
+    public:
+
+        SdLockedPrint(File32& f, tSDioClass io) : _f(f), _io(io)
+        {
+        }
+
+        size_t write(uint8_t value) override
+        {
+            return write(&value, 1);
+        }
+
+        size_t write(const uint8_t* buffer, size_t size) override
+        {
+            return sdsched.write(_f, buffer, size, _io);
+        }
+};
+
+class SdLockedSource : public AudioSource
+{
+    private:
+
+        AudioSource& _src;
+        tSDioClass _io;
+        SdLockedStream _stream;
+
+        Stream* wrap(Stream* s)
+        {
+            if (s == nullptr)
+            {
+                return nullptr;
+            }
+            _stream.attach(s);
+            return &_stream;
+        }
+
+    public:
+
+        SdLockedSource(AudioSource& src, tSDioClass io) : _src(src), _io(io), _stream(io)
+        {
+        }
+
+        // AudioSourceSDFAT monta la SD con su propio SdFat: es un remontaje más
+        void begin() override
+        {
+            SDremount remount(_io);
+            _src.begin();
+        }
+
+        Stream* nextStream(int offset) override
+        {
+            SDioLock lock(_io);
+            return wrap(_src.nextStream(offset));
+        }
+
+        Stream* selectStream(int index) override
+        {
+            SDioLock lock(_io);
+            return wrap(_src.selectStream(index));
+        }
+
+        Stream* selectStream(const char* path) override
+        {
+            SDioLock lock(_io);
+            return wrap(_src.selectStream(path));
+        }
+};
@@ -47,6 +47,7 @@ class SDmanager
     bool createEmptyFile32(char* path)
     {
         File32 fFile;
+        SDioLock lock(SDIO_INTERACTIVE);
         
         if (fFile.open(path, O_CREAT|O_WRONLY|O_TRUNC))
         {
@@ -62,6 +63,7 @@ class SDmanager
     bool createFile32(char* path)
     {
         File32 fFile;
+        SDioLock lock(SDIO_INTERACTIVE);
         
         if (!fFile.exists(path))
         {
@@ -84,6 +86,7 @@ class SDmanager
     void deleteFile32(char* path)
     {
         File32 fFile;
+        SDioLock lock(SDIO_INTERACTIVE);
         
         if (!fFile.exists(path))
         {
@@ -94,6 +97,7 @@ class SDmanager
     File32 openDir(char* path)
     {
         File32 dfFile;
+        SDioLock lock(SDIO_INTERACTIVE);
         
         if (!dfFile.open(path, O_RDWR)) 
         {
@@ -114,6 +118,7 @@ class SDmanager
     File32 openFile32(char* path)
     {
         File32 fFile;
+        SDioLock lock(SDIO_INTERACTIVE);
         
         if (!fFile.open(path, O_RDWR)) 
         {
@@ -136,6 +141,7 @@ class SDmanager
         //SerialHW.println();
         //SerialHW.println("Open file:");
         //SerialHW.println(path);
+        SDioLock lock(SDIO_INTERACTIVE);
     
         if (fFile != 0)
         {
@@ -164,6 +170,7 @@ class SDmanager
     {
         if (fFile != 0)
         {
+            SDioLock lock(SDIO_INTERACTIVE);
             fFile.close();
             #ifdef DEBUGMODE
                 log("closing file");
@@ -171,9 +178,10 @@ class SDmanager
         } 
     }
     
-    uint8_t* readFile32(File32 mFile)
+    uint8_t* readFile32(File32 mFile, tSDioClass ioClass=SDIO_INTERACTIVE)
     {
         uint8_t* bufferFile = NULL;
+        SDioLock lock(ioClass);
     
         mFile.rewind();
     
@@ -190,10 +198,13 @@ class SDmanager
         return bufferFile;
     }
     
-    void readFileRange32(File32 mFile, uint8_t* &bufferFile, uint32_t offset, int size, bool logOn=false)
+    void readFileRange32(File32 mFile, uint8_t* &bufferFile, uint32_t offset, int size, bool logOn=false, tSDioClass ioClass=SDIO_PLAYBACK)
     {         
         if (mFile) 
         {
+            // Cogemos el bus de la SD con la prioridad indicada (por defecto, reproducción)
+            SDioLock lock(ioClass);
+
             // Ponemos a cero el puntero de lectura del fichero
             mFile.rewind();          
 
@@ -224,6 +235,7 @@ class SDmanager
         // Escribimos el parámetro en el fichero de configuración
         if (mFile)
         {
+            SDioLock lock(SDIO_INTERACTIVE);
             mFile.println("<" + param + ">");
             mFile.print(value);
             mFile.print("</" + param + ">");
@@ -275,6 +287,7 @@ class SDmanager
         int i=0;
 
         // Vemos si el fichero ya está abierto
+        SDioLock lock(SDIO_INTERACTIVE);
         if (mFile.isOpen())
         {
             // read lines from the file
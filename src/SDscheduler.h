@@ -0,0 +1,459 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: SDscheduler.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Planificador de accesos a la SD. La tarjeta comparte bus SPI entre el reproductor,
+    el grabador, el HMI (file browser) y el servidor web. Todos los accesos pasan por aquí
+    y se conceden por clase de prioridad:
+
+      SDIO_PLAYBACK    - Lecturas del reproductor (tiempo real)
+      SDIO_RECORDING   - Escrituras del grabador
+      SDIO_INTERACTIVE - File browser del HMI y peticiones web
+      SDIO_BACKGROUND  - Indexado, escaneos, etc.
+
+    Las clases que no son de tiempo real trocean sus transferencias en porciones de
+    SDIO_SLICE_BYTES y ceden el bus entre porciones si hay alguien más prioritario esperando,
+    de forma que la latencia de una lectura de reproducción queda acotada a una porción.
+
+    Las tareas de fondo que dejan ficheros abiertos entre accesos (miniaturas, comprobación,
+    conversión de WAV) lo hacen dentro de una sesión (SDsession). Un remontaje de la SD
+    (sdf.begin/end, SDremount) invalida esos ficheros: no deja empezar sesiones nuevas, avisa a
+    las abiertas con remountPending() y solo coge el bus cuando se han cerrado todas.
+
+    No depende del framework de Arduino (solo de la STL) para poder probarse en el host
+    con un dispositivo de bloques simulado (test/test_sdscheduler).
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Tamaño máximo de cada porción de una transferencia que no es de tiempo real
+// (se puede cambiar con -DSDIO_SLICE_BYTES en build_flags)
+#ifndef SDIO_SLICE_BYTES
+  #define SDIO_SLICE_BYTES 4096
+#endif
+
+// Número de cubetas del histograma. Cubeta n --> latencia < 2^(n+6) us
+// (0: <64us, 1: <128us ... 13: <512ms, 14: resto)
+#define SDIO_HIST_BUCKETS 15
+
+enum tSDioClass
+{
+    SDIO_PLAYBACK = 0,
+    SDIO_RECORDING = 1,
+    SDIO_INTERACTIVE = 2,
+    SDIO_BACKGROUND = 3
+};
+
+#define SDIO_CLASSES 4
+
+struct tSDioStats
+{
+    uint32_t requests = 0;
+    // Peor espera hasta obtener el bus y peor tiempo total (espera + servicio)
+    uint32_t maxWaitUs = 0;
+    uint32_t maxTotalUs = 0;
+    // Histograma de latencia total de cada petición
+    uint32_t hist[SDIO_HIST_BUCKETS] = {};
+};
+
+class SDscheduler
+{
+    private:
+
+        std::mutex _mtx;
+        std::condition_variable _cv;
+
+        // Quién tiene el bus, con qué clase y cuántas veces lo ha cogido (reentrante)
+        const void* _owner = nullptr;
+        int _ownerClass = SDIO_BACKGROUND;
+        int _depth = 0;
+
+        // Peticiones esperando por clase
+        int _waiting[SDIO_CLASSES] = {};
+
+        // Sesiones de fondo abiertas y remontajes pedidos o en curso
+        int _sessions = 0;
+        int _remounts = 0;
+
+        tSDioStats _stats[SDIO_CLASSES];
+
+        // Identificador de la tarea/hilo que llama. Vale igual para FreeRTOS y para pthreads.
+        static const void* currentTask()
+        {
+            static thread_local char tag;
+            return &tag;
+        }
+
+        static uint32_t nowUs()
+        {
+            using namespace std::chrono;
+            return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        // ¿Hay alguien de una clase más prioritaria que ioClass esperando?
+        bool higherWaiting(int ioClass)
+        {
+            for (int c = 0; c < ioClass; c++)
+            {
+                if (_waiting[c] != 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static int bucketFor(uint32_t us)
+        {
+            int b = 0;
+            uint32_t limit = 64;
+            while (b < SDIO_HIST_BUCKETS - 1 && us >= limit)
+            {
+                limit <<= 1;
+                b++;
+            }
+            return b;
+        }
+
+    public:
+
+        // Devuelve el instante de concesión (us) para poder medir la latencia total
+        uint32_t acquire(tSDioClass ioClass, uint32_t* tRequest = nullptr)
+        {
+            const void* me = currentTask();
+            uint32_t t0 = nowUs();
+
+            std::unique_lock<std::mutex> lk(_mtx);
+
+            // Reentrada desde la misma tarea. No se vuelve a encolar.
+            if (_owner == me)
+            {
+                _depth++;
+                if (tRequest != nullptr) *tRequest = t0;
+                return t0;
+            }
+
+            _waiting[ioClass]++;
+            _cv.wait(lk, [&]{ return _owner == nullptr && !higherWaiting(ioClass); });
+            _waiting[ioClass]--;
+
+            _owner = me;
+            _ownerClass = ioClass;
+            _depth = 1;
+
+            uint32_t t1 = nowUs();
+            uint32_t wait = t1 - t0;
+            if (wait > _stats[ioClass].maxWaitUs)
+            {
+                _stats[ioClass].maxWaitUs = wait;
+            }
+
+            if (tRequest != nullptr) *tRequest = t0;
+            return t1;
+        }
+
+        void release(tSDioClass ioClass, uint32_t tRequest)
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+
+            if (_owner != currentTask() || _depth == 0)
+            {
+                return;
+            }
+
+            if (--_depth != 0)
+            {
+                return;
+            }
+
+            uint32_t total = nowUs() - tRequest;
+            tSDioStats& st = _stats[ioClass];
+            st.requests++;
+            st.hist[bucketFor(total)]++;
+            if (total > st.maxTotalUs)
+            {
+                st.maxTotalUs = total;
+            }
+
+            _owner = nullptr;
+            lk.unlock();
+            _cv.notify_all();
+        }
+
+        // Punto de cesión para operaciones largas (escaneo de directorios, etc.).
+        // Si hay alguien más prioritario esperando se le deja pasar y se vuelve a coger el bus.
+        void yield()
+        {
+            const void* me = currentTask();
+            std::unique_lock<std::mutex> lk(_mtx);
+
+            if (_owner != me || !higherWaiting(_ownerClass))
+            {
+                return;
+            }
+
+            int savedDepth = _depth;
+            int ioClass = _ownerClass;
+
+            _owner = nullptr;
+            _depth = 0;
+            _cv.notify_all();
+
+            _waiting[ioClass]++;
+            _cv.wait(lk, [&]{ return _owner == nullptr && !higherWaiting(ioClass); });
+            _waiting[ioClass]--;
+
+            _owner = me;
+            _ownerClass = ioClass;
+            _depth = savedDepth;
+        }
+
+        // Sesión de una tarea de fondo. Espera si hay un remontaje pedido o en curso.
+        // No se puede abrir teniendo el bus cogido.
+        void beginSession()
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+            _cv.wait(lk, [&]{ return _remounts == 0; });
+            _sessions++;
+        }
+
+        void endSession()
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+            _sessions--;
+            lk.unlock();
+            _cv.notify_all();
+        }
+
+        // Hay un remontaje esperando: las sesiones abiertas deben cerrar sus ficheros y acabar
+        bool remountPending()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _remounts != 0;
+        }
+
+        // Espera a que se cierren las sesiones y coge el bus. Desde una tarea sin sesión abierta
+        uint32_t beginRemount(tSDioClass ioClass, uint32_t* tRequest)
+        {
+            {
+                std::unique_lock<std::mutex> lk(_mtx);
+                _remounts++;
+                _cv.wait(lk, [&]{ return _sessions == 0; });
+            }
+            return acquire(ioClass, tRequest);
+        }
+
+        void endRemount(tSDioClass ioClass, uint32_t tRequest)
+        {
+            release(ioClass, tRequest);
+            std::unique_lock<std::mutex> lk(_mtx);
+            _remounts--;
+            lk.unlock();
+            _cv.notify_all();
+        }
+
+        // Peticiones de esta clase esperando el bus
+        int waiting(tSDioClass ioClass)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _waiting[ioClass];
+        }
+
+        // Lectura troceada. F es cualquier fichero con read(buf,len) (File32 o uno simulado)
+        template <class F>
+        int read(F& f, uint8_t* buffer, size_t len, tSDioClass ioClass)
+        {
+            size_t done = 0;
+            size_t slice = (ioClass == SDIO_PLAYBACK) ? len : SDIO_SLICE_BYTES;
+
+            while (done < len)
+            {
+                size_t n = (len - done) < slice ? (len - done) : slice;
+                uint32_t tReq;
+                acquire(ioClass, &tReq);
+                int r = f.read(buffer + done, n);
+                release(ioClass, tReq);
+
+                if (r <= 0)
+                {
+                    break;
+                }
+                done += r;
+            }
+            return (int)done;
+        }
+
+        // Escritura troceada
+        template <class F>
+        size_t write(F& f, const uint8_t* buffer, size_t len, tSDioClass ioClass)
+        {
+            size_t done = 0;
+            size_t slice = (ioClass == SDIO_PLAYBACK) ? len : SDIO_SLICE_BYTES;
+
+            while (done < len)
+            {
+                size_t n = (len - done) < slice ? (len - done) : slice;
+                uint32_t tReq;
+                acquire(ioClass, &tReq);
+                size_t w = f.write(buffer + done, n);
+                release(ioClass, tReq);
+
+                if (w == 0)
+                {
+                    break;
+                }
+                done += w;
+            }
+            return done;
+        }
+
+        tSDioStats getStats(tSDioClass ioClass)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _stats[ioClass];
+        }
+
+        void resetStats()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            for (int c = 0; c < SDIO_CLASSES; c++)
+            {
+                _stats[c] = tSDioStats();
+            }
+        }
+
+        static const char* className(int ioClass)
+        {
+            switch (ioClass)
+            {
+                case SDIO_PLAYBACK:     return "playback";
+                case SDIO_RECORDING:    return "recording";
+                case SDIO_INTERACTIVE:  return "interactive";
+                default:                return "background";
+            }
+        }
+
+        // Límite superior (us) de la cubeta b del histograma. 0 = sin límite
+        static uint32_t bucketLimitUs(int b)
+        {
+            return (b >= SDIO_HIST_BUCKETS - 1) ? 0 : ((uint32_t)64 << b);
+        }
+};
+
+// Instancia única para toda la aplicación
+SDscheduler sdsched;
+
+// Bloqueo de ámbito. Se coge el bus al crear y se libera al salir del bloque.
+//
+//   {
+//      SDioLock lock(SDIO_INTERACTIVE);
+//      ... accesos a la SD ...
+//   }
+class SDioLock
+{
+    private:
+        tSDioClass _class;
+        uint32_t _tReq;
+
+    public:
+        explicit SDioLock(tSDioClass ioClass) : _class(ioClass)
+        {
+            sdsched.acquire(_class, &_tReq);
+        }
+
+        ~SDioLock()
+        {
+            sdsched.release(_class, _tReq);
+        }
+
+        void yield()
+        {
+            sdsched.yield();
+        }
+
+        SDioLock(const SDioLock&) = delete;
+        SDioLock& operator=(const SDioLock&) = delete;
+};
+
+// Sesión de ámbito para las tareas de fondo
+//
+//   {
+//      SDsession session;
+//      ... abre ficheros, los lee a trozos, sale si sdsched.remountPending() ...
+//   }
+class SDsession
+{
+    public:
+        SDsession()
+        {
+            sdsched.beginSession();
+        }
+
+        ~SDsession()
+        {
+            sdsched.endSession();
+        }
+
+        SDsession(const SDsession&) = delete;
+        SDsession& operator=(const SDsession&) = delete;
+};
+
+// Remontaje de ámbito. Todo sdf.begin()/sdf.end() va dentro de uno.
+//
+//   {
+//      SDremount remount;
+//      sdf.begin(sdcfg);
+//   }
+class SDremount
+{
+    private:
+        tSDioClass _class;
+        uint32_t _tReq;
+
+    public:
+        explicit SDremount(tSDioClass ioClass = SDIO_INTERACTIVE) : _class(ioClass)
+        {
+            sdsched.beginRemount(_class, &_tReq);
+        }
+
+        ~SDremount()
+        {
+            sdsched.endRemount(_class, _tReq);
+        }
+
+        SDremount(const SDremount&) = delete;
+        SDremount& operator=(const SDremount&) = delete;
+};
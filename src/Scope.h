@@ -0,0 +1,463 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: Scope.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Osciloscopio de la señal EAR (reproducción) o MIC (grabación) en el componente
+    waveform de la Nextion (página SCOPE).
+
+    Captura (ScopeCapture, sin dependencias del framework):
+      - Reproducción: el ZXProcessor genera tramos de amplitud constante, así que se toma el
+        tramo entero (amplitud, nº de muestras) en createPulse/insertSamplesError. Coste O(1)
+        por pulso, no por muestra.
+      - Grabación: el bloque leído del codec (canal R) muestra a muestra.
+      - Diezmado min/max: cada columna resume SCOPE_ZOOM[n] muestras en su máximo y su mínimo,
+        que se envían como dos puntos seguidos (envolvente, no se pierden los pulsos cortos).
+      - Disparo por flanco (subida/bajada), o libre. En reproducción el nivel es el punto medio
+        entre LEVELDOWN (o 0 con ZEROLEVEL) y LEVELUP; en grabación, 0. Si no hay flanco en
+        SCOPE_AUTO_SAMPLES se dispara solo para que la pantalla no se quede parada.
+      - La configuración (disparo, zoom, nivel) la escribe la tarea del HMI en una sola palabra
+        atómica y la aplica la tarea del audio al principio de cada toma, así que nunca ve una
+        configuración a medias ni un reset en mitad de una columna.
+      - Doble buffer. Mientras la tarea del HMI no haya enviado la trama anterior no se
+        captura nada (la toma vuelve enseguida).
+
+    Envío (Scope::pump, tarea del HMI): "cle" y un solo "addt" con todos los puntos de la
+    trama. Los datos transparentes van tras la respuesta 0xFE sin que otra tarea pueda
+    escribir en medio (HMIout::sendTransparent).
+
+    Comandos del HMI: PSCOPE (entrar en la página), SCT=n (disparo 0 libre / 1 subida /
+    2 bajada), SCZ=n (escala de tiempo, índice de SCOPE_ZOOM).
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// Columnas por trama. Se envían 2 puntos por columna (máximo y mínimo)
+#ifndef SCOPE_COLUMNS
+  #define SCOPE_COLUMNS 160
+#endif
+#define SCOPE_POINTS (SCOPE_COLUMNS * 2)
+// Alto del waveform en pixels
+#ifndef SCOPE_HEIGHT
+  #define SCOPE_HEIGHT 160
+#endif
+// Disparo automático si no hay flanco en este nº de muestras (~0.5 s a 44.1 KHz)
+#define SCOPE_AUTO_SAMPLES 22050
+
+// Muestras por columna
+static const uint16_t SCOPE_ZOOM[] = {1, 2, 4, 8, 16, 32, 64, 128, 256};
+#define SCOPE_NUM_ZOOM (sizeof(SCOPE_ZOOM) / sizeof(SCOPE_ZOOM[0]))
+#define SCOPE_DEFAULT_ZOOM 2
+
+enum tScopeTrigger
+{
+    SCOPE_FREE = 0,
+    SCOPE_RISING = 1,
+    SCOPE_FALLING = 2
+};
+
+struct tScopeStats
+{
+    uint32_t frames = 0;
+    uint32_t triggers = 0;
+    uint32_t autoTriggers = 0;
+};
+
+class ScopeCapture
+{
+    private:
+
+        enum { ARMED, CAPTURING };
+
+        // Disparo (bits 0-1), zoom (2-5), generación (6-15) y nivel de disparo (16-31)
+        std::atomic<uint32_t> _config{pack(SCOPE_RISING, SCOPE_DEFAULT_ZOOM, 0, 0)};
+
+        // Lo que sigue solo lo toca la tarea del audio
+        uint32_t _applied = pack(SCOPE_RISING, SCOPE_DEFAULT_ZOOM, 0, 0);
+        int _state = ARMED;
+        int _trigger = SCOPE_RISING;
+        uint32_t _spc = SCOPE_ZOOM[SCOPE_DEFAULT_ZOOM];
+        int16_t _level = 0;
+
+        int16_t _last = 0;
+        uint32_t _armedSamples = 0;
+
+        // Columna en curso
+        uint32_t _colFill = 0;
+        int16_t _min = 0;
+        int16_t _max = 0;
+        int _col = 0;
+
+        uint8_t _buf[2][SCOPE_POINTS];
+        int _back = 0;
+        // Trama lista para enviar (-1 = ninguna)
+        std::atomic<int> _ready{-1};
+
+        // Los lee la tarea del HMI
+        std::atomic<uint32_t> _frames{0};
+        std::atomic<uint32_t> _triggers{0};
+        std::atomic<uint32_t> _autoTriggers{0};
+
+        static uint8_t scale(int16_t v)
+        {
+            return (uint8_t)(((int32_t)v + 32768) * (SCOPE_HEIGHT - 1) / 65535);
+        }
+
+        static uint32_t pack(int trigger, int zoom, uint32_t gen, int16_t level)
+        {
+            return (trigger & 3) | ((zoom & 0xF) << 2) | ((gen & 0x3FF) << 6) | ((uint32_t)(uint16_t)level << 16);
+        }
+
+        bool edge(int16_t prev, int16_t cur, int16_t level)
+        {
+            switch (_trigger)
+            {
+                case SCOPE_RISING:  return prev < level && cur >= level;
+                case SCOPE_FALLING: return prev >= level && cur < level;
+                default:            return true;
+            }
+        }
+
+        // Configuración nueva de la tarea del HMI: se aplica y la captura empieza de cero
+        void apply()
+        {
+            uint32_t c = _config.load(std::memory_order_acquire);
+            if (c == _applied)
+            {
+                return;
+            }
+
+            _applied = c;
+            _trigger = c & 3;
+            _spc = SCOPE_ZOOM[(c >> 2) & 0xF];
+            _level = (int16_t)(c >> 16);
+
+            _state = ARMED;
+            _armedSamples = 0;
+            _col = 0;
+            _colFill = 0;
+            // Una trama pendiente no se toca: la tarea del HMI puede estar enviándola
+        }
+
+        void startCapture(bool automatic)
+        {
+            _state = CAPTURING;
+            _col = 0;
+            _colFill = 0;
+            if (automatic)
+            {
+                _autoTriggers.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                _triggers.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Añade n muestras de valor v a la captura. Devuelve las que no han cabido.
+        uint32_t feed(int16_t v, uint32_t n)
+        {
+            while (n > 0)
+            {
+                if (_colFill == 0)
+                {
+                    _min = v;
+                    _max = v;
+                }
+                else
+                {
+                    if (v < _min) _min = v;
+                    if (v > _max) _max = v;
+                }
+
+                uint32_t take = _spc - _colFill;
+                if (take > n)
+                {
+                    take = n;
+                }
+                _colFill += take;
+                n -= take;
+
+                if (_colFill == _spc)
+                {
+                    _buf[_back][2 * _col] = scale(_max);
+                    _buf[_back][2 * _col + 1] = scale(_min);
+                    _colFill = 0;
+
+                    if (++_col == SCOPE_COLUMNS)
+                    {
+                        // Trama completa. La recoge la tarea del HMI.
+                        _ready.store(_back);
+                        _back ^= 1;
+                        _frames.fetch_add(1, std::memory_order_relaxed);
+                        _state = ARMED;
+                        _armedSamples = 0;
+                        return n;
+                    }
+                }
+            }
+            return 0;
+        }
+
+    public:
+
+        // Desde la tarea del HMI (un solo escritor). level: nivel de disparo de la reproducción.
+        // Cada llamada cambia la generación, así que la captura siempre vuelve a empezar.
+        void configure(int trigger, int zoom, int16_t level)
+        {
+            if (zoom < 0 || zoom >= (int)SCOPE_NUM_ZOOM)
+            {
+                zoom = SCOPE_DEFAULT_ZOOM;
+            }
+            if (trigger < SCOPE_FREE || trigger > SCOPE_FALLING)
+            {
+                trigger = SCOPE_RISING;
+            }
+            uint32_t gen = ((_config.load(std::memory_order_relaxed) >> 6) & 0x3FF) + 1;
+            _config.store(pack(trigger, zoom, gen, level), std::memory_order_release);
+        }
+
+        // Tramo de n muestras de amplitud constante (reproducción)
+        void run(int16_t amp, uint32_t n)
+        {
+            apply();
+
+            if (_ready.load(std::memory_order_relaxed) >= 0)
+            {
+                _last = amp;
+                return;
+            }
+
+            if (_state == ARMED)
+            {
+                if (_trigger != SCOPE_FREE && !edge(_last, amp, _level))
+                {
+                    _last = amp;
+                    _armedSamples += n;
+                    if (_armedSamples < SCOPE_AUTO_SAMPLES)
+                    {
+                        return;
+                    }
+                    startCapture(true);
+                }
+                else
+                {
+                    startCapture(false);
+                }
+            }
+
+            _last = amp;
+            feed(amp, n);
+        }
+
+        // Muestras sueltas (grabación). stride = valores entre una muestra y la siguiente
+        void samples(const int16_t* s, int n, int stride)
+        {
+            int i = 0;
+
+            apply();
+
+            while (i < n)
+            {
+                if (_ready.load(std::memory_order_relaxed) >= 0)
+                {
+                    _last = s[(n - 1) * stride];
+                    return;
+                }
+
+                if (_state == ARMED)
+                {
+                    // Busca el flanco. La entrada del codec está centrada en 0
+                    for (; i < n; i++)
+                    {
+                        int16_t v = s[i * stride];
+                        bool hit = _trigger == SCOPE_FREE || edge(_last, v, 0) || ++_armedSamples >= SCOPE_AUTO_SAMPLES;
+                        _last = v;
+                        if (hit)
+                        {
+                            startCapture(_trigger != SCOPE_FREE && _armedSamples >= SCOPE_AUTO_SAMPLES);
+                            break;
+                        }
+                    }
+                    if (i == n)
+                    {
+                        return;
+                    }
+                }
+
+                for (; i < n && _state == CAPTURING; i++)
+                {
+                    _last = s[i * stride];
+                    feed(_last, 1);
+                }
+            }
+        }
+
+        // Trama lista (SCOPE_POINTS puntos) o nullptr
+        const uint8_t* frame()
+        {
+            int r = _ready.load();
+            return r >= 0 ? _buf[r] : nullptr;
+        }
+
+        // La trama ya se ha enviado. Se puede capturar otra.
+        void consume()
+        {
+            _ready.store(-1);
+        }
+
+        tScopeStats getStats()
+        {
+            tScopeStats st;
+            st.frames = _frames.load(std::memory_order_relaxed);
+            st.triggers = _triggers.load(std::memory_order_relaxed);
+            st.autoTriggers = _autoTriggers.load(std::memory_order_relaxed);
+            return st;
+        }
+};
+
+#ifdef ARDUINO
+
+// Componente waveform de la página SCOPE y tiempo mínimo entre tramas
+#ifndef SCOPE_WAVEFORM_ID
+  #define SCOPE_WAVEFORM_ID "s0.id"
+#endif
+#define SCOPE_FRAME_MS 100
+// Espera a la respuesta 0xFE del addt
+#define SCOPE_READY_MS 20
+
+class Scope
+{
+    private:
+
+        ScopeCapture _cap;
+        volatile bool _active = false;
+        int _trigger = SCOPE_RISING;
+        int _zoom = SCOPE_DEFAULT_ZOOM;
+        int16_t _level = 0;
+        unsigned long _lastFrame = 0;
+
+        // Punto medio entre los dos niveles que genera el ZXProcessor
+        static int16_t playLevel()
+        {
+            return (int16_t)((LEVELUP + (ZEROLEVEL ? 0 : maxLevelDown)) / 2);
+        }
+
+        void configure()
+        {
+            _level = playLevel();
+            _cap.configure(_trigger, _zoom, _level);
+        }
+
+    public:
+
+        // Se consulta en el camino del audio. Solo lee un bool.
+        inline bool active()
+        {
+            return _active;
+        }
+
+        void start()
+        {
+            configure();
+            _active = true;
+        }
+
+        void stop()
+        {
+            _active = false;
+        }
+
+        void setTrigger(int trigger)
+        {
+            _trigger = trigger;
+            configure();
+        }
+
+        void setZoom(int zoom)
+        {
+            _zoom = zoom;
+            configure();
+        }
+
+        // Tomas
+        inline void run(int16_t amp, uint32_t n)
+        {
+            _cap.run(amp, n);
+        }
+
+        inline void samples(const int16_t* s, int n, int stride)
+        {
+            _cap.samples(s, n, stride);
+        }
+
+        // Desde la tarea del HMI
+        void pump()
+        {
+            if (!_active || CURRENT_PAGE != 4 || millis() - _lastFrame < SCOPE_FRAME_MS)
+            {
+                return;
+            }
+
+            // ZEROLEVEL o los niveles pueden cambiar desde la web con la página abierta
+            if (playLevel() != _level)
+            {
+                configure();
+                return;
+            }
+
+            const uint8_t* points = _cap.frame();
+            if (points == nullptr)
+            {
+                return;
+            }
+
+            hmiOut.send("cle " SCOPE_WAVEFORM_ID ",0");
+            hmiRx.armTransparent();
+            hmiOut.sendTransparent("addt " SCOPE_WAVEFORM_ID ",0," + String(SCOPE_POINTS), points, SCOPE_POINTS,
+                                   []() { return hmiRx.waitTransparent(SCOPE_READY_MS); });
+
+            _cap.consume();
+            _lastFrame = millis();
+        }
+
+        tScopeStats getStats()
+        {
+            return _cap.getStats();
+        }
+};
+
+// Instancia única
+Scope scope;
+
+#endif
@@ -0,0 +1,424 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: ScreenPreview.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Previsualización de la pantalla de carga (SCREEN$) en la Nextion.
+
+      1. Se decodifica el bloque de 6912 bytes: bitmap con el entrelazado del Spectrum
+         (tercio / línea dentro del carácter / fila de caracteres) y atributos (tinta, papel,
+         brillo). El flash se ignora.
+      2. Se reduce (SCR_PREVIEW_SHIFT) quedándose con el color que más se repite en cada
+         celda, así que siempre queda uno de los 15 colores del Spectrum.
+      3. Se convierte en rectángulos: tramos horizontales de un mismo color que se unen con el
+         de la fila de arriba si coinciden. El color más repetido se pinta de fondo de una vez
+         y no genera tramos.
+      4. La tarea del HMI los envía como "fill x,y,w,h,color" según haya sitio en el buffer de
+         TX de la UART, sin bloquear (ScreenPreview::pump).
+
+    Los rectángulos se guardan mientras la cinta esté cargada, así que al volver a reproducir
+    el bloque o volver a la página del TAPE solo se reenvían.
+
+    La parte de decodificación no depende del framework para poder probarse en el host.
+
+    Version: 0.2
+
+    Historico de versiones
+    v.0.1 - Version inicial
+    v.0.2 - Imágenes ya reducidas (miniaturas) con ampliación al pintar
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define SCR_W 256
+#define SCR_H 192
+#define SCR_BITMAP_SIZE 6144
+#define SCR_DATA_SIZE 6912
+
+// Posición en la página TAPE y reducción (0 = 256x192, 1 = 128x96, 2 = 64x48)
+#ifndef SCR_PREVIEW_X
+  #define SCR_PREVIEW_X 335
+#endif
+#ifndef SCR_PREVIEW_Y
+  #define SCR_PREVIEW_Y 100
+#endif
+#ifndef SCR_PREVIEW_SHIFT
+  #define SCR_PREVIEW_SHIFT 1
+#endif
+
+struct tScrRect
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+    uint8_t c;
+    uint8_t pad;
+};
+
+// Color RGB565 de la paleta del Spectrum. idx = color (0-7) + 8 si tiene brillo
+static uint16_t zxColor565(int idx)
+{
+    int level = (idx & 8) ? 255 : 215;
+    int r = (idx & 2) ? level : 0;
+    int g = (idx & 4) ? level : 0;
+    int b = (idx & 1) ? level : 0;
+    return (uint16_t)(((r * 31 / 255) << 11) | ((g * 63 / 255) << 5) | (b * 31 / 255));
+}
+
+// Color (0-15) del pixel x,y de una pantalla de 6912 bytes
+static inline int zxPixel(const uint8_t* scr, int x, int y)
+{
+    // Dirección en el bitmap: tercio (y7-y6), línea dentro del carácter (y2-y0), fila (y5-y3)
+    int addr = ((y & 0xC0) << 5) | ((y & 0x07) << 8) | ((y & 0x38) << 2) | (x >> 3);
+    uint8_t attr = scr[SCR_BITMAP_SIZE + ((y >> 3) << 5) + (x >> 3)];
+
+    bool ink = (scr[addr] >> (7 - (x & 7))) & 1;
+    int color = ink ? (attr & 0x07) : ((attr >> 3) & 0x07);
+
+    // El negro con brillo es negro
+    if (color == 0)
+    {
+        return 0;
+    }
+    return color | ((attr & 0x40) ? 8 : 0);
+}
+
+class ScreenDecoder
+{
+    public:
+
+        // Tamaño del buffer de trabajo (colores de la imagen reducida)
+        static int workSize(int shift)
+        {
+            return (SCR_W >> shift) * (SCR_H >> shift) + (SCR_W >> shift) * sizeof(int);
+        }
+
+        // Máximo número de rectángulos posible
+        static int maxRects(int shift)
+        {
+            return (SCR_W >> shift) * (SCR_H >> shift);
+        }
+
+        // Reduce la pantalla a (SCR_W >> shift) x (SCR_H >> shift) colores (0-15), uno por byte
+        static void downscale(const uint8_t* scr, int shift, uint8_t* img)
+        {
+            int w = SCR_W >> shift;
+            int h = SCR_H >> shift;
+            int cell = 1 << shift;
+
+            // Reducción por mayoría
+            for (int y = 0; y < h; y++)
+            {
+                for (int x = 0; x < w; x++)
+                {
+                    uint8_t votes[16] = {};
+                    int best = 0;
+                    for (int dy = 0; dy < cell; dy++)
+                    {
+                        for (int dx = 0; dx < cell; dx++)
+                        {
+                            int c = zxPixel(scr, (x << shift) + dx, (y << shift) + dy);
+                            if (++votes[c] > votes[best])
+                            {
+                                best = c;
+                            }
+                        }
+                    }
+                    img[y * w + x] = best;
+                }
+            }
+        }
+
+        // Convierte la pantalla en rectángulos. Devuelve cuántos y el color de fondo.
+        static int build(const uint8_t* scr, int shift, uint8_t* work, tScrRect* out, int maxOut, uint8_t &bg)
+        {
+            int w = SCR_W >> shift;
+            int h = SCR_H >> shift;
+
+            downscale(scr, shift, work);
+            return rects(work, w, h, (int*)(work + w * h), out, maxOut, bg);
+        }
+
+        // Convierte una imagen ya reducida (w x h colores) en rectángulos.
+        // openAt = w enteros de trabajo.
+        static int rects(const uint8_t* img, int w, int h, int* openAt, tScrRect* out, int maxOut, uint8_t &bg)
+        {
+            // Color de fondo
+            uint32_t total[16] = {};
+            for (int i = 0; i < w * h; i++)
+            {
+                total[img[i] & 0x0F]++;
+            }
+
+            bg = 0;
+            for (int c = 1; c < 16; c++)
+            {
+                if (total[c] > total[bg])
+                {
+                    bg = c;
+                }
+            }
+
+            // Tramos por fila, unidos con el rectángulo abierto de la fila anterior
+            for (int x = 0; x < w; x++)
+            {
+                openAt[x] = -1;
+            }
+
+            int n = 0;
+            for (int y = 0; y < h; y++)
+            {
+                const uint8_t* row = img + y * w;
+                int x = 0;
+                while (x < w)
+                {
+                    int c = row[x];
+                    int x0 = x;
+                    while (x < w && row[x] == c)
+                    {
+                        x++;
+                    }
+
+                    if (c == bg)
+                    {
+                        continue;
+                    }
+
+                    int o = openAt[x0];
+                    if (o >= 0 && out[o].c == c && out[o].w == x - x0 && out[o].y + out[o].h == y)
+                    {
+                        out[o].h++;
+                        continue;
+                    }
+
+                    if (n == maxOut)
+                    {
+                        return n;
+                    }
+
+                    out[n].x = x0;
+                    out[n].y = y;
+                    out[n].w = x - x0;
+                    out[n].h = 1;
+                    out[n].c = c;
+                    out[n].pad = 0;
+                    openAt[x0] = n;
+                    n++;
+                }
+            }
+
+            return n;
+        }
+};
+
+#ifdef ARDUINO
+
+#include <mutex>
+
+class ScreenPreview
+{
+    private:
+
+        std::mutex _mtx;
+
+        // Pantalla ya convertida (de la cinta y bloque indicados)
+        String _tape = "";
+        int _block = -1;
+        tScrRect* _rects = nullptr;
+        int _nRects = 0;
+        uint8_t _bg = 0;
+        // Factor de ampliación al pintar (miniaturas más pequeñas que la previsualización)
+        int _scale = 1;
+
+        // Envío en curso. -1 = fondo pendiente
+        int _sendPos = 0;
+        bool _sending = false;
+        unsigned long _t0 = 0;
+        unsigned long _lastDrawMs = 0;
+
+        void releaseLocked()
+        {
+            if (_rects != nullptr)
+            {
+                blockPool.release(_rects);
+                _rects = nullptr;
+            }
+            _nRects = 0;
+            _block = -1;
+            _tape = "";
+            _sending = false;
+        }
+
+        void startLocked()
+        {
+            _sendPos = -1;
+            _sending = _rects != nullptr;
+            _t0 = millis();
+        }
+
+        void storeLocked(const String &tape, int block, tScrRect* rects, int n, uint8_t bg, int scale)
+        {
+            releaseLocked();
+            _tape = tape;
+            _block = block;
+            _rects = rects;
+            _nRects = n;
+            _bg = bg;
+            _scale = scale;
+            startLocked();
+        }
+
+    public:
+
+        // El reproductor ha llegado a un bloque de pantalla. data = 6912 bytes (sin flag)
+        void submit(const String &tape, int block, const uint8_t* data)
+        {
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (_rects != nullptr && _block == block && _tape == tape)
+                {
+                    // Ya convertida. Solo se vuelve a enviar.
+                    startLocked();
+                    return;
+                }
+            }
+
+            int shift = SCR_PREVIEW_SHIFT;
+            int maxOut = ScreenDecoder::maxRects(shift);
+            uint8_t* work = (uint8_t*)blockPool.alloc(ScreenDecoder::workSize(shift));
+            tScrRect* rects = (tScrRect*)blockPool.alloc(maxOut * sizeof(tScrRect));
+
+            if (work == nullptr || rects == nullptr)
+            {
+                blockPool.release(work);
+                blockPool.release(rects);
+                return;
+            }
+
+            uint8_t bg = 0;
+            int n = ScreenDecoder::build(data, shift, work, rects, maxOut, bg);
+            blockPool.release(work);
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            storeLocked(tape, block, rects, n, bg, 1);
+
+            #ifdef DEBUGMODE
+                logln("Screen preview: " + String(n) + " rects");
+            #endif
+        }
+
+        // Imagen ya reducida (w x h colores, uno por byte) que se pinta ampliada "scale" veces.
+        // La usan las miniaturas al insertar la cinta, antes de llegar al bloque de pantalla.
+        void submitImage(const String &tape, int block, const uint8_t* img, int w, int h, int scale)
+        {
+            int maxOut = w * h;
+            int* openAt = (int*)blockPool.alloc(w * sizeof(int));
+            tScrRect* rects = (tScrRect*)blockPool.alloc(maxOut * sizeof(tScrRect));
+
+            if (openAt == nullptr || rects == nullptr)
+            {
+                blockPool.release(openAt);
+                blockPool.release(rects);
+                return;
+            }
+
+            uint8_t bg = 0;
+            int n = ScreenDecoder::rects(img, w, h, openAt, rects, maxOut, bg);
+            blockPool.release(openAt);
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            storeLocked(tape, block, rects, n, bg, scale);
+        }
+
+        // Se ha vuelto a la página TAPE (la pantalla la ha borrado)
+        void redraw()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            startLocked();
+        }
+
+        // Al expulsar la cinta
+        void release()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            releaseLocked();
+        }
+
+        // Desde la tarea del HMI. Envía lo que quepa en la UART sin esperar.
+        void pump()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+
+            if (!_sending || CURRENT_PAGE > 1)
+            {
+                return;
+            }
+
+            int shift = SCR_PREVIEW_SHIFT;
+            char cmd[48];
+
+            while (_sendPos < _nRects)
+            {
+                if (_sendPos < 0)
+                {
+                    snprintf(cmd, sizeof(cmd), "fill %d,%d,%d,%d,%u", SCR_PREVIEW_X, SCR_PREVIEW_Y,
+                             SCR_W >> shift, SCR_H >> shift, zxColor565(_bg));
+                }
+                else
+                {
+                    const tScrRect &r = _rects[_sendPos];
+                    snprintf(cmd, sizeof(cmd), "fill %d,%d,%d,%d,%u", SCR_PREVIEW_X + r.x * _scale,
+                             SCR_PREVIEW_Y + r.y * _scale, r.w * _scale, r.h * _scale, zxColor565(r.c));
+                }
+
+                if (!hmiOut.trySend(cmd))
+                {
+                    // UART llena. Se sigue en la próxima vuelta.
+                    return;
+                }
+                _sendPos++;
+            }
+
+            _sending = false;
+            _lastDrawMs = millis() - _t0;
+
+            #ifdef DEBUGMODE
+                logln("Screen preview sent in " + String(_lastDrawMs) + " ms");
+            #endif
+        }
+
+        unsigned long getLastDrawMs()
+        {
+            return _lastDrawMs;
+        }
+};
+
+// Instancia única
+ScreenPreview screenPreview;
+
+#endif
@@ -0,0 +1,1117 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: StreamTape.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Reproducción de una cinta que llega por la red (POST /play), sin escribirla antes en la SD.
+
+    Los bytes van de la tarea de AsyncTCP a la del reproductor por un anillo acotado
+    (StreamRing). Cuando se llena no se confirman a TCP los que llegan (StreamCredit), la
+    ventana se cierra y el otro extremo deja de enviar. Así el anillo nunca desborda y no se
+    bloquea la tarea de la red.
+
+    StreamTapeParser lee el TAP o el TZX en orden, sin volver atrás. Del TZX se reproducen los
+    bloques 0x10, 0x11, 0x12, 0x13, 0x14, 0x20 y 0x2B, y los bucles 0x24/0x25: el cuerpo entero
+    se guarda en un buffer acotado (STREAM_LOOP_BYTES) antes de sonar y se repite desde ahí.
+    Los que no llevan sonido se saltan. Los saltos y llamadas (0x23, 0x26 a 0x28) necesitan ir
+    a otra posición del fichero, y 0x15, 0x18 y 0x19 no se generan; con ellos, o con un bucle
+    que no cabe, la lectura se para al empezar ese bloque y unsupported() dice cuál es.
+
+    StreamRing, StreamCredit y StreamTapeParser solo dependen de la STL para poder probarse en
+    el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "TapeWalker.h"
+
+// Tamaño del anillo (PSRAM)
+#ifndef STREAM_RING_BYTES
+  #define STREAM_RING_BYTES 65536
+#endif
+
+// Ventana de recepción TCP. El anillo tiene que ser al menos así de grande
+#ifndef STREAM_TCP_WINDOW
+  #ifdef TCP_WND
+    #define STREAM_TCP_WINDOW TCP_WND
+  #else
+    #define STREAM_TCP_WINDOW 5744
+  #endif
+#endif
+
+// Cuerpo más largo de un bucle 0x24/0x25 (PSRAM)
+#ifndef STREAM_LOOP_BYTES
+  #define STREAM_LOOP_BYTES 16384
+#endif
+
+// Espera del lector entre comprobaciones de STOP (ms)
+#define STREAM_WAIT_MS 20
+
+// Tipos de bloque que entrega StreamTapeParser
+#define STREAM_BLOCK_DATA 0         // Tono guía + sync + datos (TAP, 0x10, 0x11)
+#define STREAM_BLOCK_PURE_DATA 1    // Solo datos (0x14)
+#define STREAM_BLOCK_TONE 2         // Tono puro (0x12)
+#define STREAM_BLOCK_PULSES 3       // Secuencia de pulsos (0x13)
+#define STREAM_BLOCK_PAUSE 4        // Silencio (0x20)
+#define STREAM_BLOCK_SKIP 5         // Sin sonido, o inicio y fin de bucle (ya descartado)
+#define STREAM_BLOCK_LEVEL 6        // Nivel de la señal (0x2B)
+
+struct tStreamStats
+{
+    uint32_t streams = 0;
+    uint32_t blocks = 0;
+    // Envíos parados en un bloque que no se puede reproducir en orden
+    uint32_t unsupported = 0;
+    uint32_t truncated = 0;
+    uint32_t overflows = 0;
+    // Veces que el reproductor tuvo que esperar datos a mitad de cinta
+    uint32_t underruns = 0;
+    uint64_t bytes = 0;
+};
+
+// Anillo de un productor y un consumidor. Escribir no bloquea nunca; leer espera
+class StreamRing
+{
+    private:
+
+        uint8_t* _buf = nullptr;
+        size_t _cap = 0;
+        size_t _rd = 0;
+        size_t _count = 0;
+        bool _closed = false;
+        bool _complete = false;
+        bool _aborted = false;
+        uint32_t _underruns = 0;
+
+        std::mutex _mtx;
+        std::condition_variable _cv;
+
+    public:
+
+        void attach(uint8_t* buf, size_t cap)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _buf = buf;
+            _cap = cap;
+            _rd = 0;
+            _count = 0;
+            _closed = false;
+            _complete = false;
+            _aborted = false;
+            _underruns = 0;
+        }
+
+        size_t capacity()
+        {
+            return _cap;
+        }
+
+        size_t space()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _cap - _count;
+        }
+
+        size_t available()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _count;
+        }
+
+        // Productor. Devuelve los bytes que caben (0 si el lector ya no quiere más)
+        size_t write(const uint8_t* data, size_t len)
+        {
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (_aborted || _closed)
+                {
+                    return 0;
+                }
+
+                if (len > _cap - _count)
+                {
+                    len = _cap - _count;
+                }
+
+                size_t wr = (_rd + _count) % _cap;
+                size_t first = (len < _cap - wr) ? len : _cap - wr;
+                memcpy(_buf + wr, data, first);
+                memcpy(_buf, data + first, len - first);
+                _count += len;
+            }
+            _cv.notify_all();
+            return len;
+        }
+
+        // Productor. No llegan más datos; complete = false si se cortó antes de tiempo
+        void close(bool complete)
+        {
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _closed = true;
+                _complete = complete;
+            }
+            _cv.notify_all();
+        }
+
+        // Consumidor. Deja de aceptar datos
+        void abort()
+        {
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _aborted = true;
+            }
+            _cv.notify_all();
+        }
+
+        // Consumidor. Espera hasta tener "len" bytes o el final. Cada STREAM_WAIT_MS
+        // llama a keepWaiting(); si devuelve false deja de esperar.
+        // Devuelve menos de "len" al final de los datos o si se corta la espera.
+        template <class Y>
+        size_t read(uint8_t* out, size_t len, Y keepWaiting)
+        {
+            size_t done = 0;
+            bool waited = false;
+
+            while (done < len)
+            {
+                std::unique_lock<std::mutex> lk(_mtx);
+
+                if (_count == 0)
+                {
+                    if (_closed || _aborted)
+                    {
+                        break;
+                    }
+
+                    if (!waited)
+                    {
+                        _underruns++;
+                        waited = true;
+                    }
+
+                    _cv.wait_for(lk, std::chrono::milliseconds(STREAM_WAIT_MS));
+                    if (_count == 0)
+                    {
+                        lk.unlock();
+                        if (!keepWaiting())
+                        {
+                            break;
+                        }
+                    }
+                    continue;
+                }
+
+                size_t n = len - done;
+                if (n > _count)
+                {
+                    n = _count;
+                }
+                size_t first = (n < _cap - _rd) ? n : _cap - _rd;
+                memcpy(out + done, _buf + _rd, first);
+                memcpy(out + done + first, _buf, n - first);
+                _rd = (_rd + n) % _cap;
+                _count -= n;
+                done += n;
+            }
+            return done;
+        }
+
+        // Consumidor. Espera a que haya "bytes" o a que acabe el envío (precarga)
+        template <class Y>
+        bool waitFor(size_t bytes, Y keepWaiting)
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+            while (_count < bytes && !_closed && !_aborted)
+            {
+                _cv.wait_for(lk, std::chrono::milliseconds(STREAM_WAIT_MS));
+                lk.unlock();
+                bool go = keepWaiting();
+                lk.lock();
+                if (!go)
+                {
+                    return false;
+                }
+            }
+            return _count > 0;
+        }
+
+        bool closed()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _closed;
+        }
+
+        // Se cerró a mitad y ya se ha leído todo lo que llegó
+        bool truncated()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _closed && !_complete && _count == 0;
+        }
+
+        bool aborted()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _aborted;
+        }
+
+        // Lecturas que tuvieron que esperar datos (sin contar la precarga de waitFor)
+        uint32_t underruns()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _underruns;
+        }
+};
+
+// Control de flujo TCP hacia el anillo.
+//
+// La pila TCP deja al otro extremo enviar hasta "window" bytes sin confirmar. Los que llegan
+// se apuntan con received() y no se confirman; grant() dice cuántos se pueden confirmar sin
+// que la ventana que se vuelve a abrir supere el hueco libre del anillo. Con el anillo lleno
+// la ventana queda a 0 y el emisor espera.
+//
+// Solo desde la tarea de la red.
+class StreamCredit
+{
+    private:
+
+        size_t _window = STREAM_TCP_WINDOW;
+        size_t _deferred = 0;
+
+    public:
+
+        void reset(size_t window)
+        {
+            _window = window;
+            _deferred = 0;
+        }
+
+        void received(size_t n)
+        {
+            _deferred += n;
+        }
+
+        // Bytes que se pueden confirmar ya con "space" libres en el anillo
+        size_t grant(size_t space)
+        {
+            size_t open = _deferred >= _window ? 0 : _window - _deferred;
+            if (space <= open)
+            {
+                return 0;
+            }
+
+            size_t k = space - open;
+            if (k > _deferred)
+            {
+                k = _deferred;
+            }
+            _deferred -= k;
+            return k;
+        }
+
+        // Confirma todo lo pendiente (el anillo ya no se usa)
+        size_t release()
+        {
+            size_t k = _deferred;
+            _deferred = 0;
+            return k;
+        }
+
+        size_t deferred()
+        {
+            return _deferred;
+        }
+};
+
+struct tStreamBlock
+{
+    int index = 0;
+    uint8_t id = 0;
+    uint8_t kind = STREAM_BLOCK_SKIP;
+    // Tiempos de la ROM (TAP y 0x10); los pone quien reproduce
+    bool standard = false;
+
+    // Bytes de datos que se leen después con data()
+    uint32_t dataSize = 0;
+    // Silencio posterior en ms (0x10, 0x11, 0x14, 0x20). En TAP no viene
+    uint16_t pause = 0;
+
+    // 0x11, 0x12, 0x13 y 0x14
+    tTapeTimings t;
+
+    // 0x2B: 0 bajo, 1 alto
+    uint8_t level = 0;
+
+    // 0x13 (t.numPulses)
+    uint16_t pulses[255];
+};
+
+// Lector secuencial de TAP/TZX. S tiene size_t read(uint8_t*, size_t), que espera hasta tener
+// los bytes pedidos y devuelve menos al final de los datos.
+template <class S>
+class StreamTapeParser
+{
+    private:
+
+        S& _src;
+        bool _tzx = false;
+        bool _error = false;
+        int _index = 0;
+        uint32_t _left = 0;
+        uint8_t _unsupported = 0;
+
+        // Bytes leídos para ver el formato que, en un TAP, son del primer bloque
+        uint8_t _pre[TW_TZX_HEADER_SIZE];
+        size_t _preLen = 0;
+        size_t _prePos = 0;
+
+        // Cuerpo del bucle en curso. Mientras se repite, los bloques se leen de aquí
+        uint8_t* _loop = nullptr;
+        size_t _loopCap = 0;
+        size_t _loopLen = 0;
+        size_t _loopPos = 0;
+        bool _inLoop = false;
+        // Pasadas que faltan después de la actual
+        uint16_t _loopLeft = 0;
+        // Índice del primer bloque del cuerpo y el del 0x25
+        int _loopFirst = 0;
+        int _loopEnd = 0;
+
+        size_t get(uint8_t* out, size_t len)
+        {
+            size_t done = 0;
+            while (done < len && _prePos < _preLen)
+            {
+                out[done++] = _pre[_prePos++];
+            }
+            if (_inLoop)
+            {
+                // El cuerpo son bloques enteros: nunca se lee más allá
+                size_t n = len - done;
+                if (n > _loopLen - _loopPos)
+                {
+                    n = _loopLen - _loopPos;
+                }
+                memcpy(out + done, _loop + _loopPos, n);
+                _loopPos += n;
+                return done + n;
+            }
+            if (done < len)
+            {
+                done += _src.read(out + done, len - done);
+            }
+            return done;
+        }
+
+        bool discard(uint32_t n)
+        {
+            uint8_t tmp[64];
+            while (n > 0)
+            {
+                size_t k = n < sizeof(tmp) ? n : sizeof(tmp);
+                if (get(tmp, k) != k)
+                {
+                    return false;
+                }
+                n -= k;
+            }
+            return true;
+        }
+
+        static bool soundless(uint8_t id)
+        {
+            // Grupos, fin de bucle suelto, textos, información, snapshot y fin de bloque de 48K
+            return id == 0x21 || id == 0x22 || id == 0x25 || id == 0x2A || (id >= 0x30 && id <= 0x35)
+                   || id == 0x40 || id == 0x5A;
+        }
+
+        // Lo que se puede meter en un bucle
+        static bool streamable(uint8_t id)
+        {
+            return (id >= 0x10 && id <= 0x14) || id == 0x20 || id == 0x2B || soundless(id);
+        }
+
+        // Copia el cuerpo del bucle, hasta el 0x25, al buffer. Cuenta los bloques en "blocks".
+        // false si no cabe, tiene algo que no se puede reproducir (unsupported) o está cortado
+        bool recordLoop(int &blocks)
+        {
+            _loopLen = 0;
+            blocks = 0;
+
+            for (;;)
+            {
+                uint8_t id;
+                if (get(&id, 1) != 1)
+                {
+                    _error = true;
+                    return false;
+                }
+                if (id == 0x25)
+                {
+                    return true;
+                }
+
+                // Un bucle dentro de otro tampoco vale
+                uint32_t fixed = twTzxFixedSize(id);
+                if (id == 0x24 || !streamable(id) || _loopLen + 1 + fixed > _loopCap)
+                {
+                    _unsupported = 0x24;
+                    return false;
+                }
+
+                uint8_t* h = _loop + _loopLen + 1;
+                _loop[_loopLen] = id;
+                if (get(h, fixed) != fixed)
+                {
+                    _error = true;
+                    return false;
+                }
+
+                tTapeBlock tb;
+                uint32_t body = twTzxBodySize(id, h, tb);
+                if (_loopLen + 1 + body > _loopCap)
+                {
+                    _unsupported = 0x24;
+                    return false;
+                }
+                if (get(h + fixed, body - fixed) != body - fixed)
+                {
+                    _error = true;
+                    return false;
+                }
+
+                _loopLen += 1 + body;
+                blocks++;
+            }
+        }
+
+        bool nextTZX(tStreamBlock &b)
+        {
+            uint8_t id;
+            if (get(&id, 1) != 1)
+            {
+                return false;
+            }
+
+            uint8_t h[TW_PEEK_SIZE] = {};
+            uint32_t fixed = twTzxFixedSize(id);
+            if (get(h, fixed) != fixed)
+            {
+                _error = true;
+                return false;
+            }
+
+            tTapeBlock tb;
+            uint32_t body = twTzxBodySize(id, h, tb);
+            uint32_t rest = body - fixed;
+
+            b.id = id;
+            b.pause = tb.pause;
+            twTzxTimings(id, h, b.t);
+
+            switch (id)
+            {
+                case 0x10:
+                    b.kind = STREAM_BLOCK_DATA;
+                    b.standard = true;
+                    b.dataSize = rest;
+                    break;
+
+                case 0x11:
+                    b.kind = STREAM_BLOCK_DATA;
+                    b.dataSize = rest;
+                    break;
+
+                case 0x14:
+                    b.kind = STREAM_BLOCK_PURE_DATA;
+                    b.dataSize = rest;
+                    break;
+
+                case 0x12:
+                    b.kind = STREAM_BLOCK_TONE;
+                    break;
+
+                case 0x13:
+                {
+                    b.kind = STREAM_BLOCK_PULSES;
+                    uint8_t p[2];
+                    for (int n = 0; n < b.t.numPulses; n++)
+                    {
+                        if (get(p, 2) != 2)
+                        {
+                            _error = true;
+                            return false;
+                        }
+                        b.pulses[n] = twLe16(p);
+                    }
+                    break;
+                }
+
+                case 0x20:
+                    b.kind = STREAM_BLOCK_PAUSE;
+                    break;
+
+                case 0x2B:
+                    b.kind = STREAM_BLOCK_LEVEL;
+                    b.level = h[4];
+                    break;
+
+                case 0x24:
+                {
+                    // Dentro de un bucle lo para recordLoop(); aquí solo llega el primero
+                    int blocks;
+                    if (!recordLoop(blocks))
+                    {
+                        return false;
+                    }
+                    b.kind = STREAM_BLOCK_SKIP;
+                    _inLoop = true;
+                    _loopPos = 0;
+                    _loopLeft = b.t.loopCount > 1 ? b.t.loopCount - 1 : 0;
+                    _loopFirst = _index + 1;
+                    _loopEnd = _loopFirst + blocks;
+                    break;
+                }
+
+                default:
+                    b.kind = STREAM_BLOCK_SKIP;
+                    if (!soundless(id))
+                    {
+                        // Sin leer nada más: el bloque no suena
+                        _unsupported = id;
+                        return false;
+                    }
+                    if (!discard(rest))
+                    {
+                        _error = true;
+                        return false;
+                    }
+                    break;
+            }
+
+            return true;
+        }
+
+        bool nextTAP(tStreamBlock &b)
+        {
+            uint8_t h[2];
+            size_t n = get(h, 2);
+            if (n != 2)
+            {
+                // Un byte suelto al final es un TAP cortado
+                _error = (n == 1);
+                return false;
+            }
+
+            b.id = 0x10;
+            b.kind = STREAM_BLOCK_DATA;
+            b.standard = true;
+            b.dataSize = twLe16(h);
+            return true;
+        }
+
+    public:
+
+        explicit StreamTapeParser(S& src) : _src(src)
+        {
+        }
+
+        // Buffer para el cuerpo de los bucles. Sin él solo valen bucles vacíos
+        void setLoopBuffer(uint8_t* buf, size_t cap)
+        {
+            _loop = buf;
+            _loopCap = buf != nullptr ? cap : 0;
+        }
+
+        // Mira la cabecera. false si no llega nada
+        bool begin()
+        {
+            _preLen = get(_pre, TW_TZX_HEADER_SIZE);
+            _prePos = 0;
+            _tzx = _preLen == TW_TZX_HEADER_SIZE && memcmp(_pre, "ZXTape!\x1A", 8) == 0;
+            if (_tzx)
+            {
+                // La cabecera no es de ningún bloque
+                _prePos = _preLen;
+            }
+            return _preLen > 0;
+        }
+
+        bool isTZX()
+        {
+            return _tzx;
+        }
+
+        // Siguiente bloque. Lo que quede sin leer del anterior se descarta.
+        // false al final de los datos o si están cortados (error())
+        bool next(tStreamBlock &b)
+        {
+            if (_error || (_left > 0 && !discard(_left)))
+            {
+                _error = true;
+                return false;
+            }
+            _left = 0;
+
+            // Fin de una pasada del bucle: otra vuelta o el 0x25
+            bool loopEnd = false;
+            if (_inLoop && _loopPos == _loopLen)
+            {
+                if (_loopLeft > 0 && _loopLen > 0)
+                {
+                    _loopLeft--;
+                    _loopPos = 0;
+                    _index = _loopFirst;
+                }
+                else
+                {
+                    _inLoop = false;
+                    _index = _loopEnd;
+                    loopEnd = true;
+                }
+            }
+
+            b.index = _index;
+            b.standard = false;
+            b.dataSize = 0;
+            b.pause = 0;
+            b.level = 0;
+            b.t = tTapeTimings();
+
+            if (loopEnd)
+            {
+                b.id = 0x25;
+                b.kind = STREAM_BLOCK_SKIP;
+            }
+            else if (!(_tzx ? nextTZX(b) : nextTAP(b)))
+            {
+                return false;
+            }
+
+            _left = b.dataSize;
+            _index++;
+            return true;
+        }
+
+        // Datos del bloque en curso. Devuelve menos de "len" si se acaban antes
+        size_t data(uint8_t* out, size_t len)
+        {
+            if (len > _left)
+            {
+                len = _left;
+            }
+            size_t n = get(out, len);
+            _left -= n;
+            if (n < len)
+            {
+                _error = true;
+            }
+            return n;
+        }
+
+        bool error()
+        {
+            return _error;
+        }
+
+        // ID del bloque con sonido que no se puede reproducir en orden y que paró la lectura
+        // (saltos, llamadas, DR, CSW... o 0x24 si el bucle no cabe), 0 si ninguno. next()
+        // devolvió false y el bloque que le pasó lleva su índice.
+        uint8_t unsupported()
+        {
+            return _unsupported;
+        }
+};
+
+#ifdef ARDUINO
+
+tStreamStats streamStats;
+
+// Un envío cada vez. Lo abre la petición web y lo reproduce la tarea del reproductor.
+// El anillo se libera cuando han terminado los dos.
+class StreamTape
+{
+    private:
+
+        uint8_t* _buf = nullptr;
+        int _users = 0;
+        bool _waiting = false;
+        String _name;
+        std::mutex _mtx;
+
+        void release()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_users > 0 && --_users == 0)
+            {
+                blockPool.release(_buf);
+                _buf = nullptr;
+            }
+        }
+
+    public:
+
+        StreamRing ring;
+        // Solo desde la tarea de la red
+        StreamCredit credit;
+
+        // Desde la web. false si ya hay otro envío o no hay memoria
+        bool open(const String& name)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_users > 0)
+            {
+                return false;
+            }
+
+            _buf = (uint8_t*)blockPool.alloc(STREAM_RING_BYTES);
+            if (_buf == nullptr)
+            {
+                return false;
+            }
+
+            ring.attach(_buf, STREAM_RING_BYTES);
+            credit.reset(STREAM_TCP_WINDOW);
+            _name = name;
+            _users = 2;
+            _waiting = true;
+            streamStats.streams++;
+            return true;
+        }
+
+        // Desde la web. No llegan más datos
+        void producerDone(bool complete)
+        {
+            ring.close(complete);
+            release();
+        }
+
+        // ¿Hay un envío esperando al reproductor?
+        bool waiting()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _waiting;
+        }
+
+        // Desde el reproductor. Devuelve el nombre de la cinta
+        String take()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _waiting = false;
+            return _name;
+        }
+
+        // Desde el reproductor. Lo que siga llegando se descarta
+        void consumerDone()
+        {
+            ring.abort();
+            release();
+        }
+};
+
+StreamTape streamTape;
+
+// Espera de datos en la tarea del reproductor: aplica STOP/EJECT y publica el estado
+bool streamKeepWaiting()
+{
+    if (transport.cancelRequested() != TCMD_NONE)
+    {
+        transportServiceCancels();
+    }
+    tapeStatus.publishIfDue();
+    return !STOP && !EJECT;
+}
+
+struct tStreamSource
+{
+    size_t read(uint8_t* out, size_t len)
+    {
+        return streamTape.ring.read(out, len, streamKeepWaiting);
+    }
+};
+
+// Datos de un bloque en particiones de SIZE_FOR_SPLIT, como TAPprocessor y TZXprocessor.
+// preview = mandar la pantalla de carga al HMI
+template <class S>
+void streamPlayData(StreamTapeParser<S> &parser, const tStreamBlock &b, uint8_t* buf, bool preview)
+{
+    uint32_t left = b.dataSize;
+    bool first = true;
+    int pilotLen = b.standard ? DPILOT_LEN : b.t.pilotLen;
+    int pilotPulses = b.t.pilotPulses;
+
+    PROGRESS_BAR_BLOCK_VALUE = 0;
+    TOTAL_PARTS = b.dataSize / SIZE_FOR_SPLIT;
+    // sendDataArray() divide por estos dos
+    BYTES_TOBE_LOAD = b.dataSize;
+    BYTES_IN_THIS_BLOCK = b.dataSize;
+
+    while (left > 0 && LOADING_STATE == 1)
+    {
+        uint32_t n = left > SIZE_FOR_SPLIT ? SIZE_FOR_SPLIT : left;
+        BYTES_INI = b.dataSize - left;
+        uint32_t got = parser.data(buf, n);
+        if (got == 0)
+        {
+            break;
+        }
+
+        // Si se corta el envío, lo recibido va como última parte
+        left = (got < n) ? 0 : left - got;
+        bool last = (left == 0);
+        BYTES_LOADED += got;
+
+        if (first && b.standard)
+        {
+            // Cabecera o datos según el flag
+            pilotPulses = buf[0] < 128 ? DPULSES_HEADER : DPULSES_DATA;
+        }
+
+        if (preview && first && got == 6914)
+        {
+            // Pantalla de carga (flag + 6912 bytes + checksum)
+            screenPreview.submit(PROGRAM_NAME, b.index, buf + 1);
+        }
+
+        if (b.kind == STREAM_BLOCK_PURE_DATA)
+        {
+            if (last)
+            {
+                zxp.playPureData(buf, got);
+            }
+            else
+            {
+                zxp.playDataPartition(buf, got);
+            }
+        }
+        else if (first && last)
+        {
+            zxp.playData(buf, got, pilotLen, pilotPulses);
+        }
+        else if (first)
+        {
+            zxp.playDataBegin(buf, got, pilotLen, pilotPulses);
+        }
+        else if (last)
+        {
+            zxp.playDataEnd(buf, got);
+        }
+        else
+        {
+            zxp.playDataPartition(buf, got);
+        }
+
+        first = false;
+        PARTITION_BLOCK++;
+        PROGRESS_BAR_BLOCK_VALUE = (int)((uint64_t)(b.dataSize - left) * 100 / b.dataSize);
+    }
+}
+
+// Genera el sonido de un bloque con zxp. También lo usa la exportación a WAV/CSW
+template <class S>
+void streamRenderBlock(StreamTapeParser<S> &parser, const tStreamBlock &b, uint8_t* buf, bool preview)
+{
+    if (b.standard)
+    {
+        zxp.SYNC1 = DSYNC1;
+        zxp.SYNC2 = DSYNC2;
+        zxp.BIT_0 = DBIT_0;
+        zxp.BIT_1 = DBIT_1;
+    }
+    else
+    {
+        zxp.SYNC1 = b.t.sync1;
+        zxp.SYNC2 = b.t.sync2;
+        zxp.BIT_0 = b.t.bit0;
+        zxp.BIT_1 = b.t.bit1;
+    }
+    zxp.set_maskLastByte(b.t.usedBits);
+    zxp.silent = parser.isTZX() ? b.pause : DSILENT;
+
+    switch (b.kind)
+    {
+        case STREAM_BLOCK_DATA:
+        case STREAM_BLOCK_PURE_DATA:
+            LAST_SIZE = b.dataSize;
+            streamPlayData(parser, b, buf, preview);
+            break;
+
+        case STREAM_BLOCK_TONE:
+            zxp.playPureTone(b.t.toneLen, b.t.tonePulses);
+            break;
+
+        case STREAM_BLOCK_PULSES:
+        {
+            static int pulses[255];
+            for (int n = 0; n < b.t.numPulses; n++)
+            {
+                pulses[n] = b.pulses[n];
+            }
+            zxp.playCustomSequence(pulses, b.t.numPulses);
+            break;
+        }
+
+        case STREAM_BLOCK_PAUSE:
+            if (b.pause > 0)
+            {
+                zxp.silence(b.pause);
+            }
+            break;
+
+        case STREAM_BLOCK_LEVEL:
+            // Nivel del que parte el siguiente pulso, como en TZXprocessor
+            LAST_EAR_IS = b.level == 1 ? up : down;
+            break;
+    }
+}
+
+// Tiempos por defecto para la siguiente cinta
+void streamRestoreTimings()
+{
+    zxp.SYNC1 = DSYNC1;
+    zxp.SYNC2 = DSYNC2;
+    zxp.BIT_0 = DBIT_0;
+    zxp.BIT_1 = DBIT_1;
+    zxp.set_maskLastByte(8);
+    zxp.silent = DSILENT;
+}
+
+// Reproduce el envío pendiente según va llegando. Solo desde la tarea del reproductor
+void streamPlay()
+{
+    static tStreamBlock b;
+
+    String name = streamTape.take();
+    uint8_t* buf = (uint8_t*)blockPool.alloc(SIZE_FOR_SPLIT);
+    uint8_t* loop = (uint8_t*)blockPool.alloc(STREAM_LOOP_BYTES);
+    tStreamSource src;
+    StreamTapeParser<tStreamSource> parser(src);
+    parser.setLoopBuffer(loop, STREAM_LOOP_BYTES);
+
+    PROGRAM_NAME = name;
+    LAST_MESSAGE = "Receiving tape.";
+    TOTAL_BLOCKS = 0;
+    BLOCK_SELECTED = 0;
+    BYTES_LOADED = 0;
+
+    // Sin tabla de saltos: la cinta no está en ningún sitio al que volver
+    tapeSeek.clear();
+
+    // Precarga para que la red no se quede atrás en el primer bloque
+    bool ok = buf != nullptr && loop != nullptr
+              && streamTape.ring.waitFor(streamTape.ring.capacity() / 2, streamKeepWaiting)
+              && parser.begin();
+
+    if (ok)
+    {
+        TYPE_FILE_LOAD = parser.isTZX() ? "TZX" : "TAP";
+        LAST_MESSAGE = "Loading in progress. Please wait.";
+        logln("Streaming " + TYPE_FILE_LOAD + " - " + name);
+    }
+
+    while (ok && LOADING_STATE == 1 && parser.next(b))
+    {
+        CURRENT_BLOCK_IN_PROGRESS = b.index;
+        BLOCK_SELECTED = b.index;
+        TOTAL_BLOCKS = b.index + 1;
+        PARTITION_BLOCK = 0;
+        TOTAL_PARTS = 0;
+        streamStats.blocks++;
+
+        streamRenderBlock(parser, b, buf, true);
+
+        // Los saltos pedidos durante el envío no se pueden hacer
+        int target;
+        int pass;
+        tapeSeek.take(target, pass);
+
+        if (LOADING_STATE == 3)
+        {
+            // PAUSE entre bloques. La red sigue llenando el anillo hasta que se cierra la ventana
+            LAST_MESSAGE = "Stream paused. Press PLAY to continue.";
+            while (PAUSE && !STOP && !EJECT)
+            {
+                transportService();
+                tapeStatus.publishIfDue();
+                delay(STREAM_WAIT_MS);
+            }
+            if (PLAY)
+            {
+                LOADING_STATE = 1;
+                LAST_MESSAGE = "Loading in progress. Please wait.";
+            }
+        }
+    }
+
+    bool truncated = parser.error() || streamTape.ring.truncated();
+    uint8_t unsupported = parser.unsupported();
+    if (unsupported != 0)
+    {
+        streamStats.unsupported++;
+    }
+    streamStats.underruns += streamTape.ring.underruns();
+    if (truncated)
+    {
+        streamStats.truncated++;
+    }
+
+    if (STOP || EJECT)
+    {
+        LAST_MESSAGE = "Stream stopped.";
+    }
+    else if (unsupported != 0)
+    {
+        // Nada de ese bloque ha sonado: parar es mejor que seguir con la cinta mal
+        char msg[64];
+        snprintf(msg, sizeof(msg), "Stream stopped. Block %d (ID 0x%02X) can't be streamed.", b.index, unsupported);
+        LAST_MESSAGE = msg;
+    }
+    else if (!ok || truncated)
+    {
+        LAST_MESSAGE = "Stream incomplete.";
+    }
+    else
+    {
+        LAST_MESSAGE = "Stream played.";
+    }
+    logln(LAST_MESSAGE);
+
+    streamTape.consumerDone();
+    blockPool.release(buf);
+    blockPool.release(loop);
+    streamRestoreTimings();
+}
+
+#endif
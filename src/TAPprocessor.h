@@ -79,7 +79,7 @@ class TAPprocessor
             if (tapFileName != 0)
             {
                 // La cabecera son 19 bytes
-                uint8_t* bBlock = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                uint8_t* bBlock = (uint8_t*)blockPool.alloc(19+1);
                 sdm.readFileRange32(tapFileName,bBlock,0,19,true);
 
                 // Obtenemos la firma del TAP
@@ -105,7 +105,7 @@ class TAPprocessor
                 }
 
                 // Liberamos memoria
-                free(bBlock);
+                blockPool.release(bBlock);
             }
             else
             { 
@@ -123,11 +123,11 @@ class TAPprocessor
         {
             bool rtn = false;
             // char* szName = new char[254 + 1];
-            char* szName = (char*)ps_calloc(254+1,sizeof(char));
+            char* szName = (char*)blockPool.alloc(254+1);
             tapFileName.getName(szName,254);
             String fileName = static_cast<String>(szName);
             // delete szName;
-            free(szName);
+            blockPool.release(szName);
 
             if (fileName != "")
             {
@@ -456,10 +456,10 @@ class TAPprocessor
 
                     // Almacenamos el nombre
                     //getBlockName(tB.name,sdm.readFileRange32(_mFile,startBlock,19,false),0);
-                    uint8_t* ptr = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                    uint8_t* ptr = (uint8_t*)blockPool.alloc(19+1);
                     sdm.readFileRange32(_mFile,ptr,startBlock,19,false);
                     strncpy(tB.name,getBlockName(tB.name,ptr,0),10);
-                    free(ptr);
+                    blockPool.release(ptr);
 
                     //Cogemos el nombre del TAP de la primera cabecera
                     if (startBlock < 23)
@@ -475,10 +475,10 @@ class TAPprocessor
                 {
                     // Array num header
                     // Almacenamos el nombre
-                    uint8_t* ptr = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                    uint8_t* ptr = (uint8_t*)blockPool.alloc(19+1);
                     sdm.readFileRange32(_mFile,ptr,startBlock,19,false);
                     strncpy(tB.name,getBlockName(tB.name,ptr,0),10);
-                    free(ptr);
+                    blockPool.release(ptr);
                     tB.type = HARRAYNUM;    
 
                 }
@@ -486,10 +486,10 @@ class TAPprocessor
                 {
                     // Array char header
                     // Almacenamos el nombre
-                    uint8_t* ptr = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                    uint8_t* ptr = (uint8_t*)blockPool.alloc(19+1);
                     sdm.readFileRange32(_mFile,ptr,startBlock,19,false);
                     strncpy(tB.name,getBlockName(tB.name,ptr,0),10);
-                    free(ptr);
+                    blockPool.release(ptr);
                     tB.type = HARRAYCHR;    
 
                 }
@@ -503,19 +503,19 @@ class TAPprocessor
                     blockNameDetected = true;
                     
                     // Almacenamos el nombre
-                    uint8_t* ptr = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                    uint8_t* ptr = (uint8_t*)blockPool.alloc(19+1);
                     sdm.readFileRange32(_mFile,ptr,startBlock,19,false);
                     strncpy(tB.name,getBlockName(tB.name,ptr,0),10);
-                    free(ptr);
+                    blockPool.release(ptr);
 
-                    uint8_t* ptr1= (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
-                    uint8_t* ptr2 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+                    uint8_t* ptr1= (uint8_t*)blockPool.alloc(1+1);
+                    uint8_t* ptr2 = (uint8_t*)blockPool.alloc(1+1);
 
                     sdm.readFileRange32(_mFile,ptr1,startBlock+sizeB+1,1,false);
                     sdm.readFileRange32(_mFile,ptr2,startBlock+sizeB,1,false);
                     int tmpSizeBlock = (256*ptr1[0]) + ptr2[0];
-                    free(ptr1);
-                    free(ptr2);
+                    blockPool.release(ptr1);
+                    blockPool.release(ptr2);
 
                     if (tmpSizeBlock == 6914)
                     {
@@ -602,13 +602,13 @@ class TAPprocessor
             
             // La primera cabecera SIEMPRE debe darse.
             // Los dos primeros bytes son el tamaño a contar
-            ptr1 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
-            ptr2 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+            ptr1 = (uint8_t*)blockPool.alloc(1+1);
+            ptr2 = (uint8_t*)blockPool.alloc(1+1);
             sdm.readFileRange32(_mFile,ptr1,startBlock+1,1,false);
             sdm.readFileRange32(_mFile,ptr2,startBlock,1,false);
             sizeB = (256*ptr1[0]) + ptr2[0];
-            free(ptr1);
-            free(ptr2);            
+            blockPool.release(ptr1);
+            blockPool.release(ptr2);            
 
             startBlock = 2;
 
@@ -619,18 +619,18 @@ class TAPprocessor
                 blockNameDetected = false;
                 
                 // Cogemos el bloque completo, para poder calcular su checksum
-                ptr = (uint8_t*)ps_calloc(sizeB,sizeof(uint8_t));
+                ptr = (uint8_t*)blockPool.alloc(sizeB);
                 sdm.readFileRange32(_mFile,ptr,startBlock,sizeB-1,false);
                 // Calculamos el checksum
                 chk = calculateChecksum(ptr,0,sizeB-1);
                 // Liberamos
-                free(ptr);
+                blockPool.release(ptr);
                 
                 // Obtenemos el valor de checksum de la cabecera del bloque
-                ptr = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+                ptr = (uint8_t*)blockPool.alloc(1+1);
                 sdm.readFileRange32(_mFile,ptr,startBlock+sizeB-1,1,false); 
                 blockChk =ptr[0];         
-                free(ptr);
+                blockPool.release(ptr);
 
                 // Comparamos para asegurarnos que el bloque es correcto
                 if (blockChk == chk)
@@ -648,20 +648,20 @@ class TAPprocessor
                     // Flagbyte
                     // 0x00 - HEADER
                     // 0xFF - DATA BLOCK
-                    ptr = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+                    ptr = (uint8_t*)blockPool.alloc(1+1);
                     sdm.readFileRange32(_mFile,ptr,startBlock,1,false);
                     int flagByte = ptr[0];
-                    free(ptr);
+                    blockPool.release(ptr);
 
                     // Typeblock
                     // 0x00 - PROGRAM
                     // 0x01 - ARRAY NUM
                     // 0x02 - ARRAY CHAR
                     // 0x03 - CODE FILE
-                    ptr = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+                    ptr = (uint8_t*)blockPool.alloc(1+1);
                     sdm.readFileRange32(_mFile,ptr,startBlock+1,1,false);
                     int typeBlock = ptr[0];
-                    free(ptr);
+                    blockPool.release(ptr);
                     
                     // Vemos si el bloque es una cabecera o un bloque de datos (bien BASIC o CM)
                     blockNameDetected = getInformationOfHead(_myTAP.descriptor[numBlocks],flagByte,typeBlock,startBlock,sizeB,nameTAP);
@@ -682,13 +682,13 @@ class TAPprocessor
                     // Direcion de inicio (offset)
                     startBlock = startBlock + sizeB;
                     // Tamaño
-                    ptr1 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
-                    ptr2 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+                    ptr1 = (uint8_t*)blockPool.alloc(1+1);
+                    ptr2 = (uint8_t*)blockPool.alloc(1+1);
                     sdm.readFileRange32(_mFile,ptr1,startBlock+1,1,false);
                     sdm.readFileRange32(_mFile,ptr2,startBlock,1,false);
                     newSizeB = (256*ptr1[0]) + ptr2[0];
-                    free(ptr1);
-                    free(ptr2);  
+                    blockPool.release(ptr1);
+                    blockPool.release(ptr2);  
                     // Pasamos al siguiente bloque
                     numBlocks++;
                     // Ahora el tamaño es el nuevo tamaño calculado
@@ -1103,71 +1103,11 @@ class TAPprocessor
             }
         }
 
-    void paintPixel(uint8_t px, int posX, int posY)
-    {
-        String strTx = "";
-        // Vamos a ir pintando la pantalla
-        for (int p;p<8;p++)
-        {
-            int pOn = bitRead(px, 7-p);
-            if (pOn==1)
-            {
-                strTx += "fill " + String((int)(posX)) + "," + String((int)(posY)) + ",1,1," + String(65535);
-                _hmi.writeString(strTx);
-            }
-            posX++;
-        }
-
-
-    }
     void paintLoadingScreen(uint8_t* data)
     {
-        // Variables para generar la pantalla de carga
-        // pos inicial del cuadro para screen
-        double posXScrOri = 335;
-        double posYScrOri = 100;
-        double posXScr = .0;
-        double posYScr = .0;
-        double pxScale = 1;
-        // color del pixel
-        int colorPx = 65535; 
-        int dataR = 0;
-        int posRow = 0;
-        int posLineInRow = 0;
-        int scanArea=0;
-
-        for (int i=0;i<6914;i++)
-        {
-            dataR = data[i];
-
-            if (i < 6144)
-            {
-                if(posXScr>255)
-                {
-                    posXScr=0;
-                    posRow+=8;
-
-                    if(posRow>(64*(scanArea+1)))
-                    {
-                        posRow=(64*scanArea);
-                        posLineInRow++;
-
-                        if(posLineInRow>8)
-                        {
-                            scanArea++;
-                            posLineInRow=0;
-                            posRow=(64*scanArea);
-                        }
-                    }
-                }
-
-               posYScr=(posRow+posLineInRow);
-               paintPixel(data[i],posXScrOri+posXScr,posYScrOri+posYScr);
-               posXScr++;                
-            }
-
-        }
-        // En el caso de pantalla de carga
+        // data es el bloque completo (flag + 6912 bytes + checksum).
+        // La conversión y el envío a la pantalla los hace ScreenPreview.h
+        screenPreview.submit(PATH_FILE_TO_LOAD, BLOCK_SELECTED, data + 1);
     }
 
     void showBufferPlay(byte* buffer, int size, int offset)
@@ -1237,6 +1177,59 @@ class TAPprocessor
 
 
 
+        // Rango del fichero que se lee para la parte "part" del bloque i.
+        // Los bloques de datos mayores que SIZE_FOR_SPLIT se leen en particiones,
+        // siendo la última (part == blocks) la del resto.
+        bool getPlayRange(int i, int part, uint32_t &offset, int &size)
+        {
+            if (i < 0 || i >= _myTAP.numBlocks)
+            {
+                return false;
+            }
+
+            tTAPBlockDescriptor &d = _myTAP.descriptor[i];
+            bool splitted = (d.type != 0 && d.type != 1 && d.type != 7 && d.size > SIZE_FOR_SPLIT);
+
+            if (!splitted)
+            {
+                if (part != 0)
+                {
+                    return false;
+                }
+                offset = d.offset;
+                size = d.size;
+                return true;
+            }
+
+            int blocks = d.size / SIZE_FOR_SPLIT;
+            if (part > blocks)
+            {
+                return false;
+            }
+
+            offset = d.offset + (SIZE_FOR_SPLIT * part);
+            size = (part < blocks) ? SIZE_FOR_SPLIT : d.size - (blocks * SIZE_FOR_SPLIT);
+            return true;
+        }
+
+        // Devuelve los datos de la parte "part" del bloque i y deja leyendo
+        // en segundo plano lo siguiente que se va a reproducir.
+        uint8_t* getPlayBuffer(int i, int part)
+        {
+            uint32_t offset = 0;
+            int size = 0;
+            getPlayRange(i, part, offset, size);
+
+            uint8_t* buffer = prefetcher.get(_mFile, offset, size);
+
+            if (getPlayRange(i, part + 1, offset, size) || getPlayRange(i + 1, 0, offset, size))
+            {
+                prefetcher.prefetch(_mFile, offset, size);
+            }
+
+            return buffer;
+        }
+
         void play() 
         {
 
@@ -1258,6 +1251,50 @@ class TAPprocessor
                     BYTES_TOBE_LOAD = _rlen;
                     BYTES_LOADED = 0;
 
+                    // Lectura anticipada de bloques
+                    prefetcher.begin();
+
+                    // Caché de pulsos. Si la cinta ya está guardada se reproduce desde ahí
+                    // y se salta la generación de los bloques.
+                    if (pulseCache.begin(PATH_FILE_TO_LOAD, m, _myTAP.numBlocks, true) == PLS_REPLAY)
+                    {
+                        int from = m;
+                        int pass = 0;
+                        m = _myTAP.numBlocks;
+
+                        while (!pulseCache.replay(from,
+                            [&](int amp, uint32_t samples) { return _zxp.playCachedRun(amp, samples); },
+                            [&](int i)
+                            {
+                                strncpy(LAST_NAME,_myTAP.descriptor[i].name,sizeof(_myTAP.descriptor[i].name));
+                                LAST_SIZE = _myTAP.descriptor[i].size;
+                                BYTES_IN_THIS_BLOCK = _myTAP.descriptor[i].size;
+
+                                CURRENT_BLOCK_IN_PROGRESS = i;
+                                BLOCK_SELECTED = i;
+
+                                _hmi.writeString("currentBlock.val=" + String(i + 1));
+                                _hmi.writeString("progression.val=" + String(0));
+
+                                showInfoBlockInProgress(_myTAP.descriptor[i].type);
+                                _hmi.setBasicFileInformation(0,0,_myTAP.descriptor[i].name,_myTAP.descriptor[i].typeName,_myTAP.descriptor[i].size,true);
+                            }))
+                        {
+                            // Salto durante la reproducción. Se sigue desde la caché si el bloque
+                            // está en ella y si no, generándolo.
+                            if (!tapeSeek.take(from, pass))
+                            {
+                                break;
+                            }
+
+                            if (!pulseCache.hasBlock(from))
+                            {
+                                m = from;
+                                break;
+                            }
+                        }
+                    }
+
                     #ifdef DEBUGMODE
                         logln("");
                         log("File size: " + String(BYTES_TOBE_LOAD));
@@ -1318,6 +1355,8 @@ class TAPprocessor
                                 log("LOADING_STATE 2");                           
                             #endif
 
+                            prefetcher.end();
+                            pulseCache.end(false);
                             return;
                         }
                         else if (LOADING_STATE == 3)
@@ -1333,6 +1372,8 @@ class TAPprocessor
                                 log("LOADING_STATE 3"); 
                             #endif
 
+                            prefetcher.end();
+                            pulseCache.end(false);
                             return; 
                         }
                         else
@@ -1345,6 +1386,9 @@ class TAPprocessor
                             CURRENT_BLOCK_IN_PROGRESS = i;
                             BLOCK_SELECTED = i;
 
+                            // Marca de bloque en la caché de pulsos (si se está guardando)
+                            pulseCache.mark(i);
+
                             _hmi.writeString("currentBlock.val=" + String(i + 1));
                             _hmi.writeString("progression.val=" + String(0));
                         }
@@ -1366,29 +1410,21 @@ class TAPprocessor
                         if (_myTAP.descriptor[i].type == 0) 
                         {
 
-                            // Reservamos memoria para el buffer de reproducción
-                            bufferPlay = (uint8_t*)(ps_calloc(_myTAP.descriptor[i].size, sizeof(uint8_t)));
-                            sdm.readFileRange32(_mFile,bufferPlay, _myTAP.descriptor[i].offset, _myTAP.descriptor[i].size, false);
+                            // Buffer de reproducción (leído por adelantado)
+                            bufferPlay = getPlayBuffer(i, 0);
 
                             // *** Cabecera PROGRAM
                             // Llamamos a la clase de reproducción
                             _zxp.playData(bufferPlay, _myTAP.descriptor[i].size,DPILOT_LEN,DPULSES_HEADER);
-
-                            // Liberamos el buffer de reproducción
-                            free(bufferPlay);
                         } 
                         else if (_myTAP.descriptor[i].type == 1 || _myTAP.descriptor[i].type == 7) 
                         {
                             
-                            bufferPlay = (uint8_t*)(ps_calloc(_myTAP.descriptor[i].size, sizeof(uint8_t)));
-                            sdm.readFileRange32(_mFile,bufferPlay, _myTAP.descriptor[i].offset, _myTAP.descriptor[i].size, false);
+                            bufferPlay = getPlayBuffer(i, 0);
 
                             // *** Cabecera BYTE
                             // Llamamos a la clase de reproducción
                             _zxp.playData(bufferPlay, _myTAP.descriptor[i].size,DPILOT_LEN,DPULSES_HEADER);
-
-                            // Liberamos el buffer de reproducción
-                            free(bufferPlay);
                         } 
                         else 
                         {
@@ -1419,6 +1455,12 @@ class TAPprocessor
                                 // Recorremos el vector de particiones del bloque.
                                 for (int n=0;n < blocks;n++)
                                 {
+                                    if (tapeSeek.pending())
+                                    {
+                                        // Salto a otro bloque. No se leen más particiones.
+                                        break;
+                                    }
+
                                     PARTITION_BLOCK = n;
                                     //log("Particion [" + String(n) + "/" + String(blocks) +  "]");
 
@@ -1426,10 +1468,8 @@ class TAPprocessor
                                     newOffset = offsetBase + (blockSizeSplit*n);
                                     BYTES_INI = newOffset;
 
-                                    // Accedemos a la SD y capturamos el bloque del fichero
-                                    // Reservamos memoria
-                                    bufferPlay = (uint8_t*)ps_calloc(blockSizeSplit, sizeof(uint8_t));
-                                    sdm.readFileRange32(_mFile,bufferPlay, newOffset, blockSizeSplit, true);  
+                                    // Capturamos la partición (leída por adelantado)
+                                    bufferPlay = getPlayBuffer(i, n);
                                     
                                     #ifdef DEBUGMODE
                                         showBufferPlay(bufferPlay,blockSizeSplit,newOffset);
@@ -1446,56 +1486,66 @@ class TAPprocessor
                                         // Bloque partido. Particiones
                                         _zxp.playDataPartition(bufferPlay, blockSizeSplit);                                      
                                     }
-                                    free(bufferPlay);
                                 }
 
                                 // Ultimo bloque
                                 //
-                                
-                                // Calculamos el offset del último bloque
-                                newOffset = offsetBase + (blockSizeSplit*blocks);
-                                BYTES_INI = newOffset;
-
-                                blockSizeSplit = lastBlockSize;
+                                if (!tapeSeek.pending())
+                                {
+                                    // Calculamos el offset del último bloque
+                                    newOffset = offsetBase + (blockSizeSplit*blocks);
+                                    BYTES_INI = newOffset;
 
-                                // Accedemos a la SD y capturamos el bloque del fichero
-                                bufferPlay = (uint8_t*)ps_calloc(blockSizeSplit, sizeof(uint8_t));
-                                sdm.readFileRange32(_mFile,bufferPlay, newOffset, blockSizeSplit, true);   
-                                
-                                #ifdef DEBUGMODE
-                                    showBufferPlay(bufferPlay,blockSizeSplit,newOffset); 
-                                #endif
-                                
-                                // Reproducimos el ultimo bloque con su terminador y silencio si aplica
-                                _zxp.playDataEnd(bufferPlay, blockSizeSplit);                                    
+                                    blockSizeSplit = lastBlockSize;
 
-                                free(bufferPlay); 
+                                    // Capturamos la última partición (leída por adelantado)
+                                    bufferPlay = getPlayBuffer(i, blocks);
+                                    
+                                    #ifdef DEBUGMODE
+                                        showBufferPlay(bufferPlay,blockSizeSplit,newOffset); 
+                                    #endif
+                                    
+                                    // Reproducimos el ultimo bloque con su terminador y silencio si aplica
+                                    _zxp.playDataEnd(bufferPlay, blockSizeSplit);                                    
+                                }
 
                             } 
                             else 
                             {
                                 // En el caso de NO USAR SPLIT o el bloque es menor de "SIZE_FOR_SPLIT"
                                 //
-                                bufferPlay = (uint8_t*)(ps_calloc((_myTAP.descriptor[i].size), sizeof(uint8_t)));
-                                sdm.readFileRange32(_mFile,bufferPlay,_myTAP.descriptor[i].offset, _myTAP.descriptor[i].size, false);
+                                bufferPlay = getPlayBuffer(i, 0);
                                 
-                                // if (_myTAP.descriptor[i].size==6914)
-                                // {
-                                //     // Es una pantalla de carga
-                                //     paintLoadingScreen(bufferPlay);
-                                // }
+                                if (_myTAP.descriptor[i].size==6914)
+                                {
+                                    // Es una pantalla de carga
+                                    paintLoadingScreen(bufferPlay);
+                                }
 
                                 // Reproducimos el bloque de datos
                                 _zxp.playData(bufferPlay, _myTAP.descriptor[i].size,DPILOT_LEN,DPULSES_DATA);
-
-                                // Liberamos el buffer de reproducción
-                                free(bufferPlay);
                             }
                         }
 
                         BLOCK_PLAYED = true;
+
+                        // Salto pedido durante la reproducción. Se continúa en el bloque pedido.
+                        int target;
+                        int pass;
+                        if (tapeSeek.take(target, pass))
+                        {
+                            // La caché ya no sería la cinta lineal
+                            pulseCache.end(false);
+                            // El for lo incrementa
+                            i = target - 1;
+                        }
                     }
 
+                    prefetcher.end();
+
+                    // Se guarda la caché si se ha reproducido entera
+                    pulseCache.end(LOADING_STATE == 1);
+
                     // //SerialHW.println("");
                     // //SerialHW.println("Playing was finish.");
 
@@ -69,6 +69,12 @@ class TAPrecorder
       const int BUFFER_SIZE_REC = 256; //256 (09/07/2024)
       uint8_t* bufferRec = nullptr;
 
+      // Bytes grabados que aún no están en la SD. Se escriben de una vez con sdsched.write
+      // en lugar de coger el bus por cada byte.
+      static const size_t REC_WRITE_BUFFER = 512;
+      uint8_t _wbuf[REC_WRITE_BUFFER];
+      size_t _wlen = 0;
+
       // Test Line in/out
       // const int BUFFER_SIZE_IN_OUT = 1024;
       // uint8_t bufferIn[1024];
@@ -139,8 +145,8 @@ class TAPrecorder
 
 
       // Umbral de histeresis para el filtro Schmitt al 10% de Vmax
-      const int defaultThH = 3000;
-      const int defaultThL = -3000;
+      const int defaultThH = REC_TH_HIGH;
+      const int defaultThL = REC_TH_LOW;
       int threshold_high = defaultThH; 
       int threshold_low = defaultThL; 
       int errorDetected = 0;
@@ -392,6 +398,7 @@ class TAPrecorder
             logln("");  
           #endif
 
+          SDioLock lock(SDIO_RECORDING);
           if (_mFile.rename(cPath))
           {         
             wasRenamed = true;
@@ -602,6 +609,46 @@ class TAPrecorder
         _measureSilence = 0;  //27102024
       }
 
+      // Escribe en la SD los bytes pendientes
+      bool flushBytes()
+      {
+        if (_wlen == 0)
+        {
+          return true;
+        }
+        size_t n = _wlen;
+        _wlen = 0;
+        return sdsched.write(_mFile, _wbuf, n, SDIO_RECORDING) == n;
+      }
+
+      void putByte(uint8_t value)
+      {
+        _wbuf[_wlen++] = value;
+        if (_wlen == REC_WRITE_BUFFER)
+        {
+          flushBytes();
+        }
+      }
+
+      // Posición en el fichero contando lo pendiente
+      int filePosition()
+      {
+        return _mFile.position() + _wlen;
+      }
+
+      // Reescribe el tamaño de un bloque ya grabado
+      void patchSize(int offset, uint8_t LSB, uint8_t MSB)
+      {
+        flushBytes();
+
+        SDioLock lock(SDIO_RECORDING);
+        int currentPtrOffset = _mFile.position();
+        _mFile.seek(offset);
+        _mFile.write(LSB);
+        _mFile.write(MSB);
+        _mFile.seek(currentPtrOffset);
+      }
+
       void prepareNewBlock()
       {
         //stateRecording = 0;
@@ -614,7 +661,7 @@ class TAPrecorder
 
         //guardamos la posición del puntero del fichero en este momento
         //que es justo al final del ultimo bloque + 1 (inicio del siguiente)
-        ptrOffset = _mFile.position();
+        ptrOffset = filePosition();
 
         // El nuevo bloque tiene que registrar su tamaño en el fichero .tap
         // depende si es HEAD or DATA
@@ -663,8 +710,8 @@ class TAPrecorder
         MSB = size2 >> 8;
 
         // // Antes del siguiente bloque metemos el size
-        _mFile.write(LSB);
-        _mFile.write(MSB);        
+        putByte(LSB);
+        putByte(MSB);
 
       }
 
@@ -801,14 +848,9 @@ class TAPrecorder
                   MSB = size >> 8;
 
                   // metemos el size
-                  int currentPtrOffset = _mFile.position();
-                                
-                  _mFile.seek(ptrOffset);
                   // Añadimos el tamaño del bloque capturado al principio
                   // de la cabecera.
-                  _mFile.write(LSB);
-                  _mFile.write(MSB); 
-                  _mFile.seek(currentPtrOffset);
+                  patchSize(ptrOffset, LSB, MSB);
                   //
                   showProgramName();
 
@@ -867,8 +909,8 @@ class TAPrecorder
                   byteRead = value;
                   uint8_t valueToBeWritten = byteRead;
                   
-                  // Escribimos en fichero el dato
-                  _mFile.write(valueToBeWritten);
+                  // Escribimos en fichero el dato (al buffer, va a la SD cada REC_WRITE_BUFFER bytes)
+                  putByte(valueToBeWritten);
 
                   // Guardamos el checksum generado
                   //lastChk = checksum;
@@ -1027,23 +1069,23 @@ class TAPrecorder
         int16_t *ptrOut = (int16_t*)bufferOut;
         int chn = 2;            
         
-        // Anchos de los semi-pulsos para 44.1KHz
+        // Anchos de los semi-pulsos para 44.1KHz (TapeDigitiser.h)
         // Tono guia
-        const int16_t wToneMin = 22;
-        const int16_t wToneMax = 40;
+        const int16_t wToneMin = REC_W_TONE_MIN;
+        const int16_t wToneMax = REC_W_TONE_MAX;
         // Silencio
-        const int16_t wSilence = 512;
+        const int16_t wSilence = REC_W_SILENCE;
         // SYNC 1
-        const int16_t wSync = 15;  //min value_default = 20
+        const int16_t wSync = REC_W_SYNC;  //min value_default = 20
         // Bit 0
-        const int16_t wBit0_1 = 2;  //min
-        const int16_t wBit0_2 = 15;  //max
+        const int16_t wBit0_1 = REC_W_BIT0_MIN;  //min
+        const int16_t wBit0_2 = REC_W_BIT0_MAX;  //max
         // Bit 1
-        const int16_t wBit1_1 = 15;    //17  02/11/2024
-        const int16_t wBit1_2 = 35;    //30  02/11/2024
+        const int16_t wBit1_1 = REC_W_BIT1_MIN;    //17  02/11/2024
+        const int16_t wBit1_2 = REC_W_BIT1_MAX;    //30  02/11/2024
         
         //Maximo numero de pulsos a leer antes de esperar una SYNC
-        const int maxPilotPulseCount = 256; 
+        const int maxPilotPulseCount = REC_PILOT_PULSES; 
 
 
         // Para modo debug.
@@ -1384,9 +1426,18 @@ class TAPrecorder
       {         
           size_t len = 0;
           len = _kit.read(bufferRec, BUFFER_SIZE_REC);    
+
+          // Osciloscopio (página SCOPE). Canal R del estéreo de 16 bits.
+          if (scope.active())
+          {
+              scope.samples((int16_t*)bufferRec, len / 4, 2);
+          }
           
           readBuffer(len);
 
+          // Estado para el HMI y la web
+          tapeStatus.publishIfDue();
+
           if (!stopRecordingProccess)
           {
               // No ha finalizado. Sigue grabando
@@ -1454,7 +1505,13 @@ class TAPrecorder
           String dirR = RECORDING_DIR + "/\0";
           recDir = strcpy(recDir, dirR.c_str());
           
-          if (!_sdf32.mkdir(RECORDING_DIR))
+          bool created;
+          {
+            SDioLock lock(SDIO_RECORDING);
+            created = _sdf32.mkdir(RECORDING_DIR);
+          }
+
+          if (!created)
           {
             #ifdef DEBUGMODE
               log("Error! Directory exists or wasn't created");
@@ -1503,6 +1560,9 @@ class TAPrecorder
 
       bool createTempTAPfile()
       {
+        _wlen = 0;
+        SDioLock lock(SDIO_RECORDING);
+
         // Abrimos el fichero en el directorio /REC
         if (!_mFile.open(recDir, O_WRITE | O_CREAT | O_TRUNC)) 
         {
@@ -1549,8 +1609,9 @@ class TAPrecorder
 
           for(int i=0;i<256;i++)
           {
-            _mFile.write(0x01);
+            putByte(0x01);
           }
+          flushBytes();
 
           // _mFile.close();
           // fileWasClosed = true;
@@ -1565,6 +1626,8 @@ class TAPrecorder
 
           if (_mFile.isOpen())
           {
+            flushBytes();
+
             // Lo renombramos con el nombre del BASIC
             renameFile();        
             delay(125);   
@@ -1572,13 +1635,7 @@ class TAPrecorder
             if (partially)
             {
                 // Finalmente se graba el contenido menos el bloque erroneo
-                int currentOffset = _mFile.position();
-                _mFile.seek(ptrOffset);
-                uint8_t MSB = 0;
-                uint8_t LSB = 0;                      
-                _mFile.write(LSB);
-                _mFile.write(MSB);
-                _mFile.seek(currentOffset);
+                patchSize(ptrOffset, 0, 0);
 
                 LAST_MESSAGE = "File partially saved.";
                 if (_mFile.size() < 1024)
@@ -1642,6 +1699,7 @@ class TAPrecorder
             {
                 //
                 // Se almacenó algo y hay bloques completos validados
+                flushBytes();
                 if (_mFile.size() !=0)
                 {
                     if (!partialSave)
@@ -1728,6 +1786,17 @@ class TAPrecorder
             delay(1500);            
         }
 
+        // Ruta final del fichero grabado, para el índice de directorios
+        String recorded = "";
+        if (wasRenamed && fileNameRename != nullptr)
+        {
+          recorded = RECORDING_DIR + "/" + String(fileNameRename);
+        }
+        else if (recDir != nullptr)
+        {
+          recorded = String(recDir);
+        }
+
         // Reseteamos variables
         wasRenamed = false;
         nameFileRead = false;
@@ -1746,12 +1815,37 @@ class TAPrecorder
           LAST_MESSAGE = "Closing file";
           delay(1500);
 
-          _mFile.close();
+          flushBytes();
+          {
+            SDioLock lock(SDIO_RECORDING);
+            _mFile.close();
+          }
           delay(125);
         }
         //
         fileWasClosed = true;
 
+        // La grabación aparece en los listados sin reescanear el directorio
+        if (recorded.length() > 0)
+        {
+          File32 rf;
+          bool found;
+          uint32_t size = 0;
+          {
+            SDioLock lock(SDIO_RECORDING);
+            found = rf.open(recorded.c_str(), O_RDONLY);
+            if (found)
+            {
+              size = rf.fileSize();
+              rf.close();
+            }
+          }
+          if (found)
+          {
+            dirIndex.addPath(recorded.c_str(), false, size);
+          }
+        }
+
         logln("2");
         if (fileNameRename != nullptr)
         {free(fileNameRename);}
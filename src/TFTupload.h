@@ -0,0 +1,432 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TFTupload.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Subida del firmware de la pantalla (.tft) con el protocolo v1.2 de Nextion (whmi-wris).
+
+      1. VERIFY   - Se lee el fichero entero antes de tocar la pantalla (CRC32 al log). Si la
+                    SD falla a medias no se deja la pantalla en modo descarga.
+      2. CONNECT  - "connect" hasta recibir "comok", a la velocidad actual y si no en las demás.
+      3. REQUEST  - "whmi-wris <tamaño>,<velocidad>,1". La pantalla cambia a esa velocidad y
+                    contesta 0x05.
+      4. SEND     - Trozos de 4096 bytes. Tras el primero la pantalla contesta 0x05 o 0x08 con
+                    el offset (32 bits) desde el que quiere seguir (subida anterior cortada).
+                    Después, un 0x05 por trozo.
+
+    Mientras se espera el 0x05 de un trozo, el siguiente ya se está leyendo de la SD
+    (BlockPrefetcher) y el que se envía sale por el buffer de TX de la UART, así que SD, UART
+    y escritura en la flash de la pantalla van solapadas.
+
+    Si se corta (no llega el 0x05) se vuelve a CONNECT/REQUEST y la pantalla indica con 0x08
+    dónde se quedó. El .tft solo se borra de la SD cuando la subida ha terminado, así que
+    un reinicio a medias también continúa en el siguiente arranque.
+
+    La máquina de estados va sobre un puerto y una fuente genéricos para poder probarla en el
+    host contra una pantalla simulada:
+      Puerto: setBaud, sendCmd(const char*) (con FF FF FF), write(buf, len), readByte(b, ms),
+              flushRx, drainTx, delayMs, nowUs
+      Fuente: size(), read(offset, buf, len) y scratch() (verificación),
+              get(offset, len) --> puntero a los datos y prefetch(offset, len) (envío)
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Velocidades que se prueban al conectar (HMI_LINK_BAUDS)
+#include "HMIlink.h"
+
+#define TFT_CHUNK 4096
+#define TFT_ACK 0x05
+#define TFT_RESUME 0x08
+// Reintentos si la pantalla deja de contestar a mitad
+#define TFT_RETRIES 3
+#define TFT_CONNECT_MS 400
+#define TFT_REQUEST_MS 1000
+// Escribir 4 KB en la flash de la pantalla puede tardar bastante
+#define TFT_ACK_MS 3000
+
+enum tTFTstate
+{
+    TFT_IDLE = 0,
+    TFT_VERIFY,
+    TFT_CONNECT,
+    TFT_REQUEST,
+    TFT_SEND,
+    TFT_DONE,
+    TFT_FAILED
+};
+
+struct tTFTreport
+{
+    tTFTstate state = TFT_IDLE;
+    uint32_t size = 0;
+    uint32_t crc = 0;
+    uint32_t sent = 0;          // Bytes confirmados por la pantalla
+    uint32_t resumedAt = 0;     // Offset indicado con 0x08 (0 = desde el principio)
+    uint32_t retries = 0;
+    uint32_t ms = 0;
+    const char* error = "";
+};
+
+static uint32_t tftCrc32(uint32_t crc, const uint8_t* data, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+template <class P, class S>
+class TFTuploadCore
+{
+    private:
+
+        P& _port;
+        S& _src;
+        uint32_t _uploadBaud;
+        uint32_t _linkBaud;
+        uint32_t _offset = 0;
+        bool _first = true;
+        tTFTreport _rep;
+
+        // Respuesta de texto terminada en FF FF FF
+        bool readReply(char* out, int max, uint32_t timeoutMs)
+        {
+            int n = 0;
+            int ff = 0;
+            uint8_t b;
+
+            while (_port.readByte(b, timeoutMs))
+            {
+                if (b == 0xFF)
+                {
+                    if (++ff == 3)
+                    {
+                        out[n] = 0;
+                        return true;
+                    }
+                    continue;
+                }
+                ff = 0;
+                if (n < max - 1)
+                {
+                    out[n++] = b;
+                }
+            }
+            out[n] = 0;
+            return false;
+        }
+
+        bool tryConnect(uint32_t baud)
+        {
+            static const uint8_t nul[4] = {0x00, 0xFF, 0xFF, 0xFF};
+            char reply[96];
+
+            _port.setBaud(baud);
+            _port.flushRx();
+            // Secuencia del editor de Nextion: comando inválido para vaciar su buffer y "connect"
+            _port.sendCmd("DRAKJHSUYDGBNCJHGJKSHBDN");
+            _port.write(nul, sizeof(nul));
+            _port.sendCmd("connect");
+
+            uint32_t t0 = _port.nowUs();
+            while (_port.nowUs() - t0 < TFT_CONNECT_MS * 1000u)
+            {
+                if (readReply(reply, sizeof(reply), TFT_CONNECT_MS) && strstr(reply, "comok") != nullptr)
+                {
+                    _linkBaud = baud;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        tTFTstate stepVerify()
+        {
+            uint32_t size = _src.size();
+            uint32_t crc = 0;
+            uint8_t* buf = _src.scratch();
+
+            if (size == 0 || buf == nullptr)
+            {
+                _rep.error = size == 0 ? "empty file" : "no memory";
+                return TFT_FAILED;
+            }
+
+            for (uint32_t off = 0; off < size; off += TFT_CHUNK)
+            {
+                uint32_t len = size - off < TFT_CHUNK ? size - off : TFT_CHUNK;
+                if (_src.read(off, buf, len) != (int)len)
+                {
+                    _rep.error = "read error";
+                    return TFT_FAILED;
+                }
+                crc = tftCrc32(crc, buf, len);
+            }
+
+            _rep.size = size;
+            _rep.crc = crc;
+            return TFT_CONNECT;
+        }
+
+        tTFTstate stepConnect()
+        {
+            if (tryConnect(_linkBaud))
+            {
+                return TFT_REQUEST;
+            }
+
+            for (uint32_t i = 0; i < HMI_LINK_NUM_BAUDS; i++)
+            {
+                if (HMI_LINK_BAUDS[i] != _linkBaud && tryConnect(HMI_LINK_BAUDS[i]))
+                {
+                    return TFT_REQUEST;
+                }
+            }
+
+            _rep.error = "no connect";
+            return TFT_FAILED;
+        }
+
+        tTFTstate stepRequest()
+        {
+            static const uint8_t nul[4] = {0x00, 0xFF, 0xFF, 0xFF};
+            char cmd[48];
+            uint8_t b;
+
+            _port.write(nul, sizeof(nul));
+            snprintf(cmd, sizeof(cmd), "whmi-wris %lu,%lu,1", (unsigned long)_rep.size, (unsigned long)_uploadBaud);
+            _port.sendCmd(cmd);
+            _port.drainTx();
+            _port.delayMs(50);
+            _port.setBaud(_uploadBaud);
+
+            while (_port.readByte(b, TFT_REQUEST_MS))
+            {
+                if (b == TFT_ACK)
+                {
+                    _first = true;
+                    _offset = 0;
+                    return TFT_SEND;
+                }
+            }
+
+            _rep.error = "no download ack";
+            return TFT_FAILED;
+        }
+
+        // Espera el 0x05 (o el 0x08 + offset tras el primer trozo)
+        bool waitAck(uint32_t &next)
+        {
+            uint8_t b;
+
+            while (_port.readByte(b, TFT_ACK_MS))
+            {
+                if (b == TFT_ACK)
+                {
+                    return true;
+                }
+
+                if (b == TFT_RESUME && _first)
+                {
+                    uint32_t off = 0;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        if (!_port.readByte(b, TFT_ACK_MS))
+                        {
+                            return false;
+                        }
+                        off |= (uint32_t)b << (8 * i);
+                    }
+
+                    if (off != 0 && off < _rep.size)
+                    {
+                        next = off;
+                        _rep.resumedAt = off;
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        tTFTstate stepSend()
+        {
+            uint32_t len = _rep.size - _offset < TFT_CHUNK ? _rep.size - _offset : TFT_CHUNK;
+            const uint8_t* data = _src.get(_offset, len);
+
+            if (data == nullptr)
+            {
+                _rep.error = "read error";
+                return TFT_FAILED;
+            }
+
+            _port.write(data, len);
+
+            // Se lee el siguiente mientras la pantalla graba este
+            uint32_t next = _offset + len;
+            if (next < _rep.size)
+            {
+                _src.prefetch(next, _rep.size - next < TFT_CHUNK ? _rep.size - next : TFT_CHUNK);
+            }
+
+            if (!waitAck(next))
+            {
+                if (_rep.retries++ < TFT_RETRIES)
+                {
+                    // La pantalla dirá con 0x08 dónde se quedó
+                    _port.delayMs(1000);
+                    return TFT_CONNECT;
+                }
+                _rep.error = "no chunk ack";
+                return TFT_FAILED;
+            }
+
+            _first = false;
+            _offset = next;
+            _rep.sent = _offset;
+
+            return _offset >= _rep.size ? TFT_DONE : TFT_SEND;
+        }
+
+    public:
+
+        TFTuploadCore(P& port, S& src, uint32_t linkBaud, uint32_t uploadBaud)
+            : _port(port), _src(src), _uploadBaud(uploadBaud), _linkBaud(linkBaud)
+        {
+        }
+
+        tTFTstate step()
+        {
+            switch (_rep.state)
+            {
+                case TFT_IDLE:      _rep.state = TFT_VERIFY; break;
+                case TFT_VERIFY:    _rep.state = stepVerify(); break;
+                case TFT_CONNECT:   _rep.state = stepConnect(); break;
+                case TFT_REQUEST:   _rep.state = stepRequest(); break;
+                case TFT_SEND:      _rep.state = stepSend(); break;
+                default:            break;
+            }
+            return _rep.state;
+        }
+
+        bool run()
+        {
+            uint32_t t0 = _port.nowUs();
+            while (step() != TFT_DONE && _rep.state != TFT_FAILED)
+            {
+            }
+            _rep.ms = (_port.nowUs() - t0) / 1000;
+            return _rep.state == TFT_DONE;
+        }
+
+        tTFTreport report()
+        {
+            return _rep;
+        }
+};
+
+#ifdef ARDUINO
+
+#ifndef TFT_UPLOAD_BAUD
+  #define TFT_UPLOAD_BAUD 921600
+#endif
+
+// Puerto: el de HMIlink más escritura en bruto de los trozos
+class TFTuploadSerial : public HMIlinkSerial
+{
+    public:
+
+        void sendCmd(const char* cmd)
+        {
+            const uint8_t end[3] = {0xff, 0xff, 0xff};
+            SerialHW.write((const uint8_t*)cmd, strlen(cmd));
+            SerialHW.write(end, 3);
+        }
+
+        void write(const uint8_t* data, uint32_t len)
+        {
+            SerialHW.write(data, len);
+        }
+};
+
+// Fuente: el .tft. La verificación lee de forma normal y el envío con doble buffer.
+class TFTfileSource
+{
+    private:
+        File32 &_f;
+        uint8_t* _scratch = nullptr;
+
+    public:
+        explicit TFTfileSource(File32 &f) : _f(f) {}
+
+        ~TFTfileSource()
+        {
+            prefetcher.cancel(_f);
+            blockPool.release(_scratch);
+        }
+
+        uint32_t size() { return _f.fileSize(); }
+
+        uint8_t* scratch()
+        {
+            if (_scratch == nullptr)
+            {
+                _scratch = (uint8_t*)blockPool.alloc(TFT_CHUNK);
+            }
+            return _scratch;
+        }
+
+        int read(uint32_t offset, uint8_t* buf, uint32_t len)
+        {
+            {
+                SDioLock lock(SDIO_PLAYBACK);
+                if (!_f.seekSet(offset))
+                {
+                    return 0;
+                }
+            }
+            return sdsched.read(_f, buf, len, SDIO_PLAYBACK);
+        }
+
+        const uint8_t* get(uint32_t offset, uint32_t len) { return prefetcher.get(_f, offset, len); }
+        void prefetch(uint32_t offset, uint32_t len) { prefetcher.prefetch(_f, offset, len); }
+};
+
+#endif
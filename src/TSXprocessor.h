@@ -64,6 +64,12 @@ class TSXprocessor
 
     bool stopOrPauseRequest()
     {
+        // Orden de corte pendiente en el bus. Se aplica aquí, en la tarea del reproductor.
+        if (transport.cancelRequested() != TCMD_NONE)
+        {
+            transportServiceCancels();
+        }
+
         if (LOADING_STATE == 1)
         {
             if (STOP==true)
@@ -167,6 +173,9 @@ class TSXprocessor
     {
         if (TSXFile != 0)
         {
+          // El nombre largo se lee de la entrada del directorio
+          SDioLock lock(SDIO_INTERACTIVE);
+
           // Capturamos el nombre del fichero en szName
           char szName[254];
           TSXFile.getName(szName,254);
@@ -73,13 +73,19 @@ class TZXprocessor
     File32 _mFile;
     int _sizeTZX;
     int _rlen;
+    // Bloque en curso (para la lectura anticipada)
+    int _playingBlock = 0;
 
     int CURRENT_LOADING_BLOCK = 0;
 
     bool stopOrPauseRequest()
     {
-        // 
-        
+        // Orden de corte pendiente en el bus. Se aplica aquí, en la tarea del reproductor.
+        if (transport.cancelRequested() != TCMD_NONE)
+        {
+            transportServiceCancels();
+        }
+
         if (LOADING_STATE == 1)
         {
             if (STOP==true)
@@ -157,7 +163,7 @@ class TZXprocessor
       {
 
           // Capturamos la cabecera
-          uint8_t* bBlock = (uint8_t*)ps_calloc(10+1,sizeof(uint8_t));
+          uint8_t* bBlock = (uint8_t*)blockPool.alloc(10+1);
           sdm.readFileRange32(tzxFile,bBlock,0,10,false); 
 
           // Obtenemos la firma del TZX
@@ -170,7 +176,7 @@ class TZXprocessor
               signTZXHeader[n] = (char)bBlock[n];
           }
           
-          free(bBlock);
+          blockPool.release(bBlock);
 
           //Aplicamos un terminador a la cadena de char
           signTZXHeader[7] = '\0';
@@ -196,6 +202,9 @@ class TZXprocessor
     {
         if (tzxFile != 0)
         {
+          // El nombre largo se lee de la entrada del directorio
+          SDioLock lock(SDIO_INTERACTIVE);
+
           // Capturamos el nombre del fichero en szName
           char szName[254];
           // char* szName = (char*)ps_calloc(255,sizeof(char));
@@ -244,13 +253,11 @@ class TZXprocessor
     int getWORD(File32 mFile, int offset)
     {
         int sizeDW = 0;
-        uint8_t* ptr1 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
-        uint8_t* ptr2 = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
-        sdm.readFileRange32(mFile,ptr1,offset+1,1,false);
-        sdm.readFileRange32(mFile,ptr2,offset,1,false);
-        sizeDW = (256*ptr1[0]) + ptr2[0];
-        free(ptr1);
-        free(ptr2);
+        // Los dos bytes de una vez y en la pila, sin reservar memoria
+        uint8_t word[2] = {0, 0};
+        uint8_t* ptr = word;
+        sdm.readFileRange32(mFile,ptr,offset,2,false);
+        sizeDW = (256*word[1]) + word[0];
 
         return sizeDW;    
     }
@@ -258,10 +265,10 @@ class TZXprocessor
     int getBYTE(File32 mFile, int offset)
     {
         int sizeB = 0;
-        uint8_t* ptr = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
+        uint8_t byteRead = 0;
+        uint8_t* ptr = &byteRead;
         sdm.readFileRange32(mFile,ptr,offset,1,false);
-        sizeB = ptr[0];
-        free(ptr);
+        sizeB = byteRead;
 
         return sizeB;      
     }
@@ -269,15 +276,17 @@ class TZXprocessor
     int getNBYTE(File32 mFile, int offset, int n)
     {
         int sizeNB = 0;
-        uint8_t* ptr = (uint8_t*)ps_calloc(1+1,sizeof(uint8_t));
-        
+        // Como mucho 4 bytes (int). Se leen de una vez y en la pila.
+        uint8_t bytes[4] = {0, 0, 0, 0};
+        uint8_t* ptr = bytes;
+        if (n > 4) n = 4;
+
+        sdm.readFileRange32(mFile,ptr,offset,n,false);
         for (int i = 0; i<n;i++)
         {
-            sdm.readFileRange32(mFile,ptr,offset+i,1,false);
-            sizeNB += pow(2,(8*i)) * (ptr[0]);  
+            sizeNB += pow(2,(8*i)) * (bytes[i]);  
         }
 
-        free(ptr);
         return sizeNB;             
     }
 
@@ -303,10 +312,10 @@ class TZXprocessor
         // Cogemos el checksum del bloque
         uint8_t chk = getBYTE(mFile,offset+size-1);
 
-        uint8_t* block = (uint8_t*)ps_calloc(size+1,sizeof(uint8_t));
+        uint8_t* block = (uint8_t*)blockPool.alloc(size+1);
         getBlock(mFile,block,offset,size-1);
         uint8_t calcChk = calculateChecksum(block,0,size-1);
-        free(block);
+        blockPool.release(block);
 
         if (chk == calcChk)
         {
@@ -416,12 +425,12 @@ class TZXprocessor
 
               if (!PROGRAM_NAME_DETECTED)
               {
-                  uint8_t* block = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                  uint8_t* block = (uint8_t*)blockPool.alloc(19+1);
                   getBlock(mFile,block,_myTZX.descriptor[currentBlock].offsetData,19);
                   gName = getNameFromStandardBlock(block);
                   PROGRAM_NAME = String(gName);
                   PROGRAM_NAME_DETECTED = true;
-                  free(block);
+                  blockPool.release(block);
                   strncpy(_myTZX.descriptor[currentBlock].name,gName,14);
               }
               else
@@ -454,11 +463,11 @@ class TZXprocessor
                   _myTZX.descriptor[currentBlock].type = 7;
 
                   // Almacenamos el nombre del bloque
-                  uint8_t* block = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                  uint8_t* block = (uint8_t*)blockPool.alloc(19+1);
                   getBlock(mFile,block,_myTZX.descriptor[currentBlock].offsetData,19);
                   gName = getNameFromStandardBlock(block);
                   strncpy(_myTZX.descriptor[currentBlock].name,gName,14);
-                  free(block);
+                  blockPool.release(block);
               }
               else
               {
@@ -466,11 +475,11 @@ class TZXprocessor
                 _myTZX.descriptor[currentBlock].type = 1;     
 
                 // Almacenamos el nombre del bloque
-                uint8_t* block = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+                uint8_t* block = (uint8_t*)blockPool.alloc(19+1);
                 getBlock(mFile,block,_myTZX.descriptor[currentBlock].offsetData,19);
                 gName = getNameFromStandardBlock(block);
                 strncpy(_myTZX.descriptor[currentBlock].name,gName,14);                       
-                free(block);
+                blockPool.release(block);
               }
             }
         }
@@ -623,11 +632,11 @@ class TZXprocessor
         if (flagByte < 128)
         {
             // Es una cabecera
-            uint8_t* block = (uint8_t*)ps_calloc(19+1,sizeof(uint8_t));
+            uint8_t* block = (uint8_t*)blockPool.alloc(19+1);
             getBlock(mFile,block,_myTZX.descriptor[currentBlock].offsetData,19);
             gName = getNameFromStandardBlock(block);
             strncpy(_myTZX.descriptor[currentBlock].name,gName,14);                       
-            free(block);  
+            blockPool.release(block);  
                       
             if (typeBlock == 0)
             {
@@ -718,7 +727,7 @@ class TZXprocessor
         _myTZX.descriptor[currentBlock].timming.pulse_seq_num_pulses = num_pulses;
         
         // Reservamos memoria.
-        _myTZX.descriptor[currentBlock].timming.pulse_seq_array = (int*)ps_calloc(num_pulses + 1,sizeof(int));
+        _myTZX.descriptor[currentBlock].timming.pulse_seq_array = (int*)tapeArena.alloc((num_pulses + 1) * sizeof(int));
         
         // Tomamos ahora las longitudes
         int coff = currentOffset+2;
@@ -1040,7 +1049,7 @@ class TZXprocessor
         _myTZX.descriptor[currentBlock].size = sizeTextInformation;
 
         // Ahora cogemos el texto en el siguiente byte
-        uint8_t* grpN = (uint8_t*)ps_calloc(sizeTextInformation+1,sizeof(uint8_t));
+        uint8_t* grpN = (uint8_t*)blockPool.alloc(sizeTextInformation+1);
         sdm.readFileRange32(mFile,grpN,currentOffset+2,sizeTextInformation,false);
         char groupName[sizeTextInformation+1];
         // Limpiamos de basura todo el buffer
@@ -1052,7 +1061,7 @@ class TZXprocessor
         }
 
         logln("Group name: " + String(groupName));
-        free(grpN);
+        blockPool.release(grpN);
 
         // Cogemos solo 29 letras
         if (sizeTextInformation < 30)
@@ -1484,7 +1493,7 @@ class TZXprocessor
           case 43:
             if (_myTZX.descriptor != nullptr)
             {
-              int signalLevel = getBYTE(mFile,currentOffset+4);
+              int signalLevel = getBYTE(mFile,currentOffset+5);
               
               // Inversion de señal            
               if(signalLevel==1)
@@ -1987,6 +1996,9 @@ class TZXprocessor
           logln("DSC file is not readeable.");
         }
 
+        // El .dsc es pequeño: se lee entero con el bus cogido
+        SDioLock lock(SDIO_INTERACTIVE);
+
         if (mFileDsc.isOpen())
         {
           mFileDsc.close();
@@ -2181,7 +2193,7 @@ class TZXprocessor
                               // Calculamos la posicion de la secuencia de pulsos
                               coff = myTZX.descriptor[nblock].offset + 2;
                               // Reservamos memoria.
-                              _myTZX.descriptor[nblock].timming.pulse_seq_array = (int*)ps_calloc(numPulses + 1,sizeof(int));
+                              _myTZX.descriptor[nblock].timming.pulse_seq_array = (int*)tapeArena.alloc((numPulses + 1) * sizeof(int));
                               
                               // Cogemos los pulsos
                               logln("ID13 - Num. pulses: " + String(numPulses));
@@ -2304,9 +2316,12 @@ class TZXprocessor
 
         LAST_MESSAGE = "Analyzing file. Capturing blocks";
         
-        if (dscFile.exists(pathDSC))
         {
-          dscFile.remove();
+          SDioLock lock(SDIO_INTERACTIVE);
+          if (dscFile.exists(pathDSC))
+          {
+            dscFile.remove();
+          }
         }
         
        _blDscTZX.createBlockDescriptorFileTZX(dscFile,pathDSC); 
@@ -2314,7 +2329,10 @@ class TZXprocessor
         set_file(tzxFile, _rlen);
         proccess_tzx(tzxFile, dscFile);
         
-        dscFile.close();
+        {
+          SDioLock lock(SDIO_INTERACTIVE);
+          dscFile.close();
+        }
 
         if (_myTZX.descriptor != nullptr && !ID_NOT_IMPLEMENTED)
         {
@@ -2420,6 +2438,99 @@ class TZXprocessor
       // _myTZX.descriptor = nullptr;            
     }
 
+    // Rango del fichero que lee playBlock para la parte "part" de un bloque.
+    // Los bloques mayores que SIZE_FOR_SPLIT se leen en particiones,
+    // siendo la última (part == blocks) la del resto.
+    bool getPlayRange(const tTZXBlockDescriptor &d, int part, uint32_t &offset, int &size)
+    {
+        if (d.size <= SIZE_FOR_SPLIT)
+        {
+            if (part != 0)
+            {
+                return false;
+            }
+            offset = d.offsetData;
+            size = d.size;
+            return true;
+        }
+
+        int blocks = d.size / SIZE_FOR_SPLIT;
+        if (part > blocks)
+        {
+            return false;
+        }
+
+        offset = d.offsetData + (SIZE_FOR_SPLIT * part);
+        size = (part < blocks) ? SIZE_FOR_SPLIT : d.size - (blocks * SIZE_FOR_SPLIT);
+        return true;
+    }
+
+    // Siguiente bloque que pasará por playBlock (ID 0x10, 0x11 o 0x15).
+    // Si antes hay saltos, bucles o paradas no se predice nada.
+    int getNextDataBlock(int i)
+    {
+        for (int j = i + 1; j < _myTZX.numBlocks && j <= i + 4; j++)
+        {
+            int id = _myTZX.descriptor[j].ID;
+
+            if (id == 16 || id == 17 || id == 21)
+            {
+                return j;
+            }
+
+            // 0x20 con pausa 0 (stop the tape), 0x23 jump, 0x24-0x28 loops/calls/select, 0x2A stop 48K
+            if ((id == 32 && _myTZX.descriptor[j].pauseAfterThisBlock == 0) || (id >= 35 && id <= 40) || id == 42)
+            {
+                break;
+            }
+        }
+
+        return -1;
+    }
+
+    // ¿Se reproduce siempre igual de principio a fin? (sin bloques de control que
+    // dependan del usuario). Solo estas cintas se guardan en la caché de pulsos.
+    bool isLinearTape()
+    {
+        for (int j = 0; j < _myTZX.numBlocks; j++)
+        {
+            int id = _myTZX.descriptor[j].ID;
+
+            if ((id == 32 && _myTZX.descriptor[j].pauseAfterThisBlock == 0) || (id >= 35 && id <= 40) || id == 42)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Devuelve los datos de la parte "part" del bloque en curso y deja leyendo
+    // en segundo plano la siguiente partición o el siguiente bloque de datos.
+    uint8_t* getPlayBuffer(const tTZXBlockDescriptor &d, int part)
+    {
+        uint32_t offset = 0;
+        int size = 0;
+        getPlayRange(d, part, offset, size);
+
+        uint8_t* buffer = prefetcher.get(_mFile, offset, size);
+
+        if (getPlayRange(d, part + 1, offset, size))
+        {
+            prefetcher.prefetch(_mFile, offset, size);
+        }
+        else
+        {
+            int next = getNextDataBlock(_playingBlock);
+            if (next != -1 && getPlayRange(_myTZX.descriptor[next], 0, offset, size))
+            {
+                prefetcher.prefetch(_mFile, offset, size);
+            }
+        }
+
+        return buffer;
+    }
+
     void playBlock(tTZXBlockDescriptor descriptor)
     {
 
@@ -2482,9 +2593,8 @@ class TZXprocessor
               newOffset = offsetBase + (blockSizeSplit*n);
               BYTES_INI = newOffset;
 
-              // Accedemos a la SD y capturamos el bloque del fichero
-              bufferPlay = (uint8_t*)ps_calloc(blockSizeSplit,sizeof(uint8_t));
-              sdm.readFileRange32(_mFile,bufferPlay,newOffset,blockSizeSplit, true);
+              // Capturamos la partición (leída por adelantado)
+              bufferPlay = getPlayBuffer(descriptor, n);
 
               // Mostramos en la consola los primeros y últimos bytes
               showBufferPlay(bufferPlay,blockSizeSplit,newOffset);     
@@ -2522,8 +2632,6 @@ class TZXprocessor
                     _zxp.playDRBlock(bufferPlay,blockSizeSplit,false);
                   }
               }
-
-              free(bufferPlay);
             }
 
             // Ultimo bloque
@@ -2534,9 +2642,8 @@ class TZXprocessor
             BYTES_INI = newOffset;
 
             blockSizeSplit = lastBlockSize;
-            // Accedemos a la SD y capturamos el bloque del fichero
-            bufferPlay = (uint8_t*)ps_calloc(blockSizeSplit,sizeof(uint8_t));
-            sdm.readFileRange32(_mFile,bufferPlay, newOffset,blockSizeSplit, true);
+            // Capturamos la última partición (leída por adelantado)
+            bufferPlay = getPlayBuffer(descriptor, blocks);
 
             // Mostramos en la consola los primeros y últimos bytes
             showBufferPlay(bufferPlay,blockSizeSplit,newOffset);         
@@ -2555,17 +2662,19 @@ class TZXprocessor
              
               _zxp.playDRBlock(bufferPlay,blockSizeSplit,true);
             }                                              
-
-            free(bufferPlay);       
         }
         else
         {
-            // Si es mas pequeño que el SPLIT, se reproduce completo.
-            bufferPlay = (uint8_t*)ps_calloc(descriptor.size,sizeof(uint8_t));
-            sdm.readFileRange32(_mFile,bufferPlay, descriptor.offsetData, descriptor.size, true);
+            // Si es mas pequeño que el SPLIT, se reproduce completo (leído por adelantado).
+            bufferPlay = getPlayBuffer(descriptor, 0);
 
             showBufferPlay(bufferPlay,descriptor.size,descriptor.offsetData);
-            verifyChecksum(_mFile,descriptor.offsetData,descriptor.size);    
+
+            // Pantalla de carga (flag + 6912 bytes + checksum)
+            if (descriptor.screen && descriptor.size == 6914)
+            {
+                screenPreview.submit(PATH_FILE_TO_LOAD, _playingBlock, bufferPlay + 1);
+            }
 
             // BTI 0
             _zxp.BIT_0 = descriptor.timming.bit_0;
@@ -2584,8 +2693,6 @@ class TZXprocessor
 
                 _zxp.playDRBlock(bufferPlay,descriptor.size,true);
             }
-            
-            free(bufferPlay);           
         }
     }
 
@@ -2621,7 +2728,7 @@ class TZXprocessor
 
 
         // Reservamos memoria dinamica
-        _myTZX.descriptor[currentBlock].timming.pulse_seq_array = (int*)ps_calloc(pulsosmaximos+1,sizeof(int));
+        _myTZX.descriptor[currentBlock].timming.pulse_seq_array = (int*)blockPool.alloc((pulsosmaximos+1) * sizeof(int));
         // _myTZX.descriptor[currentBlock].timming.pulse_seq_array = new int[pulsosmaximos + 1]; 
 
         #ifdef DEBUGMODE
@@ -2656,7 +2763,7 @@ class TZXprocessor
         #endif
 
         // metemos los datos
-        uint8_t *bRead = (uint8_t*)ps_calloc(ldatos + 1,sizeof(uint8_t));
+        uint8_t *bRead = (uint8_t*)blockPool.alloc(ldatos + 1);
         int lenPulse;
         
         // Leemos el bloque definido por la particion (ldatos) del fichero
@@ -2738,7 +2845,7 @@ class TZXprocessor
           logln("---------------------------------------------------------------------");
         #endif    
 
-        free(bRead);
+        blockPool.release(bRead);
     }
     
     int getIDAndPlay(int i)
@@ -2747,6 +2854,9 @@ class TZXprocessor
         uint8_t* bufferPlay = nullptr;
         int dly = 0;
         int newPosition = -1;
+
+        // Para la lectura anticipada del siguiente bloque
+        _playingBlock = i;
         
         // Cogemos la mascara del ultimo byte
         if (_myTZX.descriptor[i].hasMaskLastByte)
@@ -3173,7 +3283,7 @@ class TZXprocessor
                                       PROGRESS_BAR_BLOCK_VALUE = (BYTES_INI * 100 ) / (_myTZX.descriptor[i].offset + BYTES_IN_THIS_BLOCK);
 
                                       // Liberamos el array
-                                      free(_myTZX.descriptor[i].timming.pulse_seq_array);
+                                      blockPool.release(_myTZX.descriptor[i].timming.pulse_seq_array);
                                       // delete[] _myTZX.descriptor[i].timming.pulse_seq_array;
                                   }
 
@@ -3187,7 +3297,7 @@ class TZXprocessor
 
                                       _zxp.playCustomSequence(_myTZX.descriptor[i].timming.pulse_seq_array,_myTZX.descriptor[i].timming.pulse_seq_num_pulses,0.0); 
                                       // Liberamos el array
-                                      free(_myTZX.descriptor[i].timming.pulse_seq_array);
+                                      blockPool.release(_myTZX.descriptor[i].timming.pulse_seq_array);
                                       // delete[] _myTZX.descriptor[i].timming.pulse_seq_array;
                                       // Pausa despues de bloque                                  
                                       _zxp.silence(silence,0.0);
@@ -3213,7 +3323,7 @@ class TZXprocessor
                                       _zxp.playCustomSequence(_myTZX.descriptor[i].timming.pulse_seq_array,_myTZX.descriptor[i].timming.pulse_seq_num_pulses,0); 
 
                                       // Liberamos el array
-                                      free(_myTZX.descriptor[i].timming.pulse_seq_array); 
+                                      blockPool.release(_myTZX.descriptor[i].timming.pulse_seq_array); 
                                       // delete[] _myTZX.descriptor[i].timming.pulse_seq_array;
                                       // Pausa despues de bloque 
                                       _zxp.silence(silence,0.0); 
@@ -3271,7 +3381,7 @@ class TZXprocessor
                                     // Calculamos el offset del bloque
                                     newOffset = offsetBase + (blockSizeSplit*n);
                                     // Accedemos a la SD y capturamos el bloque del fichero
-                                    bufferPlay = (uint8_t*)ps_calloc(blockSizeSplit,sizeof(uint8_t));
+                                    bufferPlay = (uint8_t*)blockPool.alloc(blockSizeSplit);
                                     sdm.readFileRange32(_mFile,bufferPlay, newOffset, blockSizeSplit, true);
                                     // Mostramos en la consola los primeros y últimos bytes
                                     showBufferPlay(bufferPlay,blockSizeSplit,newOffset);     
@@ -3296,7 +3406,7 @@ class TZXprocessor
                                       _zxp.playDataPartition(bufferPlay, blockSizeSplit);                                      
                                     #endif
 
-                                    free(bufferPlay);
+                                    blockPool.release(bufferPlay);
 
                                   }
 
@@ -3305,7 +3415,7 @@ class TZXprocessor
                                   newOffset = offsetBase + (blockSizeSplit*blocks);
                                   blockSizeSplit = lastBlockSize;
                                   // Accedemos a la SD y capturamos el bloque del fichero
-                                  bufferPlay = (uint8_t*)ps_calloc(blockSizeSplit,sizeof(uint8_t));
+                                  bufferPlay = (uint8_t*)blockPool.alloc(blockSizeSplit);
                                   sdm.readFileRange32(_mFile,bufferPlay, newOffset,blockSizeSplit, true);
                                   // Mostramos en la consola los primeros y últimos bytes
                                   showBufferPlay(bufferPlay,blockSizeSplit,newOffset);         
@@ -3326,11 +3436,11 @@ class TZXprocessor
                                     _zxp.playPureData(bufferPlay, blockSizeSplit);                                     
                                   #endif
 
-                                  free(bufferPlay); 
+                                  blockPool.release(bufferPlay); 
                               }
                               else
                               {
-                                  bufferPlay = (uint8_t*)ps_calloc(_myTZX.descriptor[i].size,sizeof(uint8_t));
+                                  bufferPlay = (uint8_t*)blockPool.alloc(_myTZX.descriptor[i].size);
                                   sdm.readFileRange32(_mFile,bufferPlay, _myTZX.descriptor[i].offsetData, _myTZX.descriptor[i].size, true);
 
                                   showBufferPlay(bufferPlay,_myTZX.descriptor[i].size,_myTZX.descriptor[i].offsetData);
@@ -3342,7 +3452,7 @@ class TZXprocessor
                                   _zxp.BIT_1 = _myTZX.descriptor[i].timming.bit_1;
                                   //
                                   _zxp.playPureData(bufferPlay, _myTZX.descriptor[i].size);
-                                  free(bufferPlay);                                  
+                                  blockPool.release(bufferPlay);                                  
                               }                               
                               break;                          
                         }
@@ -3392,6 +3502,26 @@ class TZXprocessor
         return newPosition;
     }
 
+    // Estado de los bucles para continuar en "block" tras un salto.
+    // pass = repetición del bucle en la que se entra.
+    void prepareSeek(int block, int pass)
+    {
+        int loop = tapeSeek.table().loopOf(block);
+
+        if (loop >= 0)
+        {
+            BL_LOOP_START = loop;
+            LOOP_COUNT = _myTZX.descriptor[loop].loop_count;
+            LOOP_PLAYED = pass;
+        }
+        else
+        {
+            BL_LOOP_START = 0;
+            LOOP_COUNT = 0;
+            LOOP_PLAYED = 0;
+        }
+    }
+
     void play()
     {
 
@@ -3419,6 +3549,41 @@ class TZXprocessor
               BYTES_TOBE_LOAD = _rlen;
               BYTES_LOADED = 0;              
 
+              // Lectura anticipada de bloques
+              prefetcher.begin();
+
+              // Caché de pulsos. Si la cinta ya está guardada se reproduce desde ahí
+              // y se salta la generación de los bloques.
+              if (pulseCache.begin(PATH_FILE_TO_LOAD, firstBlockToBePlayed, _myTZX.numBlocks, isLinearTape()) == PLS_REPLAY)
+              {
+                  int from = firstBlockToBePlayed;
+                  int pass = 0;
+                  firstBlockToBePlayed = _myTZX.numBlocks;
+
+                  while (!pulseCache.replay(from,
+                      [&](int amp, uint32_t samples) { return _zxp.playCachedRun(amp, samples); },
+                      [&](int i)
+                      {
+                          BLOCK_SELECTED = i;
+                          _hmi.setBasicFileInformation(_myTZX.descriptor[i].ID,_myTZX.descriptor[i].group,_myTZX.descriptor[i].name,_myTZX.descriptor[i].typeName,_myTZX.descriptor[i].size,_myTZX.descriptor[i].playeable);
+                      }))
+                  {
+                      // Salto durante la reproducción. Se sigue desde la caché si el bloque
+                      // está en ella y si no, generándolo.
+                      if (!tapeSeek.take(from, pass))
+                      {
+                          break;
+                      }
+
+                      if (!pulseCache.hasBlock(from))
+                      {
+                          prepareSeek(from, pass);
+                          firstBlockToBePlayed = from;
+                          break;
+                      }
+                  }
+              }
+
               // Recorremos ahora todos los bloques que hay en el descriptor
               //-------------------------------------------------------------
               #ifdef DEBUGMODE
@@ -3442,6 +3607,10 @@ class TZXprocessor
                   }
 
                   _hmi.setBasicFileInformation(_myTZX.descriptor[i].ID,_myTZX.descriptor[i].group,_myTZX.descriptor[i].name,_myTZX.descriptor[i].typeName,_myTZX.descriptor[i].size,_myTZX.descriptor[i].playeable);
+
+                  // Marca de bloque en la caché de pulsos (si se está guardando)
+                  pulseCache.mark(i);
+
                   int new_i = getIDAndPlay(i);
                   // Entonces viene cambiada de un loop
                   if (new_i != -1)
@@ -3449,6 +3618,19 @@ class TZXprocessor
                     i = new_i;
                   }
 
+                  // Salto pedido durante la reproducción. Se continúa en el bloque pedido.
+                  int target;
+                  int pass;
+                  if (tapeSeek.take(target, pass))
+                  {
+                    // La caché ya no sería la cinta lineal
+                    pulseCache.end(false);
+                    prepareSeek(target, pass);
+                    // El for lo incrementa
+                    i = target - 1;
+                    continue;
+                  }
+
                   if (LOADING_STATE == 2 || LOADING_STATE == 3)
                   {
                     break;
@@ -3463,6 +3645,12 @@ class TZXprocessor
               }
               //---------------------------------------------------------------
 
+              prefetcher.end();
+
+              // Se guarda la caché si se ha reproducido entera (antes del silencio final,
+              // que se añade igual al reproducir desde la caché)
+              pulseCache.end(LOADING_STATE == 1);
+
               // En el caso de no haber parado manualmente, es por finalizar
               // la reproducción
               if (LOADING_STATE == 1) 
@@ -0,0 +1,1252 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeDigitiser.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Conversión de WAV guardados en la SD (/WAV, /REC) a TAP o TZX sin pasar por la línea de
+    entrada.
+
+    TapeDigitiser es el decodificador del grabador (TAPrecorder.h) separado del códec, de la
+    pantalla y del fichero: el mismo filtro Schmitt, los mismos anchos de tono guía y de
+    silencio, y bits que se clasifican con un umbral que se ajusta a los tiempos medidos, así
+    que también entiende cargas turbo. A diferencia del grabador, un bloque con error no para
+    la conversión: se anota y se busca el siguiente tono guía.
+
+    DigitiseWriter escribe los bloques en TAP, o en TZX con 0x10 si los tiempos medidos son los
+    de la ROM y 0x11 (turbo) si no, con la pausa real entre bloques.
+
+    La parte pura no depende del framework. DigitiseQueue (ESP32) convierte en segundo plano los
+    ficheros y carpetas que se le piden por la web y deja un informe por fichero en
+    DIGITISE_REPORT. Si se va a remontar la SD corta el WAV en curso y lo repite después.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "AudioSink.h"
+
+// Umbrales del filtro Schmitt por defecto (10% del fondo de escala)
+#define REC_TH_HIGH 3000
+#define REC_TH_LOW -3000
+
+// Anchos de semipulso en muestras a 44.1 kHz. Los usa también el grabador
+#define REC_RATE 44100
+#define REC_W_TONE_MIN 22
+#define REC_W_TONE_MAX 40
+#define REC_W_SILENCE 512
+#define REC_W_SYNC 15
+#define REC_W_BIT0_MIN 2
+#define REC_W_BIT0_MAX 15
+#define REC_W_BIT1_MIN 15
+#define REC_W_BIT1_MAX 35
+// Pulsos de tono guía antes de esperar la SYNC
+#define REC_PILOT_PULSES 256
+
+#define DIGIT_CPU 3500000
+// Tiempos de la ROM en T-states
+#define DIGIT_ROM_PILOT 2168
+#define DIGIT_ROM_SYNC1 667
+#define DIGIT_ROM_SYNC2 735
+#define DIGIT_ROM_BIT0 855
+#define DIGIT_ROM_BIT1 1710
+// Diferencia máxima con la ROM para escribir un 0x10 (en %)
+#define DIGIT_ROM_TOLERANCE 15
+
+// Bloque más largo (TAP guarda el tamaño en 16 bits)
+#define DIGIT_MAX_BLOCK 65535
+// Bloques más cortos que esto son ruido
+#define DIGIT_MIN_BLOCK 2
+// Bits que se miran antes de fijar el umbral entre 0 y 1
+#define DIGIT_CALIBRATION_BITS 64
+
+#define DIGIT_END_SILENCE 0
+#define DIGIT_END_PULSE 1
+#define DIGIT_END_EOF 2
+#define DIGIT_END_OVERFLOW 3
+
+// ------------------------------------------------------------------------------------
+// WAV
+// ------------------------------------------------------------------------------------
+
+struct tWavInfo
+{
+    uint32_t rate = 0;
+    uint8_t channels = 0;
+    uint8_t bits = 0;
+    uint32_t dataOffset = 0;
+    uint32_t dataSize = 0;
+
+    uint32_t frameSize() const
+    {
+        return channels * (bits / 8);
+    }
+};
+
+static inline uint32_t wavLe32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Cabecera de un WAV PCM de 8 o 16 bits, mono o estéreo. h son los primeros bytes del fichero.
+// Los WAV que se graban sin cerrar bien llevan tamaños a 0: los datos llegan hasta el final
+static inline bool wavParseHeader(const uint8_t* h, size_t len, uint32_t fileSize, tWavInfo &info)
+{
+    info = tWavInfo();
+    if (len < 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    bool fmt = false;
+    size_t p = 12;
+    while (p + 8 <= len)
+    {
+        uint32_t size = wavLe32(h + p + 4);
+
+        if (memcmp(h + p, "fmt ", 4) == 0 && p + 24 <= len)
+        {
+            uint16_t format = h[p + 8] | (h[p + 9] << 8);
+            info.channels = h[p + 10];
+            info.rate = wavLe32(h + p + 12);
+            info.bits = h[p + 22];
+            // PCM o WAVE_FORMAT_EXTENSIBLE
+            fmt = (format == 1 || format == 0xFFFE);
+        }
+        else if (memcmp(h + p, "data", 4) == 0)
+        {
+            info.dataOffset = p + 8;
+            uint32_t avail = fileSize > info.dataOffset ? fileSize - info.dataOffset : 0;
+            info.dataSize = (size == 0 || size > avail) ? avail : size;
+            break;
+        }
+
+        // Los bloques van alineados a 2 bytes
+        p += 8 + size + (size & 1);
+    }
+
+    return fmt && info.dataOffset > 0 && (info.channels == 1 || info.channels == 2)
+           && (info.bits == 8 || info.bits == 16) && info.rate >= 8000 && info.rate <= 192000;
+}
+
+// Una muestra de 16 bits del canal pedido (0 = izquierdo o mono)
+static inline int16_t wavSample(const uint8_t* frame, const tWavInfo &info, int channel)
+{
+    if (channel >= info.channels)
+    {
+        channel = 0;
+    }
+
+    if (info.bits == 8)
+    {
+        return (int16_t)((frame[channel] - 128) << 8);
+    }
+
+    const uint8_t* p = frame + channel * 2;
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+// ------------------------------------------------------------------------------------
+// Decodificador
+// ------------------------------------------------------------------------------------
+
+struct tDigitBlock
+{
+    uint32_t index = 0;
+    // Bytes, contando el último aunque esté incompleto
+    uint32_t size = 0;
+    // Bits del último byte (8 si acaba en byte entero)
+    uint8_t usedBits = 8;
+    bool checksumOk = false;
+    uint8_t end = DIGIT_END_SILENCE;
+
+    // Tiempos medidos en T-states
+    uint16_t pilot = 0;
+    uint16_t pilotPulses = 0;
+    uint16_t sync1 = 0;
+    uint16_t sync2 = 0;
+    uint16_t bit0 = 0;
+    uint16_t bit1 = 0;
+
+    // Posición del tono guía en el WAV y silencio desde el bloque anterior
+    uint32_t startMs = 0;
+    uint32_t gapMs = 0;
+
+    // Semipulsos demasiado cortos dentro de los datos (ruido)
+    uint32_t glitches = 0;
+};
+
+class TapeDigitiser
+{
+    private:
+
+        static const uint8_t SEEK = 0;
+        static const uint8_t PILOT = 1;
+        static const uint8_t SYNC2 = 2;
+        static const uint8_t DATA = 3;
+
+        uint32_t _rate;
+        int _thHigh;
+        int _thLow;
+        uint32_t _silence;
+
+        // Filtro Schmitt y semipulso en curso
+        int _schmitt = 0;
+        int _level = 0;
+        uint32_t _width = 0;
+        uint64_t _pos = 0;
+
+        uint8_t _state = SEEK;
+        uint32_t _pulses = 0;
+        uint64_t _pilotSum = 0;
+        uint64_t _pilotStart = 0;
+        uint64_t _lastEnd = 0;
+
+        uint32_t _sync1 = 0;
+        uint32_t _sync2 = 0;
+
+        // Bits: primer semipulso pendiente, umbral y medias
+        uint32_t _half = 0;
+        uint32_t _thr = 0;
+        uint32_t _mean0 = 0;
+        uint32_t _mean1 = 0;
+        uint64_t _sum0 = 0;
+        uint64_t _sum1 = 0;
+        uint32_t _n0 = 0;
+        uint32_t _n1 = 0;
+        uint32_t _glitches = 0;
+
+        // Primeros bits, hasta saber dónde está el umbral
+        uint32_t _pending[DIGIT_CALIBRATION_BITS];
+        uint32_t _nPending = 0;
+        bool _calibrated = false;
+
+        uint32_t _bits = 0;
+        uint8_t _byte = 0;
+        std::vector<uint8_t> _data;
+
+        tDigitBlock _block;
+        uint32_t _blocks = 0;
+        uint32_t _lost = 0;
+
+        uint32_t tstates(uint32_t samples)
+        {
+            return (uint32_t)((uint64_t)samples * DIGIT_CPU / _rate);
+        }
+
+        uint32_t ms(uint64_t samples)
+        {
+            return (uint32_t)(samples * 1000 / _rate);
+        }
+
+        // Ventana de tono guía del grabador, en T-states
+        static bool pilotWidth(uint32_t t)
+        {
+            return t >= (uint32_t)((uint64_t)REC_W_TONE_MIN * DIGIT_CPU / REC_RATE)
+                   && t < (uint32_t)((uint64_t)REC_W_TONE_MAX * DIGIT_CPU / REC_RATE);
+        }
+
+        void seek()
+        {
+            _state = SEEK;
+            _pulses = 0;
+            _pilotSum = 0;
+        }
+
+        void startPilot(uint32_t t, uint32_t w)
+        {
+            _pulses = 1;
+            _pilotSum = t;
+            _pilotStart = _pos - w;
+        }
+
+        void addBit(bool one, uint32_t t)
+        {
+            // Medias móviles de cada tipo de bit. El umbral queda en medio
+            if (one)
+            {
+                _mean1 += ((int32_t)t - (int32_t)_mean1) / 8;
+                _sum1 += t;
+                _n1++;
+            }
+            else
+            {
+                _mean0 += ((int32_t)t - (int32_t)_mean0) / 8;
+                _sum0 += t;
+                _n0++;
+            }
+            _thr = (_mean0 + _mean1) / 2;
+
+            _byte = (_byte << 1) | (one ? 1 : 0);
+            _bits++;
+            if ((_bits & 7) == 0)
+            {
+                _data.push_back(_byte);
+                _byte = 0;
+            }
+        }
+
+        // Umbral entre el bit más corto y el más largo de los primeros. Si todos son iguales
+        // se queda el de la proporción de la ROM. Después se pasan los bits guardados
+        void calibrate()
+        {
+            uint32_t lo = 0xFFFFFFFF;
+            uint32_t hi = 0;
+            for (uint32_t i = 0; i < _nPending; i++)
+            {
+                lo = _pending[i] < lo ? _pending[i] : lo;
+                hi = _pending[i] > hi ? _pending[i] : hi;
+            }
+
+            if (_nPending > 0 && hi * 2 >= lo * 3)
+            {
+                _thr = (lo + hi) / 2;
+                _mean0 = lo;
+                _mean1 = hi;
+            }
+
+            _calibrated = true;
+            for (uint32_t i = 0; i < _nPending; i++)
+            {
+                addBit(_pending[i] > _thr, _pending[i]);
+            }
+            _nPending = 0;
+        }
+
+        // Cierra el bloque en curso. true si tiene datos
+        bool endBlock(uint8_t reason)
+        {
+            if (_state == DATA && !_calibrated)
+            {
+                calibrate();
+            }
+
+            bool any = _state == DATA && _bits > 0;
+
+            if (_state == DATA || _state == SYNC2 || (_state == PILOT && _pulses >= 2 * REC_PILOT_PULSES))
+            {
+                if (!any)
+                {
+                    // Tono guía sin datos detrás
+                    _lost++;
+                }
+            }
+
+            if (any)
+            {
+                uint8_t rest = _bits & 7;
+                if (rest > 0)
+                {
+                    _data.push_back(_byte << (8 - rest));
+                }
+
+                uint8_t chk = 0;
+                size_t full = _bits / 8;
+                for (size_t i = 0; i < full; i++)
+                {
+                    chk ^= _data[i];
+                }
+
+                _block = tDigitBlock();
+                _block.index = _blocks++;
+                _block.size = _data.size();
+                _block.usedBits = rest > 0 ? rest : 8;
+                _block.checksumOk = rest == 0 && full > 0 && chk == 0;
+                _block.end = reason;
+                _block.pilot = _pilotSum / (_pulses > 0 ? _pulses : 1);
+                _block.pilotPulses = _pulses > 0xFFFF ? 0xFFFF : _pulses;
+                _block.sync1 = _sync1;
+                _block.sync2 = _sync2;
+                _block.bit0 = _n0 > 0 ? _sum0 / _n0 : 0;
+                _block.bit1 = _n1 > 0 ? _sum1 / _n1 : 0;
+                _block.startMs = ms(_pilotStart);
+                _block.gapMs = ms(_pilotStart > _lastEnd ? _pilotStart - _lastEnd : 0);
+                _block.glitches = _glitches;
+                // Último flanco del bloque
+                _lastEnd = _pos - (_width < _pos ? _width : 0);
+            }
+
+            seek();
+            return any;
+        }
+
+        // Un semipulso completo de w muestras
+        bool half(uint32_t w)
+        {
+            uint32_t t = tstates(w);
+
+            switch (_state)
+            {
+                case SEEK:
+                case PILOT:
+                {
+                    uint32_t mean = _pulses > 0 ? _pilotSum / _pulses : 0;
+
+                    if (_pulses > 0 && pilotWidth(t) && t + mean / 4 >= mean && t <= mean + mean / 4)
+                    {
+                        _pulses++;
+                        _pilotSum += t;
+                        if (_pulses >= 2 * REC_PILOT_PULSES)
+                        {
+                            _state = PILOT;
+                        }
+                    }
+                    else if (_state == PILOT && t < mean * 3 / 4)
+                    {
+                        _sync1 = t;
+                        _state = SYNC2;
+                    }
+                    else if (pilotWidth(t))
+                    {
+                        if (_state == PILOT)
+                        {
+                            _lost++;
+                            _state = SEEK;
+                        }
+                        startPilot(t, w);
+                    }
+                    else
+                    {
+                        if (_state == PILOT)
+                        {
+                            _lost++;
+                        }
+                        seek();
+                    }
+                    return false;
+                }
+
+                case SYNC2:
+                {
+                    // Umbral de partida con las proporciones de la ROM (1282 / 2168)
+                    uint32_t pilot = _pilotSum / _pulses;
+                    _sync2 = t;
+                    _thr = pilot * 59 / 100;
+                    _mean0 = _thr * 2 / 3;
+                    _mean1 = _thr * 4 / 3;
+                    _sum0 = _sum1 = 0;
+                    _n0 = _n1 = 0;
+                    _glitches = 0;
+                    _half = 0;
+                    _bits = 0;
+                    _byte = 0;
+                    _data.clear();
+                    _nPending = 0;
+                    _calibrated = false;
+                    _state = DATA;
+                    return false;
+                }
+
+                case DATA:
+                {
+                    if (t > _thr * 5 / 2)
+                    {
+                        // Más largo que cualquier bit: se acabaron los datos
+                        return endBlock(DIGIT_END_PULSE);
+                    }
+                    if (t < _thr / 4)
+                    {
+                        _glitches++;
+                    }
+
+                    if (_half == 0)
+                    {
+                        _half = t;
+                        return false;
+                    }
+
+                    uint32_t bit = (_half + t) / 2;
+                    _half = 0;
+
+                    if (!_calibrated)
+                    {
+                        _pending[_nPending++] = bit;
+                        if (_nPending == DIGIT_CALIBRATION_BITS)
+                        {
+                            calibrate();
+                        }
+                        return false;
+                    }
+                    addBit(bit > _thr, bit);
+
+                    if (_data.size() >= DIGIT_MAX_BLOCK)
+                    {
+                        return endBlock(DIGIT_END_OVERFLOW);
+                    }
+                    return false;
+                }
+            }
+            return false;
+        }
+
+    public:
+
+        TapeDigitiser(uint32_t rate, int thHigh = REC_TH_HIGH, int thLow = REC_TH_LOW)
+            : _rate(rate), _thHigh(thHigh), _thLow(thLow)
+        {
+            _silence = (uint32_t)((uint64_t)REC_W_SILENCE * rate / REC_RATE);
+            _data.reserve(8192);
+        }
+
+        // Una muestra. true si con ella ha terminado un bloque (block() y data())
+        bool push(int16_t s)
+        {
+            // Filtro Schmitt como el del grabador: entre umbrales se mantiene el nivel
+            if (s > _thHigh)
+            {
+                _schmitt = 1;
+            }
+            else if (s < _thLow)
+            {
+                _schmitt = -1;
+            }
+
+            _pos++;
+
+            if (_schmitt == 0)
+            {
+                return false;
+            }
+
+            if (_schmitt != _level)
+            {
+                uint32_t w = _width;
+                bool first = (_level == 0);
+                _level = _schmitt;
+                _width = 1;
+                // El primer nivel no tiene principio conocido
+                return !first && w < _silence && half(w);
+            }
+
+            _width++;
+            if (_width == _silence)
+            {
+                return endBlock(DIGIT_END_SILENCE);
+            }
+            return false;
+        }
+
+        // Fin del WAV. true si quedaba un bloque
+        bool flush()
+        {
+            return endBlock(DIGIT_END_EOF);
+        }
+
+        const tDigitBlock& block()
+        {
+            return _block;
+        }
+
+        const uint8_t* data()
+        {
+            return _data.data();
+        }
+
+        // Ms desde el final del último bloque hasta ahora
+        uint32_t trailingMs()
+        {
+            return ms(_pos > _lastEnd ? _pos - _lastEnd : 0);
+        }
+
+        uint32_t positionMs()
+        {
+            return ms(_pos);
+        }
+
+        // Tonos guía que no llegaron a tener datos
+        uint32_t lost()
+        {
+            return _lost;
+        }
+};
+
+// ------------------------------------------------------------------------------------
+// TAP / TZX
+// ------------------------------------------------------------------------------------
+
+static inline bool digitNear(uint32_t value, uint32_t rom)
+{
+    uint32_t d = value > rom ? value - rom : rom - value;
+    return d * 100 <= rom * DIGIT_ROM_TOLERANCE;
+}
+
+// Tiempos de la ROM: se puede escribir como 0x10
+static inline bool digitIsStandard(const tDigitBlock &b)
+{
+    return b.usedBits == 8 && digitNear(b.pilot, DIGIT_ROM_PILOT) && digitNear(b.sync1, DIGIT_ROM_SYNC1)
+           && digitNear(b.sync2, DIGIT_ROM_SYNC2) && (b.bit0 == 0 || digitNear(b.bit0, DIGIT_ROM_BIT0))
+           && (b.bit1 == 0 || digitNear(b.bit1, DIGIT_ROM_BIT1));
+}
+
+class DigitiseWriter
+{
+    private:
+
+        AudioByteOut& _out;
+        bool _tzx;
+        bool _ok = true;
+        uint32_t _pos = 0;
+        // Posición de la pausa del último bloque TZX (se sabe con el siguiente)
+        uint32_t _pauseAt = 0;
+        uint32_t _written = 0;
+
+        bool put(const uint8_t* p, size_t len)
+        {
+            _ok = _out.put(p, len) && _ok;
+            _pos += len;
+            return _ok;
+        }
+
+        void setPause(uint32_t gapMs)
+        {
+            if (_tzx && _pauseAt > 0)
+            {
+                uint8_t v[2];
+                // Una pausa 0 para la cinta. Entre bloques siempre hay algo
+                uint32_t p = gapMs < 1 ? 1 : (gapMs > 0xFFFF ? 0xFFFF : gapMs);
+                audioLe16(v, p);
+                _ok = _out.patch(_pauseAt, v, 2) && _ok;
+            }
+        }
+
+    public:
+
+        DigitiseWriter(AudioByteOut& out, bool tzx) : _out(out), _tzx(tzx)
+        {
+        }
+
+        bool begin()
+        {
+            if (_tzx)
+            {
+                static const uint8_t h[10] = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+                return put(h, sizeof(h));
+            }
+            return true;
+        }
+
+        // false si el bloque no se escribe (ruido o demasiado largo para TAP)
+        bool add(const tDigitBlock &b, const uint8_t* data)
+        {
+            if (b.size < DIGIT_MIN_BLOCK || b.size > DIGIT_MAX_BLOCK || (!_tzx && b.usedBits != 8))
+            {
+                return false;
+            }
+
+            setPause(b.gapMs);
+
+            uint8_t h[19];
+            size_t n = 0;
+
+            if (!_tzx)
+            {
+                audioLe16(h, b.size);
+                n = 2;
+            }
+            else if (digitIsStandard(b))
+            {
+                h[0] = 0x10;
+                _pauseAt = _pos + 1;
+                audioLe16(h + 1, 1000);
+                audioLe16(h + 3, b.size);
+                n = 5;
+            }
+            else
+            {
+                h[0] = 0x11;
+                audioLe16(h + 1, b.pilot);
+                audioLe16(h + 3, b.sync1);
+                audioLe16(h + 5, b.sync2);
+                audioLe16(h + 7, b.bit0 > 0 ? b.bit0 : b.bit1 / 2);
+                audioLe16(h + 9, b.bit1 > 0 ? b.bit1 : b.bit0 * 2);
+                audioLe16(h + 11, b.pilotPulses);
+                h[13] = b.usedBits;
+                _pauseAt = _pos + 14;
+                audioLe16(h + 14, 1000);
+                h[16] = b.size & 0xFF;
+                h[17] = (b.size >> 8) & 0xFF;
+                h[18] = (b.size >> 16) & 0xFF;
+                n = 19;
+            }
+
+            put(h, n);
+            put(data, b.size);
+            _written++;
+            return true;
+        }
+
+        // trailingMs: silencio después del último bloque
+        bool finish(uint32_t trailingMs)
+        {
+            setPause(trailingMs);
+            return _ok;
+        }
+
+        uint32_t written()
+        {
+            return _written;
+        }
+
+        uint32_t size()
+        {
+            return _pos;
+        }
+
+        bool ok()
+        {
+            return _ok;
+        }
+};
+
+// ------------------------------------------------------------------------------------
+// Informe
+// ------------------------------------------------------------------------------------
+
+struct tDigitiseResult
+{
+    uint32_t blocks = 0;
+    uint32_t written = 0;
+    uint32_t badChecksum = 0;
+    uint32_t partial = 0;
+    uint32_t skipped = 0;
+    uint32_t lost = 0;
+    uint32_t audioMs = 0;
+};
+
+static inline const char* digitEndName(uint8_t end)
+{
+    switch (end)
+    {
+        case DIGIT_END_PULSE:
+            return "long pulse";
+        case DIGIT_END_EOF:
+            return "end of file";
+        case DIGIT_END_OVERFLOW:
+            return "too long";
+        default:
+            return "silence";
+    }
+}
+
+// "  #3 @12.345s 6914 bytes 0x11 chk ok pilot 2168x3223 sync 667/735 bits 855/1710 gap 1000ms"
+static inline size_t digitiseBlockLine(char* out, size_t cap, const tDigitBlock &b, const uint8_t* data, bool written)
+{
+    int n = snprintf(out, cap, "  #%u @%u.%03us %u bytes flag %02X %s pilot %ux%u sync %u/%u bits %u/%u gap %ums",
+                     (unsigned)b.index, (unsigned)(b.startMs / 1000), (unsigned)(b.startMs % 1000),
+                     (unsigned)b.size, b.size > 0 ? data[0] : 0, b.checksumOk ? "chk ok" : "CHK BAD",
+                     b.pilot, b.pilotPulses, b.sync1, b.sync2, b.bit0, b.bit1, (unsigned)b.gapMs);
+
+    if (n > 0 && (size_t)n < cap && b.usedBits != 8)
+    {
+        n += snprintf(out + n, cap - n, " last byte %u bits", b.usedBits);
+    }
+    if (n > 0 && (size_t)n < cap && b.glitches > 0)
+    {
+        n += snprintf(out + n, cap - n, " %u glitches", (unsigned)b.glitches);
+    }
+    if (n > 0 && (size_t)n < cap && b.end != DIGIT_END_SILENCE)
+    {
+        n += snprintf(out + n, cap - n, " ended by %s", digitEndName(b.end));
+    }
+    if (n > 0 && (size_t)n < cap && !written)
+    {
+        n += snprintf(out + n, cap - n, " NOT WRITTEN");
+    }
+    if (n > 0 && (size_t)n < cap - 1)
+    {
+        out[n++] = '\n';
+        out[n] = 0;
+    }
+
+    return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+static inline size_t digitiseFileLine(char* out, size_t cap, const char* path, const char* status, const tDigitiseResult &r)
+{
+    int n = snprintf(out, cap, "%s: %s. %u blocks, %u written, %u bad checksum, %u partial, %u skipped, %u lost, %u.%03us\n",
+                     path, status, (unsigned)r.blocks, (unsigned)r.written, (unsigned)r.badChecksum,
+                     (unsigned)r.partial, (unsigned)r.skipped, (unsigned)r.lost,
+                     (unsigned)(r.audioMs / 1000), (unsigned)(r.audioMs % 1000));
+    return n > 0 && (size_t)n < cap ? n : 0;
+}
+
+#ifdef ARDUINO
+
+#include <mutex>
+
+#define DIGITISE_REPORT "/_digitise.txt"
+// Lectura del WAV (múltiplo de 4)
+#define DIGITISE_WINDOW 16384
+#define DIGITISE_QUEUE_MAX 16
+// Pausa entre lecturas para no acaparar la CPU
+#define DIGITISE_REST_MS 2
+
+struct tDigitiseJob
+{
+    // Un WAV o una carpeta (sus WAV, sin entrar en subcarpetas)
+    String path;
+    bool tzx;
+    bool overwrite;
+};
+
+struct tDigitiseStatus
+{
+    bool running = false;
+    uint32_t queued = 0;
+    String current = "";
+    // Bytes de audio del WAV en curso y leídos
+    uint32_t size = 0;
+    uint32_t read = 0;
+    uint32_t files = 0;
+    uint32_t failed = 0;
+    uint32_t skipped = 0;
+    uint32_t blocks = 0;
+    uint32_t written = 0;
+    uint32_t badChecksum = 0;
+    uint32_t audioMs = 0;
+    uint32_t elapsedMs = 0;
+};
+
+class DigitiseQueue
+{
+    private:
+
+        TaskHandle_t _task = nullptr;
+        SemaphoreHandle_t _go = nullptr;
+        volatile bool _stop = false;
+        // El WAV en curso se ha cortado por un remontaje de la SD
+        bool _remounted = false;
+
+        std::mutex _mtx;
+        tDigitiseStatus _status;
+        std::vector<tDigitiseJob> _queue;
+
+        static void worker(void* param)
+        {
+            DigitiseQueue* self = (DigitiseQueue*)param;
+
+            for (;;)
+            {
+                xSemaphoreTake(self->_go, portMAX_DELAY);
+                self->run();
+            }
+        }
+
+        // Se cede la SD al reproductor/grabador. false si hay que parar o dejar el WAV
+        bool waitIdle()
+        {
+            while ((PLAY || REC) && !_stop && !sdsched.remountPending())
+            {
+                vTaskDelay(500 / portTICK_PERIOD_MS);
+            }
+            _remounted = !_stop && sdsched.remountPending();
+            return !_stop && !_remounted;
+        }
+
+        void appendReport(const char* text, size_t len, bool truncate = false)
+        {
+            File32 f;
+            SDioLock lock(SDIO_BACKGROUND);
+            if (f.open(DIGITISE_REPORT, truncate ? (O_WRONLY | O_CREAT | O_TRUNC) : (O_WRONLY | O_CREAT | O_APPEND)))
+            {
+                f.write(text, len);
+                f.close();
+            }
+        }
+
+        static bool isWav(const char* name)
+        {
+            const char* dot = strrchr(name, '.');
+            return dot != nullptr && strcasecmp(dot, ".wav") == 0;
+        }
+
+        static String outPath(const String &path, bool tzx)
+        {
+            return path.substring(0, path.lastIndexOf('.')) + (tzx ? ".tzx" : ".tap");
+        }
+
+        void block(DigitiseWriter &w, TapeDigitiser &dec, tDigitiseResult &res)
+        {
+            const tDigitBlock &b = dec.block();
+            bool written = w.add(b, dec.data());
+
+            res.blocks++;
+            res.written += written ? 1 : 0;
+            res.skipped += written ? 0 : 1;
+            res.badChecksum += b.checksumOk ? 0 : 1;
+            res.partial += b.usedBits != 8 ? 1 : 0;
+
+            char line[200];
+            size_t n = digitiseBlockLine(line, sizeof(line), b, dec.data(), written);
+            if (n > 0)
+            {
+                appendReport(line, n);
+            }
+        }
+
+        // Convierte un WAV. false si se ha parado
+        bool convert(const String &path, bool tzx, bool overwrite, uint8_t* buf)
+        {
+            String out = outPath(path, tzx);
+            tDigitiseResult res;
+            tWavInfo info;
+            File32 fin;
+            File32 fout;
+            const char* result = nullptr;
+            char line[300];
+
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                if (!fin.open(path.c_str(), O_RDONLY))
+                {
+                    result = "cannot open";
+                }
+                else
+                {
+                    int n = fin.read(buf, 512);
+                    if (n <= 0 || !wavParseHeader(buf, n, fin.fileSize(), info))
+                    {
+                        result = "not a PCM WAV";
+                    }
+                    else if (!overwrite && sdf.exists(out.c_str()))
+                    {
+                        result = "skipped, output exists";
+                    }
+                    else if (!fin.seekSet(info.dataOffset) || !fout.open(out.c_str(), O_RDWR | O_CREAT | O_TRUNC))
+                    {
+                        result = "cannot create output";
+                    }
+                }
+            }
+
+            if (result != nullptr)
+            {
+                {
+                    SDioLock lock(SDIO_BACKGROUND);
+                    fin.close();
+                }
+                size_t n = digitiseFileLine(line, sizeof(line), path.c_str(), result, res);
+                appendReport(line, n);
+
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (strncmp(result, "skipped", 7) == 0)
+                {
+                    _status.skipped++;
+                }
+                else
+                {
+                    _status.failed++;
+                }
+                return true;
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _status.current = path;
+                _status.size = info.dataSize;
+                _status.read = 0;
+            }
+
+            // Umbrales del grabador
+            int thHigh = EN_SCHMITT_CHANGE ? (SCHMITT_THR * 32767) / 100 : REC_TH_HIGH;
+            int thLow = EN_SCHMITT_CHANGE ? -(SCHMITT_THR * 32768) / 100 : REC_TH_LOW;
+            // El grabador escucha el canal L (la segunda muestra) salvo SWAP_MIC_CHANNEL
+            int channel = SWAP_MIC_CHANNEL ? 0 : 1;
+
+            SdAudioOut sd(fout, SDIO_BACKGROUND);
+            DigitiseWriter w(sd, tzx);
+            TapeDigitiser dec(info.rate, thHigh, thLow);
+
+            bool ok = sd.begin() && w.begin();
+            bool stopped = false;
+            uint32_t frame = info.frameSize();
+            uint32_t window = DIGITISE_WINDOW - DIGITISE_WINDOW % frame;
+            uint32_t left = info.dataSize - info.dataSize % frame;
+
+            snprintf(line, sizeof(line), "%s -> %s, %u Hz %u bit %s\n", path.c_str(), out.c_str(), (unsigned)info.rate,
+                     info.bits, info.channels == 2 ? "stereo" : "mono");
+            appendReport(line, strlen(line));
+
+            while (ok && left > 0)
+            {
+                if (!waitIdle())
+                {
+                    stopped = true;
+                    break;
+                }
+
+                uint32_t len = left < window ? left : window;
+                int n = sdsched.read(fin, buf, len, SDIO_BACKGROUND);
+                if (n < (int)frame)
+                {
+                    break;
+                }
+                n -= n % frame;
+                left -= n;
+
+                for (int i = 0; i < n; i += frame)
+                {
+                    if (dec.push(wavSample(buf + i, info, channel)))
+                    {
+                        block(w, dec, res);
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    _status.read = info.dataSize - left;
+                }
+                vTaskDelay(DIGITISE_REST_MS / portTICK_PERIOD_MS);
+            }
+
+            if (ok && !stopped && dec.flush())
+            {
+                block(w, dec, res);
+            }
+
+            ok = w.finish(dec.trailingMs()) && ok;
+            ok = sd.end() && ok;
+            res.lost = dec.lost();
+            res.audioMs = dec.positionMs();
+
+            if (_remounted)
+            {
+                result = "SD remount, restarting";
+            }
+            else if (stopped)
+            {
+                result = "stopped";
+            }
+            else if (!ok)
+            {
+                result = "write error";
+            }
+            else if (w.written() == 0)
+            {
+                result = "no blocks found";
+            }
+            else
+            {
+                result = "done";
+            }
+
+            uint32_t outSize = w.size();
+            bool keep = !stopped && ok && w.written() > 0;
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                fin.close();
+                fout.close();
+                if (!keep)
+                {
+                    sdf.remove(out.c_str());
+                }
+            }
+            if (keep)
+            {
+                dirIndex.addPath(out.c_str(), false, outSize);
+            }
+
+            size_t n = digitiseFileLine(line, sizeof(line), path.c_str(), result, res);
+            appendReport(line, n);
+
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_remounted)
+            {
+                // Se cuenta al repetirlo
+                return false;
+            }
+            if (!stopped)
+            {
+                if (keep)
+                {
+                    _status.files++;
+                }
+                else
+                {
+                    _status.failed++;
+                }
+            }
+            _status.blocks += res.blocks;
+            _status.written += res.written;
+            _status.badChecksum += res.badChecksum;
+            _status.audioMs += res.audioMs;
+            return !stopped;
+        }
+
+        // WAV de una carpeta, antes de escribir nada en ella
+        void listWavs(const String &dir, std::vector<String> &paths)
+        {
+            char name[256];
+            File32 d;
+            File32 entry;
+            SDioLock lock(SDIO_BACKGROUND);
+            if (!d.open(dir.c_str(), O_RDONLY))
+            {
+                return;
+            }
+            while (entry.openNext(&d, O_RDONLY))
+            {
+                entry.getName(name, sizeof(name));
+                if (!entry.isDir() && !entry.isHidden() && name[0] != '.' && isWav(name))
+                {
+                    paths.push_back(dir.endsWith("/") ? dir + name : dir + "/" + name);
+                }
+                entry.close();
+            }
+            d.close();
+        }
+
+        void run()
+        {
+            unsigned long t0 = millis();
+            uint8_t* buf = (uint8_t*)blockPool.alloc(DIGITISE_WINDOW);
+
+            const char* head = "# powadcr WAV digitiser report\n";
+            appendReport(head, strlen(head), true);
+
+            for (;;)
+            {
+                tDigitiseJob job;
+                {
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    if (_queue.empty() || _stop || buf == nullptr)
+                    {
+                        _queue.clear();
+                        _status.queued = 0;
+                        _status.running = false;
+                        _status.current = "";
+                        _status.elapsedMs = millis() - t0;
+                        break;
+                    }
+                    job = _queue.front();
+                    _queue.erase(_queue.begin());
+                    _status.queued = _queue.size();
+                }
+
+                bool isDir;
+                {
+                    SDioLock lock(SDIO_BACKGROUND);
+                    File32 f;
+                    isDir = f.open(job.path.c_str(), O_RDONLY) && f.isDir();
+                    f.close();
+                }
+
+                std::vector<String> paths;
+                if (isDir)
+                {
+                    listWavs(job.path, paths);
+                }
+                else
+                {
+                    paths.push_back(job.path);
+                }
+
+                for (const String &p : paths)
+                {
+                    bool done;
+                    do
+                    {
+                        // Con el WAV y la salida abiertos
+                        SDsession session;
+                        _remounted = false;
+                        done = convert(p, job.tzx, job.overwrite, buf);
+                    }
+                    while (_remounted && !_stop);
+
+                    if (!done)
+                    {
+                        break;
+                    }
+                    std::lock_guard<std::mutex> lk(_mtx);
+                    _status.elapsedMs = millis() - t0;
+                }
+            }
+
+            blockPool.release(buf);
+        }
+
+    public:
+
+        // A la cola. false si está llena
+        bool request(const String &path, bool tzx, bool overwrite)
+        {
+            if (_task == nullptr)
+            {
+                _go = xSemaphoreCreateBinary();
+                // Prioridad mínima, en el núcleo del HMI
+                xTaskCreatePinnedToCore(worker, "digitise", 8192, this, 1, &_task, 1);
+            }
+
+            bool start;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (_queue.size() >= DIGITISE_QUEUE_MAX)
+                {
+                    return false;
+                }
+                _queue.push_back({path, tzx, overwrite});
+                _status.queued = _queue.size();
+
+                start = !_status.running;
+                if (start)
+                {
+                    // Contadores nuevos para cada tanda
+                    _status = tDigitiseStatus();
+                    _status.running = true;
+                    _status.queued = _queue.size();
+                }
+            }
+
+            if (start)
+            {
+                _stop = false;
+                xSemaphoreGive(_go);
+            }
+            return true;
+        }
+
+        // Vacía la cola y corta el WAV en curso (su salida se borra)
+        void stop()
+        {
+            _stop = true;
+        }
+
+        tDigitiseStatus status()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _status;
+        }
+};
+
+DigitiseQueue digitiser;
+
+#endif
@@ -0,0 +1,395 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeExport.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Exportación de una cinta TAP/TZX/CDT de la SD a WAV o CSW, también en la SD.
+
+    La pide la web (/api/export) y la hace la tarea del reproductor con la cinta parada. La
+    cinta se carga como con LOAD (powadcr.cpp) y se genera desde los descriptores del análisis
+    con TapeRenderer (TapeRender.h), que hace las mismas llamadas a ZXProcessor que el
+    reproductor. Las muestras van a un sink de AudioSink.h en vez de al códec, así que no hay
+    que esperar al tiempo real. Si un bloque no se puede generar (0x15 a otra frecuencia,
+    0x4B) la exportación falla y se borra el fichero, porque no sería la cinta.
+
+    STOP, PAUSE, EJECT o un salto de bloque durante la exportación la cancelan y borran el
+    fichero a medias.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <mutex>
+
+#include "AudioSink.h"
+#include "TapeRender.h"
+
+#define EXPORT_IDLE 0
+#define EXPORT_PENDING 1
+#define EXPORT_RUNNING 2
+#define EXPORT_DONE 3
+#define EXPORT_FAILED 4
+#define EXPORT_STOPPED 5
+
+#define EXPORT_RATE_MIN 8000
+#define EXPORT_RATE_MAX 48000
+
+struct tExportStatus
+{
+    uint8_t state = EXPORT_IDLE;
+    String path = "";
+    String out = "";
+    // "wav" o "csw"
+    String format = "";
+    uint8_t bits = 16;
+    uint32_t rate = 44100;
+
+    // Tamaño de la cinta y hasta dónde se ha leído
+    uint32_t size = 0;
+    uint32_t bytesIn = 0;
+    uint32_t samples = 0;
+    uint32_t bytesOut = 0;
+    uint32_t ms = 0;
+    uint32_t blocks = 0;
+    String error = "";
+};
+
+static inline const char* exportStateName(uint8_t state)
+{
+    switch (state)
+    {
+        case EXPORT_PENDING:
+            return "pending";
+        case EXPORT_RUNNING:
+            return "running";
+        case EXPORT_DONE:
+            return "done";
+        case EXPORT_FAILED:
+            return "failed";
+        case EXPORT_STOPPED:
+            return "stopped";
+        default:
+            return "idle";
+    }
+}
+
+// Nombre de salida por defecto: la cinta con la extensión del formato
+static inline String exportDefaultOut(const String &path, const String &format)
+{
+    int dot = path.lastIndexOf('.');
+    int slash = path.lastIndexOf('/');
+    String base = dot > slash ? path.substring(0, dot) : path;
+    return base + "." + format;
+}
+
+class TapeExport
+{
+    private:
+
+        // Lector para TapeRenderer. Guarda hasta dónde se ha leído para el progreso
+        struct tSource
+        {
+            File32* f;
+            uint32_t bytes;
+
+            int read(uint32_t offset, uint8_t* out, uint32_t len)
+            {
+                {
+                    SDioLock lock(SDIO_INTERACTIVE);
+                    if (!f->seekSet(offset))
+                    {
+                        return 0;
+                    }
+                }
+                int n = sdsched.read(*f, out, len, SDIO_INTERACTIVE);
+                if (n > 0 && offset + n > bytes)
+                {
+                    bytes = offset + n;
+                }
+                return n;
+            }
+        };
+
+        std::mutex _mtx;
+        tExportStatus _status;
+        volatile bool _stop = false;
+
+        void progress(const tSource &src, uint32_t samples, uint32_t bytesOut, uint32_t blocks, uint32_t t0)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _status.bytesIn = src.bytes;
+            _status.samples = samples;
+            _status.bytesOut = bytesOut;
+            _status.blocks = blocks;
+            _status.ms = millis() - t0;
+        }
+
+        void finish(uint8_t state, const String &error)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _status.state = state;
+            _status.error = error;
+        }
+
+    public:
+
+        // La deja pendiente para la tarea del reproductor. false si ya hay una
+        bool request(const String &path, const String &out, const String &format, uint8_t bits, uint32_t rate)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_status.state == EXPORT_PENDING || _status.state == EXPORT_RUNNING)
+            {
+                return false;
+            }
+
+            _status = tExportStatus();
+            _status.state = EXPORT_PENDING;
+            _status.path = path;
+            _status.out = out;
+            _status.format = format;
+            _status.bits = bits;
+            _status.rate = rate;
+            _stop = false;
+            return true;
+        }
+
+        bool pending()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _status.state == EXPORT_PENDING;
+        }
+
+        void stop()
+        {
+            _stop = true;
+        }
+
+        tExportStatus status()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _status;
+        }
+
+        // La cinta pedida no se ha podido cargar
+        void fail(const String &error)
+        {
+            finish(EXPORT_FAILED, error);
+            LAST_MESSAGE = "Export failed.";
+            logln(LAST_MESSAGE + " " + error);
+        }
+
+        // Solo desde la tarea del reproductor, con la cinta parada y cargada. Bloques first a
+        // count - 1; describe(i, tRenderBlock&) como en TapeRenderer::next()
+        template <class F>
+        void run(int first, int count, bool tzx, F describe)
+        {
+            tExportStatus job;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _status.state = EXPORT_RUNNING;
+                job = _status;
+            }
+
+            File32 fin;
+            File32 fout;
+            bool opened;
+            {
+                SDioLock lock(SDIO_INTERACTIVE);
+                opened = fin.open(job.path.c_str(), O_RDONLY);
+                if (opened && !fout.open(job.out.c_str(), O_RDWR | O_CREAT | O_TRUNC))
+                {
+                    fin.close();
+                    opened = false;
+                }
+            }
+            if (!opened)
+            {
+                fail("cannot open files");
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _status.size = fin.fileSize();
+            }
+
+            uint8_t* buf = (uint8_t*)blockPool.alloc(SIZE_FOR_SPLIT);
+            SdAudioOut out(fout);
+            WavSink wav(out, job.rate, job.bits);
+            CswSink csw(out, job.rate);
+            bool isCsw = job.format == "csw";
+            ZXAudioSink* sink = isCsw ? (ZXAudioSink*)&csw : (ZXAudioSink*)&wav;
+
+            tSource src = {&fin, 0};
+            TapeRenderer<tSource, ZXProcessor> render(src, zxp, buf, SIZE_FOR_SPLIT);
+
+            String error = "";
+            if (buf == nullptr || !out.begin())
+            {
+                error = "out of memory";
+            }
+            else if (!(isCsw ? csw.begin() : wav.begin()))
+            {
+                error = "write error";
+            }
+            else if (count <= first)
+            {
+                error = "empty tape";
+            }
+            bool ok = error == "";
+
+            // Lo que cambia el render. Se deja como estaba al terminar
+            int savedRate = SAMPLING_RATE;
+            double savedVolR = MAIN_VOL_R;
+            double savedVolL = MAIN_VOL_L;
+            int savedTotal = BYTES_TOBE_LOAD;
+
+            SAMPLING_RATE = job.rate;
+            MAIN_VOL_R = MAIN_VOL_FACTOR;
+            MAIN_VOL_L = MAIN_VOL_FACTOR;
+            BYTES_TOBE_LOAD = fin.fileSize();
+            STOP = false;
+            PAUSE = false;
+            ACU_ERROR = 0;
+            LOADING_STATE = 1;
+            BYTES_LOADED = 0;
+            LAST_MESSAGE = "Exporting to " + job.format + ". Please wait.";
+            logln("Export " + job.path + " -> " + job.out);
+
+            zxp.set_sink(sink);
+            render.begin(first, count, tzx);
+
+            uint32_t t0 = millis();
+            uint32_t blocks = 0;
+            bool seeked = false;
+            bool complete = false;
+
+            while (ok && LOADING_STATE == 1 && !_stop && !EJECT)
+            {
+                if (!render.next(describe))
+                {
+                    complete = render.unsupported() == 0 && !render.error();
+                    break;
+                }
+                blocks++;
+
+                // Un salto corta el bloque a medias: el fichero ya no vale
+                if (tapeSeek.pending())
+                {
+                    int target;
+                    int pass;
+                    tapeSeek.take(target, pass);
+                    seeked = true;
+                    break;
+                }
+
+                progress(src, isCsw ? csw.samples() : wav.samples(), out.size(), blocks, t0);
+                esp_task_wdt_reset();
+                delay(1);
+            }
+
+            bool cancelled = ok && !complete && (seeked || STOP || EJECT || _stop || LOADING_STATE != 1);
+            if (complete)
+            {
+                render.end();
+            }
+
+            if (ok && !cancelled && !complete)
+            {
+                char msg[96];
+                if (render.error())
+                {
+                    snprintf(msg, sizeof(msg), "read error at block %d", render.current());
+                }
+                else if (render.unsupported() == 0x15)
+                {
+                    snprintf(msg, sizeof(msg), "block %d (ID 0x15) is recorded at %u Hz, export at that rate",
+                             render.current(), (unsigned)render.drRate());
+                }
+                else
+                {
+                    snprintf(msg, sizeof(msg), "block %d (ID 0x%02X) cannot be exported", render.current(), render.unsupported());
+                }
+                error = msg;
+            }
+
+            bool written = ok && (isCsw ? csw.finish() : wav.finish());
+            written = out.end() && written;
+            if (ok && !written && error == "")
+            {
+                error = "write error";
+            }
+            written = written && error == "";
+
+            zxp.set_sink(nullptr);
+            streamRestoreTimings();
+            SAMPLING_RATE = savedRate;
+            MAIN_VOL_R = savedVolR;
+            MAIN_VOL_L = savedVolL;
+            BYTES_TOBE_LOAD = savedTotal;
+            STOP = true;
+            PAUSE = false;
+            LOADING_STATE = 0;
+
+            if (buf != nullptr)
+            {
+                blockPool.release(buf);
+            }
+
+            {
+                SDioLock lock(SDIO_INTERACTIVE);
+                fin.close();
+                fout.close();
+                if (cancelled || !written)
+                {
+                    sdf.remove(job.out.c_str());
+                }
+            }
+
+            progress(src, isCsw ? csw.samples() : wav.samples(), out.size(), blocks, t0);
+
+            if (cancelled)
+            {
+                finish(EXPORT_STOPPED, "");
+                LAST_MESSAGE = "Export stopped.";
+            }
+            else if (!written)
+            {
+                finish(EXPORT_FAILED, error);
+                LAST_MESSAGE = "Export failed.";
+            }
+            else
+            {
+                finish(EXPORT_DONE, "");
+                LAST_MESSAGE = "Export done.";
+            }
+            logln(LAST_MESSAGE);
+        }
+};
+
+TapeExport tapeExport;
@@ -0,0 +1,881 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeInspector.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Inspector de bloques de una cinta para la API web (GET /api/tape).
+
+    Para TZX/TSX/CDT lee el descriptor .dsc que deja el reproductor al cargar la cinta, sin
+    volver a analizarla. Si no hay .dsc, es de otra versión o no corresponde a la cinta
+    (tamaño o fecha), recorre las cabeceras de los bloques con TapeWalker. Los TAP siempre se
+    recorren así porque no tienen descriptor. Nunca escribe el .dsc ni toca el reproductor.
+
+    Para cada bloque da el ID, tipo, posición, tamaños, tiempos, pausa, grupo, bucle y una
+    estimación de su duración. La suma de los XOR de los datos (checksum) solo se comprueba
+    si se pide, porque obliga a leer el bloque entero.
+
+    TapeInspector solo depende de la libc para poder probarse en el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "TapeWalker.h"
+#include "TapeSeek.h"
+
+// Tamaño de página por defecto y máximo de /api/tape
+#define INSPECT_LIMIT 50
+#define INSPECT_LIMIT_MAX 500
+
+// Línea más larga que se acepta del .dsc
+#define INSPECT_LINE_MAX 320
+// Campos de una línea del .dsc (BlockProcessor::putBlocksDescriptorTZX)
+#define INSPECT_DSC_FIELDS 36
+// El nombre es el campo 12 y puede llevar comas. Detrás van 23 campos más
+#define INSPECT_DSC_NAME 12
+#define INSPECT_DSC_TAIL 23
+
+// Estado del checksum de un bloque
+#define INSPECT_CHK_NONE -2         // El bloque no lleva checksum
+#define INSPECT_CHK_UNCHECKED -1    // No se ha comprobado (verify=0)
+#define INSPECT_CHK_BAD 0
+#define INSPECT_CHK_OK 1
+
+// Origen de la lista de bloques
+#define INSPECT_SOURCE_DSC 0
+#define INSPECT_SOURCE_SCAN 1
+
+struct tInspectStats
+{
+    uint32_t requests = 0;
+    // Respuestas servidas desde el .dsc y recorriendo la cinta
+    uint32_t dsc = 0;
+    uint32_t scans = 0;
+    // .dsc que no correspondían a la cinta
+    uint32_t stale = 0;
+    uint32_t lastBlocks = 0;
+    uint32_t lastUs = 0;
+};
+
+struct tInspectBlock
+{
+    int index = 0;
+    uint8_t id = 0;
+    // Posición y tamaño. Con el .dsc son los del reproductor
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    // Datos con flag y checksum. dataSize = 0 si no tiene
+    uint32_t dataOffset = 0;
+    uint32_t dataSize = 0;
+    uint16_t pause = 0;
+    tTapeTimings t;
+    // Usa los tiempos de la ROM (TAP y 0x10)
+    bool standard = false;
+    // Cabecera de la ROM (flag < 128)
+    bool header = false;
+    bool playable = false;
+    char name[16] = {0};
+    // Índice del Group start y del Loop start que lo contienen (-1 ninguno)
+    int group = -1;
+    int loop = -1;
+    // Veces que suena (bucles)
+    uint32_t passes = 1;
+    int8_t checksum = INSPECT_CHK_NONE;
+    uint32_t ms = 0;
+};
+
+// Nombre del tipo de bloque según la especificación TZX
+static inline const char* inspectTypeName(uint8_t id)
+{
+    switch (id)
+    {
+        case 0x10:  return "Standard speed data";
+        case 0x11:  return "Turbo speed data";
+        case 0x12:  return "Pure tone";
+        case 0x13:  return "Pulse sequence";
+        case 0x14:  return "Pure data";
+        case 0x15:  return "Direct recording";
+        case 0x18:  return "CSW recording";
+        case 0x19:  return "Generalized data";
+        case 0x20:  return "Pause";
+        case 0x21:  return "Group start";
+        case 0x22:  return "Group end";
+        case 0x23:  return "Jump to block";
+        case 0x24:  return "Loop start";
+        case 0x25:  return "Loop end";
+        case 0x26:  return "Call sequence";
+        case 0x27:  return "Return from sequence";
+        case 0x28:  return "Select block";
+        case 0x2A:  return "Stop the tape if in 48K mode";
+        case 0x2B:  return "Set signal level";
+        case 0x30:  return "Text description";
+        case 0x31:  return "Message block";
+        case 0x32:  return "Archive info";
+        case 0x33:  return "Hardware type";
+        case 0x34:  return "Emulation info";
+        case 0x35:  return "Custom info";
+        case 0x40:  return "Snapshot";
+        case 0x4B:  return "Kansas City Standard";
+        case 0x5A:  return "Glue block";
+        default:    return "Unknown";
+    }
+}
+
+// ¿Lleva el bloque flag + datos + checksum de la ROM?
+static inline bool inspectHasChecksum(const tInspectBlock &b)
+{
+    return (b.id == 0x10 || b.id == 0x11) && b.dataSize >= 2;
+}
+
+// Duración estimada en ms de una pasada del bloque. La de 0x13 y la de los bloques sin
+// tiempos conocidos (0x18, 0x19, 0x4B) no se estiman
+static inline uint32_t inspectBlockMs(const tInspectBlock &b)
+{
+    const tTapeTimings &t = b.t;
+
+    switch (b.id)
+    {
+        case 0x10:
+        case 0x11:
+            return seekDataMs(t.pilotLen, t.pilotPulses, t.sync1, t.sync2, t.bit0, t.bit1, b.dataSize, b.pause);
+
+        case 0x14:
+            return seekDataMs(0, 0, 0, 0, t.bit0, t.bit1, b.dataSize, b.pause);
+
+        case 0x12:
+            return (uint32_t)((uint64_t)t.toneLen * t.tonePulses / 3500);
+
+        case 0x15:
+            return (uint32_t)((uint64_t)b.dataSize * 8 * t.sampleTs / 3500) + b.pause;
+
+        case 0x20:
+            return b.pause;
+
+        default:
+            return 0;
+    }
+}
+
+// Grupos y bucles: se aplica a los bloques en orden
+class InspectNesting
+{
+    private:
+
+        int _group = -1;
+        int _loop = -1;
+        uint32_t _passes = 1;
+
+    public:
+
+        void reset()
+        {
+            _group = -1;
+            _loop = -1;
+            _passes = 1;
+        }
+
+        void apply(tInspectBlock &b)
+        {
+            if (b.id == 0x21)
+            {
+                _group = b.index;
+            }
+            b.group = _group;
+            if (b.id == 0x22)
+            {
+                _group = -1;
+            }
+
+            if (b.id == 0x24)
+            {
+                // Los bucles no se anidan
+                _loop = b.index;
+                _passes = b.t.loopCount > 0 ? b.t.loopCount : 1;
+                b.loop = _loop;
+                b.passes = 1;
+                return;
+            }
+
+            b.loop = _loop;
+            b.passes = _passes;
+
+            if (b.id == 0x25)
+            {
+                _loop = -1;
+                _passes = 1;
+            }
+        }
+};
+
+// Partir una línea del .dsc. Deja los campos en f[] y el nombre (recortado) en name.
+// false si no tiene los campos esperados.
+static inline bool inspectSplitDsc(char* line, const char* f[INSPECT_DSC_FIELDS], char* name, size_t nameCap)
+{
+    const int maxTokens = INSPECT_DSC_FIELDS + 16;
+    char* tok[maxTokens];
+    int n = 0;
+
+    // Fin de línea
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    {
+        line[--len] = 0;
+    }
+
+    char* p = line;
+    tok[n++] = p;
+    for (; *p; p++)
+    {
+        if (*p == ',')
+        {
+            *p = 0;
+            if (n == maxTokens)
+            {
+                return false;
+            }
+            tok[n++] = p + 1;
+        }
+    }
+
+    if (n < INSPECT_DSC_FIELDS)
+    {
+        return false;
+    }
+
+    // Las comas de más son del nombre
+    int tail = n - INSPECT_DSC_TAIL;
+    for (int i = 0; i < INSPECT_DSC_NAME; i++)
+    {
+        f[i] = tok[i];
+    }
+    for (int i = 0; i < INSPECT_DSC_TAIL; i++)
+    {
+        f[INSPECT_DSC_NAME + 1 + i] = tok[tail + i];
+    }
+
+    size_t k = 0;
+    for (int i = INSPECT_DSC_NAME; i < tail && k + 1 < nameCap; i++)
+    {
+        if (i > INSPECT_DSC_NAME)
+        {
+            name[k++] = ',';
+        }
+        for (const char* c = tok[i]; *c && k + 1 < nameCap; c++)
+        {
+            name[k++] = *c;
+        }
+    }
+    // El .dsc añade un espacio detrás del nombre
+    while (k > 0 && name[k - 1] == ' ')
+    {
+        k--;
+    }
+    name[k] = 0;
+    f[INSPECT_DSC_NAME] = name;
+    return true;
+}
+
+// Bloque de una línea del .dsc. sizeTZX es el tamaño de la cinta que se apuntó
+static inline bool inspectParseDsc(char* line, tInspectBlock &b, uint32_t &sizeTZX)
+{
+    const char* f[INSPECT_DSC_FIELDS];
+    char name[sizeof(b.name)];
+
+    if (!inspectSplitDsc(line, f, name, sizeof(name)))
+    {
+        return false;
+    }
+
+    b = tInspectBlock();
+    b.index = atoi(f[0]);
+    b.id = (uint8_t)atoi(f[1]);
+    b.header = atoi(f[6]) != 0;
+    b.dataSize = strtoul(f[8], nullptr, 10);
+    b.t.loopCount = (uint16_t)atoi(f[9]);
+    b.offset = strtoul(f[10], nullptr, 10);
+    b.dataOffset = b.dataSize > 0 ? strtoul(f[11], nullptr, 10) : 0;
+    strcpy(b.name, name);
+    b.pause = (uint16_t)atoi(f[14]);
+    b.playable = atoi(f[15]) != 0;
+    b.t.sampleTs = (uint16_t)atoi(f[16]);
+    b.size = strtoul(f[19], nullptr, 10);
+    b.t.bit0 = (uint16_t)atoi(f[20]);
+    b.t.bit1 = (uint16_t)atoi(f[21]);
+    b.t.pilotLen = (uint16_t)atoi(f[22]);
+    b.t.pilotPulses = (uint16_t)atoi(f[23]);
+    b.t.numPulses = (uint8_t)atoi(f[24]);
+    b.t.toneLen = (uint16_t)atoi(f[25]);
+    b.t.tonePulses = (uint16_t)atoi(f[26]);
+    b.t.sync1 = (uint16_t)atoi(f[27]);
+    b.t.sync2 = (uint16_t)atoi(f[28]);
+    if (atoi(f[5]) != 0)
+    {
+        b.t.usedBits = (uint8_t)atoi(f[33]);
+        if (b.t.usedBits == 0 || b.t.usedBits > 8)
+        {
+            b.t.usedBits = 8;
+        }
+    }
+    sizeTZX = strtoul(f[35], nullptr, 10);
+    b.standard = b.id == 0x10;
+    return true;
+}
+
+// Copiar una cadena entre comillas para JSON. Lo que no es ASCII imprimible sale como '?'
+static inline size_t inspectQuote(char* out, size_t cap, const char* text)
+{
+    size_t n = 0;
+    if (cap < 3)
+    {
+        return 0;
+    }
+
+    out[n++] = '"';
+    for (const char* p = text; *p && n + 3 < cap; p++)
+    {
+        char c = *p;
+        if (c == '"' || c == '\\')
+        {
+            out[n++] = '\\';
+            out[n++] = c;
+        }
+        else
+        {
+            out[n++] = (c >= 0x20 && c < 0x7F) ? c : '?';
+        }
+    }
+    out[n++] = '"';
+    out[n] = 0;
+    return n;
+}
+
+// Un bloque en JSON. Los tiempos solo para los bloques que los usan
+static inline size_t inspectBlockJSON(char* out, size_t cap, const tInspectBlock &b)
+{
+    static const char* chk[] = {"none", "unchecked", "bad", "ok"};
+    const tTapeTimings &t = b.t;
+    size_t n = 0;
+
+    n += snprintf(out + n, cap - n,
+                  "{\"index\":%d,\"id\":%u,\"type\":\"%s\",\"offset\":%u,\"size\":%u,"
+                  "\"dataOffset\":%u,\"dataSize\":%u,\"pause\":%u,\"ms\":%u,\"passes\":%u,"
+                  "\"group\":%d,\"loop\":%d,\"playable\":%s,\"header\":%s,\"checksum\":\"%s\",\"name\":",
+                  b.index, b.id, inspectTypeName(b.id), (unsigned)b.offset, (unsigned)b.size,
+                  (unsigned)b.dataOffset, (unsigned)b.dataSize, b.pause, (unsigned)b.ms, (unsigned)b.passes,
+                  b.group, b.loop, b.playable ? "true" : "false", b.header ? "true" : "false",
+                  chk[b.checksum - INSPECT_CHK_NONE]);
+    n += inspectQuote(out + n, cap - n - 1, b.name);
+
+    switch (b.id)
+    {
+        case 0x10:
+        case 0x11:
+            n += snprintf(out + n, cap - n,
+                          ",\"timings\":{\"pilot\":%u,\"pilotPulses\":%u,\"sync1\":%u,\"sync2\":%u,"
+                          "\"bit0\":%u,\"bit1\":%u,\"usedBits\":%u}",
+                          t.pilotLen, t.pilotPulses, t.sync1, t.sync2, t.bit0, t.bit1, t.usedBits);
+            break;
+
+        case 0x14:
+            n += snprintf(out + n, cap - n, ",\"timings\":{\"bit0\":%u,\"bit1\":%u,\"usedBits\":%u}",
+                          t.bit0, t.bit1, t.usedBits);
+            break;
+
+        case 0x12:
+            n += snprintf(out + n, cap - n, ",\"timings\":{\"tone\":%u,\"tonePulses\":%u}", t.toneLen, t.tonePulses);
+            break;
+
+        case 0x13:
+            n += snprintf(out + n, cap - n, ",\"timings\":{\"pulses\":%u}", t.numPulses);
+            break;
+
+        case 0x15:
+            n += snprintf(out + n, cap - n, ",\"timings\":{\"sample\":%u,\"usedBits\":%u}", t.sampleTs, t.usedBits);
+            break;
+
+        case 0x24:
+            n += snprintf(out + n, cap - n, ",\"loops\":%u", t.loopCount);
+            break;
+    }
+
+    if (n + 2 > cap)
+    {
+        n = cap - 2;
+    }
+    out[n++] = '}';
+    out[n] = 0;
+    return n;
+}
+
+// Lectura por líneas del .dsc con el mismo lector que TapeWalker
+template <class R>
+class InspectLineReader
+{
+    private:
+
+        R* _reader = nullptr;
+        uint32_t _size = 0;
+        uint32_t _pos = 0;
+        uint8_t _buf[256];
+        int _len = 0;
+        int _at = 0;
+
+    public:
+
+        void begin(R* reader, uint32_t size)
+        {
+            _reader = reader;
+            _size = size;
+            _pos = 0;
+            _len = 0;
+            _at = 0;
+        }
+
+        // false al final o si la línea no cabe en cap
+        bool readLine(char* out, size_t cap)
+        {
+            size_t n = 0;
+
+            while (true)
+            {
+                if (_at == _len)
+                {
+                    if (_pos >= _size)
+                    {
+                        break;
+                    }
+                    uint32_t want = _size - _pos < sizeof(_buf) ? _size - _pos : sizeof(_buf);
+                    _len = _reader->read(_pos, _buf, (int)want);
+                    _at = 0;
+                    if (_len <= 0)
+                    {
+                        _len = 0;
+                        return false;
+                    }
+                    _pos += _len;
+                }
+
+                char c = (char)_buf[_at++];
+                if (c == '\n')
+                {
+                    out[n] = 0;
+                    return true;
+                }
+                if (n + 1 >= cap)
+                {
+                    return false;
+                }
+                out[n++] = c;
+            }
+
+            out[n] = 0;
+            return n > 0;
+        }
+};
+
+// Bloques de una cinta, del .dsc o de las cabeceras. R es el lector de TapeWalker
+template <class R>
+class TapeInspector
+{
+    private:
+
+        R& _tape;
+        uint32_t _size;
+        bool _tzx;
+        TapeWalker<R> _walker;
+        InspectLineReader<R> _lines;
+        InspectNesting _nesting;
+        tTapeTimings _rom;
+        uint16_t _romHeaderPulses = 0;
+        uint16_t _romDataPulses = 0;
+
+        int _source = INSPECT_SOURCE_SCAN;
+        bool _stale = false;
+        bool _error = false;
+        // Primer bloque del .dsc, leído en begin() para comprobarlo
+        tInspectBlock _first;
+        bool _haveFirst = false;
+
+        char _line[INSPECT_LINE_MAX];
+        uint8_t _buf[256];
+
+        // Flag y nombre de una cabecera de la ROM (solo cuando se recorre la cinta)
+        void peekHeader(tInspectBlock &b)
+        {
+            uint8_t h[12];
+            int want = b.dataSize < sizeof(h) ? (int)b.dataSize : (int)sizeof(h);
+            if (_tape.read(b.dataOffset, h, want) != want)
+            {
+                return;
+            }
+
+            b.header = h[0] < 0x80;
+            if (h[0] == 0 && b.dataSize == 19)
+            {
+                memcpy(b.name, h + 2, 10);
+                b.name[10] = 0;
+                for (int i = 9; i >= 0 && b.name[i] == ' '; i--)
+                {
+                    b.name[i] = 0;
+                }
+            }
+        }
+
+        bool nextScan(tInspectBlock &b)
+        {
+            tTapeBlock w;
+            if (!_walker.next(w))
+            {
+                _error = _walker.error();
+                return false;
+            }
+
+            b = tInspectBlock();
+            b.index = w.index;
+            b.id = w.id;
+            b.offset = w.offset;
+            b.size = w.size;
+            b.dataOffset = w.dataOffset;
+            b.dataSize = w.dataSize;
+            b.pause = w.pause;
+            b.playable = w.dataSize > 0 || (w.id >= 0x12 && w.id <= 0x15) || w.id == 0x18 || w.id == 0x19
+                         || w.id == 0x20 || w.id == 0x4B;
+
+            if (_tzx)
+            {
+                twTzxTimings(w.id, _walker.body(), b.t);
+                if (w.id == 0x15)
+                {
+                    const uint8_t* h = _walker.body();
+                    b.pause = twLe16(h + 2);
+                    b.dataSize = twLe24(h + 5);
+                    b.dataOffset = w.offset + 9;
+                }
+            }
+
+            b.standard = w.id == 0x10;
+            if (w.dataSize > 0 && w.id != 0x15)
+            {
+                peekHeader(b);
+            }
+            return true;
+        }
+
+        bool nextDsc(tInspectBlock &b)
+        {
+            uint32_t sizeTZX;
+
+            if (_haveFirst)
+            {
+                b = _first;
+                _haveFirst = false;
+                return true;
+            }
+
+            if (!_lines.readLine(_line, sizeof(_line)))
+            {
+                return false;
+            }
+            if (!inspectParseDsc(_line, b, sizeTZX) || sizeTZX != _size)
+            {
+                _error = true;
+                return false;
+            }
+            return true;
+        }
+
+    public:
+
+        TapeInspector(R& tape, uint32_t size, bool tzx)
+            : _tape(tape), _size(size), _tzx(tzx), _walker(tape, size, tzx)
+        {
+        }
+
+        // Tiempos de la ROM para TAP y 0x10
+        void setRom(const tTapeTimings &rom, uint16_t headerPulses, uint16_t dataPulses)
+        {
+            _rom = rom;
+            _romHeaderPulses = headerPulses;
+            _romDataPulses = dataPulses;
+        }
+
+        // dsc = lector del .dsc (nullptr si no hay). version = cabecera que se espera.
+        // Si el .dsc no vale se recorre la cinta (stale())
+        bool begin(R* dsc, uint32_t dscSize, const char* version)
+        {
+            _error = false;
+            _stale = false;
+            _haveFirst = false;
+            _nesting.reset();
+            _source = INSPECT_SOURCE_SCAN;
+
+            if (dsc != nullptr && _tzx)
+            {
+                uint32_t sizeTZX = 0;
+                _lines.begin(dsc, dscSize);
+
+                bool ok = _lines.readLine(_line, sizeof(_line));
+                if (ok)
+                {
+                    char* comma = strchr(_line, ',');
+                    if (comma != nullptr)
+                    {
+                        *comma = 0;
+                    }
+                    ok = strcmp(_line, version) == 0;
+                }
+                ok = ok && _lines.readLine(_line, sizeof(_line)) && inspectParseDsc(_line, _first, sizeTZX)
+                     && sizeTZX == _size;
+
+                if (ok)
+                {
+                    _source = INSPECT_SOURCE_DSC;
+                    _haveFirst = true;
+                    return true;
+                }
+                _stale = true;
+            }
+
+            if (!_walker.begin())
+            {
+                _error = true;
+                return false;
+            }
+            return true;
+        }
+
+        // Siguiente bloque, con grupo, bucle, tiempos de la ROM y duración
+        bool next(tInspectBlock &b)
+        {
+            if (_error)
+            {
+                return false;
+            }
+
+            bool ok = _source == INSPECT_SOURCE_DSC ? nextDsc(b) : nextScan(b);
+            if (!ok)
+            {
+                return false;
+            }
+
+            if (b.standard)
+            {
+                uint16_t pulses = b.header ? _romHeaderPulses : _romDataPulses;
+                b.t.pilotLen = _rom.pilotLen;
+                b.t.pilotPulses = pulses;
+                b.t.sync1 = _rom.sync1;
+                b.t.sync2 = _rom.sync2;
+                b.t.bit0 = _rom.bit0;
+                b.t.bit1 = _rom.bit1;
+                b.t.usedBits = 8;
+            }
+
+            if (inspectHasChecksum(b))
+            {
+                b.checksum = INSPECT_CHK_UNCHECKED;
+            }
+
+            _nesting.apply(b);
+            b.ms = inspectBlockMs(b);
+            return true;
+        }
+
+        // Lee los datos del bloque y comprueba el XOR (flag + datos + checksum = 0)
+        void verify(tInspectBlock &b)
+        {
+            if (!inspectHasChecksum(b))
+            {
+                return;
+            }
+
+            uint8_t x = 0;
+            uint32_t pos = b.dataOffset;
+            uint32_t left = b.dataSize;
+
+            while (left > 0)
+            {
+                int want = left < sizeof(_buf) ? (int)left : (int)sizeof(_buf);
+                if (_tape.read(pos, _buf, want) != want)
+                {
+                    b.checksum = INSPECT_CHK_BAD;
+                    return;
+                }
+                for (int i = 0; i < want; i++)
+                {
+                    x ^= _buf[i];
+                }
+                pos += want;
+                left -= want;
+            }
+
+            b.checksum = x == 0 ? INSPECT_CHK_OK : INSPECT_CHK_BAD;
+        }
+
+        int source()
+        {
+            return _source;
+        }
+
+        // El .dsc no correspondía a la cinta
+        bool stale()
+        {
+            return _stale;
+        }
+
+        // Cinta truncada o .dsc corrupto a mitad
+        bool error()
+        {
+            return _error;
+        }
+};
+
+#ifdef ARDUINO
+
+tInspectStats inspectStats;
+
+struct tInspectReader
+{
+    File32* f;
+
+    int read(uint32_t offset, uint8_t* buffer, int len)
+    {
+        SDioLock lock(SDIO_INTERACTIVE);
+        if (!f->seekSet(offset))
+        {
+            return 0;
+        }
+        return f->read(buffer, len);
+    }
+};
+
+// Una consulta de /api/tape. Los bloques se van sacando con inspector->next() desde la
+// respuesta web, así que los ficheros siguen abiertos hasta que se destruye.
+class TapeInspection
+{
+    public:
+
+        File32 tape;
+        File32 dsc;
+        tInspectReader tapeReader = {&tape};
+        tInspectReader dscReader = {&dsc};
+        TapeInspector<tInspectReader>* inspector = nullptr;
+        uint32_t size = 0;
+        bool tzx = false;
+
+        ~TapeInspection()
+        {
+            delete inspector;
+            SDioLock lock(SDIO_INTERACTIVE);
+            if (dsc.isOpen())
+            {
+                dsc.close();
+            }
+            if (tape.isOpen())
+            {
+                tape.close();
+            }
+        }
+
+        // false si no existe o no es una cinta. Usa el .dsc si es más nuevo que la cinta
+        bool open(const String& path)
+        {
+            String ext = path.substring(path.lastIndexOf('.'));
+            ext.toUpperCase();
+            if (ext == ".TAP")
+            {
+                tzx = false;
+            }
+            else if (ext == ".TZX" || ext == ".TSX" || ext == ".CDT")
+            {
+                tzx = true;
+            }
+            else
+            {
+                return false;
+            }
+
+            uint16_t tapeDate = 0, tapeTime = 0, dscDate = 0, dscTime = 0;
+            bool fresh = false;
+            uint32_t dscSize = 0;
+            {
+                SDioLock lock(SDIO_INTERACTIVE);
+                if (!tape.open(path.c_str(), O_RDONLY))
+                {
+                    return false;
+                }
+                size = tape.fileSize();
+                tape.getModifyDateTime(&tapeDate, &tapeTime);
+
+                if (tzx && dsc.open((path + ".dsc").c_str(), O_RDONLY))
+                {
+                    dsc.getModifyDateTime(&dscDate, &dscTime);
+                    dscSize = dsc.fileSize();
+                    fresh = (((uint32_t)dscDate << 16) | dscTime) >= (((uint32_t)tapeDate << 16) | tapeTime);
+                }
+            }
+
+            if (dsc.isOpen() && !fresh)
+            {
+                inspectStats.stale++;
+            }
+
+            tTapeTimings rom;
+            rom.pilotLen = DPILOT_LEN;
+            rom.sync1 = DSYNC1;
+            rom.sync2 = DSYNC2;
+            rom.bit0 = DBIT_0;
+            rom.bit1 = DBIT_1;
+
+            inspector = new TapeInspector<tInspectReader>(tapeReader, size, tzx);
+            inspector->setRom(rom, DPULSES_HEADER, DPULSES_DATA);
+
+            BlockProcessor bp;
+            inspector->begin(fresh ? &dscReader : nullptr, dscSize, bp.dscVersion.c_str());
+            if (inspector->stale())
+            {
+                inspectStats.stale++;
+            }
+
+            if (inspector->source() == INSPECT_SOURCE_DSC)
+            {
+                inspectStats.dsc++;
+            }
+            else
+            {
+                inspectStats.scans++;
+            }
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,349 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeRender.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Generación de una cinta TAP/TZX/CDT entera con ZXProcessor a partir de los descriptores del
+    análisis, con las mismas llamadas que TZXprocessor::getIDAndPlay() y TAPprocessor::play().
+
+    Lo usa la exportación a WAV/CSW (TapeExport.h): las muestras van a un sink de AudioSink.h
+    y no al códec. Los datos se leen del fichero a trozos de SIZE_FOR_SPLIT, y los bucles
+    (0x24/0x25) vuelven atrás por índice de bloque igual que el reproductor, que los repite
+    loop_count + 1 veces.
+
+    Los descriptores se pasan como tRenderBlock, ya resueltos (tiempos de la ROM en TAP y 0x10,
+    pulsos del tono guía según el flag...). En el equipo salen de myTAP/myTZX (powadcr.cpp) y
+    en el host de TapeWalker, para comparar la salida con ficheros de referencia.
+
+    El lector es cualquier clase con:
+      int read(uint32_t offset, uint8_t* buffer, uint32_t len);   // bytes leídos
+
+    Z es ZXProcessor. Se usan las variables del reproductor de globales.h (LAST_EAR_IS,
+    POLARIZATION, LAST_SILENCE_DURATION, SAMPLING_RATE...), que en el host pone la prueba.
+
+    0x2B no tiene descriptor propio: el análisis deja el nivel en POLARIZATION y de ahí se
+    empieza. Un 0x20 con pausa 0 para la cinta en el reproductor; aquí se sigue con el
+    siguiente bloque. Un 0x15 solo se genera si el WAV va a su frecuencia de muestreo.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "TapeWalker.h"
+
+struct tRenderBlock
+{
+    // ID del TZX. Los bloques de un TAP son 0x10
+    uint8_t id = 0;
+    // Lo que el análisis marca como reproducible
+    bool playable = false;
+    // Datos en el fichero (0x10, 0x11, 0x14, 0x15 y TAP)
+    uint32_t dataOffset = 0;
+    uint32_t dataSize = 0;
+    // Pausa posterior en ms
+    uint16_t pause = 0;
+    // Tiempos ya resueltos
+    tTapeTimings t;
+    // 0x13: longitudes de los t.numPulses pulsos
+    int* pulses = nullptr;
+};
+
+// Frecuencia de un 0x15 según sus T-states por muestra, como TZXprocessor. 0 = desconocida
+static inline uint32_t renderDrRate(uint16_t sampleTs)
+{
+    switch (sampleTs)
+    {
+        case 79:
+        case 80:
+            return 44100;
+        case 158:
+        case 159:
+            return 22050;
+        case 238:
+        case 239:
+            return 16000;
+        case 315:
+        case 316:
+            return 11025;
+        case 319:
+            return 8000;
+        default:
+            return 0;
+    }
+}
+
+template <class R, class Z>
+class TapeRenderer
+{
+    private:
+
+        R& _in;
+        Z& _zxp;
+        uint8_t* _buf;
+        uint32_t _split;
+
+        bool _tzx = false;
+        int _count = 0;
+        int _next = 0;
+        int _current = -1;
+
+        // Bucle en curso (BL_LOOP_START, LOOP_COUNT y LOOP_PLAYED en TZXprocessor)
+        int _loopStart = 0;
+        int _loopCount = 0;
+        int _loopPlayed = 0;
+
+        uint8_t _unsupported = 0;
+        uint32_t _drRate = 0;
+        bool _error = false;
+
+        bool fill(uint32_t offset, uint32_t len)
+        {
+            BYTES_INI = offset;
+            if (len > 0 && _in.read(offset, _buf, len) != (int)len)
+            {
+                _error = true;
+                return false;
+            }
+            return true;
+        }
+
+        // Los datos del bloque en partes de _split bytes. Que un bloque vaya partido o entero
+        // no cambia las muestras, solo lo que se lee de cada vez.
+        void playParts(const tRenderBlock &b)
+        {
+            uint32_t parts = b.dataSize > _split ? b.dataSize / _split : 0;
+            BYTES_IN_THIS_BLOCK = b.dataSize;
+
+            for (uint32_t n = 0; n <= parts; n++)
+            {
+                bool last = (n == parts);
+                uint32_t len = last ? b.dataSize - parts * _split : _split;
+                if (!fill(b.dataOffset + n * _split, len))
+                {
+                    return;
+                }
+
+                if (b.id == 0x14)
+                {
+                    if (last)
+                    {
+                        _zxp.playPureData(_buf, len);
+                    }
+                    else
+                    {
+                        _zxp.playDataPartition(_buf, len);
+                    }
+                }
+                else if (b.id == 0x15)
+                {
+                    _zxp.playDRBlock(_buf, len, last);
+                }
+                else if (parts == 0)
+                {
+                    _zxp.playData(_buf, len, b.t.pilotLen, b.t.pilotPulses);
+                }
+                else if (n == 0)
+                {
+                    _zxp.playDataBegin(_buf, len, b.t.pilotLen, b.t.pilotPulses);
+                }
+                else if (last)
+                {
+                    _zxp.playDataEnd(_buf, len);
+                }
+                else
+                {
+                    _zxp.playDataPartition(_buf, len);
+                }
+            }
+        }
+
+    public:
+
+        // buf de "split" bytes (SIZE_FOR_SPLIT en el equipo)
+        TapeRenderer(R& in, Z& zxp, uint8_t* buf, uint32_t split)
+            : _in(in), _zxp(zxp), _buf(buf), _split(split)
+        {
+        }
+
+        // Desde el bloque "first", como una cinta recién cargada
+        void begin(int first, int count, bool tzx)
+        {
+            _tzx = tzx;
+            _count = count;
+            _next = first;
+            _current = -1;
+            _loopStart = 0;
+            _loopCount = 0;
+            _loopPlayed = 0;
+            _unsupported = 0;
+            _drRate = 0;
+            _error = false;
+
+            LAST_EAR_IS = POLARIZATION;
+            LAST_SILENCE_DURATION = 0;
+        }
+
+        // Genera el siguiente bloque. describe(i, tRenderBlock&) da el descriptor del bloque i.
+        // false al acabar la cinta, con un error de lectura o con un bloque que no se puede
+        // generar (unsupported())
+        template <class F>
+        bool next(F describe)
+        {
+            if (_error || _unsupported != 0 || _next >= _count)
+            {
+                return false;
+            }
+
+            int i = _next++;
+            _current = i;
+
+            tRenderBlock b;
+            describe(i, b);
+            _zxp.set_maskLastByte(b.t.usedBits);
+
+            switch (b.id)
+            {
+                case 0x15:
+                    // El reproductor cambia la frecuencia del códec. Un fichero tiene una sola
+                    _drRate = renderDrRate(b.t.sampleTs);
+                    if (_drRate == 0 || _drRate != (uint32_t)SAMPLING_RATE)
+                    {
+                        _unsupported = b.id;
+                        return false;
+                    }
+                    playParts(b);
+                    return !_error;
+
+                case 0x24:
+                    _loopPlayed = 0;
+                    _loopStart = i;
+                    _loopCount = b.t.loopCount;
+                    return true;
+
+                case 0x25:
+                    if (_loopPlayed < _loopCount)
+                    {
+                        _next = _loopStart + 1;
+                        _loopPlayed++;
+                    }
+                    return true;
+
+                case 0x20:
+                    if (b.pause != 0)
+                    {
+                        _zxp.silence(b.pause);
+                    }
+                    else
+                    {
+                        // Parada de la cinta: se acaba el último flanco y se sigue
+                        if (LAST_SILENCE_DURATION == 0)
+                        {
+                            _zxp.silence(2000);
+                        }
+                        LAST_EAR_IS = POLARIZATION;
+                    }
+                    return true;
+            }
+
+            if (!b.playable)
+            {
+                return true;
+            }
+
+            _zxp.silent = b.pause;
+            _zxp.SYNC1 = b.t.sync1;
+            _zxp.SYNC2 = b.t.sync2;
+            _zxp.PILOT_PULSE_LEN = b.t.pilotLen;
+            _zxp.BIT_0 = b.t.bit0;
+            _zxp.BIT_1 = b.t.bit1;
+
+            switch (b.id)
+            {
+                case 0x10:
+                case 0x11:
+                case 0x14:
+                    playParts(b);
+                    break;
+
+                case 0x12:
+                    _zxp.playPureTone(b.t.toneLen, b.t.tonePulses);
+                    break;
+
+                case 0x13:
+                    if (b.pulses == nullptr)
+                    {
+                        _unsupported = b.id;
+                        return false;
+                    }
+                    _zxp.playCustomSequence(b.pulses, b.t.numPulses);
+                    break;
+
+                default:
+                    // 0x4B (TSX) y lo que el análisis no deja cargar
+                    _unsupported = b.id;
+                    return false;
+            }
+
+            return !_error;
+        }
+
+        // Cierre de la cinta, como TZXprocessor::play() al acabar. TAPprocessor no añade nada
+        void end()
+        {
+            if (_tzx && LAST_SILENCE_DURATION == 0)
+            {
+                _zxp.silence(2000);
+            }
+            LAST_EAR_IS = POLARIZATION;
+        }
+
+        // Último bloque generado (o el que no se pudo generar)
+        int current()
+        {
+            return _current;
+        }
+
+        // ID del bloque que paró la generación, 0 si ninguno
+        uint8_t unsupported()
+        {
+            return _unsupported;
+        }
+
+        // Frecuencia del último 0x15 (la que haría falta si fue el que paró)
+        uint32_t drRate()
+        {
+            return _drRate;
+        }
+
+        bool error()
+        {
+            return _error;
+        }
+};
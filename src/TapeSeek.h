@@ -0,0 +1,420 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeSeek.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Salto directo a cualquier bloque de la cinta o a un instante de la cinta, también durante
+    la reproducción.
+
+    TapeSeekTable se construye una vez al cargar la cinta a partir de los descriptores (sin
+    volver a leer el fichero) y guarda por bloque:
+      - Instante de inicio (ms) contando las repeticiones de los bucles (ID 0x24/0x25).
+      - La pareja de cada Group Start / Group End (ID 0x21/0x22) y de cada bucle.
+    Con eso FFWD/RWD saltan un grupo entero en O(1) y blockAt(ms) es una búsqueda binaria.
+
+    Los tiempos son estimados (tono guía, sincronismos, bits con la duración media de 0 y 1,
+    pausas). Sirven para posicionarse, no para medir.
+
+    Durante la reproducción el salto se pide con tapeSeek.request(bloque) (desde
+    transportApply, orden TCMD_SEEK). El ZXProcessor corta en el siguiente buffer y el bucle de
+    bloques del procesador continúa en el bloque pedido.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// IDs de control de TZX que usa la tabla
+#define SEEK_ID_GROUP_START 0x21
+#define SEEK_ID_GROUP_END   0x22
+#define SEEK_ID_LOOP_START  0x24
+#define SEEK_ID_LOOP_END    0x25
+
+// Anidamiento máximo de grupos y bucles (el estándar no permite anidarlos)
+#define SEEK_MAX_DEPTH 8
+
+// Lo que hace falta saber de cada bloque para construir la tabla
+struct tSeekBlock
+{
+    uint16_t id = 0;
+    bool playable = true;
+    // Duración del bloque incluida su pausa
+    uint32_t ms = 0;
+    // Veces que se reproduce el cuerpo de un bucle (solo en el Loop Start)
+    uint16_t loopPasses = 1;
+};
+
+struct tSeekEntry
+{
+    uint32_t startMs;
+    uint32_t ms;
+    // Group Start <-> Group End, Loop Start <-> Loop End. -1 si no tiene.
+    int32_t mate;
+    // Loop Start del bucle que contiene al bloque. -1 si no está en un bucle.
+    int32_t loop;
+    // Group Start del grupo que contiene al bloque (incluidos el propio Start y su End). -1 si no hay.
+    int32_t group;
+    uint16_t id;
+    uint16_t passes;
+    bool playable;
+};
+
+// Duración estimada (ms) de un bloque de datos con tono guía. T-states a 3.5 MHz.
+static inline uint32_t seekDataMs(uint32_t pilotLen, uint32_t pilotPulses, uint32_t sync1, uint32_t sync2,
+                                  uint32_t bit0, uint32_t bit1, uint32_t bytes, uint32_t pauseMs)
+{
+    // Cada bit son dos pulsos. Se toma la media entre el 0 y el 1.
+    uint64_t t = (uint64_t)pilotLen * pilotPulses + sync1 + sync2 + (uint64_t)bytes * 8 * (bit0 + bit1);
+    return (uint32_t)(t / 3500) + pauseMs;
+}
+
+class TapeSeekTable
+{
+    private:
+
+        tSeekEntry* _e = nullptr;
+        int _n = 0;
+        // Primer bloque al que se puede ir con FFWD/RWD
+        int _first = 0;
+        uint32_t _total = 0;
+
+        // Último bloque con startMs <= ms en [lo, hi]
+        int search(uint32_t ms, int lo, int hi)
+        {
+            int found = lo;
+            while (lo <= hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (_e[mid].startMs <= ms)
+                {
+                    found = mid;
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid - 1;
+                }
+            }
+            return found;
+        }
+
+        int wrap(int i)
+        {
+            if (_n == 0)
+            {
+                return i;
+            }
+            if (i >= _n)
+            {
+                return _first;
+            }
+            if (i < _first)
+            {
+                return _n - 1;
+            }
+            return i;
+        }
+
+    public:
+
+        // storage tiene sitio para n entradas. get(i, tSeekBlock&) describe el bloque i.
+        template <class G>
+        bool build(tSeekEntry* storage, int n, int first, G get)
+        {
+            clear();
+            if (storage == nullptr || n <= 0)
+            {
+                return false;
+            }
+
+            _e = storage;
+            _n = n;
+            _first = (first >= 0 && first < n) ? first : 0;
+
+            int groups[SEEK_MAX_DEPTH];
+            int nGroups = 0;
+            int loops[SEEK_MAX_DEPTH];
+            int nLoops = 0;
+
+            uint32_t t = 0;
+
+            for (int i = 0; i < n; i++)
+            {
+                tSeekBlock b;
+                get(i, b);
+
+                tSeekEntry &e = _e[i];
+                e.startMs = t;
+                e.ms = b.ms;
+                e.mate = -1;
+                e.loop = nLoops > 0 ? loops[nLoops - 1] : -1;
+                e.group = nGroups > 0 ? groups[nGroups - 1] : -1;
+                e.id = b.id;
+                e.passes = 1;
+                e.playable = b.playable;
+
+                switch (b.id)
+                {
+                    case SEEK_ID_GROUP_START:
+                        e.group = i;
+                        if (nGroups < SEEK_MAX_DEPTH)
+                        {
+                            groups[nGroups++] = i;
+                        }
+                        break;
+
+                    case SEEK_ID_GROUP_END:
+                        if (nGroups > 0)
+                        {
+                            int s = groups[--nGroups];
+                            _e[s].mate = i;
+                            e.mate = s;
+                        }
+                        break;
+
+                    case SEEK_ID_LOOP_START:
+                        e.passes = b.loopPasses > 0 ? b.loopPasses : 1;
+                        if (nLoops < SEEK_MAX_DEPTH)
+                        {
+                            loops[nLoops++] = i;
+                        }
+                        break;
+
+                    case SEEK_ID_LOOP_END:
+                        if (nLoops > 0)
+                        {
+                            int s = loops[--nLoops];
+                            _e[s].mate = i;
+                            e.mate = s;
+                            e.loop = nLoops > 0 ? loops[nLoops - 1] : -1;
+
+                            // El cuerpo ya se ha contado una vez. Se añaden las repeticiones.
+                            uint32_t body = t - _e[s].startMs;
+                            _e[s].ms = body;
+                            t += body * (_e[s].passes - 1);
+                            e.startMs = t;
+                        }
+                        break;
+                }
+
+                t += e.ms;
+            }
+
+            _total = t;
+            return true;
+        }
+
+        void clear()
+        {
+            _e = nullptr;
+            _n = 0;
+            _total = 0;
+        }
+
+        bool ready()
+        {
+            return _e != nullptr;
+        }
+
+        int count()
+        {
+            return _n;
+        }
+
+        uint32_t totalMs()
+        {
+            return _total;
+        }
+
+        uint32_t startOf(int i)
+        {
+            return (i >= 0 && i < _n) ? _e[i].startMs : 0;
+        }
+
+        // Duración del bloque (en un Loop Start, la de una pasada del cuerpo)
+        uint32_t msOf(int i)
+        {
+            return (i >= 0 && i < _n) ? _e[i].ms : 0;
+        }
+
+        // Loop Start del bucle que contiene al bloque, o -1
+        int loopOf(int i)
+        {
+            return (i >= 0 && i < _n) ? _e[i].loop : -1;
+        }
+
+        // Group Start del grupo que contiene al bloque, o -1
+        int groupOf(int i)
+        {
+            return (i >= 0 && i < _n) ? _e[i].group : -1;
+        }
+
+        bool isGroupStart(int i)
+        {
+            return i >= 0 && i < _n && _e[i].id == SEEK_ID_GROUP_START;
+        }
+
+        bool isGroupEnd(int i)
+        {
+            return i >= 0 && i < _n && _e[i].id == SEEK_ID_GROUP_END;
+        }
+
+        int mate(int i)
+        {
+            return (i >= 0 && i < _n) ? _e[i].mate : -1;
+        }
+
+        // FFWD. Un grupo se salta entero (de su Group Start a su Group End).
+        int next(int i)
+        {
+            if (isGroupStart(i) && _e[i].mate > i)
+            {
+                return _e[i].mate;
+            }
+            return wrap(i + 1);
+        }
+
+        // RWD. Desde dentro o desde el final de un grupo se vuelve a su Group Start.
+        int prev(int i)
+        {
+            if (isGroupEnd(i) && _e[i].mate >= 0)
+            {
+                return _e[i].mate;
+            }
+
+            int p = wrap(i - 1);
+            if (isGroupEnd(p) && _e[p].mate >= 0)
+            {
+                return _e[p].mate;
+            }
+            return p;
+        }
+
+        // Bloque que suena en el instante ms. "pass" = repetición del bucle (0 la primera).
+        int blockAt(uint32_t ms, int* pass = nullptr)
+        {
+            if (pass != nullptr)
+            {
+                *pass = 0;
+            }
+            if (_n == 0)
+            {
+                return -1;
+            }
+            if (ms >= _total)
+            {
+                return _n - 1;
+            }
+
+            int i = search(ms, 0, _n - 1);
+
+            // Dentro de un bucle, el instante se lleva a la primera pasada
+            int L = _e[i].id == SEEK_ID_LOOP_START ? -1 : _e[i].loop;
+            if (L >= 0 && _e[L].mate > i && _e[L].ms > 0)
+            {
+                uint32_t bodyStart = _e[L].startMs;
+                uint32_t elapsed = ms - bodyStart;
+                if (pass != nullptr)
+                {
+                    *pass = elapsed / _e[L].ms;
+                }
+                i = search(bodyStart + elapsed % _e[L].ms, L, _e[L].mate - 1);
+            }
+            return i;
+        }
+};
+
+#ifdef ARDUINO
+
+class TapeSeek
+{
+    private:
+
+        TapeSeekTable _t;
+        // Bloque pedido durante la reproducción (-1 = ninguno)
+        std::atomic<int> _pending{-1};
+        std::atomic<int> _pass{0};
+
+    public:
+
+        TapeSeekTable& table()
+        {
+            return _t;
+        }
+
+        // Al cargar la cinta. La tabla vive en la arena del fichero.
+        template <class G>
+        bool build(int n, int first, G get)
+        {
+            tSeekEntry* storage = (tSeekEntry*)tapeArena.alloc(n * sizeof(tSeekEntry));
+            if (storage == nullptr)
+            {
+                _t.clear();
+                return false;
+            }
+            return _t.build(storage, n, first, get);
+        }
+
+        // Al expulsar (antes de liberar la arena)
+        void clear()
+        {
+            _t.clear();
+            _pending.store(-1);
+        }
+
+        // pass = repetición del bucle en la que se entra (salto por tiempo)
+        void request(int block, int pass = 0)
+        {
+            _pass.store(pass);
+            _pending.store(block);
+        }
+
+        inline bool pending()
+        {
+            return _pending.load(std::memory_order_relaxed) >= 0;
+        }
+
+        bool take(int &block, int &pass)
+        {
+            int b = _pending.exchange(-1);
+            if (b < 0)
+            {
+                return false;
+            }
+            block = b;
+            pass = _pass.load();
+            return true;
+        }
+};
+
+// Instancia única
+TapeSeek tapeSeek;
+
+#endif
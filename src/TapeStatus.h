@@ -0,0 +1,322 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeStatus.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Estado de la cinta publicado por la tarea del reproductor para el HMI y el servidor web.
+
+    La tarea del reproductor (núcleo 0) y la del HMI (núcleo 1) compartían las variables
+    globales de globales.h, muchas de ellas String. Una tarea las reasignaba mientras la otra
+    las leía y copiaba, con lo que se fragmentaba el heap y a veces se leía un puntero ya liberado.
+
+    Ahora el reproductor copia su estado a una estructura de tamaño fijo (tTapeStatus, solo
+    char[] y enteros) y la publica con un seqlock:
+
+      - Escritura (una sola tarea): contador impar, copia, contador par. Sin reservas de memoria
+        ni bloqueos. No espera nunca al lector.
+      - Lectura (HMI, web): copia y comprueba que el contador no ha cambiado ni era impar.
+        Si coincide con una escritura, repite.
+
+    Los datos se copian palabra a palabra con atómicos relajados, así que no hay carreras de
+    datos aunque el lector coincida con una escritura (esa lectura se descarta).
+
+    tapeStatus.publishIfDue() se llama desde la tarea del reproductor (bucle de tapeControl,
+    createPulse y el grabador) y publica como mucho cada TAPE_STATUS_PERIOD_MS.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+#define STATUS_NAME_LEN 64
+#define STATUS_MSG_LEN 96
+#define STATUS_TYPE_LEN 36
+#define STATUS_GROUP_LEN 36
+#define STATUS_FILETYPE_LEN 8
+#define STATUS_DBG_LEN 24
+
+// Campos de la página de debug. El orden es el de STATUS_DBG_NAMES.
+enum tStatusDbg
+{
+    STATUS_DBG_DATAOFFSET1 = 0,
+    STATUS_DBG_DATAOFFSET2,
+    STATUS_DBG_DATAOFFSET3,
+    STATUS_DBG_DATAOFFSET4,
+    STATUS_DBG_OFFSET1,
+    STATUS_DBG_OFFSET2,
+    STATUS_DBG_OFFSET3,
+    STATUS_DBG_OFFSET4,
+    STATUS_DBG_BLKINFO,
+    STATUS_DBG_PAUSEAB,
+    STATUS_DBG_SYNC1,
+    STATUS_DBG_SYNC2,
+    STATUS_DBG_BIT1,
+    STATUS_DBG_BIT0,
+    STATUS_DBG_TSTATE,
+    STATUS_DBG_REP,
+    STATUS_DBG_FIELDS
+};
+
+// Nombre del componente de texto en la página de debug de la pantalla
+static const char* const STATUS_DBG_NAMES[STATUS_DBG_FIELDS] =
+{
+    "dataOffset1", "dataOffset2", "dataOffset3", "dataOffset4",
+    "offset1", "offset2", "offset3", "offset4",
+    "dbgBlkInfo", "dbgPauseAB", "dbgSync1", "dbgSync2",
+    "dbgBit1", "dbgBit0", "dbgTState", "dbgRep"
+};
+
+struct tTapeStatus
+{
+    char programName[STATUS_NAME_LEN];
+    char programName2[STATUS_NAME_LEN];
+    char message[STATUS_MSG_LEN];
+    char type[STATUS_TYPE_LEN];
+    char group[STATUS_GROUP_LEN];
+    char fileType[STATUS_FILETYPE_LEN];
+
+    int32_t size;
+    int32_t totalBlocks;
+    int32_t block;
+    int32_t partition;
+    int32_t totalParts;
+    int32_t progressBlock;
+    int32_t progressTotal;
+    int32_t loadingState;
+
+    // Posición estimada en la cinta (TapeSeek.h)
+    uint32_t positionMs;
+    uint32_t tapeMs;
+
+    bool play;
+    bool pause;
+    bool stop;
+    bool rec;
+    bool eject;
+
+    char dbg[STATUS_DBG_FIELDS][STATUS_DBG_LEN];
+
+    // Número de publicaciones (0 = todavía ninguna)
+    uint32_t updates;
+};
+
+// Copia con truncado. El destino siempre queda terminado en 0.
+static inline void statusCopy(char* dst, size_t cap, const char* src)
+{
+    size_t n = 0;
+    if (src != nullptr)
+    {
+        while (n < cap - 1 && src[n] != 0)
+        {
+            dst[n] = src[n];
+            n++;
+        }
+    }
+    dst[n] = 0;
+}
+
+// Un escritor, varios lectores. T tiene que poder copiarse byte a byte.
+template <class T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock necesita un tipo trivialmente copiable");
+
+    private:
+
+        static constexpr size_t WORDS = (sizeof(T) + 3) / 4;
+
+        std::atomic<uint32_t> _seq{0};
+        std::atomic<uint32_t> _words[WORDS] = {};
+
+        std::atomic<uint32_t> _retries{0};
+
+        static size_t wordLen(size_t n)
+        {
+            return (n + 1) * 4 <= sizeof(T) ? 4 : sizeof(T) - n * 4;
+        }
+
+    public:
+
+        void write(const T &v)
+        {
+            const uint8_t* src = (const uint8_t*)&v;
+
+            uint32_t s = _seq.load(std::memory_order_relaxed);
+            _seq.store(s + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for (size_t n = 0; n < WORDS; n++)
+            {
+                uint32_t w = 0;
+                memcpy(&w, src + n * 4, wordLen(n));
+                _words[n].store(w, std::memory_order_relaxed);
+            }
+
+            _seq.store(s + 2, std::memory_order_release);
+        }
+
+        // Un intento. false si ha coincidido con una escritura ("out" no vale)
+        bool tryRead(T &out)
+        {
+            uint8_t* dst = (uint8_t*)&out;
+
+            uint32_t s1 = _seq.load(std::memory_order_acquire);
+            if (s1 & 1)
+            {
+                return false;
+            }
+
+            for (size_t n = 0; n < WORDS; n++)
+            {
+                uint32_t w = _words[n].load(std::memory_order_relaxed);
+                memcpy(dst + n * 4, &w, wordLen(n));
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return _seq.load(std::memory_order_relaxed) == s1;
+        }
+
+        // Reintenta hasta conseguir una copia coherente. Y se llama entre intentos fallidos
+        // (cesión de la CPU, por si el escritor está en el mismo núcleo).
+        template <class Y>
+        void read(T &out, Y yield)
+        {
+            while (!tryRead(out))
+            {
+                _retries.fetch_add(1, std::memory_order_relaxed);
+                yield();
+            }
+        }
+
+        // Publicaciones hechas
+        uint32_t version()
+        {
+            return _seq.load(std::memory_order_acquire) / 2;
+        }
+
+        // Lecturas repetidas por coincidir con una escritura
+        uint32_t retries()
+        {
+            return _retries.load(std::memory_order_relaxed);
+        }
+
+};
+
+#ifdef ARDUINO
+
+// Tiempo mínimo entre publicaciones. El HMI refresca cada 125 ms.
+#define TAPE_STATUS_PERIOD_MS 40
+
+class TapeStatus
+{
+    private:
+
+        SeqLock<tTapeStatus> _lock;
+        // Copia de trabajo del escritor. Estática para no ocupar pila en el camino del audio.
+        tTapeStatus _stage = {};
+        unsigned long _last = 0;
+
+    public:
+
+        // Solo desde la tarea del reproductor
+        void publish()
+        {
+            tTapeStatus &s = _stage;
+
+            statusCopy(s.programName, sizeof(s.programName), PROGRAM_NAME.c_str());
+            statusCopy(s.programName2, sizeof(s.programName2), PROGRAM_NAME_2.c_str());
+            statusCopy(s.message, sizeof(s.message), LAST_MESSAGE.c_str());
+            statusCopy(s.type, sizeof(s.type), LAST_TYPE);
+            statusCopy(s.group, sizeof(s.group), LAST_GROUP.c_str());
+            statusCopy(s.fileType, sizeof(s.fileType), TYPE_FILE_LOAD.c_str());
+
+            s.size = LAST_SIZE;
+            s.totalBlocks = TOTAL_BLOCKS;
+            s.block = BLOCK_SELECTED;
+            s.partition = PARTITION_BLOCK;
+            s.totalParts = TOTAL_PARTS;
+            s.progressBlock = PROGRESS_BAR_BLOCK_VALUE;
+            s.progressTotal = PROGRESS_BAR_TOTAL_VALUE;
+            s.loadingState = LOADING_STATE;
+
+            TapeSeekTable &t = tapeSeek.table();
+            s.tapeMs = t.totalMs();
+            s.positionMs = t.startOf(BLOCK_SELECTED) + (uint32_t)((uint64_t)t.msOf(BLOCK_SELECTED) * PROGRESS_BAR_BLOCK_VALUE / 100);
+
+            s.play = PLAY;
+            s.pause = PAUSE;
+            s.stop = STOP;
+            s.rec = REC;
+            s.eject = EJECT;
+
+            const String* dbg[STATUS_DBG_FIELDS] =
+            {
+                &dataOffset1, &dataOffset2, &dataOffset3, &dataOffset4,
+                &Offset1, &Offset2, &Offset3, &Offset4,
+                &dbgBlkInfo, &dbgPauseAB, &dbgSync1, &dbgSync2,
+                &dbgBit1, &dbgBit0, &dbgTState, &dbgRep
+            };
+
+            for (int n = 0; n < STATUS_DBG_FIELDS; n++)
+            {
+                statusCopy(s.dbg[n], STATUS_DBG_LEN, dbg[n]->c_str());
+            }
+
+            s.updates++;
+            _lock.write(s);
+            _last = millis();
+        }
+
+        inline void publishIfDue()
+        {
+            if (millis() - _last >= TAPE_STATUS_PERIOD_MS)
+            {
+                publish();
+            }
+        }
+
+        // Desde cualquier tarea
+        void read(tTapeStatus &out)
+        {
+            _lock.read(out, []() { taskYIELD(); });
+        }
+
+        uint32_t retries()
+        {
+            return _lock.retries();
+        }
+};
+
+// Instancia única
+TapeStatus tapeStatus;
+
+#endif
@@ -0,0 +1,393 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TapeWalker.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Recorrido de los bloques de un fichero TAP o TZX/TSX/CDT sin cargarlo en memoria.
+
+    Solo lee las cabeceras de cada bloque (unos pocos bytes) para saber su tamaño y dónde
+    empiezan sus datos, así que sirve para tareas en segundo plano que necesitan "mirar" una
+    cinta sin pasar por TAPprocessor/TZXprocessor (miniaturas, comprobaciones, servidor web).
+
+    El lector es cualquier clase con:
+      int read(uint32_t offset, uint8_t* buffer, int len);   // bytes leídos
+
+    Para los ID del TZX se sigue la especificación 1.20. Los ID desconocidos se saltan con la
+    regla general de la especificación (DWORD de longitud al principio del bloque).
+
+    No depende del framework de Arduino para poder probarse en el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define TW_TZX_HEADER_SIZE 10
+// Bytes de cabecera que se leen de cada bloque (el mayor es el 0x35)
+#define TW_PEEK_SIZE 0x14
+
+struct tTapeBlock
+{
+    // Nº de bloque (empezando en 0)
+    int index = 0;
+    // ID del TZX. En TAP siempre 0x10
+    uint8_t id = 0;
+    // Posición del bloque (ID en TZX, palabra de longitud en TAP) y bytes totales
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    // Datos con flag y checksum (0x10, 0x11, 0x14 y TAP). dataSize = 0 si no tiene
+    uint32_t dataOffset = 0;
+    uint32_t dataSize = 0;
+    // Pausa posterior en ms (0x10, 0x11, 0x14, 0x20)
+    uint16_t pause = 0;
+};
+
+static inline uint32_t twLe16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t twLe24(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t twLe32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Tamaño del cuerpo de un bloque TZX (sin el byte de ID). h = cabecera del cuerpo,
+// al menos twTzxFixedSize(id) bytes
+static inline uint32_t twTzxBodySize(uint8_t id, const uint8_t* h, tTapeBlock &b)
+{
+    switch (id)
+    {
+        // Standard speed data
+        case 0x10:
+            b.pause = twLe16(h);
+            b.dataOffset = 4;
+            b.dataSize = twLe16(h + 2);
+            return 4 + b.dataSize;
+
+        // Turbo speed data
+        case 0x11:
+            b.pause = twLe16(h + 0x0D);
+            b.dataOffset = 0x12;
+            b.dataSize = twLe24(h + 0x0F);
+            return 0x12 + b.dataSize;
+
+        // Pure tone
+        case 0x12:  return 4;
+        // Pulse sequence
+        case 0x13:  return 1 + h[0] * 2;
+
+        // Pure data
+        case 0x14:
+            b.pause = twLe16(h + 5);
+            b.dataOffset = 0x0A;
+            b.dataSize = twLe24(h + 7);
+            return 0x0A + b.dataSize;
+
+        // Direct recording
+        case 0x15:  return 8 + twLe24(h + 5);
+        // CSW recording y generalized data
+        case 0x18:
+        case 0x19:  return 4 + twLe32(h);
+
+        // Pause / stop the tape
+        case 0x20:
+            b.pause = twLe16(h);
+            return 2;
+
+        // Group start, group end
+        case 0x21:  return 1 + h[0];
+        case 0x22:  return 0;
+        // Jump, loop start, loop end
+        case 0x23:  return 2;
+        case 0x24:  return 2;
+        case 0x25:  return 0;
+        // Call sequence, return
+        case 0x26:  return 2 + twLe16(h) * 2;
+        case 0x27:  return 0;
+        // Select block
+        case 0x28:  return 2 + twLe16(h);
+        // Stop if 48K, set signal level
+        case 0x2A:  return 4;
+        case 0x2B:  return 5;
+        // Text, message, archive info, hardware type
+        case 0x30:  return 1 + h[0];
+        case 0x31:  return 2 + h[1];
+        case 0x32:  return 2 + twLe16(h);
+        case 0x33:  return 1 + h[0] * 3;
+        // Emulation info (obsoleto)
+        case 0x34:  return 8;
+        // Custom info
+        case 0x35:  return 0x14 + twLe32(h + 0x10);
+        // Snapshot (obsoleto)
+        case 0x40:  return 4 + twLe24(h + 1);
+        // Kansas City Standard (TSX)
+        case 0x4B:  return 4 + twLe32(h);
+        // "Glue" block
+        case 0x5A:  return 9;
+
+        // Regla general para los ID que no conocemos
+        default:    return 4 + twLe32(h);
+    }
+}
+
+// Bytes del cuerpo que necesita twTzxBodySize() para calcular el tamaño.
+// Nunca más que el cuerpo entero, así que se pueden leer en orden sin pasarse.
+static inline uint32_t twTzxFixedSize(uint8_t id)
+{
+    switch (id)
+    {
+        case 0x10:  return 4;
+        case 0x11:  return 0x12;
+        case 0x12:  return 4;
+        case 0x13:  return 1;
+        case 0x14:  return 0x0A;
+        case 0x15:  return 8;
+        case 0x20:  return 2;
+        case 0x21:  return 1;
+        case 0x22:
+        case 0x25:
+        case 0x27:  return 0;
+        case 0x23:
+        case 0x24:
+        case 0x26:
+        case 0x28:  return 2;
+        case 0x2B:  return 5;
+        case 0x30:  return 1;
+        case 0x31:
+        case 0x32:  return 2;
+        case 0x33:  return 1;
+        case 0x34:  return 8;
+        case 0x35:  return 0x14;
+        case 0x5A:  return 9;
+        // 0x18, 0x19, 0x2A, 0x40, 0x4B y los desconocidos empiezan por la longitud
+        default:    return 4;
+    }
+}
+
+// Tiempos de un bloque en T-states, de la cabecera del cuerpo. TAP y 0x10 usan los de la ROM
+// y aquí se quedan a 0.
+struct tTapeTimings
+{
+    uint16_t pilotLen = 0;
+    uint16_t pilotPulses = 0;
+    uint16_t sync1 = 0;
+    uint16_t sync2 = 0;
+    uint16_t bit0 = 0;
+    uint16_t bit1 = 0;
+    // Bits usados del último byte
+    uint8_t usedBits = 8;
+
+    // 0x12
+    uint16_t toneLen = 0;
+    uint16_t tonePulses = 0;
+    // 0x13
+    uint8_t numPulses = 0;
+    // 0x24
+    uint16_t loopCount = 0;
+    // 0x15 (T-states por muestra)
+    uint16_t sampleTs = 0;
+};
+
+// h = cabecera del cuerpo, al menos twTzxFixedSize(id) bytes
+static inline void twTzxTimings(uint8_t id, const uint8_t* h, tTapeTimings &t)
+{
+    t = tTapeTimings();
+
+    switch (id)
+    {
+        case 0x11:
+            t.pilotLen = twLe16(h);
+            t.sync1 = twLe16(h + 2);
+            t.sync2 = twLe16(h + 4);
+            t.bit0 = twLe16(h + 6);
+            t.bit1 = twLe16(h + 8);
+            t.pilotPulses = twLe16(h + 10);
+            t.usedBits = h[12];
+            break;
+
+        case 0x14:
+            t.bit0 = twLe16(h);
+            t.bit1 = twLe16(h + 2);
+            t.usedBits = h[4];
+            break;
+
+        case 0x12:
+            t.toneLen = twLe16(h);
+            t.tonePulses = twLe16(h + 2);
+            break;
+
+        case 0x13:
+            t.numPulses = h[0];
+            break;
+
+        case 0x24:
+            t.loopCount = twLe16(h);
+            break;
+
+        case 0x15:
+            t.sampleTs = twLe16(h);
+            t.usedBits = h[4];
+            break;
+    }
+
+    if (t.usedBits == 0 || t.usedBits > 8)
+    {
+        t.usedBits = 8;
+    }
+}
+
+template <class R>
+class TapeWalker
+{
+    private:
+
+        R& _reader;
+        uint32_t _fileSize;
+        bool _tzx;
+        uint32_t _pos = 0;
+        int _index = 0;
+        bool _error = false;
+        // Cabecera del último bloque (ID incluido en TZX)
+        uint8_t _h[TW_PEEK_SIZE + 1];
+
+    public:
+
+        TapeWalker(R& reader, uint32_t fileSize, bool tzx)
+            : _reader(reader), _fileSize(fileSize), _tzx(tzx)
+        {
+        }
+
+        // Comprueba la cabecera del TZX y se coloca en el primer bloque
+        bool begin()
+        {
+            _index = 0;
+            _error = false;
+
+            if (!_tzx)
+            {
+                _pos = 0;
+                return true;
+            }
+
+            uint8_t h[TW_TZX_HEADER_SIZE];
+            if (_fileSize < TW_TZX_HEADER_SIZE || _reader.read(0, h, TW_TZX_HEADER_SIZE) != TW_TZX_HEADER_SIZE
+                || memcmp(h, "ZXTape!\x1A", 8) != 0)
+            {
+                _error = true;
+                return false;
+            }
+
+            _pos = TW_TZX_HEADER_SIZE;
+            return true;
+        }
+
+        // Siguiente bloque. false al llegar al final o si el fichero está truncado (error())
+        bool next(tTapeBlock &b)
+        {
+            if (_error || _pos >= _fileSize)
+            {
+                return false;
+            }
+
+            b = tTapeBlock();
+            b.index = _index;
+            b.offset = _pos;
+
+            uint8_t* h = _h;
+            memset(_h, 0, sizeof(_h));
+            uint32_t avail = _fileSize - _pos;
+            int peek = avail < sizeof(_h) ? (int)avail : (int)sizeof(_h);
+
+            if (_reader.read(_pos, h, peek) != peek)
+            {
+                _error = true;
+                return false;
+            }
+
+            uint32_t size;
+
+            if (_tzx)
+            {
+                b.id = h[0];
+                size = 1 + twTzxBodySize(b.id, h + 1, b);
+                if (b.dataSize != 0)
+                {
+                    b.dataOffset += _pos + 1;
+                }
+            }
+            else
+            {
+                // TAP: longitud (2 bytes) + flag + datos + checksum
+                if (avail < 2)
+                {
+                    _error = true;
+                    return false;
+                }
+                b.id = 0x10;
+                b.dataOffset = _pos + 2;
+                b.dataSize = twLe16(h);
+                size = 2 + b.dataSize;
+            }
+
+            if (size > avail)
+            {
+                _error = true;
+                return false;
+            }
+
+            b.size = size;
+            _pos += size;
+            _index++;
+            return true;
+        }
+
+        bool error()
+        {
+            return _error;
+        }
+
+        // Cabecera del cuerpo del último bloque de next() (para twTzxTimings)
+        const uint8_t* body()
+        {
+            return _tzx ? _h + 1 : _h;
+        }
+
+        // ¿Es un bloque con datos de 6914 bytes (flag + 6912 + checksum)? Son las SCREEN$
+        static bool isScreen(const tTapeBlock &b)
+        {
+            return b.dataSize == 6914;
+        }
+};
@@ -0,0 +1,790 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: ThumbCache.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Miniaturas de las pantallas de carga de las cintas de un directorio.
+
+    Una tarea en segundo plano recorre el directorio que se abre en el file browser (o donde
+    se sube un fichero por web), busca en cada TAP/TZX/TSX/CDT el primer bloque de 6914 bytes
+    (SCREEN$) con TapeWalker, lo reduce a 64x48 con ScreenDecoder y lo guarda en un fichero
+    de miniaturas por directorio (_thumbs.pak):
+
+      cabecera  | claves[capacidad] (16 bytes) | imágenes[capacidad] (1536 bytes, 4 bits/pixel)
+
+    La clave es el hash del nombre (en minúsculas) más tamaño y fecha de modificación, así que
+    solo se vuelven a procesar los ficheros nuevos o cambiados. Las cintas sin pantalla también
+    se apuntan para no recorrerlas otra vez. Al terminar un recorrido completo se liberan las
+    entradas de ficheros que ya no existen. Si se llena, se rehace con el doble de capacidad.
+
+    La tarea no hace nada mientras haya PLAY o REC y accede a la SD como SDIO_BACKGROUND.
+    Si se pide otro directorio abandona el actual (lo ya guardado no se pierde). Si se va a
+    remontar la SD lo deja también y lo sigue después.
+
+    Para mostrar una miniatura basta leer las claves y una imagen (ThumbCache::get). Al insertar
+    una cinta se pinta en la zona de la pantalla de carga hasta que llega el bloque real.
+
+    La parte del formato no depende del framework para poder probarse en el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+// SCR_W, SCR_H
+#include "ScreenPreview.h"
+
+#define THUMB_SHIFT 2
+#define THUMB_W (SCR_W >> THUMB_SHIFT)
+#define THUMB_H (SCR_H >> THUMB_SHIFT)
+// 2 pixels por byte. El de la izquierda en el nibble alto (como en un BMP de 4 bits)
+#define THUMB_BYTES (THUMB_W * THUMB_H / 2)
+
+#define THUMB_PACK_NAME "_thumbs.pak"
+#define THUMB_PACK_TMP "_thumbs.tmp"
+#define THUMB_PACK_MAGIC 0x4D485450
+#define THUMB_PACK_VERSION 1
+#define THUMB_PACK_MIN_CAPACITY 32
+
+// BMP de 4 bits: cabecera de fichero (14) + info (40) + paleta (16 * 4) + filas
+#define THUMB_BMP_HEADER (14 + 40 + 16 * 4)
+#define THUMB_BMP_SIZE (THUMB_BMP_HEADER + THUMB_BYTES)
+
+enum tThumbStatus
+{
+    THUMB_EMPTY = 0,    // Hueco libre
+    THUMB_OK = 1,       // Tiene imagen
+    THUMB_NONE = 2      // Procesada, pero no tiene pantalla de carga
+};
+
+struct tThumbPackHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t thumbBytes;
+    uint32_t capacity;
+    uint32_t count;     // Huecos usados (incluidos los liberados)
+};
+
+struct tThumbKey
+{
+    uint32_t nameHash;
+    uint32_t size;
+    uint16_t date;
+    uint16_t time;
+    uint8_t status;
+    uint8_t pad[3];
+};
+
+// FNV-1a del nombre sin distinguir mayúsculas (PATH_FILE_TO_LOAD va en mayúsculas)
+static uint32_t thumbNameHash(const char* name)
+{
+    uint32_t h = 2166136261u;
+    while (*name)
+    {
+        h ^= (uint8_t)tolower((uint8_t)*name++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t thumbKeyOffset(uint32_t slot)
+{
+    return sizeof(tThumbPackHeader) + slot * sizeof(tThumbKey);
+}
+
+static uint32_t thumbPixelsOffset(uint32_t capacity, uint32_t slot)
+{
+    return sizeof(tThumbPackHeader) + capacity * sizeof(tThumbKey) + slot * THUMB_BYTES;
+}
+
+static bool thumbIsTape(const char* name, bool &tzx)
+{
+    const char* dot = strrchr(name, '.');
+    if (dot == nullptr || strlen(dot) != 4)
+    {
+        return false;
+    }
+
+    char ext[4];
+    for (int i = 0; i < 3; i++)
+    {
+        ext[i] = tolower((uint8_t)dot[i + 1]);
+    }
+    ext[3] = 0;
+
+    tzx = strcmp(ext, "tzx") == 0 || strcmp(ext, "tsx") == 0 || strcmp(ext, "cdt") == 0;
+    return tzx || strcmp(ext, "tap") == 0;
+}
+
+// Imagen reducida (un color por byte) --> 4 bits por pixel
+static void thumbPack(const uint8_t* img, uint8_t* out)
+{
+    for (int i = 0; i < THUMB_BYTES; i++)
+    {
+        out[i] = ((img[2 * i] & 0x0F) << 4) | (img[2 * i + 1] & 0x0F);
+    }
+}
+
+static void thumbUnpack(const uint8_t* pixels, uint8_t* img)
+{
+    for (int i = 0; i < THUMB_BYTES; i++)
+    {
+        img[2 * i] = pixels[i] >> 4;
+        img[2 * i + 1] = pixels[i] & 0x0F;
+    }
+}
+
+// Genera un BMP de 4 bits con la paleta del Spectrum. out = THUMB_BMP_SIZE bytes
+static void thumbToBMP(const uint8_t* pixels, uint8_t* out)
+{
+    auto put16 = [](uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; };
+    auto put32 = [](uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; };
+
+    memset(out, 0, THUMB_BMP_HEADER);
+
+    out[0] = 'B';
+    out[1] = 'M';
+    put32(out + 2, THUMB_BMP_SIZE);
+    put32(out + 10, THUMB_BMP_HEADER);
+
+    put32(out + 14, 40);
+    put32(out + 18, THUMB_W);
+    put32(out + 22, THUMB_H);
+    put16(out + 26, 1);
+    put16(out + 28, 4);
+    put32(out + 34, THUMB_BYTES);
+    put32(out + 46, 16);
+
+    // Paleta (B, G, R, 0)
+    uint8_t* pal = out + 54;
+    for (int c = 0; c < 16; c++)
+    {
+        int level = (c & 8) ? 255 : 215;
+        pal[c * 4 + 0] = (c & 1) ? level : 0;
+        pal[c * 4 + 1] = (c & 4) ? level : 0;
+        pal[c * 4 + 2] = (c & 2) ? level : 0;
+    }
+
+    // Las filas del BMP van de abajo a arriba
+    const int stride = THUMB_W / 2;
+    for (int y = 0; y < THUMB_H; y++)
+    {
+        memcpy(out + THUMB_BMP_HEADER + (THUMB_H - 1 - y) * stride, pixels + y * stride, stride);
+    }
+}
+
+#ifdef ARDUINO
+
+#include <mutex>
+
+// Bloque especial de ScreenPreview para la miniatura (el real lo sustituye al llegar)
+#define THUMB_PREVIEW_BLOCK -2
+
+struct tThumbStats
+{
+    uint32_t scanned = 0;       // Cintas vistas
+    uint32_t extracted = 0;     // Miniaturas nuevas
+    uint32_t noScreen = 0;      // Cintas sin pantalla de carga
+    uint32_t errors = 0;
+    uint32_t lastDirMs = 0;     // Duración del último recorrido completo
+};
+
+class ThumbCache
+{
+    private:
+
+        // Lector para TapeWalker
+        struct tReader
+        {
+            File32* f;
+
+            int read(uint32_t offset, uint8_t* buffer, int len)
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                if (!f->seekSet(offset))
+                {
+                    return 0;
+                }
+                return f->read(buffer, len);
+            }
+        };
+
+        TaskHandle_t _task = nullptr;
+        SemaphoreHandle_t _go = nullptr;
+
+        // Directorio pedido. Se protege con _reqMtx
+        std::mutex _reqMtx;
+        String _requested = "";
+        volatile bool _newRequest = false;
+        // La tarea está recorriendo un directorio
+        volatile bool _busy = false;
+        // El recorrido se ha cortado por un remontaje de la SD
+        bool _remounted = false;
+
+        // El fichero de miniaturas lo escribe la tarea y lo leen el HMI y la web
+        std::mutex _packMtx;
+
+        tThumbStats _stats;
+
+        static String join(const String &dir, const char* name)
+        {
+            return dir.endsWith("/") ? dir + name : dir + "/" + name;
+        }
+
+        static void worker(void* param)
+        {
+            ThumbCache* self = (ThumbCache*)param;
+
+            for (;;)
+            {
+                xSemaphoreTake(self->_go, portMAX_DELAY);
+
+                String dir;
+                {
+                    std::lock_guard<std::mutex> lk(self->_reqMtx);
+                    dir = self->_requested;
+                    self->_newRequest = false;
+                }
+
+                if (dir != "")
+                {
+                    self->_busy = true;
+                    do
+                    {
+                        // Con el directorio y el fichero de miniaturas abiertos
+                        SDsession session;
+                        self->_remounted = false;
+                        self->processDir(dir);
+                    }
+                    while (self->_remounted && !self->_newRequest);
+                    self->_busy = false;
+                }
+            }
+        }
+
+        // Se cede la SD al reproductor/grabador. false si hay que dejar este directorio
+        bool waitIdle()
+        {
+            while (PLAY || REC)
+            {
+                if (_newRequest || sdsched.remountPending())
+                {
+                    break;
+                }
+                vTaskDelay(500 / portTICK_PERIOD_MS);
+            }
+            _remounted = sdsched.remountPending();
+            return !_newRequest && !_remounted;
+        }
+
+        // Busca la primera pantalla de la cinta. Devuelve THUMB_OK o THUMB_NONE
+        uint8_t extract(const String &path, bool tzx, uint8_t* pixels)
+        {
+            File32 tape;
+            uint32_t size;
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                if (!tape.open(path.c_str(), O_RDONLY))
+                {
+                    return THUMB_NONE;
+                }
+                size = tape.fileSize();
+            }
+
+            tReader reader = {&tape};
+            TapeWalker<tReader> walker(reader, size, tzx);
+            tTapeBlock b;
+            uint8_t status = THUMB_NONE;
+
+            if (walker.begin())
+            {
+                while (walker.next(b))
+                {
+                    if (!TapeWalker<tReader>::isScreen(b))
+                    {
+                        continue;
+                    }
+
+                    uint8_t* scr = (uint8_t*)blockPool.alloc(SCR_DATA_SIZE);
+                    uint8_t* img = (uint8_t*)blockPool.alloc(THUMB_W * THUMB_H);
+
+                    if (scr != nullptr && img != nullptr)
+                    {
+                        // Sin el flag
+                        bool ok;
+                        {
+                            SDioLock lock(SDIO_BACKGROUND);
+                            ok = tape.seekSet(b.dataOffset + 1);
+                        }
+                        if (ok && sdsched.read(tape, scr, SCR_DATA_SIZE, SDIO_BACKGROUND) == SCR_DATA_SIZE)
+                        {
+                            ScreenDecoder::downscale(scr, THUMB_SHIFT, img);
+                            thumbPack(img, pixels);
+                            status = THUMB_OK;
+                        }
+                    }
+
+                    blockPool.release(scr);
+                    blockPool.release(img);
+                    break;
+                }
+            }
+
+            SDioLock lock(SDIO_BACKGROUND);
+            tape.close();
+            return status;
+        }
+
+        // Abre (o crea) el fichero de miniaturas y carga las claves en PSRAM
+        bool openPack(const String &dir, File32 &pak, tThumbPackHeader &hdr, tThumbKey* &keys)
+        {
+            String path = join(dir, THUMB_PACK_NAME);
+            SDioLock lock(SDIO_BACKGROUND);
+
+            keys = nullptr;
+
+            if (pak.open(path.c_str(), O_RDWR)
+                && pak.read(&hdr, sizeof(hdr)) == sizeof(hdr)
+                && hdr.magic == THUMB_PACK_MAGIC && hdr.version == THUMB_PACK_VERSION
+                && hdr.thumbBytes == THUMB_BYTES && hdr.count <= hdr.capacity)
+            {
+                keys = (tThumbKey*)ps_calloc(hdr.capacity, sizeof(tThumbKey));
+                if (keys != nullptr && pak.read(keys, hdr.capacity * sizeof(tThumbKey)) == (int)(hdr.capacity * sizeof(tThumbKey)))
+                {
+                    return true;
+                }
+                free(keys);
+                keys = nullptr;
+            }
+
+            // No existe o no es de esta versión. Se crea vacío.
+            pak.close();
+            if (!pak.open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC))
+            {
+                return false;
+            }
+
+            hdr.magic = THUMB_PACK_MAGIC;
+            hdr.version = THUMB_PACK_VERSION;
+            hdr.thumbBytes = THUMB_BYTES;
+            hdr.capacity = THUMB_PACK_MIN_CAPACITY;
+            hdr.count = 0;
+
+            keys = (tThumbKey*)ps_calloc(hdr.capacity, sizeof(tThumbKey));
+            if (keys == nullptr)
+            {
+                pak.close();
+                return false;
+            }
+
+            // Se reserva todo el fichero para que las imágenes queden en su sitio
+            pak.write(&hdr, sizeof(hdr));
+            pak.write(keys, hdr.capacity * sizeof(tThumbKey));
+            pak.preAllocate(thumbPixelsOffset(hdr.capacity, hdr.capacity));
+            pak.sync();
+            return true;
+        }
+
+        // Rehace el fichero con el doble de capacidad
+        bool grow(const String &dir, File32 &pak, tThumbPackHeader &hdr, tThumbKey* &keys)
+        {
+            uint32_t capacity = hdr.capacity * 2;
+            tThumbKey* newKeys = (tThumbKey*)ps_calloc(capacity, sizeof(tThumbKey));
+            uint8_t* pixels = (uint8_t*)blockPool.alloc(THUMB_BYTES);
+
+            if (newKeys == nullptr || pixels == nullptr)
+            {
+                free(newKeys);
+                blockPool.release(pixels);
+                return false;
+            }
+            memcpy(newKeys, keys, hdr.count * sizeof(tThumbKey));
+
+            String path = join(dir, THUMB_PACK_NAME);
+            String tmpPath = join(dir, THUMB_PACK_TMP);
+            File32 tmp;
+            bool ok;
+
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                ok = tmp.open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC);
+            }
+
+            if (ok)
+            {
+                tThumbPackHeader newHdr = hdr;
+                newHdr.capacity = capacity;
+
+                // Mismo orden que get(): primero el fichero y luego la SD
+                std::lock_guard<std::mutex> lk(_packMtx);
+                SDioLock lock(SDIO_BACKGROUND);
+                ok = tmp.preAllocate(thumbPixelsOffset(capacity, capacity))
+                     && tmp.write(&newHdr, sizeof(newHdr)) == sizeof(newHdr)
+                     && tmp.write(newKeys, capacity * sizeof(tThumbKey)) == capacity * sizeof(tThumbKey);
+
+                for (uint32_t i = 0; ok && i < hdr.count; i++)
+                {
+                    ok = pak.seekSet(thumbPixelsOffset(hdr.capacity, i))
+                         && pak.read(pixels, THUMB_BYTES) == THUMB_BYTES
+                         && tmp.seekSet(thumbPixelsOffset(capacity, i))
+                         && tmp.write(pixels, THUMB_BYTES) == THUMB_BYTES;
+                    lock.yield();
+                }
+
+                if (ok)
+                {
+                    pak.remove();
+                    ok = tmp.rename(path.c_str());
+                    pak = tmp;
+                }
+                else
+                {
+                    tmp.remove();
+                }
+            }
+
+            blockPool.release(pixels);
+
+            if (!ok)
+            {
+                free(newKeys);
+                return false;
+            }
+
+            free(keys);
+            keys = newKeys;
+            hdr.capacity = capacity;
+            return true;
+        }
+
+        // Guarda la miniatura y su clave en el hueco indicado
+        bool writeSlot(File32 &pak, tThumbPackHeader &hdr, tThumbKey* keys, uint32_t slot, const uint8_t* pixels)
+        {
+            std::lock_guard<std::mutex> lk(_packMtx);
+            SDioLock lock(SDIO_BACKGROUND);
+
+            bool ok = true;
+            if (keys[slot].status == THUMB_OK)
+            {
+                ok = pak.seekSet(thumbPixelsOffset(hdr.capacity, slot))
+                     && pak.write(pixels, THUMB_BYTES) == THUMB_BYTES;
+            }
+
+            ok = ok && pak.seekSet(thumbKeyOffset(slot))
+                    && pak.write(&keys[slot], sizeof(tThumbKey)) == sizeof(tThumbKey)
+                    && pak.seekSet(0)
+                    && pak.write(&hdr, sizeof(hdr)) == sizeof(hdr);
+
+            pak.sync();
+            return ok;
+        }
+
+        void processDir(const String &dir)
+        {
+            unsigned long t0 = millis();
+            File32 pak;
+            tThumbPackHeader hdr;
+            tThumbKey* keys = nullptr;
+
+            if (!waitIdle() || !openPack(dir, pak, hdr, keys))
+            {
+                return;
+            }
+
+            // Entradas vistas en este recorrido (para liberar las de ficheros borrados)
+            uint8_t* seen = (uint8_t*)ps_calloc(hdr.capacity, 1);
+            uint32_t seenCapacity = hdr.capacity;
+            uint8_t* pixels = (uint8_t*)blockPool.alloc(THUMB_BYTES);
+
+            File32 d;
+            File32 entry;
+            char name[256];
+            bool complete = false;
+
+            {
+                SDioLock lock(SDIO_BACKGROUND);
+                if (!d.open(dir.c_str(), O_RDONLY))
+                {
+                    seenCapacity = 0;
+                }
+            }
+
+            while (seen != nullptr && pixels != nullptr && seenCapacity != 0)
+            {
+                if (!waitIdle())
+                {
+                    break;
+                }
+
+                uint32_t size;
+                uint16_t date;
+                uint16_t time;
+                bool skip;
+
+                {
+                    SDioLock lock(SDIO_BACKGROUND);
+                    if (!entry.openNext(&d, O_RDONLY))
+                    {
+                        complete = true;
+                        break;
+                    }
+                    entry.getName(name, sizeof(name));
+                    skip = entry.isDir() || entry.isHidden();
+                    size = entry.fileSize();
+                    entry.getModifyDateTime(&date, &time);
+                    entry.close();
+                }
+
+                bool tzx;
+                if (skip || !thumbIsTape(name, tzx))
+                {
+                    continue;
+                }
+
+                _stats.scanned++;
+
+                uint32_t hash = thumbNameHash(name);
+                int32_t slot = -1;
+                int32_t freeSlot = -1;
+
+                for (uint32_t i = 0; i < hdr.count; i++)
+                {
+                    if (keys[i].status == THUMB_EMPTY)
+                    {
+                        if (freeSlot < 0) freeSlot = i;
+                    }
+                    else if (keys[i].nameHash == hash)
+                    {
+                        slot = i;
+                        break;
+                    }
+                }
+
+                if (slot >= 0 && keys[slot].size == size && keys[slot].date == date && keys[slot].time == time)
+                {
+                    // Sin cambios
+                    seen[slot] = 1;
+                    continue;
+                }
+
+                uint8_t status = extract(join(dir, name), tzx, pixels);
+
+                if (slot < 0)
+                {
+                    slot = freeSlot;
+                }
+                if (slot < 0)
+                {
+                    if (hdr.count == hdr.capacity && !grow(dir, pak, hdr, keys))
+                    {
+                        _stats.errors++;
+                        break;
+                    }
+                    if (hdr.capacity > seenCapacity)
+                    {
+                        uint8_t* s = (uint8_t*)ps_calloc(hdr.capacity, 1);
+                        if (s == nullptr)
+                        {
+                            break;
+                        }
+                        memcpy(s, seen, seenCapacity);
+                        free(seen);
+                        seen = s;
+                        seenCapacity = hdr.capacity;
+                    }
+                    slot = hdr.count++;
+                }
+
+                keys[slot].nameHash = hash;
+                keys[slot].size = size;
+                keys[slot].date = date;
+                keys[slot].time = time;
+                keys[slot].status = status;
+                seen[slot] = 1;
+
+                if (!writeSlot(pak, hdr, keys, slot, pixels))
+                {
+                    _stats.errors++;
+                    break;
+                }
+
+                if (status == THUMB_OK)
+                {
+                    _stats.extracted++;
+                }
+                else
+                {
+                    _stats.noScreen++;
+                }
+            }
+
+            // Recorrido completo. Se liberan las entradas de ficheros que ya no están.
+            if (complete)
+            {
+                for (uint32_t i = 0; i < hdr.count; i++)
+                {
+                    if (keys[i].status != THUMB_EMPTY && !seen[i])
+                    {
+                        keys[i].status = THUMB_EMPTY;
+                        writeSlot(pak, hdr, keys, i, nullptr);
+                    }
+                }
+                _stats.lastDirMs = millis() - t0;
+
+                #ifdef DEBUGMODE
+                    logln("Thumbnails " + dir + ": " + String(_stats.extracted) + " new, "
+                          + String(_stats.noScreen) + " without screen, " + String(_stats.lastDirMs) + " ms");
+                #endif
+            }
+
+            free(seen);
+            free(keys);
+            blockPool.release(pixels);
+
+            SDioLock lock(SDIO_BACKGROUND);
+            d.close();
+            pak.close();
+        }
+
+    public:
+
+        // Pide (de forma asíncrona) actualizar las miniaturas de un directorio.
+        // Sin "force" no se repite si es el último que se pidió (cambios de página del browser).
+        void request(const String &dir, bool force = false)
+        {
+            if (_task == nullptr)
+            {
+                _go = xSemaphoreCreateBinary();
+                // Prioridad mínima, en el núcleo del HMI
+                xTaskCreatePinnedToCore(worker, "thumbs", 6144, this, 1, &_task, 1);
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(_reqMtx);
+                if (!force && dir == _requested)
+                {
+                    return;
+                }
+                _requested = dir;
+                _newRequest = true;
+            }
+            xSemaphoreGive(_go);
+        }
+
+        // Lee la miniatura de un fichero. pixels = THUMB_BYTES. false si no la hay
+        bool get(const String &dir, const String &name, uint8_t* pixels)
+        {
+            String path = join(dir, THUMB_PACK_NAME);
+            uint32_t hash = thumbNameHash(name.c_str());
+            tThumbPackHeader hdr;
+            tThumbKey keys[32];
+            File32 pak;
+
+            std::lock_guard<std::mutex> lk(_packMtx);
+            SDioLock lock(SDIO_INTERACTIVE);
+
+            if (!pak.open(path.c_str(), O_RDONLY))
+            {
+                return false;
+            }
+
+            bool found = false;
+
+            if (pak.read(&hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == THUMB_PACK_MAGIC
+                && hdr.version == THUMB_PACK_VERSION && hdr.thumbBytes == THUMB_BYTES)
+            {
+                for (uint32_t i = 0; i < hdr.count && !found; i += 32)
+                {
+                    uint32_t n = hdr.count - i < 32 ? hdr.count - i : 32;
+                    if (pak.read(keys, n * sizeof(tThumbKey)) != (int)(n * sizeof(tThumbKey)))
+                    {
+                        break;
+                    }
+
+                    for (uint32_t k = 0; k < n; k++)
+                    {
+                        if (keys[k].status == THUMB_OK && keys[k].nameHash == hash)
+                        {
+                            found = pak.seekSet(thumbPixelsOffset(hdr.capacity, i + k))
+                                    && pak.read(pixels, THUMB_BYTES) == THUMB_BYTES;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            pak.close();
+            return found;
+        }
+
+        // Pinta la miniatura de la cinta insertada en la zona de la pantalla de carga
+        void show(const String &path)
+        {
+            #if THUMB_SHIFT >= SCR_PREVIEW_SHIFT
+                int slash = path.lastIndexOf('/');
+                if (slash < 0)
+                {
+                    return;
+                }
+
+                uint8_t* pixels = (uint8_t*)blockPool.alloc(THUMB_BYTES);
+                uint8_t* img = (uint8_t*)blockPool.alloc(THUMB_W * THUMB_H);
+
+                if (pixels != nullptr && img != nullptr
+                    && get(path.substring(0, slash + 1), path.substring(slash + 1), pixels))
+                {
+                    thumbUnpack(pixels, img);
+                    screenPreview.submitImage(path, THUMB_PREVIEW_BLOCK, img, THUMB_W, THUMB_H,
+                                              1 << (THUMB_SHIFT - SCR_PREVIEW_SHIFT));
+                }
+
+                blockPool.release(pixels);
+                blockPool.release(img);
+            #endif
+        }
+
+        // Hay un directorio en curso o pedido
+        bool busy()
+        {
+            return _busy || _newRequest;
+        }
+
+        tThumbStats getStats()
+        {
+            return _stats;
+        }
+};
+
+// Instancia única
+ThumbCache thumbCache;
+
+#endif
@@ -0,0 +1,576 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: TransportBus.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Canal de órdenes del transporte (PLAY, STOP, PAUSE, FFWD, RWD, EJECT, REC, salto a un
+    bloque o a un instante de la cinta, carga de un fichero, volumen y polaridad) desde el HMI
+    y la web hacia la tarea del reproductor.
+
+    Antes cada orden escribía directamente PLAY/STOP/PAUSE/... desde la tarea del HMI y el
+    reproductor los consultaba en cada muestra. Ahora:
+
+      - post() encola la orden (cola fija, sin memoria dinámica) y devuelve un número de
+        secuencia. Las que interrumpen la salida (STOP, PAUSE, EJECT, SEEK) levantan además un testigo de cancelación atómico.
+      - El generador de audio consulta el testigo una vez por buffer (createPulse), no por
+        muestra. Si está levantado, aplica las órdenes pendientes y corta.
+      - transportService() aplica las órdenes a las variables globales desde la tarea del
+        reproductor (al principio de cada vuelta de tapeControl y al cortar) y confirma cada
+        una con ack(). El que envía puede esperar la confirmación con waitAck().
+      - Se mide la latencia desde post() hasta ack() (/api/status, campo "transport").
+
+    El núcleo solo usa la STL (mutex y condition_variable, igual que SDscheduler), así que
+    funciona tal cual en el ESP32 y en el host con std::thread. No hay una versión aparte con
+    xQueue y event groups: en el ESP32 el mutex y la condition_variable son los de pthread de
+    ESP-IDF, que ya van sobre semáforos de FreeRTOS, y una cola de FreeRTOS no permite lo que
+    necesita el bus (adelantar las órdenes de corte en takeCancels, perder la más antigua
+    con la cola llena y esperar la confirmación de un número de secuencia en waitAck).
+    test/test_transportbus mide en el host la latencia post() --> ack() y la entrega del
+    testigo con el reproductor en otro hilo.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Órdenes en cola. Si se llena, se pierde la más antigua (vale la última intención).
+#ifndef TRANSPORT_QUEUE_SIZE
+  #define TRANSPORT_QUEUE_SIZE 16
+#endif
+
+enum tTransportCmd
+{
+    TCMD_NONE = 0,
+    TCMD_PLAY,
+    TCMD_STOP,
+    TCMD_PAUSE,
+    TCMD_FFWD,
+    TCMD_RWD,
+    TCMD_EJECT,
+    TCMD_REC,
+    // arg = bloque
+    TCMD_SEEK,
+    // arg = milisegundos desde el principio de la cinta
+    TCMD_SEEK_MS,
+    // Meter un fichero en la cinta. La ruta se deja con transportLoad()
+    TCMD_LOAD,
+    // arg = volumen 0-100
+    TCMD_VOLUME,
+    // arg = 1 empieza en DOWN (señal invertida), 0 empieza en UP
+    TCMD_POLARITY,
+    // Mensaje para LAST_MESSAGE. El texto se deja con transportNotice()
+    TCMD_NOTICE,
+    // Borra la información del fichero (nombre, grupo, bloques)
+    TCMD_CLEARINFO
+};
+
+struct tTransportMsg
+{
+    uint8_t cmd = TCMD_NONE;
+    int32_t arg = 0;
+    uint32_t seq = 0;
+    // Instante de post() (us)
+    uint32_t tPostUs = 0;
+};
+
+struct tTransportStats
+{
+    uint32_t posted = 0;
+    uint32_t acked = 0;
+    // Órdenes perdidas por cola llena
+    uint32_t overflows = 0;
+    // Latencia post() --> ack()
+    uint32_t lastAckUs = 0;
+    uint32_t maxAckUs = 0;
+    uint64_t totalAckUs = 0;
+};
+
+class TransportBus
+{
+    private:
+
+        std::mutex _mtx;
+        std::condition_variable _cv;
+
+        tTransportMsg _q[TRANSPORT_QUEUE_SIZE];
+        int _head = 0;
+        int _count = 0;
+
+        uint32_t _nextSeq = 1;
+        uint32_t _ackedSeq = 0;
+
+        // Orden que ha levantado el testigo (TCMD_NONE = ninguna)
+        std::atomic<uint8_t> _cancel{TCMD_NONE};
+
+        tTransportStats _stats;
+
+        static uint32_t nowUs()
+        {
+            using namespace std::chrono;
+            return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Con _mtx cogido. La última orden de corte que sigue en la cola.
+        uint8_t pendingCancel()
+        {
+            uint8_t c = TCMD_NONE;
+            for (int n = 0; n < _count; n++)
+            {
+                const tTransportMsg &m = _q[(_head + n) % TRANSPORT_QUEUE_SIZE];
+                if (cancels(m.cmd))
+                {
+                    c = m.cmd;
+                }
+            }
+            return c;
+        }
+
+    public:
+
+        // ¿Esta orden tiene que cortar la salida de audio en curso?
+        static bool cancels(uint8_t cmd)
+        {
+            // Un salto durante la reproducción también corta el buffer en curso
+            return cmd == TCMD_STOP || cmd == TCMD_PAUSE || cmd == TCMD_EJECT ||
+                   cmd == TCMD_SEEK || cmd == TCMD_SEEK_MS;
+        }
+
+        // ¿Esta orden deja la cinta parada? Anula PLAY/REC/FFWD/RWD anteriores
+        static bool halts(uint8_t cmd)
+        {
+            return cmd == TCMD_STOP || cmd == TCMD_PAUSE || cmd == TCMD_EJECT;
+        }
+
+        // Desde cualquier tarea. Devuelve el número de secuencia para waitAck().
+        uint32_t post(uint8_t cmd, int32_t arg = 0)
+        {
+            uint32_t seq;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+
+                if (_count == TRANSPORT_QUEUE_SIZE)
+                {
+                    _head = (_head + 1) % TRANSPORT_QUEUE_SIZE;
+                    _count--;
+                    _stats.overflows++;
+                }
+
+                tTransportMsg &m = _q[(_head + _count) % TRANSPORT_QUEUE_SIZE];
+                m.cmd = cmd;
+                m.arg = arg;
+                m.seq = seq = _nextSeq++;
+                m.tPostUs = nowUs();
+                _count++;
+                _stats.posted++;
+
+                if (cancels(cmd))
+                {
+                    _cancel.store(cmd, std::memory_order_release);
+                }
+            }
+            _cv.notify_all();
+            return seq;
+        }
+
+        // Testigo de cancelación. Una lectura atómica, para el camino del audio.
+        inline uint8_t cancelRequested()
+        {
+            return _cancel.load(std::memory_order_acquire);
+        }
+
+        // Siguiente orden, sin esperar
+        bool poll(tTransportMsg &m)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_count == 0)
+            {
+                return false;
+            }
+            m = _q[_head];
+            _head = (_head + 1) % TRANSPORT_QUEUE_SIZE;
+            _count--;
+            return true;
+        }
+
+        // Saca de la cola, en orden, las órdenes de corte y las PLAY/REC/FFWD/RWD que un
+        // STOP/PAUSE/EJECT posterior deja sin efecto. El resto (LOAD, VOLUME, POLARITY y lo
+        // que llegue después del último corte) se queda para transportService().
+        // Devuelve cuántas ha dejado en "out"
+        int takeCancels(tTransportMsg* out, int max)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+
+            int lastHalt = -1;
+            for (int n = 0; n < _count; n++)
+            {
+                if (halts(_q[(_head + n) % TRANSPORT_QUEUE_SIZE].cmd))
+                {
+                    lastHalt = n;
+                }
+            }
+
+            tTransportMsg keep[TRANSPORT_QUEUE_SIZE];
+            int kept = 0;
+            int taken = 0;
+            for (int n = 0; n < _count; n++)
+            {
+                const tTransportMsg &m = _q[(_head + n) % TRANSPORT_QUEUE_SIZE];
+                bool superseded = n < lastHalt && (m.cmd == TCMD_PLAY || m.cmd == TCMD_REC ||
+                                                   m.cmd == TCMD_FFWD || m.cmd == TCMD_RWD);
+                if ((cancels(m.cmd) || superseded) && taken < max)
+                {
+                    out[taken++] = m;
+                }
+                else
+                {
+                    keep[kept++] = m;
+                }
+            }
+
+            for (int n = 0; n < kept; n++)
+            {
+                _q[n] = keep[n];
+            }
+            _head = 0;
+            _count = kept;
+            return taken;
+        }
+
+        // Siguiente orden, esperando como mucho timeoutMs
+        bool wait(tTransportMsg &m, uint32_t timeoutMs)
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+            if (!_cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&]{ return _count != 0; }))
+            {
+                return false;
+            }
+            m = _q[_head];
+            _head = (_head + 1) % TRANSPORT_QUEUE_SIZE;
+            _count--;
+            return true;
+        }
+
+        // La orden se ha aplicado
+        void ack(const tTransportMsg &m)
+        {
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+
+                uint32_t us = nowUs() - m.tPostUs;
+                _stats.acked++;
+                _stats.lastAckUs = us;
+                _stats.totalAckUs += us;
+                if (us > _stats.maxAckUs)
+                {
+                    _stats.maxAckUs = us;
+                }
+
+                // Hechas: todas las anteriores a la más antigua que sigue en la cola. Las de
+                // corte pueden adelantarse a otras más viejas (takeCancels)
+                uint32_t done = _count > 0 ? _q[_head].seq - 1 : _nextSeq - 1;
+                if ((int32_t)(done - _ackedSeq) > 0)
+                {
+                    _ackedSeq = done;
+                }
+
+                // Se baja el testigo salvo que quede otra orden de corte en la cola
+                if (cancels(m.cmd))
+                {
+                    _cancel.store(pendingCancel(), std::memory_order_release);
+                }
+            }
+            _cv.notify_all();
+        }
+
+        // Espera a que se haya aplicado la orden "seq" (o una posterior)
+        bool waitAck(uint32_t seq, uint32_t timeoutMs)
+        {
+            std::unique_lock<std::mutex> lk(_mtx);
+            return _cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&]{ return (int32_t)(_ackedSeq - seq) >= 0; });
+        }
+
+        // Sin esperar: ya se ha aplicado la orden "seq" (o una posterior)
+        bool acked(uint32_t seq)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return (int32_t)(_ackedSeq - seq) >= 0;
+        }
+
+        tTransportStats getStats()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _stats;
+        }
+
+        void resetStats()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _stats = tTransportStats();
+        }
+
+        static const char* name(uint8_t cmd)
+        {
+            switch (cmd)
+            {
+                case TCMD_PLAY:  return "PLAY";
+                case TCMD_STOP:  return "STOP";
+                case TCMD_PAUSE: return "PAUSE";
+                case TCMD_FFWD:  return "FFWD";
+                case TCMD_RWD:   return "RWD";
+                case TCMD_EJECT: return "EJECT";
+                case TCMD_REC:   return "REC";
+                case TCMD_SEEK:  return "SEEK";
+                case TCMD_SEEK_MS: return "SEEK_MS";
+                case TCMD_LOAD:  return "LOAD";
+                case TCMD_VOLUME: return "VOLUME";
+                case TCMD_POLARITY: return "POLARITY";
+                case TCMD_NOTICE: return "NOTICE";
+                case TCMD_CLEARINFO: return "CLEARINFO";
+                default:         return "NONE";
+            }
+        }
+};
+
+// Instancia única
+TransportBus transport;
+
+#ifdef ARDUINO
+
+// Ruta de la orden LOAD. La escribe quien envía y la lee la tarea del reproductor
+std::mutex transportLoadMtx;
+char transportLoadPath[256] = {};
+
+// Pide meter "path" en la cinta. Se hace en el reposo o con la cinta parada, así que si
+// está reproduciendo o grabando hay que mandar antes STOP.
+uint32_t transportLoad(const char* path)
+{
+    {
+        std::lock_guard<std::mutex> lk(transportLoadMtx);
+        statusCopy(transportLoadPath, sizeof(transportLoadPath), path);
+    }
+    return transport.post(TCMD_LOAD);
+}
+
+// Texto de la orden NOTICE. Los String compartidos (LAST_MESSAGE, PROGRAM_NAME, LAST_GROUP)
+// solo los escribe la tarea del reproductor, que es la que publica TapeStatus.
+std::mutex transportNoticeMtx;
+char transportNoticeText[STATUS_MSG_LEN] = {};
+
+uint32_t transportNotice(const char* msg)
+{
+    {
+        std::lock_guard<std::mutex> lk(transportNoticeMtx);
+        statusCopy(transportNoticeText, sizeof(transportNoticeText), msg);
+    }
+    return transport.post(TCMD_NOTICE);
+}
+
+// Salto a un bloque. Reproduciendo, el procesador continúa en él en el siguiente buffer.
+// Con la cinta parada o en pausa solo se selecciona.
+void transportSeek(int block, int pass = 0)
+{
+    if (block < 0 || block > TOTAL_BLOCKS)
+    {
+        return;
+    }
+
+    if (LOADING_STATE == 1)
+    {
+        if (block < tapeSeek.table().count())
+        {
+            tapeSeek.request(block, pass);
+        }
+    }
+    else
+    {
+        BLOCK_SELECTED = block;
+        // Esto lo hacemos para poder actualizar la info del bloque
+        UPDATE_HMI = true;
+    }
+}
+
+// Aplica una orden a las variables del transporte. Solo desde la tarea del reproductor.
+void transportApply(const tTransportMsg &m)
+{
+    switch (m.cmd)
+    {
+        case TCMD_PLAY:
+            PLAY = true;
+            PAUSE = false;
+            STOP = false;
+            REC = false;
+            EJECT = false;
+            ABORT = false;
+            BTN_PLAY_PRESSED = true;
+            break;
+
+        case TCMD_STOP:
+            PLAY = false;
+            PAUSE = false;
+            STOP = true;
+            REC = false;
+            ABORT = true;
+            EJECT = false;
+            BLOCK_SELECTED = 0;
+            BYTES_LOADED = 0;
+            break;
+
+        case TCMD_PAUSE:
+            PLAY = false;
+            PAUSE = true;
+            STOP = false;
+            REC = false;
+            ABORT = true;
+            EJECT = false;
+            break;
+
+        case TCMD_FFWD:
+            FFWIND = true;
+            RWIND = false;
+            break;
+
+        case TCMD_RWD:
+            FFWIND = false;
+            RWIND = true;
+            break;
+
+        case TCMD_EJECT:
+            PLAY = false;
+            PAUSE = false;
+            STOP = true;
+            REC = false;
+            ABORT = false;
+            EJECT = true;
+            break;
+
+        case TCMD_REC:
+            PLAY = false;
+            PAUSE = false;
+            STOP = false;
+            REC = true;
+            ABORT = false;
+            EJECT = false;
+            break;
+
+        case TCMD_SEEK:
+            transportSeek(m.arg);
+            break;
+
+        case TCMD_SEEK_MS:
+            if (tapeSeek.table().ready())
+            {
+                int pass = 0;
+                int block = tapeSeek.table().blockAt((uint32_t)m.arg, &pass);
+                transportSeek(block, pass);
+            }
+            break;
+
+        case TCMD_LOAD:
+        {
+            std::lock_guard<std::mutex> lk(transportLoadMtx);
+            PATH_FILE_TO_LOAD = transportLoadPath;
+            FILE_LOAD = PATH_FILE_TO_LOAD.substring(PATH_FILE_TO_LOAD.lastIndexOf('/') + 1);
+            FILE_SELECTED = PATH_FILE_TO_LOAD.length() > 0;
+            LOAD_REQUEST = FILE_SELECTED;
+            break;
+        }
+
+        case TCMD_VOLUME:
+            MAIN_VOL = (m.arg < 0) ? 0 : (m.arg > MAX_MAIN_VOL ? MAX_MAIN_VOL : m.arg);
+            MAIN_VOL_L = MAIN_VOL;
+            MAIN_VOL_R = MAIN_VOL;
+            break;
+
+        case TCMD_POLARITY:
+            INVERSETRAIN = (m.arg == 1);
+            // Para que empiece en DOWN, POLARIZATION = up
+            POLARIZATION = INVERSETRAIN ? up : down;
+            LAST_EAR_IS = POLARIZATION;
+            break;
+
+        case TCMD_NOTICE:
+        {
+            std::lock_guard<std::mutex> lk(transportNoticeMtx);
+            LAST_MESSAGE = transportNoticeText;
+            break;
+        }
+
+        case TCMD_CLEARINFO:
+            PROGRAM_NAME = "";
+            PROGRAM_NAME_2 = "";
+            LAST_GROUP = "";
+            LAST_NAME[0] = 0;
+            LAST_TYPE[0] = 0;
+            LAST_SIZE = 0;
+            TOTAL_BLOCKS = 0;
+            BLOCK_SELECTED = 0;
+            BYTES_LOADED = 0;
+            PROGRESS_BAR_BLOCK_VALUE = 0;
+            PROGRESS_BAR_TOTAL_VALUE = 0;
+            break;
+    }
+}
+
+// Aplica y confirma las órdenes pendientes. Solo desde la tarea del reproductor.
+void transportService()
+{
+    tTransportMsg m;
+    while (transport.poll(m))
+    {
+        transportApply(m);
+        transport.ack(m);
+    }
+}
+
+// Solo las órdenes de corte, a mitad de un bloque. Las PLAY/REC/FFWD/RWD anuladas por un
+// STOP/PAUSE/EJECT posterior se confirman sin aplicar. LOAD, REC, VOLUME y POLARITY esperan
+// a transportService() en el bucle principal.
+void transportServiceCancels()
+{
+    tTransportMsg taken[TRANSPORT_QUEUE_SIZE];
+    int n = transport.takeCancels(taken, TRANSPORT_QUEUE_SIZE);
+    for (int i = 0; i < n; i++)
+    {
+        if (TransportBus::cancels(taken[i].cmd))
+        {
+            transportApply(taken[i]);
+        }
+    }
+    // Se confirman cuando están todas aplicadas
+    for (int i = 0; i < n; i++)
+    {
+        transport.ack(taken[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,827 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: UploadSink.h
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Subida de ficheros desde la web a la SD.
+
+    TCP entrega los datos en trozos del tamaño de un segmento (1-3 KB), sin alinear. Escribirlos
+    tal cual obliga a SdFat a leer-modificar-escribir sectores y a pedir el bus muchas veces.
+    Aquí se juntan en escrituras de UPLOAD_BUFFER_BYTES (múltiplo del sector), de modo que cada
+    escritura empieza alineada en el fichero y sale como escritura multisector. Si se conoce el
+    tamaño del fichero se reservan antes sus clusters contiguos.
+
+    También extrae al vuelo un tar (ustar, nombres largos GNU y pax) que llega por la red, sin
+    copia temporal en la SD.
+
+    UploadCoalescer y TarReader solo dependen de la STL para poder probarse en el host.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Tamaño de cada escritura a la SD. Múltiplo de UPLOAD_SECTOR
+#ifndef UPLOAD_BUFFER_BYTES
+  #define UPLOAD_BUFFER_BYTES 32768
+#endif
+
+#define UPLOAD_SECTOR 512
+#define TAR_BLOCK 512
+#define TAR_NAME_MAX 256
+
+struct tUploadStats
+{
+    uint32_t files = 0;         // Ficheros escritos
+    uint32_t tarFiles = 0;      // De ellos, extraídos de un tar
+    uint32_t preallocated = 0;  // Con clusters reservados de antemano
+    uint32_t errors = 0;
+    uint32_t writes = 0;        // Escrituras a la SD
+    uint64_t bytes = 0;
+    // Última petición completa
+    uint32_t lastBytes = 0;
+    uint32_t lastUs = 0;
+    uint32_t lastKBps = 0;
+    uint32_t bestKBps = 0;
+};
+
+// Junta los trozos que llegan en escrituras de tamaño fijo. Como todas (salvo la última)
+// son de _cap bytes, cada una empieza en el fichero en un múltiplo del sector
+class UploadCoalescer
+{
+    private:
+
+        uint8_t* _buf = nullptr;
+        size_t _cap = 0;
+        size_t _len = 0;
+
+    public:
+
+        // Sin buffer los datos pasan directos
+        void attach(uint8_t* buf, size_t cap)
+        {
+            _buf = buf;
+            _cap = (buf != nullptr) ? cap - cap % UPLOAD_SECTOR : 0;
+            _len = 0;
+        }
+
+        size_t pending() const
+        {
+            return _len;
+        }
+
+        // W: size_t(const uint8_t*, size_t). Devuelve false si falla una escritura
+        template <class W>
+        bool push(const uint8_t* data, size_t len, W&& write)
+        {
+            if (_cap == 0)
+            {
+                return len == 0 || write(data, len) == len;
+            }
+
+            while (len > 0)
+            {
+                // Con el buffer vacío los bloques completos van directos, sin copia
+                if (_len == 0 && len >= _cap)
+                {
+                    size_t n = len - len % _cap;
+                    if (write(data, n) != n)
+                    {
+                        return false;
+                    }
+                    data += n;
+                    len -= n;
+                    continue;
+                }
+
+                size_t n = _cap - _len;
+                if (n > len)
+                {
+                    n = len;
+                }
+                memcpy(_buf + _len, data, n);
+                _len += n;
+                data += n;
+                len -= n;
+
+                if (_len == _cap)
+                {
+                    _len = 0;
+                    if (write(_buf, _cap) != _cap)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        template <class W>
+        bool flush(W&& write)
+        {
+            if (_len == 0)
+            {
+                return true;
+            }
+            size_t n = _len;
+            _len = 0;
+            return write(_buf, n) == n;
+        }
+
+        void reset()
+        {
+            _len = 0;
+        }
+};
+
+struct tTarEntry
+{
+    // Ruta relativa, ya saneada (sin "/" inicial ni "..")
+    char name[TAR_NAME_MAX];
+    uint32_t size = 0;
+    bool isDir = false;
+};
+
+// Lector de tar por flujo. Los datos pueden llegar en trozos de cualquier tamaño.
+// C tiene que ofrecer:
+//   bool begin(const tTarEntry&)          - nuevo fichero o directorio. false = saltarlo
+//   void data(const uint8_t*, size_t)     - contenido del fichero
+//   void end()                            - fin del fichero
+class TarReader
+{
+    private:
+
+        enum { TAR_HEADER, TAR_DATA, TAR_EXT, TAR_PAD, TAR_END };
+
+        uint8_t _hdr[TAR_BLOCK];
+        size_t _hdrLen = 0;
+        int _state = TAR_HEADER;
+        // Datos del miembro actual que quedan y relleno hasta el siguiente bloque
+        uint64_t _size = 0;
+        uint64_t _left = 0;
+        uint32_t _pad = 0;
+        // El contenido va al callback
+        bool _emit = false;
+        bool _error = false;
+        int _zeros = 0;
+
+        // Nombre largo (GNU 'L') o cabecera pax ('x') para el siguiente miembro
+        char _ext[2 * TAR_BLOCK];
+        size_t _extLen = 0;
+        bool _extPax = false;
+        char _longName[TAR_NAME_MAX];
+        bool _haveLong = false;
+
+        tTarEntry _entry;
+
+        static uint64_t octal(const uint8_t* p, size_t n)
+        {
+            // Extensión base-256 de GNU para tamaños grandes
+            if (p[0] & 0x80)
+            {
+                uint64_t v = p[0] & 0x7F;
+                for (size_t i = 1; i < n; i++)
+                {
+                    v = (v << 8) | p[i];
+                }
+                return v;
+            }
+
+            uint64_t v = 0;
+            size_t i = 0;
+            while (i < n && p[i] == ' ')
+            {
+                i++;
+            }
+            while (i < n && p[i] >= '0' && p[i] <= '7')
+            {
+                v = (v << 3) | (p[i] - '0');
+                i++;
+            }
+            return v;
+        }
+
+        bool checksumOk() const
+        {
+            uint32_t sum = 0;
+            int32_t ssum = 0;
+            for (int i = 0; i < TAR_BLOCK; i++)
+            {
+                uint8_t c = (i >= 148 && i < 156) ? ' ' : _hdr[i];
+                sum += c;
+                ssum += (int8_t)c;
+            }
+            uint64_t stored = octal(_hdr + 148, 8);
+            return stored == sum || stored == (uint64_t)(uint32_t)ssum;
+        }
+
+        // Copia un campo de tamaño fijo que puede no acabar en NUL
+        static size_t field(char* out, size_t cap, const uint8_t* p, size_t n)
+        {
+            size_t len = 0;
+            while (len < n && p[len] != 0 && len + 1 < cap)
+            {
+                out[len] = (char)p[len];
+                len++;
+            }
+            out[len] = 0;
+            return len;
+        }
+
+        // Quita "/" y "./" iniciales y el "/" final. false si sale de la carpeta destino
+        static bool sanitize(char* name)
+        {
+            char* s = name;
+            while (*s == '/' || (s[0] == '.' && s[1] == '/'))
+            {
+                s += (*s == '/') ? 1 : 2;
+            }
+            memmove(name, s, strlen(s) + 1);
+
+            size_t len = strlen(name);
+            while (len > 0 && name[len - 1] == '/')
+            {
+                name[--len] = 0;
+            }
+
+            if (len == 0 || strcmp(name, ".") == 0)
+            {
+                return false;
+            }
+
+            // Ningún componente puede ser ".."
+            const char* c = name;
+            while (*c)
+            {
+                const char* e = strchr(c, '/');
+                size_t n = e ? (size_t)(e - c) : strlen(c);
+                if (n == 2 && c[0] == '.' && c[1] == '.')
+                {
+                    return false;
+                }
+                c += n;
+                if (*c == '/')
+                {
+                    c++;
+                }
+            }
+            return true;
+        }
+
+        // Registros pax "<len> clave=valor\n". Solo interesa path
+        void parsePax()
+        {
+            size_t i = 0;
+            while (i < _extLen)
+            {
+                size_t recLen = 0;
+                size_t j = i;
+                while (j < _extLen && _ext[j] >= '0' && _ext[j] <= '9')
+                {
+                    recLen = recLen * 10 + (_ext[j] - '0');
+                    j++;
+                }
+                if (recLen == 0 || i + recLen > _extLen || j >= _extLen || _ext[j] != ' ')
+                {
+                    return;
+                }
+
+                const char* kv = _ext + j + 1;
+                size_t kvLen = i + recLen - (j + 1);
+                if (kvLen > 5 && memcmp(kv, "path=", 5) == 0)
+                {
+                    size_t n = kvLen - 5;
+                    if (n > 0 && kv[5 + n - 1] == '\n')
+                    {
+                        n--;
+                    }
+                    if (n < TAR_NAME_MAX)
+                    {
+                        memcpy(_longName, kv + 5, n);
+                        _longName[n] = 0;
+                        _haveLong = true;
+                    }
+                }
+                i += recLen;
+            }
+        }
+
+        void startPad(uint64_t size)
+        {
+            _pad = (uint32_t)((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+            _state = _pad ? TAR_PAD : TAR_HEADER;
+        }
+
+        template <class C>
+        void header(C& cb)
+        {
+            bool zero = true;
+            for (int i = 0; i < TAR_BLOCK && zero; i++)
+            {
+                zero = (_hdr[i] == 0);
+            }
+            if (zero)
+            {
+                // Dos bloques a cero cierran el archivo
+                if (++_zeros == 2)
+                {
+                    _state = TAR_END;
+                }
+                return;
+            }
+            _zeros = 0;
+
+            if (!checksumOk())
+            {
+                _error = true;
+                _state = TAR_END;
+                return;
+            }
+
+            uint64_t size = octal(_hdr + 124, 12);
+            _size = size;
+            char type = (char)_hdr[156];
+
+            // Nombre largo o pax: su contenido es el nombre del siguiente miembro
+            if (type == 'L' || type == 'x')
+            {
+                _extPax = (type == 'x');
+                _extLen = 0;
+                _left = size;
+                _emit = false;
+                _state = TAR_EXT;
+                if (size == 0)
+                {
+                    startPad(0);
+                }
+                return;
+            }
+
+            if (_haveLong)
+            {
+                strcpy(_entry.name, _longName);
+                _haveLong = false;
+            }
+            else
+            {
+                size_t n = 0;
+                // ustar: prefijo + "/" + nombre
+                if (memcmp(_hdr + 257, "ustar", 5) == 0 && _hdr[345] != 0)
+                {
+                    n = field(_entry.name, TAR_NAME_MAX, _hdr + 345, 155);
+                    _entry.name[n++] = '/';
+                }
+                field(_entry.name + n, TAR_NAME_MAX - n, _hdr, 100);
+            }
+
+            bool isFile = (type == '0' || type == 0 || type == '7');
+            bool isDir = (type == '5');
+
+            _entry.isDir = isDir;
+            _entry.size = (isFile && size <= 0xFFFFFFFFull) ? (uint32_t)size : 0;
+
+            // Enlaces, dispositivos, cabeceras globales... se saltan
+            _emit = (isFile || isDir) && (size <= 0xFFFFFFFFull) && sanitize(_entry.name) && cb.begin(_entry);
+            _emit = _emit && isFile;
+
+            _left = size;
+            if (size == 0)
+            {
+                if (_emit)
+                {
+                    cb.end();
+                }
+                _state = TAR_HEADER;
+                return;
+            }
+            _state = TAR_DATA;
+        }
+
+    public:
+
+        TarReader()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            _hdrLen = 0;
+            _state = TAR_HEADER;
+            _size = 0;
+            _left = 0;
+            _pad = 0;
+            _emit = false;
+            _error = false;
+            _zeros = 0;
+            _extLen = 0;
+            _haveLong = false;
+        }
+
+        // Se leyó el final del archivo
+        bool finished() const
+        {
+            return _state == TAR_END;
+        }
+
+        bool error() const
+        {
+            return _error;
+        }
+
+        // Está a mitad de un miembro
+        bool inEntry() const
+        {
+            return _state == TAR_DATA || _state == TAR_EXT || _state == TAR_PAD;
+        }
+
+        template <class C>
+        bool feed(const uint8_t* data, size_t len, C& cb)
+        {
+            while (len > 0 && _state != TAR_END)
+            {
+                switch (_state)
+                {
+                    case TAR_HEADER:
+                    {
+                        size_t n = TAR_BLOCK - _hdrLen;
+                        if (n > len)
+                        {
+                            n = len;
+                        }
+                        memcpy(_hdr + _hdrLen, data, n);
+                        _hdrLen += n;
+                        data += n;
+                        len -= n;
+
+                        if (_hdrLen == TAR_BLOCK)
+                        {
+                            _hdrLen = 0;
+                            header(cb);
+                        }
+                        break;
+                    }
+
+                    case TAR_DATA:
+                    case TAR_EXT:
+                    {
+                        size_t n = (_left < len) ? (size_t)_left : len;
+                        if (_state == TAR_DATA)
+                        {
+                            if (_emit)
+                            {
+                                cb.data(data, n);
+                            }
+                        }
+                        else
+                        {
+                            size_t room = sizeof(_ext) - _extLen;
+                            size_t c = n < room ? n : room;
+                            memcpy(_ext + _extLen, data, c);
+                            _extLen += c;
+                        }
+                        data += n;
+                        len -= n;
+                        _left -= n;
+
+                        if (_left == 0)
+                        {
+                            if (_state == TAR_DATA)
+                            {
+                                if (_emit)
+                                {
+                                    cb.end();
+                                }
+                                startPad(_size);
+                            }
+                            else
+                            {
+                                if (_extPax)
+                                {
+                                    parsePax();
+                                }
+                                else
+                                {
+                                    // Si no cabe, el miembro se salta (nombre vacío)
+                                    size_t n2 = (_extLen < TAR_NAME_MAX) ? _extLen : 0;
+                                    memcpy(_longName, _ext, n2);
+                                    _longName[n2] = 0;
+                                    _haveLong = true;
+                                }
+                                startPad(_size);
+                            }
+                        }
+                        break;
+                    }
+
+                    case TAR_PAD:
+                    {
+                        size_t n = (_pad < len) ? _pad : len;
+                        data += n;
+                        len -= n;
+                        _pad -= n;
+                        if (_pad == 0)
+                        {
+                            _state = TAR_HEADER;
+                        }
+                        break;
+                    }
+                }
+            }
+            return !_error;
+        }
+};
+
+#ifdef ARDUINO
+
+tUploadStats uploadStats;
+
+// Una subida (petición HTTP). Puede traer varios ficheros seguidos o un tar
+class UploadSession
+{
+    private:
+
+        File32 _f;
+        bool _open = false;
+        bool _failed = false;
+        bool _prealloc = false;
+        String _path;
+
+        uint8_t* _buf = nullptr;
+        UploadCoalescer _co;
+
+        // Extracción de un tar
+        TarReader _tar;
+        String _dest;
+        String _lastDir;
+        bool _untar = false;
+
+        uint32_t _t0 = 0;
+        uint32_t _bytes = 0;
+        uint32_t _files = 0;
+        uint32_t _errors = 0;
+
+        size_t writeOut(const uint8_t* p, size_t n)
+        {
+            uploadStats.writes++;
+            return sdsched.write(_f, p, n, SDIO_INTERACTIVE);
+        }
+
+        void append(const uint8_t* data, size_t len)
+        {
+            if (!_open || _failed)
+            {
+                return;
+            }
+            if (!_co.push(data, len, [this](const uint8_t* p, size_t n) { return writeOut(p, n); }))
+            {
+                _failed = true;
+            }
+        }
+
+        // Crea (si hace falta) la carpeta de un fichero del tar y la apunta en el índice
+        void makeParent(const String& path)
+        {
+            int slash = path.lastIndexOf('/');
+            if (slash <= 0)
+            {
+                return;
+            }
+            String dir = path.substring(0, slash);
+            if (dir == _lastDir)
+            {
+                return;
+            }
+
+            {
+                SDioLock lock(SDIO_INTERACTIVE);
+                if (!sdf.exists(dir.c_str()))
+                {
+                    sdf.mkdir(dir.c_str(), true);
+                }
+            }
+
+            for (int i = _dest.length() + 1; i <= (int)dir.length(); i++)
+            {
+                if (i == (int)dir.length() || dir[i] == '/')
+                {
+                    dirIndex.addPath(dir.substring(0, i).c_str(), true, 0);
+                }
+            }
+            _lastDir = dir;
+        }
+
+    public:
+
+        UploadSession()
+        {
+            _buf = (uint8_t*)blockPool.alloc(UPLOAD_BUFFER_BYTES);
+            _co.attach(_buf, UPLOAD_BUFFER_BYTES);
+            _t0 = micros();
+        }
+
+        ~UploadSession()
+        {
+            if (_open)
+            {
+                // Conexión cortada a mitad de fichero
+                closeFile(false);
+            }
+            blockPool.release(_buf);
+
+            uint32_t us = micros() - _t0;
+            uploadStats.lastBytes = _bytes;
+            uploadStats.lastUs = us;
+            uploadStats.lastKBps = us ? (uint32_t)((uint64_t)_bytes * 1000 / us) : 0;
+            if (_bytes >= UPLOAD_BUFFER_BYTES && uploadStats.lastKBps > uploadStats.bestKBps)
+            {
+                uploadStats.bestKBps = uploadStats.lastKBps;
+            }
+        }
+
+        // sizeHint = tamaño esperado (0 si no se sabe). Si es mayor que el real, lo que
+        // sobra se libera al cerrar
+        bool openFile(const String& path, uint32_t sizeHint)
+        {
+            if (_open)
+            {
+                closeFile(false);
+            }
+
+            SDioLock lock(SDIO_INTERACTIVE);
+            _f = sdf.open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC);
+            _open = _f.isOpen();
+            _failed = !_open;
+            _path = path;
+            _co.reset();
+
+            if (!_open)
+            {
+                _errors++;
+                uploadStats.errors++;
+                logln("Upload not created - " + path);
+                return false;
+            }
+
+            _prealloc = sizeHint > 0 && _f.preAllocate(sizeHint);
+            if (_prealloc)
+            {
+                uploadStats.preallocated++;
+            }
+            return true;
+        }
+
+        void write(const uint8_t* data, size_t len)
+        {
+            _bytes += len;
+            uploadStats.bytes += len;
+            append(data, len);
+        }
+
+        // Cierra el fichero en curso. Si algo falló se borra para no dejarlo a medias
+        bool closeFile(bool complete)
+        {
+            if (!_open)
+            {
+                return false;
+            }
+
+            if (!_co.flush([this](const uint8_t* p, size_t n) { return writeOut(p, n); }))
+            {
+                _failed = true;
+            }
+
+            uint32_t size;
+            {
+                SDioLock lock(SDIO_INTERACTIVE);
+                if (_prealloc)
+                {
+                    // Libera los clusters reservados que no se usaron
+                    _f.truncate();
+                }
+                size = _f.fileSize();
+                _f.close();
+                if (_failed || !complete)
+                {
+                    sdf.remove(_path.c_str());
+                }
+            }
+            _open = false;
+
+            if (_failed || !complete)
+            {
+                _errors++;
+                uploadStats.errors++;
+                logln("Upload failed - " + _path);
+                dirIndex.removePath(_path.c_str());
+                return false;
+            }
+
+            _files++;
+            uploadStats.files++;
+            dirIndex.addPath(_path.c_str(), false, size);
+            return true;
+        }
+
+        // ---- Extracción de un tar en "dest"
+
+        void untarTo(const String& dest)
+        {
+            _dest = dest;
+            if (_dest.endsWith("/"))
+            {
+                _dest.remove(_dest.length() - 1);
+            }
+            _lastDir = "";
+            _untar = true;
+            _tar.reset();
+        }
+
+        bool untarring() const
+        {
+            return _untar;
+        }
+
+        bool feedTar(const uint8_t* data, size_t len)
+        {
+            _bytes += len;
+            uploadStats.bytes += len;
+            return _tar.feed(data, len, *this);
+        }
+
+        // Con una cabecera rota o un fichero a medias el tar llegó incompleto
+        bool tarComplete()
+        {
+            return !_tar.error() && !_tar.inEntry() && !_open;
+        }
+
+        bool begin(const tTarEntry& e)
+        {
+            String path = _dest + "/" + e.name;
+            if (e.isDir)
+            {
+                makeParent(path + "/");
+                return true;
+            }
+            makeParent(path);
+            return openFile(path, e.size);
+        }
+
+        void data(const uint8_t* p, size_t n)
+        {
+            append(p, n);
+        }
+
+        void end()
+        {
+            if (closeFile(true))
+            {
+                uploadStats.tarFiles++;
+            }
+        }
+
+        uint32_t files() const
+        {
+            return _files;
+        }
+
+        uint32_t errors() const
+        {
+            return _errors;
+        }
+
+        uint32_t bytes() const
+        {
+            return _bytes;
+        }
+};
+
+#endif
@@ -106,9 +106,28 @@ class ZXProcessor
 
         AudioKit m_kit;
 
+        // Destino alternativo de las muestras (exportación a fichero). nullptr = códec
+        ZXAudioSink* _sink = nullptr;
+
+        void audioOut(uint8_t* buffer, size_t len)
+        {
+            if (_sink != nullptr)
+            {
+                _sink->write(buffer, len);
+            }
+            else
+            {
+                m_kit.write(buffer, len);
+            }
+        }
+
         bool stopOrPauseRequest()
         {
-            
+            // Orden de corte pendiente en el bus. Se aplica aquí, en la tarea del reproductor.
+            if (transport.cancelRequested() != TCMD_NONE)
+            {
+                transportServiceCancels();
+            }
 
             if (STOP==true)
             {
@@ -124,6 +143,11 @@ class ZXProcessor
                 ACU_ERROR = 0;
                 return true;
             }
+            else if (tapeSeek.pending())
+            {
+                // Salto a otro bloque. Se deja de generar el actual (sin cambiar LOADING_STATE)
+                return true;
+            }
             else
             {
                 return false;   
@@ -144,8 +168,17 @@ class ZXProcessor
             uint16_t sample_R = 0;
             uint16_t sample_L = 0;
 
-            sample_R = getChannelAmplitude(changeNextEARedge,true) * (MAIN_VOL_R / 100);
-            sample_L = getChannelAmplitude(changeNextEARedge,true) * (MAIN_VOL_L / 100); 
+            double amplitude = getChannelAmplitude(changeNextEARedge,true);
+            sample_R = amplitude * (MAIN_VOL_R / 100);
+            sample_L = amplitude * (MAIN_VOL_L / 100); 
+
+            // STOP/PAUSE se comprueba una vez por buffer, no por muestra
+            if (stopOrPauseRequest())
+            {
+                // Salimos
+                forzeExit = true;
+                return;
+            }
 
             // Escribimos el tren de pulsos en el procesador de Audio
             // Generamos la señal en el buffer del chip de audio.
@@ -156,18 +189,21 @@ class ZXProcessor
                 //L-OUT
                 *ptr++ = sample_L * EN_STEREO;
                 result+=2*channels;
-
-                if (stopOrPauseRequest())
-                {
-                    // Salimos
-                    forzeExit = true;
-                    return;
-                }
             }
 
             if (!forzeExit)
             {
-                m_kit.write(buffer, result);
+                audioOut(buffer, result);
+
+                if (pulseCache.recording())
+                {
+                    pulseCache.run(amplitude, samples);
+                }
+
+                if (scope.active())
+                {
+                    scope.run((int16_t)sample_R, samples);
+                }
             }
 
             // Reiniciamos
@@ -310,23 +346,15 @@ class ZXProcessor
                 int16_t *ptr = (int16_t*)buffer;
                 int chn = channels;        
 
-                for (int j=0;j<width;j++)
+                // STOP/PAUSE se comprueba una vez por buffer, no por muestra
+                if (stopOrPauseRequest())
                 {
-                    // if (sample_R > 0)
-                    // {
-                    //     SCOPE=up;
-                    // }
-                    // else
-                    // {
-                    //     SCOPE=down;
-                    // }
+                    // Salimos
+                    return;
+                }
 
-                    if (stopOrPauseRequest())
-                    {
-                        // Salimos
-                        return;
-                    }
-                                    
+                for (int j=0;j<width;j++)
+                {
                     //R-OUT
                     *ptr++ = sample_R;
                     //L-OUT
@@ -337,7 +365,16 @@ class ZXProcessor
                 }            
 
                 // Volcamos en el buffer
-                m_kit.write(buffer, result);             
+                audioOut(buffer, result);
+
+                // Osciloscopio (página SCOPE). Un tramo entero, no muestra a muestra.
+                if (scope.active())
+                {
+                    scope.run((int16_t)sample_R, width);
+                }
+
+                // Estado para el HMI y la web
+                tapeStatus.publishIfDue();
         }
 
         void sampleDR(int width, int amp)
@@ -366,6 +403,11 @@ class ZXProcessor
             // Generamos la onda
             createPulse(samples,bytes,sample_R,sample_L);
 
+            if (pulseCache.recording())
+            {
+                pulseCache.run(amp, samples);
+            }
+
             if (stopOrPauseRequest())
             {
                 // Salimos
@@ -442,6 +484,11 @@ class ZXProcessor
                 bytes = samples * 2 * channels;
                 // Generamos la onda
                 createPulse(samples,bytes,sample_R,sample_L);
+
+                if (pulseCache.recording())
+                {
+                    pulseCache.run(amplitude, samples);
+                }
             }
             else
             {
@@ -463,6 +510,11 @@ class ZXProcessor
                     createPulse(minFrame, bytes, sample_R, sample_L);
                     frameSlot += minFrame;
 
+                    if (pulseCache.recording())
+                    {
+                        pulseCache.run(amplitude, minFrame);
+                    }
+
                     if (stopOrPauseRequest())
                     {
                         // Salimos
@@ -688,6 +740,32 @@ class ZXProcessor
             _mask_last_byte = mask;
         }
 
+        // Reproduce un tramo guardado en la caché de pulsos (PulseCache.h).
+        // La amplitud viene sin volumen. Devuelve false si hay STOP/PAUSE.
+        bool playCachedRun(int amp, uint32_t samples)
+        {
+            int minFrame = 256;
+
+            int16_t sample_R = amp * (MAIN_VOL_R / 100);
+            int16_t sample_L = amp * (MAIN_VOL_L / 100);
+
+            DEBUG_AMP_R = sample_R;
+            DEBUG_AMP_L = sample_L;
+
+            while (samples > 0)
+            {
+                int width = samples < minFrame ? samples : minFrame;
+                createPulse(width, width * 2 * channels, sample_R, sample_L);
+
+                if (stopOrPauseRequest())
+                {
+                    return false;
+                }
+                samples -= width;
+            }
+            return true;
+        }
+
         void silence(double duration, long calibrationValue = 0)
         {
             // la duracion se da en ms
@@ -1036,6 +1114,12 @@ class ZXProcessor
           m_kit = kit;
         }
 
+        // Las muestras van al sink en vez de al códec. nullptr vuelve al códec
+        void set_sink(ZXAudioSink* sink)
+        {
+          _sink = sink;
+        }
+
         void set_HMI(HMI hmi)
         {
           _hmi = hmi;
@@ -39,7 +39,16 @@ int lst_psram_used = 0;
 int lst_stack_used = 0;
 int lst_psram_free = 0;
 int lst_stack_free = 0;
+uint32_t lst_pool_allocs = 0;
+uint32_t lst_pool_inuse = 0;
 int SD_SPEED_MHZ = 4;
+// Benchmark de la SD (se lanza desde el HMI o la web y lo ejecuta tapeControl)
+bool SD_BENCHMARK_REQUEST = false;
+bool SD_BENCHMARK_RUNNING = false;
+// Caché de pulsos por cinta (.pls). Se activa desde el HMI (PLS=)
+bool PULSE_CACHE_ENABLE = false;
+// Benchmark del enlace con la pantalla (lo ejecuta la tarea del HMI)
+bool HMI_LINK_BENCH_REQUEST = false;
 // ************************************************************
 //
 // Estructura de datos
@@ -363,27 +372,17 @@ bool BLOCK_PLAYED = false;
 String TYPE_FILE_LOAD = "";
 char LAST_NAME[15];
 char LAST_TYPE[36];
-String lastType = "";
 // Para TZX / TSX
 String LAST_GROUP = "";
 bool LAST_BLOCK_WAS_GROUP_START = false;
 bool LAST_BLOCK_WAS_GROUP_END = false;
-String lastGrp = "";
 String LAST_MESSAGE = "";
 String HMI_FNAME = "";
-String lastMsn = "";
 String lastfname = "";
-int lastPr1 = 0;
-int lastPr2 = 0;
-int lastBl1 = 0;
-int lastBl2 = 0;
 String PROGRAM_NAME = "";
 String PROGRAM_NAME_2 = "";
-String lastPrgName = "";
-String lastPrgName2 = "";
 bool PROGRAM_NAME_ESTABLISHED = false;
 int LAST_SIZE = 0;
-int lstLastSize = 0;
 
 int LAST_BIT_WIDTH = 0;
 int MULTIGROUP_COUNT = 1;
@@ -424,6 +423,8 @@ bool LST_FILE_IS_OPEN = false;
 int FILE_LAST_INDEX = 0;
 int FILE_IDX_SELECTED = -1;
 bool FILE_SELECTED = false;
+// Orden LOAD del transporte pendiente (PATH_FILE_TO_LOAD ya está puesto)
+bool LOAD_REQUEST = false;
 bool FILE_PREPARED = false;
 bool FILE_INSIDE_TAPE = false;
 bool PROGRAM_NAME_DETECTED = false;
@@ -121,15 +121,68 @@ EasyNex myNex(SerialHW);
 AudioKit ESP32kit;
 
 // Estos includes deben ir en este orden por dependencias
+#include "SDscheduler.h"
 #include "SDmanager.h"
 
 // Creamos el gestor de ficheros para usarlo en todo el firmware
 SDmanager sdm;
 
+// Lectura anticipada de bloques para TAP/TZX
+#include "BlockPrefetcher.h"
+
+// Benchmark del bus de la SD y selección del reloj SPI
+#include "SDbenchmark.h"
+
+// Pool de buffers de bloque y arena por fichero
+#include "MemoryPool.h"
+
+// Caché de la señal generada por cinta (.pls)
+#include "PulseCache.h"
+
+// Tabla de salto a bloque / instante de la cinta
+#include "TapeSeek.h"
+
+// Estado de la cinta publicado por el reproductor (seqlock)
+#include "TapeStatus.h"
+
+// Órdenes del transporte (HMI/web --> reproductor)
+#include "TransportBus.h"
+
+// Estado para los clientes remotos (solo los campos que cambian)
+#include "RemoteStatus.h"
+
+// Salida hacia la pantalla (sombra de atributos y tramas)
+#include "HMIout.h"
+
+// Entrada desde la pantalla (troceado de comandos por interrupción)
+#include "HMIparser.h"
+
+// Velocidad del enlace con la pantalla
+#include "HMIlink.h"
+
+// Subida del firmware de la pantalla (.tft)
+#include "TFTupload.h"
+
+// Previsualización de la pantalla de carga
+#include "ScreenPreview.h"
+
+// Miniaturas de las pantallas de carga por directorio
+#include "TapeWalker.h"
+#include "ThumbCache.h"
+// Comprobación de checksums de todas las cintas en segundo plano
+#include "IntegrityScan.h"
+// Índice de directorios ordenado compartido por web y grabador
+#include "DirIndex.h"
+
+// Osciloscopio EAR/MIC
+#include "Scope.h"
+
 #include "HMI.h"
 HMI hmi;
 
 // #include "interface.h"
+// Salidas de ZXProcessor distintas del códec (WAV/CSW)
+#include "AudioSink.h"
 #include "ZXProcessor.h"
 
 // ZX Spectrum. Procesador de audio output
@@ -154,6 +207,8 @@ File32 wavfile;
 TZXprocessor pTZX(ESP32kit);
 TAPprocessor pTAP(ESP32kit);
 
+// Decodificador del grabador y conversión de WAV de la SD a TAP/TZX (/api/digitise)
+#include "TapeDigitiser.h"
 // Procesador de audio input
 #include "TAPrecorder.h"
 TAPrecorder taprec;
@@ -184,6 +239,14 @@ bool pageScreenIsShown = false;
 
 // WEBFILE SERVER
 // -----------------------------------------------------------------------
+// Subidas web con escrituras grandes y extracción de tar (usa sdf)
+#include "UploadSink.h"
+// Reproducción de cintas que llegan por la web, sin pasar por la SD
+#include "StreamTape.h"
+// Lista de bloques de una cinta para /api/tape (desde el .dsc)
+#include "TapeInspector.h"
+// Exportación de cintas a WAV/CSW más rápida que el tiempo real (/api/export)
+#include "TapeExport.h"
 #include "webpage.h"
 #include "webserver.h"
 
@@ -198,6 +261,9 @@ bool pageScreenIsShown = false;
 
 using namespace audio_tools;  
 
+// Reproductor y grabador de WAV/MP3: la SD se coge solo en los accesos al fichero
+#include "SDioStream.h"
+
 // Variables
 //
 // -----------------------------------------------------------------------
@@ -210,46 +276,30 @@ bool disable_auto_wav_stop = false;
 
 void ejectingFile();
 void isGroupStart();
-void isGroupEnd();
+void buildSeekTable();
+void remoteLoad();
 
 // -----------------------------------------------------------------------
 
 void freeMemoryFromDescriptorTZX(tTZXBlockDescriptor* descriptor)
 {
-  // Vamos a liberar el descriptor completo
+  // Los arrays de pulsos de los bloques 0x13 están en la arena del fichero.
+  // Se liberan todos de golpe.
   for (int n=0;n<TOTAL_BLOCKS;n++)
   {
-    switch (descriptor[n].ID)
-    {
-      case 19:  // bloque 0x13
-        // Hay que liberar el array
-        // delete[] descriptor[n].timming.pulse_seq_array;
-        free(descriptor[n].timming.pulse_seq_array);
-        break;
-      
-      default:
-        break;
-    }
+    descriptor[n].timming.pulse_seq_array = nullptr;
   }
+  tapeArena.releaseAll();
 }
 
 void freeMemoryFromDescriptorTSX(tTZXBlockDescriptor* descriptor)
 {
-  // Vamos a liberar el descriptor completo
+  // Igual que en TZX. Todo está en la arena del fichero.
   for (int n=0;n<TOTAL_BLOCKS;n++)
   {
-    switch (descriptor[n].ID)
-    {
-      case 19:  // bloque 0x13
-        // Hay que liberar el array
-        // delete[] descriptor[n].timming.pulse_seq_array;
-        free(descriptor[n].timming.pulse_seq_array);
-        break;
-
-      default:
-        break;
-    }
+    descriptor[n].timming.pulse_seq_array = nullptr;
   }
+  tapeArena.releaseAll();
 }
 
 int* strToIPAddress(String strIPAddr)
@@ -281,10 +331,31 @@ int* strToIPAddress(String strIPAddr)
     // Si no hay nada para devolver, envio un 0.
     return 0;
 }  
+
+// Accesos sueltos al sistema de ficheros con el bus cogido
+bool sdExists(const char* path)
+{
+  SDioLock lock(SDIO_INTERACTIVE);
+  return sdf.exists(path);
+}
+
+bool sdChdir(const String &dir)
+{
+  SDioLock lock(SDIO_INTERACTIVE);
+  return sdf.chdir(dir);
+}
+
+bool sdMkdir(const String &dir)
+{
+  SDioLock lock(SDIO_INTERACTIVE);
+  return sdf.mkdir(dir);
+}
+
 bool loadWifiCfgFile()
 {
    
   bool cfgloaded = false;
+  SDioLock lock(SDIO_INTERACTIVE);
 
   if(sdf.exists("/wifi.cfg"))
   {
@@ -542,13 +613,29 @@ int setSDFrequency(int SD_Speed)
 {
   bool SD_ok = false;
   bool lastStatus = false;
+
+  // Si esta tarjeta ya pasó el benchmark usamos el reloj que se eligió entonces.
+  // Si no, arrancamos con SD_Speed y se va bajando hasta que la SD responda.
+  // SD_SPEED_MHZ (valor seguro) solo se usa para leer el reloj guardado.
+  SDremount remount;
+  SdSpiConfig sdcfgSafe(ESP32kit.pinSpiCs(),SHARED_SPI,SD_SCK_MHZ(SD_SPEED_MHZ),&SPI);
+  int storedClock = -1;
+  if (sdf.begin(sdcfgSafe))
+  {
+      storedClock = getStoredSDClock(sdf);
+  }
+
+  if (storedClock > 0)
+  {
+      SD_Speed = storedClock;
+  }
   
   // Hasta que la SD no quede testeada no se sale del bucle.
   // Si la SD no es compatible, no se puede hacer uso del dispositivo
   while (!SD_ok) 
   {
       // Comenzamos con una frecuencia dada
-      SdSpiConfig sdcfg(ESP32kit.pinSpiCs(),SHARED_SPI,SD_SCK_MHZ(SD_SPEED_MHZ),&SPI);
+      SdSpiConfig sdcfg(ESP32kit.pinSpiCs(),SHARED_SPI,SD_SCK_MHZ(SD_Speed),&SPI);
       if (!sdf.begin(sdcfg) || lastStatus) 
       {
 
@@ -643,6 +730,142 @@ int setSDFrequency(int SD_Speed)
   return SD_Speed;
 }
 
+void showSDBenchmarkResults()
+{
+    // Se muestran en la pantalla DEBUG del HMI.
+    // dataOffsetN - lectura secuencial 32K de cada reloj estable (los cuatro más rápidos)
+    // offsetN     - detalle del reloj elegido
+    String* lines[4] = {&dataOffset1, &dataOffset2, &dataOffset3, &dataOffset4};
+    String* detail[4] = {&Offset1, &Offset2, &Offset3, &Offset4};
+
+    int row = 0;
+    for (int i = 0; i < (int)SDBENCH_NUM_CLOCKS && row < 4; i++)
+    {
+        tSDbenchReport &rep = sdBenchReports[i];
+        if (!rep.mounted)
+        {
+            continue;
+        }
+        *lines[row++] = String(rep.mhz) + "MHz " + (rep.stable ? "" : "ERR ") + String(rep.r[SDB_SEQ_READ][SDB_SIZES-1].kbps) + "KB/s";
+    }
+    for (; row < 4; row++)
+    {
+        *lines[row] = "";
+    }
+
+    if (sdBenchBest >= 0)
+    {
+        tSDbenchReport &best = sdBenchReports[sdBenchBest];
+        *detail[0] = "SR " + String(best.r[SDB_SEQ_READ][SDB_SIZES-1].kbps) + " SW " + String(best.r[SDB_SEQ_WRITE][SDB_SIZES-1].kbps) + " KB/s";
+        *detail[1] = "RR4K p99 " + String(best.r[SDB_RND_READ][1].p99) + "us";
+        *detail[2] = "RW4K p99 " + String(best.r[SDB_RND_WRITE][1].p99) + "us";
+        *detail[3] = "Selected " + String(best.mhz) + " MHz";
+    }
+    else
+    {
+        *detail[0] = "";
+        *detail[1] = "";
+        *detail[2] = "";
+        *detail[3] = "No stable clock";
+    }
+}
+
+// El benchmark vuelve a montar la SD con cada reloj: los ficheros que otra tarea tenga
+// abiertos dejan de valer. Devuelve lo que lo impide o nullptr.
+const char* sdBenchBlocker()
+{
+    if (TAPESTATE != 0)
+    {
+        return "Eject the tape";
+    }
+    if (WF_UPLOAD_TO_SD)
+    {
+        return "Wait for the upload";
+    }
+    if (thumbCache.busy())
+    {
+        return "Wait for the thumbnails";
+    }
+    if (integrity.status().running)
+    {
+        return "Stop the integrity scan";
+    }
+    if (digitiser.status().running)
+    {
+        return "Stop the WAV conversion";
+    }
+    uint8_t exportState = tapeExport.status().state;
+    if (exportState == EXPORT_PENDING || exportState == EXPORT_RUNNING)
+    {
+        return "Wait for the export";
+    }
+    return nullptr;
+}
+
+void runSDBenchmark()
+{
+    // Prueba todos los relojes candidatos, elige el más rápido estable
+    // y lo guarda para esta tarjeta (por CID).
+    SD_BENCHMARK_RUNNING = true;
+    sdBenchDone = false;
+    sdBenchBest = -1;
+
+    // Cada reloj vuelve a montar la SD: se espera a que las tareas de fondo cierren sus ficheros
+    SDremount remount(SDIO_BACKGROUND);
+    SDbenchCore core;
+    SDbenchFile32IO io(sdf);
+
+    for (int i = 0; i < (int)SDBENCH_NUM_CLOCKS; i++)
+    {
+        tSDbenchReport &rep = sdBenchReports[i];
+        rep = tSDbenchReport();
+        rep.mhz = SDBENCH_CLOCKS[i];
+
+        LAST_MESSAGE = "SD benchmark at " + String(rep.mhz) + " MHz";
+
+        SdSpiConfig sdcfg(ESP32kit.pinSpiCs(),SHARED_SPI,SD_SCK_MHZ(rep.mhz),&SPI);
+        rep.mounted = sdf.begin(sdcfg);
+
+        if (rep.mounted)
+        {
+            if (!core.run(io, rep))
+            {
+                rep.ioErrors++;
+                rep.stable = false;
+            }
+        }
+
+        esp_task_wdt_reset();
+    }
+
+    sdBenchBest = SDbenchCore::pickBest(sdBenchReports, SDBENCH_NUM_CLOCKS);
+
+    int newClock = (sdBenchBest >= 0) ? sdBenchReports[sdBenchBest].mhz : SD_SPEED_MHZ;
+    SdSpiConfig sdcfg(ESP32kit.pinSpiCs(),SHARED_SPI,SD_SCK_MHZ(newClock),&SPI);
+
+    if (sdf.begin(sdcfg))
+    {
+        SD_SPEED_MHZ = newClock;
+        if (sdBenchBest >= 0)
+        {
+            storeSDClock(sdf, newClock);
+        }
+        LAST_MESSAGE = "SD benchmark done. Clock " + String(SD_SPEED_MHZ) + " MHz";
+    }
+    else
+    {
+        // Volvemos al reloj que había
+        SdSpiConfig sdcfgOld(ESP32kit.pinSpiCs(),SHARED_SPI,SD_SCK_MHZ(SD_SPEED_MHZ),&SPI);
+        sdf.begin(sdcfgOld);
+        LAST_MESSAGE = "SD benchmark failed. Clock " + String(SD_SPEED_MHZ) + " MHz";
+    }
+
+    showSDBenchmarkResults();
+
+    sdBenchDone = true;
+    SD_BENCHMARK_RUNNING = false;
+}
+
 void waitForHMI(bool waitAndNotForze)
 {
     // Le decimos que no queremos esperar sincronización
@@ -839,13 +1062,16 @@ void setWavRecording(char* file_name,bool start=true)
 
     if (start)
     {
-        if (sdf.exists(file_name))
         {
-            sdf.remove(file_name);
-        }  
+          SDioLock lock(SDIO_RECORDING);
+          if (sdf.exists(file_name))
+          {
+              sdf.remove(file_name);
+          }  
 
-        // open file for recording WAV
-        wavfile = sdf.open(file_name, O_WRITE | O_CREAT);
+          // open file for recording WAV
+          wavfile = sdf.open(file_name, O_WRITE | O_CREAT);
+        }
 
         if (!wavfile)
         {
@@ -866,7 +1092,9 @@ void setWavRecording(char* file_name,bool start=true)
             // ADPCMEncoder adpcm_encoder(AV_CODEC_ID_ADPCM_MS); 
             // WAVEncoder wavencoder(adpcm_encoder, AudioFormat::ADPCM);            
             AudioKitStream in;
-            EncodedAudioStream out(&wavfile, new WAVEncoder());
+            // El copier espera al I2S. La SD solo se coge para escribir lo leído
+            SdLockedPrint wavOut(wavfile, SDIO_RECORDING);
+            EncodedAudioStream out(&wavOut, new WAVEncoder());
             StreamCopy copier(out, in);  // copies data
 
             auto cfg = in.defaultConfig(RX_MODE);
@@ -889,6 +1117,9 @@ void setWavRecording(char* file_name,bool start=true)
 
             while(!STOP)
             {
+              // Órdenes del HMI y la web (STOP termina la grabación)
+              transportService();
+
               copier.copy();
 
               if (millis() - progress_millis > 1000) 
@@ -920,7 +1151,10 @@ void setWavRecording(char* file_name,bool start=true)
 
             }
 
-            wavfile.flush();
+            {
+              SDioLock lock(SDIO_RECORDING);
+              wavfile.flush();
+            }
 
               logln("File has ");
               log(String(wavfile.size()/1024));
@@ -951,7 +1185,10 @@ void setWavRecording(char* file_name,bool start=true)
               hmi.writeString("size.txt=\"" + String(wavfile.size() / 1024) + " KB\"");
             }
 
-            wavfile.close();
+            {
+              SDioLock lock(SDIO_RECORDING);
+              wavfile.close();
+            }
 
             in.end();
             out.end();
@@ -1167,169 +1404,48 @@ void writeStatusLCD(String txt)
     hmi.writeString("statusLCD.txt=\"" + txt + "\"");
 }
 
-void uploadFirmDisplay(char *filetft)
+bool uploadFirmDisplay(char *filetft)
 {
     writeStatusLCD("New display firmware");
-    File32 file;
-    String ans = "";    
-
-    char strpath[20] = {};
-    strcpy(strpath,"/powadcr_iface.tft");
-
-    file = sdm.openFile32(strpath);
-    uint32_t filesize = file.size();
-
-    //Enviamos comando de conexión
-    // Forzamos un reinicio de la pantalla
-    hmi.write("DRAKJHSUYDGBNCJHGJKSHBDN");    
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);  
-    delay(200);
-
-    SerialHW.write(0x00);    
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);    
-    delay(200);
-
-    hmi.write("connect");    
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);      
-    delay(500);
-    
-    hmi.write("connect");    
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);  
-
-    ans = hmi.readStr();
-    delay(500);
-
-    hmi.write("runmod=2");
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
 
-    hmi.write("print \"mystop_yesABC\"");    
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-
-    ans = hmi.readStr();
-
-    hmi.write("get sleep");
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    delay(200);
-    
-    hmi.write("get dim");
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    delay(200);
-    
-    hmi.write("get baud");
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    delay(200);
-    
-    hmi.write("prints \"ABC\",0");    
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    delay(200);
-
-    ans = hmi.readStr();
-
-    SerialHW.write(0x00);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    delay(200);
-
-    hmi.write("whmi-wris " + String(filesize) + ",921600,1");  
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    SerialHW.write(0xff);
-    
-    delay(500);
-    ans = hmi.readStr();
-
-    //
-    file.rewind();
-
-    // Enviamos los datos
-
-    char buf[4096];
-    size_t avail;
-    size_t readcount;
-    int bl = 0;
-    
-    while (filesize > 0)
+    File32 file;
     {
-        // Leemos un bloque de 4096 bytes o el residual final < 4096
-        readcount = file.read(buf, filesize > 4096 ? 4096 : filesize);
-
-        // Lo enviamos
-        SerialHW.write(buf, readcount);
-
-        // Si es el primer bloque esperamos respuesta de 0x05 o 0x08
-        // en el caso de 0x08 saltaremos a la posición que indica la pantalla.
-    
-        if (bl==0)
+        SDioLock lock(SDIO_INTERACTIVE);
+        if (!file.open(filetft, O_RDONLY))
         {
-          String res = "";
+            logln("Display firmware: cannot open " + String(filetft));
+            return false;
+        }
+    }
 
-          // Una vez enviado el primer bloque esperamos 2s
-          delay(2000);
+    // Las respuestas de la pantalla se leen directamente de la UART
+    hmiRx.suspend(true);
+    prefetcher.begin();
 
-          while (1)
-          {
-              res = hmi.readStr();
+    uint32_t linkBaud = hmiLink.report().baud != 0 ? hmiLink.report().baud : SerialHWDataBits;
 
-              if (res.indexOf(0x08) != -1)
-              {
-                int offset = (pow(16,6) * int(res[4])) + (pow(16,4) * int(res[3])) + (pow(16,2) * int(res[2])) + int(res[1]);
-                
-                if (offset != 0)
-                {
-                    file.rewind();
-                    delay(50);
-                    file.seek(offset);
-                    delay(50);
-                }
-                break;
-              }
-              delay(50);
-          }
-        }
-        else
-        {
-          String res = "";
-          while(1)
-          {
-            // Esperams un ACK 0x05
-            res = hmi.readStr();
-            if(res.indexOf(0x05) != -1)
-            {
-              break;
-            }
-          }
-        }
-            
-        //
-        bl++;          
-        // Vemos lo que queda una vez he movido el seek o he leido un bloque
-        // ".available" mide lo que queda desde el puntero a EOF.
-        filesize = file.available();        
+    TFTuploadSerial port;
+    TFTfileSource src(file);
+    TFTuploadCore<TFTuploadSerial, TFTfileSource> upload(port, src, linkBaud, TFT_UPLOAD_BAUD);
+    bool ok = upload.run();
+
+    prefetcher.end();
+    prefetcher.release();
+    {
+        SDioLock lock(SDIO_INTERACTIVE);
+        file.close();
     }
 
+    tTFTreport rep = upload.report();
+    logln("Display firmware: " + String(ok ? "done" : "FAILED (" + String(rep.error) + ")")
+          + " - " + String(rep.sent) + "/" + String(rep.size) + " bytes, crc " + String(rep.crc, HEX)
+          + ", resumed at " + String(rep.resumedAt) + ", retries " + String(rep.retries) + ", " + String(rep.ms) + " ms");
 
-    file.close();
+    // La pantalla se reinicia a su velocidad por defecto
+    SerialHW.updateBaudRate(linkBaud);
+    hmiRx.suspend(false);
+
+    return ok;
 }
 // -------------------------------------------------------------------------------------------------------------------
 
@@ -1371,7 +1487,7 @@ int getWAVfileSize(String path)
     strcpy(pfile,path.c_str());
     File32 f = sdm.openFile32(pfile);
     int fsize = f.size();
-    f.close();  
+    sdm.closeFile32(f);
 
     if (fsize < 1000000)
     {
@@ -1837,12 +1953,14 @@ void playMP3()
     // WAVDecoder decoder;
     SdSpiConfig sdcfg(PIN_AUDIO_KIT_SD_CARD_CS,SHARED_SPI,SD_SCK_MHZ(SD_SPEED_MHZ),&SPI);
     AudioSourceSDFAT source("/mp3","mp3",sdcfg);
+    // Lecturas de la SD con prioridad de reproducción
+    SdLockedSource sdSource(source, SDIO_PLAYBACK);
     AudioKitStream kit;
     // A2DPStream outbt;
     MP3DecoderHelix decoder;
     
     // WAVDecoder decoderbt;
-    AudioPlayer player(source,kit,decoder);
+    AudioPlayer player(sdSource,kit,decoder);
     // AudioPlayer playerbt(source, outbt, decoder);
     
     // setup output
@@ -1880,7 +1998,7 @@ void playMP3()
 
         player.setActive(true);
         // Indicamos cual es el fichero seleccionado
-        source.selectStream(FILE_PTR_POS + FILE_IDX_SELECTED - 1);
+        sdSource.selectStream(FILE_PTR_POS + FILE_IDX_SELECTED - 1);
 
         // Esto lo hacemos para parar cuando termine el audio.
         int currentIdx = (FILE_PTR_POS + FILE_IDX_SELECTED) - 1;
@@ -1892,7 +2010,9 @@ void playMP3()
 
         while(!EJECT && !REC)
         {          
-          
+          // Órdenes del HMI y la web (este bucle no vuelve a Task1code)
+          transportService();
+
           player.setVolume(MAIN_VOL/100);
   
           switch (stateWAVplayer)
@@ -1924,7 +2044,7 @@ void playMP3()
                     // Comprobamos
                     if (idx > source.size())
                     {
-                      source.selectStream(0);
+                      sdSource.selectStream(0);
                     }
                     else
                     {
@@ -1954,7 +2074,7 @@ void playMP3()
                     // Comprobamos
                     if (idx < 0)
                     {
-                      source.selectStream(source.size());
+                      sdSource.selectStream(source.size());
                     }
                     else
                     {
@@ -2002,6 +2122,7 @@ void playMP3()
                       }
                     }
                     // Vamos transmitiendo y quedandonos con el numero de bytes transmitidos
+                    // (sdSource coge la SD solo para leer, no mientras espera al I2S)
                     fileread += player.copy();
 
                     // Mostramos la progresion de la reproduccion
@@ -2026,7 +2147,7 @@ void playMP3()
                             // la lista de reproduccion (play list)
                             if ((currentIdx + 1) > source.size())
                             {
-                              source.selectStream(0);
+                              sdSource.selectStream(0);
                               player.begin();
 
                               logln("Change IDX: " + String(source.index()) + " / " + String(source.size()));
@@ -2066,7 +2187,7 @@ void playMP3()
                     // Comprobamos
                     if (idx > source.size())
                     {
-                      source.selectStream(0);
+                      sdSource.selectStream(0);
                     }
                     else
                     {
@@ -2099,7 +2220,7 @@ void playMP3()
                     // Comprobamos
                     if (idx < 0)
                     {
-                      source.selectStream(source.size());
+                      sdSource.selectStream(source.size());
                     }
                     else
                     {
@@ -2149,7 +2270,7 @@ void playMP3()
                     currentIdx = source.index();  
                     stateWAVplayer = 0;  
                     player.begin();
-                    source.selectStream(currentIdx);
+                    sdSource.selectStream(currentIdx);
                     // updateIndicators(source.size() + 1, source.index() + 1, fileSize, source.toStr()); 
 
                     // Indicadores
@@ -2178,7 +2299,7 @@ void playMP3()
                     // Ponemos la pista al principio
                     player.begin();
                     // Nos quedamos en la misma pista
-                    source.selectStream(currentIdx);
+                    sdSource.selectStream(currentIdx);
                     // Actualizamos indicadores
                     // updateIndicators(source.size() + 1, source.index() + 1, fileSize, source.toStr());  
 
@@ -2222,11 +2343,14 @@ void playMP3()
       STOP=true;
     } 
 
-    // Recupero la SD para el resto de procesadores.
-    if (!sdf.begin(sdcfg)) 
+    // Recupero la SD para el resto de procesadores, con las tareas de fondo paradas.
     {
-      logln("Error recovering spi initialization");
-    }  
+      SDremount remount;
+      if (!sdf.begin(sdcfg)) 
+      {
+        logln("Error recovering spi initialization");
+      }
+    }
 }
 
 void playWAV()
@@ -2252,10 +2376,12 @@ void playWAV()
     // WAVDecoder decoder;
     SdSpiConfig sdcfg(PIN_AUDIO_KIT_SD_CARD_CS,SHARED_SPI,SD_SCK_MHZ(SD_SPEED_MHZ),&SPI);
     AudioSourceSDFAT source("/wav","wav",sdcfg);
+    // Lecturas de la SD con prioridad de reproducción
+    SdLockedSource sdSource(source, SDIO_PLAYBACK);
     AudioKitStream kit;
     // A2DPStream outbt;
     WAVDecoder decoder;
-    AudioPlayer player(source,kit,decoder);
+    AudioPlayer player(sdSource,kit,decoder);
     
     auto cfg = kit.defaultConfig(TX_MODE);
     cfg.bits_per_sample = 16;
@@ -2282,7 +2408,7 @@ void playWAV()
 
         player.setActive(true);
         // Indicamos cual es el fichero seleccionado
-        source.selectStream(FILE_PTR_POS + FILE_IDX_SELECTED - 1);
+        sdSource.selectStream(FILE_PTR_POS + FILE_IDX_SELECTED - 1);
 
         // Esto lo hacemos para parar cuando termine el audio.
         int currentIdx = (FILE_PTR_POS + FILE_IDX_SELECTED) - 1;
@@ -2294,7 +2420,9 @@ void playWAV()
 
         while(!EJECT && !REC)
         {          
-          
+          // Órdenes del HMI y la web (este bucle no vuelve a Task1code)
+          transportService();
+
           player.setVolume(MAIN_VOL/100);
   
           switch (stateWAVplayer)
@@ -2326,7 +2454,7 @@ void playWAV()
                     // Comprobamos
                     if (idx > source.size())
                     {
-                      source.selectStream(0);
+                      sdSource.selectStream(0);
                     }
                     else
                     {
@@ -2356,7 +2484,7 @@ void playWAV()
                     // Comprobamos
                     if (idx < 0)
                     {
-                      source.selectStream(source.size());
+                      sdSource.selectStream(source.size());
                     }
                     else
                     {
@@ -2404,6 +2532,7 @@ void playWAV()
                       }
                     }
                     // Vamos transmitiendo y quedandonos con el numero de bytes transmitidos
+                    // (sdSource coge la SD solo para leer, no mientras espera al I2S)
                     fileread += player.copy();
 
                     // Mostramos la progresion de la reproduccion
@@ -2428,7 +2557,7 @@ void playWAV()
                             // la lista de reproduccion (play list)
                             if ((currentIdx + 1) > source.size())
                             {
-                              source.selectStream(0);
+                              sdSource.selectStream(0);
                               player.begin();
 
                               logln("Change IDX: " + String(source.index()) + " / " + String(source.size()));
@@ -2468,7 +2597,7 @@ void playWAV()
                     // Comprobamos
                     if (idx > source.size())
                     {
-                      source.selectStream(0);
+                      sdSource.selectStream(0);
                     }
                     else
                     {
@@ -2501,7 +2630,7 @@ void playWAV()
                     // Comprobamos
                     if (idx < 0)
                     {
-                      source.selectStream(source.size());
+                      sdSource.selectStream(source.size());
                     }
                     else
                     {
@@ -2551,7 +2680,7 @@ void playWAV()
                     currentIdx = source.index();  
                     stateWAVplayer = 0;  
                     player.begin();
-                    source.selectStream(currentIdx);
+                    sdSource.selectStream(currentIdx);
                     // updateIndicators(source.size() + 1, source.index() + 1, fileSize, source.toStr()); 
 
                     // Indicadores
@@ -2580,7 +2709,7 @@ void playWAV()
                     // Ponemos la pista al principio
                     player.begin();
                     // Nos quedamos en la misma pista
-                    source.selectStream(currentIdx);
+                    sdSource.selectStream(currentIdx);
                     // Actualizamos indicadores
                     // updateIndicators(source.size() + 1, source.index() + 1, fileSize, source.toStr());  
 
@@ -2653,10 +2782,13 @@ void playWAV()
       STOP=true;
     } 
 
-    // Recupero la SD para el resto de procesadores.
-    if (!sdf.begin(sdcfg)) 
+    // Recupero la SD para el resto de procesadores, con las tareas de fondo paradas.
     {
-      logln("Error recovering spi initialization");
+      SDremount remount;
+      if (!sdf.begin(sdcfg)) 
+      {
+        logln("Error recovering spi initialization");
+      }
     }
 }
 
@@ -2723,6 +2855,7 @@ void verifyConfigFileForSelection()
 
   // Abrimos el fichero de configuracion.
   File32 cfg;
+  SDioLock lock(SDIO_INTERACTIVE);
 
   logln("");
   log("path: " + String(strpath));
@@ -2920,6 +3053,12 @@ void loadingFile(char* file_ch)
         proccesingTAP(file_ch);
         TYPE_FILE_LOAD = "TAP";  
         BYTES_TOBE_LOAD = myTAP.size;
+
+        if (FILE_PREPARED)
+        {
+          buildSeekTable();
+          thumbCache.show(PATH_FILE_TO_LOAD);
+        }
      
     }
     else if ((PATH_FILE_TO_LOAD.indexOf(".TZX") != -1) || (PATH_FILE_TO_LOAD.indexOf(".TSX") != -1) || (PATH_FILE_TO_LOAD.indexOf(".CDT") != -1))    
@@ -2948,6 +3087,12 @@ void loadingFile(char* file_ch)
             TYPE_FILE_LOAD = "CDT";
         }
         BYTES_TOBE_LOAD = myTZX.size;
+
+        if (FILE_PREPARED)
+        {
+          buildSeekTable();
+          thumbCache.show(PATH_FILE_TO_LOAD);
+        }
     }
     else if(PATH_FILE_TO_LOAD.indexOf(".WAV") != -1)
     {
@@ -3038,6 +3183,19 @@ void ejectingFile()
   //       pTSX.terminate();
   //     }
   // }    
+
+  // Liberamos los buffers de lectura anticipada
+  prefetcher.release();
+
+  // Pantalla de carga de la cinta
+  screenPreview.release();
+
+  // La tabla de saltos está en la arena del fichero
+  tapeSeek.clear();
+
+  // La arena del fichero y los buffers libres del pool vuelven a la PSRAM
+  tapeArena.releaseAll();
+  blockPool.trim();
 }
 
 
@@ -3188,24 +3346,21 @@ void nextGroupBlock()
   
   if (TYPE_FILE_LOAD !="TAP" && TYPE_FILE_LOAD != "WAV" && TYPE_FILE_LOAD != "MP3")
   {
-    while(myTZX.descriptor[BLOCK_SELECTED].ID != 34 && BLOCK_SELECTED <= TOTAL_BLOCKS)
-    {
-      BLOCK_SELECTED++;
-    }
+    // El Group End es la pareja del Group Start que contiene al bloque
+    TapeSeekTable &t = tapeSeek.table();
+    int g = t.groupOf(BLOCK_SELECTED);
 
-    if (BLOCK_SELECTED > (TOTAL_BLOCKS-1))
+    if (g < 0 || t.mate(g) < 0)
     {
       // No he encontrado el Group End
       BLOCK_SELECTED = 1;
     }
     else
     {
-      // Avanzo uno mas
+      BLOCK_SELECTED = t.mate(g);
       PROGRAM_NAME_2 = "";
       LAST_BLOCK_WAS_GROUP_END = true;
       LAST_BLOCK_WAS_GROUP_START = false;
-      // BLOCK_SELECTED++;
-      // isGroupStart();
     }
   }
 }
@@ -3216,24 +3371,19 @@ void prevGroupBlock()
 
   if (TYPE_FILE_LOAD !="TAP" && TYPE_FILE_LOAD != "WAV" && TYPE_FILE_LOAD != "MP3")
   {
-    while(myTZX.descriptor[BLOCK_SELECTED].ID != 33 && BLOCK_SELECTED > 1)
-    {
-      BLOCK_SELECTED--;
-    }
+    int g = tapeSeek.table().groupOf(BLOCK_SELECTED);
 
-    if (BLOCK_SELECTED < 1)
+    if (g < 0)
     {
-      // No he encontrado el Group Start
-      BLOCK_SELECTED = TOTAL_BLOCKS - 1;
-    }
-    else
-    {
-      // Le pasamos el nombre del grupo al PROGRAM_NAME_2
-      // BLOCK_SELECTED++;
-      LAST_GROUP = myTZX.descriptor[BLOCK_SELECTED].name;
-      LAST_BLOCK_WAS_GROUP_START = true;
-      LAST_BLOCK_WAS_GROUP_END = false;
+      // No está dentro de un grupo
+      return;
     }
+
+    // Le pasamos el nombre del grupo al PROGRAM_NAME_2
+    BLOCK_SELECTED = g;
+    LAST_GROUP = myTZX.descriptor[BLOCK_SELECTED].name;
+    LAST_BLOCK_WAS_GROUP_START = true;
+    LAST_BLOCK_WAS_GROUP_END = false;
   }
 }
 
@@ -3260,40 +3410,167 @@ void isGroupStart()
   }
 }
 
-void isGroupEnd()
+void updateHMIOnBlockChange()
 {
-  // Verificamos si se entra en un grupo
-  logln("ID: " + String(myTZX.descriptor[BLOCK_SELECTED].ID));
+    if (TYPE_FILE_LOAD=="TAP")
+    {
+      hmi.setBasicFileInformation(0,0,myTAP.descriptor[BLOCK_SELECTED].name,myTAP.descriptor[BLOCK_SELECTED].typeName,myTAP.descriptor[BLOCK_SELECTED].size,true);
+    }
+    else if(TYPE_FILE_LOAD=="TZX" || TYPE_FILE_LOAD=="CDT" || TYPE_FILE_LOAD=="TSX")
+    {
+      hmi.setBasicFileInformation(myTZX.descriptor[BLOCK_SELECTED].ID,myTZX.descriptor[BLOCK_SELECTED].group,myTZX.descriptor[BLOCK_SELECTED].name,myTZX.descriptor[BLOCK_SELECTED].typeName,myTZX.descriptor[BLOCK_SELECTED].size,myTZX.descriptor[BLOCK_SELECTED].playeable);
+    } 
 
-  if (TYPE_FILE_LOAD != "TAP" && TYPE_FILE_LOAD != "WAV" && TYPE_FILE_LOAD != "MP3")
-  {
-    if (myTZX.descriptor[BLOCK_SELECTED].ID == 34)
+    // La tarea del HMI pinta solo lo que cambia en la instantánea
+    tapeStatus.publish();
+}
+
+// Duración estimada (ms) de un bloque TZX a partir de su descriptor
+uint32_t tzxBlockMs(const tTZXBlockDescriptor &d)
+{
+    const tTimming &t = d.timming;
+    uint32_t pause = d.pauseAfterThisBlock > 0 ? d.pauseAfterThisBlock : 0;
+
+    switch (d.ID)
     {
-      // Es un group start
-      LAST_BLOCK_WAS_GROUP_END = true;
-      LAST_BLOCK_WAS_GROUP_START = false;
-      prevGroupBlock();      
+      case 16:
+      case 17:
+        // Standard / turbo
+        return seekDataMs(t.pilot_len, t.pilot_num_pulses, t.sync_1, t.sync_2, t.bit_0, t.bit_1, d.size, pause);
+
+      case 18:
+        // Pure tone
+        return (uint32_t)((uint64_t)t.pure_tone_len * t.pure_tone_num_pulses / 3500);
+
+      case 19:
+      {
+        // Pulse sequence
+        uint64_t ts = 0;
+        for (int p = 0; t.pulse_seq_array != nullptr && p < t.pulse_seq_num_pulses; p++)
+        {
+          ts += t.pulse_seq_array[p];
+        }
+        return (uint32_t)(ts / 3500);
+      }
+
+      case 20:
+        // Pure data
+        return seekDataMs(0, 0, 0, 0, t.bit_0, t.bit_1, d.size, pause);
+
+      case 21:
+        // Direct recording. Un bit por muestra de samplingRate T-states.
+        return (uint32_t)((uint64_t)d.lengthOfData * 8 * d.samplingRate / 3500) + pause;
+
+      case 32:
+        // Pause
+        return pause;
     }
-    else
+
+    return 0;
+}
+
+// Tabla de saltos de la cinta cargada. Se calcula una vez a partir de los descriptores.
+void buildSeekTable()
+{
+    bool ok = false;
+
+    if (TYPE_FILE_LOAD == "TAP")
     {
-      LAST_BLOCK_WAS_GROUP_START = false;
-      LAST_BLOCK_WAS_GROUP_END = false;
-    }    
-  }
+      // myTAP es una copia anterior al análisis. El número de bloques lo tiene pTAP.
+      ok = tapeSeek.build(pTAP.getTAP().numBlocks, 1, [](int i, tSeekBlock &b)
+      {
+        const tTAPBlockDescriptor &d = myTAP.descriptor[i];
+        bool header = (d.type == 0 || d.type == 1 || d.type == 7);
+        b.id = 16;
+        b.playable = d.playeable;
+        b.ms = seekDataMs(DPILOT_LEN, header ? DPULSES_HEADER : DPULSES_DATA, DSYNC1, DSYNC2, DBIT_0, DBIT_1, d.size, DSILENT);
+      });
+    }
+    else if (TYPE_FILE_LOAD == "TZX" || TYPE_FILE_LOAD == "CDT" || TYPE_FILE_LOAD == "TSX")
+    {
+      ok = tapeSeek.build(TOTAL_BLOCKS, 1, [](int i, tSeekBlock &b)
+      {
+        const tTZXBlockDescriptor &d = myTZX.descriptor[i];
+        b.id = d.ID;
+        b.playable = d.playeable;
+        b.ms = tzxBlockMs(d);
+        // El reproductor toca el cuerpo del bucle loop_count + 1 veces
+        b.loopPasses = d.loop_count + 1;
+      });
+    }
+
+    if (ok)
+    {
+      logln("Seek table: " + String(tapeSeek.table().count()) + " blocks, " + String(tapeSeek.table().totalMs() / 1000) + " s");
+    }
 }
 
-void updateHMIOnBlockChange()
+// Exportación pedida por la web (/api/export). Si la cinta no es la cargada se carga como con
+// LOAD, y se genera desde los descriptores del análisis, igual que buildSeekTable()
+void exportingFile()
 {
-    if (TYPE_FILE_LOAD=="TAP")
+    String path = tapeExport.status().path;
+
+    if (!FILE_PREPARED || !PATH_FILE_TO_LOAD.equalsIgnoreCase(path))
     {
-      hmi.setBasicFileInformation(0,0,myTAP.descriptor[BLOCK_SELECTED].name,myTAP.descriptor[BLOCK_SELECTED].typeName,myTAP.descriptor[BLOCK_SELECTED].size,true);
+      PATH_FILE_TO_LOAD = path;
+      FILE_LOAD = path.substring(path.lastIndexOf('/') + 1);
+      FILE_SELECTED = true;
+      remoteLoad();
     }
-    else if(TYPE_FILE_LOAD=="TZX" || TYPE_FILE_LOAD=="CDT" || TYPE_FILE_LOAD=="TSX")
+
+    if (!FILE_PREPARED || (TYPE_FILE_LOAD != "TAP" && TYPE_FILE_LOAD != "TZX" && TYPE_FILE_LOAD != "CDT"))
     {
-      hmi.setBasicFileInformation(myTZX.descriptor[BLOCK_SELECTED].ID,myTZX.descriptor[BLOCK_SELECTED].group,myTZX.descriptor[BLOCK_SELECTED].name,myTZX.descriptor[BLOCK_SELECTED].typeName,myTZX.descriptor[BLOCK_SELECTED].size,myTZX.descriptor[BLOCK_SELECTED].playeable);
-    } 
+      tapeExport.fail("cannot load tape");
+      return;
+    }
 
-    hmi.updateInformationMainPage(true);
+    if (TYPE_FILE_LOAD == "TAP")
+    {
+      // TAPprocessor::play() los reproduce todos con los tiempos de la ROM
+      tapeExport.run(0, pTAP.getTAP().numBlocks, false, [](int i, tRenderBlock &b)
+      {
+        const tTAPBlockDescriptor &d = myTAP.descriptor[i];
+        bool header = (d.type == 0 || d.type == 1 || d.type == 7);
+        b.id = 16;
+        b.playable = true;
+        b.dataOffset = d.offset;
+        b.dataSize = d.size;
+        b.pause = DSILENT;
+        b.t.pilotLen = DPILOT_LEN;
+        b.t.pilotPulses = header ? DPULSES_HEADER : DPULSES_DATA;
+        b.t.sync1 = DSYNC1;
+        b.t.sync2 = DSYNC2;
+        b.t.bit0 = DBIT_0;
+        b.t.bit1 = DBIT_1;
+      });
+    }
+    else
+    {
+      tapeExport.run(1, TOTAL_BLOCKS, true, [](int i, tRenderBlock &b)
+      {
+        const tTZXBlockDescriptor &d = myTZX.descriptor[i];
+        b.id = d.ID;
+        b.playable = d.playeable;
+        b.dataOffset = d.offsetData;
+        b.dataSize = d.size;
+        b.pause = d.pauseAfterThisBlock;
+        // getIDAndPlay() pone el tono guía de la ROM en los 0x10
+        b.t.pilotLen = d.ID == 16 ? DPILOT_LEN : d.timming.pilot_len;
+        b.t.pilotPulses = d.timming.pilot_num_pulses;
+        b.t.sync1 = d.timming.sync_1;
+        b.t.sync2 = d.timming.sync_2;
+        b.t.bit0 = d.timming.bit_0;
+        b.t.bit1 = d.timming.bit_1;
+        b.t.usedBits = d.hasMaskLastByte ? d.maskLastByte : 8;
+        b.t.toneLen = d.timming.pure_tone_len;
+        b.t.tonePulses = d.timming.pure_tone_num_pulses;
+        b.t.numPulses = d.timming.pulse_seq_num_pulses;
+        b.pulses = d.timming.pulse_seq_array;
+        b.t.loopCount = d.loop_count;
+        b.t.sampleTs = d.samplingRate;
+      });
+    }
 }
 
 void getRandomFilename (char* &currentPath, String currentFileBaseName)
@@ -3366,55 +3643,24 @@ void setFWIND()
 {
     logln("Set FFWD - " + String(LAST_BLOCK_WAS_GROUP_START));
 
-
+    // Un grupo se salta entero (Group Start --> Group End)
+    BLOCK_SELECTED = tapeSeek.table().next(BLOCK_SELECTED);
 
     if (TYPE_FILE_LOAD != "TAP")
     {
-        if (LAST_BLOCK_WAS_GROUP_START)
+        if (tapeSeek.table().isGroupEnd(BLOCK_SELECTED))
         {
-          // Si el ultimo bloque fue un GroupStart entonces busco un Group End y avanzo 1
-          nextGroupBlock();
-          // LAST_BLOCK_WAS_GROUP_START = false;
+          PROGRAM_NAME_2 = "";
+          LAST_BLOCK_WAS_GROUP_END = true;
+          LAST_BLOCK_WAS_GROUP_START = false;
         }
         else
         {
-          // Modo normal avanzo 1 a 1 y verifico si hay Group Start
-          BLOCK_SELECTED++;
           isGroupStart();
         }
     }
-    else
-    {
-      BLOCK_SELECTED++;
-    }
-
-    if (BLOCK_SELECTED > (TOTAL_BLOCKS - 1)) 
-    {
-      BLOCK_SELECTED = 1;
-      isGroupStart();
-    }
-
-    if (TYPE_FILE_LOAD != "TAP")
-    {
-        // Forzamos un refresco de los indicadores
-        hmi.setBasicFileInformation(myTZX.descriptor[BLOCK_SELECTED].ID,
-                                    myTZX.descriptor[BLOCK_SELECTED].group,
-                                    myTZX.descriptor[BLOCK_SELECTED].name,
-                                    myTZX.descriptor[BLOCK_SELECTED].typeName,
-                                    myTZX.descriptor[BLOCK_SELECTED].size,
-                                    myTZX.descriptor[BLOCK_SELECTED].playeable);
-    }
-    else
-    {
-        // Forzamos un refresco de los indicadores
-        hmi.setBasicFileInformation(0,0,myTAP.descriptor[BLOCK_SELECTED].name,
-                                        myTAP.descriptor[BLOCK_SELECTED].typeName,
-                                        myTAP.descriptor[BLOCK_SELECTED].size,
-                                        myTAP.descriptor[BLOCK_SELECTED].playeable);
-    }
-
-    hmi.updateInformationMainPage(true);
 
+    // El refresco de los indicadores lo hace updateHMIOnBlockChange()
     rewindAnimation(1);
 
 }
@@ -3424,52 +3670,15 @@ void setRWIND()
 
     logln("Set RWD - " + String(LAST_BLOCK_WAS_GROUP_END));
     
-    if (TYPE_FILE_LOAD != "TAP")
-    {
-        if (LAST_BLOCK_WAS_GROUP_END)
-        {
-          // Si el ultimo bloque fue un Group End entonces busco un Group Start y avanzo 1
-          prevGroupBlock();
-          // LAST_BLOCK_WAS_GROUP_END = false;
-        } 
-        else
-        {
-          BLOCK_SELECTED--;
-          isGroupEnd();
-        }      
-    }
-    else
-    {
-        BLOCK_SELECTED--;      
-    }
-
-    if (BLOCK_SELECTED < 1) 
-    {
-      BLOCK_SELECTED = (TOTAL_BLOCKS-1);
-      isGroupEnd();
-    }
+    // Desde el final de un grupo se vuelve a su Group Start
+    BLOCK_SELECTED = tapeSeek.table().prev(BLOCK_SELECTED);
 
     if (TYPE_FILE_LOAD != "TAP")
     {
-        // Forzamos un refresco de los indicadores
-        hmi.setBasicFileInformation(myTZX.descriptor[BLOCK_SELECTED].ID,
-                                    myTZX.descriptor[BLOCK_SELECTED].group,
-                                    myTZX.descriptor[BLOCK_SELECTED].name,
-                                    myTZX.descriptor[BLOCK_SELECTED].typeName,
-                                    myTZX.descriptor[BLOCK_SELECTED].size,
-                                    myTZX.descriptor[BLOCK_SELECTED].playeable);
+        isGroupStart();
     }
-    else
-    {
-        // Forzamos un refresco de los indicadores
-        hmi.setBasicFileInformation(0,0,myTAP.descriptor[BLOCK_SELECTED].name,
-                                        myTAP.descriptor[BLOCK_SELECTED].typeName,
-                                        myTAP.descriptor[BLOCK_SELECTED].size,
-                                        myTAP.descriptor[BLOCK_SELECTED].playeable);
-    }
-
-    hmi.updateInformationMainPage(true);   
 
+    // El refresco de los indicadores lo hace updateHMIOnBlockChange()
     rewindAnimation(-1);
 
 }
@@ -3539,6 +3748,129 @@ void openBlocksBrowser()
     }  
 }
 
+// Mete en la cinta el fichero seleccionado (PATH_FILE_TO_LOAD). Se usa al cerrar el
+// file browser (estado 100) y con la orden LOAD del transporte (web).
+void insertSelectedFile()
+{
+  // Si se ha seleccionado lo cargo en el cassette.     
+  char* file_ch = (char*)ps_calloc(256,sizeof(char));
+  PATH_FILE_TO_LOAD.toCharArray(file_ch, 256);
+  
+  loadingFile(file_ch);
+  free(file_ch);
+
+  // Ponemos FILE_SELECTED = false, para el proximo fichero     
+  FILE_SELECTED = false;
+  
+  // Ahora miro si está preparado
+  if(FILE_PREPARED)
+  {
+    #ifdef DEBUGMODE
+      logAlert("File inside the tape.");
+    #endif
+    
+    // Avanzamos ahora hasta el primer bloque playeable
+    if (!ABORT)
+    {
+      logln("Type file load: " + TYPE_FILE_LOAD);
+
+      if (TYPE_FILE_LOAD != "WAV" && TYPE_FILE_LOAD != "MP3")
+      {
+        getTheFirstPlayeableBlock();
+
+        LAST_MESSAGE = "File inside the TAPE.";
+        PROGRAM_NAME = FILE_LOAD;
+        HMI_FNAME = FILE_LOAD;
+
+        TAPESTATE = 10;
+        LOADING_STATE = 0;
+
+      }
+      else
+      {
+        PROGRAM_NAME = FILE_LOAD;
+        hmi.writeString("name.txt=\"" + FILE_LOAD + "\"");
+
+        LAST_MESSAGE = "File inside the TAPE.";
+        HMI_FNAME = FILE_LOAD;
+
+        TAPESTATE = 10;
+        LOADING_STATE = 0;
+
+        // Esto lo hacemos para llevar el control desde el WAV player 
+        playingFile();
+      }
+
+    }
+    else
+    {
+      LAST_MESSAGE = "Aborting proccess.";
+      delay(2000);
+      TAPESTATE = 0;
+      LOADING_STATE = 0;
+    }
+  }
+  else
+  {
+
+    #ifdef DEBUGMODE
+      logAlert("No file selected or empty file.");
+    #endif
+
+    LAST_MESSAGE = "No file selected or empty file.";                
+  }
+}
+
+// Carga pedida por la orden LOAD. Si el fichero no entra en la cinta se vuelve al reposo
+void remoteLoad()
+{
+  LOAD_REQUEST = false;
+  ABORT = false;
+
+  insertSelectedFile();
+
+  if (TAPESTATE != 10)
+  {
+    TAPESTATE = 0;
+    LOADING_STATE = 0;
+  }
+}
+
+// Cinta que llega por la web (POST /play). Se reproduce según se recibe y al acabar
+// la cinta queda vacía
+void streamPlaying()
+{
+  if (FILE_PREPARED)
+  {
+    ejectingFile();
+  }
+
+  FILE_PREPARED = false;
+  FILE_SELECTED = false;
+  hmi.clearInformationFile();
+
+  setAudioOutput();
+  ESP32kit.setVolume(MAX_MAIN_VOL);
+  sendStatus(REC_ST, 0);
+
+  PLAY = true;
+  PAUSE = false;
+  STOP = false;
+  ABORT = false;
+  LAST_EAR_IS = POLARIZATION;
+  LOADING_STATE = 1;
+  tapeAnimationON();
+
+  streamPlay();
+
+  tapeAnimationOFF();
+  PLAY = false;
+  PAUSE = false;
+  STOP = true;
+  TAPESTATE = 0;
+  LOADING_STATE = 0;
+}
+
 void tapeControl()
 {
   // Estados de funcionamiento del TAPE
@@ -3558,6 +3890,25 @@ void tapeControl()
     UPDATE_HMI = false;
   }
 
+  if (SD_BENCHMARK_REQUEST)
+  {
+    SD_BENCHMARK_REQUEST = false;
+
+    // Solo sin cinta cargada y sin nadie más usando la SD,
+    // porque se reinicia el acceso a la SD con cada reloj.
+    const char* blocker = sdBenchBlocker();
+    if (blocker == nullptr)
+    {
+      sdBenchRefused = "";
+      runSDBenchmark();
+    }
+    else
+    {
+      sdBenchRefused = blocker;
+      LAST_MESSAGE = String(blocker) + " to run the SD benchmark.";
+    }
+  }
+
   switch (TAPESTATE)
   {
     case 0:
@@ -3596,6 +3947,19 @@ void tapeControl()
           setPolarization();
 
         }
+        else if (LOAD_REQUEST)
+        {
+          // Orden LOAD del transporte (web). Mismo camino que el file browser
+          remoteLoad();
+        }
+        else if (streamTape.waiting())
+        {
+          streamPlaying();
+        }
+        else if (tapeExport.pending())
+        {
+          exportingFile();
+        }
         else if (REC)
         {
           LAST_MESSAGE = "Rec paused. Press PAUSE to start recording.";
@@ -3615,8 +3979,12 @@ void tapeControl()
         else if (DISABLE_SD)
         {
           DISABLE_SD = false;
-          // Deshabilitamos temporalmente la SD para poder subir un firmware
-          sdf.end();
+          // Deshabilitamos temporalmente la SD para poder subir un firmware.
+          // El bus no se retiene durante la espera (la web no puede quedarse bloqueada).
+          {
+            SDremount remount;
+            sdf.end();
+          }
           int tout = 59;
           while(tout != 0)
           {
@@ -3626,7 +3994,10 @@ void tapeControl()
           }
 
           hmi.writeString("debug.blockLoading.txt=\"..\"");
-          sdf.begin(ESP32kit.pinSpiCs(), SD_SCK_MHZ(SD_SPEED_MHZ));  
+          {
+            SDremount remount;
+            sdf.begin(ESP32kit.pinSpiCs(), SD_SCK_MHZ(SD_SPEED_MHZ));  
+          }
         }        
         else
         {
@@ -3918,6 +4289,18 @@ void tapeControl()
           TAPESTATE = 0;
           LOADING_STATE = 0;
         }
+        else if (LOAD_REQUEST)
+        {
+          remoteLoad();
+        }
+        else if (streamTape.waiting())
+        {
+          streamPlaying();
+        }
+        else if (tapeExport.pending())
+        {
+          exportingFile();
+        }
         else if (REC)
         {
           if (FILE_PREPARED)
@@ -4040,73 +4423,7 @@ void tapeControl()
 
           if(FILE_SELECTED)
           {
-              // Si se ha seleccionado lo cargo en el cassette.     
-              char* file_ch = (char*)ps_calloc(256,sizeof(char));
-              PATH_FILE_TO_LOAD.toCharArray(file_ch, 256);
-              
-              loadingFile(file_ch);
-              free(file_ch);
-
-              // Ponemos FILE_SELECTED = false, para el proximo fichero     
-              FILE_SELECTED = false;
-              
-              // Ahora miro si está preparado
-              if(FILE_PREPARED)
-              {
-                #ifdef DEBUGMODE
-                  logAlert("File inside the tape.");
-                #endif
-                
-                // Avanzamos ahora hasta el primer bloque playeable
-                if (!ABORT)
-                {
-                  logln("Type file load: " + TYPE_FILE_LOAD);
-
-                  if (TYPE_FILE_LOAD != "WAV" && TYPE_FILE_LOAD != "MP3")
-                  {
-                    getTheFirstPlayeableBlock();
-
-                    LAST_MESSAGE = "File inside the TAPE.";
-                    PROGRAM_NAME = FILE_LOAD;
-                    HMI_FNAME = FILE_LOAD;
-
-                    TAPESTATE = 10;
-                    LOADING_STATE = 0;
-
-                  }
-                  else
-                  {
-                    PROGRAM_NAME = FILE_LOAD;
-                    hmi.writeString("name.txt=\"" + FILE_LOAD + "\"");
-
-                    LAST_MESSAGE = "File inside the TAPE.";
-                    HMI_FNAME = FILE_LOAD;
-
-                    TAPESTATE = 10;
-                    LOADING_STATE = 0;
-
-                    // Esto lo hacemos para llevar el control desde el WAV player 
-                    playingFile();
-                  }
-
-                }
-                else
-                {
-                  LAST_MESSAGE = "Aborting proccess.";
-                  delay(2000);
-                  TAPESTATE = 0;
-                  LOADING_STATE = 0;
-                }
-              }
-              else
-              {
-
-                #ifdef DEBUGMODE
-                  logAlert("No file selected or empty file.");
-                #endif
-
-                LAST_MESSAGE = "No file selected or empty file.";                
-              }
+              insertSelectedFile();
           }
           else
           {
@@ -4284,7 +4601,14 @@ void Task1code( void * pvParameters )
         if (serialEventRun) serialEventRun();
 
         esp_task_wdt_reset();
+
+        // Órdenes del HMI y la web
+        transportService();
+
         tapeControl();
+
+        // Estado para el HMI y la web
+        tapeStatus.publishIfDue();
     }
 }
 
@@ -4329,20 +4653,38 @@ void Task0code( void * pvParameters )
             startTime = millis();
             stackFreeCore1 = uxTaskGetStackHighWaterMark(Task1);    
             stackFreeCore0 = uxTaskGetStackHighWaterMark(Task0);        
+            hmiOut.beginFrame();
             hmi.updateInformationMainPage();
-          }    
+            hmiOut.endFrame();
+          }
+
+          // Pantalla de carga pendiente de enviar
+          screenPreview.pump();
+
+          // Trama del osciloscopio (si la página SCOPE está visible)
+          scope.pump();
+
+          // Cambios de estado hacia los clientes del WebSocket /ws
+          remoteStatusPump();
+
+          if (HMI_LINK_BENCH_REQUEST)
+          {
+            HMI_LINK_BENCH_REQUEST = false;
+
+            // Las respuestas se leen directamente de la UART
+            hmiRx.suspend(true);
+            hmiLink.benchmark();
+            hmiRx.suspend(false);
+
+            tHMIlinkReport link = hmiLink.report();
+            LAST_MESSAGE = "HMI link: " + String(link.cmdsPerSec) + " cmd/s at " + String(link.baud) + " bauds";
+          }
 
           if ((millis() - startTime2) > tRotateNameRfsh && FILE_LOAD.length() > windowNameLength)
           {
-            // Capturamos el texto con tamaño de la ventana
-            if (TYPE_FILE_LOAD == "WAV" || TYPE_FILE_LOAD == "MP3")
-            {
-              hmi.writeString("name.txt=\"" + FILE_LOAD.substring(posRotateName, posRotateName + windowNameLength) + "\"");
-            }
-            else
-            {
-              PROGRAM_NAME = FILE_LOAD.substring(posRotateName, posRotateName + windowNameLength);
-            }
+            // Capturamos el texto con tamaño de la ventana. Va directo a la pantalla
+            // (PROGRAM_NAME es de la tarea del reproductor).
+            hmi.writeString("name.txt=\"" + FILE_LOAD.substring(posRotateName, posRotateName + windowNameLength) + "\"");
             // Lo rotamos segun el sentido que toque
             posRotateName += moveDirection;
             // Comprobamos limites para ver si hay que cambiar sentido
@@ -4377,16 +4719,23 @@ void setup()
     
     // Configuramos el size de los buffers de TX y RX del puerto serie
     SerialHW.setRxBufferSize(4096);
-    SerialHW.setTxBufferSize(4096);
+    SerialHW.setTxBufferSize(HMIOUT_TX_RING);
     // Configuramos la velocidad del puerto serie
     SerialHW.begin(SerialHWDataBits,SERIAL_8N1,hmiRxD,hmiTxD);
     //SerialHW.begin(512000);
     delay(125);
 
+    // La pantalla puede estar a otra velocidad (arranque anterior o "bauds" del proyecto)
+    hmiLink.detect(SerialHWDataBits);
+
     // Forzamos un reinicio de la pantalla
     hmi.writeString("rest");
     delay(125);
 
+    // Tras el reinicio vuelve a su velocidad por defecto. Subimos a la mayor que sea fiable.
+    hmiLink.negotiate(hmiLink.report().baud, HMI_LINK_MAX_BAUD, SerialHWDataBits);
+    logln("HMI link at " + String(hmiLink.report().baud) + " bauds");
+
     // Indicamos que estamos haciendo reset
     sendStatus(RESET, 1);
     delay(250);
@@ -4463,6 +4812,8 @@ void setup()
     File32 firmware =  sdm.openFile32(strpath);
     if (firmware) 
     {
+      // Ya no se vuelve de aquí (se reinicia)
+      SDioLock lock(SDIO_INTERACTIVE);
       hmi.writeString("statusLCD.txt=\"New powadcr firmware found\"" );       
       onOTAStart();
       log_v("found!");
@@ -4506,7 +4857,7 @@ void setup()
     // -------------------------------------------------------------------------
     // Actualizacion del HMI
     // -------------------------------------------------------------------------
-    if (sdf.exists("/powadcr_iface.tft"))
+    if (sdExists("/powadcr_iface.tft"))
     {
         // NOTA: Este metodo necesita que la pantalla esté alimentada con 5V
         //writeStatusLCD("Uploading display firmware");
@@ -4515,10 +4866,15 @@ void setup()
         char strpath[20] = {};
         strcpy(strpath,"/powadcr_iface.tft");
 
-        uploadFirmDisplay(strpath);
-        sdf.remove(strpath);
-        // Esperamos al reinicio de la pantalla
+        // Solo se borra si ha terminado. Si no, en el siguiente arranque se continúa.
+        if (uploadFirmDisplay(strpath))
+        {
+            SDioLock lock(SDIO_INTERACTIVE);
+            sdf.remove(strpath);
+        }
+        // Esperamos al reinicio de la pantalla y volvemos a ajustar la velocidad
         delay(5000);
+        hmiLink.negotiate(hmiLink.report().baud, HMI_LINK_MAX_BAUD, SerialHWDataBits);
     }
 
     // -------------------------------------------------------------------------
@@ -4552,9 +4908,9 @@ void setup()
     String fDir = "/FAV";
     
     //Esto lo hacemos para ver si el directorio existe
-    if (!sdf.chdir(fDir))
+    if (!sdChdir(fDir))
     {
-        if (!sdf.mkdir(fDir))
+        if (!sdMkdir(fDir))
         {
           #ifdef DEBUGMODE
             logln("");
@@ -4573,9 +4929,9 @@ void setup()
     fDir = "/REC";
     
     //Esto lo hacemos para ver si el directorio existe
-    if (!sdf.chdir(fDir))
+    if (!sdChdir(fDir))
     {
-        if (!sdf.mkdir(fDir))
+        if (!sdMkdir(fDir))
         {
           #ifdef DEBUGMODE
             logln("");
@@ -4594,9 +4950,9 @@ void setup()
     fDir = "/WAV";
     
     //Esto lo hacemos para ver si el directorio existe
-    if (!sdf.chdir(fDir))
+    if (!sdChdir(fDir))
     {
-        if (!sdf.mkdir(fDir))
+        if (!sdMkdir(fDir))
         {
           #ifdef DEBUGMODE
             logln("");
@@ -4679,6 +5035,9 @@ void setup()
     esp_task_wdt_add(&Task1);  
     delay(500);
     
+    // A partir de aquí los comandos de la pantalla llegan por el callback de la UART
+    hmiRx.begin(SerialHW);
+
     // Control de la UART - HMI
     xTaskCreatePinnedToCore(Task0code, "TaskCORE0", 8192, NULL, 3|portPRIVILEGE_BIT, &Task0, 1);
     esp_task_wdt_add(&Task0);  
@@ -4687,6 +5046,9 @@ void setup()
     // Inicializamos el modulo de recording
     taprec.set_HMI(hmi);
     taprec.set_SdFat32(sdf);
+
+    // Sigue la comprobación de cintas si se apagó a mitad
+    integrity.resumeIfPending();
     
     //hmi.getMemFree();
     taskStop = false;
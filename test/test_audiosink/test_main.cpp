@@ -0,0 +1,229 @@
+// WavSink y CswSink (AudioSink.h): salida byte a byte contra ficheros de referencia y la misma
+// salida sin importar cómo llegan troceadas las muestras del ZXProcessor.
+
+#include <unity.h>
+#include <vector>
+#include <random>
+
+#include "AudioSink.h"
+
+typedef std::vector<uint8_t> tBytes;
+
+struct tVecOut : public AudioByteOut
+{
+    tBytes v;
+
+    bool put(const uint8_t* data, size_t len) override
+    {
+        v.insert(v.end(), data, data + len);
+        return true;
+    }
+
+    bool patch(uint32_t offset, const uint8_t* data, size_t len) override
+    {
+        if (offset + len > v.size())
+        {
+            return false;
+        }
+        memcpy(&v[offset], data, len);
+        return true;
+    }
+};
+
+// Muestras como las deja ZXProcessor: R y L iguales, 16 bits
+static tBytes frames(const std::vector<int16_t> &s)
+{
+    tBytes f;
+    for (int16_t x : s)
+    {
+        uint8_t b[AUDIO_SINK_FRAME];
+        memcpy(b, &x, 2);
+        memcpy(b + 2, &x, 2);
+        f.insert(f.end(), b, b + AUDIO_SINK_FRAME);
+    }
+    return f;
+}
+
+// Escribe en trozos de tamaño al azar (siempre muestras enteras)
+static void feed(ZXAudioSink &sink, const tBytes &f, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    size_t p = 0;
+    while (p < f.size())
+    {
+        size_t n = AUDIO_SINK_FRAME * (1 + rng() % 700);
+        if (n > f.size() - p)
+        {
+            n = f.size() - p;
+        }
+        sink.write(f.data() + p, n);
+        p += n;
+    }
+}
+
+static tBytes wav(const std::vector<int16_t> &s, uint32_t rate, uint8_t bits, uint32_t seed)
+{
+    tVecOut out;
+    WavSink w(out, rate, bits);
+    w.begin();
+    feed(w, frames(s), seed);
+    w.finish();
+    return out.v;
+}
+
+static tBytes csw(const std::vector<int16_t> &s, uint32_t rate, uint32_t seed)
+{
+    tVecOut out;
+    CswSink c(out, rate);
+    c.begin();
+    feed(c, frames(s), seed);
+    c.finish();
+    return out.v;
+}
+
+static std::vector<int16_t> square(uint32_t seed, std::vector<uint32_t> &runs)
+{
+    std::mt19937 rng(seed);
+    std::vector<int16_t> s;
+    bool high = rng() & 1;
+    int n = 1 + rng() % 60;
+    for (int r = 0; r < n; r++)
+    {
+        uint32_t len = 1 + (rng() % 4 == 0 ? rng() % 2000 : rng() % 300);
+        runs.push_back(len);
+        for (uint32_t i = 0; i < len; i++)
+        {
+            // Bajo puede ser negativo o 0 (ZEROLEVEL)
+            s.push_back(high ? 32767 : ((rng() & 1) ? -32767 : 0));
+        }
+        high = !high;
+    }
+    return s;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_wav16_reference()
+{
+    tBytes got = wav({1000, 1000, -1000, 0, 32767}, 44100, 16, 1);
+
+    const uint8_t ref[] = {
+        'R', 'I', 'F', 'F', 0x2E, 0x00, 0x00, 0x00, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+        0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x44, 0xAC, 0x00, 0x00, 0x88, 0x58, 0x01, 0x00,
+        0x02, 0x00, 0x10, 0x00, 'd', 'a', 't', 'a', 0x0A, 0x00, 0x00, 0x00,
+        0xE8, 0x03, 0xE8, 0x03, 0x18, 0xFC, 0x00, 0x00, 0xFF, 0x7F
+    };
+
+    TEST_ASSERT_EQUAL_INT(sizeof(ref), got.size());
+    TEST_ASSERT_EQUAL_MEMORY(ref, got.data(), sizeof(ref));
+}
+
+// 8 bits sin signo, y el bloque de datos impar se rellena a par
+void test_wav8_reference()
+{
+    tBytes got = wav({32767, -32767, 0}, 22050, 8, 1);
+
+    const uint8_t ref[] = {
+        'R', 'I', 'F', 'F', 0x28, 0x00, 0x00, 0x00, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+        0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x22, 0x56, 0x00, 0x00, 0x22, 0x56, 0x00, 0x00,
+        0x01, 0x00, 0x08, 0x00, 'd', 'a', 't', 'a', 0x03, 0x00, 0x00, 0x00,
+        0xFF, 0x00, 0x80, 0x00
+    };
+
+    TEST_ASSERT_EQUAL_INT(sizeof(ref), got.size());
+    TEST_ASSERT_EQUAL_MEMORY(ref, got.data(), sizeof(ref));
+}
+
+// 3 altas, 300 bajas (no cabe en un byte), 2 altas
+void test_csw_reference()
+{
+    std::vector<int16_t> s(3, 32767);
+    s.insert(s.end(), 300, -32767);
+    s.insert(s.end(), 2, 32767);
+    tBytes got = csw(s, 44100, 1);
+
+    tBytes ref(CSW_HEADER_SIZE, 0);
+    memcpy(ref.data(), "Compressed Square Wave\x1A", 23);
+    ref[0x17] = 1;
+    ref[0x18] = 1;
+    ref[0x19] = 0x44;
+    ref[0x1A] = 0xAC;
+    ref[0x1B] = 1;
+    ref[0x1C] = 1;
+    const uint8_t pulses[] = {0x03, 0x00, 0x2C, 0x01, 0x00, 0x00, 0x02};
+    ref.insert(ref.end(), pulses, pulses + sizeof(pulses));
+
+    TEST_ASSERT_EQUAL_INT(ref.size(), got.size());
+    TEST_ASSERT_EQUAL_MEMORY(ref.data(), got.data(), ref.size());
+}
+
+// La salida no depende de cómo se trocean las muestras
+void test_chunking_is_bit_identical()
+{
+    for (uint32_t seed = 1; seed <= 50; seed++)
+    {
+        std::vector<uint32_t> runs;
+        std::vector<int16_t> s = square(seed, runs);
+
+        tBytes a = wav(s, 44100, 16, seed);
+        tBytes b = wav(s, 44100, 16, seed + 1000);
+        TEST_ASSERT_TRUE(a == b);
+
+        a = wav(s, 32000, 8, seed);
+        b = wav(s, 32000, 8, seed + 1000);
+        TEST_ASSERT_TRUE(a == b);
+
+        a = csw(s, 44100, seed);
+        b = csw(s, 44100, seed + 1000);
+        TEST_ASSERT_TRUE(a == b);
+    }
+}
+
+// Se recuperan las muestras del WAV y los semipulsos del CSW
+void test_round_trip()
+{
+    for (uint32_t seed = 1; seed <= 50; seed++)
+    {
+        std::vector<uint32_t> runs;
+        std::vector<int16_t> s = square(seed, runs);
+
+        tBytes w = wav(s, 44100, 16, seed);
+        TEST_ASSERT_EQUAL_INT(WAV_HEADER_SIZE + s.size() * 2, w.size());
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            int16_t v = (int16_t)(w[WAV_HEADER_SIZE + 2 * i] | (w[WAV_HEADER_SIZE + 2 * i + 1] << 8));
+            TEST_ASSERT_EQUAL_INT(s[i], v);
+        }
+
+        tBytes c = csw(s, 44100, seed);
+        std::vector<uint32_t> got;
+        size_t q = CSW_HEADER_SIZE;
+        while (q < c.size())
+        {
+            if (c[q] != 0)
+            {
+                got.push_back(c[q]);
+                q++;
+            }
+            else
+            {
+                got.push_back(c[q + 1] | (c[q + 2] << 8) | (c[q + 3] << 16) | ((uint32_t)c[q + 4] << 24));
+                q += 5;
+            }
+        }
+        TEST_ASSERT_TRUE(got == runs);
+        TEST_ASSERT_EQUAL_INT(s[0] > 0 ? 1 : 0, c[0x1C]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wav16_reference);
+    RUN_TEST(test_wav8_reference);
+    RUN_TEST(test_csw_reference);
+    RUN_TEST(test_chunking_is_bit_identical);
+    RUN_TEST(test_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,361 @@
+// TapeDigitiser + DigitiseWriter (TapeDigitiser.h): se sintetiza el audio de una cinta (ROM y
+// turbo, con ruido y offset de continua) a varias frecuencias y se comprueba el TAP/TZX que sale.
+
+#include <unity.h>
+#include <vector>
+#include <random>
+
+#include "TapeDigitiser.h"
+
+typedef std::vector<uint8_t> tBytes;
+
+struct tVecOut : public AudioByteOut
+{
+    tBytes v;
+
+    bool put(const uint8_t* data, size_t len) override
+    {
+        v.insert(v.end(), data, data + len);
+        return true;
+    }
+
+    bool patch(uint32_t offset, const uint8_t* data, size_t len) override
+    {
+        if (offset + len > v.size())
+        {
+            return false;
+        }
+        memcpy(&v[offset], data, len);
+        return true;
+    }
+};
+
+// Tiempos en T-states
+struct tTiming
+{
+    uint32_t pilot;
+    uint32_t sync1;
+    uint32_t sync2;
+    uint32_t bit0;
+    uint32_t bit1;
+    uint32_t pilotPulses;
+};
+
+static const tTiming ROM_HEADER = {2168, 667, 735, 855, 1710, 8063};
+static const tTiming ROM_DATA = {2168, 667, 735, 855, 1710, 3223};
+static const tTiming TURBO = {2168, 667, 735, 500, 1000, 3223};
+
+// Señal cuadrada como la de un casete: amplitud, ruido y continua
+class tTapeSignal
+{
+    private:
+
+        std::mt19937 _rng;
+        double _rate;
+        double _acc = 0;
+        int _level = 1;
+        int _amp;
+        int _noise;
+        int _dc;
+
+        int16_t sample(double v)
+        {
+            v += _dc + (int)(_rng() % (2 * _noise + 1)) - _noise;
+            return (int16_t)(v > 32767 ? 32767 : (v < -32767 ? -32767 : v));
+        }
+
+    public:
+
+        std::vector<int16_t> s;
+
+        tTapeSignal(double rate, int amp, int noise, int dc) : _rng(7), _rate(rate), _amp(amp), _noise(noise), _dc(dc)
+        {
+        }
+
+        void half(uint32_t t)
+        {
+            _acc += t * _rate / DIGIT_CPU;
+            int n = (int)_acc;
+            _acc -= n;
+            for (int i = 0; i < n; i++)
+            {
+                s.push_back(sample(_level * _amp));
+            }
+            _level = -_level;
+        }
+
+        void silence(uint32_t ms)
+        {
+            uint32_t n = ms * _rate / 1000;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                s.push_back(sample(0));
+            }
+        }
+
+        void block(const tBytes &d, const tTiming &t, uint8_t usedBits = 8)
+        {
+            for (uint32_t i = 0; i < t.pilotPulses; i++)
+            {
+                half(t.pilot);
+            }
+            half(t.sync1);
+            half(t.sync2);
+            for (size_t i = 0; i < d.size(); i++)
+            {
+                int bits = i + 1 == d.size() ? usedBits : 8;
+                for (int b = 0; b < bits; b++)
+                {
+                    uint32_t w = (d[i] >> (7 - b)) & 1 ? t.bit1 : t.bit0;
+                    half(w);
+                    half(w);
+                }
+            }
+            half(945);
+        }
+};
+
+// Bloque con flag y checksum correctos
+static tBytes tapeBlock(size_t n, uint8_t flag, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    tBytes d(n);
+    d[0] = flag;
+    uint8_t chk = flag;
+    for (size_t i = 1; i < n - 1; i++)
+    {
+        d[i] = (uint8_t)rng();
+        chk ^= d[i];
+    }
+    d[n - 1] = chk;
+    return d;
+}
+
+struct tDecoded
+{
+    std::vector<tDigitBlock> blocks;
+    std::vector<tBytes> data;
+    tBytes out;
+    uint32_t written = 0;
+    uint32_t lost = 0;
+};
+
+static tDecoded decode(const std::vector<int16_t> &s, uint32_t rate, bool tzx)
+{
+    tDecoded r;
+    tVecOut out;
+    TapeDigitiser dec(rate);
+    DigitiseWriter w(out, tzx);
+    w.begin();
+
+    for (size_t i = 0; i <= s.size(); i++)
+    {
+        bool got = i < s.size() ? dec.push(s[i]) : dec.flush();
+        if (got)
+        {
+            r.blocks.push_back(dec.block());
+            r.data.emplace_back(dec.data(), dec.data() + dec.block().size);
+            w.add(dec.block(), dec.data());
+        }
+    }
+
+    w.finish(dec.trailingMs());
+    r.out = out.v;
+    r.written = w.written();
+    r.lost = dec.lost();
+    return r;
+}
+
+static uint16_t le16(const tBytes &v, size_t p)
+{
+    return v[p] | (v[p + 1] << 8);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Cabecera y datos de la ROM y un bloque turbo, a varias frecuencias y con continua
+void test_rom_and_turbo()
+{
+    const tBytes header = tapeBlock(19, 0x00, 1);
+    const tBytes data = tapeBlock(6914, 0xFF, 2);
+    const tBytes turbo = tapeBlock(300, 0xFF, 3);
+
+    for (uint32_t rate : {22050u, 44100u, 48000u})
+    {
+        for (int dc : {0, 2000})
+        {
+            tTapeSignal sig(rate, 20000, 1500, dc);
+            sig.silence(300);
+            sig.block(header, ROM_HEADER);
+            sig.silence(1000);
+            sig.block(data, ROM_DATA);
+            sig.silence(2000);
+            sig.block(turbo, TURBO);
+            sig.silence(500);
+
+            tDecoded r = decode(sig.s, rate, true);
+
+            TEST_ASSERT_EQUAL_INT(3, r.blocks.size());
+            TEST_ASSERT_TRUE(r.data[0] == header);
+            TEST_ASSERT_TRUE(r.data[1] == data);
+            TEST_ASSERT_TRUE(r.data[2] == turbo);
+            for (const tDigitBlock &b : r.blocks)
+            {
+                TEST_ASSERT_TRUE(b.checksumOk);
+            }
+            TEST_ASSERT_TRUE(digitIsStandard(r.blocks[0]));
+            TEST_ASSERT_TRUE(digitIsStandard(r.blocks[1]));
+            TEST_ASSERT_FALSE(digitIsStandard(r.blocks[2]));
+
+            // TZX: 0x10, 0x10 y 0x11 con las pausas medidas
+            const tBytes &v = r.out;
+            TEST_ASSERT_EQUAL_MEMORY("ZXTape!\x1A", v.data(), 8);
+            size_t p = 10;
+            TEST_ASSERT_EQUAL_HEX8(0x10, v[p]);
+            TEST_ASSERT_UINT32_WITHIN(100, 1000, le16(v, p + 1));
+            TEST_ASSERT_EQUAL_INT(19, le16(v, p + 3));
+            p += 5 + 19;
+            TEST_ASSERT_EQUAL_HEX8(0x10, v[p]);
+            TEST_ASSERT_UINT32_WITHIN(100, 2000, le16(v, p + 1));
+            p += 5 + 6914;
+            TEST_ASSERT_EQUAL_HEX8(0x11, v[p]);
+            TEST_ASSERT_UINT32_WITHIN(60, 500, le16(v, p + 7));
+            TEST_ASSERT_UINT32_WITHIN(100, 1000, le16(v, p + 9));
+            TEST_ASSERT_EQUAL_INT(8, v[p + 13]);
+            p += 19 + 300;
+            TEST_ASSERT_EQUAL_INT(p, v.size());
+        }
+    }
+}
+
+// En TAP solo van tamaño y datos
+void test_tap_output()
+{
+    const tBytes header = tapeBlock(19, 0x00, 4);
+    const tBytes data = tapeBlock(500, 0xFF, 5);
+
+    tTapeSignal sig(44100, 20000, 500, 0);
+    sig.silence(200);
+    sig.block(header, ROM_HEADER);
+    sig.silence(1000);
+    sig.block(data, ROM_DATA);
+    sig.silence(200);
+
+    tDecoded r = decode(sig.s, 44100, false);
+
+    tBytes ref;
+    for (const tBytes* b : {&header, &data})
+    {
+        ref.push_back(b->size() & 0xFF);
+        ref.push_back(b->size() >> 8);
+        ref.insert(ref.end(), b->begin(), b->end());
+    }
+    TEST_ASSERT_EQUAL_INT(2, r.written);
+    TEST_ASSERT_TRUE(r.out == ref);
+}
+
+// Último byte incompleto: en TZX va como 0x11 con sus bits, en TAP no se puede escribir
+void test_partial_last_byte()
+{
+    const tBytes data = tapeBlock(100, 0xFF, 6);
+
+    tTapeSignal sig(44100, 20000, 500, 0);
+    sig.silence(200);
+    sig.block(data, ROM_DATA, 5);
+    sig.silence(500);
+
+    tDecoded r = decode(sig.s, 44100, true);
+    TEST_ASSERT_EQUAL_INT(1, r.blocks.size());
+    TEST_ASSERT_EQUAL_INT(5, r.blocks[0].usedBits);
+    TEST_ASSERT_EQUAL_INT(100, r.blocks[0].size);
+    TEST_ASSERT_EQUAL_HEX8(0x11, r.out[10]);
+    TEST_ASSERT_EQUAL_INT(5, r.out[10 + 13]);
+
+    r = decode(sig.s, 44100, false);
+    TEST_ASSERT_EQUAL_INT(1, r.blocks.size());
+    TEST_ASSERT_EQUAL_INT(0, r.written);
+}
+
+// Checksum mal: el bloque se escribe igual y se anota
+void test_bad_checksum()
+{
+    tBytes data = tapeBlock(200, 0xFF, 7);
+    data[50] ^= 0x10;
+
+    tTapeSignal sig(44100, 20000, 500, 0);
+    sig.silence(200);
+    sig.block(data, ROM_DATA);
+    sig.silence(500);
+
+    tDecoded r = decode(sig.s, 44100, true);
+    TEST_ASSERT_EQUAL_INT(1, r.written);
+    TEST_ASSERT_FALSE(r.blocks[0].checksumOk);
+    TEST_ASSERT_TRUE(r.data[0] == data);
+
+    char line[300];
+    TEST_ASSERT_TRUE(digitiseBlockLine(line, sizeof(line), r.blocks[0], r.data[0].data(), true) > 0);
+    TEST_ASSERT_NOT_NULL(strstr(line, "CHK BAD"));
+}
+
+// Solo ruido: ningún bloque
+void test_noise_only()
+{
+    std::mt19937 rng(8);
+    std::vector<int16_t> s(44100 * 5);
+    for (int16_t &x : s)
+    {
+        x = (int16_t)((int)(rng() % 20001) - 10000);
+    }
+
+    tDecoded r = decode(s, 44100, true);
+    TEST_ASSERT_EQUAL_INT(0, r.blocks.size());
+    TEST_ASSERT_EQUAL_INT(10, r.out.size());
+}
+
+void test_wav_header()
+{
+    // Estéreo 16 bits con un bloque LIST antes de "data"
+    uint8_t h[80] = {0};
+    memcpy(h, "RIFF", 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    h[16] = 16;
+    h[20] = 1;
+    h[22] = 2;
+    h[24] = 0x44;
+    h[25] = 0xAC;
+    h[34] = 16;
+    memcpy(h + 36, "LIST", 4);
+    h[40] = 4;
+    memcpy(h + 48, "data", 4);
+
+    tWavInfo info;
+    TEST_ASSERT_TRUE(wavParseHeader(h, sizeof(h), 100000, info));
+    TEST_ASSERT_EQUAL_UINT32(44100, info.rate);
+    TEST_ASSERT_EQUAL_INT(2, info.channels);
+    TEST_ASSERT_EQUAL_INT(16, info.bits);
+    TEST_ASSERT_EQUAL_UINT32(56, info.dataOffset);
+    // Tamaño 0 (grabación sin cerrar): hasta el final del fichero
+    TEST_ASSERT_EQUAL_UINT32(100000 - 56, info.dataSize);
+
+    const uint8_t frame[4] = {0x34, 0x12, 0xCD, 0xAB};
+    TEST_ASSERT_EQUAL_INT(0x1234, wavSample(frame, info, 0));
+    TEST_ASSERT_EQUAL_INT((int16_t)0xABCD, wavSample(frame, info, 1));
+
+    // 24 bits no
+    h[34] = 24;
+    TEST_ASSERT_FALSE(wavParseHeader(h, sizeof(h), 100000, info));
+    TEST_ASSERT_FALSE(wavParseHeader(h, 8, 100000, info));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rom_and_turbo);
+    RUN_TEST(test_tap_output);
+    RUN_TEST(test_partial_last_byte);
+    RUN_TEST(test_bad_checksum);
+    RUN_TEST(test_noise_only);
+    RUN_TEST(test_wav_header);
+    return UNITY_END();
+}
@@ -0,0 +1,151 @@
+// HMIframer + hmiLookup (HMIparser.h): se reproducen ráfagas de la UART como las que manda
+// la pantalla y se comprueba qué comando le llega a HMI::dispatchFrame / verifyCommand.
+
+#include <unity.h>
+#include <string>
+#include <vector>
+
+#include "HMIparser.h"
+
+struct tDispatched
+{
+    int id;
+    std::string frame;
+};
+
+// Lo que hace readUART(): bytes de una ráfaga al framer, idle() al final
+static std::vector<tDispatched> replay(const std::vector<std::string> &bursts)
+{
+    HMIframer framer;
+    std::vector<tDispatched> out;
+    tHMIframe f;
+    uint32_t t = 0;
+
+    for (const std::string &burst : bursts)
+    {
+        for (char c : burst)
+        {
+            if (framer.feed((uint8_t)c, t++, f))
+            {
+                out.push_back({hmiLookup(f.data, f.len), std::string(f.data, f.len)});
+            }
+        }
+        if (framer.idle(f))
+        {
+            out.push_back({hmiLookup(f.data, f.len), std::string(f.data, f.len)});
+        }
+    }
+    return out;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_table_sorted_and_prefix_free()
+{
+    for (size_t i = 1; i < HMI_CMD_TABLE_SIZE; i++)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(strcmp(HMI_CMD_TABLE[i - 1].token, HMI_CMD_TABLE[i].token) < 0,
+                                 HMI_CMD_TABLE[i].token);
+    }
+
+    for (size_t i = 0; i < HMI_CMD_TABLE_SIZE; i++)
+    {
+        for (size_t j = 0; j < HMI_CMD_TABLE_SIZE; j++)
+        {
+            const char* a = HMI_CMD_TABLE[i].token;
+            const char* b = HMI_CMD_TABLE[j].token;
+            TEST_ASSERT_TRUE_MESSAGE(i == j || strncmp(a, b, strlen(a)) != 0, b);
+        }
+    }
+}
+
+void test_every_token_found()
+{
+    for (size_t i = 0; i < HMI_CMD_TABLE_SIZE; i++)
+    {
+        const char* t = HMI_CMD_TABLE[i].token;
+        TEST_ASSERT_EQUAL_INT(HMI_CMD_TABLE[i].id, hmiLookup(t, strlen(t)));
+
+        // Con un valor binario detrás
+        char frame[32];
+        int n = snprintf(frame, sizeof(frame), "%s", t);
+        frame[n++] = 0x00;
+        frame[n++] = (char)0xFF;
+        TEST_ASSERT_EQUAL_INT(HMI_CMD_TABLE[i].id, hmiLookup(frame, n));
+    }
+}
+
+void test_unknown_frames()
+{
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, hmiLookup("", 0));
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, hmiLookup("PLA", 3));
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, hmiLookup("VOL", 3));
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, hmiLookup("play", 4));
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, hmiLookup("\x1a\xff\xff\xff", 4));
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, hmiLookup("ZZZ", 3));
+    // Parecidos que no deben confundirse
+    TEST_ASSERT_EQUAL_INT(HMICMD_VOL, hmiLookup("VOL=\x32", 5));
+    TEST_ASSERT_EQUAL_INT(HMICMD_VOLUP, hmiLookup("VOLUP", 5));
+    TEST_ASSERT_EQUAL_INT(HMICMD_SAV, hmiLookup("SAV", 3));
+    TEST_ASSERT_EQUAL_INT(HMICMD_SAM, hmiLookup("SAM=\x01", 5));
+    TEST_ASSERT_EQUAL_INT(HMICMD_PLZ, hmiLookup("PLZ=\x01", 5));
+}
+
+// Sesión capturada: navegar, elegir fichero, PLAY, volumen, STOP y EJECT
+void test_replay_session()
+{
+    std::vector<std::string> bursts = {
+        "GFIL",
+        std::string("PAG=\x01\x00\x00\x00", 8),
+        std::string("CHD=\x03\x00\x00\x00", 8) + "   " + "LFI=" + std::string("\x02\x00\x00\x00", 4),
+        "PLAY",
+        std::string("VOL=\x40\x00\x00\x00", 8),
+        "STOP   EJECT",
+        std::string("BKX=\x0c\x00\x00\x00", 8),
+        std::string("TXTF=GAME.TAP", 13)
+    };
+
+    std::vector<tDispatched> got = replay(bursts);
+
+    const int expected[] = {
+        HMICMD_GFIL, HMICMD_PAG, HMICMD_CHD, HMICMD_LFI, HMICMD_PLAY, HMICMD_VOL,
+        HMICMD_STOP, HMICMD_EJECT, HMICMD_BKX, HMICMD_TXTF
+    };
+
+    TEST_ASSERT_EQUAL_INT(sizeof(expected) / sizeof(expected[0]), got.size());
+    for (size_t i = 0; i < got.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_INT(expected[i], got[i].id);
+    }
+
+    // Los valores binarios llegan enteros (con sus 0x00)
+    TEST_ASSERT_EQUAL_INT(8, got[1].frame.size());
+    TEST_ASSERT_EQUAL_INT(0x01, got[1].frame[4]);
+    TEST_ASSERT_EQUAL_INT(8, got[3].frame.size());
+    TEST_ASSERT_EQUAL_STRING("TXTF=GAME.TAP", got[9].frame.c_str());
+}
+
+// Una ráfaga más larga que HMI_FRAME_MAX se trocea sin perder bytes
+void test_replay_overflow()
+{
+    std::string big(HMI_FRAME_MAX + 10, 'A');
+    std::vector<tDispatched> got = replay({big, "PAUSE"});
+
+    TEST_ASSERT_EQUAL_INT(3, got.size());
+    TEST_ASSERT_EQUAL_INT(HMI_FRAME_MAX, got[0].frame.size());
+    TEST_ASSERT_EQUAL_INT(10, got[1].frame.size());
+    TEST_ASSERT_EQUAL_INT(HMICMD_NONE, got[0].id);
+    TEST_ASSERT_EQUAL_INT(HMICMD_PAUSE, got[2].id);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_table_sorted_and_prefix_free);
+    RUN_TEST(test_every_token_found);
+    RUN_TEST(test_unknown_frames);
+    RUN_TEST(test_replay_session);
+    RUN_TEST(test_replay_overflow);
+    return UNITY_END();
+}
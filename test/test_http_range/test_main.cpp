@@ -0,0 +1,119 @@
+// http_range.h: Range, ETag, Last-Modified, If-None-Match e If-Range.
+
+#include <unity.h>
+
+#include "http_range.h"
+
+static uint32_t rStart;
+static uint32_t rLength;
+
+static int range(const char* value, uint32_t size)
+{
+    rStart = rLength = 999;
+    return httpParseRange(value, size, rStart, rLength);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_range_partial()
+{
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_PARTIAL, range("bytes=0-499", 1000));
+    TEST_ASSERT_EQUAL_UINT32(0, rStart);
+    TEST_ASSERT_EQUAL_UINT32(500, rLength);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_PARTIAL, range("bytes=500-", 1000));
+    TEST_ASSERT_EQUAL_UINT32(500, rStart);
+    TEST_ASSERT_EQUAL_UINT32(500, rLength);
+
+    // Sufijo
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_PARTIAL, range("bytes=-300", 1000));
+    TEST_ASSERT_EQUAL_UINT32(700, rStart);
+    TEST_ASSERT_EQUAL_UINT32(300, rLength);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_PARTIAL, range("bytes=-3000", 1000));
+    TEST_ASSERT_EQUAL_UINT32(0, rStart);
+    TEST_ASSERT_EQUAL_UINT32(1000, rLength);
+
+    // El final se recorta al tamaño
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_PARTIAL, range("bytes=900-5000", 1000));
+    TEST_ASSERT_EQUAL_UINT32(900, rStart);
+    TEST_ASSERT_EQUAL_UINT32(100, rLength);
+
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_PARTIAL, range(" Bytes = 10-19 ", 1000));
+    TEST_ASSERT_EQUAL_UINT32(10, rStart);
+    TEST_ASSERT_EQUAL_UINT32(10, rLength);
+}
+
+void test_range_unsatisfiable()
+{
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_UNSATISFIABLE, range("bytes=1000-", 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_UNSATISFIABLE, range("bytes=-0", 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_UNSATISFIABLE, range("bytes=0-", 0));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_UNSATISFIABLE, range("bytes=99999999999999999999-", 1000));
+}
+
+// Lo que no se entiende se ignora: se envía el fichero entero
+void test_range_ignored()
+{
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_NONE, range(nullptr, 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_NONE, range("bytes=5-4", 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_NONE, range("bytes=0-1,5-6", 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_NONE, range("items=0-1", 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_NONE, range("bytes=abc", 1000));
+    TEST_ASSERT_EQUAL_INT(HTTP_RANGE_NONE, range("bytes=-", 1000));
+}
+
+void test_etag_and_date()
+{
+    char etag[32];
+    httpETag(etag, sizeof(etag), 123456, 0x5A21, 0x8C5E);
+    TEST_ASSERT_EQUAL_STRING("\"1e240-5a218c5e\"", etag);
+
+    // 2025-01-01 17:30:20
+    char date[40];
+    TEST_ASSERT_TRUE(httpDate(date, sizeof(date), (45 << 9) | (1 << 5) | 1, (17 << 11) | (30 << 5) | 10));
+    TEST_ASSERT_EQUAL_STRING("Wed, 01 Jan 2025 17:30:20 GMT", date);
+
+    // Sin fecha en la entrada del directorio
+    TEST_ASSERT_FALSE(httpDate(date, sizeof(date), 0, 0));
+}
+
+void test_if_none_match()
+{
+    const char* etag = "\"1e240-5a218c5e\"";
+
+    TEST_ASSERT_TRUE(httpETagListMatches("*", etag));
+    TEST_ASSERT_TRUE(httpETagListMatches("\"x\", W/\"1e240-5a218c5e\"", etag));
+    TEST_ASSERT_FALSE(httpETagListMatches("\"1e240-5a218c5f\"", etag));
+    TEST_ASSERT_FALSE(httpETagListMatches("", etag));
+    TEST_ASSERT_FALSE(httpETagListMatches("garbage", etag));
+    TEST_ASSERT_FALSE(httpETagListMatches("\"unterminated", etag));
+    TEST_ASSERT_FALSE(httpETagListMatches(nullptr, etag));
+}
+
+void test_if_range()
+{
+    const char* etag = "\"1e240-5a218c5e\"";
+    const char* date = "Wed, 01 Jan 2025 17:30:20 GMT";
+
+    TEST_ASSERT_TRUE(httpIfRangeMatches(nullptr, etag, ""));
+    TEST_ASSERT_TRUE(httpIfRangeMatches(etag, etag, ""));
+    // Las ETag débiles no valen para If-Range
+    TEST_ASSERT_FALSE(httpIfRangeMatches("W/\"1e240-5a218c5e\"", etag, ""));
+    TEST_ASSERT_TRUE(httpIfRangeMatches(date, etag, date));
+    TEST_ASSERT_FALSE(httpIfRangeMatches("Thu, 01 Jan 1970 00:00:00 GMT", etag, date));
+    TEST_ASSERT_FALSE(httpIfRangeMatches(date, etag, ""));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_range_partial);
+    RUN_TEST(test_range_unsatisfiable);
+    RUN_TEST(test_range_ignored);
+    RUN_TEST(test_etag_and_date);
+    RUN_TEST(test_if_none_match);
+    RUN_TEST(test_if_range);
+    return UNITY_END();
+}
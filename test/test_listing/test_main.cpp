@@ -0,0 +1,232 @@
+// Listado de /listfiles (list_stream.h) sobre un directorio de 5.000 entradas: memoria,
+// tiempo hasta el primer trozo y tiempo total del listado por trozos frente a construir toda
+// la página en una cadena, y recorrido completo con el cursor JSON. Imprime las medidas.
+
+#include <unity.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "list_stream.h"
+
+// Memoria dinámica en uso, contada en new/delete. Hace de ESP.getFreeHeap()
+static size_t liveBytes = 0;
+static const uint32_t HEAP_SIZE = 64 * 1024 * 1024;
+
+void* operator new(size_t n)
+{
+    size_t* p = (size_t*)malloc(n + sizeof(max_align_t));
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    *p = n;
+    liveBytes += n;
+    return (uint8_t*)p + sizeof(max_align_t);
+}
+
+void operator delete(void* q) noexcept
+{
+    if (q == nullptr)
+    {
+        return;
+    }
+    size_t* p = (size_t*)((uint8_t*)q - sizeof(max_align_t));
+    liveBytes -= *p;
+    free(p);
+}
+
+void operator delete(void* q, size_t) noexcept
+{
+    operator delete(q);
+}
+
+static uint32_t hostNowUs()
+{
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t hostFreeHeap()
+{
+    return HEAP_SIZE - (uint32_t)liveBytes;
+}
+
+// Lo que manda AsyncTCP por trozo (MSS de 1436 bytes)
+static const size_t CHUNK = 1436;
+static const int ENTRIES = 5000;
+
+static tDirListPtr buildDir(int entries)
+{
+    std::shared_ptr<tDirList> list = std::make_shared<tDirList>();
+    char name[200];
+    for (int i = 0; i < entries; i++)
+    {
+        bool dir = (i % 3) == 0;
+        snprintf(name, sizeof(name), "Some Very Long Game Title Number %d (1985)(Publisher Name)[a][h]%s",
+                 i, dir ? "" : ".TZX");
+        list->add(name, dir, i * 100);
+    }
+    list->sort();
+    return list;
+}
+
+struct tRun
+{
+    std::string out;
+    uint32_t ttfbUs = 0;
+    uint32_t totalUs = 0;
+    uint32_t heapUsed = 0;
+    uint32_t entries = 0;
+    uint32_t bytes = 0;
+    int chunks = 0;
+};
+
+// Como sendListing() + el callback de AsyncWebServer: trozos de CHUNK hasta que devuelve 0.
+// Con "keep" se guarda lo enviado, y esa memoria cuenta como usada por el listado.
+static tRun stream(tDirListPtr list, bool json, int first, int count, bool keep)
+{
+    tRun r;
+    uint32_t heap0 = hostFreeHeap();
+
+    tListStream* st = new tListStream();
+    st->nowUs = hostNowUs;
+    st->freeHeap = hostFreeHeap;
+    snprintf(st->dir, sizeof(st->dir), "/games");
+    st->t0 = hostNowUs();
+    st->heap0 = heap0;
+    st->heapMin = heap0;
+    st->json = json;
+    st->first = first;
+    st->end = first + count;
+    st->gen = 1;
+    st->list = list;
+
+    uint8_t buf[CHUNK];
+    size_t n;
+    while ((n = listFill(*st, buf, sizeof(buf))) > 0)
+    {
+        r.chunks++;
+        if (keep)
+        {
+            r.out.append((const char*)buf, n);
+        }
+    }
+    delete st;
+
+    r.ttfbUs = listStats.lastTtfbUs;
+    r.totalUs = listStats.lastTotalUs;
+    r.heapUsed = listStats.lastHeapUsed;
+    r.entries = listStats.lastEntries;
+    r.bytes = listStats.lastBytes;
+    return r;
+}
+
+void setUp()
+{
+    listStats = tListStats();
+}
+
+void tearDown() {}
+
+// Las 5.000 filas en HTML por trozos: la memoria es el estado del listado (~3,7 KB) sea
+// cual sea el tamaño del directorio, y el primer trozo sale enseguida
+void test_stream_html_bounded()
+{
+    tDirListPtr big = buildDir(ENTRIES);
+    tDirListPtr small = buildDir(ENTRIES / 10);
+
+    tRun r = stream(big, false, 0, ENTRIES, false);
+    tRun s = stream(small, false, 0, ENTRIES / 10, false);
+
+    printf("stream html: %d entries, %u bytes, %d chunks, ttfb %u us, total %u us, heap %u B\n",
+           ENTRIES, r.bytes, r.chunks, r.ttfbUs, r.totalUs, r.heapUsed);
+
+    TEST_ASSERT_EQUAL_UINT32(ENTRIES, r.entries);
+    TEST_ASSERT_EQUAL_UINT32(ENTRIES / 10, s.entries);
+    TEST_ASSERT_TRUE(r.bytes > 1000000);
+    TEST_ASSERT_TRUE(r.heapUsed >= sizeof(tListStream));
+    TEST_ASSERT_TRUE(r.heapUsed < sizeof(tListStream) + 1024);
+    TEST_ASSERT_EQUAL_UINT32(s.heapUsed, r.heapUsed);
+    TEST_ASSERT_TRUE(r.ttfbUs * 100 < r.totalUs);
+}
+
+// Lo de antes: toda la página en una cadena antes de mandar nada. La memoria crece con el
+// directorio y el primer byte sale cuando está todo.
+void test_single_string_baseline()
+{
+    tDirListPtr big = buildDir(ENTRIES);
+    tRun streamed = stream(big, false, 0, ENTRIES, true);
+    tRun bounded = stream(big, false, 0, ENTRIES, false);
+
+    uint32_t heap0 = hostFreeHeap();
+    uint32_t heapMin = heap0;
+    uint32_t t0 = hostNowUs();
+
+    tListStream* st = new tListStream();
+    st->list = big;
+    st->end = ENTRIES;
+    st->nowUs = hostNowUs;
+    st->freeHeap = hostFreeHeap;
+    snprintf(st->dir, sizeof(st->dir), "/games");
+
+    std::string page;
+    while (listNextPiece(*st))
+    {
+        page.append(st->row, st->len);
+        heapMin = hostFreeHeap() < heapMin ? hostFreeHeap() : heapMin;
+    }
+    delete st;
+    uint32_t totalUs = hostNowUs() - t0;
+
+    printf("single string: %zu bytes, heap %u B, first byte after %u us\n", page.size(), heap0 - heapMin, totalUs);
+
+    // Mismo contenido
+    TEST_ASSERT_TRUE(page == streamed.out);
+    TEST_ASSERT_TRUE(heap0 - heapMin > page.size());
+    TEST_ASSERT_TRUE(heap0 - heapMin > 100 * bounded.heapUsed);
+    TEST_ASSERT_TRUE(bounded.ttfbUs < totalUs);
+}
+
+// El directorio entero con el cursor JSON, 500 entradas por petición
+void test_json_cursor_pages()
+{
+    tDirListPtr big = buildDir(ENTRIES);
+    int cursor = 0;
+    int pages = 0;
+    int entries = 0;
+    size_t bytes = 0;
+    uint32_t totalUs = 0;
+
+    while (cursor >= 0)
+    {
+        tRun r = stream(big, true, cursor, LIST_JSON_LIMIT_MAX, true);
+        pages++;
+        bytes += r.out.size();
+        totalUs += r.totalUs;
+        entries += r.entries;
+
+        TEST_ASSERT_EQUAL_INT(0, strncmp("{\"dir\":\"/games\",\"gen\":1,", r.out.c_str(), 24));
+        TEST_ASSERT_EQUAL_STRING("]}", r.out.c_str() + r.out.size() - 2);
+
+        const char* next = strstr(r.out.c_str(), "\"next\":");
+        TEST_ASSERT_NOT_NULL(next);
+        cursor = atoi(next + 7);
+        TEST_ASSERT_TRUE(pages <= ENTRIES / LIST_JSON_LIMIT_MAX);
+    }
+
+    printf("json cursor: %d pages of %d, %zu bytes, %u us\n", pages, LIST_JSON_LIMIT_MAX, bytes, totalUs);
+
+    TEST_ASSERT_EQUAL_INT(ENTRIES / LIST_JSON_LIMIT_MAX, pages);
+    TEST_ASSERT_EQUAL_INT(ENTRIES, entries);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_html_bounded);
+    RUN_TEST(test_single_string_baseline);
+    RUN_TEST(test_json_cursor_pages);
+    return UNITY_END();
+}
@@ -0,0 +1,148 @@
+// ScopeCapture (Scope.h): disparo en el punto medio entre los dos niveles (también con
+// ZEROLEVEL) y cambios de configuración desde otra tarea mientras se captura.
+
+#include <unity.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "Scope.h"
+
+static const int16_t HIGH = 32767;
+static const int16_t LOW = -32767;
+
+// Punto medio como lo calcula Scope::playLevel()
+static int16_t mid(int16_t up, int16_t down)
+{
+    return (int16_t)((up + down) / 2);
+}
+
+// Cuadrada de semiperiodo "half" muestras en tramos, como la da el ZXProcessor
+static void square(ScopeCapture &cap, int16_t up, int16_t down, uint32_t half, int pulses)
+{
+    for (int i = 0; i < pulses; i++)
+    {
+        cap.run(i & 1 ? up : down, half);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Nivel bajo a 0: el flanco está en el punto medio, no en 0
+void test_zerolevel_triggers()
+{
+    ScopeCapture cap;
+    cap.configure(SCOPE_RISING, 0, mid(HIGH, 0));
+
+    square(cap, HIGH, 0, 40, 2 * SCOPE_COLUMNS);
+
+    const uint8_t* f = cap.frame();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_INT(1, cap.getStats().triggers);
+    TEST_ASSERT_EQUAL_INT(0, cap.getStats().autoTriggers);
+    // Empieza en el flanco de subida
+    TEST_ASSERT_EQUAL_INT(SCOPE_HEIGHT - 1, f[0]);
+    TEST_ASSERT_EQUAL_INT(SCOPE_HEIGHT - 1, f[2 * 39]);
+    TEST_ASSERT_TRUE(f[2 * 40] < SCOPE_HEIGHT - 1);
+}
+
+// Con el nivel en 0 (el de antes) una señal entre 0 y HIGH solo dispara por tiempo
+void test_zero_level_only_auto()
+{
+    ScopeCapture cap;
+    cap.configure(SCOPE_RISING, 0, 0);
+
+    square(cap, HIGH, 0, 40, SCOPE_AUTO_SAMPLES / 40 + 10);
+
+    TEST_ASSERT_EQUAL_INT(0, cap.getStats().triggers);
+    TEST_ASSERT_EQUAL_INT(1, cap.getStats().autoTriggers);
+}
+
+void test_falling_and_full_swing()
+{
+    ScopeCapture cap;
+    cap.configure(SCOPE_FALLING, 1, mid(HIGH, LOW));
+
+    square(cap, HIGH, LOW, 25, 2 * SCOPE_COLUMNS);
+
+    const uint8_t* f = cap.frame();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_INT(1, cap.getStats().triggers);
+    // Empieza en bajo
+    TEST_ASSERT_EQUAL_INT(0, f[0]);
+    TEST_ASSERT_EQUAL_INT(0, f[1]);
+}
+
+// Grabación: muestras centradas en 0 sea cual sea el nivel de reproducción
+void test_record_samples()
+{
+    ScopeCapture cap;
+    cap.configure(SCOPE_RISING, 0, mid(HIGH, 0));
+
+    std::vector<int16_t> s;
+    for (int i = 0; i < 4 * SCOPE_COLUMNS; i++)
+    {
+        int16_t v = (i / 20) & 1 ? 8000 : -8000;
+        s.push_back(v);
+        s.push_back(v);
+    }
+    cap.samples(s.data(), s.size() / 2, 2);
+
+    TEST_ASSERT_NOT_NULL(cap.frame());
+    TEST_ASSERT_EQUAL_INT(1, cap.getStats().triggers);
+}
+
+// La tarea del HMI cambia la configuración sin parar mientras la del audio captura
+void test_configure_while_running()
+{
+    ScopeCapture cap;
+    std::atomic<bool> stop{false};
+
+    std::thread audio([&]()
+    {
+        for (int i = 0; !stop.load(); i++)
+        {
+            cap.run(i & 1 ? HIGH : LOW, 1 + i % 50);
+        }
+    });
+
+    std::thread hmi([&]()
+    {
+        for (int k = 0; k < 20000; k++)
+        {
+            cap.configure(k % 3, k % SCOPE_NUM_ZOOM, (int16_t)(k * 7));
+            if (cap.frame() != nullptr)
+            {
+                cap.consume();
+            }
+        }
+        // Última configuración: disparo libre, una muestra por columna
+        cap.configure(SCOPE_FREE, 0, 0);
+    });
+
+    hmi.join();
+    // La tarea del audio aplica la última y completa tramas con ella
+    cap.consume();
+    uint32_t before = cap.getStats().frames;
+    while (cap.getStats().frames < before + 3)
+    {
+        cap.consume();
+        std::this_thread::yield();
+    }
+    stop = true;
+    audio.join();
+
+    TEST_ASSERT_TRUE(cap.getStats().frames > 0);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_zerolevel_triggers);
+    RUN_TEST(test_zero_level_only_auto);
+    RUN_TEST(test_falling_and_full_swing);
+    RUN_TEST(test_record_samples);
+    RUN_TEST(test_configure_while_running);
+    return UNITY_END();
+}
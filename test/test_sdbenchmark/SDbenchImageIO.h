@@ -0,0 +1,113 @@
+// SDbenchIO sobre un fichero imagen del host. El reloj es virtual: cada acceso suma un coste
+// fijo más otro proporcional a los bytes, según los MHz simulados, así las medidas son
+// deterministas. Por encima de un reloj límite la "tarjeta" corrompe lecturas o escrituras.
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include "SDbenchmark.h"
+
+class SDbenchImageIO : public SDbenchIO
+{
+    private:
+
+        const char* _path;
+        FILE* _f = nullptr;
+        uint64_t _clockUs = 0;
+
+        // SPI de 1 bit: mhz millones de bits por segundo
+        void advance(int bytes)
+        {
+            _clockUs += cmdUs + ((uint64_t)bytes * 8) / mhz;
+        }
+
+    public:
+
+        // Reloj SPI simulado (MHz) y coste fijo por comando
+        int mhz = 20;
+        uint32_t cmdUs = 200;
+
+        // Fallos simulados: cada cuántas lecturas se invierte un bit del dato leído,
+        // cada cuántas escrituras se guarda un byte mal, y cada cuántas lecturas se
+        // devuelve menos de lo pedido. 0 desactiva cada uno.
+        int flipEveryReads = 0;
+        int badEveryWrites = 0;
+        int shortEveryReads = 0;
+
+        int reads = 0;
+        int writes = 0;
+
+        SDbenchImageIO(const char* path) : _path(path) {}
+
+        ~SDbenchImageIO()
+        {
+            close();
+        }
+
+        bool open() override
+        {
+            _f = fopen(_path, "w+b");
+            return _f != nullptr;
+        }
+
+        bool seek(uint32_t offset) override
+        {
+            return fseek(_f, offset, SEEK_SET) == 0;
+        }
+
+        int read(uint8_t* buffer, int len) override
+        {
+            reads++;
+            int n = (int)fread(buffer, 1, len, _f);
+            if (shortEveryReads && reads % shortEveryReads == 0 && n > 0)
+            {
+                n--;
+            }
+            if (flipEveryReads && reads % flipEveryReads == 0 && n > 0)
+            {
+                buffer[n / 2] ^= 0x10;
+            }
+            advance(n);
+            return n;
+        }
+
+        int write(const uint8_t* buffer, int len) override
+        {
+            writes++;
+            int n;
+            if (badEveryWrites && writes % badEveryWrites == 0 && len > 0)
+            {
+                std::vector<uint8_t> copy(buffer, buffer + len);
+                copy[len - 1] ^= 0x01;
+                n = (int)fwrite(copy.data(), 1, len, _f);
+            }
+            else
+            {
+                n = (int)fwrite(buffer, 1, len, _f);
+            }
+            advance(n);
+            return n;
+        }
+
+        bool sync() override
+        {
+            _clockUs += cmdUs;
+            return fflush(_f) == 0;
+        }
+
+        void close() override
+        {
+            if (_f != nullptr)
+            {
+                fclose(_f);
+                _f = nullptr;
+            }
+        }
+
+        uint32_t nowUs() override
+        {
+            return (uint32_t)_clockUs;
+        }
+};
@@ -0,0 +1,211 @@
+// SDbenchCore (SDbenchmark.h) contra un fichero imagen en el host: verificación CRC de lo
+// leído, errores de E/S y elección del reloj con pickBest sobre informes estables e inestables.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "SDbenchImageIO.h"
+
+// La imagen puede indicarse con SDBENCH_IMAGE. Se sobrescribe.
+static std::string imagePath()
+{
+    const char* env = getenv("SDBENCH_IMAGE");
+    return env ? env : "/tmp/powadcr_sdbench.img";
+}
+
+// Lecturas verificadas por tamaño: secuenciales, aleatorias y las de comprobación
+// de las escrituras aleatorias
+static int verifiedReads()
+{
+    int n = 0;
+    for (int s = 0; s < SDB_SIZES; s++)
+    {
+        n += SDBENCH_FILE_SIZE / SDB_SIZE_LIST[s] + 2 * SDBENCH_RANDOM_OPS;
+    }
+    return n;
+}
+
+static uint32_t expectedKbps(int mhz, uint32_t cmdUs, int len)
+{
+    uint64_t opUs = cmdUs + ((uint64_t)len * 8) / mhz;
+    uint64_t totalUs = opUs * (SDBENCH_FILE_SIZE / len);
+    return (uint32_t)(((uint64_t)SDBENCH_FILE_SIZE * 1000000ULL) / (1024ULL * totalUs));
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Imagen sana: sin errores, la imagen queda con el patrón completo y las medidas
+// salen del reloj simulado
+void test_clean_image_is_stable()
+{
+    std::string path = imagePath();
+    SDbenchImageIO io(path.c_str());
+    io.mhz = 20;
+
+    SDbenchCore core;
+    tSDbenchReport rep;
+    rep.mounted = true;
+    TEST_ASSERT_TRUE(core.run(io, rep));
+
+    TEST_ASSERT_TRUE(rep.stable);
+    TEST_ASSERT_EQUAL_INT(0, rep.crcErrors);
+    TEST_ASSERT_EQUAL_INT(0, rep.ioErrors);
+    TEST_ASSERT_EQUAL_INT(verifiedReads(), io.reads);
+
+    for (int s = 0; s < SDB_SIZES; s++)
+    {
+        int len = SDB_SIZE_LIST[s];
+        TEST_ASSERT_EQUAL_INT(expectedKbps(20, io.cmdUs, len), rep.r[SDB_SEQ_READ][s].kbps);
+        TEST_ASSERT_EQUAL_INT(io.cmdUs + len * 8 / 20, rep.r[SDB_SEQ_READ][s].p50);
+
+        for (int t = 0; t < SDB_TESTS; t++)
+        {
+            const tSDbenchResult &r = rep.r[t][s];
+            TEST_ASSERT_TRUE(r.kbps > 0);
+            TEST_ASSERT_TRUE(r.p50 <= r.p95 && r.p95 <= r.p99);
+        }
+    }
+
+    FILE* f = fopen(path.c_str(), "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    fseek(f, 0, SEEK_END);
+    TEST_ASSERT_EQUAL_INT(SDBENCH_FILE_SIZE, ftell(f));
+    fclose(f);
+}
+
+// Un bit cambiado en la lectura es un error de CRC por cada lectura afectada
+void test_crc_catches_flipped_reads()
+{
+    std::string path = imagePath();
+    SDbenchImageIO io(path.c_str());
+    io.flipEveryReads = 50;
+
+    SDbenchCore core;
+    tSDbenchReport rep;
+    rep.mounted = true;
+    TEST_ASSERT_TRUE(core.run(io, rep));
+
+    TEST_ASSERT_FALSE(rep.stable);
+    TEST_ASSERT_EQUAL_INT(io.reads / 50, rep.crcErrors);
+    TEST_ASSERT_EQUAL_INT(0, rep.ioErrors);
+}
+
+// Un byte mal guardado aparece al leerlo de vuelta
+void test_crc_catches_bad_writes()
+{
+    std::string path = imagePath();
+    SDbenchImageIO io(path.c_str());
+    io.badEveryWrites = 40;
+
+    SDbenchCore core;
+    tSDbenchReport rep;
+    rep.mounted = true;
+    TEST_ASSERT_TRUE(core.run(io, rep));
+
+    TEST_ASSERT_FALSE(rep.stable);
+    TEST_ASSERT_TRUE(rep.crcErrors > 0);
+    TEST_ASSERT_EQUAL_INT(0, rep.ioErrors);
+}
+
+// Una lectura corta cuenta como error de E/S y no se verifica
+void test_short_reads_are_io_errors()
+{
+    std::string path = imagePath();
+    SDbenchImageIO io(path.c_str());
+    io.shortEveryReads = 25;
+
+    SDbenchCore core;
+    tSDbenchReport rep;
+    rep.mounted = true;
+    TEST_ASSERT_TRUE(core.run(io, rep));
+
+    TEST_ASSERT_FALSE(rep.stable);
+    TEST_ASSERT_EQUAL_INT(io.reads / 25, rep.ioErrors);
+    TEST_ASSERT_EQUAL_INT(0, rep.crcErrors);
+}
+
+// Barrido como el del ESP32: por encima de 20 MHz la tarjeta corrompe datos y a 50 MHz
+// no monta. Gana el reloj estable más rápido aunque los inestables midan más.
+void test_pick_best_from_sweep()
+{
+    static const int clocks[] = {50, 40, 26, 20, 16, 13};
+    const int n = sizeof(clocks) / sizeof(clocks[0]);
+    std::vector<tSDbenchReport> reports(n);
+    std::string path = imagePath();
+    SDbenchCore core;
+
+    for (int i = 0; i < n; i++)
+    {
+        reports[i].mhz = clocks[i];
+        if (clocks[i] == 50)
+        {
+            // Lo que deja un begin fallido: sin medidas útiles
+            reports[i].r[SDB_SEQ_READ][SDB_SIZES - 1].kbps = 99999;
+            continue;
+        }
+
+        SDbenchImageIO io(path.c_str());
+        io.mhz = clocks[i];
+        io.flipEveryReads = clocks[i] > 20 ? 97 : 0;
+        reports[i].mounted = true;
+        TEST_ASSERT_TRUE(core.run(io, reports[i]));
+        TEST_ASSERT_EQUAL(clocks[i] <= 20, reports[i].stable);
+    }
+
+    TEST_ASSERT_TRUE(reports[1].r[SDB_SEQ_READ][SDB_SIZES - 1].kbps > reports[3].r[SDB_SEQ_READ][SDB_SIZES - 1].kbps);
+
+    int best = SDbenchCore::pickBest(reports.data(), n);
+    TEST_ASSERT_EQUAL_INT(3, best);
+    TEST_ASSERT_EQUAL_INT(20, reports[best].mhz);
+}
+
+// Casos límite de pickBest con informes construidos a mano
+void test_pick_best_mix()
+{
+    tSDbenchReport r[4];
+    const int last = SDB_SIZES - 1;
+
+    TEST_ASSERT_EQUAL_INT(-1, SDbenchCore::pickBest(r, 0));
+
+    // Ninguno estable
+    for (int i = 0; i < 4; i++)
+    {
+        r[i].mounted = true;
+        r[i].stable = false;
+        r[i].r[SDB_SEQ_READ][last].kbps = 1000 * (i + 1);
+    }
+    TEST_ASSERT_EQUAL_INT(-1, SDbenchCore::pickBest(r, 4));
+
+    // Estable pero sin montar no cuenta
+    r[3].stable = true;
+    r[3].mounted = false;
+    TEST_ASSERT_EQUAL_INT(-1, SDbenchCore::pickBest(r, 4));
+
+    // Dos estables: gana el de más lectura secuencial de 32 KB, no el de 512 B
+    r[0].stable = true;
+    r[2].stable = true;
+    r[0].r[SDB_SEQ_READ][0].kbps = 50000;
+    TEST_ASSERT_EQUAL_INT(2, SDbenchCore::pickBest(r, 4));
+
+    // Empate: se queda el primero (el de reloj más alto en el barrido)
+    r[0].r[SDB_SEQ_READ][last].kbps = r[2].r[SDB_SEQ_READ][last].kbps;
+    TEST_ASSERT_EQUAL_INT(0, SDbenchCore::pickBest(r, 4));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_image_is_stable);
+    RUN_TEST(test_crc_catches_flipped_reads);
+    RUN_TEST(test_crc_catches_bad_writes);
+    RUN_TEST(test_short_reads_are_io_errors);
+    RUN_TEST(test_pick_best_from_sweep);
+    RUN_TEST(test_pick_best_mix);
+    int rc = UNITY_END();
+    remove(imagePath().c_str());
+    return rc;
+}
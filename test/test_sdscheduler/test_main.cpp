@@ -0,0 +1,234 @@
+// SDscheduler (SDscheduler.h) sobre una SD simulada lenta: orden de concesión por clase,
+// latencia de la reproducción acotada a una porción y remontajes que esperan a las sesiones.
+
+#include <unity.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+#include "SDscheduler.h"
+
+// Tiempo de servicio de la SD simulada
+static const uint32_t US_PER_KB = 1000;
+static const uint32_t SLICE_US = (SDIO_SLICE_BYTES / 1024) * US_PER_KB;
+
+// Fichero en una SD lenta: cada acceso tarda en proporción a su tamaño
+struct SlowFile
+{
+    std::atomic<size_t> maxChunk{0};
+
+    void busy(size_t n)
+    {
+        size_t m = maxChunk.load();
+        while (n > m && !maxChunk.compare_exchange_weak(m, n))
+        {
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(n * US_PER_KB / 1024));
+    }
+
+    int read(uint8_t* buf, size_t n)
+    {
+        busy(n);
+        return (int)n;
+    }
+
+    size_t write(const uint8_t* buf, size_t n)
+    {
+        busy(n);
+        return n;
+    }
+};
+
+static uint8_t buffer[1 << 18];
+
+static void waitUntil(std::function<bool()> cond)
+{
+    while (!cond())
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+void setUp()
+{
+    sdsched.resetStats();
+}
+
+void tearDown() {}
+
+// Con el bus cogido llegan las cuatro clases, de menos a más prioritaria.
+// Al soltarlo se conceden de más a menos.
+void test_priority_order()
+{
+    std::vector<int> order;
+    std::mutex orderMtx;
+    std::vector<std::thread> threads;
+
+    {
+        SDioLock hold(SDIO_BACKGROUND);
+
+        for (int c = SDIO_CLASSES - 1; c >= 0; c--)
+        {
+            threads.emplace_back([&, c]()
+            {
+                SDioLock lock((tSDioClass)c);
+                std::lock_guard<std::mutex> lk(orderMtx);
+                order.push_back(c);
+            });
+            waitUntil([c]() { return sdsched.waiting((tSDioClass)c) == 1; });
+        }
+    }
+
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+
+    TEST_ASSERT_EQUAL_INT(SDIO_CLASSES, order.size());
+    TEST_ASSERT_EQUAL_INT(SDIO_PLAYBACK, order[0]);
+    TEST_ASSERT_EQUAL_INT(SDIO_RECORDING, order[1]);
+    TEST_ASSERT_EQUAL_INT(SDIO_INTERACTIVE, order[2]);
+    TEST_ASSERT_EQUAL_INT(SDIO_BACKGROUND, order[3]);
+}
+
+// Las clases que no son de tiempo real se trocean. La reproducción no.
+void test_slicing()
+{
+    SlowFile f;
+    sdsched.write(f, buffer, 5 * SDIO_SLICE_BYTES + 100, SDIO_BACKGROUND);
+    TEST_ASSERT_EQUAL_INT(SDIO_SLICE_BYTES, f.maxChunk.load());
+    TEST_ASSERT_EQUAL_INT(6, sdsched.getStats(SDIO_BACKGROUND).requests);
+
+    SlowFile g;
+    sdsched.read(g, buffer, 3 * SDIO_SLICE_BYTES, SDIO_PLAYBACK);
+    TEST_ASSERT_EQUAL_INT(3 * SDIO_SLICE_BYTES, g.maxChunk.load());
+    TEST_ASSERT_EQUAL_INT(1, sdsched.getStats(SDIO_PLAYBACK).requests);
+}
+
+// Escrituras de fondo e interactivas de 256 KB sin parar. Cada lectura de reproducción
+// espera como mucho la porción en curso.
+void test_playback_latency_one_slice()
+{
+    SlowFile f;
+    std::atomic<bool> run{true};
+
+    std::thread background([&]()
+    {
+        while (run)
+        {
+            sdsched.write(f, buffer, sizeof(buffer), SDIO_BACKGROUND);
+        }
+    });
+
+    std::thread web([&]()
+    {
+        while (run)
+        {
+            sdsched.read(f, buffer, sizeof(buffer), SDIO_INTERACTIVE);
+        }
+    });
+
+    uint8_t block[512];
+    for (int i = 0; i < 100; i++)
+    {
+        sdsched.read(f, block, sizeof(block), SDIO_PLAYBACK);
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    }
+
+    run = false;
+    background.join();
+    web.join();
+
+    tSDioStats play = sdsched.getStats(SDIO_PLAYBACK);
+    TEST_ASSERT_EQUAL_INT(100, play.requests);
+    TEST_ASSERT_TRUE(sdsched.getStats(SDIO_BACKGROUND).requests > 0);
+    TEST_ASSERT_TRUE(sdsched.getStats(SDIO_INTERACTIVE).requests > 0);
+
+    // Una porción más el margen del planificador del sistema. Sin trocear serían 256 ms.
+    TEST_ASSERT_UINT32_WITHIN(SLICE_US, SLICE_US, play.maxWaitUs);
+}
+
+// El remontaje espera a que la sesión abierta cierre sus ficheros, y las sesiones
+// nuevas esperan a que acabe el remontaje
+void test_remount_waits_for_sessions()
+{
+    std::atomic<bool> opened{false};
+    std::atomic<bool> closed{false};
+    std::atomic<bool> entered{false};
+
+    std::thread task([&]()
+    {
+        SDsession session;
+        opened = true;
+        // Trabaja hasta que se pide el remontaje
+        while (!sdsched.remountPending())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        closed = true;
+    });
+
+    waitUntil([&]() { return opened.load(); });
+    TEST_ASSERT_FALSE(sdsched.remountPending());
+
+    std::thread late;
+    {
+        SDremount remount;
+        TEST_ASSERT_TRUE(closed.load());
+
+        late = std::thread([&]()
+        {
+            SDsession session;
+            entered = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        TEST_ASSERT_FALSE(entered.load());
+    }
+
+    task.join();
+    late.join();
+    TEST_ASSERT_TRUE(entered.load());
+    TEST_ASSERT_FALSE(sdsched.remountPending());
+}
+
+// El remontaje coge el bus: espera al acceso en curso y bloquea los siguientes
+void test_remount_holds_bus()
+{
+    SlowFile f;
+    std::atomic<bool> done{false};
+    std::thread remount;
+
+    {
+        SDioLock lock(SDIO_INTERACTIVE);
+        remount = std::thread([&]()
+        {
+            SDremount r;
+            done = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        TEST_ASSERT_FALSE(done.load());
+    }
+
+    waitUntil([&]() { return done.load(); });
+    auto t0 = std::chrono::steady_clock::now();
+    sdsched.read(f, buffer, 512, SDIO_PLAYBACK);
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    remount.join();
+
+    TEST_ASSERT_TRUE(waited >= 10);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_priority_order);
+    RUN_TEST(test_slicing);
+    RUN_TEST(test_playback_latency_one_slice);
+    RUN_TEST(test_remount_waits_for_sessions);
+    RUN_TEST(test_remount_holds_bus);
+    return UNITY_END();
+}
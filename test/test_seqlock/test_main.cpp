@@ -0,0 +1,172 @@
+// SeqLock (TapeStatus.h): un escritor y varios lectores a la vez. Ninguna lectura
+// puede devolver una mezcla de dos publicaciones.
+
+#include <unity.h>
+#include <thread>
+#include <vector>
+
+#include "TapeStatus.h"
+
+// Tamaño que no es múltiplo de 4, para probar la última palabra incompleta
+struct tProbe
+{
+    uint32_t seq;
+    char text[37];
+    uint32_t check;
+};
+
+static const uint32_t WRITES = 200000;
+
+static void fillProbe(tProbe &p, uint32_t n)
+{
+    p.seq = n;
+    memset(p.text, 'a' + (n % 26), sizeof(p.text) - 1);
+    p.text[sizeof(p.text) - 1] = 0;
+    p.check = ~n;
+}
+
+static bool probeIsCoherent(const tProbe &p)
+{
+    if (p.check != ~p.seq || p.text[sizeof(p.text) - 1] != 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(p.text) - 1; i++)
+    {
+        if (p.text[i] != (char)('a' + (p.seq % 26)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_seqlock_single_thread()
+{
+    SeqLock<tProbe> lock;
+    tProbe in, out;
+
+    fillProbe(in, 7);
+    lock.write(in);
+    TEST_ASSERT_TRUE(lock.tryRead(out));
+    TEST_ASSERT_EQUAL_MEMORY(&in, &out, sizeof(in));
+    TEST_ASSERT_EQUAL_UINT32(1, lock.version());
+}
+
+void test_seqlock_stress()
+{
+    SeqLock<tProbe> lock;
+    tProbe first;
+    fillProbe(first, 0);
+    lock.write(first);
+
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> torn{0};
+    std::atomic<uint32_t> backwards{0};
+    std::atomic<uint32_t> reads{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++)
+    {
+        readers.emplace_back([&]()
+        {
+            uint32_t last = 0;
+            while (!done.load())
+            {
+                tProbe p;
+                lock.read(p, []() { std::this_thread::yield(); });
+                if (!probeIsCoherent(p))
+                {
+                    torn++;
+                }
+                // Un mismo lector nunca ve una publicación anterior a la que ya vio
+                if (p.seq < last)
+                {
+                    backwards++;
+                }
+                last = p.seq;
+                reads++;
+            }
+        });
+    }
+
+    std::thread writer([&]()
+    {
+        tProbe p;
+        for (uint32_t n = 1; n <= WRITES; n++)
+        {
+            fillProbe(p, n);
+            lock.write(p);
+        }
+        done = true;
+    });
+
+    writer.join();
+    for (auto &t : readers)
+    {
+        t.join();
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+    TEST_ASSERT_EQUAL_UINT32(0, backwards.load());
+    TEST_ASSERT_GREATER_THAN(0, reads.load());
+    TEST_ASSERT_EQUAL_UINT32(WRITES + 1, lock.version());
+
+    tProbe last;
+    TEST_ASSERT_TRUE(lock.tryRead(last));
+    TEST_ASSERT_EQUAL_UINT32(WRITES, last.seq);
+}
+
+// El estado real de la cinta, con cadenas que cambian de longitud
+void test_seqlock_tape_status()
+{
+    SeqLock<tTapeStatus> lock;
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> torn{0};
+
+    std::thread reader([&]()
+    {
+        while (!done.load())
+        {
+            tTapeStatus st;
+            lock.read(st, []() { std::this_thread::yield(); });
+            // Nombre y mensaje se publican juntos con el mismo número
+            if (st.totalBlocks != st.block ||
+                strlen(st.programName) != (size_t)(st.totalBlocks % (STATUS_NAME_LEN - 1)) ||
+                strlen(st.message) != (size_t)(st.totalBlocks % (STATUS_MSG_LEN - 1)))
+            {
+                torn++;
+            }
+        }
+    });
+
+    tTapeStatus st;
+    memset(&st, 0, sizeof(st));
+    lock.write(st);
+    for (int n = 1; n <= 100000; n++)
+    {
+        st.totalBlocks = n;
+        st.block = n;
+        memset(st.programName, 'P', sizeof(st.programName));
+        st.programName[n % (STATUS_NAME_LEN - 1)] = 0;
+        memset(st.message, 'M', sizeof(st.message));
+        st.message[n % (STATUS_MSG_LEN - 1)] = 0;
+        lock.write(st);
+    }
+    done = true;
+    reader.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_seqlock_single_thread);
+    RUN_TEST(test_seqlock_stress);
+    RUN_TEST(test_seqlock_tape_status);
+    return UNITY_END();
+}
@@ -0,0 +1,444 @@
+// StreamTapeParser + StreamRing (StreamTape.h) con datos que llegan por un socket, como en
+// /api/stream: una tarea recibe y llena el anillo, otra lee los bloques.
+
+#include <unity.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include <random>
+
+#include "StreamTape.h"
+
+typedef std::vector<uint8_t> tBytes;
+
+static void le16(tBytes &v, uint16_t x)
+{
+    v.push_back(x & 0xFF);
+    v.push_back(x >> 8);
+}
+
+static void le24(tBytes &v, uint32_t x)
+{
+    le16(v, x & 0xFFFF);
+    v.push_back((x >> 16) & 0xFF);
+}
+
+static tBytes payload(size_t n, uint8_t seed)
+{
+    tBytes d(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        d[i] = (uint8_t)(seed + i * 7);
+    }
+    return d;
+}
+
+// TZX con los bloques que se reproducen en streaming y alguno sin sonido
+static tBytes buildTZX()
+{
+    tBytes v = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+
+    // 0x10 cabecera estándar
+    tBytes d = payload(19, 0);
+    v.push_back(0x10); le16(v, 1000); le16(v, d.size());
+    v.insert(v.end(), d.begin(), d.end());
+
+    // 0x30 texto (sin sonido)
+    v.push_back(0x30); v.push_back(3); v.push_back('a'); v.push_back('b'); v.push_back('c');
+
+    // 0x12 tono y 0x13 pulsos
+    v.push_back(0x12); le16(v, 2168); le16(v, 3223);
+    v.push_back(0x13); v.push_back(2); le16(v, 667); le16(v, 735);
+
+    // 0x11 turbo, más grande que el anillo
+    d = payload(1500, 3);
+    v.push_back(0x11);
+    le16(v, 2000); le16(v, 600); le16(v, 700); le16(v, 800); le16(v, 1600); le16(v, 4000);
+    v.push_back(6); le16(v, 500); le24(v, d.size());
+    v.insert(v.end(), d.begin(), d.end());
+
+    // 0x24/0x25 bucle vacío
+    v.push_back(0x24); le16(v, 2);
+    v.push_back(0x25);
+
+    // 0x20 pausa y 0x14 datos puros
+    v.push_back(0x20); le16(v, 250);
+    d = payload(40, 9);
+    v.push_back(0x14); le16(v, 855); le16(v, 1710); v.push_back(8); le16(v, 0); le24(v, d.size());
+    v.insert(v.end(), d.begin(), d.end());
+
+    return v;
+}
+
+// Cabecera, nivel de la señal y un bucle de tres pasadas con tono y datos puros.
+// Con "inner" se mete ese bloque al final del cuerpo.
+static tBytes buildLoopTZX(size_t loopData, int inner)
+{
+    tBytes v = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+
+    tBytes d = payload(19, 0);
+    v.push_back(0x10); le16(v, 1000); le16(v, d.size());
+    v.insert(v.end(), d.begin(), d.end());
+
+    // 0x2B nivel alto
+    v.push_back(0x2B); le16(v, 1); le16(v, 0); v.push_back(1);
+
+    v.push_back(0x24); le16(v, 3);
+    v.push_back(0x12); le16(v, 1000); le16(v, 10);
+    d = payload(loopData, 5);
+    v.push_back(0x14); le16(v, 855); le16(v, 1710); v.push_back(8); le16(v, 0); le24(v, d.size());
+    v.insert(v.end(), d.begin(), d.end());
+    if (inner >= 0)
+    {
+        v.push_back(inner); le16(v, 0);
+    }
+    v.push_back(0x25);
+
+    v.push_back(0x20); le16(v, 100);
+    return v;
+}
+
+static tBytes buildTAP()
+{
+    tBytes v;
+    tBytes h = payload(19, 1);
+    tBytes d = payload(700, 2);
+    le16(v, h.size()); v.insert(v.end(), h.begin(), h.end());
+    le16(v, d.size()); v.insert(v.end(), d.begin(), d.end());
+    return v;
+}
+
+// Fuente del parser: lee del anillo sin límite de espera
+struct tRingSource
+{
+    StreamRing &ring;
+    size_t read(uint8_t* out, size_t len)
+    {
+        return ring.read(out, len, []() { return true; });
+    }
+};
+
+struct tParsed
+{
+    tStreamBlock b;
+    tBytes data;
+};
+
+// Envía "tape" por un socket en trozos al azar (hasta "cut" bytes) y lo parsea del otro lado
+static std::vector<tParsed> streamOver(const tBytes &tape, size_t ringBytes, size_t cut,
+                                       bool &error, uint8_t &unsupported, uint32_t &underruns,
+                                       size_t loopBytes = 4096)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    {
+        error = true;
+        return std::vector<tParsed>();
+    }
+
+    std::vector<uint8_t> mem(ringBytes);
+    StreamRing ring;
+    ring.attach(mem.data(), mem.size());
+
+    std::thread sender([&]()
+    {
+        std::mt19937 rng(1234);
+        size_t pos = 0;
+        while (pos < cut)
+        {
+            size_t n = 1 + rng() % 97;
+            if (n > cut - pos)
+            {
+                n = cut - pos;
+            }
+            ssize_t w = send(sv[0], tape.data() + pos, n, 0);
+            if (w <= 0)
+            {
+                break;
+            }
+            pos += w;
+            if (rng() % 4 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+        shutdown(sv[0], SHUT_WR);
+    });
+
+    // La tarea de la red: lo recibido va al anillo cuando hay hueco
+    std::thread receiver([&]()
+    {
+        uint8_t buf[128];
+        size_t total = 0;
+        for (;;)
+        {
+            ssize_t n = recv(sv[1], buf, sizeof(buf), 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            size_t done = 0;
+            while (done < (size_t)n)
+            {
+                size_t k = ring.write(buf + done, n - done);
+                if (k == 0)
+                {
+                    if (ring.aborted())
+                    {
+                        return;
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                done += k;
+            }
+            total += n;
+        }
+        ring.close(total == tape.size());
+    });
+
+    tRingSource src{ring};
+    StreamTapeParser<tRingSource> parser(src);
+    std::vector<uint8_t> loop(loopBytes);
+    parser.setLoopBuffer(loop.data(), loop.size());
+    std::vector<tParsed> out;
+
+    if (parser.begin())
+    {
+        tParsed p;
+        while (parser.next(p.b))
+        {
+            p.data.assign(p.b.dataSize, 0);
+            size_t got = 0;
+            // En trozos pequeños, como el render de los bloques
+            while (got < p.b.dataSize)
+            {
+                size_t k = p.b.dataSize - got < 33 ? p.b.dataSize - got : 33;
+                size_t n = parser.data(p.data.data() + got, k);
+                got += n;
+                if (n < k)
+                {
+                    break;
+                }
+            }
+            p.data.resize(got);
+            out.push_back(p);
+        }
+    }
+
+    error = parser.error();
+    unsupported = parser.unsupported();
+    ring.abort();
+
+    sender.join();
+    receiver.join();
+    close(sv[0]);
+    close(sv[1]);
+
+    underruns = ring.underruns();
+    return out;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_stream_tzx()
+{
+    tBytes tape = buildTZX();
+    bool error = true;
+    uint8_t unsupported = 0;
+    uint32_t underruns = 0;
+
+    // Anillo más pequeño que el bloque turbo: el receptor tiene que esperar al lector
+    std::vector<tParsed> got = streamOver(tape, 256, tape.size(), error, unsupported, underruns);
+
+    TEST_ASSERT_FALSE(error);
+    TEST_ASSERT_EQUAL_INT(0, unsupported);
+    TEST_ASSERT_EQUAL_INT(9, got.size());
+
+    TEST_ASSERT_EQUAL_INT(0x10, got[0].b.id);
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_DATA, got[0].b.kind);
+    TEST_ASSERT_TRUE(got[0].b.standard);
+    TEST_ASSERT_EQUAL_INT(1000, got[0].b.pause);
+    TEST_ASSERT_TRUE(got[0].data == payload(19, 0));
+
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_SKIP, got[1].b.kind);
+
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_TONE, got[2].b.kind);
+    TEST_ASSERT_EQUAL_INT(2168, got[2].b.t.toneLen);
+    TEST_ASSERT_EQUAL_INT(3223, got[2].b.t.tonePulses);
+
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_PULSES, got[3].b.kind);
+    TEST_ASSERT_EQUAL_INT(2, got[3].b.t.numPulses);
+    TEST_ASSERT_EQUAL_INT(667, got[3].b.pulses[0]);
+    TEST_ASSERT_EQUAL_INT(735, got[3].b.pulses[1]);
+
+    TEST_ASSERT_EQUAL_INT(0x11, got[4].b.id);
+    TEST_ASSERT_FALSE(got[4].b.standard);
+    TEST_ASSERT_EQUAL_INT(2000, got[4].b.t.pilotLen);
+    TEST_ASSERT_EQUAL_INT(4000, got[4].b.t.pilotPulses);
+    TEST_ASSERT_EQUAL_INT(6, got[4].b.t.usedBits);
+    TEST_ASSERT_EQUAL_INT(500, got[4].b.pause);
+    TEST_ASSERT_TRUE(got[4].data == payload(1500, 3));
+
+    TEST_ASSERT_EQUAL_INT(0x24, got[5].b.id);
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_SKIP, got[5].b.kind);
+    TEST_ASSERT_EQUAL_INT(0x25, got[6].b.id);
+
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_PAUSE, got[7].b.kind);
+    TEST_ASSERT_EQUAL_INT(250, got[7].b.pause);
+
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_PURE_DATA, got[8].b.kind);
+    TEST_ASSERT_EQUAL_INT(1710, got[8].b.t.bit1);
+    TEST_ASSERT_TRUE(got[8].data == payload(40, 9));
+
+    for (size_t i = 0; i < got.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_INT(i, got[i].b.index);
+    }
+}
+
+// El cuerpo del bucle (más grande que el anillo) se entrega tres veces con los índices del
+// fichero, y después el 0x25 y lo que sigue
+void test_stream_loop()
+{
+    tBytes tape = buildLoopTZX(600, -1);
+    bool error = true;
+    uint8_t unsupported = 0xFF;
+    uint32_t underruns = 0;
+
+    std::vector<tParsed> got = streamOver(tape, 256, tape.size(), error, unsupported, underruns);
+
+    TEST_ASSERT_FALSE(error);
+    TEST_ASSERT_EQUAL_INT(0, unsupported);
+    TEST_ASSERT_EQUAL_INT(3 + 3 * 2 + 2, got.size());
+
+    TEST_ASSERT_EQUAL_INT(0x10, got[0].b.id);
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_LEVEL, got[1].b.kind);
+    TEST_ASSERT_EQUAL_INT(1, got[1].b.level);
+    TEST_ASSERT_EQUAL_INT(0x24, got[2].b.id);
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_SKIP, got[2].b.kind);
+    TEST_ASSERT_EQUAL_INT(3, got[2].b.t.loopCount);
+
+    for (int pass = 0; pass < 3; pass++)
+    {
+        const tParsed &tone = got[3 + pass * 2];
+        const tParsed &data = got[4 + pass * 2];
+        TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_TONE, tone.b.kind);
+        TEST_ASSERT_EQUAL_INT(3, tone.b.index);
+        TEST_ASSERT_EQUAL_INT(10, tone.b.t.tonePulses);
+        TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_PURE_DATA, data.b.kind);
+        TEST_ASSERT_EQUAL_INT(4, data.b.index);
+        TEST_ASSERT_TRUE(data.data == payload(600, 5));
+    }
+
+    TEST_ASSERT_EQUAL_INT(0x25, got[9].b.id);
+    TEST_ASSERT_EQUAL_INT(5, got[9].b.index);
+    TEST_ASSERT_EQUAL_INT(STREAM_BLOCK_PAUSE, got[10].b.kind);
+    TEST_ASSERT_EQUAL_INT(6, got[10].b.index);
+    TEST_ASSERT_EQUAL_INT(100, got[10].b.pause);
+}
+
+// Un bucle que no cabe en el buffer, o con un salto dentro, para la lectura en el 0x24
+// sin entregar nada del cuerpo
+void test_stream_loop_unstreamable()
+{
+    tBytes tape = buildLoopTZX(600, -1);
+    bool error = true;
+    uint8_t unsupported = 0;
+    uint32_t underruns = 0;
+
+    std::vector<tParsed> got = streamOver(tape, 256, tape.size(), error, unsupported, underruns, 512);
+
+    TEST_ASSERT_FALSE(error);
+    TEST_ASSERT_EQUAL_INT(0x24, unsupported);
+    TEST_ASSERT_EQUAL_INT(2, got.size());
+
+    tape = buildLoopTZX(20, 0x23);
+    got = streamOver(tape, 256, tape.size(), error, unsupported, underruns);
+
+    TEST_ASSERT_FALSE(error);
+    TEST_ASSERT_EQUAL_INT(0x24, unsupported);
+    TEST_ASSERT_EQUAL_INT(2, got.size());
+}
+
+// Un salto fuera de bucle para la lectura al llegar a él
+void test_stream_jump_stops()
+{
+    tBytes v = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+    tBytes d = payload(19, 0);
+    v.push_back(0x10); le16(v, 1000); le16(v, d.size());
+    v.insert(v.end(), d.begin(), d.end());
+    v.push_back(0x23); le16(v, 0xFFFF);
+    v.push_back(0x20); le16(v, 100);
+
+    bool error = true;
+    uint8_t unsupported = 0;
+    uint32_t underruns = 0;
+    std::vector<tParsed> got = streamOver(v, 256, v.size(), error, unsupported, underruns);
+
+    TEST_ASSERT_FALSE(error);
+    TEST_ASSERT_EQUAL_INT(0x23, unsupported);
+    TEST_ASSERT_EQUAL_INT(1, got.size());
+}
+
+void test_stream_tap()
+{
+    tBytes tape = buildTAP();
+    bool error = true;
+    uint8_t unsupported = 0;
+    uint32_t underruns = 0;
+
+    std::vector<tParsed> got = streamOver(tape, 512, tape.size(), error, unsupported, underruns);
+
+    TEST_ASSERT_FALSE(error);
+    TEST_ASSERT_EQUAL_INT(2, got.size());
+    TEST_ASSERT_TRUE(got[0].b.standard);
+    TEST_ASSERT_TRUE(got[0].data == payload(19, 1));
+    TEST_ASSERT_TRUE(got[1].data == payload(700, 2));
+}
+
+// Conexión cortada a mitad de un bloque: se entrega lo que llegó y se marca el error
+void test_stream_truncated()
+{
+    tBytes tape = buildTAP();
+    bool error = false;
+    uint8_t unsupported = 0;
+    uint32_t underruns = 0;
+
+    size_t cut = 2 + 19 + 2 + 300;
+    std::vector<tParsed> got = streamOver(tape, 512, cut, error, unsupported, underruns);
+
+    TEST_ASSERT_TRUE(error);
+    TEST_ASSERT_EQUAL_INT(2, got.size());
+    TEST_ASSERT_EQUAL_INT(700, got[1].b.dataSize);
+    TEST_ASSERT_EQUAL_INT(300, got[1].data.size());
+}
+
+// Un TAP con un byte suelto al final también está cortado
+void test_stream_odd_byte()
+{
+    tBytes tape = buildTAP();
+    tape.push_back(0x13);
+    bool error = false;
+    uint8_t unsupported = 0;
+    uint32_t underruns = 0;
+
+    std::vector<tParsed> got = streamOver(tape, 512, tape.size(), error, unsupported, underruns);
+
+    TEST_ASSERT_TRUE(error);
+    TEST_ASSERT_EQUAL_INT(2, got.size());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_tzx);
+    RUN_TEST(test_stream_loop);
+    RUN_TEST(test_stream_loop_unstreamable);
+    RUN_TEST(test_stream_jump_stops);
+    RUN_TEST(test_stream_tap);
+    RUN_TEST(test_stream_truncated);
+    RUN_TEST(test_stream_odd_byte);
+    return UNITY_END();
+}
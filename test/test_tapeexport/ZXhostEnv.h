@@ -0,0 +1,104 @@
+// Lo que ZXProcessor.h y TapeRender.h toman del firmware, para generar en el host con el
+// ZXProcessor de verdad: variables de globales.h con sus valores y lo demás sin efecto.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "AudioSink.h"
+#include "TransportBus.h"
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+// ---- globales.h ----
+
+double DfreqCPU = 3500000;
+const int DPULSES_HEADER = 8063;
+const int DPULSES_DATA = 3223;
+int DSYNC1 = 667;
+int DSYNC2 = 735;
+int DBIT_0 = 855;
+int DBIT_1 = 1710;
+int DPILOT_LEN = 2168;
+int DSILENT = 1000;
+int BIT_DR_1 = 0;
+int BIT_DR_0 = 0;
+
+enum edge
+{
+  up=1,
+  down=0
+};
+
+double ACU_ERROR = 0.0;
+edge POLARIZATION = down;
+edge LAST_EAR_IS = POLARIZATION;
+bool APPLY_END = false;
+int SAMPLING_RATE = 44100;
+bool ZEROLEVEL = false;
+int maxLevelUp = 32767;
+int maxLevelDown = -32767;
+int LEVELUP = maxLevelUp;
+int LEVELDOWN = maxLevelDown;
+int DEBUG_AMP_L = 0;
+int DEBUG_AMP_R = 0;
+
+bool TEST_RUNNING = false;
+int LOADING_STATE = 0;
+int PROGRESS_BAR_BLOCK_VALUE = 0;
+int PROGRESS_BAR_TOTAL_VALUE = 0;
+int BYTES_LOADED = 0;
+int BYTES_INI = 0;
+int BYTES_TOBE_LOAD = 0;
+int BYTES_IN_THIS_BLOCK = 0;
+int BYTES_LAST_BLOCK = 0;
+int LAST_SILENCE_DURATION = 0;
+bool PAUSE = true;
+bool STOP = false;
+
+double MAIN_VOL_FACTOR = 100;
+double MAIN_VOL_R = 0.9 * MAIN_VOL_FACTOR;
+double MAIN_VOL_L = 0.9 * MAIN_VOL_FACTOR;
+int EN_STEREO = 0;
+
+// ---- Lo que en el equipo es del firmware ----
+
+class HMI
+{
+};
+
+class AudioKit
+{
+    public:
+        size_t write(const uint8_t* data, size_t len)
+        {
+            return len;
+        }
+};
+
+void transportServiceCancels()
+{
+}
+
+struct
+{
+    bool pending() { return false; }
+} tapeSeek;
+
+struct
+{
+    bool recording() { return false; }
+    void run(double amp, int samples) {}
+} pulseCache;
+
+struct
+{
+    bool active() { return false; }
+    void run(int16_t level, int samples) {}
+} scope;
+
+struct
+{
+    void publishIfDue() {}
+} tapeStatus;
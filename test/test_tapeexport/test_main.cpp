@@ -0,0 +1,465 @@
+// Exportación (TapeRender.h) con el ZXProcessor del reproductor: un TAP y un TZX con bucle de
+// tapes/ contra hashes de referencia, y la misma salida sea cual sea el tamaño de lectura.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "ZXhostEnv.h"
+#include "ZXProcessor.h"
+#include "TapeRender.h"
+
+typedef std::vector<uint8_t> tBytes;
+
+// SIZE_FOR_SPLIT de config.h
+static const uint32_t SPLIT = 10000;
+
+struct tVecOut : public AudioByteOut
+{
+    tBytes v;
+
+    bool put(const uint8_t* data, size_t len) override
+    {
+        v.insert(v.end(), data, data + len);
+        return true;
+    }
+
+    bool patch(uint32_t offset, const uint8_t* data, size_t len) override
+    {
+        if (offset + len > v.size())
+        {
+            return false;
+        }
+        memcpy(&v[offset], data, len);
+        return true;
+    }
+};
+
+// La cinta en memoria. Hace de fichero de la SD
+struct tMemReader
+{
+    const tBytes& d;
+
+    int read(uint32_t offset, uint8_t* out, uint32_t len)
+    {
+        if (offset >= d.size())
+        {
+            return 0;
+        }
+        uint32_t n = d.size() - offset < len ? d.size() - offset : len;
+        memcpy(out, d.data() + offset, n);
+        return n;
+    }
+};
+
+static tBytes loadTape(const char* name)
+{
+    std::string path = __FILE__;
+    path = path.substr(0, path.find_last_of('/') + 1) + "tapes/" + name;
+
+    tBytes d;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr)
+    {
+        return d;
+    }
+    uint8_t b[4096];
+    size_t n;
+    while ((n = fread(b, 1, sizeof(b), f)) > 0)
+    {
+        d.insert(d.end(), b, b + n);
+    }
+    fclose(f);
+    return d;
+}
+
+static uint64_t fnv1a(const tBytes &v)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint8_t b : v)
+    {
+        h = (h ^ b) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void le16(tBytes &v, uint16_t x)
+{
+    v.push_back(x & 0xFF);
+    v.push_back(x >> 8);
+}
+
+static void le24(tBytes &v, uint32_t x)
+{
+    le16(v, x & 0xFFFF);
+    v.push_back((x >> 16) & 0xFF);
+}
+
+// Los descriptores que deja el análisis de TAPprocessor/TZXprocessor, sacados con TapeWalker.
+// En TZX el bloque 0 no se usa y la cinta empieza en el 1. Deja POLARIZATION como el 0x2B.
+struct tTape
+{
+    bool ok = false;
+    bool tzx = false;
+    int first = 0;
+    std::vector<tRenderBlock> blocks;
+    std::vector<std::vector<int>> pulses;
+};
+
+static tTape analyse(const tBytes &file, bool tzx)
+{
+    tTape tape;
+    tape.tzx = tzx;
+    tape.first = tzx ? 1 : 0;
+    if (tzx)
+    {
+        tape.blocks.push_back(tRenderBlock());
+    }
+    POLARIZATION = down;
+
+    tMemReader in = {file};
+    TapeWalker<tMemReader> walker(in, file.size(), tzx);
+    if (!walker.begin())
+    {
+        return tape;
+    }
+
+    tTapeBlock tb;
+    while (walker.next(tb))
+    {
+        tRenderBlock b;
+        b.id = tb.id;
+        b.dataOffset = tb.dataOffset;
+        b.dataSize = tb.dataSize;
+        b.pause = tzx ? tb.pause : DSILENT;
+        if (tzx)
+        {
+            twTzxTimings(tb.id, walker.body(), b.t);
+        }
+
+        const uint8_t* body = walker.body();
+        switch (tb.id)
+        {
+            case 0x10:
+                // Tiempos de la ROM. Cabecera (flag < 128) o datos
+                b.playable = true;
+                b.t.pilotLen = DPILOT_LEN;
+                b.t.sync1 = DSYNC1;
+                b.t.sync2 = DSYNC2;
+                b.t.bit0 = DBIT_0;
+                b.t.bit1 = DBIT_1;
+                b.t.pilotPulses = file[tb.dataOffset] < 128 ? DPULSES_HEADER : DPULSES_DATA;
+                break;
+
+            case 0x11:
+            case 0x12:
+            case 0x14:
+                b.playable = true;
+                break;
+
+            case 0x13:
+            {
+                b.playable = true;
+                std::vector<int> p;
+                for (int i = 0; i < b.t.numPulses; i++)
+                {
+                    p.push_back(file[tb.offset + 2 + 2 * i] | (file[tb.offset + 3 + 2 * i] << 8));
+                }
+                tape.pulses.push_back(p);
+                break;
+            }
+
+            case 0x15:
+                // Cuerpo: T-states (2), pausa (2), bits usados (1), longitud (3) y los datos
+                b.playable = true;
+                b.pause = twLe16(body + 2);
+                b.dataOffset = tb.offset + 1 + 8;
+                b.dataSize = twLe24(body + 5);
+                break;
+
+            case 0x2B:
+                // Sin descriptor propio: cambia el nivel de toda la cinta
+                POLARIZATION = body[4] == 1 ? up : down;
+                LAST_EAR_IS = POLARIZATION;
+                b = tRenderBlock();
+                break;
+
+            case 0x4B:
+                b.playable = true;
+                break;
+        }
+
+        tape.blocks.push_back(b);
+    }
+    tape.ok = !walker.error();
+
+    // Los 0x13 apuntan a su lista cuando ya no se mueve
+    size_t k = 0;
+    for (tRenderBlock &b : tape.blocks)
+    {
+        if (b.id == 0x13)
+        {
+            b.pulses = tape.pulses[k++].data();
+        }
+    }
+    return tape;
+}
+
+struct tRender
+{
+    bool ok = false;
+    tBytes out;
+    bool complete = false;
+    uint8_t unsupported = 0;
+    int current = -1;
+    uint32_t drRate = 0;
+};
+
+// Como TapeExport::run(), sin SD ni progreso
+static tRender render(const tBytes &file, bool tzx, bool csw, uint32_t rate, uint8_t bits, uint32_t split)
+{
+    tRender r;
+    tTape tape = analyse(file, tzx);
+
+    tVecOut out;
+    WavSink wav(out, rate, bits);
+    CswSink cs(out, rate);
+    ZXAudioSink* sink = csw ? (ZXAudioSink*)&cs : (ZXAudioSink*)&wav;
+    r.ok = tape.ok && (csw ? cs.begin() : wav.begin());
+
+    SAMPLING_RATE = rate;
+    MAIN_VOL_R = MAIN_VOL_FACTOR;
+    MAIN_VOL_L = MAIN_VOL_FACTOR;
+    BYTES_TOBE_LOAD = file.size();
+    STOP = false;
+    PAUSE = false;
+    ACU_ERROR = 0;
+    LOADING_STATE = 1;
+    BYTES_LOADED = 0;
+
+    ZXProcessor zxp;
+    zxp.set_sink(sink);
+
+    tMemReader in = {file};
+    std::vector<uint8_t> buf(split);
+    TapeRenderer<tMemReader, ZXProcessor> tr(in, zxp, buf.data(), split);
+    tr.begin(tape.first, tape.blocks.size(), tzx);
+
+    auto describe = [&](int i, tRenderBlock &b) { b = tape.blocks[i]; };
+    while (tr.next(describe))
+    {
+        // Nada corta la generación
+        r.ok = r.ok && LOADING_STATE == 1;
+    }
+
+    r.complete = tr.unsupported() == 0 && !tr.error();
+    if (r.complete)
+    {
+        tr.end();
+    }
+    r.unsupported = tr.unsupported();
+    r.current = tr.current();
+    r.drRate = tr.drRate();
+
+    r.ok = (csw ? cs.finish() : wav.finish()) && r.ok;
+    zxp.set_sink(nullptr);
+    LOADING_STATE = 0;
+
+    r.out = out.v;
+    return r;
+}
+
+static uint32_t wavSamples(const tBytes &w)
+{
+    return (w[40] | (w[41] << 8) | (w[42] << 16) | ((uint32_t)w[43] << 24)) / (w[34] / 8);
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Referencias: hash FNV-1a de 64 bits del fichero entero (cabecera incluida). Se generaron con
+// esta misma prueba; si cambian, ha cambiado la señal del ZXProcessor.
+
+// TAP: cabecera y programa BASIC, cabecera y 600 bytes de CODE
+void test_tap_golden()
+{
+    tBytes tap = loadTape("basic.tap");
+    TEST_ASSERT_EQUAL_INT(683, tap.size());
+
+    tRender w16 = render(tap, false, false, 44100, 16, SPLIT);
+    tRender w8 = render(tap, false, false, 22050, 8, SPLIT);
+    tRender cs = render(tap, false, true, 44100, 16, SPLIT);
+
+    printf("basic.tap: wav16 %zu bytes %016llx, wav8 %zu bytes %016llx, csw %zu bytes %016llx\n",
+           w16.out.size(), (unsigned long long)fnv1a(w16.out), w8.out.size(), (unsigned long long)fnv1a(w8.out),
+           cs.out.size(), (unsigned long long)fnv1a(cs.out));
+
+    TEST_ASSERT_TRUE(w16.ok && w8.ok && cs.ok);
+    TEST_ASSERT_TRUE(w16.complete && w8.complete && cs.complete);
+    // Cuatro bloques con su pausa de 1 s: más de 4 s de señal
+    TEST_ASSERT_TRUE(wavSamples(w16.out) > 4 * 44100);
+
+    TEST_ASSERT_EQUAL_UINT64(0x036c2913e06bb58fULL, fnv1a(w16.out));
+    TEST_ASSERT_EQUAL_UINT64(0xebe8edad1c7b6b80ULL, fnv1a(w8.out));
+    TEST_ASSERT_EQUAL_UINT64(0x6c96505947d7290eULL, fnv1a(cs.out));
+}
+
+// TZX: 0x30, 0x2B, 0x10 estándar, 0x11 turbo con 6 bits en el último byte, grupo con un bucle
+// de 0x12 + 0x13 + 0x14, 0x20 con y sin pausa y un último 0x10
+void test_tzx_golden()
+{
+    tBytes tzx = loadTape("loops.tzx");
+    TEST_ASSERT_EQUAL_INT(788, tzx.size());
+
+    tRender w16 = render(tzx, true, false, 44100, 16, SPLIT);
+    tRender w8 = render(tzx, true, false, 22050, 8, SPLIT);
+    tRender cs = render(tzx, true, true, 44100, 16, SPLIT);
+
+    printf("loops.tzx: wav16 %zu bytes %016llx, wav8 %zu bytes %016llx, csw %zu bytes %016llx\n",
+           w16.out.size(), (unsigned long long)fnv1a(w16.out), w8.out.size(), (unsigned long long)fnv1a(w8.out),
+           cs.out.size(), (unsigned long long)fnv1a(cs.out));
+
+    TEST_ASSERT_TRUE(w16.ok && w8.ok && cs.ok);
+    TEST_ASSERT_TRUE(w16.complete && w8.complete && cs.complete);
+    // 0x2B con nivel 1
+    TEST_ASSERT_EQUAL_INT(up, POLARIZATION);
+
+    TEST_ASSERT_EQUAL_UINT64(0x46edb68a423ba439ULL, fnv1a(w16.out));
+    TEST_ASSERT_EQUAL_UINT64(0x7c1225a901eabf98ULL, fnv1a(w8.out));
+    TEST_ASSERT_EQUAL_UINT64(0x8a2205c6129d3140ULL, fnv1a(cs.out));
+}
+
+// Leer a trozos de 64 bytes en vez de SIZE_FOR_SPLIT no cambia ni una muestra
+void test_split_does_not_change_output()
+{
+    tBytes tap = loadTape("basic.tap");
+    tBytes tzx = loadTape("loops.tzx");
+
+    TEST_ASSERT_TRUE(render(tap, false, false, 44100, 16, SPLIT).out == render(tap, false, false, 44100, 16, 64).out);
+    TEST_ASSERT_TRUE(render(tzx, true, false, 44100, 16, SPLIT).out == render(tzx, true, false, 44100, 16, 64).out);
+    TEST_ASSERT_TRUE(render(tzx, true, true, 44100, 16, SPLIT).out == render(tzx, true, true, 44100, 16, 64).out);
+}
+
+// El bucle suena como su cuerpo repetido: loop_count + 1 veces, igual que en el reproductor
+void test_loop_equals_unrolled()
+{
+    tBytes tzx = loadTape("loops.tzx");
+
+    tTape tape = analyse(tzx, true);
+    TEST_ASSERT_TRUE(tape.ok);
+    tMemReader in = {tzx};
+    TapeWalker<tMemReader> walker(in, tzx.size(), true);
+    TEST_ASSERT_TRUE(walker.begin());
+
+    tBytes unrolled(tzx.begin(), tzx.begin() + 10);
+    tBytes body;
+    bool inLoop = false;
+    int passes = 0;
+    tTapeBlock tb;
+    while (walker.next(tb))
+    {
+        const uint8_t* p = tzx.data() + tb.offset;
+        if (tb.id == 0x24)
+        {
+            inLoop = true;
+            passes = tape.blocks[tb.index + 1].t.loopCount + 1;
+        }
+        else if (tb.id == 0x25)
+        {
+            inLoop = false;
+            for (int i = 0; i < passes; i++)
+            {
+                unrolled.insert(unrolled.end(), body.begin(), body.end());
+            }
+        }
+        else
+        {
+            tBytes &dst = inLoop ? body : unrolled;
+            dst.insert(dst.end(), p, p + tb.size);
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(3, passes);
+
+    tRender a = render(tzx, true, false, 44100, 16, SPLIT);
+    tRender b = render(unrolled, true, false, 44100, 16, SPLIT);
+    TEST_ASSERT_TRUE(a.ok && b.ok && b.complete);
+    TEST_ASSERT_TRUE(a.out == b.out);
+}
+
+// Un TAP suena igual que un TZX con sus bloques como 0x10 y pausa de 1 s
+void test_tap_equals_tzx_standard_blocks()
+{
+    tBytes tap = loadTape("basic.tap");
+
+    tBytes tzx = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+    size_t p = 0;
+    while (p + 2 <= tap.size())
+    {
+        uint16_t len = tap[p] | (tap[p + 1] << 8);
+        tzx.push_back(0x10);
+        le16(tzx, DSILENT);
+        tzx.insert(tzx.end(), tap.begin() + p, tap.begin() + p + 2 + len);
+        p += 2 + len;
+    }
+
+    TEST_ASSERT_TRUE(render(tap, false, false, 44100, 16, SPLIT).out == render(tzx, true, false, 44100, 16, SPLIT).out);
+    TEST_ASSERT_TRUE(render(tap, false, true, 44100, 16, SPLIT).out == render(tzx, true, true, 44100, 16, SPLIT).out);
+}
+
+// 0x15 grabado a 44.100 Hz: se genera a esa frecuencia y a otra la exportación falla en él
+void test_direct_recording_needs_its_rate()
+{
+    tBytes tzx = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20};
+    tzx.push_back(0x20);
+    le16(tzx, 100);
+    tzx.push_back(0x15);
+    le16(tzx, 79);
+    le16(tzx, 200);
+    tzx.push_back(4);
+    le24(tzx, 300);
+    for (int i = 0; i < 300; i++)
+    {
+        tzx.push_back((uint8_t)(i * 37));
+    }
+
+    tRender ok = render(tzx, true, false, 44100, 16, SPLIT);
+    TEST_ASSERT_TRUE(ok.ok && ok.complete);
+    TEST_ASSERT_EQUAL_UINT32(44100, ok.drRate);
+    // 100 ms de pausa y una muestra por bit: 299 * 8 + 4
+    TEST_ASSERT_TRUE(wavSamples(ok.out) >= 4410 + 299 * 8 + 4);
+    TEST_ASSERT_TRUE(render(tzx, true, false, 44100, 16, 64).out == ok.out);
+
+    tRender bad = render(tzx, true, false, 22050, 16, SPLIT);
+    TEST_ASSERT_FALSE(bad.complete);
+    TEST_ASSERT_EQUAL_UINT8(0x15, bad.unsupported);
+    TEST_ASSERT_EQUAL_INT(2, bad.current);
+    TEST_ASSERT_EQUAL_UINT32(44100, bad.drRate);
+}
+
+// Un bloque que se reproduce pero no se puede generar (0x4B) para la exportación en él
+void test_unsupported_block_stops()
+{
+    tBytes tzx = loadTape("loops.tzx");
+    tzx.push_back(0x4B);
+    uint8_t kcs[16] = {12, 0, 0, 0, 0xE8, 0x03, 0x6C, 0x07, 0x02, 0x20, 0x01, 0x01};
+    tzx.insert(tzx.end(), kcs, kcs + 16);
+
+    tRender r = render(tzx, true, false, 44100, 16, SPLIT);
+    TEST_ASSERT_FALSE(r.complete);
+    TEST_ASSERT_EQUAL_UINT8(0x4B, r.unsupported);
+    TEST_ASSERT_EQUAL_INT(16, r.current);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_tap_golden);
+    RUN_TEST(test_tzx_golden);
+    RUN_TEST(test_split_does_not_change_output);
+    RUN_TEST(test_loop_equals_unrolled);
+    RUN_TEST(test_tap_equals_tzx_standard_blocks);
+    RUN_TEST(test_direct_recording_needs_its_rate);
+    RUN_TEST(test_unsupported_block_stops);
+    return UNITY_END();
+}
@@ -0,0 +1,154 @@
+// TapeSeekTable (TapeSeek.h): tiempos, saltos por tiempo dentro de bucles (ID 0x24/0x25)
+// y FFWD/RWD sobre grupos (ID 0x21/0x22).
+
+#include <unity.h>
+#include <vector>
+
+#include "TapeSeek.h"
+
+// Descripción de una cinta de prueba
+struct tTestBlock
+{
+    uint16_t id;
+    uint32_t ms;
+    uint16_t passes;
+};
+
+static std::vector<tSeekEntry> storage;
+
+static void buildTable(TapeSeekTable &t, const std::vector<tTestBlock> &blocks, int first = 0)
+{
+    storage.assign(blocks.size(), tSeekEntry());
+    bool ok = t.build(storage.data(), blocks.size(), first, [&](int i, tSeekBlock &b)
+    {
+        b.id = blocks[i].id;
+        b.ms = blocks[i].ms;
+        b.loopPasses = blocks[i].passes;
+        b.playable = blocks[i].ms > 0;
+    });
+    TEST_ASSERT_TRUE(ok);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_linear_tape()
+{
+    TapeSeekTable t;
+    buildTable(t, {{0x10, 100, 1}, {0x10, 200, 1}, {0x10, 300, 1}});
+
+    TEST_ASSERT_EQUAL_UINT32(600, t.totalMs());
+    TEST_ASSERT_EQUAL_UINT32(100, t.startOf(1));
+    TEST_ASSERT_EQUAL_INT(0, t.blockAt(0));
+    TEST_ASSERT_EQUAL_INT(0, t.blockAt(99));
+    TEST_ASSERT_EQUAL_INT(1, t.blockAt(100));
+    TEST_ASSERT_EQUAL_INT(2, t.blockAt(599));
+    TEST_ASSERT_EQUAL_INT(2, t.blockAt(5000));
+}
+
+// A, Loop Start x3, B, C, Loop End, D
+void test_seek_across_loop()
+{
+    TapeSeekTable t;
+    buildTable(t, {{0x10, 100, 1}, {SEEK_ID_LOOP_START, 0, 3}, {0x10, 200, 1}, {0x10, 300, 1},
+                   {SEEK_ID_LOOP_END, 0, 1}, {0x10, 100, 1}});
+
+    // Cuerpo de 500 ms tres veces
+    TEST_ASSERT_EQUAL_UINT32(100 + 500 * 3 + 100, t.totalMs());
+    TEST_ASSERT_EQUAL_UINT32(500, t.msOf(1));
+    TEST_ASSERT_EQUAL_INT(4, t.mate(1));
+    TEST_ASSERT_EQUAL_INT(1, t.mate(4));
+    TEST_ASSERT_EQUAL_INT(1, t.loopOf(2));
+    TEST_ASSERT_EQUAL_INT(1, t.loopOf(3));
+    TEST_ASSERT_EQUAL_INT(-1, t.loopOf(5));
+    TEST_ASSERT_EQUAL_UINT32(1600, t.startOf(5));
+
+    int pass = -1;
+    TEST_ASSERT_EQUAL_INT(2, t.blockAt(100, &pass));
+    TEST_ASSERT_EQUAL_INT(0, pass);
+
+    // Segunda pasada, dentro de C
+    TEST_ASSERT_EQUAL_INT(3, t.blockAt(100 + 500 + 250, &pass));
+    TEST_ASSERT_EQUAL_INT(1, pass);
+
+    // Tercera pasada, principio de B
+    TEST_ASSERT_EQUAL_INT(2, t.blockAt(100 + 1000, &pass));
+    TEST_ASSERT_EQUAL_INT(2, pass);
+
+    // Última muestra del bucle y bloque siguiente
+    TEST_ASSERT_EQUAL_INT(3, t.blockAt(1599, &pass));
+    TEST_ASSERT_EQUAL_INT(2, pass);
+    TEST_ASSERT_EQUAL_INT(5, t.blockAt(1600, &pass));
+    TEST_ASSERT_EQUAL_INT(0, pass);
+}
+
+// A, Group Start, B, C, Group End, D
+void test_ffwd_rwd_groups()
+{
+    TapeSeekTable t;
+    buildTable(t, {{0x10, 100, 1}, {SEEK_ID_GROUP_START, 0, 1}, {0x10, 100, 1}, {0x10, 100, 1},
+                   {SEEK_ID_GROUP_END, 0, 1}, {0x10, 100, 1}});
+
+    TEST_ASSERT_EQUAL_INT(4, t.mate(1));
+    TEST_ASSERT_EQUAL_INT(1, t.groupOf(2));
+    TEST_ASSERT_EQUAL_INT(1, t.groupOf(4));
+    TEST_ASSERT_EQUAL_INT(-1, t.groupOf(5));
+
+    // FFWD salta el grupo entero
+    TEST_ASSERT_EQUAL_INT(1, t.next(0));
+    TEST_ASSERT_EQUAL_INT(4, t.next(1));
+    TEST_ASSERT_EQUAL_INT(5, t.next(4));
+    // Al final vuelve al principio
+    TEST_ASSERT_EQUAL_INT(0, t.next(5));
+
+    // RWD desde detrás del grupo vuelve a su Group Start
+    TEST_ASSERT_EQUAL_INT(1, t.prev(5));
+    TEST_ASSERT_EQUAL_INT(1, t.prev(4));
+    TEST_ASSERT_EQUAL_INT(2, t.prev(3));
+    TEST_ASSERT_EQUAL_INT(0, t.prev(1));
+    TEST_ASSERT_EQUAL_INT(5, t.prev(0));
+
+    // Por tiempo se entra dentro del grupo
+    TEST_ASSERT_EQUAL_INT(3, t.blockAt(250));
+}
+
+// Grupo dentro de un bucle, y el primer bloque navegable después de la cabecera
+void test_group_inside_loop()
+{
+    TapeSeekTable t;
+    buildTable(t, {{0x30, 0, 1}, {SEEK_ID_LOOP_START, 0, 2}, {SEEK_ID_GROUP_START, 0, 1},
+                   {0x10, 100, 1}, {SEEK_ID_GROUP_END, 0, 1}, {0x10, 50, 1},
+                   {SEEK_ID_LOOP_END, 0, 1}}, 1);
+
+    TEST_ASSERT_EQUAL_UINT32(300, t.totalMs());
+    TEST_ASSERT_EQUAL_INT(1, t.loopOf(3));
+    TEST_ASSERT_EQUAL_INT(2, t.groupOf(3));
+    TEST_ASSERT_EQUAL_INT(4, t.next(2));
+    TEST_ASSERT_EQUAL_INT(2, t.prev(5));
+    // El bloque 0 no es navegable: desde el primero se va al último
+    TEST_ASSERT_EQUAL_INT(6, t.prev(1));
+    TEST_ASSERT_EQUAL_INT(1, t.next(6));
+
+    int pass = -1;
+    TEST_ASSERT_EQUAL_INT(5, t.blockAt(150 + 120, &pass));
+    TEST_ASSERT_EQUAL_INT(1, pass);
+}
+
+// Cabecera ROM estándar: 8063 pulsos guía, 19 bytes, 1 s de pausa
+void test_data_ms()
+{
+    uint32_t ms = seekDataMs(2168, 8063, 667, 735, 855, 1710, 19, 1000);
+    uint64_t t = 2168ull * 8063 + 667 + 735 + 19ull * 8 * (855 + 1710);
+    TEST_ASSERT_EQUAL_UINT32(t / 3500 + 1000, ms);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_linear_tape);
+    RUN_TEST(test_seek_across_loop);
+    RUN_TEST(test_ffwd_rwd_groups);
+    RUN_TEST(test_group_inside_loop);
+    RUN_TEST(test_data_ms);
+    return UNITY_END();
+}
@@ -0,0 +1,339 @@
+// TFTuploadCore (TFTupload.h) contra una pantalla simulada que habla el protocolo v1.2:
+// "comok" al conectar, 0x05 por trozo y 0x08 + offset para continuar una subida cortada.
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "TFTupload.h"
+
+// Pantalla Nextion simulada detrás del puerto. El reloj es virtual: un readByte sin datos
+// consume su timeout entero.
+struct FakeDisplay
+{
+    uint32_t displayBaud = 921600;
+    uint32_t portBaud = 0;
+    uint64_t clockUs = 0;
+    std::deque<uint8_t> rx;
+
+    // Lo que tiene grabado y hasta dónde llegó (lo que contesta con 0x08)
+    std::vector<uint8_t> flash;
+    uint32_t progress = 0;
+
+    // Descarga en curso
+    bool download = false;
+    uint32_t size = 0;
+    uint32_t pos = 0;
+    bool first = false;
+    std::vector<uint8_t> chunk;
+
+    // Fallos: nº de trozo (global, desde 1) cuyo 0x05 se pierde, y trozos que se
+    // contestan antes de dejar de responder (-1 = siempre)
+    int dropAckAt = 0;
+    int ackBudget = -1;
+    int chunks = 0;
+
+    std::vector<uint32_t> connectBauds;
+    std::vector<std::string> commands;
+    uint32_t dataBytes = 0;
+
+    void reply(const char* text)
+    {
+        for (const char* c = text; *c; c++)
+        {
+            rx.push_back((uint8_t)*c);
+        }
+        rx.push_back(0xFF);
+        rx.push_back(0xFF);
+        rx.push_back(0xFF);
+    }
+
+    void chunkDone()
+    {
+        chunks++;
+        if (ackBudget == 0)
+        {
+            return;
+        }
+        if (ackBudget > 0)
+        {
+            ackBudget--;
+        }
+
+        if (first && progress > 0 && progress < size)
+        {
+            // Subida anterior cortada: sigue desde donde se quedó
+            first = false;
+            pos = progress;
+            rx.push_back(TFT_RESUME);
+            for (int i = 0; i < 4; i++)
+            {
+                rx.push_back((progress >> (8 * i)) & 0xFF);
+            }
+            return;
+        }
+
+        first = false;
+        memcpy(flash.data() + pos, chunk.data(), chunk.size());
+        pos += chunk.size();
+        if (pos > progress)
+        {
+            progress = pos;
+        }
+
+        if (chunks != dropAckAt)
+        {
+            rx.push_back(TFT_ACK);
+        }
+    }
+
+    // ---- Interfaz del puerto ----
+
+    void setBaud(uint32_t baud)
+    {
+        portBaud = baud;
+    }
+
+    void sendCmd(const char* cmd)
+    {
+        // Un comando corta la descarga (la pantalla sale por timeout)
+        download = false;
+        commands.push_back(cmd);
+
+        if (portBaud != displayBaud)
+        {
+            return;
+        }
+
+        unsigned long sz = 0, baud = 0;
+        if (strcmp(cmd, "connect") == 0)
+        {
+            connectBauds.push_back(portBaud);
+            reply("comok 2,30601-0,NX4832T035_011R,52,61488,DE6064B7CB4F5A2E,4194304");
+        }
+        else if (sscanf(cmd, "whmi-wris %lu,%lu,1", &sz, &baud) == 2)
+        {
+            size = sz;
+            flash.resize(size);
+            displayBaud = baud;
+            download = true;
+            first = true;
+            pos = 0;
+            chunk.clear();
+            rx.push_back(TFT_ACK);
+        }
+    }
+
+    void write(const uint8_t* data, uint32_t len)
+    {
+        if (!download || portBaud != displayBaud)
+        {
+            return;
+        }
+
+        dataBytes += len;
+        for (uint32_t i = 0; i < len; i++)
+        {
+            chunk.push_back(data[i]);
+            uint32_t want = size - pos < TFT_CHUNK ? size - pos : TFT_CHUNK;
+            if (chunk.size() == want)
+            {
+                chunkDone();
+                chunk.clear();
+            }
+        }
+    }
+
+    bool readByte(uint8_t &b, uint32_t timeoutMs)
+    {
+        if (rx.empty())
+        {
+            clockUs += (uint64_t)timeoutMs * 1000;
+            return false;
+        }
+        b = rx.front();
+        rx.pop_front();
+        clockUs += 10;
+        return true;
+    }
+
+    void flushRx() { rx.clear(); }
+    void drainTx() {}
+    void delayMs(uint32_t ms) { clockUs += (uint64_t)ms * 1000; }
+    uint32_t nowUs() { return (uint32_t)clockUs; }
+};
+
+// El .tft en memoria
+struct FakeSource
+{
+    std::vector<uint8_t> data;
+    uint8_t buf[TFT_CHUNK];
+    int failReadAt = -1;
+    std::vector<uint32_t> prefetched;
+
+    explicit FakeSource(uint32_t size) : data(size)
+    {
+        for (uint32_t i = 0; i < size; i++)
+        {
+            data[i] = (uint8_t)(i * 31 + (i >> 8));
+        }
+    }
+
+    uint32_t size() { return data.size(); }
+    uint8_t* scratch() { return buf; }
+
+    int read(uint32_t offset, uint8_t* out, uint32_t len)
+    {
+        if (failReadAt >= 0 && offset >= (uint32_t)failReadAt)
+        {
+            return 0;
+        }
+        memcpy(out, data.data() + offset, len);
+        return len;
+    }
+
+    const uint8_t* get(uint32_t offset, uint32_t len) { return data.data() + offset; }
+    void prefetch(uint32_t offset, uint32_t len) { prefetched.push_back(offset); }
+};
+
+typedef TFTuploadCore<FakeDisplay, FakeSource> tCore;
+
+static const uint32_t SIZE = 3 * TFT_CHUNK + 1808;
+
+void setUp() {}
+void tearDown() {}
+
+// Subida nueva: un 0x05 por trozo y la pantalla acaba con el fichero entero
+void test_fresh_upload()
+{
+    FakeDisplay disp;
+    FakeSource src(SIZE);
+    tCore core(disp, src, 921600, 921600);
+
+    TEST_ASSERT_TRUE(core.run());
+    tTFTreport rep = core.report();
+
+    TEST_ASSERT_EQUAL_INT(TFT_DONE, rep.state);
+    TEST_ASSERT_EQUAL_UINT32(SIZE, rep.size);
+    TEST_ASSERT_EQUAL_UINT32(SIZE, rep.sent);
+    TEST_ASSERT_EQUAL_UINT32(tftCrc32(0, src.data.data(), SIZE), rep.crc);
+    TEST_ASSERT_EQUAL_UINT32(0, rep.resumedAt);
+    TEST_ASSERT_EQUAL_UINT32(0, rep.retries);
+
+    TEST_ASSERT_EQUAL_INT(4, disp.chunks);
+    TEST_ASSERT_EQUAL_UINT32(SIZE, disp.dataBytes);
+    TEST_ASSERT_EQUAL_MEMORY(src.data.data(), disp.flash.data(), SIZE);
+
+    char cmd[48];
+    snprintf(cmd, sizeof(cmd), "whmi-wris %lu,921600,1", (unsigned long)SIZE);
+    TEST_ASSERT_EQUAL_STRING(cmd, disp.commands.back().c_str());
+
+    // Cada trozo salvo el primero se pidió por adelantado
+    TEST_ASSERT_EQUAL_INT(3, src.prefetched.size());
+    TEST_ASSERT_EQUAL_UINT32(TFT_CHUNK, src.prefetched[0]);
+}
+
+// La pantalla tiene media subida de antes: tras el primer trozo contesta 0x08 con el
+// offset y solo se envía lo que falta
+void test_resume_from_previous_upload()
+{
+    FakeDisplay disp;
+    FakeSource src(SIZE);
+    disp.flash.assign(src.data.begin(), src.data.begin() + 2 * TFT_CHUNK);
+    disp.progress = 2 * TFT_CHUNK;
+    tCore core(disp, src, 921600, 921600);
+
+    TEST_ASSERT_TRUE(core.run());
+    tTFTreport rep = core.report();
+
+    TEST_ASSERT_EQUAL_UINT32(2 * TFT_CHUNK, rep.resumedAt);
+    TEST_ASSERT_EQUAL_UINT32(SIZE, rep.sent);
+    TEST_ASSERT_EQUAL_UINT32(0, rep.retries);
+    TEST_ASSERT_EQUAL_UINT32(TFT_CHUNK + (SIZE - 2 * TFT_CHUNK), disp.dataBytes);
+    TEST_ASSERT_EQUAL_MEMORY(src.data.data(), disp.flash.data(), SIZE);
+}
+
+// Se pierde el 0x05 del segundo trozo: se reconecta, la pantalla dice con 0x08 que ya
+// tiene dos trozos y se sigue desde ahí
+void test_retry_after_lost_ack()
+{
+    FakeDisplay disp;
+    FakeSource src(SIZE);
+    disp.dropAckAt = 2;
+    tCore core(disp, src, 921600, 921600);
+
+    TEST_ASSERT_TRUE(core.run());
+    tTFTreport rep = core.report();
+
+    TEST_ASSERT_EQUAL_INT(TFT_DONE, rep.state);
+    TEST_ASSERT_EQUAL_UINT32(1, rep.retries);
+    TEST_ASSERT_EQUAL_UINT32(2 * TFT_CHUNK, rep.resumedAt);
+    TEST_ASSERT_EQUAL_INT(2, disp.connectBauds.size());
+    TEST_ASSERT_EQUAL_MEMORY(src.data.data(), disp.flash.data(), SIZE);
+
+    // El primer intento esperó el 0x05 entero antes de reintentar
+    TEST_ASSERT_TRUE(rep.ms >= TFT_ACK_MS);
+}
+
+// La pantalla deja de contestar: se reintenta TFT_RETRIES veces y se abandona
+void test_gives_up_after_retries()
+{
+    FakeDisplay disp;
+    FakeSource src(SIZE);
+    disp.ackBudget = 1;
+    tCore core(disp, src, 921600, 921600);
+
+    TEST_ASSERT_FALSE(core.run());
+    tTFTreport rep = core.report();
+
+    TEST_ASSERT_EQUAL_INT(TFT_FAILED, rep.state);
+    TEST_ASSERT_EQUAL_STRING("no chunk ack", rep.error);
+    TEST_ASSERT_EQUAL_UINT32(TFT_RETRIES + 1, rep.retries);
+    TEST_ASSERT_EQUAL_INT(TFT_RETRIES + 1, disp.connectBauds.size());
+    TEST_ASSERT_EQUAL_UINT32(TFT_CHUNK, rep.sent);
+}
+
+// La pantalla no está a la velocidad del enlace: se buscan las de HMI_LINK_BAUDS
+// y la subida va a la velocidad pedida
+void test_connect_searches_bauds()
+{
+    FakeDisplay disp;
+    FakeSource src(SIZE);
+    disp.displayBaud = 115200;
+    tCore core(disp, src, 921600, 512000);
+
+    TEST_ASSERT_TRUE(core.run());
+
+    TEST_ASSERT_EQUAL_INT(1, disp.connectBauds.size());
+    TEST_ASSERT_EQUAL_UINT32(115200, disp.connectBauds[0]);
+    TEST_ASSERT_EQUAL_UINT32(512000, disp.displayBaud);
+    TEST_ASSERT_EQUAL_MEMORY(src.data.data(), disp.flash.data(), SIZE);
+}
+
+// Si la SD falla al verificar no se toca la pantalla
+void test_verify_read_error()
+{
+    FakeDisplay disp;
+    FakeSource src(SIZE);
+    src.failReadAt = 2 * TFT_CHUNK;
+    tCore core(disp, src, 921600, 921600);
+
+    TEST_ASSERT_FALSE(core.run());
+    tTFTreport rep = core.report();
+
+    TEST_ASSERT_EQUAL_STRING("read error", rep.error);
+    TEST_ASSERT_EQUAL_INT(0, disp.commands.size());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fresh_upload);
+    RUN_TEST(test_resume_from_previous_upload);
+    RUN_TEST(test_retry_after_lost_ack);
+    RUN_TEST(test_gives_up_after_retries);
+    RUN_TEST(test_connect_searches_bauds);
+    RUN_TEST(test_verify_read_error);
+    return UNITY_END();
+}
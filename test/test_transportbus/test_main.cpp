@@ -0,0 +1,270 @@
+// TransportBus (TransportBus.h) con un reproductor simulado en otra tarea: órdenes enviadas
+// desde un segundo hilo, latencia post() --> ack() y entrega del testigo de cancelación.
+
+#include <unity.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#include "TransportBus.h"
+
+// Duración de un buffer de audio simulado. El testigo se mira una vez por buffer.
+static const uint32_t BUFFER_US = 2000;
+// Margen para el planificador del host. Solo se aplica al peor caso; el percentil 90 tiene
+// que quedar dentro de un buffer.
+static const uint32_t SLACK_US = 8000;
+
+static uint32_t nowUs()
+{
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Lo mínimo de tapeControl: reproduciendo genera buffers y mira el testigo entre uno y otro;
+// parado espera órdenes en la cola
+struct Player
+{
+    std::atomic<bool> run{true};
+    std::atomic<bool> playing{false};
+    std::atomic<int> volume{0};
+    std::atomic<uint32_t> buffers{0};
+
+    std::mutex mtx;
+    std::vector<tTransportMsg> applied;
+    // Tiempo desde post() hasta que el generador vio el testigo levantado
+    std::vector<uint32_t> cancelSeenUs;
+
+    void apply(const tTransportMsg &m)
+    {
+        switch (m.cmd)
+        {
+            case TCMD_PLAY:   playing = true; break;
+            case TCMD_STOP:
+            case TCMD_PAUSE:
+            case TCMD_EJECT:  playing = false; break;
+            case TCMD_VOLUME: volume = m.arg; break;
+        }
+        std::lock_guard<std::mutex> lk(mtx);
+        applied.push_back(m);
+    }
+
+    void service()
+    {
+        tTransportMsg m;
+        while (transport.poll(m))
+        {
+            apply(m);
+            transport.ack(m);
+        }
+    }
+
+    void loop()
+    {
+        while (run)
+        {
+            service();
+
+            if (!playing)
+            {
+                tTransportMsg m;
+                if (transport.wait(m, 5))
+                {
+                    apply(m);
+                    transport.ack(m);
+                }
+                continue;
+            }
+
+            // Un buffer de audio
+            std::this_thread::sleep_for(std::chrono::microseconds(BUFFER_US));
+            buffers++;
+
+            if (transport.cancelRequested() != TCMD_NONE)
+            {
+                tTransportMsg taken[TRANSPORT_QUEUE_SIZE];
+                int n = transport.takeCancels(taken, TRANSPORT_QUEUE_SIZE);
+                uint32_t t = nowUs();
+                for (int i = 0; i < n; i++)
+                {
+                    if (TransportBus::cancels(taken[i].cmd))
+                    {
+                        std::lock_guard<std::mutex> lk(mtx);
+                        cancelSeenUs.push_back(t - taken[i].tPostUs);
+                    }
+                    apply(taken[i]);
+                }
+                for (int i = 0; i < n; i++)
+                {
+                    transport.ack(taken[i]);
+                }
+            }
+        }
+    }
+};
+
+static void drain()
+{
+    tTransportMsg m;
+    while (transport.poll(m))
+    {
+        transport.ack(m);
+    }
+}
+
+void setUp()
+{
+    drain();
+    transport.resetStats();
+}
+
+void tearDown() {}
+
+// Órdenes desde otro hilo, esperando cada confirmación: llegan todas, en orden, y cada una
+// se aplica en lo que tarda la tarea en despertar
+void test_commands_from_second_thread()
+{
+    Player player;
+    std::thread task([&]() { player.loop(); });
+
+    std::atomic<int> timeouts{0};
+    std::thread hmi([&]()
+    {
+        for (int v = 1; v <= 50; v++)
+        {
+            uint32_t seq = transport.post(TCMD_VOLUME, v);
+            if (!transport.waitAck(seq, 100) || !transport.acked(seq))
+            {
+                timeouts++;
+            }
+        }
+    });
+
+    hmi.join();
+    player.run = false;
+    task.join();
+
+    TEST_ASSERT_EQUAL_INT(0, timeouts.load());
+    TEST_ASSERT_EQUAL_INT(50, player.volume.load());
+    TEST_ASSERT_EQUAL_INT(50, player.applied.size());
+    for (int i = 0; i < 50; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(i + 1, player.applied[i].arg);
+    }
+
+    tTransportStats st = transport.getStats();
+    TEST_ASSERT_EQUAL_UINT32(50, st.posted);
+    TEST_ASSERT_EQUAL_UINT32(50, st.acked);
+    TEST_ASSERT_EQUAL_UINT32(0, st.overflows);
+    // Parado, la tarea espera en la cola: no hay sondeo que sumar
+    TEST_ASSERT_TRUE(st.maxAckUs <= SLACK_US);
+    TEST_ASSERT_TRUE(st.totalAckUs / st.acked <= BUFFER_US);
+}
+
+// Reproduciendo, STOP y PAUSE llegan al generador en el siguiente buffer: el testigo se ve
+// como mucho un buffer después del post() (más el margen del planificador)
+void test_cancel_token_within_one_buffer()
+{
+    Player player;
+    std::thread task([&]() { player.loop(); });
+
+    // Los asserts no pueden ir en otro hilo: se cuentan los fallos
+    std::atomic<int> failures{0};
+    std::thread hmi([&]()
+    {
+        for (int i = 0; i < 40; i++)
+        {
+            uint32_t seq = transport.post(TCMD_PLAY);
+            if (!transport.waitAck(seq, 100))
+            {
+                failures++;
+            }
+
+            // Deja generar unos buffers y corta en un momento cualquiera de uno
+            std::this_thread::sleep_for(std::chrono::microseconds(3 * BUFFER_US + (i * 137) % BUFFER_US));
+            seq = transport.post((i & 1) ? TCMD_PAUSE : TCMD_STOP);
+            if (!transport.waitAck(seq, 100) || transport.cancelRequested() != TCMD_NONE)
+            {
+                failures++;
+            }
+        }
+    });
+
+    hmi.join();
+    player.run = false;
+    task.join();
+
+    TEST_ASSERT_EQUAL_INT(0, failures.load());
+    TEST_ASSERT_FALSE(player.playing.load());
+    TEST_ASSERT_TRUE(player.buffers.load() >= 40 * 3);
+    TEST_ASSERT_EQUAL_INT(40, player.cancelSeenUs.size());
+
+    std::vector<uint32_t> seen = player.cancelSeenUs;
+    std::sort(seen.begin(), seen.end());
+    TEST_ASSERT_TRUE(seen[seen.size() * 9 / 10] <= BUFFER_US + BUFFER_US / 2);
+    TEST_ASSERT_TRUE(seen.back() <= BUFFER_US + SLACK_US);
+    TEST_ASSERT_TRUE(transport.getStats().maxAckUs <= BUFFER_US + SLACK_US);
+}
+
+// Un STOP deja sin efecto el PLAY y el FFWD anteriores. Lo que llega detrás se queda en la
+// cola para transportService(), y el testigo se baja al confirmar
+void test_take_cancels_supersedes_play()
+{
+    uint32_t play = transport.post(TCMD_PLAY);
+    transport.post(TCMD_FFWD);
+    uint32_t stop = transport.post(TCMD_STOP);
+    uint32_t vol = transport.post(TCMD_VOLUME, 30);
+
+    TEST_ASSERT_EQUAL_INT(TCMD_STOP, transport.cancelRequested());
+
+    tTransportMsg taken[TRANSPORT_QUEUE_SIZE];
+    int n = transport.takeCancels(taken, TRANSPORT_QUEUE_SIZE);
+    TEST_ASSERT_EQUAL_INT(3, n);
+    TEST_ASSERT_EQUAL_INT(TCMD_PLAY, taken[0].cmd);
+    TEST_ASSERT_EQUAL_INT(TCMD_FFWD, taken[1].cmd);
+    TEST_ASSERT_EQUAL_INT(TCMD_STOP, taken[2].cmd);
+
+    for (int i = 0; i < n; i++)
+    {
+        transport.ack(taken[i]);
+    }
+
+    TEST_ASSERT_TRUE(transport.acked(play));
+    TEST_ASSERT_TRUE(transport.acked(stop));
+    TEST_ASSERT_FALSE(transport.acked(vol));
+    TEST_ASSERT_EQUAL_INT(TCMD_NONE, transport.cancelRequested());
+
+    tTransportMsg m;
+    TEST_ASSERT_TRUE(transport.poll(m));
+    TEST_ASSERT_EQUAL_INT(TCMD_VOLUME, m.cmd);
+    TEST_ASSERT_EQUAL_INT(30, m.arg);
+    transport.ack(m);
+    TEST_ASSERT_TRUE(transport.acked(vol));
+}
+
+// Con la cola llena se pierde la más antigua
+void test_overflow_drops_oldest()
+{
+    for (int i = 0; i < TRANSPORT_QUEUE_SIZE + 3; i++)
+    {
+        transport.post(TCMD_VOLUME, i);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(3, transport.getStats().overflows);
+
+    tTransportMsg m;
+    TEST_ASSERT_TRUE(transport.poll(m));
+    TEST_ASSERT_EQUAL_INT(3, m.arg);
+    transport.ack(m);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_commands_from_second_thread);
+    RUN_TEST(test_cancel_token_within_one_buffer);
+    RUN_TEST(test_take_cancels_supersedes_play);
+    RUN_TEST(test_overflow_drops_oldest);
+    return UNITY_END();
+}
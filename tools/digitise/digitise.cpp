@@ -0,0 +1,289 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    Nombre: digitise.cpp
+
+    Creado por:
+      Copyright (c) Antonio Tamairón. 2023  / https://github.com/hash6iron/powadcr
+      @hash6iron / https://powagames.itch.io/
+
+    Descripción:
+    Conversión de WAV a TAP o TZX en el PC, con el mismo decodificador (TapeDigitiser.h) que
+    usa el powaDCR para los WAV de la SD. Sirve para convertir cintas sin la placa y para
+    probar el decodificador con grabaciones reales.
+
+        g++ -std=gnu++17 -O2 -Isrc tools/digitise/digitise.cpp -o digitise
+
+        digitise [-tap] [-c canal] [-t umbral%] [-f] entrada.wav [salida]
+
+    Sin salida se escribe junto al WAV con extensión .tzx (o .tap con -tap). El informe por
+    bloque y el resumen son los mismos que deja DigitiseQueue en _digitise.txt.
+
+    Devuelve 0 si se ha escrito algún bloque, 1 si hay un error y 2 si no se encuentra
+    ningún bloque.
+
+    Version: 0.1
+
+    Historico de versiones
+    v.0.1 - Version inicial
+
+    Derechos de autor y distribución
+    --------------------------------
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+    To Contact the dev team you can write to hash6iron@gmail.com
+
+ +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
+
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+
+#include "TapeDigitiser.h"
+
+// Lectura del WAV (múltiplo de 4)
+#define DIGITISE_WINDOW 65536
+// Hasta aquí se buscan los bloques "fmt " y "data"
+#define DIGITISE_HEADER_MAX 4096
+
+class FileAudioOut : public AudioByteOut
+{
+    private:
+
+        FILE* _f;
+
+    public:
+
+        FileAudioOut(FILE* f) : _f(f)
+        {
+        }
+
+        bool put(const uint8_t* data, size_t len) override
+        {
+            return fwrite(data, 1, len, _f) == len;
+        }
+
+        bool patch(uint32_t offset, const uint8_t* data, size_t len) override
+        {
+            long pos = ftell(_f);
+            bool ok = pos >= 0 && fseek(_f, offset, SEEK_SET) == 0 && fwrite(data, 1, len, _f) == len;
+            return fseek(_f, pos, SEEK_SET) == 0 && ok;
+        }
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: digitise [-tap] [-c channel] [-t threshold%%] [-f] input.wav [output]\n"
+                    "  -tap  write a TAP instead of a TZX (turbo and partial blocks are skipped)\n"
+                    "  -c    0 = left or mono (default), 1 = right\n"
+                    "  -t    Schmitt trigger threshold, 1-99 %% of full scale (default 10)\n"
+                    "  -f    overwrite the output if it exists\n");
+}
+
+static bool exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static void block(DigitiseWriter &w, TapeDigitiser &dec, tDigitiseResult &res)
+{
+    const tDigitBlock &b = dec.block();
+    bool written = w.add(b, dec.data());
+
+    res.blocks++;
+    res.written += written ? 1 : 0;
+    res.skipped += written ? 0 : 1;
+    res.badChecksum += b.checksumOk ? 0 : 1;
+    res.partial += b.usedBits != 8 ? 1 : 0;
+
+    char line[200];
+    if (digitiseBlockLine(line, sizeof(line), b, dec.data(), written) > 0)
+    {
+        fputs(line, stdout);
+    }
+}
+
+static int report(const std::string &path, const char* status, const tDigitiseResult &res, int code)
+{
+    char line[300];
+    if (digitiseFileLine(line, sizeof(line), path.c_str(), status, res) > 0)
+    {
+        fputs(line, code == 1 ? stderr : stdout);
+    }
+    return code;
+}
+
+int main(int argc, char** argv)
+{
+    bool tzx = true;
+    bool overwrite = false;
+    int channel = 0;
+    int threshold = 0;
+    std::string in;
+    std::string out;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+
+        if (a == "-tap")
+        {
+            tzx = false;
+        }
+        else if (a == "-f")
+        {
+            overwrite = true;
+        }
+        else if ((a == "-c" || a == "-t") && i + 1 < argc)
+        {
+            int v = atoi(argv[++i]);
+            if (a == "-c" && (v == 0 || v == 1))
+            {
+                channel = v;
+            }
+            else if (a == "-t" && v >= 1 && v <= 99)
+            {
+                threshold = v;
+            }
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if (a.size() > 1 && a[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else if (in.empty())
+        {
+            in = a;
+        }
+        else if (out.empty())
+        {
+            out = a;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (in.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    if (out.empty())
+    {
+        size_t dot = in.find_last_of('.');
+        size_t slash = in.find_last_of('/');
+        out = (dot != std::string::npos && (slash == std::string::npos || dot > slash) ? in.substr(0, dot) : in)
+              + (tzx ? ".tzx" : ".tap");
+    }
+
+    tDigitiseResult res;
+    tWavInfo info;
+
+    FILE* fin = fopen(in.c_str(), "rb");
+    if (fin == nullptr)
+    {
+        return report(in, "cannot open", res, 1);
+    }
+
+    std::vector<uint8_t> buf(DIGITISE_WINDOW);
+    fseek(fin, 0, SEEK_END);
+    long fileSize = ftell(fin);
+    fseek(fin, 0, SEEK_SET);
+    size_t n = fread(buf.data(), 1, DIGITISE_HEADER_MAX, fin);
+
+    if (fileSize <= 0 || !wavParseHeader(buf.data(), n, (uint32_t)fileSize, info))
+    {
+        fclose(fin);
+        return report(in, "not a PCM WAV", res, 1);
+    }
+    if (!overwrite && exists(out))
+    {
+        fclose(fin);
+        return report(in, "skipped, output exists", res, 1);
+    }
+
+    FILE* fout = fopen(out.c_str(), "w+b");
+    if (fout == nullptr || fseek(fin, info.dataOffset, SEEK_SET) != 0)
+    {
+        if (fout != nullptr)
+        {
+            fclose(fout);
+        }
+        fclose(fin);
+        return report(in, "cannot create output", res, 1);
+    }
+
+    // Mismos umbrales que el grabador con EN_SCHMITT_CHANGE
+    int thHigh = threshold > 0 ? (threshold * 32767) / 100 : REC_TH_HIGH;
+    int thLow = threshold > 0 ? -(threshold * 32768) / 100 : REC_TH_LOW;
+
+    FileAudioOut file(fout);
+    DigitiseWriter w(file, tzx);
+    TapeDigitiser dec(info.rate, thHigh, thLow);
+
+    printf("%s -> %s, %u Hz %u bit %s\n", in.c_str(), out.c_str(), (unsigned)info.rate, info.bits,
+           info.channels == 2 ? "stereo" : "mono");
+
+    bool ok = w.begin();
+    uint32_t frame = info.frameSize();
+    uint32_t window = DIGITISE_WINDOW - DIGITISE_WINDOW % frame;
+    uint32_t left = info.dataSize - info.dataSize % frame;
+
+    while (ok && left > 0)
+    {
+        uint32_t len = left < window ? left : window;
+        n = fread(buf.data(), 1, len, fin);
+        if (n < frame)
+        {
+            break;
+        }
+        n -= n % frame;
+        left -= n;
+
+        for (size_t i = 0; i < n; i += frame)
+        {
+            if (dec.push(wavSample(buf.data() + i, info, channel)))
+            {
+                block(w, dec, res);
+            }
+        }
+    }
+
+    if (ok && dec.flush())
+    {
+        block(w, dec, res);
+    }
+
+    ok = w.finish(dec.trailingMs()) && ok;
+    ok = fclose(fout) == 0 && ok;
+    fclose(fin);
+    res.lost = dec.lost();
+    res.audioMs = dec.positionMs();
+
+    if (!ok || w.written() == 0)
+    {
+        remove(out.c_str());
+        return report(in, ok ? "no blocks found" : "write error", res, ok ? 2 : 1);
+    }
+
+    return report(in, "done", res, 0);
+}